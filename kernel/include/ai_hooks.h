@@ -59,6 +59,7 @@ typedef enum {
     AI_EVENT_SYSCALL,
     AI_EVENT_SECURITY_CHECK,
     AI_EVENT_POWER_STATE,
+    AI_EVENT_DECISION_MISS,     // No model answered; a sample for retraining
     AI_EVENT_COUNT
 } ai_event_type_t;
 
@@ -98,6 +99,8 @@ typedef struct ai_hook_stats {
     uint64_t decisions_cached;  // Cache hits
     uint64_t decisions_ai;      // AI-generated decisions
     uint64_t decisions_fallback; // Fallback to default
+    uint64_t decisions_model;   // Answered by a compiled model
+    uint32_t model_version;     // Installed model, 0 if none
     uint64_t total_latency_ns;  // Total decision latency
     uint64_t max_latency_ns;    // Maximum latency
 } ai_hook_stats_t;
@@ -122,8 +125,15 @@ ai_config_t* ai_hooks_get_config(void);
 /* Get AI hook statistics */
 ai_hook_stats_t* ai_hooks_get_stats(ai_hook_type_t hook_type);
 
-/* Register userspace AI service */
-status_t ai_hooks_register_service(ipc_endpoint_t endpoint);
+/*
+ * Register userspace AI service. Kernel replies and events go to endpoint;
+ * *out_control receives the endpoint the service sends model control
+ * requests to (see ai_control_msg_t).
+ */
+status_t ai_hooks_register_service(ipc_endpoint_t endpoint, ipc_endpoint_t* out_control);
+
+/* Serve pending control requests; called from the idle loop */
+void ai_hooks_poll(void);
 
 /* Telemetry API */
 
@@ -165,26 +175,149 @@ status_t ai_cache_decision(ai_hook_type_t hook_type, uint32_t context_id,
 
 status_t ai_invalidate_cache(ai_hook_type_t hook_type);
 
-/* Convenience Wrappers for Common Operations */
+/*
+ * Compiled decision models
+ *
+ * The userspace AI service trains off the hot path and pushes a compact
+ * model per hook: a decision tree, a fixed-point linear model or a lookup
+ * table. The kernel verifies it, keeps a private copy and evaluates it
+ * inline in a bounded number of steps. Replacing a model publishes the new
+ * pointer and waits out readers of the old one (RCU style) before it is
+ * freed, so evaluation takes no lock. Requests no model answers are
+ * logged as AI_EVENT_DECISION_MISS for retraining.
+ */
+#define AI_MODEL_MAGIC          0x4c444d41u  /* "AMDL" */
+#define AI_MODEL_INPUTS         8            /* Features: a request's input_data[] */
+#define AI_MODEL_MAX_NODES      256
+#define AI_MODEL_MAX_DEPTH      16
+#define AI_MODEL_MAX_ENTRIES    4096
+#define AI_MODEL_LEAF           0xFF
+
+typedef enum {
+    AI_MODEL_TREE,              // Binary decision tree over input thresholds
+    AI_MODEL_LINEAR,            // Fixed-point weighted sum, clamped
+    AI_MODEL_TABLE,             // Lookup on one or two scaled inputs
+    AI_MODEL_KIND_COUNT
+} ai_model_kind_t;
+
+/* Model blob: header, then the kind's payload */
+typedef struct ai_model_header {
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t count;             // Tree nodes or table entries, 0 for linear
+    uint32_t version;           // Assigned by the service
+    uint32_t confidence;        // Linear and table outputs (0-100)
+} ai_model_header_t;
+
+/* Children always follow their parent, so a tree cannot loop */
+typedef struct ai_model_node {
+    uint8_t feature;            // Input compared, or AI_MODEL_LEAF
+    uint8_t confidence;         // Leaf confidence (0-100)
+    uint16_t left;              // Taken when input <= value
+    uint16_t right;
+    uint16_t reserved;
+    int64_t value;              // Threshold, or the leaf's output
+} ai_model_node_t;
+
+/* Output = clamp((bias + sum(weights[i] * input[i])) >> shift, min, max) */
+typedef struct ai_model_linear {
+    int16_t weights[AI_MODEL_INPUTS];   // Inputs saturate to 32 bits first
+    int64_t bias;
+    int64_t min;
+    int64_t max;
+    uint32_t shift;
+    uint32_t reserved;
+} ai_model_linear_t;
+
+/* Followed by rows * cols int32_t entries, row major */
+typedef struct ai_model_table {
+    uint8_t feature[2];         // Row and column inputs
+    uint8_t shift[2];           // Inputs are shifted down, then clamped to the table
+    uint16_t rows;
+    uint16_t cols;              // 1 for a one-input table
+} ai_model_table_t;
+
+typedef struct ai_model_result {
+    int64_t value;
+    uint32_t confidence;
+    uint32_t version;
+} ai_model_result_t;
+
+typedef struct ai_model ai_model_t;
+
+/* Bit per hook with a model installed, for the inline fast path */
+extern uint32_t g_ai_model_mask;
+
+/* Verify a blob and build a private copy */
+status_t ai_model_compile(const void* blob, size_t size, ai_model_t** out);
+void ai_model_free(ai_model_t* model);
+
+/* Publish model (NULL removes) and return the old one once no reader holds it */
+ai_model_t* ai_model_swap(ai_hook_type_t hook_type, ai_model_t* model);
+
+/* Compile, swap in and free the old model; the service's entry point */
+status_t ai_model_install(ai_hook_type_t hook_type, const void* blob, size_t size);
+status_t ai_model_remove(ai_hook_type_t hook_type);
+
+/* Largest blob: a table model of AI_MODEL_MAX_ENTRIES entries */
+#define AI_MODEL_MAX_BLOB       (sizeof(ai_model_header_t) + sizeof(ai_model_table_t) + \
+                                 AI_MODEL_MAX_ENTRIES * sizeof(int32_t))
 
-/* Scheduler: Should we preempt this thread? */
-static inline bool ai_should_preempt(tid_t current_tid, tid_t candidate_tid) {
+/*
+ * Control channel. A blob does not fit in one IPC message, so the service
+ * stages it with BEGIN and in-order DATA chunks, then COMMIT compiles and
+ * installs it. Every request is answered with an ai_control_reply_t on the
+ * service's endpoint.
+ */
+#define AI_CONTROL_CHUNK        96
+#define AI_CONTROL_BATCH        16           /* Requests served per poll */
+
+typedef enum {
+    AI_CONTROL_MODEL_BEGIN,     // hook, size
+    AI_CONTROL_MODEL_DATA,      // offset, len, data
+    AI_CONTROL_MODEL_COMMIT,    // Install the staged blob on its hook
+    AI_CONTROL_MODEL_REMOVE,    // hook
+    AI_CONTROL_SCHED_BENCH,     // offset = CPU threads, len = I/O threads; staged blob or built-in tree
+} ai_control_op_t;
+
+typedef struct ai_control_msg {
+    uint16_t op;
+    uint16_t hook;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t len;
+    uint8_t data[AI_CONTROL_CHUNK];
+} ai_control_msg_t;
+
+typedef struct ai_control_reply {
+    int32_t status;
+    uint32_t reserved;
+    sched_ai_bench_result_t bench;          // AI_CONTROL_SCHED_BENCH only
+} ai_control_reply_t;
+
+/* Evaluate the installed model; false if there is none */
+bool ai_model_eval(ai_hook_type_t hook_type, const int64_t input[AI_MODEL_INPUTS],
+                   ai_model_result_t* result);
+
+static inline bool ai_model_present(ai_hook_type_t hook_type) {
     extern bool g_ai_decision_enabled;
-    if (!g_ai_decision_enabled) return false; // Use default scheduler logic
+    return g_ai_decision_enabled && (g_ai_model_mask & (1u << hook_type));
+}
+
+/* Convenience Wrappers for Common Operations */
+
+/* Scheduler: Should we preempt this thread? ran_ns is its slice so far, lag_ns its vruntime lead */
+static inline bool ai_should_preempt(tid_t current_tid, tid_t candidate_tid,
+                                     uint64_t ran_ns, int64_t lag_ns) {
+    if (!ai_model_present(AI_HOOK_SCHEDULER)) return false; // Use default scheduler logic
     
-    ai_decision_request_t req = {
-        .hook_type = AI_HOOK_SCHEDULER,
-        .context_id = current_tid,
-        .input_data = {current_tid, candidate_tid, 0, 0, 0, 0, 0, 0},
-        .urgency = 50,
-        .use_cache = true
+    int64_t input[AI_MODEL_INPUTS] = {
+        (int64_t)current_tid, (int64_t)candidate_tid, (int64_t)ran_ns, lag_ns, 0, 0, 0, 0
     };
+    ai_model_result_t result;
     
-    ai_decision_response_t resp;
-    status_t status = ai_request_decision(&req, &resp, 1000000); // 1ms timeout
-    
-    if (SUCCESS(status) && resp.confidence > 70) {
-        return resp.output_data[0] != 0;
+    if (ai_model_eval(AI_HOOK_SCHEDULER, input, &result) && result.confidence > 70) {
+        return result.value != 0;
     }
     
     return false; // Fallback to default
@@ -192,28 +325,51 @@ static inline bool ai_should_preempt(tid_t current_tid, tid_t candidate_tid) {
 
 /* Memory: Should we swap this page? */
 static inline bool ai_should_swap_page(paddr_t page, uint32_t access_count) {
-    extern bool g_ai_decision_enabled;
-    if (!g_ai_decision_enabled) return false;
+    if (!ai_model_present(AI_HOOK_MEMORY)) return false; // Fallback to default LRU
     
-    // Implementation similar to ai_should_preempt
-    return false; // Fallback to default LRU
+    int64_t input[AI_MODEL_INPUTS] = {(int64_t)page, access_count, 0, 0, 0, 0, 0, 0};
+    ai_model_result_t result;
+    
+    if (ai_model_eval(AI_HOOK_MEMORY, input, &result) && result.confidence > 70) {
+        return result.value != 0;
+    }
+    
+    return false;
 }
 
-/* I/O: Predict next block to read-ahead */
-static inline uint64_t ai_predict_readahead(uint64_t current_block, uint32_t size) {
-    extern bool g_ai_decision_enabled;
-    if (!g_ai_decision_enabled) return current_block + size; // Sequential
-    
-    // AI can predict non-sequential patterns
-    return current_block + size;
+/* I/O: Predict next block to read-ahead; predicted is the read-ahead engine's guess */
+static inline uint64_t ai_predict_readahead(uint64_t current_block, uint32_t size,
+                                            uint64_t predicted) {
+    if (!ai_model_present(AI_HOOK_IO)) return predicted;
+
+    /* The model predicts a block offset, so non-sequential patterns fit */
+    int64_t input[AI_MODEL_INPUTS] = {(int64_t)current_block, size, (int64_t)predicted,
+                                      0, 0, 0, 0, 0};
+    ai_model_result_t result;
+
+    if (ai_model_eval(AI_HOOK_IO, input, &result) && result.confidence > 70) {
+        return current_block + (uint64_t)result.value;
+    }
+
+    return predicted;
 }
 
 /* Network: Prioritize this packet? */
 static inline uint32_t ai_get_packet_priority(void* packet, size_t size) {
-    extern bool g_ai_decision_enabled;
-    if (!g_ai_decision_enabled) return 0; // Default priority
+    if (!ai_model_present(AI_HOOK_NETWORK)) return 0; // Default priority
+    
+    /* Size and the first bytes of the frame; a table model keys on them directly */
+    const uint8_t* bytes = (const uint8_t*)packet;
+    int64_t input[AI_MODEL_INPUTS] = {(int64_t)size, 0, 0, 0, 0, 0, 0, 0};
+    for (size_t i = 0; i < 4 && i < size; i++) {
+        input[1 + i] = bytes[i];
+    }
+    ai_model_result_t result;
+    
+    if (ai_model_eval(AI_HOOK_NETWORK, input, &result) && result.confidence > 70 && result.value > 0) {
+        return (uint32_t)result.value;
+    }
     
-    // AI can analyze packet contents for QoS
     return 0;
 }
 
@@ -230,16 +386,22 @@ static inline bool ai_is_suspicious(pid_t pid, const char* operation) {
 
 /* Power Management: Should we enter low-power state? */
 static inline bool ai_should_power_save(uint32_t idle_time_ms) {
-    extern bool g_ai_decision_enabled;
-    if (!g_ai_decision_enabled) return idle_time_ms > 100;
+    if (!ai_model_present(AI_HOOK_POWER)) return idle_time_ms > 100;
+    
+    int64_t input[AI_MODEL_INPUTS] = {idle_time_ms, 0, 0, 0, 0, 0, 0, 0};
+    ai_model_result_t result;
+    
+    if (ai_model_eval(AI_HOOK_POWER, input, &result) && result.confidence > 70) {
+        return result.value != 0;
+    }
     
-    // AI can predict workload patterns
     return idle_time_ms > 100;
 }
 
 /* Global AI state (defined in ai_hooks.c) */
 extern bool g_ai_telemetry_enabled;
 extern bool g_ai_decision_enabled;
+extern uint32_t g_ai_model_mask;
 
 /* Kernel Module Interface */
 
@@ -104,6 +104,44 @@ typedef struct e1000_tx_desc {
 /* TX Descriptor status bits */
 #define E1000_TXD_STAT_DD  BIT(0)  // Descriptor Done
 
+/* TCP/IP context descriptor: describes the headers of the TSO packet that follows */
+typedef struct e1000_tx_ctx_desc {
+    uint8_t ipcss;            // IP header start
+    uint8_t ipcso;            // IP checksum offset
+    uint16_t ipcse;           // IP header end (inclusive)
+    uint8_t tucss;            // TCP header start
+    uint8_t tucso;            // TCP checksum offset
+    uint16_t tucse;           // TCP checksum end, 0 = end of packet
+    uint32_t cmd_and_length;  // Payload length, DTYP and TUCMD
+    uint8_t status;
+    uint8_t hdr_len;          // Ethernet + IP + TCP header bytes
+    uint16_t mss;             // Payload bytes per segment
+} PACKED e1000_tx_ctx_desc_t;
+
+/* Extended data descriptor (DEXT set): one buffer of a TSO packet */
+typedef struct e1000_tx_data_desc {
+    uint64_t buffer_addr;
+    uint32_t cmd_and_length;  // Buffer length, DTYP and DCMD
+    uint8_t status;
+    uint8_t popts;
+    uint16_t special;
+} PACKED e1000_tx_data_desc_t;
+
+#define E1000_TXD_LENGTH_MASK  0x000FFFFF
+#define E1000_TXD_DTYP_D       0x00100000  // Data descriptor (context is DTYP 0)
+#define E1000_TXD_DCMD_EOP     0x01000000
+#define E1000_TXD_DCMD_IFCS    0x02000000  // Insert FCS
+#define E1000_TXD_DCMD_TSE     0x04000000  // TCP segmentation enable
+#define E1000_TXD_DCMD_RS      0x08000000
+#define E1000_TXD_DCMD_DEXT    0x20000000  // Extended descriptor
+#define E1000_TXD_TUCMD_TCP    0x01000000  // Context: TCP (not UDP)
+#define E1000_TXD_TUCMD_IP     0x02000000  // Context: IPv4 (not IPv6)
+#define E1000_TXD_POPTS_IXSM   0x01        // Insert IP checksum
+#define E1000_TXD_POPTS_TXSM   0x02        // Insert TCP checksum
+
+/* A TSO send may use one context and this many data descriptors */
+#define E1000_TSO_MAX_DESC     (1 + (NET_GSO_MAX_SIZE + 14 + PAGE_SIZE - 1) / PAGE_SIZE)
+
 /* e1000 device structure */
 typedef struct e1000_device {
     /* PCI information */
@@ -129,6 +167,14 @@ typedef struct e1000_device {
     paddr_t tx_descs_phys;
     uint8_t** tx_buffers;
     uint16_t tx_tail;
+    uint16_t tx_clean;       /* Oldest descriptor not yet reported complete */
+
+    /* Per-send bookkeeping, indexed by the send's first descriptor: a TSO
+     * send spans several descriptors and completes when its last one does */
+    paddr_t tx_phys[E1000_NUM_TX_DESC];     /* Buffer of each slot (context descriptors overwrite it) */
+    uint16_t tx_eop[E1000_NUM_TX_DESC];
+    uint16_t tx_segs[E1000_NUM_TX_DESC];
+    uint32_t tx_report[E1000_NUM_TX_DESC];  /* Bytes reported to BQL */
 
     /* Network interface */
     net_interface_t* iface;
@@ -148,6 +194,7 @@ e1000_device_t* e1000_get_device(uint8_t index);
 
 /* I/O operations */
 status_t e1000_send_packet(net_interface_t* iface, const void* data, size_t length);
+status_t e1000_send_tso(net_interface_t* iface, net_buffer_t* buf);
 void e1000_receive_packets(e1000_device_t* dev);
 
 /* Register access */
@@ -111,6 +111,68 @@ typedef _Bool bool;
 #define container_of(ptr, type, member) \
     ((type*)((char*)(ptr) - offsetof(type, member)))
 
+/* Intrusive doubly linked list (helpers live in microkernel.h) */
+struct list_head {
+    struct list_head* next;
+    struct list_head* prev;
+};
+
+/*
+ * Epoch-counted readers. Lock-free readers register in the current of two
+ * epochs on one of EPOCH_SLOTS counters, each on its own cache line, so
+ * readers running on different CPUs do not bounce a shared line.
+ * epoch_synchronize() waits until no reader can still hold a pointer that
+ * was replaced before the call: each epoch's counters are drained once
+ * after a flip, and a reader that registers after its counter was checked
+ * already sees the new pointer.
+ */
+#define EPOCH_SLOTS 32
+#define EPOCH_CACHE_LINE 64
+
+typedef struct epoch_slot {
+    uint32_t readers[2];
+} ALIGNED(EPOCH_CACHE_LINE) epoch_slot_t;
+
+typedef struct epoch {
+    epoch_slot_t slots[EPOCH_SLOTS];
+    uint32_t current ALIGNED(EPOCH_CACHE_LINE);
+} epoch_t;
+
+/*
+ * Counter for the calling reader, hashed from its stack page. Readers on
+ * different CPUs run on different stacks; two that share a slot are still
+ * counted correctly, only less cheaply. No CPU-number instruction is fast
+ * enough here: rdtscp waits for earlier instructions to retire.
+ */
+static inline uint32_t epoch_reader_slot(void) {
+    uint64_t page = (uint64_t)__builtin_frame_address(0) >> 12;
+    return (uint32_t)((page * 0x9E3779B97F4A7C15ULL) >> 59) % EPOCH_SLOTS;
+}
+
+/* Returns the token to hand back to epoch_read_unlock */
+static inline uint32_t epoch_read_lock(epoch_t* e) {
+    uint32_t slot = epoch_reader_slot();
+    uint32_t idx = __atomic_load_n(&e->current, __ATOMIC_SEQ_CST) & 1;
+    __atomic_add_fetch(&e->slots[slot].readers[idx], 1, __ATOMIC_SEQ_CST);
+    return slot << 1 | idx;
+}
+
+/* The token names the counter, so a reader that migrated still releases its own */
+static inline void epoch_read_unlock(epoch_t* e, uint32_t token) {
+    __atomic_sub_fetch(&e->slots[token >> 1].readers[token & 1], 1, __ATOMIC_RELEASE);
+}
+
+static inline void epoch_synchronize(epoch_t* e) {
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t idx = __atomic_fetch_add(&e->current, 1, __ATOMIC_SEQ_CST) & 1;
+        for (uint32_t slot = 0; slot < EPOCH_SLOTS; slot++) {
+            while (__atomic_load_n(&e->slots[slot].readers[idx], __ATOMIC_ACQUIRE) != 0) {
+                __asm__ volatile("pause");
+            }
+        }
+    }
+}
+
 /* Logging levels */
 typedef enum {
     LOG_DEBUG = 0,
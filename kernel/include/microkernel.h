@@ -14,15 +14,6 @@
  * - Deterministic latency: Real-time scheduling support
  */
 
-/* ============================================================================
- * List Data Structure (needed by process and other structures)
- * ============================================================================ */
-
-struct list_head {
-    struct list_head* next;
-    struct list_head* prev;
-};
-
 /* ============================================================================
  * Process Management
  * ============================================================================ */
@@ -91,6 +82,15 @@ status_t ipc_send(ipc_endpoint_t endpoint, ipc_message_t* msg, uint64_t timeout_
 status_t ipc_receive(ipc_endpoint_t endpoint, ipc_message_t* msg, uint64_t timeout_ns);
 status_t ipc_reply(ipc_endpoint_t endpoint, ipc_msg_id_t msg_id, const void* data, size_t size);
 
+/*
+ * A thread that sends with IPC_FLAG_SYNC is treated as blocked on the
+ * endpoint's server until the server replies. The server, the last thread
+ * to call ipc_receive() there, runs at the priority of the highest such
+ * caller, queued or being handled, so a low-priority server cannot hold
+ * up a high-priority client.
+ */
+#define IPC_MAX_CALLS 256              /* Synchronous requests in service at once */
+
 /* ============================================================================
  * Memory Management
  * ============================================================================ */
@@ -207,13 +207,166 @@ typedef struct sched_config {
     bool smp_enabled;
 } sched_config_t;
 
+/*
+ * PRIORITY_REALTIME threads run first-in first-out, round-robin among
+ * themselves every time_slice_ns, and always ahead of everything else.
+ * All lower priorities share the CPU in the fair class: each thread
+ * accumulates virtual runtime at a rate inversely proportional to its
+ * nice weight and the thread with the smallest vruntime runs next. Every
+ * runnable fair thread runs once per time_slice_ns (the latency target),
+ * stretched when more than 8 would get less than the minimum granularity
+ * of time_slice_ns / 8. Waking threads are placed at most half a latency
+ * period behind the queue, so sleepers get prompt but bounded credit.
+ */
+#define SCHED_NICE_MIN       -20
+#define SCHED_NICE_MAX       19
+#define SCHED_NICE_0_WEIGHT  1024
+
+/*
+ * Deadline threads sit above both: each has a (runtime, deadline, period)
+ * reservation and the one with the earliest absolute deadline runs. A
+ * constant bandwidth server throttles a thread that uses up its runtime
+ * until its next period, so it can never take more than runtime/period of
+ * the CPU, and admission refuses reservations that would push the total
+ * past SCHED_DL_BW_LIMIT_PERMILLE, leaving the rest to the other classes.
+ */
+#define SCHED_DL_MIN_RUNTIME_NS     1024
+#define SCHED_DL_BW_SHIFT           20
+#define SCHED_DL_BW_LIMIT_PERMILLE  950
+
 /* Scheduler syscalls */
 status_t sched_init(sched_config_t* config);
 void sched_schedule(void);
 thread_t* sched_get_current_thread(void);
+/* Reset scheduling state of a new thread; nice defaults from its priority */
+void sched_init_thread(thread_t* thread);
+status_t sched_set_nice(thread_t* thread, int nice);
+/* Reserve runtime every period, due deadline after each release (runtime 0 = leave the class);
+ * STATUS_BUSY if admission would overcommit the CPU */
+status_t sched_set_deadline(thread_t* thread, uint64_t runtime_ns, uint64_t deadline_ns, uint64_t period_ns);
 void sched_add_thread(thread_t* thread);
 void sched_remove_thread(thread_t* thread);
 void sched_yield(void);
+/* Timer tick: charge the running thread and preempt it once its slice is used */
+void sched_tick(void);
+
+/* Simulated mixed workload on a private run queue */
+typedef struct sched_bench_result {
+    uint64_t duration_ns;
+    uint32_t fairness_permille;        // Jain's index over the CPU-bound threads
+    uint32_t weighted_ratio_x100;      // CPU time nice 0 : nice 5 (ideal 305)
+    uint32_t low_share_permille;       // PRIORITY_LOW next to PRIORITY_HIGH (ideal 97)
+    uint64_t wakeup_avg_ns;            // IO thread wakeup to running
+    uint64_t wakeup_max_ns;
+    uint64_t io_bursts;                // IO bursts completed
+    uint64_t context_switches;
+} sched_bench_result_t;
+
+status_t sched_benchmark(uint32_t cpu_threads, uint32_t io_threads, sched_bench_result_t* result);
+
+/* The mixed workload without [0] and with [1] the AI scheduler hook; model NULL = built-in tree */
+typedef struct sched_ai_bench_result {
+    uint64_t schedules[2];
+    uint64_t context_switches[2];
+    uint64_t ns_per_schedule[2];       // Host time per schedule, simulation included
+    uint64_t decisions;                // Model evaluations on ticks
+    uint64_t ai_preemptions;           // Ticks the model preempted on
+    uint64_t ns_per_decision;          // Extra host time per evaluation
+} sched_ai_bench_result_t;
+
+status_t sched_ai_benchmark(uint32_t cpu_threads, uint32_t io_threads, const void* model,
+                            size_t model_size, sched_ai_bench_result_t* result);
+
+/* cyclictest-style: periodic audio thread against background load */
+typedef struct sched_dl_bench_result {
+    uint64_t activations;
+    uint64_t max_jitter_ns;            // Release to running, deadline class
+    uint64_t avg_jitter_ns;
+    uint64_t deadline_misses;          // Bursts finished after their deadline
+    uint64_t fair_max_jitter_ns;       // Same thread as PRIORITY_HIGH, for comparison
+    uint32_t hog_share_permille;       // Runaway deadline thread reserving 200
+    uint32_t background_share_permille;// Fair CPU hogs
+    uint32_t admitted;                 // 30% reservations accepted until refusal
+} sched_dl_bench_result_t;
+
+status_t sched_deadline_benchmark(uint32_t background_threads, sched_dl_bench_result_t* result);
+
+/*
+ * Priority inheritance. A thread holding something a higher-priority
+ * thread waits for runs with the waiter's class, deadline and weight
+ * until it lets go. A boosted deadline thread is never throttled; its
+ * reservation is postponed instead, so the waiter cannot be stalled by
+ * the holder's budget. Each boost that ends counts as one inversion.
+ */
+typedef struct sched_pi_stats {
+    uint64_t boosts;
+    uint64_t inversions;               // Boosts that have ended
+    uint64_t inversion_total_ns;       // Time spent boosted
+    uint64_t inversion_max_ns;
+} sched_pi_stats_t;
+
+/* Does a run ahead of b, counting inherited priority? */
+bool sched_prio_higher(const thread_t* a, const thread_t* b);
+/* Run thread as donor (NULL = its own parameters); ignored unless donor ranks higher */
+void sched_pi_boost(thread_t* thread, thread_t* donor);
+void sched_get_pi_stats(sched_pi_stats_t* stats);
+
+/*
+ * Wait queues. The condition a thread waits for is protected by a caller
+ * lock: the waiter checks it and calls wait_queue_sleep() with the lock
+ * held, which queues the thread before dropping the lock, and the waker
+ * changes the condition under the same lock before waking. That ordering
+ * means no wakeup is lost between the check and the sleep.
+ */
+typedef struct wait_queue {
+    struct list_head waiters;
+    uint32_t lock;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t* wq);
+/* Returns with *lock re-acquired; STATUS_BUSY if there is no thread to block */
+status_t wait_queue_sleep(wait_queue_t* wq, uint32_t* lock);
+void wait_queue_wake_one(wait_queue_t* wq);
+void wait_queue_wake_all(wait_queue_t* wq);
+
+/*
+ * Sleeping mutexes with priority inheritance. Waiters queue in priority
+ * order and the owner inherits the top waiter's priority, transitively
+ * along a chain of owners blocked on other mutexes. Unlock hands the
+ * mutex straight to the top waiter.
+ */
+typedef struct kmutex {
+    thread_t* owner;
+    struct list_head waiters;          // Highest priority first
+    struct list_head held_node;        // Owner's pi_held list
+} kmutex_t;
+
+#define KMUTEX_MAX_CHAIN   16          /* Owners boosted per lock attempt */
+
+void kmutex_init(kmutex_t* mutex);
+/* STATUS_BUSY if it would deadlock (including on the caller) or there is no thread to block */
+status_t kmutex_lock(kmutex_t* mutex);
+status_t kmutex_trylock(kmutex_t* mutex);
+/* STATUS_DENIED unless the caller owns it */
+status_t kmutex_unlock(kmutex_t* mutex);
+/* Set the synchronous IPC caller a server thread works for (NULL = none) and re-derive its priority */
+void kmutex_pi_donate(thread_t* server, thread_t* donor);
+/* Hand every mutex a dying thread owns to its top waiter and withdraw any wait it has pending */
+void kmutex_thread_exit(thread_t* thread);
+
+/*
+ * PI futexes. The word holds the owner's TID, or 0 when free, so user
+ * space takes and releases an uncontended lock with one compare-and-swap;
+ * FUTEX_WAITERS makes the owner come into the kernel to hand it over.
+ */
+#define FUTEX_WAITERS      0x80000000u
+#define FUTEX_TID_MASK     0x3FFFFFFFu
+#define FUTEX_PI_MAX       256         /* Contended futexes at once */
+#define FUTEX_PI_HASH      64
+
+/* STATUS_INVALID unless uaddr is an aligned, mapped, writable word of the caller */
+status_t futex_lock_pi(uint32_t* uaddr);
+status_t futex_unlock_pi(uint32_t* uaddr);
 
 /* ============================================================================
  * List Data Structure (functions)
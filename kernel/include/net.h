@@ -106,6 +106,8 @@ typedef struct tcp_header {
 #define TCP_FLAG_PSH 0x08
 #define TCP_FLAG_ACK 0x10
 #define TCP_FLAG_URG 0x20
+#define TCP_FLAG_ECE 0x40
+#define TCP_FLAG_CWR 0x80
 
 /* TCP states */
 typedef enum {
@@ -123,18 +125,90 @@ typedef enum {
 } tcp_state_t;
 
 /* Network buffer */
-#define NET_BUF_SIZE 2048
+#define NET_BUF_SIZE       2048
+#define NET_MTU            1500
+#define NET_HEADROOM       128      /* Room to push Ethernet, IP and TCP headers */
+#define NET_GSO_MAX_SIZE   65535    /* Largest IP packet a super-packet may carry */
 
+/* Super-packet types */
+#define NET_GSO_NONE       0
+#define NET_GSO_TCPV4      1
+#define NET_GSO_UDPV4      2
+
+/*
+ * Packet bytes live at data + offset; the space before offset is headroom
+ * for headers pushed by lower layers. A buffer with gso_size set is a
+ * super-packet: one set of headers followed by a payload that is sent as
+ * gso_size-byte segments.
+ */
 typedef struct net_buffer {
-    uint8_t data[NET_BUF_SIZE];
     size_t length;
     size_t offset;
+    size_t capacity;         /* Bytes available in data[] */
     struct list_head list_node;
+
+    /* Egress metadata, filled in when the frame enters the qdisc */
+    uint32_t flow_hash;
+    uint32_t pacing_rate;    /* Bytes per second, 0 = unpaced */
+    uint8_t priority;        /* NET_PRIO_* */
+    uint64_t enqueue_ns;
+
+    /* Segmentation offload */
+    uint16_t gso_size;       /* Payload bytes per segment, 0 = ordinary packet */
+    uint8_t gso_type;        /* NET_GSO_* */
+    uint32_t gso_sent;       /* Payload bytes already segmented out by a partial send */
+
+    uint8_t data[];
 } net_buffer_t;
 
+net_buffer_t* net_buffer_alloc(size_t capacity);
+void net_buffer_free(net_buffer_t* buf);
+
+static inline uint8_t* net_buffer_head(net_buffer_t* buf) {
+    return buf->data + buf->offset;
+}
+
+/* Prepend len bytes of header space and return its start */
+static inline uint8_t* net_buffer_push(net_buffer_t* buf, size_t len) {
+    buf->offset -= len;
+    buf->length += len;
+    return buf->data + buf->offset;
+}
+
+/* Transmit priorities (socket priority, DSCP or the AI hook map onto these) */
+#define NET_PRIO_BESTEFFORT        0
+#define NET_PRIO_FILLER            1
+#define NET_PRIO_BULK              2
+#define NET_PRIO_INTERACTIVE_BULK  4
+#define NET_PRIO_INTERACTIVE       6
+#define NET_PRIO_CONTROL           7
+#define NET_PRIO_MAX               7
+
 /* Network interface */
 #define NET_MAX_INTERFACES 8
 
+struct net_filter;
+struct qdisc;
+struct net_gro;
+
+/* Interface features */
+#define NET_F_TSO          BIT(0)   /* send_gso accepts TCPv4 super-packets */
+#define NET_F_GSO_ANY      BIT(1)   /* send_gso accepts every super-packet (loopback) */
+#define NET_F_GRO          BIT(2)   /* Driver calls net_gro_flush() after each RX poll */
+#define NET_F_NOARP        BIT(3)   /* No link-layer resolution */
+
+/* Byte queue limit on the driver TX ring (see qdisc.h) */
+typedef struct net_bql {
+    uint32_t limit;          /* Bytes the qdisc may hand to the ring */
+    uint32_t inflight;       /* Bytes handed over and not yet completed */
+    uint32_t min_limit;
+    uint32_t max_limit;
+    uint32_t slack;          /* Least inflight seen at completion this interval */
+    uint64_t slack_start_ns;
+    bool enabled;
+    bool limited;            /* The qdisc held packets back because of limit */
+} net_bql_t;
+
 typedef struct net_interface {
     uint8_t id;
     char name[16];
@@ -149,9 +223,27 @@ typedef struct net_interface {
     uint64_t tx_bytes;
     uint64_t rx_errors;
     uint64_t tx_errors;
+    uint64_t rx_filtered;
+    uint64_t tx_filtered;
+
+    /* Filter programs run on every frame (see netfilter.h) */
+    struct net_filter* rx_filter;
+    struct net_filter* tx_filter;
+
+    /* Egress queueing discipline; NULL hands frames straight to the driver */
+    struct qdisc* qdisc;
+    uint32_t qdisc_users;
+    net_bql_t bql;
 
-    /* Driver callbacks */
+    /* Offloads; super-packets the driver cannot take are segmented in software */
+    uint32_t features;
+    struct net_gro* gro;
+
+    /* Driver callbacks; send returns STATUS_BUSY when the TX ring is full and
+     * the optional tx_reclaim reports finished descriptors via net_tx_complete() */
     status_t (*send)(struct net_interface* iface, const void* data, size_t length);
+    status_t (*send_gso)(struct net_interface* iface, net_buffer_t* buf);
+    void (*tx_reclaim)(struct net_interface* iface);
     void* driver_data;
 
     uint32_t lock;
@@ -167,8 +259,59 @@ typedef struct arp_entry {
     bool valid;
 } arp_entry_t;
 
+/*
+ * IPv4 forwarding information base (kernel/src/net/route.c)
+ *
+ * Longest-prefix match runs over a DIR-16-8-8 table: a 64K-entry root
+ * indexed by the top 16 address bits, with 256-entry groups expanded on
+ * demand for /17-/24 and /25-/32. A lookup is at most three loads.
+ * Leaves point at shared next-hop groups; a group with several members is
+ * an ECMP set and members are picked by flow hash.
+ */
+#define FIB_ECMP_MAX       8
+#define FIB_MAX_ROUTES     (1u << 20)
+#define FIB_MAX_NHGROUPS   1024
+#define FIB_METRIC_CONNECTED 0
+#define FIB_METRIC_DEFAULT   100
+
+typedef struct fib_table fib_table_t;
+
+typedef struct fib_nexthop {
+    ipv4_addr_t gateway;    /* 0.0.0.0 = destination is on-link */
+    uint8_t iface_id;
+} fib_nexthop_t;
+
+/* Result of resolving a destination */
+typedef struct route_result {
+    net_interface_t* iface;
+    ipv4_addr_t next_hop;   /* Gateway, or the destination itself if on-link */
+    uint8_t prefix_len;
+} route_result_t;
+
+/* Per-socket cached route; valid while generation matches the FIB */
+typedef struct route_cache {
+    uint32_t generation;
+    ipv4_addr_t dst;
+    ipv4_addr_t next_hop;
+    mac_addr_t next_hop_mac;
+    uint8_t iface_id;
+    bool valid;
+} route_cache_t;
+
+/* FIB lookup benchmark result */
+typedef struct fib_bench_result {
+    uint32_t routes;
+    uint32_t lookups;
+    uint32_t groups;        /* 256-entry groups in use */
+    uint64_t table_bytes;
+    uint64_t insert_ns;
+    uint64_t lookup_ns;
+    uint64_t lookups_per_sec;
+} fib_bench_result_t;
+
 /* Socket */
 #define SOCKET_MAX 1024
+#define SOCKET_RX_QUEUE_MAX 64
 
 typedef enum {
     SOCKET_TYPE_RAW = 0,
@@ -193,6 +336,18 @@ typedef struct socket {
     struct list_head rx_queue;
     struct list_head tx_queue;
 
+    route_cache_t route_cache;
+
+    /* Socket filter, run on each datagram before it is queued */
+    struct net_filter* filter;
+    uint32_t rx_queued;
+    uint64_t rx_filtered;
+
+    /* Egress scheduling */
+    uint8_t priority;        /* NET_PRIO_*, 0 = classify by DSCP */
+    uint32_t pacing_rate;    /* Bytes per second for the fq qdisc, 0 = unpaced */
+    uint16_t gso_size;       /* UDP: send each write as datagrams of this size */
+
     bool bound;
     bool connected;
     uint32_t lock;
@@ -221,9 +376,41 @@ status_t net_register_interface(net_interface_t* iface);
 net_interface_t* net_get_interface(uint8_t id);
 status_t net_interface_up(net_interface_t* iface);
 status_t net_interface_down(net_interface_t* iface);
+status_t net_interface_configure(net_interface_t* iface, const ipv4_addr_t* ip,
+                                 const ipv4_addr_t* netmask, const ipv4_addr_t* gateway);
 
 /* Packet reception (called by drivers) */
 status_t net_receive_packet(net_interface_t* iface, const void* data, size_t length);
+status_t net_receive_gso(net_interface_t* iface, const void* data, size_t length,
+                         uint16_t gso_size);
+/* Protocol demux for a frame already counted and filtered (GRO output) */
+void net_process_frame(net_interface_t* iface, const void* data, size_t length,
+                       uint16_t gso_size);
+
+/* Loopback device (kernel/src/net/loopback.c) */
+status_t loopback_init(void);
+
+/* Segmentation offload (kernel/src/net/offload.c) */
+status_t net_dev_xmit(net_interface_t* iface, net_buffer_t* buf, uint32_t* out_packets,
+                      uint32_t* out_bytes);
+uint32_t net_gso_segments(const net_buffer_t* buf);
+bool net_gro_receive(net_interface_t* iface, const void* data, size_t length);
+void net_gro_flush(net_interface_t* iface);
+
+/* Offload benchmark result; costs are CPU cycles per payload byte x 1000 */
+typedef struct net_offload_bench_result {
+    uint64_t bytes;            /* Payload moved in each scenario */
+    uint64_t lo_udp_cpb;       /* UDP over lo, one datagram per write */
+    uint64_t lo_gso_cpb;       /* UDP over lo, 64 KB GSO writes */
+    uint64_t sw_gso_cpb;       /* TCP super-packets segmented in software */
+    uint64_t tso_cpb;          /* TCP super-packets handed to a TSO device whole */
+    uint64_t rx_cpb;           /* TCP receive, every segment through the stack */
+    uint64_t gro_cpb;          /* TCP receive with GRO */
+    uint64_t gro_merged;
+    uint32_t mismatches;       /* Bytes or segments that did not arrive as sent; must be 0 */
+} net_offload_bench_result_t;
+
+status_t net_offload_benchmark(uint32_t megabytes, net_offload_bench_result_t* result);
 
 /* Ethernet layer */
 status_t eth_send_packet(net_interface_t* iface, const mac_addr_t* dst_mac,
@@ -234,7 +421,30 @@ status_t arp_request(net_interface_t* iface, const ipv4_addr_t* target_ip);
 status_t arp_lookup(const ipv4_addr_t* ip, mac_addr_t* out_mac);
 status_t arp_add_entry(const ipv4_addr_t* ip, const mac_addr_t* mac);
 
-/* IP layer */
+/* Routing */
+status_t fib_init(void);
+fib_table_t* fib_table_create(void);
+void fib_table_destroy(fib_table_t* table);
+status_t fib_table_add(fib_table_t* table, uint32_t prefix, uint8_t prefix_len,
+                       const fib_nexthop_t* nh, uint16_t metric);
+status_t fib_table_delete(fib_table_t* table, uint32_t prefix, uint8_t prefix_len,
+                          const fib_nexthop_t* nh);
+status_t fib_table_lookup(fib_table_t* table, uint32_t dst, uint32_t flow_hash,
+                          fib_nexthop_t* out_nh, uint8_t* out_prefix_len);
+status_t fib_benchmark(uint32_t route_count, uint32_t lookups, fib_bench_result_t* result);
+
+status_t route_add(const ipv4_addr_t* prefix, uint8_t prefix_len, const ipv4_addr_t* gateway,
+                   uint8_t iface_id, uint16_t metric);
+status_t route_delete(const ipv4_addr_t* prefix, uint8_t prefix_len, const ipv4_addr_t* gateway,
+                      uint8_t iface_id);
+status_t route_delete_iface(uint8_t iface_id);
+status_t route_lookup(const ipv4_addr_t* dst, uint32_t flow_hash, route_result_t* out);
+uint32_t route_generation(void);
+void route_invalidate(void);
+uint32_t route_flow_hash(const ipv4_addr_t* src, const ipv4_addr_t* dst, uint8_t protocol,
+                         uint16_t src_port, uint16_t dst_port);
+
+/* IP layer (iface may be NULL to let the FIB choose) */
 status_t ip_send_packet(net_interface_t* iface, const ipv4_addr_t* dst_ip,
                         uint8_t protocol, const void* payload, size_t length);
 uint16_t ip_checksum(const void* data, size_t length);
@@ -261,6 +471,9 @@ status_t net_socket_create(socket_type_t type, uint8_t protocol, socket_t** out_
 status_t net_socket_bind(socket_t* sock, const ipv4_addr_t* ip, uint16_t port);
 status_t net_socket_connect(socket_t* sock, const ipv4_addr_t* ip, uint16_t port);
 status_t net_socket_close(socket_t* sock);
+status_t net_socket_set_priority(socket_t* sock, uint8_t priority);
+status_t net_socket_set_pacing_rate(socket_t* sock, uint32_t bytes_per_sec);
+status_t net_socket_set_gso_size(socket_t* sock, uint16_t gso_size);
 
 /* Utility functions */
 bool mac_addr_equals(const mac_addr_t* a, const mac_addr_t* b);
@@ -0,0 +1,203 @@
+#ifndef LIMITLESS_NETFILTER_H
+#define LIMITLESS_NETFILTER_H
+
+/*
+ * Packet Filtering
+ * BPF-style filter programs, compiled firewall rulesets and connection tracking
+ */
+
+#include "kernel.h"
+#include "net.h"
+
+/* ============================================================================
+ * Filter programs (kernel/src/net/filter.c)
+ *
+ * Programs use the classic BPF instruction set: an accumulator A, an index
+ * register X and 16 scratch words. The verifier only admits forward jumps
+ * and requires every path to end in RET, so a program always terminates
+ * after at most len instructions. Packet loads are bounds checked at run
+ * time; an out-of-range load ends the program with 0.
+ *
+ * The return value is the verdict: 0 drops the packet, anything else
+ * accepts it (socket filters truncate the datagram to that many bytes).
+ * ============================================================================ */
+
+typedef struct nf_insn {
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+} nf_insn_t;
+
+/* Instruction classes */
+#define NF_LD     0x00
+#define NF_LDX    0x01
+#define NF_ST     0x02
+#define NF_STX    0x03
+#define NF_ALU    0x04
+#define NF_JMP    0x05
+#define NF_RET    0x06
+#define NF_MISC   0x07
+#define NF_CLASS(code) ((code) & 0x07)
+
+/* Load size */
+#define NF_W      0x00
+#define NF_H      0x08
+#define NF_B      0x10
+#define NF_SIZE(code) ((code) & 0x18)
+
+/* Load mode */
+#define NF_IMM    0x00
+#define NF_ABS    0x20
+#define NF_IND    0x40
+#define NF_MEM    0x60
+#define NF_LEN    0x80
+#define NF_MSH    0xA0
+#define NF_MODE(code) ((code) & 0xE0)
+
+/* ALU and jump operations */
+#define NF_ADD    0x00
+#define NF_SUB    0x10
+#define NF_MUL    0x20
+#define NF_DIV    0x30
+#define NF_OR     0x40
+#define NF_AND    0x50
+#define NF_LSH    0x60
+#define NF_RSH    0x70
+#define NF_NEG    0x80
+#define NF_MOD    0x90
+#define NF_XOR    0xA0
+
+#define NF_JA     0x00
+#define NF_JEQ    0x10
+#define NF_JGT    0x20
+#define NF_JGE    0x30
+#define NF_JSET   0x40
+#define NF_OP(code) ((code) & 0xF0)
+
+/* Operand source */
+#define NF_K      0x00
+#define NF_X      0x08
+#define NF_SRC(code) ((code) & 0x08)
+
+/* RET operand and MISC operations */
+#define NF_A      0x10
+#define NF_RVAL(code) ((code) & 0x18)
+#define NF_TAX    0x00
+#define NF_TXA    0x80
+#define NF_MISCOP(code) ((code) & 0xF8)
+
+#define NF_STMT(code, k)          ((nf_insn_t){ (uint16_t)(code), 0, 0, (uint32_t)(k) })
+#define NF_JUMP(code, k, jt, jf)  ((nf_insn_t){ (uint16_t)(code), (jt), (jf), (uint32_t)(k) })
+
+#define NF_MAX_INSNS  4096
+#define NF_MEMWORDS   16
+
+typedef struct net_filter net_filter_t;
+
+/* Attach points on an interface */
+typedef enum {
+    NF_HOOK_RX = 0,
+    NF_HOOK_TX,
+} nf_hook_t;
+
+status_t nf_verify(const nf_insn_t* prog, uint32_t len);
+status_t nf_create(const nf_insn_t* prog, uint32_t len, net_filter_t** out_filter);
+void nf_destroy(net_filter_t* filter);
+uint32_t nf_run(const net_filter_t* filter, const void* packet, uint32_t length);
+uint32_t nf_interpret(const nf_insn_t* prog, const uint8_t* packet, uint32_t length);
+void nf_set_jit(bool enable);
+bool nf_is_jited(const net_filter_t* filter);
+
+/* Filters stay owned by the caller; detach (NULL) before destroying one */
+status_t net_interface_attach_filter(net_interface_t* iface, nf_hook_t hook, net_filter_t* filter);
+status_t net_socket_attach_filter(socket_t* sock, net_filter_t* filter);
+
+/* ============================================================================
+ * Firewall (kernel/src/net/firewall.c)
+ *
+ * Rulesets are first-match lists. fw_compile() turns one into a decision
+ * tree: each interior node cuts one header field into equal power-of-two
+ * slices, and leaves hold the few rules that can still match, which are
+ * checked in priority order. Accepted flows are entered into the
+ * connection tracker; later packets of a tracked flow, in either direction
+ * and on either chain, skip rule evaluation.
+ * ============================================================================ */
+
+#define FW_MAX_RULES  65536
+
+typedef enum {
+    FW_CHAIN_INPUT = 0,
+    FW_CHAIN_OUTPUT,
+    FW_CHAIN_COUNT,
+} fw_chain_t;
+
+typedef enum {
+    FW_ACTION_ACCEPT = 0,
+    FW_ACTION_DROP,
+} fw_action_t;
+
+/* One rule; addresses in host byte order, protocol 0 matches any */
+typedef struct fw_rule {
+    uint32_t src;
+    uint32_t dst;
+    uint8_t src_len;
+    uint8_t dst_len;
+    uint8_t protocol;
+    uint8_t action;
+    uint16_t sport_lo;
+    uint16_t sport_hi;
+    uint16_t dport_lo;
+    uint16_t dport_hi;
+} fw_rule_t;
+
+/* Classification key, host byte order */
+typedef struct fw_key {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t protocol;
+} fw_key_t;
+
+typedef struct fw_ruleset fw_ruleset_t;
+
+typedef struct fw_stats {
+    uint64_t packets[FW_CHAIN_COUNT];
+    uint64_t dropped[FW_CHAIN_COUNT];
+    uint64_t ct_hits;
+    uint64_t ct_inserts;
+    uint64_t ct_evictions;
+    uint64_t classified;
+} fw_stats_t;
+
+/* Firewall benchmark result; times are totals over `packets` */
+typedef struct fw_bench_result {
+    uint32_t rules;
+    uint32_t packets;
+    uint32_t nodes;
+    uint32_t max_leaf;
+    uint64_t tree_bytes;
+    uint64_t compile_ns;
+    uint64_t tree_ns;
+    uint64_t linear_ns;
+    uint64_t tracked_ns;
+    uint32_t mismatches;     /* Tree and linear walk disagreed; must be 0 */
+} fw_bench_result_t;
+
+status_t fw_init(void);
+status_t fw_compile(const fw_rule_t* rules, uint32_t count, fw_action_t default_action,
+                    fw_ruleset_t** out_ruleset);
+void fw_ruleset_destroy(fw_ruleset_t* ruleset);
+int32_t fw_classify(const fw_ruleset_t* ruleset, const fw_key_t* key);
+int32_t fw_classify_linear(const fw_ruleset_t* ruleset, const fw_key_t* key);
+fw_action_t fw_verdict(const fw_ruleset_t* ruleset, const fw_key_t* key);
+
+/* Replace a chain's ruleset (NULL accepts everything); the old one is freed */
+status_t fw_install(fw_chain_t chain, fw_ruleset_t* ruleset);
+fw_action_t fw_filter(fw_chain_t chain, const void* ip_packet, size_t length);
+void fw_conntrack_flush(void);
+status_t fw_get_stats(fw_stats_t* stats);
+status_t fw_benchmark(uint32_t rule_count, uint32_t packets, fw_bench_result_t* result);
+
+#endif /* LIMITLESS_NETFILTER_H */
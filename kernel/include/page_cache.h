@@ -0,0 +1,58 @@
+#ifndef LIMITLESS_PAGE_CACHE_H
+#define LIMITLESS_PAGE_CACHE_H
+
+/*
+ * Page Cache
+ * Page-sized copies of file data shared by every mapping of the file
+ */
+
+#include "kernel.h"
+#include "vfs.h"
+#include "readahead.h"
+
+/* ============================================================================
+ * Pages are keyed by (node, page index) and hold a reference on the node.
+ * A page mapped into an address space is pinned by a map reference and is
+ * never evicted; unmapped pages are recycled in clock order when the pool
+ * runs out. Writes through the VFS refresh cached copies, so mappings see
+ * the same data as read(). Runs of missing pages are read with one vectored
+ * request of up to PAGE_CACHE_BATCH pages.
+ * ============================================================================ */
+
+#define PAGE_CACHE_PAGES   4096    /* 16 MiB */
+#define PAGE_CACHE_HASH    1024
+#define PAGE_CACHE_BATCH   32      /* Pages per read request */
+
+typedef struct page_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t readahead;        /* Pages read before anyone asked for them */
+    uint64_t readahead_used;   /* ... that were then read or mapped */
+    uint64_t readahead_wasted; /* ... that were evicted or dropped first */
+    uint64_t evictions;
+    uint32_t cached;
+    uint32_t mapped;
+} page_cache_stats_t;
+
+/* Find or read a page and take a map reference on it */
+status_t page_cache_get(vfs_node_t* node, uint64_t index, paddr_t* out_page);
+/* Take a map reference only if the page is already cached (0 if not) */
+paddr_t page_cache_lookup(vfs_node_t* node, uint64_t index);
+/* Drop a map reference taken by page_cache_get/lookup */
+void page_cache_put(vfs_node_t* node, uint64_t index);
+
+/* Read pages into the cache without mapping them; returns pages now cached */
+uint32_t page_cache_readahead(vfs_node_t* node, uint64_t index, uint32_t count);
+/* Feed an access of count pages at index to a tracker and read what it asks for;
+ * returns pages read ahead */
+uint32_t page_cache_ra_access(vfs_node_t* node, ra_state_t* ra, uint64_t index, uint32_t count);
+/* Copy file data through the cache, reading missing pages; returns bytes or status */
+ssize_t page_cache_read(vfs_node_t* node, void* buffer, size_t size, uint64_t offset);
+/* Re-read cached pages overlapping a byte range after the file changed */
+void page_cache_refresh(vfs_node_t* node, uint64_t offset, uint64_t len);
+/* Forget unmapped pages in a page range (count 0 = to the end of the file) */
+void page_cache_drop(vfs_node_t* node, uint64_t index, uint64_t count);
+
+void page_cache_get_stats(page_cache_stats_t* stats);
+
+#endif /* LIMITLESS_PAGE_CACHE_H */
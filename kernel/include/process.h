@@ -7,9 +7,11 @@
  */
 
 #include "kernel.h"
+#include "microkernel.h"
 #include "vmm.h"
 #include "elf.h"
 #include "vfs.h"
+#include "rbtree.h"
 
 /* Process states */
 typedef enum {
@@ -26,9 +28,41 @@ typedef enum {
 #define PROCESS_FLAG_USER       0x0002  // User process
 #define PROCESS_FLAG_TRACED     0x0004  // Being traced
 #define PROCESS_FLAG_STOPPED    0x0008  // Stopped by signal
+#define PROCESS_FLAG_VFORK      0x0010  // Borrowing the parent's address space
+
+/* process_wait() options */
+#define PROCESS_WNOHANG         0x0001  // Return STATUS_BUSY instead of blocking
+#define PROCESS_WUNTRACED       0x0002  // Also report stopped children
+#define PROCESS_WCONTINUED      0x0008  // Also report continued children
+
+/* Wait status encoding (same layout as POSIX wait status) */
+#define PROCESS_STATUS_EXITED(code)   (((code) & 0xFF) << 8)
+#define PROCESS_STATUS_SIGNALED(sig)  ((sig) & 0x7F)
+#define PROCESS_STATUS_STOPPED(sig)   ((((sig) & 0xFF) << 8) | 0x7F)
+#define PROCESS_STATUS_CONTINUED      0xFFFF
+
+/* Signals the process manager acts on */
+#define PROCESS_SIGKILL  9
+#define PROCESS_SIGCONT  18
+#define PROCESS_SIGSTOP  19
+
+/* File descriptor types (high bits of file_descriptor_t.flags) */
+#define PROCESS_FD_PIDFD  0x80000000  // file is a process_pidfd_t, not a vfs_file_t
 
 /* Maximum processes */
+/* process_mmap() protection and flags (Linux values) */
+#define PROCESS_PROT_READ       0x1
+#define PROCESS_PROT_WRITE      0x2
+#define PROCESS_PROT_EXEC       0x4
+#define PROCESS_MAP_SHARED      0x0001
+#define PROCESS_MAP_PRIVATE     0x0002
+#define PROCESS_MAP_FIXED       0x0010
+#define PROCESS_MAP_ANONYMOUS   0x0020
+#define PROCESS_MAP_POPULATE    0x8000  // Fault the whole mapping in now
+#define PROCESS_MMAP_BASE       0x100000000000UL  // Where unhinted mappings go
+
 #define PROCESS_MAX_COUNT 1024
+#define PROCESS_PID_HASH  1024
 #define PROCESS_MAX_THREADS 64
 #define PROCESS_MAX_CHILDREN 256
 #define PROCESS_MAX_FDS 1024
@@ -43,6 +77,7 @@ typedef struct file_descriptor {
 
 /* Forward declaration for CPU context */
 struct cpu_context;
+struct process_pidfd;
 
 /* Thread structure */
 typedef struct thread {
@@ -54,9 +89,38 @@ typedef struct thread {
     uint32_t priority;         // Scheduling priority
     uint64_t cpu_time;         // CPU time used (nanoseconds)
     struct process* process;   // Parent process
-    struct list_head list_node; // Scheduler list linkage
+    struct list_head list_node; // Real-time run queue or wait queue linkage
     struct cpu_context* context; // CPU execution context
     bool in_use;
+
+    /* Fair class (every priority below PRIORITY_REALTIME) */
+    int32_t nice;              // -20..19, defaults from priority
+    uint32_t weight;           // Load weight for nice, 1024 at nice 0
+    uint64_t vruntime;         // Run time scaled by 1024 / weight
+    uint64_t exec_start;       // Clock when it was last picked or accounted
+    uint64_t slice_start;      // cpu_time when it was last picked
+    uint64_t wake_time;        // Clock of the last wakeup, 0 once it has run
+    struct rb_node run_node;   // Fair or deadline run queue linkage
+    bool on_rq;                // Queued on a run queue
+
+    /* Deadline class (sched_set_deadline); dl_runtime 0 = not a deadline thread */
+    uint64_t dl_runtime;       // Budget per period
+    uint64_t dl_deadline;      // Relative deadline
+    uint64_t dl_period;
+    uint64_t dl_abs_deadline;  // EDF key
+    int64_t dl_budget;         // Runtime left before the deadline
+    bool dl_throttled;         // Budget used up; waits for the next period
+    struct list_head dl_throttle_node; // Run queue's throttled list
+
+    /* Priority inheritance; the scheduler runs the thread as pi_donor while set */
+    struct thread* pi_donor;   // Highest-priority thread waiting on this one
+    uint8_t pi_rank;           // Donor's class, deadline and weight at boost time
+    uint64_t pi_deadline;
+    uint32_t pi_weight;
+    uint64_t pi_since;         // Clock when the boost began
+    struct thread* ipc_donor;  // Highest synchronous caller this server is handling
+    struct kmutex* pi_blocked_on; // Mutex this thread sleeps on
+    struct list_head pi_held;  // Mutexes this thread owns
 } thread_t;
 
 /* Process structure */
@@ -93,6 +157,21 @@ typedef struct process {
     pid_t children[PROCESS_MAX_CHILDREN];
     uint32_t child_count;
 
+    /* Child state changes, protected by the process manager's wait lock.
+     * An exiting child is appended to its parent's zombie list and a stop
+     * or continue to its report list, so waiting for any child takes the
+     * head of a list instead of searching the children. */
+    wait_queue_t child_waiters;          // Threads blocked in process_wait()
+    struct list_head zombies;            // Exited children, oldest first
+    struct list_head reports;            // Stopped/continued children
+    struct list_head zombie_node;        // Linkage on the parent's zombie list
+    struct list_head report_node;        // Linkage on the parent's report list
+    int wait_status;                     // PROCESS_STATUS_* once exited or reported
+    uint8_t report;                      // Pending stop/continue report, 0 = none
+    struct list_head pidfds;             // pidfds referring to this process
+    struct process* hash_next;           // PID hash chain
+    wait_queue_t vfork_waiters;          // Parent blocked until this vfork child execs or exits
+
     /* Working directory */
     char cwd[VFS_MAX_PATH];
 
@@ -124,7 +203,10 @@ typedef struct process_manager {
     process_t* current_process;
     thread_t* current_thread;
     struct list_head process_list;
+    process_t* pid_hash[PROCESS_PID_HASH];
     uint32_t lock;
+    uint32_t wait_lock;        // Parent/child wait state, pidfds and event queues
+    uint64_t reaped;
     bool initialized;
 } process_manager_t;
 
@@ -137,8 +219,86 @@ status_t process_create(process_t** out_process);
 status_t process_fork(process_t* parent, process_t** out_child);
 status_t process_exec(process_t* process, const char* path, char* const argv[], char* const envp[]);
 status_t process_exit(process_t* process, int exit_code);
-status_t process_wait(process_t* parent, pid_t child_pid, int* status, uint32_t options);
+/* child_pid 0 waits for any child; out_pid (optional) receives the child reported */
+status_t process_wait(process_t* parent, pid_t child_pid, int* status, uint32_t options,
+                      pid_t* out_pid);
 status_t process_kill(pid_t pid, int signal);
+status_t process_stop(process_t* process, int signal);
+status_t process_continue(process_t* process);
+
+/*
+ * Spawning. process_spawn() creates a child with a fresh address space,
+ * applies the file actions to the fd table it inherits, and execs path,
+ * all without ever copying the parent's memory. It backs posix_spawn and
+ * CreateProcess; fork+exec pays for a full copy only to discard it.
+ */
+#define PROCESS_SPAWN_OPEN          1   // fd = open(path, oflags, mode)
+#define PROCESS_SPAWN_CLOSE         2   // close(fd)
+#define PROCESS_SPAWN_DUP2          3   // dup2(fd, newfd)
+#define PROCESS_SPAWN_CHDIR         4   // chdir(path)
+
+#define PROCESS_SPAWN_SETPGROUP     0x0001  // Join process group attr->pgid (0 = own group)
+#define PROCESS_SPAWN_RESETIDS      0x0002  // Effective IDs revert to the real IDs
+
+typedef struct process_spawn_action {
+    uint32_t type;             // PROCESS_SPAWN_OPEN etc.
+    int fd;
+    int newfd;                 // DUP2 target
+    uint32_t oflags;           // OPEN: VFS_O_* flags
+    uint32_t mode;             // OPEN: creation mode
+    const char* path;          // OPEN, CHDIR
+} process_spawn_action_t;
+
+typedef struct process_spawn_attr {
+    const process_spawn_action_t* actions;  // Applied in order
+    uint32_t action_count;
+    uint32_t flags;            // PROCESS_SPAWN_SETPGROUP etc.
+    pid_t pgid;
+} process_spawn_attr_t;
+
+/* attr may be NULL; on failure no child is left behind */
+status_t process_spawn(process_t* parent, const char* path, char* const argv[], char* const envp[],
+                       const process_spawn_attr_t* attr, process_t** out_child);
+
+/*
+ * vfork: the child runs on the parent's address space until it execs or
+ * exits. process_vfork_wait() blocks the parent until then.
+ */
+status_t process_vfork(process_t* parent, process_t** out_child);
+status_t process_vfork_wait(process_t* child);
+
+/* Average cycles to create, exec and reap one child from a parent of parent_pages */
+typedef struct process_spawn_bench_result {
+    uint64_t fork_exec_cycles;
+    uint64_t vfork_exec_cycles;
+    uint64_t spawn_cycles;
+} process_spawn_bench_result_t;
+
+status_t process_spawn_benchmark(const char* path, size_t parent_pages, uint32_t iterations,
+                                 process_spawn_bench_result_t* result);
+
+/*
+ * Process handles. A pidfd refers to one process for as long as it is open,
+ * even after the PID is reused; it can be waited on directly or registered
+ * with an event queue, which reports the process's exit once.
+ */
+typedef struct process_pidfd process_pidfd_t;
+typedef struct process_evq process_evq_t;
+
+typedef struct process_event {
+    uint64_t cookie;           // Value given at registration
+    pid_t pid;
+} process_event_t;
+
+status_t process_pidfd_open(process_t* caller, pid_t pid, int* out_fd);
+status_t process_pidfd_wait(process_t* caller, int pidfd, int* status, uint32_t options);
+
+status_t process_evq_create(process_evq_t** out_evq);
+void process_evq_destroy(process_evq_t* evq);
+status_t process_evq_add_pidfd(process_evq_t* evq, process_t* caller, int pidfd, uint64_t cookie);
+/* Blocks until an event is ready unless options has PROCESS_WNOHANG */
+status_t process_evq_wait(process_evq_t* evq, process_event_t* events, uint32_t max,
+                          uint32_t options, uint32_t* out_count);
 
 /* Thread management */
 status_t thread_create(process_t* process, vaddr_t entry_point, vaddr_t stack_ptr, thread_t** out_thread);
@@ -148,6 +308,7 @@ status_t thread_exit(thread_t* thread, int exit_code);
 process_t* process_find_by_pid(pid_t pid);
 process_t* process_get_current(void);
 thread_t* thread_get_current(void);
+thread_t* process_find_thread(process_t* process, tid_t tid);
 
 /* File descriptor management */
 int process_fd_alloc(process_t* process, void* file, uint32_t flags);
@@ -160,6 +321,7 @@ status_t process_fd_clone_all(process_t* parent, process_t* child);
 status_t process_brk(process_t* process, vaddr_t new_brk, vaddr_t* out_brk);
 status_t process_mmap(process_t* process, vaddr_t addr, size_t length, uint32_t prot, uint32_t flags, int fd, uint64_t offset, vaddr_t* out_addr);
 status_t process_munmap(process_t* process, vaddr_t addr, size_t length);
+status_t process_madvise(process_t* process, vaddr_t addr, size_t length, uint32_t advice);
 
 /* Address space management */
 status_t process_copy_address_space(address_space_t* src, address_space_t** out_dest);
@@ -176,6 +338,7 @@ typedef struct process_stats {
     uint32_t active_processes;
     uint32_t zombie_processes;
     uint32_t total_threads;
+    uint64_t reaped;           // Children collected by process_wait()
     uint64_t total_cpu_time;
 } process_stats_t;
 
@@ -0,0 +1,160 @@
+#ifndef LIMITLESS_QDISC_H
+#define LIMITLESS_QDISC_H
+
+/*
+ * Traffic Control
+ * Egress queueing disciplines and byte queue limits for driver TX rings
+ */
+
+#include "kernel.h"
+#include "net.h"
+
+/* ============================================================================
+ * Queueing disciplines (kernel/src/net/qdisc.c)
+ *
+ * Every frame leaving an interface is enqueued on the interface's qdisc and
+ * dequeued into the driver while the TX ring is under its byte queue limit.
+ * Keeping the ring short moves the standing queue into the qdisc, where it
+ * can be scheduled:
+ *
+ *   pfifo_fast  three strict-priority FIFO bands selected by NET_PRIO_*
+ *   fq_codel    per-flow queues served by deficit round robin, new flows
+ *               first, with CoDel dropping (or ECN marking) from any flow
+ *               whose packets sit longer than the target delay
+ *   fq          per-flow round robin with pacing: a flow with a pacing rate
+ *               is held until its next packet is due
+ *
+ * Only one CPU dequeues from a qdisc at a time; others enqueue and leave.
+ * ============================================================================ */
+
+#define QDISC_NAME_MAX        16
+
+#define QDISC_F_CAN_BYPASS    BIT(0)   /* An empty qdisc may send directly */
+
+typedef struct qdisc qdisc_t;
+
+typedef struct qdisc_ops {
+    char name[QDISC_NAME_MAX];
+    uint32_t flags;
+    size_t priv_size;
+    status_t (*init)(qdisc_t* q);
+    /* Returns STATUS_BUSY if the packet was dropped */
+    status_t (*enqueue)(qdisc_t* q, net_buffer_t* buf, uint64_t now);
+    net_buffer_t* (*dequeue)(qdisc_t* q, uint64_t now);
+    /* Drop everything queued */
+    void (*reset)(qdisc_t* q);
+} qdisc_ops_t;
+
+typedef struct qdisc_stats {
+    uint64_t enqueued;
+    uint64_t sent_packets;
+    uint64_t sent_bytes;
+    uint64_t dropped;          /* Tail drops and overlimit drops */
+    uint64_t codel_dropped;
+    uint64_t ecn_marked;
+    uint64_t requeues;         /* Driver ring was full */
+    uint64_t bypassed;
+    uint64_t throttled;        /* Flows held back by pacing */
+    uint32_t qlen;
+    uint32_t backlog;
+} qdisc_stats_t;
+
+struct qdisc {
+    const qdisc_ops_t* ops;
+    net_interface_t* iface;
+    uint32_t limit;            /* Packets */
+    uint32_t qlen;
+    uint32_t backlog;          /* Bytes */
+    uint64_t watchdog_ns;      /* Earliest time a throttled flow is due, 0 = none */
+    net_buffer_t* requeued;    /* Refused by the driver; sent before anything else */
+    qdisc_stats_t stats;
+    size_t pages;
+    uint32_t lock;
+    uint32_t running;
+    uint8_t priv[];
+};
+
+static inline void* qdisc_priv(qdisc_t* q) {
+    return q->priv;
+}
+
+/* Egress metadata from the socket layer; any field may be zero */
+typedef struct qdisc_meta {
+    uint32_t flow_hash;
+    uint32_t pacing_rate;
+    uint8_t priority;
+} qdisc_meta_t;
+
+status_t qdisc_register(const qdisc_ops_t* ops);
+status_t qdisc_create(net_interface_t* iface, const char* kind, qdisc_t** out_qdisc);
+void qdisc_destroy(qdisc_t* q);
+
+/* Replace the interface's qdisc (NULL kind removes it); queued packets are dropped */
+status_t net_interface_set_qdisc(net_interface_t* iface, const char* kind);
+status_t qdisc_get_stats(net_interface_t* iface, qdisc_stats_t* stats);
+
+/* Queue one frame (or super-packet, taking ownership of buf) and run the qdisc */
+status_t qdisc_xmit(net_interface_t* iface, const void* frame, size_t length,
+                    const qdisc_meta_t* meta);
+status_t qdisc_xmit_buffer(net_interface_t* iface, net_buffer_t* buf, const qdisc_meta_t* meta);
+void qdisc_run(net_interface_t* iface);
+uint8_t qdisc_classify(const void* frame, size_t length, const qdisc_meta_t* meta);
+
+/* Reap completions and restart every interface with due packets; the idle loop calls it each tick */
+void net_tx_poll(void);
+
+/* ============================================================================
+ * Byte queue limits
+ *
+ * A driver that reports TX completions enables BQL with the size of its
+ * ring. The limit starts at two frames, grows whenever the ring runs dry
+ * while the qdisc still holds packets, and shrinks by the smallest excess
+ * seen over each hold interval, so it settles near the least amount of
+ * data that keeps the hardware busy between completions.
+ * ============================================================================ */
+
+#define BQL_SLACK_HOLD_NS  (100ULL * 1000000ULL)
+
+void net_bql_enable(net_interface_t* iface, uint32_t max_bytes);
+void net_tx_complete(net_interface_t* iface, uint32_t packets, uint32_t bytes);
+
+/* ============================================================================
+ * Latency benchmark
+ *
+ * Simulates a link of `link_mbps` with a 256-descriptor TX ring in virtual
+ * time. A bulk sender offers `bulk_load_pct` percent of the link rate in
+ * full-sized frames while a ping is sent every 10 ms; the result is the
+ * ping's time from qdisc enqueue to leaving the wire.
+ * ============================================================================ */
+
+typedef struct qdisc_bench_config {
+    const char* kind;
+    uint32_t link_mbps;
+    uint32_t bulk_load_pct;
+    uint32_t duration_ms;
+    uint32_t bulk_pacing_rate;   /* Bytes per second set on the bulk socket */
+    uint8_t ping_priority;
+    bool bql;
+} qdisc_bench_config_t;
+
+typedef struct qdisc_bench_result {
+    uint32_t pings;
+    uint64_t ping_avg_ns;
+    uint64_t ping_p99_ns;
+    uint64_t ping_max_ns;
+    uint64_t bulk_goodput_bps;
+    uint32_t bql_limit;          /* Final limit, 0 without BQL */
+    qdisc_stats_t stats;
+} qdisc_bench_result_t;
+
+status_t qdisc_benchmark(const qdisc_bench_config_t* config, qdisc_bench_result_t* result);
+
+/*
+ * The same load and pings as real UDP traffic over "lo", with the qdisc
+ * under test attached and lo's driver replaced by a ring draining at
+ * link_mbps in real time; runs for duration_ms of wall-clock time.
+ */
+status_t qdisc_loopback_benchmark(const qdisc_bench_config_t* config,
+                                  qdisc_bench_result_t* result);
+
+#endif /* LIMITLESS_QDISC_H */
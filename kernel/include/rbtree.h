@@ -0,0 +1,43 @@
+#ifndef LIMITLESS_RBTREE_H
+#define LIMITLESS_RBTREE_H
+
+/*
+ * Red-Black Tree
+ * Intrusive balanced tree; callers embed struct rb_node and do their own
+ * ordered descent, then link and rebalance
+ */
+
+#include "kernel.h"
+
+struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    bool red;
+};
+
+struct rb_root {
+    struct rb_node* node;
+};
+
+#define RB_ROOT ((struct rb_root){ NULL })
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+/* Attach node below parent at *link (found by the caller's descent) */
+static ALWAYS_INLINE void rb_link_node(struct rb_node* node, struct rb_node* parent, struct rb_node** link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->red = true;
+    *link = node;
+}
+
+/* Rebalance after rb_link_node() */
+void rb_insert_color(struct rb_node* node, struct rb_root* root);
+void rb_erase(struct rb_node* node, struct rb_root* root);
+
+struct rb_node* rb_first(const struct rb_root* root);
+struct rb_node* rb_next(const struct rb_node* node);
+
+#endif /* LIMITLESS_RBTREE_H */
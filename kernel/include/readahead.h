@@ -0,0 +1,97 @@
+#ifndef LIMITLESS_READAHEAD_H
+#define LIMITLESS_READAHEAD_H
+
+/*
+ * Read-ahead
+ * Access-pattern tracking for files and file mappings
+ */
+
+#include "kernel.h"
+
+/* ============================================================================
+ * Each open file and each file-backed region carries a tracker fed with the
+ * page range of every access. It recognises sequential, strided and reverse
+ * streams and loops that return to the start of a run, and answers with the
+ * page runs to read next. A window of steps is kept ahead of the stream and
+ * refilled once half of it is consumed, so the reader finds its pages cached.
+ * The window doubles while read-ahead pages are used and halves when they
+ * are evicted unread or the stream breaks. Steps of a window are merged
+ * into runs, in either direction and across gaps of up to RA_MAX_GAP pages,
+ * since a request costs more than a few extra pages. A gap is bridged only
+ * while it is no wider than a step; wider strides read their steps alone.
+ * Bridged gap pages count as wasted, as does read-ahead still pending when
+ * the tracker is released. Unrecognised accesses may still be predicted by
+ * the AI_HOOK_IO model (ai_predict_readahead).
+ * ============================================================================ */
+
+#define RA_MIN_PAGES    4       /* First window */
+#define RA_MAX_PAGES    256     /* 1 MiB */
+#define RA_MAX_RUNS     32      /* Runs per window; also caps strided windows */
+#define RA_LOOP_STEPS   4       /* Steps a run needs before a jump back to its start is a loop */
+#define RA_MAX_GAP      8       /* Pages between steps read anyway to keep one request */
+
+typedef enum {
+    RA_NONE,
+    RA_SEQUENTIAL,
+    RA_STRIDED,                 /* Constant gap between accesses */
+    RA_REVERSE,                 /* Constant negative stride */
+    RA_LOOP,                    /* A run revisited from its first page */
+} ra_pattern_t;
+
+/* Hints from fadvise/madvise */
+#define RA_ADVICE_NORMAL        0
+#define RA_ADVICE_RANDOM        1   /* Track nothing, read nothing ahead */
+#define RA_ADVICE_SEQUENTIAL    2   /* Treat every access as a sequential stream */
+
+typedef struct ra_stats {
+    uint64_t prefetched;        /* Pages read ahead */
+    uint64_t used;              /* Read-ahead pages the stream then reached */
+    uint64_t wasted;            /* Evicted first, skipped by a break, bridged gaps, left at release */
+    uint64_t windows;           /* Windows issued */
+} ra_stats_t;
+
+typedef struct ra_state {
+    uint64_t last;              /* First page of the previous access */
+    uint64_t last_end;          /* One past its last page */
+    uint64_t accesses;
+
+    uint32_t pattern;           /* ra_pattern_t */
+    uint32_t advice;
+    int64_t stride;             /* Pages between steps (candidate while RA_NONE) */
+    uint32_t unit;              /* Pages per step */
+    uint64_t cur;               /* Page of the current step */
+
+    uint32_t ahead;             /* Steps past cur already read ahead */
+    uint32_t window;            /* Steps to keep ahead, 0 until the first window */
+    bool wasted;                /* Waste since the last window */
+
+    uint64_t run_start;         /* First page of the current stream */
+    uint32_t run_steps;
+    uint64_t loop_start;        /* RA_LOOP: run_steps steps from loop_start repeat */
+    uint32_t loop_steps;
+    uint32_t loop_pos;
+
+    ra_stats_t stats;
+} ra_state_t;
+
+typedef struct ra_run {
+    uint64_t index;
+    uint32_t count;
+} ra_run_t;
+
+void ra_init(ra_state_t* ra);
+void ra_advise(ra_state_t* ra, uint32_t advice);
+/* The file is closed or unmapped: pending read-ahead will never be used */
+void ra_release(ra_state_t* ra);
+
+/*
+ * Record an access of count pages at index in a file of pages pages;
+ * cached says whether its first page was already cached. Fills runs
+ * (RA_MAX_RUNS entries) with what to read ahead and returns their number.
+ */
+uint32_t ra_access(ra_state_t* ra, uint64_t index, uint32_t count, uint64_t pages, bool cached,
+                   ra_run_t* runs);
+
+const char* ra_pattern_name(ra_pattern_t pattern);
+
+#endif /* LIMITLESS_READAHEAD_H */
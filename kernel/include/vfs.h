@@ -7,6 +7,7 @@
  */
 
 #include "kernel.h"
+#include "readahead.h"
 
 /* File types */
 #define VFS_TYPE_FILE       0x1
@@ -44,6 +45,27 @@
 #define VFS_SEEK_CUR   1
 #define VFS_SEEK_END   2
 
+/* Positional/vectored write flags */
+#define VFS_RW_SYNC    0x1      /* Flush to backing store before returning */
+#define VFS_RW_APPEND  0x2      /* Write at end of file regardless of offset */
+
+/* Access pattern advice */
+#define VFS_ADV_NORMAL     0
+#define VFS_ADV_RANDOM     1
+#define VFS_ADV_SEQUENTIAL 2
+#define VFS_ADV_WILLNEED   3
+#define VFS_ADV_DONTNEED   4
+#define VFS_ADV_NOREUSE    5
+
+/* Mount flags (vfs_mount_t.flags) */
+#define VFS_MOUNT_MEMORY    0x80000000u /* Data lives in memory; reads bypass the page cache */
+
+/* Allocation modes */
+#define VFS_ALLOC_KEEP_SIZE 0x1 /* Reserve space without changing file size */
+
+/* Maximum segments per vectored request */
+#define VFS_IOV_MAX 1024
+
 /* Maximum path length */
 #define VFS_MAX_PATH 4096
 #define VFS_MAX_NAME 256
@@ -76,6 +98,12 @@ typedef struct vfs_dirent {
     char name[VFS_MAX_NAME];
 } vfs_dirent_t;
 
+/* I/O vector segment (layout-compatible with POSIX struct iovec) */
+typedef struct vfs_iovec {
+    void* base;
+    size_t len;
+} vfs_iovec_t;
+
 /* File operations */
 typedef struct vfs_file_ops {
     ssize_t (*read)(vfs_node_t* node, void* buffer, size_t size, uint64_t offset);
@@ -85,6 +113,14 @@ typedef struct vfs_file_ops {
     status_t (*ioctl)(vfs_node_t* node, uint32_t request, void* arg);
     status_t (*truncate)(vfs_node_t* node, uint64_t size);
     status_t (*flush)(vfs_node_t* node);
+
+    /* Optional: whole-vector transfers; VFS loops over read/write if NULL */
+    ssize_t (*readv)(vfs_node_t* node, const vfs_iovec_t* iov, uint32_t iovcnt, uint64_t offset);
+    ssize_t (*writev)(vfs_node_t* node, const vfs_iovec_t* iov, uint32_t iovcnt, uint64_t offset);
+
+    /* Optional: preallocation and access pattern hints */
+    status_t (*allocate)(vfs_node_t* node, uint32_t mode, uint64_t offset, uint64_t len);
+    status_t (*advise)(vfs_node_t* node, uint64_t offset, uint64_t len, uint32_t advice);
 } vfs_file_ops_t;
 
 /* Directory operations */
@@ -163,6 +199,8 @@ typedef struct vfs_file {
     uint64_t offset;
     uint32_t flags;
     uint32_t ref_count;
+    uint32_t advice;        /* Last VFS_ADV_* hint for the whole file */
+    ra_state_t ra;          /* Read-ahead tracker for cached reads */
 } vfs_file_t;
 
 /* VFS initialization */
@@ -192,6 +230,22 @@ status_t vfs_seek(vfs_file_t* file, int64_t offset, int whence, uint64_t* out_of
 status_t vfs_stat(const char* path, vfs_stat_t* stat);
 status_t vfs_fstat(vfs_file_t* file, vfs_stat_t* stat);
 
+/*
+ * Positional and vectored I/O. A negative offset means "use and advance the
+ * file position". Each call transfers the whole vector in one VFS entry and
+ * returns the byte count or a negative status_t.
+ */
+ssize_t vfs_pread(vfs_file_t* file, void* buffer, size_t size, int64_t offset);
+ssize_t vfs_pwrite(vfs_file_t* file, const void* buffer, size_t size, int64_t offset);
+ssize_t vfs_preadv(vfs_file_t* file, const vfs_iovec_t* iov, uint32_t iovcnt, int64_t offset);
+ssize_t vfs_pwritev(vfs_file_t* file, const vfs_iovec_t* iov, uint32_t iovcnt,
+                    int64_t offset, uint32_t flags);
+status_t vfs_fallocate(vfs_file_t* file, uint32_t mode, uint64_t offset, uint64_t len);
+status_t vfs_fadvise(vfs_file_t* file, uint64_t offset, uint64_t len, uint32_t advice);
+status_t vfs_readahead_stats(vfs_file_t* file, ra_stats_t* stats);
+ssize_t vfs_copy_range(vfs_file_t* in, int64_t in_offset,
+                       vfs_file_t* out, int64_t out_offset, size_t len);
+
 /* Directory operations */
 status_t vfs_mkdir(const char* path, uint32_t mode);
 status_t vfs_rmdir(const char* path);
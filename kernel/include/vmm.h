@@ -7,6 +7,7 @@
  */
 
 #include "kernel.h"
+#include "readahead.h"
 
 /* Page table levels */
 #define PT_LEVEL_PML4 3  // Page Map Level 4
@@ -24,6 +25,8 @@
 #define PTE_DIRTY      BIT(6)   // Page has been written to
 #define PTE_HUGE       BIT(7)   // 2MB or 1GB page
 #define PTE_GLOBAL     BIT(8)   // Page is global (not flushed on CR3 reload)
+#define PTE_CACHED     BIT(9)   // Software: frame belongs to the page cache
+#define PTE_LAZYFREE   BIT(10)  // Software: MADV_FREE'd, reclaimable while clean
 #define PTE_NX         BIT(63)  // No execute
 
 /* Page table entry */
@@ -42,11 +45,36 @@ typedef struct page_table {
 typedef struct vm_region {
     vaddr_t start;
     vaddr_t end;
-    uint32_t flags;
+    uint64_t flags;            // PTE_* flags for pages of the region (NX included)
     uint32_t type;
     struct list_head list_node;
+
+    /* Demand paging: file pages come from the page cache, the rest are zero-filled */
+    struct vfs_node* node;     // Backing file, NULL = anonymous
+    uint64_t offset;           // File offset of start
+    uint32_t advice;           // VM_MADV_NORMAL, RANDOM or SEQUENTIAL
+    uint32_t vm_flags;         // VM_SHARED, VM_HUGEPAGE
+    ra_state_t ra;             // Read-ahead tracker fed with fault windows
 } vm_region_t;
 
+/* vm_region_t.vm_flags */
+#define VM_SHARED          BIT(0)   // File writes would be visible to others; mapped read-only
+#define VM_HUGEPAGE        BIT(1)   // Fault anonymous memory in 2 MiB extents
+
+/* Memory advice (madvise) */
+#define VM_MADV_NORMAL      0
+#define VM_MADV_RANDOM      1   // No fault-around or read-ahead
+#define VM_MADV_SEQUENTIAL  2   // Read ahead of faults, map the window ahead
+#define VM_MADV_WILLNEED    3   // Start reading the range into the page cache
+#define VM_MADV_DONTNEED    4   // Drop the pages; anonymous memory reads back as zero
+#define VM_MADV_FREE        8   // Reclaim anonymous pages later unless rewritten
+#define VM_MADV_HUGEPAGE    14
+#define VM_MADV_NOHUGEPAGE  15
+
+/* Pages mapped around a file fault when they are already cached */
+#define VM_FAULT_AROUND_PAGES   16
+#define VM_HUGE_PAGES           512
+
 /* VM region types */
 #define VM_REGION_CODE     1
 #define VM_REGION_DATA     2
@@ -66,14 +94,20 @@ typedef struct address_space {
     uint32_t lock;
 } address_space_t;
 
-/* TLB operations */
+/* TLB operations; hosted builds (KERNEL_HOSTED) have no MMU to tell */
 static ALWAYS_INLINE void tlb_flush_all(void) {
+#ifndef KERNEL_HOSTED
     uint64_t cr3;
     __asm__ volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3));
+#endif
 }
 
 static ALWAYS_INLINE void tlb_flush_page(vaddr_t addr) {
+#ifndef KERNEL_HOSTED
     __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
+#else
+    (void)addr;
+#endif
 }
 
 /* VMM initialization */
@@ -97,10 +131,29 @@ status_t vmm_unmap_pages(address_space_t* aspace, vaddr_t vaddr, size_t count);
 status_t vmm_get_physical(address_space_t* aspace, vaddr_t vaddr, paddr_t* out_paddr);
 bool vmm_is_mapped(address_space_t* aspace, vaddr_t vaddr);
 
-/* VM region management */
-status_t vmm_add_region(address_space_t* aspace, vaddr_t start, size_t size, uint32_t flags, uint32_t type);
+/* VM region management; regions are faulted in on demand */
+status_t vmm_add_region(address_space_t* aspace, vaddr_t start, size_t size, uint64_t flags, uint32_t type);
+status_t vmm_add_file_region(address_space_t* aspace, vaddr_t start, size_t size, uint64_t flags,
+                             struct vfs_node* node, uint64_t offset, uint32_t vm_flags);
 status_t vmm_remove_region(address_space_t* aspace, vaddr_t start);
+/* Unmap [start, start+size), trimming or splitting regions that straddle it */
+status_t vmm_remove_range(address_space_t* aspace, vaddr_t start, size_t size);
 vm_region_t* vmm_find_region(address_space_t* aspace, vaddr_t addr);
+/* Lowest free range of size bytes at or above hint (0 if none) */
+vaddr_t vmm_find_free_range(address_space_t* aspace, vaddr_t hint, size_t size);
+/* Free the regions' pages and the regions themselves */
+void vmm_release_regions(address_space_t* aspace);
+status_t vmm_clone_regions(address_space_t* src, address_space_t* dst);
+
+/* Resolve a fault in a region; STATUS_NOTFOUND if the address is not mapped */
+status_t vmm_handle_fault(address_space_t* aspace, vaddr_t addr, uint32_t error_code);
+/* Fault in every page of a range now (MAP_POPULATE) */
+status_t vmm_populate(address_space_t* aspace, vaddr_t start, size_t size);
+status_t vmm_madvise(address_space_t* aspace, vaddr_t start, size_t size, uint32_t advice);
+/* Read-ahead counters of the file region containing addr */
+status_t vmm_readahead_stats(address_space_t* aspace, vaddr_t addr, ra_stats_t* stats);
+/* Free MADV_FREE pages that have not been written since; returns pages freed */
+size_t vmm_reclaim_lazy(address_space_t* aspace);
 
 /* High-level allocation */
 status_t vmm_alloc_pages(address_space_t* aspace, size_t count, uint32_t flags, vaddr_t* out_vaddr);
@@ -123,8 +176,26 @@ typedef struct vmm_stats {
     size_t user_pages;
     size_t page_faults;
     size_t tlb_flushes;
+    size_t fault_around_pages;   // Pages mapped by fault-around instead of their own fault
+    size_t populated_pages;      // Mapped ahead of use by MAP_POPULATE
+    size_t lazy_freed;           // MADV_FREE pages reclaimed
 } vmm_stats_t;
 
+/*
+ * Sequential-scan fault benchmark: maps path and touches every page in
+ * order, counting the faults each mapping strategy takes.
+ */
+typedef struct vmm_scan_bench_result {
+    size_t pages;
+    size_t faults_no_around;     // RANDOM advice: one fault per page
+    size_t faults_cold;          // Default, nothing cached
+    size_t faults_warm;          // Default, file already in the page cache
+    size_t faults_sequential;    // SEQUENTIAL advice, nothing cached
+    size_t faults_populate;      // MAP_POPULATE
+} vmm_scan_bench_result_t;
+
+status_t vmm_scan_benchmark(const char* path, vmm_scan_bench_result_t* result);
+
 void vmm_get_stats(vmm_stats_t* stats);
 
 /* Helper macros for virtual address decomposition */
@@ -134,8 +205,13 @@ void vmm_get_stats(vmm_stats_t* stats);
 #define VADDR_PT_INDEX(addr)   (((addr) >> 12) & 0x1FF)
 #define VADDR_OFFSET(addr)     ((addr) & 0xFFF)
 
-/* Helper macros for address conversion */
-#define VIRT_TO_PHYS_DIRECT(vaddr) ((paddr_t)((vaddr) - 0xFFFF800000000000ULL))
-#define PHYS_TO_VIRT_DIRECT(paddr) ((vaddr_t)((paddr) + 0xFFFF800000000000ULL))
+/* Helper macros for address conversion; hosted builds hand out process memory as frames */
+#ifdef KERNEL_HOSTED
+#define DIRECT_MAP_BASE 0ULL
+#else
+#define DIRECT_MAP_BASE 0xFFFF800000000000ULL
+#endif
+#define VIRT_TO_PHYS_DIRECT(vaddr) ((paddr_t)((vaddr) - DIRECT_MAP_BASE))
+#define PHYS_TO_VIRT_DIRECT(paddr) ((vaddr_t)((paddr) + DIRECT_MAP_BASE))
 
 #endif /* LIMITLESS_VMM_H */
@@ -2,16 +2,21 @@
  * LimitlessOS AI Integration Hooks - Implementation
  * 
  * Provides kernel-level AI integration for intelligent OS behavior.
- * Uses ring buffers for telemetry and IPC for decision support.
+ * Uses ring buffers for telemetry, compiled models for inline decisions
+ * and the userspace service for retraining them.
  */
 
 #include "kernel.h"
 #include "ai_hooks.h"
 #include "microkernel.h"
+#include "process.h"
 
 /* Global AI state (exported for inline checks) */
 bool g_ai_telemetry_enabled = false;
 bool g_ai_decision_enabled = false;
+uint32_t g_ai_model_mask = 0;
+
+#define PAGES_FOR(bytes)  (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
 
 /* Telemetry ring buffer */
 #define AI_TELEMETRY_BUFFER_ENTRIES 4096
@@ -60,11 +65,39 @@ static struct {
     
     /* Userspace AI service */
     ipc_endpoint_t ai_service_endpoint;
+    ipc_endpoint_t control_endpoint;
+    pid_t service_pid;
     bool ai_service_registered;
+
+    /* Model blob being staged over the control channel */
+    uint8_t* staging;
+    size_t staging_pages;
+    uint32_t staging_size;
+    uint32_t staged;
+    ai_hook_type_t staging_hook;
     
     uint32_t global_lock;
 } ai_state = {0};
 
+/* Installed models; readers of models[] are counted per epoch */
+struct ai_model {
+    ai_model_header_t header;
+    size_t pages;
+    ai_model_linear_t linear;
+    ai_model_table_t table;
+    const ai_model_node_t* nodes;
+    const int32_t* entries;
+    uint64_t payload[];
+};
+
+static struct {
+    ai_model_t* models[AI_HOOK_COUNT];
+    epoch_t readers;
+    uint32_t lock;
+} ai_models;
+
+static void ai_control_drop_staging(void);
+
 /* Simple spinlock helpers */
 static ALWAYS_INLINE void ai_lock(uint32_t* lock) {
     while (__sync_lock_test_and_set(lock, 1)) {
@@ -133,6 +166,7 @@ status_t ai_hooks_init(ai_config_t* config) {
         ai_state.stats[i].decisions_cached = 0;
         ai_state.stats[i].decisions_ai = 0;
         ai_state.stats[i].decisions_fallback = 0;
+        ai_state.stats[i].decisions_model = 0;
         ai_state.stats[i].total_latency_ns = 0;
         ai_state.stats[i].max_latency_ns = 0;
     }
@@ -143,6 +177,8 @@ status_t ai_hooks_init(ai_config_t* config) {
     }
     
     ai_state.ai_service_registered = false;
+    ai_state.control_endpoint = IPC_ENDPOINT_INVALID;
+    ai_state.staging = NULL;
     ai_state.global_lock = 0;
     ai_state.initialized = true;
     
@@ -166,6 +202,11 @@ void ai_hooks_shutdown(void) {
     g_ai_decision_enabled = false;
     ai_state.initialized = false;
     
+    for (int i = 0; i < AI_HOOK_COUNT; i++) {
+        ai_model_free(ai_model_swap((ai_hook_type_t)i, NULL));
+    }
+    ai_control_drop_staging();
+    
     KLOG_INFO("AI", "AI hooks shut down");
 }
 
@@ -214,8 +255,8 @@ ai_hook_stats_t* ai_hooks_get_stats(ai_hook_type_t hook_type) {
 }
 
 /* Register userspace AI service */
-status_t ai_hooks_register_service(ipc_endpoint_t endpoint) {
-    if (!ai_state.initialized) {
+status_t ai_hooks_register_service(ipc_endpoint_t endpoint, ipc_endpoint_t* out_control) {
+    if (!ai_state.initialized || !out_control) {
         return STATUS_INVALID;
     }
     
@@ -223,11 +264,25 @@ status_t ai_hooks_register_service(ipc_endpoint_t endpoint) {
         return STATUS_INVALID;
     }
     
+    thread_t* current = sched_get_current_thread();
+    if (!current || !current->process) {
+        return STATUS_INVALID;
+    }
+    
+    if (ai_state.control_endpoint == IPC_ENDPOINT_INVALID) {
+        status_t status = ipc_endpoint_create(&ai_state.control_endpoint);
+        if (FAILED(status)) {
+            return status;
+        }
+    }
+    
     ai_lock(&ai_state.global_lock);
     ai_state.ai_service_endpoint = endpoint;
+    ai_state.service_pid = current->process->pid;
     ai_state.ai_service_registered = true;
     ai_unlock(&ai_state.global_lock);
     
+    *out_control = ai_state.control_endpoint;
     KLOG_INFO("AI", "AI service registered (endpoint=0x%lx)", endpoint);
     
     return STATUS_OK;
@@ -311,6 +366,45 @@ static uint32_t ai_cache_hash(uint32_t context_id) {
     return context_id % AI_DECISION_CACHE_SIZE;
 }
 
+/* Answer a request from the hook's model, if one is installed */
+static bool ai_model_decide(const ai_decision_request_t* request, ai_decision_response_t* response) {
+    int64_t input[AI_MODEL_INPUTS];
+    for (int i = 0; i < AI_MODEL_INPUTS; i++) {
+        input[i] = (int64_t)request->input_data[i];
+    }
+    
+    ai_model_result_t result;
+    if (!ai_model_eval(request->hook_type, input, &result)) {
+        return false;
+    }
+    
+    response->decision_id = result.version;
+    response->output_data[0] = (uint64_t)result.value;
+    for (int i = 1; i < 8; i++) {
+        response->output_data[i] = 0;
+    }
+    response->confidence = result.confidence;
+    response->cache_result = false;
+    response->expiry_time = 0;
+    return true;
+}
+
+/* Log a request no model could answer, for the service to retrain on */
+static void ai_decision_miss(const ai_decision_request_t* request) {
+    if (!ai_state.ai_service_registered) {
+        return;
+    }
+    ai_emit_event_slow(AI_EVENT_DECISION_MISS, request->context_id, request->hook_type,
+                       request->input_data[0], request->input_data[1], request->input_data[2]);
+}
+
+static void ai_record_latency(ai_hook_type_t hook_type, uint64_t latency) {
+    __sync_fetch_and_add(&ai_state.stats[hook_type].total_latency_ns, latency);
+    if (latency > ai_state.stats[hook_type].max_latency_ns) {
+        ai_state.stats[hook_type].max_latency_ns = latency;
+    }
+}
+
 /* Request AI decision (synchronous) */
 status_t ai_request_decision(ai_decision_request_t* request,
                              ai_decision_response_t* response,
@@ -333,6 +427,13 @@ status_t ai_request_decision(ai_decision_request_t* request,
     /* Update statistics */
     __sync_fetch_and_add(&ai_state.stats[hook_type].decisions_requested, 1);
     
+    /* A compiled model answers inline */
+    if (ai_model_decide(request, response)) {
+        __sync_fetch_and_add(&ai_state.stats[hook_type].decisions_ai, 1);
+        ai_record_latency(hook_type, ai_get_timestamp() - start_time);
+        return STATUS_OK;
+    }
+    
     /* Check cache if requested */
     if (request->use_cache) {
         ai_decision_cache_t* cache = &ai_state.decision_caches[hook_type];
@@ -355,27 +456,12 @@ status_t ai_request_decision(ai_decision_request_t* request,
         ai_unlock(&cache->lock);
     }
     
-    /* If AI service is registered, send IPC request */
-    if (ai_state.ai_service_registered) {
-        /* TODO: Implement IPC communication with userspace AI service */
-        /* For now, return fallback */
-        __sync_fetch_and_add(&ai_state.stats[hook_type].decisions_fallback, 1);
-        response->decision_id = 0;
-        response->confidence = 0;
-        response->cache_result = false;
-        
-        uint64_t end_time = ai_get_timestamp();
-        uint64_t latency = end_time - start_time;
-        
-        __sync_fetch_and_add(&ai_state.stats[hook_type].total_latency_ns, latency);
-        if (latency > ai_state.stats[hook_type].max_latency_ns) {
-            ai_state.stats[hook_type].max_latency_ns = latency;
-        }
-        
-        return STATUS_OK;
-    }
+    /*
+     * No model: the request is not forwarded synchronously. It becomes a
+     * retraining sample for the service, which pushes a model back.
+     */
+    ai_decision_miss(request);
     
-    /* No AI service, return fallback */
     __sync_fetch_and_add(&ai_state.stats[hook_type].decisions_fallback, 1);
     response->decision_id = 0;
     response->confidence = 0;
@@ -392,7 +478,19 @@ status_t ai_request_decision_async(ai_decision_request_t* request,
         return STATUS_INVALID;
     }
     
-    /* TODO: Implement async decision support */
+    if (request->hook_type >= AI_HOOK_COUNT) {
+        return STATUS_INVALID;
+    }
+    
+    /* Models answer immediately; anything else waits for a retrained model */
+    ai_decision_response_t response;
+    if (g_ai_decision_enabled && ai_model_decide(request, &response)) {
+        __sync_fetch_and_add(&ai_state.stats[request->hook_type].decisions_ai, 1);
+        callback(&response, user_data);
+        return STATUS_OK;
+    }
+    
+    ai_decision_miss(request);
     return STATUS_NOSUPPORT;
 }
 
@@ -462,3 +560,351 @@ status_t ai_unregister_hook(ai_hook_type_t type) {
     
     return STATUS_OK;
 }
+
+/* ============================================================================
+ * Compiled decision models
+ * ============================================================================ */
+
+/* Forward-only children, leaves reachable within AI_MODEL_MAX_DEPTH */
+static status_t ai_model_verify_tree(const ai_model_node_t* nodes, uint32_t count) {
+    uint8_t depth[AI_MODEL_MAX_NODES];
+
+    for (uint32_t i = count; i-- > 0;) {
+        const ai_model_node_t* node = &nodes[i];
+        if (node->confidence > 100) {
+            return STATUS_INVALID;
+        }
+        if (node->feature == AI_MODEL_LEAF) {
+            depth[i] = 1;
+            continue;
+        }
+        if (node->feature >= AI_MODEL_INPUTS ||
+            node->left <= i || node->left >= count || node->right <= i || node->right >= count) {
+            return STATUS_INVALID;
+        }
+        uint32_t d = 1 + MAX(depth[node->left], depth[node->right]);
+        if (d > AI_MODEL_MAX_DEPTH) {
+            return STATUS_INVALID;
+        }
+        depth[i] = (uint8_t)d;
+    }
+    return STATUS_OK;
+}
+
+static status_t ai_model_verify(const ai_model_header_t* header, const void* payload, size_t size) {
+    if (header->magic != AI_MODEL_MAGIC || header->kind >= AI_MODEL_KIND_COUNT ||
+        header->confidence > 100) {
+        return STATUS_INVALID;
+    }
+
+    switch (header->kind) {
+    case AI_MODEL_TREE:
+        if (header->count == 0 || header->count > AI_MODEL_MAX_NODES ||
+            size != header->count * sizeof(ai_model_node_t)) {
+            return STATUS_INVALID;
+        }
+        return ai_model_verify_tree((const ai_model_node_t*)payload, header->count);
+
+    case AI_MODEL_LINEAR: {
+        if (size != sizeof(ai_model_linear_t)) {
+            return STATUS_INVALID;
+        }
+        /* 8 x 2^15 x 2^31 plus the bias stays well inside 63 bits */
+        const ai_model_linear_t* linear = (const ai_model_linear_t*)payload;
+        const int64_t bias_limit = 1LL << 50;
+        if (linear->shift > 62 || linear->min > linear->max ||
+            linear->bias > bias_limit || linear->bias < -bias_limit) {
+            return STATUS_INVALID;
+        }
+        return STATUS_OK;
+    }
+
+    case AI_MODEL_TABLE: {
+        if (size < sizeof(ai_model_table_t)) {
+            return STATUS_INVALID;
+        }
+        const ai_model_table_t* table = (const ai_model_table_t*)payload;
+        uint32_t entries = (uint32_t)table->rows * table->cols;
+        if (table->rows == 0 || table->cols == 0 || entries > AI_MODEL_MAX_ENTRIES ||
+            entries != header->count || size != sizeof(ai_model_table_t) + entries * sizeof(int32_t) ||
+            table->feature[0] >= AI_MODEL_INPUTS || table->feature[1] >= AI_MODEL_INPUTS ||
+            table->shift[0] > 63 || table->shift[1] > 63) {
+            return STATUS_INVALID;
+        }
+        return STATUS_OK;
+    }
+    }
+    return STATUS_INVALID;
+}
+
+/* Verify a blob and build a private copy */
+status_t ai_model_compile(const void* blob, size_t size, ai_model_t** out) {
+    if (!blob || !out || size < sizeof(ai_model_header_t) || size > AI_MODEL_MAX_BLOB) {
+        return STATUS_INVALID;
+    }
+
+    ai_model_header_t header;
+    memcpy(&header, blob, sizeof(header));
+    size_t payload_size = size - sizeof(header);
+
+    size_t pages = PAGES_FOR(sizeof(ai_model_t) + payload_size);
+    ai_model_t* model = (ai_model_t*)pmm_alloc_pages(pages);
+    if (!model) {
+        return STATUS_NOMEM;
+    }
+
+    /* Verify the copy, so the service cannot change the blob in between */
+    memcpy(model->payload, (const uint8_t*)blob + sizeof(header), payload_size);
+    status_t status = ai_model_verify(&header, model->payload, payload_size);
+    if (FAILED(status)) {
+        pmm_free_pages((paddr_t)model, pages);
+        return status;
+    }
+
+    model->header = header;
+    model->pages = pages;
+    model->nodes = NULL;
+    model->entries = NULL;
+    if (header.kind == AI_MODEL_TREE) {
+        model->nodes = (const ai_model_node_t*)model->payload;
+    } else if (header.kind == AI_MODEL_LINEAR) {
+        memcpy(&model->linear, model->payload, sizeof(model->linear));
+    } else {
+        memcpy(&model->table, model->payload, sizeof(model->table));
+        model->entries = (const int32_t*)((const uint8_t*)model->payload + sizeof(ai_model_table_t));
+    }
+
+    *out = model;
+    return STATUS_OK;
+}
+
+void ai_model_free(ai_model_t* model) {
+    if (model) {
+        pmm_free_pages((paddr_t)model, model->pages);
+    }
+}
+
+/* Publish model (NULL removes) and return the old one once no reader holds it */
+ai_model_t* ai_model_swap(ai_hook_type_t hook_type, ai_model_t* model) {
+    if (hook_type >= AI_HOOK_COUNT) {
+        return model;
+    }
+
+    ai_lock(&ai_models.lock);
+    ai_model_t* old = __atomic_exchange_n(&ai_models.models[hook_type], model, __ATOMIC_SEQ_CST);
+    if (model) {
+        __atomic_or_fetch(&g_ai_model_mask, 1u << hook_type, __ATOMIC_RELEASE);
+    } else {
+        __atomic_and_fetch(&g_ai_model_mask, ~(1u << hook_type), __ATOMIC_RELEASE);
+    }
+    ai_state.stats[hook_type].model_version = model ? model->header.version : 0;
+    epoch_synchronize(&ai_models.readers);
+    ai_unlock(&ai_models.lock);
+
+    return old;
+}
+
+/* Compile, swap in and free the old model; the service's entry point */
+status_t ai_model_install(ai_hook_type_t hook_type, const void* blob, size_t size) {
+    if (hook_type >= AI_HOOK_COUNT) {
+        return STATUS_INVALID;
+    }
+
+    ai_model_t* model;
+    status_t status = ai_model_compile(blob, size, &model);
+    if (FAILED(status)) {
+        KLOG_INFO("AI", "Rejected model for hook %u (%d)", hook_type, status);
+        return status;
+    }
+
+    ai_model_header_t header = model->header;
+    ai_model_free(ai_model_swap(hook_type, model));
+    ai_invalidate_cache(hook_type);
+
+    KLOG_INFO("AI", "Installed model v%u for hook %u (kind %u, %u entries)",
+              header.version, hook_type, header.kind, header.count);
+    return STATUS_OK;
+}
+
+status_t ai_model_remove(ai_hook_type_t hook_type) {
+    if (hook_type >= AI_HOOK_COUNT) {
+        return STATUS_INVALID;
+    }
+    ai_model_free(ai_model_swap(hook_type, NULL));
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Control channel
+ * ============================================================================ */
+
+static void ai_control_drop_staging(void) {
+    if (ai_state.staging) {
+        pmm_free_pages((paddr_t)ai_state.staging, ai_state.staging_pages);
+        ai_state.staging = NULL;
+    }
+}
+
+static status_t ai_control_begin(const ai_control_msg_t* msg) {
+    if (msg->hook >= AI_HOOK_COUNT || msg->size < sizeof(ai_model_header_t) ||
+        msg->size > AI_MODEL_MAX_BLOB) {
+        return STATUS_INVALID;
+    }
+
+    ai_control_drop_staging();
+    size_t pages = PAGES_FOR(msg->size);
+    ai_state.staging = (uint8_t*)pmm_alloc_pages(pages);
+    if (!ai_state.staging) {
+        return STATUS_NOMEM;
+    }
+    ai_state.staging_pages = pages;
+    ai_state.staging_size = msg->size;
+    ai_state.staged = 0;
+    ai_state.staging_hook = (ai_hook_type_t)msg->hook;
+    return STATUS_OK;
+}
+
+/* Chunks arrive in order, so a lost one is caught rather than left as a hole */
+static status_t ai_control_data(const ai_control_msg_t* msg) {
+    if (!ai_state.staging || msg->offset != ai_state.staged || msg->len > AI_CONTROL_CHUNK ||
+        msg->len > ai_state.staging_size - ai_state.staged) {
+        return STATUS_INVALID;
+    }
+    memcpy(ai_state.staging + msg->offset, msg->data, msg->len);
+    ai_state.staged += msg->len;
+    return STATUS_OK;
+}
+
+static status_t ai_control_commit(void) {
+    if (!ai_state.staging || ai_state.staged != ai_state.staging_size) {
+        return STATUS_INVALID;
+    }
+    status_t status = ai_model_install(ai_state.staging_hook, ai_state.staging, ai_state.staging_size);
+    ai_control_drop_staging();
+    return status;
+}
+
+static void ai_control_handle(const ipc_message_t* msg, ai_control_reply_t* reply) {
+    ai_control_msg_t req;
+    if (msg->sender != ai_state.service_pid) {
+        reply->status = STATUS_DENIED;
+        return;
+    }
+    if (msg->size < sizeof(req)) {
+        reply->status = STATUS_INVALID;
+        return;
+    }
+    memcpy(&req, msg->data, sizeof(req));
+
+    switch (req.op) {
+    case AI_CONTROL_MODEL_BEGIN:
+        reply->status = ai_control_begin(&req);
+        break;
+    case AI_CONTROL_MODEL_DATA:
+        reply->status = ai_control_data(&req);
+        break;
+    case AI_CONTROL_MODEL_COMMIT:
+        reply->status = ai_control_commit();
+        break;
+    case AI_CONTROL_MODEL_REMOVE:
+        reply->status = ai_model_remove((ai_hook_type_t)req.hook);
+        break;
+    case AI_CONTROL_SCHED_BENCH: {
+        /* A complete staged blob is benchmarked instead of installed */
+        bool staged = ai_state.staging && ai_state.staged == ai_state.staging_size;
+        reply->status = sched_ai_benchmark(req.offset, req.len, staged ? ai_state.staging : NULL,
+                                           staged ? ai_state.staging_size : 0, &reply->bench);
+        break;
+    }
+    default:
+        reply->status = STATUS_NOSUPPORT;
+        break;
+    }
+}
+
+void ai_hooks_poll(void) {
+    if (!ai_state.initialized || !ai_state.ai_service_registered) {
+        return;
+    }
+
+    ipc_message_t msg;
+    for (uint32_t i = 0; i < AI_CONTROL_BATCH; i++) {
+        if (FAILED(ipc_receive(ai_state.control_endpoint, &msg, 0))) {
+            return;
+        }
+
+        ai_control_reply_t reply = {0};
+        ai_control_handle(&msg, &reply);
+        ipc_reply(ai_state.ai_service_endpoint, msg.id, &reply, sizeof(reply));
+    }
+}
+
+static ALWAYS_INLINE int64_t ai_model_saturate32(int64_t x) {
+    return x > INT32_MAX ? INT32_MAX : (x < INT32_MIN ? INT32_MIN : x);
+}
+
+/* Scale an input down and clamp it to [0, limit) */
+static ALWAYS_INLINE uint32_t ai_model_index(int64_t x, uint8_t shift, uint16_t limit) {
+    if (x <= 0) {
+        return 0;
+    }
+    uint64_t i = (uint64_t)x >> shift;
+    return i >= limit ? limit - 1u : (uint32_t)i;
+}
+
+/* At most AI_MODEL_MAX_DEPTH compares, AI_MODEL_INPUTS multiplies or one lookup */
+static void ai_model_run(const ai_model_t* model, const int64_t* input, ai_model_result_t* result) {
+    result->version = model->header.version;
+    result->confidence = model->header.confidence;
+
+    switch (model->header.kind) {
+    case AI_MODEL_TREE: {
+        const ai_model_node_t* node = &model->nodes[0];
+        for (uint32_t d = 1; d < AI_MODEL_MAX_DEPTH && node->feature != AI_MODEL_LEAF; d++) {
+            node = &model->nodes[input[node->feature] <= node->value ? node->left : node->right];
+        }
+        result->value = node->value;
+        result->confidence = node->confidence;
+        break;
+    }
+
+    case AI_MODEL_LINEAR: {
+        const ai_model_linear_t* linear = &model->linear;
+        int64_t sum = linear->bias;
+        for (uint32_t i = 0; i < AI_MODEL_INPUTS; i++) {
+            sum += linear->weights[i] * ai_model_saturate32(input[i]);
+        }
+        sum >>= linear->shift;
+        result->value = MIN(MAX(sum, linear->min), linear->max);
+        break;
+    }
+
+    default: {
+        const ai_model_table_t* table = &model->table;
+        uint32_t row = ai_model_index(input[table->feature[0]], table->shift[0], table->rows);
+        uint32_t col = ai_model_index(input[table->feature[1]], table->shift[1], table->cols);
+        result->value = model->entries[row * table->cols + col];
+        break;
+    }
+    }
+}
+
+/* Evaluate the installed model; false if there is none */
+bool ai_model_eval(ai_hook_type_t hook_type, const int64_t input[AI_MODEL_INPUTS],
+                   ai_model_result_t* result) {
+    if (hook_type >= AI_HOOK_COUNT) {
+        return false;
+    }
+
+    uint32_t reader = epoch_read_lock(&ai_models.readers);
+    const ai_model_t* model = __atomic_load_n(&ai_models.models[hook_type], __ATOMIC_ACQUIRE);
+    if (model) {
+        ai_model_run(model, input, result);
+    }
+    epoch_read_unlock(&ai_models.readers, reader);
+
+    if (model) {
+        __atomic_fetch_add(&ai_state.stats[hook_type].decisions_model, 1, __ATOMIC_RELAXED);
+    }
+    return model != NULL;
+}
@@ -8,6 +8,7 @@
 #include "vmm.h"
 #include "e1000.h"
 #include "net.h"
+#include "qdisc.h"
 #include "hal.h"
 
 /* Global e1000 device (supports single device for now) */
@@ -147,6 +148,7 @@ status_t e1000_init_tx(e1000_device_t* dev) {
         }
 
         dev->tx_buffers[i] = (uint8_t*)PHYS_TO_VIRT_DIRECT(buf_phys);
+        dev->tx_phys[i] = buf_phys;
         dev->tx_descs[i].buffer_addr = buf_phys;
         dev->tx_descs[i].status = E1000_TXD_STAT_DD;
         dev->tx_descs[i].cmd = 0;
@@ -161,6 +163,7 @@ status_t e1000_init_tx(e1000_device_t* dev) {
     e1000_write_reg(dev, E1000_REG_TDH, 0);
     e1000_write_reg(dev, E1000_REG_TDT, 0);
     dev->tx_tail = 0;
+    dev->tx_clean = 0;
 
     /* Enable transmitter */
     uint32_t tctl = E1000_TCTL_EN |     // Enable
@@ -173,7 +176,45 @@ status_t e1000_init_tx(e1000_device_t* dev) {
     return STATUS_OK;
 }
 
-/* Send packet */
+/* Reap descriptors the hardware has finished with; caller holds dev->lock */
+static uint32_t e1000_tx_clean(e1000_device_t* dev, uint32_t* out_packets) {
+    uint32_t bytes = 0;
+    uint32_t packets = 0;
+
+    while (dev->tx_clean != dev->tx_tail) {
+        uint16_t first = dev->tx_clean;
+        uint16_t eop = dev->tx_eop[first];
+        if (!(dev->tx_descs[eop].status & E1000_TXD_STAT_DD)) {
+            break;
+        }
+        bytes += dev->tx_report[first];
+        packets += dev->tx_segs[first];
+        dev->tx_clean = (eop + 1) % E1000_NUM_TX_DESC;
+    }
+
+    *out_packets = packets;
+    return bytes;
+}
+
+/* Report TX completions so the qdisc can refill the ring */
+static void e1000_tx_reclaim(net_interface_t* iface) {
+    e1000_device_t* dev = (e1000_device_t*)iface->driver_data;
+
+    if (!dev || !dev->initialized) {
+        return;
+    }
+
+    uint32_t packets;
+    __sync_lock_test_and_set(&dev->lock, 1);
+    uint32_t bytes = e1000_tx_clean(dev, &packets);
+    __sync_lock_release(&dev->lock);
+
+    if (packets) {
+        net_tx_complete(iface, packets, bytes);
+    }
+}
+
+/* Send packet; STATUS_BUSY when the ring is full */
 status_t e1000_send_packet(net_interface_t* iface, const void* data, size_t length) {
     e1000_device_t* dev = (e1000_device_t*)iface->driver_data;
 
@@ -183,25 +224,39 @@ status_t e1000_send_packet(net_interface_t* iface, const void* data, size_t leng
 
     __sync_lock_test_and_set(&dev->lock, 1);
 
-    /* Get next TX descriptor */
-    uint16_t tail = dev->tx_tail;
-    e1000_tx_desc_t* desc = &dev->tx_descs[tail];
+    uint32_t packets;
+    uint32_t bytes = e1000_tx_clean(dev, &packets);
 
-    /* Wait if descriptor is in use */
-    while (!(desc->status & E1000_TXD_STAT_DD)) {
-        /* Descriptor not ready, would need timeout */
+    /* One descriptor stays unused so a full ring is distinguishable from an empty one */
+    uint16_t tail = dev->tx_tail;
+    if ((tail + 1) % E1000_NUM_TX_DESC == dev->tx_clean) {
+        __sync_lock_release(&dev->lock);
+        if (packets) {
+            net_tx_complete(iface, packets, bytes);
+        }
+        return STATUS_BUSY;
     }
 
+    e1000_tx_desc_t* desc = &dev->tx_descs[tail];
+
     /* Copy data to buffer */
     uint8_t* buffer = dev->tx_buffers[tail];
     for (size_t i = 0; i < length; i++) {
         buffer[i] = ((const uint8_t*)data)[i];
     }
 
-    /* Setup descriptor */
+    /* Setup descriptor; a context descriptor may have used the slot last */
+    desc->buffer_addr = dev->tx_phys[tail];
     desc->length = length;
+    desc->cso = 0;
     desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS;
     desc->status = 0;
+    desc->css = 0;
+    desc->special = 0;
+
+    dev->tx_eop[tail] = tail;
+    dev->tx_segs[tail] = 1;
+    dev->tx_report[tail] = (uint32_t)length;
 
     /* Update tail */
     dev->tx_tail = (tail + 1) % E1000_NUM_TX_DESC;
@@ -209,6 +264,122 @@ status_t e1000_send_packet(net_interface_t* iface, const void* data, size_t leng
 
     __sync_lock_release(&dev->lock);
 
+    if (packets) {
+        net_tx_complete(iface, packets, bytes);
+    }
+
+    return STATUS_OK;
+}
+
+/*
+ * TCP segmentation offload: one context descriptor describing the headers,
+ * then the super-packet copied across as many data descriptors as it needs.
+ * The NIC replicates the headers for every MSS-sized segment and fills in
+ * IP length, IP ID, sequence number and both checksums.
+ */
+status_t e1000_send_tso(net_interface_t* iface, net_buffer_t* buf) {
+    e1000_device_t* dev = (e1000_device_t*)iface->driver_data;
+
+    if (!dev || !dev->initialized || buf->gso_type != NET_GSO_TCPV4 ||
+        buf->length > sizeof(eth_header_t) + NET_GSO_MAX_SIZE) {
+        return STATUS_INVALID;
+    }
+
+    const uint8_t* head = net_buffer_head(buf);
+    size_t l3 = sizeof(eth_header_t);
+    if (buf->length < l3 + sizeof(ipv4_header_t)) {
+        return STATUS_INVALID;
+    }
+    const ipv4_header_t* ip = (const ipv4_header_t*)(head + l3);
+    size_t l4 = l3 + (size_t)(ip->version_ihl & 0x0F) * 4;
+    if (ip->protocol != IP_PROTO_TCP || buf->length < l4 + sizeof(tcp_header_t)) {
+        return STATUS_INVALID;
+    }
+    const tcp_header_t* tcp = (const tcp_header_t*)(head + l4);
+    size_t hdr_len = l4 + (size_t)(tcp->data_offset_reserved >> 4) * 4;
+    if (hdr_len > buf->length || hdr_len > 255) {
+        return STATUS_INVALID;
+    }
+
+    uint32_t data_descs = (uint32_t)((buf->length + PAGE_SIZE - 1) / PAGE_SIZE);
+
+    __sync_lock_test_and_set(&dev->lock, 1);
+
+    uint32_t packets;
+    uint32_t bytes = e1000_tx_clean(dev, &packets);
+
+    uint16_t first = dev->tx_tail;
+    uint32_t free = (dev->tx_clean + E1000_NUM_TX_DESC - first - 1) % E1000_NUM_TX_DESC;
+    if (free < 1 + data_descs) {
+        __sync_lock_release(&dev->lock);
+        if (packets) {
+            net_tx_complete(iface, packets, bytes);
+        }
+        return STATUS_BUSY;
+    }
+
+    /* Context descriptor */
+    e1000_tx_ctx_desc_t* ctx = (e1000_tx_ctx_desc_t*)&dev->tx_descs[first];
+    ctx->ipcss = (uint8_t)l3;
+    ctx->ipcso = (uint8_t)(l3 + 10);
+    ctx->ipcse = (uint16_t)(l4 - 1);
+    ctx->tucss = (uint8_t)l4;
+    ctx->tucso = (uint8_t)(l4 + 16);
+    ctx->tucse = 0;
+    ctx->cmd_and_length = (uint32_t)(buf->length - hdr_len) | E1000_TXD_DCMD_DEXT |
+                          E1000_TXD_DCMD_TSE | E1000_TXD_TUCMD_IP | E1000_TXD_TUCMD_TCP;
+    ctx->status = 0;
+    ctx->hdr_len = (uint8_t)hdr_len;
+    ctx->mss = buf->gso_size;
+
+    /* Data descriptors */
+    uint16_t slot = first;
+    size_t off = 0;
+    while (off < buf->length) {
+        slot = (slot + 1) % E1000_NUM_TX_DESC;
+        size_t chunk = buf->length - off < PAGE_SIZE ? buf->length - off : PAGE_SIZE;
+        memcpy(dev->tx_buffers[slot], head + off, chunk);
+
+        if (off == 0) {
+            /* The NIC sums each segment on top of a pseudo-header without
+             * the length, and writes IP total length and checksum itself */
+            uint8_t* frame = dev->tx_buffers[slot];
+            ipv4_header_t* hip = (ipv4_header_t*)(frame + l3);
+            tcp_header_t* htcp = (tcp_header_t*)(frame + l4);
+            uint8_t pseudo[12] = {0};
+            memcpy(pseudo, hip->src.addr, 4);
+            memcpy(pseudo + 4, hip->dst.addr, 4);
+            pseudo[9] = IP_PROTO_TCP;
+            hip->total_length = 0;
+            hip->checksum = 0;
+            htcp->checksum = (uint16_t)~ip_checksum(pseudo, sizeof(pseudo));
+        }
+
+        e1000_tx_data_desc_t* desc = (e1000_tx_data_desc_t*)&dev->tx_descs[slot];
+        desc->buffer_addr = dev->tx_phys[slot];
+        desc->cmd_and_length = (uint32_t)chunk | E1000_TXD_DTYP_D | E1000_TXD_DCMD_DEXT |
+                               E1000_TXD_DCMD_TSE | E1000_TXD_DCMD_IFCS;
+        desc->status = 0;
+        desc->popts = E1000_TXD_POPTS_IXSM | E1000_TXD_POPTS_TXSM;
+        desc->special = 0;
+        off += chunk;
+    }
+    ((e1000_tx_data_desc_t*)&dev->tx_descs[slot])->cmd_and_length |=
+        E1000_TXD_DCMD_EOP | E1000_TXD_DCMD_RS;
+
+    dev->tx_eop[first] = slot;
+    dev->tx_segs[first] = (uint16_t)net_gso_segments(buf);
+    dev->tx_report[first] = (uint32_t)buf->length;
+
+    dev->tx_tail = (slot + 1) % E1000_NUM_TX_DESC;
+    e1000_write_reg(dev, E1000_REG_TDT, dev->tx_tail);
+
+    __sync_lock_release(&dev->lock);
+
+    if (packets) {
+        net_tx_complete(iface, packets, bytes);
+    }
+
     return STATUS_OK;
 }
 
@@ -246,6 +417,12 @@ void e1000_receive_packets(e1000_device_t* dev) {
     }
 
     dev->rx_tail = tail;
+
+    /* Hand up whatever GRO merged during this poll */
+    net_gro_flush(dev->iface);
+
+    /* Reap TX completions on the same poll */
+    e1000_tx_reclaim(dev->iface);
 }
 
 /* Detect e1000 devices using HAL PCI */
@@ -381,7 +558,6 @@ status_t e1000_init_device(uintptr_t mmio_base, size_t mmio_size) {
 
     /* Register network interface */
     net_interface_t iface = {0};
-    iface.id = 0;
 
     /* Copy name */
     const char* name = "eth0";
@@ -391,6 +567,9 @@ status_t e1000_init_device(uintptr_t mmio_base, size_t mmio_size) {
 
     mac_addr_copy(&iface.mac, &dev->mac);
     iface.send = e1000_send_packet;
+    iface.send_gso = e1000_send_tso;
+    iface.tx_reclaim = e1000_tx_reclaim;
+    iface.features = NET_F_TSO | NET_F_GRO;
     iface.driver_data = dev;
     iface.up = false;
 
@@ -399,9 +578,12 @@ status_t e1000_init_device(uintptr_t mmio_base, size_t mmio_size) {
         return result;
     }
 
-    dev->iface = net_get_interface(0);
+    dev->iface = net_get_interface(iface.id);
     dev->initialized = true;
 
+    /* Completions are reported, so the qdisc can keep the ring short */
+    net_bql_enable(dev->iface, (E1000_NUM_TX_DESC - 1) * NET_BUF_SIZE);
+
     KLOG_INFO("E1000", "Device initialized and registered as eth0");
     return STATUS_OK;
 }
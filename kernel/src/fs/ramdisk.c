@@ -40,6 +40,7 @@ static ssize_t ramdisk_write(vfs_node_t* node, const void* buffer, size_t size,
 static status_t ramdisk_open(vfs_node_t* node, uint32_t flags);
 static status_t ramdisk_close(vfs_node_t* node);
 static status_t ramdisk_truncate(vfs_node_t* node, uint64_t size);
+static status_t ramdisk_allocate(vfs_node_t* node, uint32_t mode, uint64_t offset, uint64_t len);
 
 static status_t ramdisk_lookup(vfs_node_t* dir, const char* name, vfs_node_t** out_node);
 static status_t ramdisk_create(vfs_node_t* dir, const char* name, uint32_t mode, vfs_node_t** out_node);
@@ -59,6 +60,7 @@ static vfs_file_ops_t ramdisk_file_ops = {
     .truncate = ramdisk_truncate,
     .ioctl = NULL,
     .flush = NULL,
+    .allocate = ramdisk_allocate,
 };
 
 /* Directory operations */
@@ -186,6 +188,7 @@ static status_t ramdisk_mount(vfs_mount_t* mount, const char* device, uint32_t f
     root->parent_inode = 0;
 
     mount->private_data = fs;
+    mount->flags |= VFS_MOUNT_MEMORY;
 
     KLOG_INFO("RAMDISK", "Mounted ramdisk filesystem");
     return STATUS_OK;
@@ -227,15 +230,40 @@ static ssize_t ramdisk_read(vfs_node_t* node, void* buffer, size_t size, uint64_
         to_read = file->size - offset;
     }
 
-    uint8_t* src = file->data + offset;
-    uint8_t* dest = (uint8_t*)buffer;
-    for (size_t i = 0; i < to_read; i++) {
-        dest[i] = src[i];
-    }
+    memcpy(buffer, file->data + offset, to_read);
 
     return to_read;
 }
 
+/* Grow backing store to hold at least 'end' bytes; new space reads as zero */
+static status_t ramdisk_reserve(ramdisk_file_t* file, uint64_t end) {
+    if (end > RAMDISK_MAX_FILE_SIZE) {
+        return STATUS_NOMEM;
+    }
+
+    if (end > file->capacity) {
+        /* Grow geometrically so appends do not recopy the file every block */
+        uint64_t want = MAX(end, MIN(file->capacity * 2, (uint64_t)RAMDISK_MAX_FILE_SIZE));
+        uint64_t new_capacity = ((want + RAMDISK_BLOCK_SIZE - 1) / RAMDISK_BLOCK_SIZE) * RAMDISK_BLOCK_SIZE;
+        uint8_t* new_data = (uint8_t*)pmm_alloc_pages((new_capacity + PAGE_SIZE - 1) / PAGE_SIZE);
+
+        if (!new_data) {
+            return STATUS_NOMEM;
+        }
+
+        if (file->data) {
+            memcpy(new_data, file->data, file->size);
+            pmm_free_pages((paddr_t)file->data, (file->capacity + PAGE_SIZE - 1) / PAGE_SIZE);
+        }
+        memset(new_data + file->size, 0, new_capacity - file->size);
+
+        file->data = new_data;
+        file->capacity = new_capacity;
+    }
+
+    return STATUS_OK;
+}
+
 /* Write to file */
 static ssize_t ramdisk_write(vfs_node_t* node, const void* buffer, size_t size, uint64_t offset) {
     if (!node || !buffer) {
@@ -247,45 +275,43 @@ static ssize_t ramdisk_write(vfs_node_t* node, const void* buffer, size_t size,
         return -1;
     }
 
-    /* Check size limit */
-    if (offset + size > RAMDISK_MAX_FILE_SIZE) {
+    if (FAILED(ramdisk_reserve(file, offset + size))) {
         return -1;
     }
 
-    /* Expand if needed */
-    if (offset + size > file->capacity) {
-        uint64_t new_capacity = ((offset + size + RAMDISK_BLOCK_SIZE - 1) / RAMDISK_BLOCK_SIZE) * RAMDISK_BLOCK_SIZE;
-        uint8_t* new_data = (uint8_t*)pmm_alloc_pages((new_capacity + PAGE_SIZE - 1) / PAGE_SIZE);
+    /* Write data */
+    memcpy(file->data + offset, buffer, size);
 
-        if (!new_data) {
-            return -1;
-        }
+    if (offset + size > file->size) {
+        file->size = offset + size;
+        node->size = file->size;
+    }
 
-        if (file->data) {
-            /* Copy old data */
-            for (uint64_t i = 0; i < file->size; i++) {
-                new_data[i] = file->data[i];
-            }
-            pmm_free_pages((paddr_t)file->data, (file->capacity + PAGE_SIZE - 1) / PAGE_SIZE);
-        }
+    return size;
+}
 
-        file->data = new_data;
-        file->capacity = new_capacity;
+/* Preallocate a range */
+static status_t ramdisk_allocate(vfs_node_t* node, uint32_t mode, uint64_t offset, uint64_t len) {
+    if (!node) {
+        return STATUS_INVALID;
     }
 
-    /* Write data */
-    const uint8_t* src = (const uint8_t*)buffer;
-    uint8_t* dest = file->data + offset;
-    for (size_t i = 0; i < size; i++) {
-        dest[i] = src[i];
+    ramdisk_file_t* file = (ramdisk_file_t*)node->private_data;
+    if (!file) {
+        return STATUS_INVALID;
     }
 
-    if (offset + size > file->size) {
-        file->size = offset + size;
+    status_t status = ramdisk_reserve(file, offset + len);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    if (!(mode & VFS_ALLOC_KEEP_SIZE) && offset + len > file->size) {
+        file->size = offset + len;
         node->size = file->size;
     }
 
-    return size;
+    return STATUS_OK;
 }
 
 /* Open file */
@@ -313,6 +339,11 @@ static status_t ramdisk_truncate(vfs_node_t* node, uint64_t size) {
         return STATUS_INVALID;
     }
 
+    /* Clear the dropped tail so a later extension reads zeroes */
+    if (size < file->size) {
+        memset(file->data + size, 0, file->size - size);
+    }
+
     file->size = size;
     node->size = size;
 
@@ -5,6 +5,7 @@
 
 #include "kernel.h"
 #include "microkernel.h"
+#include "process.h"
 
 #define MAX_IPC_ENDPOINTS 4096
 #define MAX_PENDING_MESSAGES 256
@@ -21,6 +22,8 @@ typedef struct ipc_endpoint_impl {
     uint32_t queue_head;
     uint32_t queue_tail;
     uint32_t queue_count;
+    thread_t** callers;         /* Synchronous sender of each queued message */
+    thread_t* server;           /* Last thread to receive here */
 
     /* Waiting threads */
     struct list_head waiting_senders;
@@ -42,6 +45,15 @@ typedef struct ipc_pending_msg {
     struct list_head list_node;
 } ipc_pending_msg_t;
 
+/* Synchronous request received but not yet replied to */
+typedef struct ipc_call {
+    ipc_endpoint_impl_t* ep;
+    ipc_msg_id_t msg_id;
+    thread_t* caller;
+    thread_t* server;
+    bool in_use;
+} ipc_call_t;
+
 /* Global IPC state */
 static struct {
     ipc_endpoint_impl_t endpoints[MAX_IPC_ENDPOINTS];
@@ -54,6 +66,10 @@ static struct {
     uint64_t total_messages_sent;
     uint64_t total_messages_received;
     uint64_t total_endpoints_created;
+
+    /* Requests in service, for priority donation */
+    ipc_call_t calls[IPC_MAX_CALLS];
+    uint32_t call_lock;
 } ipc_state = {0};
 
 /* Initialize IPC subsystem */
@@ -67,6 +83,7 @@ status_t ipc_init(void) {
         ipc_state.endpoints[i].id = 0;
         ipc_state.endpoints[i].active = false;
         ipc_state.endpoints[i].queue = NULL;
+        ipc_state.endpoints[i].callers = NULL;
         list_init(&ipc_state.endpoints[i].waiting_senders);
         list_init(&ipc_state.endpoints[i].waiting_receivers);
     }
@@ -133,6 +150,16 @@ status_t ipc_endpoint_create(ipc_endpoint_t* out_endpoint) {
         return STATUS_NOMEM;
     }
 
+    ep->callers = (thread_t**)pmm_alloc_pages((sizeof(thread_t*) * ep->queue_size + PAGE_SIZE - 1) / PAGE_SIZE);
+    if (!ep->callers) {
+        pmm_free_pages((paddr_t)ep->queue, (sizeof(ipc_message_t) * ep->queue_size + PAGE_SIZE - 1) / PAGE_SIZE);
+        ep->queue = NULL;
+        ep->active = false;
+        __sync_lock_release(&ipc_state.lock);
+        return STATUS_NOMEM;
+    }
+    ep->server = NULL;
+
     ep->queue_head = 0;
     ep->queue_tail = 0;
     ep->queue_count = 0;
@@ -155,6 +182,43 @@ status_t ipc_endpoint_create(ipc_endpoint_t* out_endpoint) {
     return STATUS_OK;
 }
 
+/* Higher-priority of two candidate donors; exited threads don't count */
+static thread_t* ipc_pick_donor(thread_t* best, thread_t* candidate) {
+    if (!candidate || !candidate->in_use) {
+        return best;
+    }
+    return !best || sched_prio_higher(candidate, best) ? candidate : best;
+}
+
+/*
+ * Re-derive which caller server works for: every request it is handling,
+ * plus synchronous senders still queued on ep if it serves ep. Queued
+ * callers on a server's other endpoints count again when it next receives
+ * from them.
+ */
+static void ipc_update_donor(thread_t* server, ipc_endpoint_impl_t* ep) {
+    thread_t* donor = NULL;
+
+    if (ep && ep->server == server) {
+        __sync_lock_test_and_set(&ep->lock, 1);
+        for (uint32_t i = 0; i < ep->queue_count; i++) {
+            donor = ipc_pick_donor(donor, ep->callers[(ep->queue_head + i) % ep->queue_size]);
+        }
+        __sync_lock_release(&ep->lock);
+    }
+
+    __sync_lock_test_and_set(&ipc_state.call_lock, 1);
+    for (uint32_t i = 0; i < IPC_MAX_CALLS; i++) {
+        ipc_call_t* call = &ipc_state.calls[i];
+        if (call->in_use && call->server == server) {
+            donor = ipc_pick_donor(donor, call->caller);
+        }
+    }
+    __sync_lock_release(&ipc_state.call_lock);
+
+    kmutex_pi_donate(server, donor);
+}
+
 /* Destroy IPC endpoint */
 status_t ipc_endpoint_destroy(ipc_endpoint_t endpoint_id) {
     __sync_lock_test_and_set(&ipc_state.lock, 1);
@@ -174,6 +238,22 @@ status_t ipc_endpoint_destroy(ipc_endpoint_t endpoint_id) {
         ep->queue = NULL;
     }
 
+    if (ep->callers) {
+        pmm_free_pages((paddr_t)ep->callers, (sizeof(thread_t*) * ep->queue_size + PAGE_SIZE - 1) / PAGE_SIZE);
+        ep->callers = NULL;
+    }
+
+    /* Requests in service here will never be replied to */
+    thread_t* server = ep->server;
+    ep->server = NULL;
+    __sync_lock_test_and_set(&ipc_state.call_lock, 1);
+    for (uint32_t i = 0; i < IPC_MAX_CALLS; i++) {
+        if (ipc_state.calls[i].in_use && ipc_state.calls[i].ep == ep) {
+            ipc_state.calls[i].in_use = false;
+        }
+    }
+    __sync_lock_release(&ipc_state.call_lock);
+
     /* Wake all waiting threads (they will get error) */
     while (!list_empty(&ep->waiting_senders)) {
         struct list_head* node = ep->waiting_senders.next;
@@ -194,6 +274,10 @@ status_t ipc_endpoint_destroy(ipc_endpoint_t endpoint_id) {
     __sync_lock_release(&ep->lock);
     __sync_lock_release(&ipc_state.lock);
 
+    if (server) {
+        ipc_update_donor(server, NULL);
+    }
+
     KLOG_DEBUG("IPC", "Destroyed endpoint %llu", endpoint_id);
     return STATUS_OK;
 }
@@ -235,6 +319,11 @@ status_t ipc_send(ipc_endpoint_t endpoint_id, ipc_message_t* msg, uint64_t timeo
     ep->queue[tail] = *msg;
     ep->queue[tail].sender = 0;  // Would set from current process
 
+    /* A synchronous sender waits on the server until it replies */
+    thread_t* caller = (msg->flags & IPC_FLAG_SYNC) ? sched_get_current_thread() : NULL;
+    thread_t* server = ep->server;
+    ep->callers[tail] = caller;
+
     ep->queue_tail = (tail + 1) % ep->queue_size;
     ep->queue_count++;
     ep->messages_sent++;
@@ -249,6 +338,12 @@ status_t ipc_send(ipc_endpoint_t endpoint_id, ipc_message_t* msg, uint64_t timeo
 
     __sync_lock_release(&ep->lock);
 
+    /* Raise a server already busy with a lower-priority request */
+    if (caller && server && server->in_use && caller != server &&
+        (!server->ipc_donor || sched_prio_higher(caller, server->ipc_donor))) {
+        kmutex_pi_donate(server, caller);
+    }
+
     return STATUS_OK;
 }
 
@@ -269,6 +364,12 @@ status_t ipc_receive(ipc_endpoint_t endpoint_id, ipc_message_t* msg, uint64_t ti
     __sync_lock_test_and_set(&ep->lock, 1);
     __sync_lock_release(&ipc_state.lock);
 
+    /* Whoever waits for requests here is the server callers donate to */
+    thread_t* server = sched_get_current_thread();
+    if (server) {
+        ep->server = server;
+    }
+
     /* Check if queue is empty */
     if (ep->queue_count == 0) {
         /* Queue empty - block or return */
@@ -285,6 +386,7 @@ status_t ipc_receive(ipc_endpoint_t endpoint_id, ipc_message_t* msg, uint64_t ti
     /* Get message from queue */
     uint32_t head = ep->queue_head;
     *msg = ep->queue[head];
+    thread_t* caller = ep->callers[head];
 
     ep->queue_head = (head + 1) % ep->queue_size;
     ep->queue_count--;
@@ -302,6 +404,26 @@ status_t ipc_receive(ipc_endpoint_t endpoint_id, ipc_message_t* msg, uint64_t ti
 
     __sync_lock_release(&ep->lock);
 
+    /* The server works for this caller until ipc_reply() */
+    if (server) {
+        if (caller && caller != server) {
+            __sync_lock_test_and_set(&ipc_state.call_lock, 1);
+            for (uint32_t i = 0; i < IPC_MAX_CALLS; i++) {
+                ipc_call_t* call = &ipc_state.calls[i];
+                if (!call->in_use) {
+                    call->ep = ep;
+                    call->msg_id = msg->id;
+                    call->caller = caller;
+                    call->server = server;
+                    call->in_use = true;
+                    break;
+                }
+            }
+            __sync_lock_release(&ipc_state.call_lock);
+        }
+        ipc_update_donor(server, ep);
+    }
+
     return STATUS_OK;
 }
 
@@ -323,6 +445,27 @@ status_t ipc_reply(ipc_endpoint_t endpoint_id, ipc_msg_id_t msg_id, const void*
         reply.data[i] = src[i];
     }
 
+    /* The request is done; the server stops running on the caller's behalf */
+    __sync_lock_test_and_set(&ipc_state.lock, 1);
+    ipc_endpoint_impl_t* ep = find_endpoint(endpoint_id);
+    __sync_lock_release(&ipc_state.lock);
+
+    thread_t* server = NULL;
+    __sync_lock_test_and_set(&ipc_state.call_lock, 1);
+    for (uint32_t i = 0; ep && i < IPC_MAX_CALLS; i++) {
+        ipc_call_t* call = &ipc_state.calls[i];
+        if (call->in_use && call->ep == ep && call->msg_id == msg_id) {
+            call->in_use = false;
+            server = call->server;
+            break;
+        }
+    }
+    __sync_lock_release(&ipc_state.call_lock);
+
+    if (server) {
+        ipc_update_donor(server, ep);
+    }
+
     return ipc_send(endpoint_id, &reply, 0);
 }
 
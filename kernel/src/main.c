@@ -9,6 +9,8 @@
 #include "vmm.h"
 #include "vfs.h"
 #include "process.h"
+#include "qdisc.h"
+#include "ai_hooks.h"
 
 /* Forward declarations for subsystem initialization */
 extern status_t vmm_init(void);
@@ -277,6 +279,17 @@ void kernel_main(void* boot_info_ptr) {
          * - Manage power states
          */
         __asm__ volatile("hlt");
+
+        /*
+         * Every timer tick wakes us. There is no TX-completion interrupt,
+         * so reap finished descriptors here and restart queues held back
+         * by BQL or pacing. This runs in thread context, where the qdisc
+         * locks cannot be held by the code we interrupted.
+         */
+        net_tx_poll();
+
+        /* Model installs and benchmarks requested by the AI service */
+        ai_hooks_poll();
     }
 }
 
@@ -0,0 +1,466 @@
+/*
+ * Kernel Mutexes
+ * Sleeping locks and PI futexes with transitive priority inheritance
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "process.h"
+#include "vmm.h"
+
+/* PI state for a contended futex; exists only while it has waiters */
+typedef struct futex_pi_state {
+    address_space_t* aspace;
+    uint32_t* uaddr;
+    kmutex_t mutex;
+    bool in_use;
+    struct futex_pi_state* hash_next;
+} futex_pi_state_t;
+
+/* One lock covers every owner, waiter list and blocked_on link, so chains can be walked safely */
+static uint32_t pi_lock;
+
+static futex_pi_state_t futex_pi_states[FUTEX_PI_MAX];
+static futex_pi_state_t* futex_pi_hash[FUTEX_PI_HASH];
+
+static ALWAYS_INLINE void pi_acquire(void) {
+    while (__sync_lock_test_and_set(&pi_lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+static ALWAYS_INLINE void pi_release(void) {
+    __sync_lock_release(&pi_lock);
+}
+
+/* Highest-priority thread waiting on anything this thread holds or serves */
+static thread_t* pi_top_donor(thread_t* thread) {
+    thread_t* best = thread->ipc_donor;
+    struct list_head* pos;
+
+    list_for_each(pos, &thread->pi_held) {
+        kmutex_t* mutex = list_entry(pos, kmutex_t, held_node);
+        if (list_empty(&mutex->waiters)) {
+            continue;
+        }
+        thread_t* waiter = list_entry(mutex->waiters.next, thread_t, list_node);
+        if (!best || sched_prio_higher(waiter, best)) {
+            best = waiter;
+        }
+    }
+    return best;
+}
+
+/* Queue behind every waiter of equal or higher priority; a blocked thread's list node is free */
+static void waiter_insert(kmutex_t* mutex, thread_t* thread) {
+    struct list_head* pos;
+    list_for_each(pos, &mutex->waiters) {
+        if (sched_prio_higher(thread, list_entry(pos, thread_t, list_node))) {
+            break;
+        }
+    }
+    list_add(&thread->list_node, pos->prev);
+}
+
+/*
+ * Re-derive the inherited priority of thread and of each owner it is
+ * blocked behind, re-sorting it among the waiters at every step.
+ */
+static void pi_chain_update(thread_t* thread) {
+    for (uint32_t depth = 0; thread && depth < KMUTEX_MAX_CHAIN; depth++) {
+        sched_pi_boost(thread, pi_top_donor(thread));
+
+        kmutex_t* mutex = thread->pi_blocked_on;
+        if (!mutex) {
+            break;
+        }
+        list_del(&thread->list_node);
+        waiter_insert(mutex, thread);
+        thread = mutex->owner;
+    }
+}
+
+static void kmutex_take(kmutex_t* mutex, thread_t* owner) {
+    mutex->owner = owner;
+    list_add(&mutex->held_node, &owner->pi_held);
+}
+
+/* Would blocking on mutex make thread wait for itself? */
+static bool kmutex_would_deadlock(kmutex_t* mutex, thread_t* thread) {
+    for (uint32_t depth = 0; mutex && depth < KMUTEX_MAX_CHAIN; depth++) {
+        if (mutex->owner == thread) {
+            return true;
+        }
+        mutex = mutex->owner ? mutex->owner->pi_blocked_on : NULL;
+    }
+    return false;
+}
+
+/* Sleep until the owner hands mutex over; pi_lock is held on entry and on return */
+static void kmutex_block(kmutex_t* mutex, thread_t* thread) {
+    waiter_insert(mutex, thread);
+    thread->pi_blocked_on = mutex;
+    sched_remove_thread(thread);
+    pi_chain_update(mutex->owner);
+
+    /* The handoff clears pi_blocked_on before waking us; mutex may be gone by then */
+    while (thread->pi_blocked_on) {
+        pi_release();
+        sched_schedule();
+        pi_acquire();
+    }
+}
+
+/* Pass mutex to its top waiter, or release it; returns the new owner, not yet woken */
+static thread_t* kmutex_handoff(kmutex_t* mutex) {
+    thread_t* prev = mutex->owner;
+    thread_t* next = NULL;
+
+    list_del(&mutex->held_node);
+    mutex->owner = NULL;
+
+    if (!list_empty(&mutex->waiters)) {
+        next = list_entry(mutex->waiters.next, thread_t, list_node);
+        list_del(&next->list_node);
+        next->pi_blocked_on = NULL;
+        kmutex_take(mutex, next);
+        pi_chain_update(next);
+    }
+
+    /* The old owner drops whatever it inherited through this mutex */
+    sched_pi_boost(prev, pi_top_donor(prev));
+    return next;
+}
+
+void kmutex_init(kmutex_t* mutex) {
+    mutex->owner = NULL;
+    list_init(&mutex->waiters);
+    list_init(&mutex->held_node);
+}
+
+status_t kmutex_lock(kmutex_t* mutex) {
+    thread_t* current = sched_get_current_thread();
+    if (!mutex) {
+        return STATUS_INVALID;
+    }
+    if (!current) {
+        return STATUS_BUSY;
+    }
+
+    pi_acquire();
+
+    if (!mutex->owner) {
+        kmutex_take(mutex, current);
+        pi_release();
+        return STATUS_OK;
+    }
+
+    if (kmutex_would_deadlock(mutex, current)) {
+        pi_release();
+        return STATUS_BUSY;
+    }
+
+    kmutex_block(mutex, current);
+    pi_release();
+    return STATUS_OK;
+}
+
+status_t kmutex_trylock(kmutex_t* mutex) {
+    thread_t* current = sched_get_current_thread();
+    if (!mutex) {
+        return STATUS_INVALID;
+    }
+
+    status_t status = STATUS_BUSY;
+    pi_acquire();
+    if (current && !mutex->owner) {
+        kmutex_take(mutex, current);
+        status = STATUS_OK;
+    }
+    pi_release();
+    return status;
+}
+
+status_t kmutex_unlock(kmutex_t* mutex) {
+    thread_t* current = sched_get_current_thread();
+    if (!mutex) {
+        return STATUS_INVALID;
+    }
+
+    pi_acquire();
+    if (!current || mutex->owner != current) {
+        pi_release();
+        return STATUS_DENIED;
+    }
+
+    thread_t* next = kmutex_handoff(mutex);
+    if (next) {
+        sched_add_thread(next);
+    }
+    pi_release();
+    return STATUS_OK;
+}
+
+void kmutex_pi_donate(thread_t* server, thread_t* donor) {
+    if (!server) {
+        return;
+    }
+
+    pi_acquire();
+    server->ipc_donor = donor;
+    pi_chain_update(server);
+    pi_release();
+}
+
+/* ============================================================================
+ * PI futexes
+ * ============================================================================ */
+
+static ALWAYS_INLINE uint32_t futex_bucket(address_space_t* aspace, uint32_t* uaddr) {
+    uint64_t key = ((uint64_t)(uintptr_t)uaddr >> 2) ^ ((uint64_t)(uintptr_t)aspace >> 6);
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) % FUTEX_PI_HASH;
+}
+
+/*
+ * The word must be an aligned, writable user address of the running address
+ * space; fault it in (breaking copy-on-write) so the CAS cannot fault.
+ */
+static status_t futex_check_uaddr(address_space_t* aspace, uint32_t* uaddr) {
+    vaddr_t addr = (vaddr_t)uaddr;
+    if (!aspace || aspace != vmm_get_current_address_space()) {
+        return STATUS_INVALID;
+    }
+    if ((addr & (sizeof(uint32_t) - 1)) || addr < VM_REGION_USER_START ||
+        addr >= VM_REGION_USER_END) {
+        return STATUS_INVALID;
+    }
+    return vmm_handle_fault(aspace, addr, 0x2);
+}
+
+/* Kernel view of a futex word, for updates outside its address space (NULL if unmapped) */
+static uint32_t* futex_pi_word(futex_pi_state_t* state) {
+    paddr_t phys;
+    if (FAILED(vmm_get_physical(state->aspace, (vaddr_t)state->uaddr, &phys))) {
+        return NULL;
+    }
+    return (uint32_t*)PHYS_TO_VIRT_DIRECT(phys);
+}
+
+/* Caller holds pi_lock */
+static futex_pi_state_t* futex_pi_find(address_space_t* aspace, uint32_t* uaddr) {
+    for (futex_pi_state_t* s = futex_pi_hash[futex_bucket(aspace, uaddr)]; s; s = s->hash_next) {
+        if (s->aspace == aspace && s->uaddr == uaddr) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/* Attach kernel state to a futex already owned by owner; caller holds pi_lock */
+static futex_pi_state_t* futex_pi_create(address_space_t* aspace, uint32_t* uaddr, thread_t* owner) {
+    for (uint32_t i = 0; i < FUTEX_PI_MAX; i++) {
+        futex_pi_state_t* state = &futex_pi_states[i];
+        if (state->in_use) {
+            continue;
+        }
+
+        uint32_t bucket = futex_bucket(aspace, uaddr);
+        state->aspace = aspace;
+        state->uaddr = uaddr;
+        state->in_use = true;
+        kmutex_init(&state->mutex);
+        kmutex_take(&state->mutex, owner);
+        state->hash_next = futex_pi_hash[bucket];
+        futex_pi_hash[bucket] = state;
+        return state;
+    }
+    return NULL;
+}
+
+/* Drop state with no waiters left; its owner keeps the futex through the word alone */
+static void futex_pi_free(futex_pi_state_t* state) {
+    futex_pi_state_t** link = &futex_pi_hash[futex_bucket(state->aspace, state->uaddr)];
+    while (*link != state) {
+        link = &(*link)->hash_next;
+    }
+    *link = state->hash_next;
+
+    thread_t* owner = state->mutex.owner;
+    if (owner) {
+        list_del(&state->mutex.held_node);
+        state->mutex.owner = NULL;
+        pi_chain_update(owner);
+    }
+    state->in_use = false;
+}
+
+/* Pass the futex to its top waiter and publish the new owner in word (if mapped); caller holds pi_lock */
+static void futex_pi_handoff(futex_pi_state_t* state, uint32_t* word) {
+    thread_t* next = kmutex_handoff(&state->mutex);
+    if (next) {
+        bool more = !list_empty(&state->mutex.waiters);
+        if (word) {
+            __sync_lock_test_and_set(word, (next->tid & FUTEX_TID_MASK) | (more ? FUTEX_WAITERS : 0));
+        }
+        if (!more) {
+            futex_pi_free(state);
+        }
+        sched_add_thread(next);
+    } else {
+        if (word) {
+            __sync_lock_test_and_set(word, 0);
+        }
+        futex_pi_free(state);
+    }
+}
+
+status_t futex_lock_pi(uint32_t* uaddr) {
+    thread_t* current = sched_get_current_thread();
+    if (!uaddr || !current || !current->process) {
+        return STATUS_INVALID;
+    }
+
+    address_space_t* aspace = current->process->aspace;
+    status_t status = futex_check_uaddr(aspace, uaddr);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    uint32_t tid = current->tid & FUTEX_TID_MASK;
+    uint32_t owner_tid;
+
+    pi_acquire();
+
+    /* Take it if free, otherwise make sure the owner will call futex_unlock_pi */
+    for (;;) {
+        uint32_t val = *(volatile uint32_t*)uaddr;
+        owner_tid = val & FUTEX_TID_MASK;
+
+        if (owner_tid == 0) {
+            if (__sync_bool_compare_and_swap(uaddr, val, tid | (val & FUTEX_WAITERS))) {
+                pi_release();
+                return STATUS_OK;
+            }
+            continue;
+        }
+        if (owner_tid == tid) {
+            pi_release();
+            return STATUS_BUSY;
+        }
+        if ((val & FUTEX_WAITERS) || __sync_bool_compare_and_swap(uaddr, val, val | FUTEX_WAITERS)) {
+            break;
+        }
+    }
+
+    futex_pi_state_t* state = futex_pi_find(aspace, uaddr);
+    if (!state) {
+        thread_t* owner = process_find_thread(current->process, owner_tid);
+        if (!owner) {
+            pi_release();
+            return STATUS_NOTFOUND;
+        }
+        state = futex_pi_create(aspace, uaddr, owner);
+        if (!state) {
+            pi_release();
+            return STATUS_NOMEM;
+        }
+    }
+
+    if (kmutex_would_deadlock(&state->mutex, current)) {
+        if (list_empty(&state->mutex.waiters)) {
+            futex_pi_free(state);
+        }
+        pi_release();
+        return STATUS_BUSY;
+    }
+
+    /* futex_unlock_pi() writes our TID into the word before waking us */
+    kmutex_block(&state->mutex, current);
+    pi_release();
+    return STATUS_OK;
+}
+
+status_t futex_unlock_pi(uint32_t* uaddr) {
+    thread_t* current = sched_get_current_thread();
+    if (!uaddr || !current || !current->process) {
+        return STATUS_INVALID;
+    }
+
+    status_t status = futex_check_uaddr(current->process->aspace, uaddr);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    uint32_t tid = current->tid & FUTEX_TID_MASK;
+
+    pi_acquire();
+
+    uint32_t val = *(volatile uint32_t*)uaddr;
+    if ((val & FUTEX_TID_MASK) != tid) {
+        pi_release();
+        return STATUS_DENIED;
+    }
+
+    futex_pi_state_t* state = futex_pi_find(current->process->aspace, uaddr);
+    if (!state || state->mutex.owner != current) {
+        __sync_lock_test_and_set(uaddr, 0);
+        pi_release();
+        return STATUS_OK;
+    }
+
+    futex_pi_handoff(state, uaddr);
+    pi_release();
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Thread exit
+ * ============================================================================ */
+
+/* The futex a kernel mutex belongs to, or NULL for a plain kmutex_t */
+static futex_pi_state_t* futex_pi_of(kmutex_t* mutex) {
+    uintptr_t base = (uintptr_t)futex_pi_states;
+    uintptr_t addr = (uintptr_t)mutex - offsetof(futex_pi_state_t, mutex);
+    if ((uintptr_t)mutex < base || addr >= base + sizeof(futex_pi_states) ||
+        (addr - base) % sizeof(futex_pi_state_t)) {
+        return NULL;
+    }
+    return (futex_pi_state_t*)addr;
+}
+
+void kmutex_thread_exit(thread_t* thread) {
+    if (!thread) {
+        return;
+    }
+
+    pi_acquire();
+
+    /* Withdraw a pending wait; the owner drops what it inherited from us */
+    kmutex_t* blocked = thread->pi_blocked_on;
+    if (blocked) {
+        list_del(&thread->list_node);
+        thread->pi_blocked_on = NULL;
+        futex_pi_state_t* state = futex_pi_of(blocked);
+        if (state && list_empty(&blocked->waiters)) {
+            futex_pi_free(state);
+        } else if (blocked->owner) {
+            pi_chain_update(blocked->owner);
+        }
+    }
+
+    /* Nobody will unlock what we hold: hand each mutex to its top waiter */
+    while (!list_empty(&thread->pi_held)) {
+        kmutex_t* mutex = list_entry(thread->pi_held.next, kmutex_t, held_node);
+        futex_pi_state_t* state = futex_pi_of(mutex);
+        if (state) {
+            futex_pi_handoff(state, futex_pi_word(state));
+            continue;
+        }
+        thread_t* next = kmutex_handoff(mutex);
+        if (next) {
+            sched_add_thread(next);
+        }
+    }
+
+    pi_release();
+}
@@ -0,0 +1,686 @@
+/*
+ * Packet Filter Programs
+ * Verifier, interpreter and x86-64 JIT for BPF-style filter bytecode
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "net.h"
+#include "netfilter.h"
+
+#define PAGES_FOR(bytes)  (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+typedef uint32_t (*nf_jit_fn)(const uint8_t* packet, uint32_t length, uint32_t* mem);
+
+struct net_filter {
+    uint32_t len;
+    uint32_t pages;
+    nf_jit_fn jit;
+    uint32_t jit_pages;
+    nf_insn_t insns[];
+};
+
+#if defined(ARCH_X86_64)
+static bool nf_jit_enabled = true;
+#else
+static bool nf_jit_enabled = false;
+#endif
+
+/* ============================================================================
+ * Verifier
+ * ============================================================================ */
+
+static bool nf_valid_load(const nf_insn_t* in) {
+    uint16_t size = NF_SIZE(in->code);
+    uint16_t mode = NF_MODE(in->code);
+
+    if (NF_CLASS(in->code) == NF_LDX) {
+        switch (mode) {
+            case NF_IMM:
+            case NF_LEN:
+                return size == NF_W;
+            case NF_MEM:
+                return size == NF_W && in->k < NF_MEMWORDS;
+            case NF_MSH:
+                return size == NF_B && in->k <= 0x7FFFFFFF;
+            default:
+                return false;
+        }
+    }
+
+    switch (mode) {
+        case NF_IMM:
+        case NF_LEN:
+            return size == NF_W;
+        case NF_MEM:
+            return size == NF_W && in->k < NF_MEMWORDS;
+        case NF_ABS:
+        case NF_IND:
+            /* Offsets are treated as signed 31-bit by the JIT */
+            return size != 0x18 && in->k <= 0x7FFFFFFF;
+        default:
+            return false;
+    }
+}
+
+static bool nf_valid_alu(const nf_insn_t* in) {
+    uint16_t op = NF_OP(in->code);
+
+    if (in->code & ~(uint16_t)(0xF0 | NF_X | 0x07)) {
+        return false;
+    }
+    if (op == NF_NEG) {
+        return NF_SRC(in->code) == NF_K;
+    }
+    if (op > NF_XOR) {
+        return false;
+    }
+    if (NF_SRC(in->code) == NF_K) {
+        if ((op == NF_DIV || op == NF_MOD) && in->k == 0) {
+            return false;
+        }
+        if ((op == NF_LSH || op == NF_RSH) && in->k >= 32) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Accept a program only if every instruction is well formed, every jump
+ * goes forward and lands inside the program, and the last instruction is
+ * a RET. Together these bound execution to len steps.
+ */
+status_t nf_verify(const nf_insn_t* prog, uint32_t len) {
+    if (!prog || len == 0 || len > NF_MAX_INSNS) {
+        return STATUS_INVALID;
+    }
+
+    for (uint32_t i = 0; i < len; i++) {
+        const nf_insn_t* in = &prog[i];
+        uint32_t remaining = len - i - 1;
+
+        switch (NF_CLASS(in->code)) {
+            case NF_LD:
+            case NF_LDX:
+                if (in->code & ~(uint16_t)0xFF || !nf_valid_load(in)) {
+                    return STATUS_INVALID;
+                }
+                break;
+
+            case NF_ST:
+            case NF_STX:
+                if ((in->code & ~(uint16_t)0x07) || in->k >= NF_MEMWORDS) {
+                    return STATUS_INVALID;
+                }
+                break;
+
+            case NF_ALU:
+                if (!nf_valid_alu(in)) {
+                    return STATUS_INVALID;
+                }
+                break;
+
+            case NF_JMP:
+                if (in->code & ~(uint16_t)(0xF0 | NF_X | 0x07)) {
+                    return STATUS_INVALID;
+                }
+                if (NF_OP(in->code) == NF_JA) {
+                    if (NF_SRC(in->code) != NF_K || in->k >= remaining) {
+                        return STATUS_INVALID;
+                    }
+                } else if (NF_OP(in->code) > NF_JSET ||
+                           in->jt >= remaining || in->jf >= remaining) {
+                    return STATUS_INVALID;
+                }
+                break;
+
+            case NF_RET:
+                if (in->code != (NF_RET | NF_K) && in->code != (NF_RET | NF_A)) {
+                    return STATUS_INVALID;
+                }
+                break;
+
+            case NF_MISC:
+                if (in->code != (NF_MISC | NF_TAX) && in->code != (NF_MISC | NF_TXA)) {
+                    return STATUS_INVALID;
+                }
+                break;
+        }
+    }
+
+    if (NF_CLASS(prog[len - 1].code) != NF_RET) {
+        return STATUS_INVALID;
+    }
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Interpreter
+ * ============================================================================ */
+
+/* Big-endian packet load; false if any byte lies past the end */
+static inline bool nf_load(const uint8_t* pkt, uint32_t len, uint64_t off, uint32_t size,
+                           uint32_t* out) {
+    if (off + size > len) {
+        return false;
+    }
+    const uint8_t* p = pkt + off;
+    switch (size) {
+        case 4:
+            *out = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            break;
+        case 2:
+            *out = ((uint32_t)p[0] << 8) | p[1];
+            break;
+        default:
+            *out = p[0];
+            break;
+    }
+    return true;
+}
+
+static inline uint32_t nf_size_bytes(uint16_t code) {
+    switch (NF_SIZE(code)) {
+        case NF_H: return 2;
+        case NF_B: return 1;
+        default:   return 4;
+    }
+}
+
+/* Run a verified program; shifts by X use the low five bits of X like the JIT */
+uint32_t nf_interpret(const nf_insn_t* prog, const uint8_t* pkt, uint32_t len) {
+    uint32_t A = 0;
+    uint32_t X = 0;
+    uint32_t M[NF_MEMWORDS] = {0};
+    uint32_t tmp;
+
+    for (const nf_insn_t* in = prog;; in++) {
+        uint32_t src = NF_SRC(in->code) == NF_X ? X : in->k;
+
+        switch (NF_CLASS(in->code)) {
+            case NF_LD:
+                switch (NF_MODE(in->code)) {
+                    case NF_IMM: A = in->k; break;
+                    case NF_LEN: A = len; break;
+                    case NF_MEM: A = M[in->k]; break;
+                    case NF_ABS:
+                        if (!nf_load(pkt, len, in->k, nf_size_bytes(in->code), &A)) {
+                            return 0;
+                        }
+                        break;
+                    case NF_IND:
+                        if (!nf_load(pkt, len, (uint64_t)X + in->k, nf_size_bytes(in->code), &A)) {
+                            return 0;
+                        }
+                        break;
+                }
+                break;
+
+            case NF_LDX:
+                switch (NF_MODE(in->code)) {
+                    case NF_IMM: X = in->k; break;
+                    case NF_LEN: X = len; break;
+                    case NF_MEM: X = M[in->k]; break;
+                    case NF_MSH:
+                        if (!nf_load(pkt, len, in->k, 1, &tmp)) {
+                            return 0;
+                        }
+                        X = (tmp & 0xF) << 2;
+                        break;
+                }
+                break;
+
+            case NF_ST:
+                M[in->k] = A;
+                break;
+
+            case NF_STX:
+                M[in->k] = X;
+                break;
+
+            case NF_ALU:
+                switch (NF_OP(in->code)) {
+                    case NF_ADD: A += src; break;
+                    case NF_SUB: A -= src; break;
+                    case NF_MUL: A *= src; break;
+                    case NF_OR:  A |= src; break;
+                    case NF_AND: A &= src; break;
+                    case NF_XOR: A ^= src; break;
+                    case NF_LSH: A <<= (src & 31); break;
+                    case NF_RSH: A >>= (src & 31); break;
+                    case NF_NEG: A = -A; break;
+                    case NF_DIV:
+                        if (src == 0) {
+                            return 0;
+                        }
+                        A /= src;
+                        break;
+                    case NF_MOD:
+                        if (src == 0) {
+                            return 0;
+                        }
+                        A %= src;
+                        break;
+                }
+                break;
+
+            case NF_JMP:
+                switch (NF_OP(in->code)) {
+                    case NF_JA:   in += in->k; break;
+                    case NF_JEQ:  in += (A == src) ? in->jt : in->jf; break;
+                    case NF_JGT:  in += (A > src) ? in->jt : in->jf; break;
+                    case NF_JGE:  in += (A >= src) ? in->jt : in->jf; break;
+                    case NF_JSET: in += (A & src) ? in->jt : in->jf; break;
+                }
+                break;
+
+            case NF_RET:
+                return NF_RVAL(in->code) == NF_A ? A : in->k;
+
+            case NF_MISC:
+                if (NF_MISCOP(in->code) == NF_TXA) {
+                    A = X;
+                } else {
+                    X = A;
+                }
+                break;
+        }
+    }
+}
+
+/* ============================================================================
+ * x86-64 JIT
+ *
+ * Register use: eax = A, r9d = X, rdi = packet, rsi = length (zero
+ * extended), r8 = scratch memory, ecx/edx/r10 temporaries. Nothing
+ * callee-saved is touched, so there is no frame. Every jump is emitted in
+ * its rel32 form, which makes instruction sizes independent of layout: a
+ * sizing pass records offsets and the second pass emits the code.
+ * ============================================================================ */
+
+#if defined(ARCH_X86_64)
+
+typedef struct nf_jit_ctx {
+    uint8_t* buf;           /* NULL during the sizing pass */
+    uint32_t pos;
+    uint32_t* offsets;      /* Start of each instruction; [len] is the exit stub */
+} nf_jit_ctx_t;
+
+static void jit_emit(nf_jit_ctx_t* c, const uint8_t* bytes, uint32_t n) {
+    if (c->buf) {
+        memcpy(c->buf + c->pos, bytes, n);
+    }
+    c->pos += n;
+}
+
+#define EMIT(...) do { \
+        const uint8_t _b[] = { __VA_ARGS__ }; \
+        jit_emit(c, _b, sizeof(_b)); \
+    } while (0)
+
+static void jit_emit_u32(nf_jit_ctx_t* c, uint32_t v) {
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    jit_emit(c, b, 4);
+}
+
+/* jmp/jcc rel32 to the start of instruction `target` */
+static void jit_jump(nf_jit_ctx_t* c, uint8_t cc, uint32_t target) {
+    if (cc == 0) {
+        EMIT(0xE9);
+    } else {
+        EMIT(0x0F, cc);
+    }
+    uint32_t end = c->pos + 4;
+    jit_emit_u32(c, c->buf ? c->offsets[target] - end : 0);
+}
+
+#define JCC_JB   0x82
+#define JCC_JAE  0x83
+#define JCC_JE   0x84
+#define JCC_JNE  0x85
+#define JCC_JBE  0x86
+#define JCC_JA   0x87
+
+/* Branch to the exit stub unless [off, off + size) lies inside the packet */
+static void jit_check_abs(nf_jit_ctx_t* c, uint32_t k, uint32_t size, uint32_t len) {
+    uint64_t end = (uint64_t)k + size;
+    if (end > 0x7FFFFFFF) {
+        jit_jump(c, 0, len);
+        return;
+    }
+    EMIT(0x81, 0xFE);                   /* cmp esi, imm32 */
+    jit_emit_u32(c, (uint32_t)end);
+    jit_jump(c, JCC_JB, len);
+}
+
+static void jit_insn(nf_jit_ctx_t* c, const nf_insn_t* prog, uint32_t i, uint32_t len) {
+    const nf_insn_t* in = &prog[i];
+    uint32_t k = in->k;
+    uint32_t size = nf_size_bytes(in->code);
+
+    switch (in->code) {
+        /* Loads into A */
+        case NF_LD | NF_W | NF_IMM:
+            EMIT(0xB8); jit_emit_u32(c, k);                 /* mov eax, k */
+            break;
+        case NF_LD | NF_W | NF_LEN:
+            EMIT(0x89, 0xF0);                               /* mov eax, esi */
+            break;
+        case NF_LD | NF_W | NF_MEM:
+            EMIT(0x41, 0x8B, 0x80); jit_emit_u32(c, k * 4); /* mov eax, [r8 + 4k] */
+            break;
+        case NF_LD | NF_W | NF_ABS:
+        case NF_LD | NF_H | NF_ABS:
+        case NF_LD | NF_B | NF_ABS:
+            jit_check_abs(c, k, size, len);
+            if (size == 4) {
+                EMIT(0x8B, 0x87); jit_emit_u32(c, k);       /* mov eax, [rdi + k] */
+                EMIT(0x0F, 0xC8);                           /* bswap eax */
+            } else if (size == 2) {
+                EMIT(0x0F, 0xB7, 0x87); jit_emit_u32(c, k); /* movzx eax, word [rdi + k] */
+                EMIT(0x66, 0xC1, 0xC0, 0x08);               /* rol ax, 8 */
+            } else {
+                EMIT(0x0F, 0xB6, 0x87); jit_emit_u32(c, k); /* movzx eax, byte [rdi + k] */
+            }
+            break;
+        case NF_LD | NF_W | NF_IND:
+        case NF_LD | NF_H | NF_IND:
+        case NF_LD | NF_B | NF_IND:
+            EMIT(0x44, 0x89, 0xCA);                         /* mov edx, r9d */
+            EMIT(0x48, 0x81, 0xC2); jit_emit_u32(c, k);     /* add rdx, k */
+            EMIT(0x4C, 0x8D, 0x52, (uint8_t)size);          /* lea r10, [rdx + size] */
+            EMIT(0x49, 0x39, 0xF2);                         /* cmp r10, rsi */
+            jit_jump(c, JCC_JA, len);
+            if (size == 4) {
+                EMIT(0x8B, 0x04, 0x17);                     /* mov eax, [rdi + rdx] */
+                EMIT(0x0F, 0xC8);                           /* bswap eax */
+            } else if (size == 2) {
+                EMIT(0x0F, 0xB7, 0x04, 0x17);               /* movzx eax, word [rdi + rdx] */
+                EMIT(0x66, 0xC1, 0xC0, 0x08);               /* rol ax, 8 */
+            } else {
+                EMIT(0x0F, 0xB6, 0x04, 0x17);               /* movzx eax, byte [rdi + rdx] */
+            }
+            break;
+
+        /* Loads into X */
+        case NF_LDX | NF_W | NF_IMM:
+            EMIT(0x41, 0xB9); jit_emit_u32(c, k);           /* mov r9d, k */
+            break;
+        case NF_LDX | NF_W | NF_LEN:
+            EMIT(0x41, 0x89, 0xF1);                         /* mov r9d, esi */
+            break;
+        case NF_LDX | NF_W | NF_MEM:
+            EMIT(0x45, 0x8B, 0x88); jit_emit_u32(c, k * 4); /* mov r9d, [r8 + 4k] */
+            break;
+        case NF_LDX | NF_B | NF_MSH:
+            jit_check_abs(c, k, 1, len);
+            EMIT(0x44, 0x0F, 0xB6, 0x8F); jit_emit_u32(c, k); /* movzx r9d, byte [rdi + k] */
+            EMIT(0x41, 0x83, 0xE1, 0x0F);                   /* and r9d, 0xf */
+            EMIT(0x41, 0xC1, 0xE1, 0x02);                   /* shl r9d, 2 */
+            break;
+
+        /* Stores */
+        case NF_ST:
+            EMIT(0x41, 0x89, 0x80); jit_emit_u32(c, k * 4); /* mov [r8 + 4k], eax */
+            break;
+        case NF_STX:
+            EMIT(0x45, 0x89, 0x88); jit_emit_u32(c, k * 4); /* mov [r8 + 4k], r9d */
+            break;
+
+        /* ALU with constant operand */
+        case NF_ALU | NF_ADD | NF_K: EMIT(0x05); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_SUB | NF_K: EMIT(0x2D); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_AND | NF_K: EMIT(0x25); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_OR  | NF_K: EMIT(0x0D); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_XOR | NF_K: EMIT(0x35); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_MUL | NF_K: EMIT(0x69, 0xC0); jit_emit_u32(c, k); break;
+        case NF_ALU | NF_LSH | NF_K: EMIT(0xC1, 0xE0, (uint8_t)k); break;
+        case NF_ALU | NF_RSH | NF_K: EMIT(0xC1, 0xE8, (uint8_t)k); break;
+        case NF_ALU | NF_NEG:        EMIT(0xF7, 0xD8); break;
+        case NF_ALU | NF_DIV | NF_K:
+        case NF_ALU | NF_MOD | NF_K:
+            EMIT(0x31, 0xD2);                               /* xor edx, edx */
+            EMIT(0xB9); jit_emit_u32(c, k);                 /* mov ecx, k */
+            EMIT(0xF7, 0xF1);                               /* div ecx */
+            if (NF_OP(in->code) == NF_MOD) {
+                EMIT(0x89, 0xD0);                           /* mov eax, edx */
+            }
+            break;
+
+        /* ALU with X operand */
+        case NF_ALU | NF_ADD | NF_X: EMIT(0x44, 0x01, 0xC8); break;
+        case NF_ALU | NF_SUB | NF_X: EMIT(0x44, 0x29, 0xC8); break;
+        case NF_ALU | NF_AND | NF_X: EMIT(0x44, 0x21, 0xC8); break;
+        case NF_ALU | NF_OR  | NF_X: EMIT(0x44, 0x09, 0xC8); break;
+        case NF_ALU | NF_XOR | NF_X: EMIT(0x44, 0x31, 0xC8); break;
+        case NF_ALU | NF_MUL | NF_X: EMIT(0x41, 0x0F, 0xAF, 0xC1); break;
+        case NF_ALU | NF_LSH | NF_X:
+            EMIT(0x44, 0x89, 0xC9);                         /* mov ecx, r9d */
+            EMIT(0xD3, 0xE0);                               /* shl eax, cl */
+            break;
+        case NF_ALU | NF_RSH | NF_X:
+            EMIT(0x44, 0x89, 0xC9);                         /* mov ecx, r9d */
+            EMIT(0xD3, 0xE8);                               /* shr eax, cl */
+            break;
+        case NF_ALU | NF_DIV | NF_X:
+        case NF_ALU | NF_MOD | NF_X:
+            EMIT(0x45, 0x85, 0xC9);                         /* test r9d, r9d */
+            jit_jump(c, JCC_JE, len);
+            EMIT(0x31, 0xD2);                               /* xor edx, edx */
+            EMIT(0x41, 0xF7, 0xF1);                         /* div r9d */
+            if (NF_OP(in->code) == NF_MOD) {
+                EMIT(0x89, 0xD0);                           /* mov eax, edx */
+            }
+            break;
+
+        case NF_JMP | NF_JA:
+            if (k != 0) {
+                jit_jump(c, 0, i + 1 + k);
+            }
+            break;
+
+        case NF_RET | NF_K:
+            EMIT(0xB8); jit_emit_u32(c, k);                 /* mov eax, k */
+            EMIT(0xC3);
+            break;
+        case NF_RET | NF_A:
+            EMIT(0xC3);
+            break;
+
+        case NF_MISC | NF_TAX:
+            EMIT(0x41, 0x89, 0xC1);                         /* mov r9d, eax */
+            break;
+        case NF_MISC | NF_TXA:
+            EMIT(0x44, 0x89, 0xC8);                         /* mov eax, r9d */
+            break;
+
+        default: {
+            /* Conditional jumps */
+            uint8_t cc_true;
+            uint8_t cc_false;
+            bool is_x = NF_SRC(in->code) == NF_X;
+
+            if (NF_OP(in->code) == NF_JSET) {
+                if (is_x) {
+                    EMIT(0x44, 0x85, 0xC8);                 /* test eax, r9d */
+                } else {
+                    EMIT(0xA9); jit_emit_u32(c, k);         /* test eax, k */
+                }
+                cc_true = JCC_JNE;
+                cc_false = JCC_JE;
+            } else {
+                if (is_x) {
+                    EMIT(0x44, 0x39, 0xC8);                 /* cmp eax, r9d */
+                } else {
+                    EMIT(0x3D); jit_emit_u32(c, k);         /* cmp eax, k */
+                }
+                switch (NF_OP(in->code)) {
+                    case NF_JEQ: cc_true = JCC_JE;  cc_false = JCC_JNE; break;
+                    case NF_JGT: cc_true = JCC_JA;  cc_false = JCC_JBE; break;
+                    default:     cc_true = JCC_JAE; cc_false = JCC_JB;  break;
+                }
+            }
+
+            if (in->jt != 0 && in->jf != 0) {
+                jit_jump(c, cc_true, i + 1 + in->jt);
+                jit_jump(c, 0, i + 1 + in->jf);
+            } else if (in->jt != 0) {
+                jit_jump(c, cc_true, i + 1 + in->jt);
+            } else if (in->jf != 0) {
+                jit_jump(c, cc_false, i + 1 + in->jf);
+            }
+            break;
+        }
+    }
+}
+
+static void jit_pass(nf_jit_ctx_t* c, const nf_insn_t* prog, uint32_t len) {
+    c->pos = 0;
+    EMIT(0x89, 0xF6);                                       /* mov esi, esi */
+    EMIT(0x31, 0xC0);                                       /* xor eax, eax */
+    EMIT(0x45, 0x31, 0xC9);                                 /* xor r9d, r9d */
+    EMIT(0x49, 0x89, 0xD0);                                 /* mov r8, rdx */
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (!c->buf) {
+            c->offsets[i] = c->pos;
+        }
+        jit_insn(c, prog, i, len);
+    }
+
+    /* Exit stub for failed loads and division by zero */
+    if (!c->buf) {
+        c->offsets[len] = c->pos;
+    }
+    EMIT(0x31, 0xC0, 0xC3);                                 /* xor eax, eax; ret */
+}
+
+#undef EMIT
+
+/* Compile a verified program; on failure the filter keeps using the interpreter */
+static void nf_jit_compile(net_filter_t* f) {
+    uint32_t offsets_pages = PAGES_FOR((f->len + 1) * sizeof(uint32_t));
+    uint32_t* offsets = (uint32_t*)pmm_alloc_pages(offsets_pages);
+    if (!offsets) {
+        return;
+    }
+
+    nf_jit_ctx_t c = { .buf = NULL, .pos = 0, .offsets = offsets };
+    jit_pass(&c, f->insns, f->len);
+
+    /* The kernel direct map is executable, so page memory can hold code */
+    uint32_t pages = PAGES_FOR(c.pos);
+    uint8_t* code = (uint8_t*)pmm_alloc_pages(pages);
+    if (code) {
+        uint32_t size = c.pos;
+        c.buf = code;
+        jit_pass(&c, f->insns, f->len);
+        if (c.pos == size) {
+            f->jit = (nf_jit_fn)(uintptr_t)code;
+            f->jit_pages = pages;
+        } else {
+            pmm_free_pages((paddr_t)code, pages);
+        }
+    }
+
+    pmm_free_pages((paddr_t)offsets, offsets_pages);
+}
+
+#endif /* ARCH_X86_64 */
+
+/* ============================================================================
+ * Filter objects
+ * ============================================================================ */
+
+void nf_set_jit(bool enable) {
+#if defined(ARCH_X86_64)
+    nf_jit_enabled = enable;
+#else
+    (void)enable;
+#endif
+}
+
+status_t nf_create(const nf_insn_t* prog, uint32_t len, net_filter_t** out_filter) {
+    if (!out_filter) {
+        return STATUS_INVALID;
+    }
+
+    status_t status = nf_verify(prog, len);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    uint32_t pages = PAGES_FOR(sizeof(net_filter_t) + len * sizeof(nf_insn_t));
+    net_filter_t* f = (net_filter_t*)pmm_alloc_pages(pages);
+    if (!f) {
+        return STATUS_NOMEM;
+    }
+
+    f->len = len;
+    f->pages = pages;
+    f->jit = NULL;
+    f->jit_pages = 0;
+    memcpy(f->insns, prog, len * sizeof(nf_insn_t));
+
+#if defined(ARCH_X86_64)
+    if (nf_jit_enabled) {
+        nf_jit_compile(f);
+    }
+#endif
+
+    *out_filter = f;
+    return STATUS_OK;
+}
+
+void nf_destroy(net_filter_t* f) {
+    if (!f) {
+        return;
+    }
+    if (f->jit) {
+        pmm_free_pages((paddr_t)(uintptr_t)f->jit, f->jit_pages);
+    }
+    pmm_free_pages((paddr_t)f, f->pages);
+}
+
+uint32_t nf_run(const net_filter_t* f, const void* packet, uint32_t length) {
+    if (f->jit) {
+        uint32_t mem[NF_MEMWORDS] = {0};
+        return f->jit((const uint8_t*)packet, length, mem);
+    }
+    return nf_interpret(f->insns, (const uint8_t*)packet, length);
+}
+
+bool nf_is_jited(const net_filter_t* f) {
+    return f && f->jit != NULL;
+}
+
+/* ============================================================================
+ * Attachment
+ * ============================================================================ */
+
+status_t net_interface_attach_filter(net_interface_t* iface, nf_hook_t hook, net_filter_t* filter) {
+    if (!iface) {
+        return STATUS_INVALID;
+    }
+
+    switch (hook) {
+        case NF_HOOK_RX:
+            __atomic_store_n(&iface->rx_filter, filter, __ATOMIC_RELEASE);
+            return STATUS_OK;
+        case NF_HOOK_TX:
+            __atomic_store_n(&iface->tx_filter, filter, __ATOMIC_RELEASE);
+            return STATUS_OK;
+        default:
+            return STATUS_INVALID;
+    }
+}
+
+status_t net_socket_attach_filter(socket_t* sock, net_filter_t* filter) {
+    if (!sock) {
+        return STATUS_INVALID;
+    }
+
+    __atomic_store_n(&sock->filter, filter, __ATOMIC_RELEASE);
+    return STATUS_OK;
+}
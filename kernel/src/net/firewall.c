@@ -0,0 +1,1101 @@
+/*
+ * Host Firewall
+ * Decision-tree rule classification and connection tracking
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "net.h"
+#include "netfilter.h"
+
+extern uint64_t perf_timestamp_ns(void);
+
+#define PAGES_FOR(bytes)   (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+/* Header fields a rule can constrain, each as an inclusive range */
+#define FW_DIM_SRC         0
+#define FW_DIM_DST         1
+#define FW_DIM_SPORT       2
+#define FW_DIM_DPORT       3
+#define FW_DIM_PROTO       4
+#define FW_DIMS            5
+
+#define FW_NODE_LEAF       0xFF
+#define FW_LEAF_RULES      8     /* Stop cutting once a node holds this few */
+#define FW_MAX_CUT_BITS    6     /* At most 64 children per node */
+#define FW_SPACE_FACTOR    4     /* Children may hold this multiple of the parent's rules */
+#define FW_POOL_PER_RULE   64    /* Build-time rule list budget */
+
+static const uint8_t fw_dim_bits[FW_DIMS] = { 32, 32, 16, 16, 8 };
+
+typedef struct fw_range {
+    uint32_t lo;
+    uint32_t hi;
+} fw_range_t;
+
+typedef struct fw_crule {
+    fw_range_t r[FW_DIMS];
+    uint32_t action;
+} fw_crule_t;
+
+/* Interior nodes index children by (field >> shift) & mask */
+typedef struct fw_node {
+    uint8_t dim;
+    uint8_t shift;
+    uint16_t mask;
+    uint32_t first;     /* Into children[], or leaf_rules[] for a leaf */
+    uint32_t count;     /* Rules in a leaf */
+} fw_node_t;
+
+/* Region and candidate rules of a node that has not been split yet */
+typedef struct fw_build {
+    uint32_t lo[FW_DIMS];
+    uint8_t bits[FW_DIMS];
+    uint32_t list;
+    uint32_t count;
+} fw_build_t;
+
+/* Build work item; node UINT32_MAX releases rule lists above pool_mark */
+typedef struct fw_pending {
+    uint32_t node;
+    uint32_t pool_mark;
+} fw_pending_t;
+
+/* Growable array backed by whole pages */
+typedef struct fw_vec {
+    uint8_t* data;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t elem;
+    uint32_t pages;
+} fw_vec_t;
+
+struct fw_ruleset {
+    fw_vec_t rules;         /* fw_crule_t, in priority order */
+    fw_vec_t nodes;         /* fw_node_t, root first */
+    fw_vec_t children;      /* uint32_t node indices */
+    fw_vec_t leaf_rules;    /* uint32_t rule indices */
+    uint32_t max_leaf;
+    uint8_t default_action;
+};
+
+/* ============================================================================
+ * Connection tracking
+ *
+ * A set-associative table: a flow hashes to one set of CT_WAYS entries,
+ * and inserting into a full set evicts the entry closest to expiry. Flows
+ * are stored with their endpoints in canonical order so both directions
+ * hash to the same entry; `orig` records which endpoint opened the flow.
+ * ============================================================================ */
+
+#define CT_WAYS            4
+#define CT_SETS            4096
+#define CT_LOCK_STRIPES    64
+
+#define CT_STATE_FREE         0
+#define CT_STATE_NEW          1
+#define CT_STATE_ESTABLISHED  2
+#define CT_STATE_CLOSING      3
+
+#define CT_SEC                    1000000000ULL
+#define CT_TIMEOUT_NEW_NS         (30 * CT_SEC)
+#define CT_TIMEOUT_ESTABLISHED_NS (300 * CT_SEC)
+#define CT_TIMEOUT_DATAGRAM_NS    (120 * CT_SEC)
+#define CT_TIMEOUT_CLOSING_NS     (10 * CT_SEC)
+
+typedef struct ct_entry {
+    uint32_t addr[2];
+    uint16_t port[2];
+    uint8_t protocol;
+    uint8_t state;
+    uint8_t orig;
+    uint8_t reserved;
+    uint64_t expires;
+} ct_entry_t;
+
+typedef struct ct_tuple {
+    uint32_t addr[2];
+    uint16_t port[2];
+    uint8_t protocol;
+    uint8_t dir;            /* 1 if the packet runs from endpoint 1 to 0 */
+} ct_tuple_t;
+
+typedef struct ct_table {
+    ct_entry_t* entries;
+    uint32_t sets;
+    uint32_t pages;
+    uint32_t locks[CT_LOCK_STRIPES];
+} ct_table_t;
+
+/* Firewall state; readers of chains[] are counted per epoch */
+static struct {
+    fw_ruleset_t* chains[FW_CHAIN_COUNT];
+    ct_table_t conntrack;
+    epoch_t readers;
+    uint32_t lock;
+    bool active;
+    bool initialized;
+} fw_state;
+
+static fw_stats_t fw_stats;
+
+static inline uint32_t fw_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline void fw_spin_lock(uint32_t* lock) {
+    while (__sync_lock_test_and_set(lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+static inline void fw_spin_unlock(uint32_t* lock) {
+    __sync_lock_release(lock);
+}
+
+/* ============================================================================
+ * Page-backed vectors
+ * ============================================================================ */
+
+static void fw_vec_init(fw_vec_t* v, uint32_t elem) {
+    v->data = NULL;
+    v->count = 0;
+    v->capacity = 0;
+    v->elem = elem;
+    v->pages = 0;
+}
+
+static status_t fw_vec_reserve(fw_vec_t* v, uint32_t extra) {
+    uint64_t need = (uint64_t)v->count + extra;
+    if (need <= v->capacity) {
+        return STATUS_OK;
+    }
+    if (need > 0x7FFFFFFF) {
+        return STATUS_NOMEM;
+    }
+
+    uint64_t capacity = v->capacity ? v->capacity : PAGE_SIZE / v->elem;
+    while (capacity < need) {
+        capacity *= 2;
+    }
+
+    uint32_t pages = PAGES_FOR(capacity * v->elem);
+    uint8_t* data = (uint8_t*)pmm_alloc_pages(pages);
+    if (!data) {
+        return STATUS_NOMEM;
+    }
+    if (v->data) {
+        memcpy(data, v->data, (size_t)v->count * v->elem);
+        pmm_free_pages((paddr_t)v->data, v->pages);
+    }
+
+    v->data = data;
+    v->pages = pages;
+    v->capacity = (uint32_t)((uint64_t)pages * PAGE_SIZE / v->elem);
+    return STATUS_OK;
+}
+
+static void fw_vec_free(fw_vec_t* v) {
+    if (v->data) {
+        pmm_free_pages((paddr_t)v->data, v->pages);
+    }
+    v->data = NULL;
+    v->count = 0;
+    v->capacity = 0;
+    v->pages = 0;
+}
+
+#define FW_VEC_AT(v, type, i) (((type*)(v)->data) + (i))
+
+/* ============================================================================
+ * Rule matching
+ * ============================================================================ */
+
+static inline bool fw_rule_match(const fw_crule_t* r, const uint32_t* f) {
+    for (uint32_t d = 0; d < FW_DIMS; d++) {
+        if (f[d] < r->r[d].lo || f[d] > r->r[d].hi) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void fw_key_fields(const fw_key_t* key, uint32_t* f) {
+    f[FW_DIM_SRC] = key->src;
+    f[FW_DIM_DST] = key->dst;
+    f[FW_DIM_SPORT] = key->sport;
+    f[FW_DIM_DPORT] = key->dport;
+    f[FW_DIM_PROTO] = key->protocol;
+}
+
+/* Index of the first matching rule, or -1 */
+int32_t fw_classify(const fw_ruleset_t* rs, const fw_key_t* key) {
+    uint32_t f[FW_DIMS];
+    fw_key_fields(key, f);
+
+    const fw_node_t* nodes = (const fw_node_t*)rs->nodes.data;
+    const uint32_t* children = (const uint32_t*)rs->children.data;
+    const fw_node_t* node = &nodes[0];
+
+    while (node->dim != FW_NODE_LEAF) {
+        node = &nodes[children[node->first + ((f[node->dim] >> node->shift) & node->mask)]];
+    }
+
+    const uint32_t* leaf = (const uint32_t*)rs->leaf_rules.data + node->first;
+    const fw_crule_t* rules = (const fw_crule_t*)rs->rules.data;
+    for (uint32_t i = 0; i < node->count; i++) {
+        if (fw_rule_match(&rules[leaf[i]], f)) {
+            return (int32_t)leaf[i];
+        }
+    }
+    return -1;
+}
+
+/* Reference walk over every rule; used to check the tree */
+int32_t fw_classify_linear(const fw_ruleset_t* rs, const fw_key_t* key) {
+    uint32_t f[FW_DIMS];
+    fw_key_fields(key, f);
+
+    const fw_crule_t* rules = (const fw_crule_t*)rs->rules.data;
+    for (uint32_t i = 0; i < rs->rules.count; i++) {
+        if (fw_rule_match(&rules[i], f)) {
+            return (int32_t)i;
+        }
+    }
+    return -1;
+}
+
+fw_action_t fw_verdict(const fw_ruleset_t* rs, const fw_key_t* key) {
+    int32_t idx = fw_classify(rs, key);
+    if (idx < 0) {
+        return (fw_action_t)rs->default_action;
+    }
+    return (fw_action_t)FW_VEC_AT(&rs->rules, fw_crule_t, idx)->action;
+}
+
+/* ============================================================================
+ * Rule compiler
+ *
+ * HiCuts-style construction. Nodes are built depth first: each pending
+ * node picks the field whose cut leaves the smallest largest child, with
+ * as many cuts as the space factor allows, and pushes one child per slice
+ * holding the rules that overlap it. Empty slices share one empty leaf and
+ * equal neighbouring small slices share a leaf.
+ * ============================================================================ */
+
+static status_t fw_rule_convert(const fw_rule_t* in, fw_crule_t* out) {
+    if (in->src_len > 32 || in->dst_len > 32 || in->action > FW_ACTION_DROP ||
+        in->sport_lo > in->sport_hi || in->dport_lo > in->dport_hi) {
+        return STATUS_INVALID;
+    }
+
+    uint32_t src_mask = in->src_len ? 0xFFFFFFFFu << (32 - in->src_len) : 0;
+    uint32_t dst_mask = in->dst_len ? 0xFFFFFFFFu << (32 - in->dst_len) : 0;
+
+    out->r[FW_DIM_SRC].lo = in->src & src_mask;
+    out->r[FW_DIM_SRC].hi = (in->src & src_mask) | ~src_mask;
+    out->r[FW_DIM_DST].lo = in->dst & dst_mask;
+    out->r[FW_DIM_DST].hi = (in->dst & dst_mask) | ~dst_mask;
+    out->r[FW_DIM_SPORT].lo = in->sport_lo;
+    out->r[FW_DIM_SPORT].hi = in->sport_hi;
+    out->r[FW_DIM_DPORT].lo = in->dport_lo;
+    out->r[FW_DIM_DPORT].hi = in->dport_hi;
+    out->r[FW_DIM_PROTO].lo = in->protocol;
+    out->r[FW_DIM_PROTO].hi = in->protocol ? in->protocol : 0xFF;
+    out->action = in->action;
+    return STATUS_OK;
+}
+
+/* Largest child and total fan-out of cutting dimension d into 2^c slices */
+static uint32_t fw_cut_cost(const fw_crule_t* rules, const uint32_t* list, uint32_t count,
+                            const fw_build_t* b, uint32_t d, uint32_t c, int32_t* diff,
+                            uint64_t* out_sum) {
+    uint32_t cuts = 1u << c;
+    uint32_t shift = b->bits[d] - c;
+    uint32_t lo = b->lo[d];
+    uint32_t hi = (uint32_t)(lo + ((1ULL << b->bits[d]) - 1));
+    uint64_t sum = 0;
+
+    memset(diff, 0, (cuts + 1) * sizeof(int32_t));
+    for (uint32_t i = 0; i < count; i++) {
+        const fw_range_t* r = &rules[list[i]].r[d];
+        uint32_t first = ((r->lo > lo ? r->lo : lo) - lo) >> shift;
+        uint32_t last = ((r->hi < hi ? r->hi : hi) - lo) >> shift;
+        diff[first]++;
+        diff[last + 1]--;
+        sum += last - first + 1;
+    }
+
+    uint32_t max = 0;
+    int32_t running = 0;
+    for (uint32_t j = 0; j < cuts; j++) {
+        running += diff[j];
+        if ((uint32_t)running > max) {
+            max = (uint32_t)running;
+        }
+    }
+
+    *out_sum = sum;
+    return max;
+}
+
+/* Pick a dimension and cut count; false if no cut separates the rules */
+static bool fw_choose_cut(const fw_crule_t* rules, const uint32_t* list, const fw_build_t* b,
+                          int32_t* diff, uint32_t* out_dim, uint32_t* out_bits) {
+    uint32_t best_max = b->count;
+    uint64_t best_sum = 0;
+    bool found = false;
+
+    for (uint32_t d = 0; d < FW_DIMS; d++) {
+        if (b->bits[d] == 0) {
+            continue;
+        }
+
+        uint32_t limit = b->bits[d] < FW_MAX_CUT_BITS ? b->bits[d] : FW_MAX_CUT_BITS;
+        uint64_t sum;
+        uint32_t max = fw_cut_cost(rules, list, b->count, b, d, 1, diff, &sum);
+        uint32_t c = 1;
+
+        while (c < limit) {
+            uint64_t next_sum;
+            uint32_t next_max = fw_cut_cost(rules, list, b->count, b, d, c + 1, diff, &next_sum);
+            if (next_sum + (2u << c) > (uint64_t)FW_SPACE_FACTOR * b->count) {
+                break;
+            }
+            c++;
+            max = next_max;
+            sum = next_sum;
+        }
+
+        if (max < best_max || (found && max == best_max && sum < best_sum)) {
+            best_max = max;
+            best_sum = sum;
+            *out_dim = d;
+            *out_bits = c;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+/* True if the rule matches all of the region, shadowing every later rule there */
+static bool fw_rule_covers(const fw_crule_t* r, const fw_build_t* region) {
+    for (uint32_t d = 0; d < FW_DIMS; d++) {
+        uint32_t hi = (uint32_t)(region->lo[d] + ((1ULL << region->bits[d]) - 1));
+        if (r->r[d].lo > region->lo[d] || r->r[d].hi < hi) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static status_t fw_make_leaf(fw_ruleset_t* rs, uint32_t node_idx, const uint32_t* list,
+                             uint32_t count) {
+    status_t status = fw_vec_reserve(&rs->leaf_rules, count);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    fw_node_t* node = FW_VEC_AT(&rs->nodes, fw_node_t, node_idx);
+    node->dim = FW_NODE_LEAF;
+    node->first = rs->leaf_rules.count;
+    node->count = count;
+
+    if (count) {
+        memcpy(FW_VEC_AT(&rs->leaf_rules, uint32_t, rs->leaf_rules.count), list,
+               count * sizeof(uint32_t));
+    }
+    rs->leaf_rules.count += count;
+    if (count > rs->max_leaf) {
+        rs->max_leaf = count;
+    }
+    return STATUS_OK;
+}
+
+/* Split pending node i into 2^c slices of dimension dim */
+static status_t fw_split(fw_ruleset_t* rs, fw_vec_t* build, fw_vec_t* pool, uint32_t i,
+                         uint32_t dim, uint32_t c, uint32_t* empty_leaf) {
+    fw_build_t b = *FW_VEC_AT(build, fw_build_t, i);
+    uint32_t cuts = 1u << c;
+    uint32_t shift = b.bits[dim] - c;
+
+    status_t status;
+    if (FAILED(status = fw_vec_reserve(&rs->children, cuts)) ||
+        FAILED(status = fw_vec_reserve(&rs->nodes, cuts + 1)) ||
+        FAILED(status = fw_vec_reserve(build, cuts + 1)) ||
+        FAILED(status = fw_vec_reserve(pool, cuts * b.count))) {
+        return status;
+    }
+
+    fw_node_t* node = FW_VEC_AT(&rs->nodes, fw_node_t, i);
+    node->dim = (uint8_t)dim;
+    node->shift = (uint8_t)shift;
+    node->mask = (uint16_t)(cuts - 1);
+    node->first = rs->children.count;
+
+    const fw_crule_t* rules = (const fw_crule_t*)rs->rules.data;
+    uint32_t prev_child = UINT32_MAX;
+    uint32_t prev_list = 0;
+    uint32_t prev_count = 0;
+
+    for (uint32_t j = 0; j < cuts; j++) {
+        fw_build_t region = b;
+        region.lo[dim] = b.lo[dim] + (j << shift);
+        region.bits[dim] = (uint8_t)shift;
+        uint32_t clo = region.lo[dim];
+        uint32_t chi = (uint32_t)(clo + ((1ULL << shift) - 1));
+        uint32_t* list = FW_VEC_AT(pool, uint32_t, b.list);
+        uint32_t* out = FW_VEC_AT(pool, uint32_t, pool->count);
+        uint32_t n = 0;
+
+        for (uint32_t r = 0; r < b.count; r++) {
+            const fw_crule_t* rule = &rules[list[r]];
+            if (rule->r[dim].lo <= chi && rule->r[dim].hi >= clo) {
+                out[n++] = list[r];
+                if (fw_rule_covers(rule, &region)) {
+                    break;
+                }
+            }
+        }
+
+        uint32_t child;
+        if (n == 0 && *empty_leaf != UINT32_MAX) {
+            child = *empty_leaf;
+        } else if (n <= FW_LEAF_RULES && n == prev_count && prev_child != UINT32_MAX &&
+                   memcmp(out, FW_VEC_AT(pool, uint32_t, prev_list), n * sizeof(uint32_t)) == 0) {
+            child = prev_child;
+        } else {
+            child = rs->nodes.count++;
+            memset(FW_VEC_AT(&rs->nodes, fw_node_t, child), 0, sizeof(fw_node_t));
+
+            fw_build_t* cb = FW_VEC_AT(build, fw_build_t, build->count++);
+            *cb = region;
+            cb->list = pool->count;
+            cb->count = n;
+            pool->count += n;
+
+            if (n == 0) {
+                *empty_leaf = child;
+            } else if (n <= FW_LEAF_RULES) {
+                prev_child = child;
+                prev_list = cb->list;
+                prev_count = n;
+            }
+        }
+
+        *FW_VEC_AT(&rs->children, uint32_t, rs->children.count++) = child;
+    }
+
+    return STATUS_OK;
+}
+
+static status_t fw_build_tree(fw_ruleset_t* rs) {
+    uint32_t count = rs->rules.count;
+    fw_vec_t build;
+    fw_vec_t pool;
+    fw_vec_t stack;
+    fw_vec_init(&build, sizeof(fw_build_t));
+    fw_vec_init(&pool, sizeof(uint32_t));
+    fw_vec_init(&stack, sizeof(fw_pending_t));
+
+    status_t status;
+    if (FAILED(status = fw_vec_reserve(&build, 1)) ||
+        FAILED(status = fw_vec_reserve(&pool, count)) ||
+        FAILED(status = fw_vec_reserve(&stack, 1)) ||
+        FAILED(status = fw_vec_reserve(&rs->nodes, 1))) {
+        goto out;
+    }
+
+    fw_build_t* root = FW_VEC_AT(&build, fw_build_t, build.count++);
+    for (uint32_t d = 0; d < FW_DIMS; d++) {
+        root->lo[d] = 0;
+        root->bits[d] = fw_dim_bits[d];
+    }
+    root->list = 0;
+    root->count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        *FW_VEC_AT(&pool, uint32_t, i) = i;
+    }
+    pool.count = count;
+    memset(FW_VEC_AT(&rs->nodes, fw_node_t, 0), 0, sizeof(fw_node_t));
+    rs->nodes.count = 1;
+    *FW_VEC_AT(&stack, fw_pending_t, stack.count++) = (fw_pending_t){ 0, 0 };
+
+    uint64_t pool_limit = (uint64_t)count * FW_POOL_PER_RULE + (1u << 16);
+    uint32_t empty_leaf = UINT32_MAX;
+    int32_t diff[(1u << FW_MAX_CUT_BITS) + 1];
+
+    /*
+     * Depth first, so rule lists live on a stack: a split queues its new
+     * children above a marker that drops their lists once all are built.
+     */
+    while (stack.count > 0) {
+        fw_pending_t item = *FW_VEC_AT(&stack, fw_pending_t, --stack.count);
+        if (item.node == UINT32_MAX) {
+            pool.count = item.pool_mark;
+            continue;
+        }
+
+        const fw_build_t* b = FW_VEC_AT(&build, fw_build_t, item.node);
+        const uint32_t* list = FW_VEC_AT(&pool, uint32_t, b->list);
+        uint32_t mark = pool.count;
+        uint32_t first_new = rs->nodes.count;
+        uint32_t dim = 0;
+        uint32_t c = 0;
+
+        if (b->count <= FW_LEAF_RULES || pool.count > pool_limit ||
+            !fw_choose_cut((const fw_crule_t*)rs->rules.data, list, b, diff, &dim, &c)) {
+            status = fw_make_leaf(rs, item.node, list, b->count);
+        } else if (SUCCESS(status = fw_split(rs, &build, &pool, item.node, dim, c, &empty_leaf))) {
+            status = fw_vec_reserve(&stack, rs->nodes.count - first_new + 1);
+            if (SUCCESS(status)) {
+                *FW_VEC_AT(&stack, fw_pending_t, stack.count++) = (fw_pending_t){ UINT32_MAX, mark };
+                for (uint32_t n = rs->nodes.count; n-- > first_new;) {
+                    *FW_VEC_AT(&stack, fw_pending_t, stack.count++) = (fw_pending_t){ n, 0 };
+                }
+            }
+        }
+        if (FAILED(status)) {
+            goto out;
+        }
+    }
+    status = STATUS_OK;
+
+out:
+    fw_vec_free(&build);
+    fw_vec_free(&pool);
+    fw_vec_free(&stack);
+    return status;
+}
+
+status_t fw_compile(const fw_rule_t* rules, uint32_t count, fw_action_t default_action,
+                    fw_ruleset_t** out_ruleset) {
+    if ((!rules && count) || count > FW_MAX_RULES || !out_ruleset ||
+        default_action > FW_ACTION_DROP) {
+        return STATUS_INVALID;
+    }
+
+    fw_ruleset_t* rs = (fw_ruleset_t*)pmm_alloc_pages(PAGES_FOR(sizeof(fw_ruleset_t)));
+    if (!rs) {
+        return STATUS_NOMEM;
+    }
+    memset(rs, 0, sizeof(fw_ruleset_t));
+    fw_vec_init(&rs->rules, sizeof(fw_crule_t));
+    fw_vec_init(&rs->nodes, sizeof(fw_node_t));
+    fw_vec_init(&rs->children, sizeof(uint32_t));
+    fw_vec_init(&rs->leaf_rules, sizeof(uint32_t));
+    rs->default_action = (uint8_t)default_action;
+
+    status_t status = fw_vec_reserve(&rs->rules, count ? count : 1);
+    for (uint32_t i = 0; SUCCESS(status) && i < count; i++) {
+        status = fw_rule_convert(&rules[i], FW_VEC_AT(&rs->rules, fw_crule_t, i));
+    }
+    if (SUCCESS(status)) {
+        rs->rules.count = count;
+        status = fw_build_tree(rs);
+    }
+    if (FAILED(status)) {
+        fw_ruleset_destroy(rs);
+        return status;
+    }
+
+    *out_ruleset = rs;
+    return STATUS_OK;
+}
+
+void fw_ruleset_destroy(fw_ruleset_t* rs) {
+    if (!rs) {
+        return;
+    }
+    fw_vec_free(&rs->rules);
+    fw_vec_free(&rs->nodes);
+    fw_vec_free(&rs->children);
+    fw_vec_free(&rs->leaf_rules);
+    pmm_free_pages((paddr_t)rs, PAGES_FOR(sizeof(fw_ruleset_t)));
+}
+
+/* ============================================================================
+ * Connection tracker
+ * ============================================================================ */
+
+static status_t ct_table_init(ct_table_t* ct, uint32_t sets) {
+    ct->sets = sets;
+    ct->pages = PAGES_FOR((uint64_t)sets * CT_WAYS * sizeof(ct_entry_t));
+    ct->entries = (ct_entry_t*)pmm_alloc_pages(ct->pages);
+    if (!ct->entries) {
+        return STATUS_NOMEM;
+    }
+    memset(ct->entries, 0, (size_t)sets * CT_WAYS * sizeof(ct_entry_t));
+    memset(ct->locks, 0, sizeof(ct->locks));
+    return STATUS_OK;
+}
+
+static void ct_table_free(ct_table_t* ct) {
+    if (ct->entries) {
+        pmm_free_pages((paddr_t)ct->entries, ct->pages);
+        ct->entries = NULL;
+    }
+}
+
+static inline void ct_tuple_from_key(const fw_key_t* key, ct_tuple_t* t) {
+    bool swap = key->src > key->dst || (key->src == key->dst && key->sport > key->dport);
+    t->addr[swap] = key->src;
+    t->port[swap] = key->sport;
+    t->addr[!swap] = key->dst;
+    t->port[!swap] = key->dport;
+    t->protocol = key->protocol;
+    t->dir = swap;
+}
+
+static inline uint32_t ct_hash(const ct_tuple_t* t) {
+    uint32_t h = fw_mix(t->addr[0] ^ 0x9E3779B9u);
+    h = fw_mix(h ^ t->addr[1]);
+    return fw_mix(h ^ ((uint32_t)t->port[0] << 16 | t->port[1]) ^ ((uint32_t)t->protocol << 8));
+}
+
+static inline bool ct_match(const ct_entry_t* e, const ct_tuple_t* t) {
+    return e->addr[0] == t->addr[0] && e->addr[1] == t->addr[1] &&
+           e->port[0] == t->port[0] && e->port[1] == t->port[1] &&
+           e->protocol == t->protocol;
+}
+
+static uint64_t ct_timeout(const ct_entry_t* e) {
+    switch (e->state) {
+        case CT_STATE_ESTABLISHED:
+            return e->protocol == IP_PROTO_TCP ? CT_TIMEOUT_ESTABLISHED_NS : CT_TIMEOUT_DATAGRAM_NS;
+        case CT_STATE_CLOSING:
+            return CT_TIMEOUT_CLOSING_NS;
+        default:
+            return CT_TIMEOUT_NEW_NS;
+    }
+}
+
+/*
+ * Find the flow and advance its state: traffic from the other endpoint
+ * establishes it, FIN starts the close timer and RST ends it at once.
+ */
+static bool ct_lookup(ct_table_t* ct, const ct_tuple_t* t, uint8_t tcp_flags, uint64_t now) {
+    uint32_t set = ct_hash(t) & (ct->sets - 1);
+    uint32_t* lock = &ct->locks[set % CT_LOCK_STRIPES];
+    ct_entry_t* e = &ct->entries[set * CT_WAYS];
+    bool hit = false;
+
+    fw_spin_lock(lock);
+    for (uint32_t w = 0; w < CT_WAYS; w++, e++) {
+        if (e->state == CT_STATE_FREE || e->expires < now || !ct_match(e, t)) {
+            continue;
+        }
+
+        if (e->state == CT_STATE_NEW && t->dir != e->orig) {
+            e->state = CT_STATE_ESTABLISHED;
+        }
+        if (e->protocol == IP_PROTO_TCP) {
+            if (tcp_flags & TCP_FLAG_RST) {
+                e->state = CT_STATE_FREE;
+            } else if (tcp_flags & TCP_FLAG_FIN) {
+                e->state = CT_STATE_CLOSING;
+            }
+        }
+        e->expires = now + ct_timeout(e);
+        hit = true;
+        break;
+    }
+    fw_spin_unlock(lock);
+
+    return hit;
+}
+
+/* Start tracking a flow; true if a live entry had to be evicted */
+static bool ct_insert(ct_table_t* ct, const ct_tuple_t* t, uint64_t now) {
+    uint32_t set = ct_hash(t) & (ct->sets - 1);
+    uint32_t* lock = &ct->locks[set % CT_LOCK_STRIPES];
+    ct_entry_t* ways = &ct->entries[set * CT_WAYS];
+    ct_entry_t* victim = &ways[0];
+
+    fw_spin_lock(lock);
+    for (uint32_t w = 0; w < CT_WAYS; w++) {
+        if (ways[w].state == CT_STATE_FREE || ways[w].expires < now) {
+            victim = &ways[w];
+            break;
+        }
+        if (ways[w].expires < victim->expires) {
+            victim = &ways[w];
+        }
+    }
+    bool evicted = victim->state != CT_STATE_FREE && victim->expires >= now;
+
+    victim->addr[0] = t->addr[0];
+    victim->addr[1] = t->addr[1];
+    victim->port[0] = t->port[0];
+    victim->port[1] = t->port[1];
+    victim->protocol = t->protocol;
+    victim->orig = t->dir;
+    victim->state = CT_STATE_NEW;
+    victim->expires = now + CT_TIMEOUT_NEW_NS;
+    fw_spin_unlock(lock);
+
+    return evicted;
+}
+
+void fw_conntrack_flush(void) {
+    ct_table_t* ct = &fw_state.conntrack;
+    if (!ct->entries) {
+        return;
+    }
+
+    for (uint32_t set = 0; set < ct->sets; set++) {
+        uint32_t* lock = &ct->locks[set % CT_LOCK_STRIPES];
+        fw_spin_lock(lock);
+        memset(&ct->entries[set * CT_WAYS], 0, CT_WAYS * sizeof(ct_entry_t));
+        fw_spin_unlock(lock);
+    }
+}
+
+/* ============================================================================
+ * Chains and packet path
+ * ============================================================================ */
+
+status_t fw_init(void) {
+    if (fw_state.initialized) {
+        return STATUS_EXISTS;
+    }
+
+    status_t status = ct_table_init(&fw_state.conntrack, CT_SETS);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    fw_state.initialized = true;
+    KLOG_INFO("FW", "Firewall initialized (%u conntrack entries)", CT_SETS * CT_WAYS);
+    return STATUS_OK;
+}
+
+status_t fw_install(fw_chain_t chain, fw_ruleset_t* ruleset) {
+    if (chain >= FW_CHAIN_COUNT || !fw_state.initialized) {
+        return STATUS_INVALID;
+    }
+
+    fw_spin_lock(&fw_state.lock);
+    fw_ruleset_t* old = __atomic_exchange_n(&fw_state.chains[chain], ruleset, __ATOMIC_SEQ_CST);
+
+    bool active = false;
+    for (uint32_t i = 0; i < FW_CHAIN_COUNT; i++) {
+        active |= fw_state.chains[i] != NULL;
+    }
+    __atomic_store_n(&fw_state.active, active, __ATOMIC_RELEASE);
+
+    epoch_synchronize(&fw_state.readers);
+
+    /*
+     * Flows were admitted by the old rules; drop them so their next packet
+     * is judged by the new ones. Readers insert inside the read section, so
+     * none admitted under the old ruleset can land after this.
+     */
+    fw_conntrack_flush();
+    fw_spin_unlock(&fw_state.lock);
+
+    fw_ruleset_destroy(old);
+
+    KLOG_INFO("FW", "Installed %s chain: %u rules",
+              chain == FW_CHAIN_INPUT ? "input" : "output", ruleset ? ruleset->rules.count : 0);
+    return STATUS_OK;
+}
+
+/*
+ * Extract the classification key. Ports stay 0 for other protocols and for
+ * non-first fragments; *has_ports says whether the key names a flow.
+ */
+static bool fw_parse(const uint8_t* p, size_t length, fw_key_t* key, uint8_t* tcp_flags,
+                     bool* has_ports) {
+    if (length < sizeof(ipv4_header_t)) {
+        return false;
+    }
+
+    const ipv4_header_t* ip = (const ipv4_header_t*)p;
+    uint32_t ihl = (ip->version_ihl & 0x0F) * 4;
+    if ((ip->version_ihl >> 4) != 4 || ihl < sizeof(ipv4_header_t) || ihl > length) {
+        return false;
+    }
+
+    key->src = ((uint32_t)ip->src.addr[0] << 24) | ((uint32_t)ip->src.addr[1] << 16) |
+               ((uint32_t)ip->src.addr[2] << 8) | ip->src.addr[3];
+    key->dst = ((uint32_t)ip->dst.addr[0] << 24) | ((uint32_t)ip->dst.addr[1] << 16) |
+               ((uint32_t)ip->dst.addr[2] << 8) | ip->dst.addr[3];
+    key->protocol = ip->protocol;
+    key->sport = 0;
+    key->dport = 0;
+    *tcp_flags = 0;
+    *has_ports = false;
+
+    bool first_fragment = (ntohs(ip->flags_fragment) & 0x1FFF) == 0;
+    if (first_fragment && (ip->protocol == IP_PROTO_TCP || ip->protocol == IP_PROTO_UDP) &&
+        length >= ihl + 4) {
+        const uint8_t* l4 = p + ihl;
+        key->sport = ((uint16_t)l4[0] << 8) | l4[1];
+        key->dport = ((uint16_t)l4[2] << 8) | l4[3];
+        *has_ports = true;
+        if (ip->protocol == IP_PROTO_TCP && length >= ihl + 14) {
+            *tcp_flags = l4[13];
+        }
+    }
+    return true;
+}
+
+/*
+ * Verdict for an IPv4 packet on a chain. Packets of tracked flows are
+ * accepted without consulting the rules; otherwise the chain's ruleset
+ * decides and accepted flows start being tracked. Only TCP and UDP with
+ * ports are tracked: anything else would collapse every exchange between
+ * two hosts into one flow, so it is classified packet by packet.
+ */
+fw_action_t fw_filter(fw_chain_t chain, const void* ip_packet, size_t length) {
+    if (!__atomic_load_n(&fw_state.active, __ATOMIC_ACQUIRE) || chain >= FW_CHAIN_COUNT) {
+        return FW_ACTION_ACCEPT;
+    }
+
+    fw_stats.packets[chain]++;
+
+    fw_key_t key;
+    uint8_t tcp_flags;
+    bool has_ports;
+    if (!fw_parse((const uint8_t*)ip_packet, length, &key, &tcp_flags, &has_ports)) {
+        fw_stats.dropped[chain]++;
+        return FW_ACTION_DROP;
+    }
+
+    ct_tuple_t tuple;
+    ct_tuple_from_key(&key, &tuple);
+    uint64_t now = perf_timestamp_ns();
+
+    if (has_ports && ct_lookup(&fw_state.conntrack, &tuple, tcp_flags, now)) {
+        fw_stats.ct_hits++;
+        return FW_ACTION_ACCEPT;
+    }
+
+    uint32_t reader = epoch_read_lock(&fw_state.readers);
+    fw_ruleset_t* rs = __atomic_load_n(&fw_state.chains[chain], __ATOMIC_SEQ_CST);
+    fw_action_t action = rs ? fw_verdict(rs, &key) : FW_ACTION_ACCEPT;
+    bool track = has_ports && action == FW_ACTION_ACCEPT && !(tcp_flags & TCP_FLAG_RST);
+    bool evicted = track && ct_insert(&fw_state.conntrack, &tuple, now);
+    epoch_read_unlock(&fw_state.readers, reader);
+    fw_stats.classified++;
+
+    if (action != FW_ACTION_ACCEPT) {
+        fw_stats.dropped[chain]++;
+    } else if (track) {
+        fw_stats.ct_inserts++;
+        if (evicted) {
+            fw_stats.ct_evictions++;
+        }
+    }
+    return action;
+}
+
+status_t fw_get_stats(fw_stats_t* stats) {
+    if (!stats) {
+        return STATUS_INVALID;
+    }
+
+    *stats = fw_stats;
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+#define FW_BENCH_KEYS     65536
+#define FW_BENCH_LINEAR   (1u << 27)   /* Rule checks allowed for the linear pass */
+
+static inline uint32_t fw_bench_rand(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static uint8_t fw_bench_prefix(uint32_t r, uint32_t wildcard_pct) {
+    uint32_t p = r % 100;
+    if (p < wildcard_pct) return 0;
+    if (p < wildcard_pct + 15) return 8;
+    if (p < wildcard_pct + 35) return 16;
+    if (p < wildcard_pct + 65) return 24;
+    return 32;
+}
+
+/* Access-list shaped rules drawn from a handful of /8s so that they overlap */
+static void fw_bench_rule(uint32_t* seed, fw_rule_t* r) {
+    static const uint16_t ports[] = { 22, 25, 53, 80, 123, 443, 993, 3306, 5432, 6379, 8080, 8443 };
+    uint32_t x = fw_bench_rand(seed);
+
+    r->src = ((10u + (x & 15)) << 24) | (fw_bench_rand(seed) & 0x00FFFFFFu);
+    r->dst = ((10u + ((x >> 4) & 15)) << 24) | (fw_bench_rand(seed) & 0x00FFFFFFu);
+    r->src_len = fw_bench_prefix(fw_bench_rand(seed), 20);
+    r->dst_len = fw_bench_prefix(fw_bench_rand(seed), 2);
+
+    uint32_t p = (x >> 8) % 10;
+    r->protocol = p < 6 ? IP_PROTO_TCP : (p < 9 ? IP_PROTO_UDP : 0);
+
+    r->sport_lo = 0;
+    r->sport_hi = 0xFFFF;
+    if (((x >> 12) % 10) == 0) {
+        r->sport_lo = r->sport_hi = 1024 + (fw_bench_rand(seed) % 64512);
+    }
+
+    uint32_t d = (x >> 16) % 20;
+    if (d < 12) {
+        r->dport_lo = r->dport_hi = ports[fw_bench_rand(seed) % 12];
+    } else if (d < 16) {
+        r->dport_lo = 1024 + (fw_bench_rand(seed) % 60000);
+        r->dport_hi = r->dport_lo + (fw_bench_rand(seed) % 512);
+    } else if (d < 18) {
+        r->dport_lo = 1024;
+        r->dport_hi = 0xFFFF;
+    } else {
+        r->dport_lo = 0;
+        r->dport_hi = 0xFFFF;
+    }
+
+    r->action = (x >> 24) & 1 ? FW_ACTION_DROP : FW_ACTION_ACCEPT;
+}
+
+/* Half the keys are random, half are drawn from inside a random rule */
+static void fw_bench_key(uint32_t* seed, const fw_rule_t* rules, uint32_t count, fw_key_t* k) {
+    uint32_t x = fw_bench_rand(seed);
+    k->src = ((10u + (x & 15)) << 24) | (fw_bench_rand(seed) & 0x00FFFFFFu);
+    k->dst = ((10u + ((x >> 4) & 15)) << 24) | (fw_bench_rand(seed) & 0x00FFFFFFu);
+    k->sport = 1024 + fw_bench_rand(seed) % 64512;
+    k->dport = fw_bench_rand(seed) & 0xFFFF;
+    k->protocol = (x >> 8) & 1 ? IP_PROTO_TCP : IP_PROTO_UDP;
+
+    if (count && ((x >> 9) & 1)) {
+        const fw_rule_t* r = &rules[fw_bench_rand(seed) % count];
+        uint32_t sm = r->src_len ? 0xFFFFFFFFu << (32 - r->src_len) : 0;
+        uint32_t dm = r->dst_len ? 0xFFFFFFFFu << (32 - r->dst_len) : 0;
+        k->src = (r->src & sm) | (k->src & ~sm);
+        k->dst = (r->dst & dm) | (k->dst & ~dm);
+        k->sport = r->sport_lo + fw_bench_rand(seed) % (r->sport_hi - r->sport_lo + 1u);
+        k->dport = r->dport_lo + fw_bench_rand(seed) % (r->dport_hi - r->dport_lo + 1u);
+        if (r->protocol) {
+            k->protocol = r->protocol;
+        }
+    }
+}
+
+/*
+ * Compile rule_count synthetic rules and time classification of `packets`
+ * keys through the decision tree, through a linear walk (capped so large
+ * rulesets finish; its keys double as a correctness check) and through the
+ * conntrack fast path with every flow already established.
+ */
+status_t fw_benchmark(uint32_t rule_count, uint32_t packets, fw_bench_result_t* result) {
+    if (!result || rule_count > FW_MAX_RULES || packets == 0) {
+        return STATUS_INVALID;
+    }
+
+    uint32_t rule_pages = PAGES_FOR((uint64_t)(rule_count ? rule_count : 1) * sizeof(fw_rule_t));
+    uint32_t key_pages = PAGES_FOR(FW_BENCH_KEYS * sizeof(fw_key_t));
+    fw_rule_t* rules = (fw_rule_t*)pmm_alloc_pages(rule_pages);
+    fw_key_t* keys = (fw_key_t*)pmm_alloc_pages(key_pages);
+    ct_table_t ct = {0};
+    fw_ruleset_t* rs = NULL;
+    status_t status = STATUS_NOMEM;
+
+    if (!rules || !keys || FAILED(ct_table_init(&ct, CT_SETS * 4))) {
+        goto out;
+    }
+
+    uint32_t seed = 0x2545F491;
+    for (uint32_t i = 0; i < rule_count; i++) {
+        fw_bench_rule(&seed, &rules[i]);
+    }
+    for (uint32_t i = 0; i < FW_BENCH_KEYS; i++) {
+        fw_bench_key(&seed, rules, rule_count, &keys[i]);
+    }
+
+    uint64_t start = perf_timestamp_ns();
+    status = fw_compile(rules, rule_count, FW_ACTION_ACCEPT, &rs);
+    result->compile_ns = perf_timestamp_ns() - start;
+    if (FAILED(status)) {
+        goto out;
+    }
+
+    volatile uint32_t sink = 0;
+    start = perf_timestamp_ns();
+    for (uint32_t i = 0; i < packets; i++) {
+        sink += (uint32_t)fw_classify(rs, &keys[i & (FW_BENCH_KEYS - 1)]);
+    }
+    result->tree_ns = perf_timestamp_ns() - start;
+
+    uint32_t linear = packets;
+    if (rule_count && linear > FW_BENCH_LINEAR / rule_count) {
+        linear = FW_BENCH_LINEAR / rule_count;
+    }
+    if (linear > FW_BENCH_KEYS) {
+        linear = FW_BENCH_KEYS;
+    }
+    start = perf_timestamp_ns();
+    for (uint32_t i = 0; i < linear; i++) {
+        sink += (uint32_t)fw_classify_linear(rs, &keys[i]);
+    }
+    uint64_t linear_ns = perf_timestamp_ns() - start;
+    result->linear_ns = linear ? linear_ns * packets / linear : 0;
+
+    result->mismatches = 0;
+    for (uint32_t i = 0; i < linear; i++) {
+        if (fw_classify(rs, &keys[i]) != fw_classify_linear(rs, &keys[i])) {
+            result->mismatches++;
+        }
+    }
+
+    /* Open every flow, then answer it so the entries are established */
+    uint64_t now = perf_timestamp_ns();
+    for (uint32_t i = 0; i < FW_BENCH_KEYS; i++) {
+        ct_tuple_t t;
+        ct_tuple_from_key(&keys[i], &t);
+        ct_insert(&ct, &t, now);
+        t.dir = !t.dir;
+        ct_lookup(&ct, &t, 0, now);
+    }
+
+    uint32_t hits = 0;
+    start = perf_timestamp_ns();
+    for (uint32_t i = 0; i < packets; i++) {
+        ct_tuple_t t;
+        ct_tuple_from_key(&keys[i & (FW_BENCH_KEYS - 1)], &t);
+        hits += ct_lookup(&ct, &t, TCP_FLAG_ACK, now);
+    }
+    result->tracked_ns = perf_timestamp_ns() - start;
+
+    result->rules = rule_count;
+    result->packets = packets;
+    result->nodes = rs->nodes.count;
+    result->max_leaf = rs->max_leaf;
+    result->tree_bytes = (uint64_t)rs->nodes.count * sizeof(fw_node_t) +
+                         (uint64_t)rs->children.count * sizeof(uint32_t) +
+                         (uint64_t)rs->leaf_rules.count * sizeof(uint32_t) +
+                         (uint64_t)rule_count * sizeof(fw_crule_t);
+
+    KLOG_INFO("FW", "Bench: %u rules, %u nodes, tree %llu ns/pkt, linear %llu ns/pkt, "
+              "tracked %llu ns/pkt (%u hits, %u mismatches)",
+              rule_count, rs->nodes.count, result->tree_ns / packets, result->linear_ns / packets,
+              result->tracked_ns / packets, hits, result->mismatches);
+    status = STATUS_OK;
+
+out:
+    fw_ruleset_destroy(rs);
+    ct_table_free(&ct);
+    if (keys) {
+        pmm_free_pages((paddr_t)keys, key_pages);
+    }
+    if (rules) {
+        pmm_free_pages((paddr_t)rules, rule_pages);
+    }
+    return status;
+}
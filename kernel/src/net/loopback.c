@@ -0,0 +1,43 @@
+/*
+ * Loopback Device
+ * 127.0.0.1/8; frames sent on "lo" are received on it immediately
+ */
+
+#include "kernel.h"
+#include "net.h"
+#include "qdisc.h"
+
+static status_t loopback_send(net_interface_t* iface, const void* data, size_t length) {
+    return net_receive_packet(iface, data, length);
+}
+
+/* Super-packets are never segmented; the receive side sees them whole */
+static status_t loopback_send_gso(net_interface_t* iface, net_buffer_t* buf) {
+    return net_receive_gso(iface, net_buffer_head(buf), buf->length, buf->gso_size);
+}
+
+status_t loopback_init(void) {
+    net_interface_t iface = {0};
+    const char* name = "lo";
+    for (int i = 0; name[i]; i++) {
+        iface.name[i] = name[i];
+    }
+    iface.send = loopback_send;
+    iface.send_gso = loopback_send_gso;
+    iface.features = NET_F_GSO_ANY | NET_F_NOARP;
+
+    status_t status = net_register_interface(&iface);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    net_interface_t* lo = net_get_interface(iface.id);
+
+    /* Nothing to queue for: the "wire" is the receive path */
+    net_interface_set_qdisc(lo, NULL);
+
+    ipv4_addr_t ip = {{127, 0, 0, 1}};
+    ipv4_addr_t netmask = {{255, 0, 0, 0}};
+    net_interface_configure(lo, &ip, &netmask, NULL);
+    return net_interface_up(lo);
+}
@@ -6,6 +6,11 @@
 #include "kernel.h"
 #include "microkernel.h"
 #include "net.h"
+#include "netfilter.h"
+#include "qdisc.h"
+
+#define NET_BUFFER_PAGES(capacity) ((sizeof(net_buffer_t) + (capacity) + PAGE_SIZE - 1) / PAGE_SIZE)
+#define NET_DEFAULT_QDISC "fq_codel"
 
 /* Global network stack */
 static net_stack_t net_stack = {0};
@@ -82,6 +87,28 @@ uint16_t ip_checksum(const void* data, size_t length) {
     return ~sum;
 }
 
+/* Allocate a buffer with room for capacity bytes of packet data */
+net_buffer_t* net_buffer_alloc(size_t capacity) {
+    net_buffer_t* buf = (net_buffer_t*)pmm_alloc_pages(NET_BUFFER_PAGES(capacity));
+    if (!buf) {
+        return NULL;
+    }
+
+    buf->length = 0;
+    buf->offset = 0;
+    buf->capacity = capacity;
+    buf->gso_size = 0;
+    buf->gso_type = NET_GSO_NONE;
+    buf->gso_sent = 0;
+    return buf;
+}
+
+void net_buffer_free(net_buffer_t* buf) {
+    if (buf) {
+        pmm_free_pages((paddr_t)buf, NET_BUFFER_PAGES(buf->capacity));
+    }
+}
+
 /* Initialize network stack */
 status_t net_init(void) {
     if (net_stack.initialized) {
@@ -114,8 +141,25 @@ status_t net_init(void) {
 
     net_stack.socket_count = 0;
     net_stack.lock = 0;
+
+    status_t status = fib_init();
+    if (FAILED(status) && status != STATUS_EXISTS) {
+        KLOG_ERROR("NET", "Failed to initialize routing table");
+        return status;
+    }
+
+    status = fw_init();
+    if (FAILED(status) && status != STATUS_EXISTS) {
+        KLOG_ERROR("NET", "Failed to initialize firewall");
+        return status;
+    }
+
     net_stack.initialized = true;
 
+    if (FAILED(loopback_init())) {
+        KLOG_WARN("NET", "Failed to create loopback interface");
+    }
+
     KLOG_INFO("NET", "Network stack initialized");
     return STATUS_OK;
 }
@@ -158,12 +202,17 @@ status_t net_register_interface(net_interface_t* iface) {
     }
 
     uint8_t id = net_stack.interface_count;
+    iface->id = id;
     net_stack.interfaces[id] = *iface;
-    net_stack.interfaces[id].id = id;
     net_stack.interface_count++;
 
     __sync_lock_release(&net_stack.lock);
 
+    /* Fair queueing by default; without a qdisc frames go straight to the driver */
+    if (FAILED(net_interface_set_qdisc(&net_stack.interfaces[id], NET_DEFAULT_QDISC))) {
+        KLOG_WARN("NET", "No qdisc on %s, transmitting directly", iface->name);
+    }
+
     KLOG_INFO("NET", "Registered interface %s (id=%d)", iface->name, id);
     return STATUS_OK;
 }
@@ -177,6 +226,45 @@ net_interface_t* net_get_interface(uint8_t id) {
     return &net_stack.interfaces[id];
 }
 
+/* Prefix length of a contiguous netmask */
+static uint8_t net_netmask_len(const ipv4_addr_t* netmask) {
+    uint8_t len = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t b = netmask->addr[i];
+        while (b & 0x80) {
+            len++;
+            b <<= 1;
+        }
+        if (netmask->addr[i] != 0xFF) {
+            break;
+        }
+    }
+    return len;
+}
+
+static bool ipv4_addr_is_zero(const ipv4_addr_t* a) {
+    return !(a->addr[0] | a->addr[1] | a->addr[2] | a->addr[3]);
+}
+
+/* Install the connected subnet and default gateway routes for an interface */
+static void net_install_routes(net_interface_t* iface) {
+    if (ipv4_addr_is_zero(&iface->ip)) {
+        return;
+    }
+
+    ipv4_addr_t subnet;
+    for (int i = 0; i < 4; i++) {
+        subnet.addr[i] = iface->ip.addr[i] & iface->netmask.addr[i];
+    }
+    route_add(&subnet, net_netmask_len(&iface->netmask), NULL, iface->id, FIB_METRIC_CONNECTED);
+
+    /* Equal metrics make default routes on several interfaces an ECMP set */
+    if (!ipv4_addr_is_zero(&iface->gateway)) {
+        ipv4_addr_t any = {{0, 0, 0, 0}};
+        route_add(&any, 0, &iface->gateway, iface->id, FIB_METRIC_DEFAULT);
+    }
+}
+
 /* Bring interface up */
 status_t net_interface_up(net_interface_t* iface) {
     if (!iface) {
@@ -184,6 +272,7 @@ status_t net_interface_up(net_interface_t* iface) {
     }
 
     iface->up = true;
+    net_install_routes(iface);
     KLOG_INFO("NET", "Interface %s is up", iface->name);
     return STATUS_OK;
 }
@@ -195,52 +284,101 @@ status_t net_interface_down(net_interface_t* iface) {
     }
 
     iface->up = false;
+    route_delete_iface(iface->id);
     KLOG_INFO("NET", "Interface %s is down", iface->name);
     return STATUS_OK;
 }
 
-/* Send Ethernet packet */
-status_t eth_send_packet(net_interface_t* iface, const mac_addr_t* dst_mac,
-                         uint16_t ethertype, const void* payload, size_t length) {
-    if (!iface || !dst_mac || !payload || !iface->up) {
+/* Set address, netmask and gateway, replacing the interface's routes */
+status_t net_interface_configure(net_interface_t* iface, const ipv4_addr_t* ip,
+                                 const ipv4_addr_t* netmask, const ipv4_addr_t* gateway) {
+    if (!iface || !ip || !netmask) {
+        return STATUS_INVALID;
+    }
+
+    route_delete_iface(iface->id);
+
+    ipv4_addr_copy(&iface->ip, ip);
+    ipv4_addr_copy(&iface->netmask, netmask);
+    if (gateway) {
+        ipv4_addr_copy(&iface->gateway, gateway);
+    } else {
+        iface->gateway = (ipv4_addr_t){{0, 0, 0, 0}};
+    }
+
+    if (iface->up) {
+        net_install_routes(iface);
+    }
+    return STATUS_OK;
+}
+
+/* Prepend the Ethernet header and queue the frame on the interface's qdisc; consumes buf */
+static status_t eth_output(net_interface_t* iface, const mac_addr_t* dst_mac, uint16_t ethertype,
+                           net_buffer_t* buf, const qdisc_meta_t* meta) {
+    if (!iface || !dst_mac || !iface->up || buf->offset < sizeof(eth_header_t)) {
+        net_buffer_free(buf);
         return STATUS_INVALID;
     }
 
-    /* Allocate buffer for frame */
-    uint8_t frame[NET_BUF_SIZE];
-    eth_header_t* eth = (eth_header_t*)frame;
+    /* Only super-packets may exceed one frame */
+    size_t total_length = sizeof(eth_header_t) + buf->length;
+    if (!buf->gso_size && total_length > NET_BUF_SIZE) {
+        net_buffer_free(buf);
+        return STATUS_INVALID;
+    }
 
     /* Build Ethernet header */
+    eth_header_t* eth = (eth_header_t*)net_buffer_push(buf, sizeof(eth_header_t));
     mac_addr_copy(&eth->dst, dst_mac);
     mac_addr_copy(&eth->src, &iface->mac);
     eth->ethertype = htons(ethertype);
 
-    /* Copy payload */
-    size_t total_length = sizeof(eth_header_t) + length;
-    if (total_length > NET_BUF_SIZE) {
-        return STATUS_INVALID;
+    net_filter_t* filter = __atomic_load_n(&iface->tx_filter, __ATOMIC_ACQUIRE);
+    if (filter && nf_run(filter, eth, (uint32_t)total_length) == 0) {
+        iface->tx_filtered++;
+        net_buffer_free(buf);
+        return STATUS_OK;
     }
 
-    uint8_t* payload_ptr = frame + sizeof(eth_header_t);
-    for (size_t i = 0; i < length; i++) {
-        payload_ptr[i] = ((const uint8_t*)payload)[i];
-    }
-
-    /* Send through driver */
-    status_t result = iface->send(iface, frame, total_length);
+    /* Interface counters are updated when the qdisc hands the frame to the driver */
+    uint32_t segments = net_gso_segments(buf);
+    status_t result = qdisc_xmit_buffer(iface, buf, meta);
 
     if (SUCCESS(result)) {
-        iface->tx_packets++;
-        iface->tx_bytes += total_length;
-        net_stats.total_tx_packets++;
+        net_stats.total_tx_packets += segments;
         net_stats.total_tx_bytes += total_length;
-    } else {
-        iface->tx_errors++;
     }
 
     return result;
 }
 
+/* Copy a payload into a fresh buffer with headroom for the lower layers */
+static net_buffer_t* net_buffer_from(const void* payload, size_t length) {
+    net_buffer_t* buf = net_buffer_alloc(NET_HEADROOM + length);
+    if (!buf) {
+        return NULL;
+    }
+
+    buf->offset = NET_HEADROOM;
+    buf->length = length;
+    memcpy(net_buffer_head(buf), payload, length);
+    return buf;
+}
+
+/* Send Ethernet packet */
+status_t eth_send_packet(net_interface_t* iface, const mac_addr_t* dst_mac,
+                         uint16_t ethertype, const void* payload, size_t length) {
+    if (!iface || !dst_mac || !payload || !iface->up) {
+        return STATUS_INVALID;
+    }
+
+    net_buffer_t* buf = net_buffer_from(payload, length);
+    if (!buf) {
+        return STATUS_NOMEM;
+    }
+    return eth_output(iface, dst_mac, ethertype, buf, NULL);
+}
+
 /* ARP lookup */
 status_t arp_lookup(const ipv4_addr_t* ip, mac_addr_t* out_mac) {
     if (!ip || !out_mac) {
@@ -264,6 +402,18 @@ status_t arp_add_entry(const ipv4_addr_t* ip, const mac_addr_t* mac) {
         return STATUS_INVALID;
     }
 
+    /* Refresh an existing entry; a changed MAC invalidates cached routes */
+    for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (net_stack.arp_cache[i].valid &&
+            ipv4_addr_equals(&net_stack.arp_cache[i].ip, ip)) {
+            if (!mac_addr_equals(&net_stack.arp_cache[i].mac, mac)) {
+                mac_addr_copy(&net_stack.arp_cache[i].mac, mac);
+                route_invalidate();
+            }
+            return STATUS_OK;
+        }
+    }
+
     /* Find free slot */
     for (uint32_t i = 0; i < ARP_CACHE_SIZE; i++) {
         if (!net_stack.arp_cache[i].valid) {
@@ -307,29 +457,97 @@ status_t arp_request(net_interface_t* iface, const ipv4_addr_t* target_ip) {
     return eth_send_packet(iface, &broadcast, ETHERTYPE_ARP, &arp, sizeof(arp));
 }
 
-/* Send IP packet */
-status_t ip_send_packet(net_interface_t* iface, const ipv4_addr_t* dst_ip,
-                        uint8_t protocol, const void* payload, size_t length) {
-    if (!iface || !dst_ip || !payload) {
+/* True if dst is inside the interface's own subnet */
+static bool ip_on_link(const net_interface_t* iface, const ipv4_addr_t* dst) {
+    for (int i = 0; i < 4; i++) {
+        if ((dst->addr[i] ^ iface->ip.addr[i]) & iface->netmask.addr[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Pick the outgoing interface and next-hop MAC for dst. A caller-supplied
+ * interface (replies leave where the request came in) is kept and only the
+ * next hop is chosen; otherwise the FIB decides. A valid cache whose
+ * generation still matches skips both the FIB and ARP lookups.
+ */
+static status_t ip_route_output(net_interface_t* iface, const ipv4_addr_t* dst_ip,
+                                uint32_t flow_hash, route_cache_t* cache,
+                                net_interface_t** out_iface, mac_addr_t* out_mac) {
+    uint32_t generation = route_generation();
+
+    if (cache && cache->valid && cache->generation == generation &&
+        ipv4_addr_equals(&cache->dst, dst_ip) &&
+        (!iface || iface->id == cache->iface_id)) {
+        *out_iface = net_get_interface(cache->iface_id);
+        mac_addr_copy(out_mac, &cache->next_hop_mac);
+        return STATUS_OK;
+    }
+
+    route_result_t rt;
+    status_t status = route_lookup(dst_ip, flow_hash, &rt);
+
+    if (iface) {
+        if (ip_on_link(iface, dst_ip)) {
+            ipv4_addr_copy(&rt.next_hop, dst_ip);
+        } else if (FAILED(status) || rt.iface != iface) {
+            if (ipv4_addr_is_zero(&iface->gateway)) {
+                return STATUS_NOTFOUND;
+            }
+            ipv4_addr_copy(&rt.next_hop, &iface->gateway);
+        }
+        rt.iface = iface;
+    } else if (FAILED(status)) {
+        return STATUS_NOTFOUND;
+    }
+
+    mac_addr_t mac = {{0, 0, 0, 0, 0, 0}};
+    if (!(rt.iface->features & NET_F_NOARP) && FAILED(arp_lookup(&rt.next_hop, &mac))) {
+        /* Send ARP request and fail for now */
+        arp_request(rt.iface, &rt.next_hop);
+        return STATUS_NOTFOUND;
+    }
+
+    if (cache) {
+        cache->generation = generation;
+        ipv4_addr_copy(&cache->dst, dst_ip);
+        ipv4_addr_copy(&cache->next_hop, &rt.next_hop);
+        mac_addr_copy(&cache->next_hop_mac, &mac);
+        cache->iface_id = rt.iface->id;
+        cache->valid = true;
+    }
+
+    *out_iface = rt.iface;
+    mac_addr_copy(out_mac, &mac);
+    return STATUS_OK;
+}
+
+/* Route buf, prepend the IP header and send it; consumes buf */
+static status_t ip_output_buffer(net_interface_t* iface, const ipv4_addr_t* dst_ip,
+                                 uint8_t protocol, net_buffer_t* buf, uint32_t flow_hash,
+                                 socket_t* sock) {
+    size_t total_length = sizeof(ipv4_header_t) + buf->length;
+    if (total_length > NET_GSO_MAX_SIZE || buf->offset < sizeof(ipv4_header_t)) {
+        net_buffer_free(buf);
         return STATUS_INVALID;
     }
 
-    /* Look up MAC address */
     mac_addr_t dst_mac;
-    status_t result = arp_lookup(dst_ip, &dst_mac);
+    status_t result = ip_route_output(iface, dst_ip, flow_hash, sock ? &sock->route_cache : NULL,
+                                      &iface, &dst_mac);
     if (FAILED(result)) {
-        /* Send ARP request and fail for now */
-        arp_request(iface, dst_ip);
-        return STATUS_NOTFOUND;
+        net_buffer_free(buf);
+        return result;
     }
 
     /* Build IP header */
-    uint8_t packet[NET_BUF_SIZE];
-    ipv4_header_t* ip = (ipv4_header_t*)packet;
+    ipv4_header_t* ip = (ipv4_header_t*)net_buffer_push(buf, sizeof(ipv4_header_t));
 
     ip->version_ihl = 0x45;  // IPv4, IHL=5 (20 bytes)
     ip->dscp_ecn = 0;
-    ip->total_length = htons(sizeof(ipv4_header_t) + length);
+    ip->total_length = htons((uint16_t)total_length);
     ip->identification = 0;
     ip->flags_fragment = 0;
     ip->ttl = 64;
@@ -340,26 +558,54 @@ status_t ip_send_packet(net_interface_t* iface, const ipv4_addr_t* dst_ip,
 
     ip->checksum = ip_checksum(ip, sizeof(ipv4_header_t));
 
-    /* Copy payload */
-    uint8_t* payload_ptr = packet + sizeof(ipv4_header_t);
-    for (size_t i = 0; i < length; i++) {
-        payload_ptr[i] = ((const uint8_t*)payload)[i];
+    if (fw_filter(FW_CHAIN_OUTPUT, ip, total_length) != FW_ACTION_ACCEPT) {
+        net_buffer_free(buf);
+        return STATUS_DENIED;
     }
 
-    return eth_send_packet(iface, &dst_mac, ETHERTYPE_IP, packet,
-                          sizeof(ipv4_header_t) + length);
+    qdisc_meta_t meta = { flow_hash, 0, 0 };
+    if (sock) {
+        meta.priority = sock->priority;
+        meta.pacing_rate = sock->pacing_rate;
+    }
+
+    return eth_output(iface, &dst_mac, ETHERTYPE_IP, buf, &meta);
 }
 
-/* Send ICMP echo request (ping) */
-status_t icmp_send_echo_request(const ipv4_addr_t* dst_ip, uint16_t id, uint16_t seq) {
+/* Route and send an IP packet */
+static status_t ip_output(net_interface_t* iface, const ipv4_addr_t* dst_ip, uint8_t protocol,
+                          const void* payload, size_t length, uint32_t flow_hash,
+                          socket_t* sock) {
+    if (!dst_ip || !payload) {
+        return STATUS_INVALID;
+    }
+
+    if (length > NET_BUF_SIZE - sizeof(ipv4_header_t)) {
+        return STATUS_INVALID;
+    }
+
+    net_buffer_t* buf = net_buffer_from(payload, length);
+    if (!buf) {
+        return STATUS_NOMEM;
+    }
+    return ip_output_buffer(iface, dst_ip, protocol, buf, flow_hash, sock);
+}
+
+/* Send IP packet */
+status_t ip_send_packet(net_interface_t* iface, const ipv4_addr_t* dst_ip,
+                        uint8_t protocol, const void* payload, size_t length) {
     if (!dst_ip) {
         return STATUS_INVALID;
     }
 
-    /* Get first interface */
-    net_interface_t* iface = net_get_interface(0);
-    if (!iface || !iface->up) {
-        return STATUS_ERROR;
+    uint32_t flow_hash = route_flow_hash(iface ? &iface->ip : NULL, dst_ip, protocol, 0, 0);
+    return ip_output(iface, dst_ip, protocol, payload, length, flow_hash, NULL);
+}
+
+/* Send ICMP echo request (ping) */
+status_t icmp_send_echo_request(const ipv4_addr_t* dst_ip, uint16_t id, uint16_t seq) {
+    if (!dst_ip) {
+        return STATUS_INVALID;
     }
 
     icmp_header_t icmp;
@@ -372,7 +618,7 @@ status_t icmp_send_echo_request(const ipv4_addr_t* dst_ip, uint16_t id, uint16_t
     icmp.checksum = ip_checksum(&icmp, sizeof(icmp));
 
     net_stats.icmp_echo_requests++;
-    return ip_send_packet(iface, dst_ip, IP_PROTO_ICMP, &icmp, sizeof(icmp));
+    return ip_send_packet(NULL, dst_ip, IP_PROTO_ICMP, &icmp, sizeof(icmp));
 }
 
 /* Send ICMP echo reply */
@@ -409,8 +655,97 @@ status_t icmp_send_echo_reply(net_interface_t* iface, const ipv4_addr_t* dst_ip,
                           sizeof(icmp_header_t) + length);
 }
 
+/* Run the socket filter over one datagram and queue it; the header is rebuilt for each segment */
+static void udp_queue(socket_t* sock, const udp_header_t* udp, const uint8_t* payload,
+                      size_t payload_length) {
+    size_t udp_length = sizeof(udp_header_t) + payload_length;
+    net_buffer_t* buf = net_buffer_alloc(udp_length);
+    if (!buf) {
+        return;
+    }
+
+    udp_header_t* hdr = (udp_header_t*)buf->data;
+    *hdr = *udp;
+    hdr->length = htons((uint16_t)udp_length);
+    memcpy(buf->data + sizeof(udp_header_t), payload, payload_length);
+
+    /* The socket filter sees the datagram from the UDP header on */
+    size_t keep = udp_length;
+    net_filter_t* filter = __atomic_load_n(&sock->filter, __ATOMIC_ACQUIRE);
+    if (filter) {
+        uint32_t verdict = nf_run(filter, buf->data, (uint32_t)udp_length);
+        if (verdict == 0) {
+            sock->rx_filtered++;
+            net_buffer_free(buf);
+            return;
+        }
+        if (verdict < keep) {
+            keep = verdict < sizeof(udp_header_t) ? sizeof(udp_header_t) : verdict;
+        }
+    }
+
+    buf->offset = sizeof(udp_header_t);
+    buf->length = keep - sizeof(udp_header_t);
+
+    __sync_lock_test_and_set(&sock->lock, 1);
+    if (sock->rx_queued >= SOCKET_RX_QUEUE_MAX) {
+        __sync_lock_release(&sock->lock);
+        net_buffer_free(buf);
+        return;
+    }
+    list_add(&buf->list_node, sock->rx_queue.prev);
+    sock->rx_queued++;
+    __sync_lock_release(&sock->lock);
+}
+
+/*
+ * Queue a datagram on the UDP socket bound to its destination port. A
+ * super-packet from the loopback device carries gso_size-byte datagrams
+ * back to back and is split here, so the receiver sees the writes the
+ * sender made.
+ */
+static void udp_deliver(const ipv4_header_t* ip, const uint8_t* data, size_t length,
+                        uint16_t gso_size) {
+    if (length < sizeof(udp_header_t)) {
+        return;
+    }
+
+    const udp_header_t* udp = (const udp_header_t*)data;
+    uint16_t dst_port = ntohs(udp->dst_port);
+    size_t udp_length = ntohs(udp->length);
+    if (udp_length < sizeof(udp_header_t) || udp_length > length) {
+        return;
+    }
+
+    socket_t* sock = NULL;
+    for (uint32_t i = 0; i < SOCKET_MAX; i++) {
+        socket_t* s = &net_stack.sockets[i];
+        if (s->bound && s->type == SOCKET_TYPE_UDP && s->local_port == dst_port &&
+            (ipv4_addr_is_zero(&s->local_ip) || ipv4_addr_equals(&s->local_ip, &ip->dst))) {
+            sock = s;
+            break;
+        }
+    }
+    if (!sock) {
+        return;
+    }
+
+    const uint8_t* payload = data + sizeof(udp_header_t);
+    size_t payload_length = udp_length - sizeof(udp_header_t);
+    if (!gso_size) {
+        udp_queue(sock, udp, payload, payload_length);
+        return;
+    }
+
+    for (size_t off = 0; off < payload_length; off += gso_size) {
+        size_t seg = payload_length - off < gso_size ? payload_length - off : gso_size;
+        udp_queue(sock, udp, payload + off, seg);
+    }
+}
+
 /* Process received Ethernet frame */
-static void net_process_ethernet(net_interface_t* iface, const uint8_t* data, size_t length) {
+static void net_process_ethernet(net_interface_t* iface, const uint8_t* data, size_t length,
+                                 uint16_t gso_size) {
     if (length < sizeof(eth_header_t)) {
         return;
     }
@@ -462,7 +797,15 @@ static void net_process_ethernet(net_interface_t* iface, const uint8_t* data, si
         const ipv4_header_t* ip = (const ipv4_header_t*)payload;
         uint8_t protocol = ip->protocol;
         const uint8_t* ip_payload = payload + sizeof(ipv4_header_t);
-        size_t ip_payload_length = ntohs(ip->total_length) - sizeof(ipv4_header_t);
+        size_t total_length = ntohs(ip->total_length);
+        if (total_length < sizeof(ipv4_header_t) || total_length > payload_length) {
+            return;
+        }
+        size_t ip_payload_length = total_length - sizeof(ipv4_header_t);
+
+        if (fw_filter(FW_CHAIN_INPUT, payload, total_length) != FW_ACTION_ACCEPT) {
+            return;
+        }
 
         if (protocol == IP_PROTO_ICMP) {
             /* Process ICMP */
@@ -481,31 +824,73 @@ static void net_process_ethernet(net_interface_t* iface, const uint8_t* data, si
             }
         } else if (protocol == IP_PROTO_UDP) {
             net_stats.udp_packets++;
-            /* UDP processing would go here */
+            udp_deliver(ip, ip_payload, ip_payload_length, gso_size);
         } else if (protocol == IP_PROTO_TCP) {
-            net_stats.tcp_packets++;
+            /* A GRO packet stands for every segment merged into it */
+            net_stats.tcp_packets += gso_size && ip_payload_length > sizeof(tcp_header_t) ?
+                (ip_payload_length - sizeof(tcp_header_t) + gso_size - 1) / gso_size : 1;
             /* TCP processing would go here */
         }
     }
 }
 
-/* Receive packet (called by driver) */
-status_t net_receive_packet(net_interface_t* iface, const void* data, size_t length) {
-    if (!iface || !data || length == 0) {
-        return STATUS_INVALID;
+void net_process_frame(net_interface_t* iface, const void* data, size_t length,
+                       uint16_t gso_size) {
+    if (!iface || !data) {
+        return;
     }
+    net_process_ethernet(iface, (const uint8_t*)data, length, gso_size);
+}
 
+/* Count a frame and run the interface's receive filter; false if it was dropped */
+static bool net_rx_accept(net_interface_t* iface, const void* data, size_t length) {
     iface->rx_packets++;
     iface->rx_bytes += length;
     net_stats.total_rx_packets++;
     net_stats.total_rx_bytes += length;
 
+    net_filter_t* filter = __atomic_load_n(&iface->rx_filter, __ATOMIC_ACQUIRE);
+    if (filter && nf_run(filter, data, (uint32_t)length) == 0) {
+        iface->rx_filtered++;
+        return false;
+    }
+    return true;
+}
+
+/* Receive packet (called by driver) */
+status_t net_receive_packet(net_interface_t* iface, const void* data, size_t length) {
+    if (!iface || !data || length == 0) {
+        return STATUS_INVALID;
+    }
+
+    if (!net_rx_accept(iface, data, length)) {
+        return STATUS_OK;
+    }
+
+    /* GRO holds in-order TCP segments until the driver flushes */
+    if (net_gro_receive(iface, data, length)) {
+        return STATUS_OK;
+    }
+
     /* Process Ethernet frame */
-    net_process_ethernet(iface, (const uint8_t*)data, length);
+    net_process_ethernet(iface, (const uint8_t*)data, length, 0);
 
     return STATUS_OK;
 }
 
+/* Receive a super-packet of gso_size segments from a device that never split it */
+status_t net_receive_gso(net_interface_t* iface, const void* data, size_t length,
+                         uint16_t gso_size) {
+    if (!iface || !data || length == 0) {
+        return STATUS_INVALID;
+    }
+
+    if (net_rx_accept(iface, data, length)) {
+        net_process_ethernet(iface, (const uint8_t*)data, length, gso_size);
+    }
+    return STATUS_OK;
+}
+
 /* Create socket */
 status_t net_socket_create(socket_type_t type, uint8_t protocol, socket_t** out_sock) {
     if (!out_sock) {
@@ -533,6 +918,15 @@ status_t net_socket_create(socket_type_t type, uint8_t protocol, socket_t** out_
     sock->bound = false;
     sock->connected = false;
     sock->tcp_state = TCP_STATE_CLOSED;
+    sock->route_cache.valid = false;
+    sock->filter = NULL;
+    sock->rx_queued = 0;
+    sock->rx_filtered = 0;
+    sock->priority = NET_PRIO_BESTEFFORT;
+    sock->pacing_rate = 0;
+    sock->gso_size = 0;
+    list_init(&sock->rx_queue);
+    list_init(&sock->tx_queue);
 
     net_stack.socket_count++;
 
@@ -566,6 +960,7 @@ status_t net_socket_connect(socket_t* sock, const ipv4_addr_t* ip, uint16_t port
     ipv4_addr_copy(&sock->remote_ip, ip);
     sock->remote_port = port;
     sock->connected = true;
+    sock->route_cache.valid = false;
 
     if (sock->type == SOCKET_TYPE_TCP) {
         return tcp_connect(sock, ip, port);
@@ -584,6 +979,17 @@ status_t net_socket_close(socket_t* sock) {
         tcp_close(sock);
     }
 
+    /* Drop undelivered datagrams */
+    __sync_lock_test_and_set(&sock->lock, 1);
+    while (sock->rx_queued > 0) {
+        net_buffer_t* buf = list_entry(sock->rx_queue.next, net_buffer_t, list_node);
+        list_del(&buf->list_node);
+        sock->rx_queued--;
+        net_buffer_free(buf);
+    }
+    sock->filter = NULL;
+    __sync_lock_release(&sock->lock);
+
     sock->bound = false;
     sock->connected = false;
     net_stack.socket_count--;
@@ -591,6 +997,41 @@ status_t net_socket_close(socket_t* sock) {
     return STATUS_OK;
 }
 
+/* Transmit priority for the socket's packets (NET_PRIO_*) */
+status_t net_socket_set_priority(socket_t* sock, uint8_t priority) {
+    if (!sock || priority > NET_PRIO_MAX) {
+        return STATUS_INVALID;
+    }
+
+    sock->priority = priority;
+    return STATUS_OK;
+}
+
+/* Pacing rate honoured by the fq qdisc; 0 sends as fast as the link allows */
+status_t net_socket_set_pacing_rate(socket_t* sock, uint32_t bytes_per_sec) {
+    if (!sock) {
+        return STATUS_INVALID;
+    }
+
+    sock->pacing_rate = bytes_per_sec;
+    return STATUS_OK;
+}
+
+/*
+ * UDP segmentation: a write longer than gso_size leaves as one super-packet
+ * that is cut into gso_size-byte datagrams at the driver (or not at all on
+ * loopback). 0 sends each write as one datagram.
+ */
+status_t net_socket_set_gso_size(socket_t* sock, uint16_t gso_size) {
+    if (!sock || sock->type != SOCKET_TYPE_UDP ||
+        gso_size > NET_MTU - sizeof(ipv4_header_t) - sizeof(udp_header_t)) {
+        return STATUS_INVALID;
+    }
+
+    sock->gso_size = gso_size;
+    return STATUS_OK;
+}
+
 /* Get statistics */
 status_t net_get_stats(net_stats_t* stats) {
     if (!stats) {
@@ -652,31 +1093,56 @@ status_t udp_send(socket_t* sock, const void* data, size_t length) {
         return STATUS_INVALID;
     }
 
-    uint8_t packet[NET_BUF_SIZE];
-    udp_header_t* udp = (udp_header_t*)packet;
+    size_t max_length = sock->gso_size ?
+        NET_GSO_MAX_SIZE - sizeof(ipv4_header_t) - sizeof(udp_header_t) :
+        NET_BUF_SIZE - sizeof(eth_header_t) - sizeof(ipv4_header_t) - sizeof(udp_header_t);
+    if (length > max_length) {
+        return STATUS_INVALID;
+    }
+
+    size_t udp_length = sizeof(udp_header_t) + length;
+    net_buffer_t* buf = net_buffer_alloc(NET_HEADROOM + udp_length);
+    if (!buf) {
+        return STATUS_NOMEM;
+    }
+    buf->offset = NET_HEADROOM;
+    buf->length = udp_length;
 
+    udp_header_t* udp = (udp_header_t*)net_buffer_head(buf);
     udp->src_port = htons(sock->local_port);
     udp->dst_port = htons(sock->remote_port);
-    udp->length = htons(sizeof(udp_header_t) + length);
+    udp->length = htons((uint16_t)udp_length);
     udp->checksum = 0;
+    memcpy(udp + 1, data, length);
 
-    /* Copy data */
-    uint8_t* data_ptr = packet + sizeof(udp_header_t);
-    for (size_t i = 0; i < length && i < (NET_BUF_SIZE - sizeof(udp_header_t)); i++) {
-        data_ptr[i] = ((const uint8_t*)data)[i];
+    if (sock->gso_size && length > sock->gso_size) {
+        buf->gso_size = sock->gso_size;
+        buf->gso_type = NET_GSO_UDPV4;
     }
 
-    /* Get interface */
-    net_interface_t* iface = net_get_interface(0);
-    if (!iface) {
-        return STATUS_ERROR;
-    }
-
-    return ip_send_packet(iface, &sock->remote_ip, IP_PROTO_UDP, packet,
-                          sizeof(udp_header_t) + length);
+    /* Route through the socket's cache; the flow hash keeps ECMP per-flow */
+    uint32_t flow_hash = route_flow_hash(&sock->local_ip, &sock->remote_ip, IP_PROTO_UDP,
+                                         sock->local_port, sock->remote_port);
+    return ip_output_buffer(NULL, &sock->remote_ip, IP_PROTO_UDP, buf, flow_hash, sock);
 }
 
 ssize_t udp_recv(socket_t* sock, void* buffer, size_t length) {
-    /* Would receive from RX queue */
-    return -1;
+    if (!sock || !buffer) {
+        return -1;
+    }
+
+    __sync_lock_test_and_set(&sock->lock, 1);
+    if (sock->rx_queued == 0) {
+        __sync_lock_release(&sock->lock);
+        return -1;
+    }
+    net_buffer_t* buf = list_entry(sock->rx_queue.next, net_buffer_t, list_node);
+    list_del(&buf->list_node);
+    sock->rx_queued--;
+    __sync_lock_release(&sock->lock);
+
+    size_t copy = buf->length < length ? buf->length : length;
+    memcpy(buffer, net_buffer_head(buf), copy);
+    net_buffer_free(buf);
+    return (ssize_t)copy;
 }
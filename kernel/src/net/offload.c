@@ -0,0 +1,696 @@
+/*
+ * Segmentation Offload
+ * Software GSO at the driver boundary and receive-side GRO for TCP
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "net.h"
+
+extern uint64_t perf_cycles(void);
+
+#define PAGES_FOR(bytes)    (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+#define NET_GRO_MAX_FLOWS   8
+#define NET_GRO_BUF_SIZE    (sizeof(eth_header_t) + NET_GSO_MAX_SIZE)
+
+/* ============================================================================
+ * Checksums
+ *
+ * Sums are kept in native byte order like ip_checksum(); a folded result
+ * stored as-is is the correct network-order checksum.
+ * ============================================================================ */
+
+static uint64_t csum_add(const void* data, size_t length, uint64_t sum) {
+    const uint8_t* p = (const uint8_t*)data;
+
+    while (length >= 8) {
+        uint32_t a, b;
+        memcpy(&a, p, 4);
+        memcpy(&b, p + 4, 4);
+        sum += (uint64_t)a + b;
+        p += 8;
+        length -= 8;
+    }
+    while (length >= 2) {
+        uint16_t w;
+        memcpy(&w, p, 2);
+        sum += w;
+        p += 2;
+        length -= 2;
+    }
+    if (length) {
+        sum += *p;
+    }
+    return sum;
+}
+
+static uint16_t csum_fold(uint64_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+/* Pseudo-header sum for an IPv4 transport header of l4_length bytes */
+static uint64_t csum_pseudo(const ipv4_header_t* ip, uint8_t protocol, uint16_t l4_length) {
+    uint64_t sum = csum_add(ip->src.addr, 4, 0);
+    sum = csum_add(ip->dst.addr, 4, sum);
+    sum += htons(protocol);
+    sum += htons(l4_length);
+    return sum;
+}
+
+/* ============================================================================
+ * Transmit: segmentation at the driver boundary
+ * ============================================================================ */
+
+/* Offsets of the IP and transport headers and of the payload in a super-packet */
+static status_t gso_parse(const net_buffer_t* buf, size_t* out_l4, size_t* out_hdr_len) {
+    const uint8_t* head = buf->data + buf->offset;
+    size_t l3 = sizeof(eth_header_t);
+
+    if (buf->length < l3 + sizeof(ipv4_header_t)) {
+        return STATUS_INVALID;
+    }
+
+    const eth_header_t* eth = (const eth_header_t*)head;
+    const ipv4_header_t* ip = (const ipv4_header_t*)(head + l3);
+    if (ntohs(eth->ethertype) != ETHERTYPE_IP) {
+        return STATUS_INVALID;
+    }
+
+    size_t l4 = l3 + (size_t)(ip->version_ihl & 0x0F) * 4;
+    size_t hdr_len;
+
+    if (buf->gso_type == NET_GSO_TCPV4 && ip->protocol == IP_PROTO_TCP) {
+        if (buf->length < l4 + sizeof(tcp_header_t)) {
+            return STATUS_INVALID;
+        }
+        const tcp_header_t* tcp = (const tcp_header_t*)(head + l4);
+        hdr_len = l4 + (size_t)(tcp->data_offset_reserved >> 4) * 4;
+    } else if (buf->gso_type == NET_GSO_UDPV4 && ip->protocol == IP_PROTO_UDP) {
+        hdr_len = l4 + sizeof(udp_header_t);
+    } else {
+        return STATUS_INVALID;
+    }
+
+    if (hdr_len > buf->length || hdr_len + buf->gso_size > NET_BUF_SIZE) {
+        return STATUS_INVALID;
+    }
+
+    *out_l4 = l4;
+    *out_hdr_len = hdr_len;
+    return STATUS_OK;
+}
+
+/* Frames a packet becomes on the wire */
+uint32_t net_gso_segments(const net_buffer_t* buf) {
+    size_t l4, hdr_len;
+    if (!buf->gso_size || FAILED(gso_parse(buf, &l4, &hdr_len))) {
+        return 1;
+    }
+
+    size_t payload = buf->length - hdr_len;
+    return payload ? (uint32_t)((payload + buf->gso_size - 1) / buf->gso_size) : 1;
+}
+
+/* Build segment `index` (payload bytes [off, off + seg)) of a super-packet into frame */
+static size_t gso_build_segment(net_buffer_t* buf, size_t l4, size_t hdr_len, uint32_t index,
+                                size_t off, size_t seg, bool last, uint8_t* frame) {
+    const uint8_t* head = net_buffer_head(buf);
+    size_t l3 = sizeof(eth_header_t);
+
+    memcpy(frame, head, hdr_len);
+    memcpy(frame + hdr_len, head + hdr_len + off, seg);
+
+    ipv4_header_t* ip = (ipv4_header_t*)(frame + l3);
+    ip->total_length = htons((uint16_t)(hdr_len - l3 + seg));
+    ip->identification = htons((uint16_t)(ntohs(ip->identification) + index));
+    ip->checksum = 0;
+    ip->checksum = ip_checksum(ip, l4 - l3);
+
+    uint16_t l4_length = (uint16_t)(hdr_len - l4 + seg);
+
+    if (buf->gso_type == NET_GSO_TCPV4) {
+        tcp_header_t* tcp = (tcp_header_t*)(frame + l4);
+        tcp->seq_num = htonl(ntohl(tcp->seq_num) + (uint32_t)off);
+        if (!last) {
+            tcp->flags &= (uint8_t)~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+        }
+        if (index) {
+            tcp->flags &= (uint8_t)~TCP_FLAG_CWR;
+        }
+        tcp->checksum = 0;
+        tcp->checksum = csum_fold(csum_add(frame + l4, l4_length,
+                                           csum_pseudo(ip, IP_PROTO_TCP, l4_length)));
+    } else {
+        udp_header_t* udp = (udp_header_t*)(frame + l4);
+        udp->length = htons(l4_length);
+        /* A zero checksum means the sender did not use one */
+        if (udp->checksum) {
+            udp->checksum = 0;
+            uint16_t sum = csum_fold(csum_add(frame + l4, l4_length,
+                                              csum_pseudo(ip, IP_PROTO_UDP, l4_length)));
+            udp->checksum = sum ? sum : 0xFFFF;
+        }
+    }
+
+    return hdr_len + seg;
+}
+
+/*
+ * Segment a super-packet in software and send each segment. If the driver
+ * runs out of ring space part way, the progress is kept in gso_sent and the
+ * next call resumes from there.
+ */
+static status_t gso_xmit(net_interface_t* iface, net_buffer_t* buf, uint32_t* out_packets,
+                         uint32_t* out_bytes) {
+    size_t l4, hdr_len;
+    status_t status = gso_parse(buf, &l4, &hdr_len);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    uint8_t frame[NET_BUF_SIZE];
+    size_t payload = buf->length - hdr_len;
+    size_t off = buf->gso_sent;
+
+    while (off < payload) {
+        size_t seg = payload - off < buf->gso_size ? payload - off : buf->gso_size;
+        uint32_t index = (uint32_t)(off / buf->gso_size);
+        size_t frame_len = gso_build_segment(buf, l4, hdr_len, index, off, seg,
+                                             off + seg == payload, frame);
+
+        status = iface->send(iface, frame, frame_len);
+        if (FAILED(status)) {
+            buf->gso_sent = (uint32_t)off;
+            return status;
+        }
+
+        (*out_packets)++;
+        *out_bytes += (uint32_t)frame_len;
+        off += seg;
+    }
+
+    buf->gso_sent = (uint32_t)off;
+    return STATUS_OK;
+}
+
+/*
+ * Hand one packet to the driver. Super-packets go to send_gso when the
+ * driver can take their type and are segmented here otherwise. Reports the
+ * frames and bytes the driver accepted, which on STATUS_BUSY may be part of
+ * a super-packet.
+ */
+status_t net_dev_xmit(net_interface_t* iface, net_buffer_t* buf, uint32_t* out_packets,
+                      uint32_t* out_bytes) {
+    *out_packets = 0;
+    *out_bytes = 0;
+
+    if (!buf->gso_size) {
+        status_t status = iface->send(iface, net_buffer_head(buf), buf->length);
+        if (SUCCESS(status)) {
+            *out_packets = 1;
+            *out_bytes = (uint32_t)buf->length;
+        }
+        return status;
+    }
+
+    bool offload = iface->send_gso && buf->gso_sent == 0 &&
+                   ((iface->features & NET_F_GSO_ANY) ||
+                    (buf->gso_type == NET_GSO_TCPV4 && (iface->features & NET_F_TSO)));
+    if (offload) {
+        status_t status = iface->send_gso(iface, buf);
+        if (SUCCESS(status)) {
+            *out_packets = net_gso_segments(buf);
+            *out_bytes = (uint32_t)buf->length;
+        }
+        return status;
+    }
+
+    return gso_xmit(iface, buf, out_packets, out_bytes);
+}
+
+/* ============================================================================
+ * Receive: GRO
+ *
+ * In-order TCP segments of a flow are merged into one packet until a
+ * segment arrives that cannot be appended (out of order, different ACK or
+ * options, flags other than ACK/PSH), a short or PSH segment ends the
+ * burst, or the driver finishes its poll with net_gro_flush(). The merged
+ * packet is delivered once with gso_size set to the segment size, so the
+ * stack pays its per-packet costs once per burst.
+ * ============================================================================ */
+
+typedef struct net_gro_flow {
+    net_buffer_t* buf;       /* Merged packet, NULL if the slot is free */
+    uint32_t src;
+    uint32_t dst;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t next_seq;
+    uint16_t mss;
+    uint16_t segs;
+    uint64_t age;
+} net_gro_flow_t;
+
+typedef struct net_gro {
+    net_gro_flow_t flows[NET_GRO_MAX_FLOWS];
+    uint64_t clock;
+    uint64_t merged;
+    uint64_t flushed;
+} net_gro_t;
+
+/* Parsed view of a candidate segment */
+typedef struct gro_seg {
+    const ipv4_header_t* ip;
+    const tcp_header_t* tcp;
+    size_t hdr_len;
+    size_t frame_len;        /* Ethernet + IP total length */
+    size_t payload;
+    uint32_t src;
+    uint32_t dst;
+} gro_seg_t;
+
+static bool gro_parse(const uint8_t* data, size_t length, gro_seg_t* seg) {
+    size_t l3 = sizeof(eth_header_t);
+    size_t l4 = l3 + sizeof(ipv4_header_t);
+
+    if (length < l4 + sizeof(tcp_header_t)) {
+        return false;
+    }
+
+    const eth_header_t* eth = (const eth_header_t*)data;
+    const ipv4_header_t* ip = (const ipv4_header_t*)(data + l3);
+    if (ntohs(eth->ethertype) != ETHERTYPE_IP || ip->version_ihl != 0x45 ||
+        ip->protocol != IP_PROTO_TCP) {
+        return false;
+    }
+
+    /* Fragments are never merged */
+    if (ntohs(ip->flags_fragment) & 0x3FFF) {
+        return false;
+    }
+
+    size_t total = ntohs(ip->total_length);
+    if (total < sizeof(ipv4_header_t) + sizeof(tcp_header_t) || l3 + total > length) {
+        return false;
+    }
+
+    const tcp_header_t* tcp = (const tcp_header_t*)(data + l4);
+    size_t hdr_len = l4 + (size_t)(tcp->data_offset_reserved >> 4) * 4;
+    if (hdr_len < l4 + sizeof(tcp_header_t) || hdr_len > l3 + total) {
+        return false;
+    }
+
+    seg->ip = ip;
+    seg->tcp = tcp;
+    seg->hdr_len = hdr_len;
+    seg->frame_len = l3 + total;
+    seg->payload = l3 + total - hdr_len;
+    memcpy(&seg->src, ip->src.addr, 4);
+    memcpy(&seg->dst, ip->dst.addr, 4);
+    return true;
+}
+
+static net_gro_flow_t* gro_find(net_gro_t* gro, const gro_seg_t* seg) {
+    for (uint32_t i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        net_gro_flow_t* f = &gro->flows[i];
+        if (f->buf && f->src == seg->src && f->dst == seg->dst &&
+            f->sport == seg->tcp->src_port && f->dport == seg->tcp->dst_port) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static void gro_flush_flow(net_interface_t* iface, net_gro_t* gro, net_gro_flow_t* f) {
+    net_buffer_t* buf = f->buf;
+    uint8_t* head = net_buffer_head(buf);
+
+    ipv4_header_t* ip = (ipv4_header_t*)(head + sizeof(eth_header_t));
+    ip->total_length = htons((uint16_t)(buf->length - sizeof(eth_header_t)));
+    ip->checksum = 0;
+    ip->checksum = ip_checksum(ip, sizeof(ipv4_header_t));
+
+    f->buf = NULL;
+    gro->flushed++;
+    net_process_frame(iface, head, buf->length, f->segs > 1 ? f->mss : 0);
+    net_buffer_free(buf);
+}
+
+/* Whether seg can be appended to the packet held for f */
+static bool gro_can_merge(const net_gro_flow_t* f, const gro_seg_t* seg) {
+    const uint8_t* held = net_buffer_head(f->buf);
+    const ipv4_header_t* hip = (const ipv4_header_t*)(held + sizeof(eth_header_t));
+    const tcp_header_t* htcp = (const tcp_header_t*)(held + sizeof(eth_header_t) +
+                                                     sizeof(ipv4_header_t));
+    size_t hdr_len = sizeof(eth_header_t) + sizeof(ipv4_header_t) +
+                     (size_t)(htcp->data_offset_reserved >> 4) * 4;
+
+    if (ntohl(seg->tcp->seq_num) != f->next_seq || seg->tcp->ack_num != htcp->ack_num ||
+        seg->hdr_len != hdr_len || seg->payload > f->mss ||
+        seg->ip->dscp_ecn != hip->dscp_ecn || seg->ip->ttl != hip->ttl) {
+        return false;
+    }
+
+    /* Options (timestamps included) must match byte for byte */
+    size_t options = hdr_len - sizeof(eth_header_t) - sizeof(ipv4_header_t) - sizeof(tcp_header_t);
+    if (options && memcmp(seg->tcp + 1, htcp + 1, options) != 0) {
+        return false;
+    }
+
+    return f->buf->length + seg->payload <= NET_GRO_BUF_SIZE;
+}
+
+/* Returns true if the frame was taken by GRO and must not be processed further */
+bool net_gro_receive(net_interface_t* iface, const void* data, size_t length) {
+    if (!(iface->features & NET_F_GRO)) {
+        return false;
+    }
+
+    net_gro_t* gro = iface->gro;
+    if (!gro) {
+        gro = (net_gro_t*)pmm_alloc_pages(PAGES_FOR(sizeof(net_gro_t)));
+        if (!gro) {
+            return false;
+        }
+        memset(gro, 0, sizeof(net_gro_t));
+        iface->gro = gro;
+    }
+
+    gro_seg_t seg;
+    if (!gro_parse((const uint8_t*)data, length, &seg)) {
+        return false;
+    }
+
+    net_gro_flow_t* f = gro_find(gro, &seg);
+    uint8_t flags = seg.tcp->flags;
+    bool mergeable = seg.payload > 0 && (flags & TCP_FLAG_ACK) &&
+                     !(flags & (uint8_t)~(TCP_FLAG_ACK | TCP_FLAG_PSH));
+
+    if (f && mergeable && gro_can_merge(f, &seg)) {
+        net_buffer_t* buf = f->buf;
+        memcpy(net_buffer_head(buf) + buf->length, (const uint8_t*)data + seg.hdr_len, seg.payload);
+        buf->length += seg.payload;
+        f->next_seq += (uint32_t)seg.payload;
+        f->segs++;
+        gro->merged++;
+
+        /* Latest window; PSH ends the burst */
+        tcp_header_t* tcp = (tcp_header_t*)(net_buffer_head(buf) + sizeof(eth_header_t) +
+                                            sizeof(ipv4_header_t));
+        tcp->window = seg.tcp->window;
+        tcp->flags |= flags & TCP_FLAG_PSH;
+
+        if ((flags & TCP_FLAG_PSH) || seg.payload < f->mss ||
+            buf->length + f->mss > NET_GRO_BUF_SIZE) {
+            gro_flush_flow(iface, gro, f);
+        }
+        return true;
+    }
+
+    /* Anything held for this flow goes up first to keep the stream in order */
+    if (f) {
+        gro_flush_flow(iface, gro, f);
+    }
+    if (!mergeable || (flags & TCP_FLAG_PSH)) {
+        return false;
+    }
+
+    /* Start a new burst, evicting the oldest one if every slot is taken */
+    net_gro_flow_t* slot = NULL;
+    for (uint32_t i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        net_gro_flow_t* c = &gro->flows[i];
+        if (!c->buf) {
+            slot = c;
+            break;
+        }
+        if (!slot || c->age < slot->age) {
+            slot = c;
+        }
+    }
+    if (slot->buf) {
+        gro_flush_flow(iface, gro, slot);
+    }
+
+    net_buffer_t* buf = net_buffer_alloc(NET_GRO_BUF_SIZE);
+    if (!buf) {
+        return false;
+    }
+    memcpy(buf->data, data, seg.frame_len);
+    buf->length = seg.frame_len;
+
+    slot->buf = buf;
+    slot->src = seg.src;
+    slot->dst = seg.dst;
+    slot->sport = seg.tcp->src_port;
+    slot->dport = seg.tcp->dst_port;
+    slot->next_seq = ntohl(seg.tcp->seq_num) + (uint32_t)seg.payload;
+    slot->mss = (uint16_t)seg.payload;
+    slot->segs = 1;
+    slot->age = gro->clock++;
+    return true;
+}
+
+/* Deliver every held burst; drivers call this at the end of each RX poll */
+void net_gro_flush(net_interface_t* iface) {
+    net_gro_t* gro = iface ? iface->gro : NULL;
+    if (!gro) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < NET_GRO_MAX_FLOWS; i++) {
+        if (gro->flows[i].buf) {
+            gro_flush_flow(iface, gro, &gro->flows[i]);
+        }
+    }
+}
+
+/* ============================================================================
+ * Benchmark
+ *
+ * Loopback runs real sockets over "lo". The TCP cases use a private null
+ * device: transmit copies each frame (or the whole super-packet, for TSO)
+ * into a staging buffer the way a driver copies into its ring, and receive
+ * feeds MSS-sized segments in polls of NET_BENCH_POLL frames.
+ * ============================================================================ */
+
+#define NET_BENCH_MSS        1448
+#define NET_BENCH_DGRAM      1472
+#define NET_BENCH_WRITE      (44 * NET_BENCH_DGRAM)
+#define NET_BENCH_SUPER      (45 * NET_BENCH_MSS)
+#define NET_BENCH_POLL       64
+#define NET_BENCH_PORT_TX    40000
+#define NET_BENCH_PORT_RX    40001
+
+static uint8_t* bench_stage;
+
+static status_t bench_send(net_interface_t* iface, const void* data, size_t length) {
+    (void)iface;
+    memcpy(bench_stage, data, length);
+    return STATUS_OK;
+}
+
+static status_t bench_send_gso(net_interface_t* iface, net_buffer_t* buf) {
+    (void)iface;
+    memcpy(bench_stage, net_buffer_head(buf), buf->length);
+    return STATUS_OK;
+}
+
+static uint64_t bench_cpb(uint64_t cycles, uint64_t bytes) {
+    return bytes ? cycles * 1000 / bytes : 0;
+}
+
+/* Ethernet + IPv4 + TCP headers for the benchmark flow */
+static size_t bench_tcp_headers(uint8_t* frame, size_t payload, uint32_t seq) {
+    size_t hdr_len = sizeof(eth_header_t) + sizeof(ipv4_header_t) + sizeof(tcp_header_t);
+    memset(frame, 0, hdr_len);
+
+    eth_header_t* eth = (eth_header_t*)frame;
+    eth->ethertype = htons(ETHERTYPE_IP);
+
+    ipv4_header_t* ip = (ipv4_header_t*)(frame + sizeof(eth_header_t));
+    ip->version_ihl = 0x45;
+    ip->total_length = htons((uint16_t)(hdr_len - sizeof(eth_header_t) + payload));
+    ip->ttl = 64;
+    ip->protocol = IP_PROTO_TCP;
+    ip->src = (ipv4_addr_t){{10, 0, 0, 2}};
+    ip->dst = (ipv4_addr_t){{10, 0, 0, 1}};
+    ip->checksum = ip_checksum(ip, sizeof(ipv4_header_t));
+
+    tcp_header_t* tcp = (tcp_header_t*)(ip + 1);
+    tcp->src_port = htons(NET_BENCH_PORT_TX);
+    tcp->dst_port = htons(NET_BENCH_PORT_RX);
+    tcp->seq_num = htonl(seq);
+    tcp->ack_num = htonl(1);
+    tcp->data_offset_reserved = (sizeof(tcp_header_t) / 4) << 4;
+    tcp->flags = TCP_FLAG_ACK;
+    tcp->window = htons(0xFFFF);
+    return hdr_len;
+}
+
+/* UDP over lo: returns cycles, counts payload bytes received into *received */
+static uint64_t bench_loopback(socket_t* tx, socket_t* rx, const uint8_t* payload,
+                               uint32_t rounds, bool gso, uint64_t* received) {
+    uint8_t dgram[NET_BENCH_DGRAM];
+    net_socket_set_gso_size(tx, gso ? NET_BENCH_DGRAM : 0);
+
+    uint64_t start = perf_cycles();
+    for (uint32_t r = 0; r < rounds; r++) {
+        if (gso) {
+            udp_send(tx, payload, NET_BENCH_WRITE);
+        } else {
+            for (size_t off = 0; off < NET_BENCH_WRITE; off += NET_BENCH_DGRAM) {
+                udp_send(tx, payload + off, NET_BENCH_DGRAM);
+            }
+        }
+
+        ssize_t n;
+        while ((n = udp_recv(rx, dgram, sizeof(dgram))) > 0) {
+            *received += (uint64_t)n;
+        }
+    }
+    return perf_cycles() - start;
+}
+
+/* TCP transmit through net_dev_xmit(); returns cycles */
+static uint64_t bench_transmit(net_interface_t* dev, net_buffer_t* buf, uint32_t rounds,
+                               uint64_t* segments) {
+    uint64_t start = perf_cycles();
+    for (uint32_t r = 0; r < rounds; r++) {
+        uint32_t packets, bytes;
+        buf->gso_sent = 0;
+        net_dev_xmit(dev, buf, &packets, &bytes);
+        *segments += packets;
+    }
+    return perf_cycles() - start;
+}
+
+/* TCP receive of `segments` MSS-sized frames; returns cycles */
+static uint64_t bench_receive(net_interface_t* dev, uint8_t* frame, uint32_t segments) {
+    size_t hdr_len = bench_tcp_headers(frame, NET_BENCH_MSS, 0);
+    ipv4_header_t* ip = (ipv4_header_t*)(frame + sizeof(eth_header_t));
+    tcp_header_t* tcp = (tcp_header_t*)(ip + 1);
+    uint32_t seq = 1;
+
+    uint64_t start = perf_cycles();
+    for (uint32_t i = 0; i < segments; i++) {
+        tcp->seq_num = htonl(seq);
+        seq += NET_BENCH_MSS;
+        net_receive_packet(dev, frame, hdr_len + NET_BENCH_MSS);
+        if ((i + 1) % NET_BENCH_POLL == 0) {
+            net_gro_flush(dev);
+        }
+    }
+    net_gro_flush(dev);
+    return perf_cycles() - start;
+}
+
+status_t net_offload_benchmark(uint32_t megabytes, net_offload_bench_result_t* result) {
+    if (!result || megabytes == 0) {
+        return STATUS_INVALID;
+    }
+
+    uint64_t total = (uint64_t)megabytes << 20;
+    size_t stage_pages = PAGES_FOR(NET_GRO_BUF_SIZE);
+    bench_stage = (uint8_t*)pmm_alloc_pages(stage_pages);
+    net_buffer_t* super = net_buffer_alloc(NET_GRO_BUF_SIZE);
+    socket_t* tx = NULL;
+    socket_t* rx = NULL;
+    status_t status = STATUS_NOMEM;
+
+    memset(result, 0, sizeof(*result));
+    if (!bench_stage || !super) {
+        goto out;
+    }
+
+    /* Payload pattern for the loopback writes */
+    uint8_t* payload = net_buffer_head(super);
+    for (size_t i = 0; i < NET_BENCH_WRITE; i++) {
+        payload[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    /* UDP over loopback */
+    ipv4_addr_t lo = {{127, 0, 0, 1}};
+    if (FAILED(status = net_socket_create(SOCKET_TYPE_UDP, IP_PROTO_UDP, &tx)) ||
+        FAILED(status = net_socket_create(SOCKET_TYPE_UDP, IP_PROTO_UDP, &rx)) ||
+        FAILED(status = net_socket_bind(tx, &lo, NET_BENCH_PORT_TX)) ||
+        FAILED(status = net_socket_bind(rx, &lo, NET_BENCH_PORT_RX)) ||
+        FAILED(status = net_socket_connect(tx, &lo, NET_BENCH_PORT_RX))) {
+        goto out;
+    }
+
+    uint32_t rounds = (uint32_t)((total + NET_BENCH_WRITE - 1) / NET_BENCH_WRITE);
+    uint64_t bytes = (uint64_t)rounds * NET_BENCH_WRITE;
+    uint64_t received = 0;
+    result->bytes = bytes;
+    result->lo_udp_cpb = bench_cpb(bench_loopback(tx, rx, payload, rounds, false, &received),
+                                   bytes);
+    result->mismatches += received != bytes;
+    received = 0;
+    result->lo_gso_cpb = bench_cpb(bench_loopback(tx, rx, payload, rounds, true, &received),
+                                   bytes);
+    result->mismatches += received != bytes;
+
+    /* TCP transmit: software GSO against TSO on the null device */
+    net_interface_t dev = {0};
+    dev.up = true;
+    dev.send = bench_send;
+    dev.send_gso = bench_send_gso;
+
+    size_t hdr_len = bench_tcp_headers(super->data, NET_BENCH_SUPER, 1);
+    super->offset = 0;
+    super->length = hdr_len + NET_BENCH_SUPER;
+    super->gso_size = NET_BENCH_MSS;
+    super->gso_type = NET_GSO_TCPV4;
+
+    uint64_t segments = 0;
+    rounds = (uint32_t)((total + NET_BENCH_SUPER - 1) / NET_BENCH_SUPER);
+    bytes = (uint64_t)rounds * NET_BENCH_SUPER;
+    result->sw_gso_cpb = bench_cpb(bench_transmit(&dev, super, rounds, &segments), bytes);
+    result->mismatches += segments != (uint64_t)rounds * 45;
+
+    dev.features = NET_F_TSO;
+    segments = 0;
+    result->tso_cpb = bench_cpb(bench_transmit(&dev, super, rounds, &segments), bytes);
+    result->mismatches += segments != (uint64_t)rounds * 45;
+
+    /* TCP receive with and without GRO; the stack must count every segment */
+    uint32_t rx_segments = (uint32_t)(total / NET_BENCH_MSS);
+    bytes = (uint64_t)rx_segments * NET_BENCH_MSS;
+    net_stats_t before, after;
+
+    dev.features = 0;
+    net_get_stats(&before);
+    result->rx_cpb = bench_cpb(bench_receive(&dev, super->data, rx_segments), bytes);
+    net_get_stats(&after);
+    result->mismatches += after.tcp_packets - before.tcp_packets != rx_segments;
+
+    dev.features = NET_F_GRO;
+    net_get_stats(&before);
+    result->gro_cpb = bench_cpb(bench_receive(&dev, super->data, rx_segments), bytes);
+    net_get_stats(&after);
+    result->mismatches += after.tcp_packets - before.tcp_packets != rx_segments;
+
+    if (dev.gro) {
+        result->gro_merged = dev.gro->merged;
+        pmm_free_pages((paddr_t)dev.gro, PAGES_FOR(sizeof(net_gro_t)));
+    }
+    status = STATUS_OK;
+
+out:
+    if (tx) {
+        net_socket_close(tx);
+    }
+    if (rx) {
+        net_socket_close(rx);
+    }
+    net_buffer_free(super);
+    if (bench_stage) {
+        pmm_free_pages((paddr_t)bench_stage, stage_pages);
+        bench_stage = NULL;
+    }
+    return status;
+}
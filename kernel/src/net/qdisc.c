@@ -0,0 +1,1605 @@
+/*
+ * Traffic Control
+ * Egress queueing disciplines (pfifo_fast, fq_codel, fq) and byte queue limits
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "net.h"
+#include "qdisc.h"
+#include "ai_hooks.h"
+
+extern uint64_t perf_timestamp_ns(void);
+
+#define PAGES_FOR(bytes)    (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
+#define NSEC_PER_SEC        1000000000ULL
+#define NSEC_PER_MSEC       1000000ULL
+
+#define QDISC_MAX_KINDS     8
+#define QDISC_FRAME_MAX     1514   /* Largest Ethernet frame without FCS */
+
+static void qdisc_list_append(struct list_head* node, struct list_head* head) {
+    list_add(node, head->prev);
+}
+
+static net_buffer_t* qdisc_list_pop(struct list_head* head) {
+    if (list_empty(head)) {
+        return NULL;
+    }
+    net_buffer_t* buf = list_entry(head->next, net_buffer_t, list_node);
+    list_del(&buf->list_node);
+    return buf;
+}
+
+static void qdisc_buf_free(net_buffer_t* buf) {
+    net_buffer_free(buf);
+}
+
+/* Account a packet entering or leaving the queue proper */
+static void qdisc_account_add(qdisc_t* q, const net_buffer_t* buf) {
+    q->qlen++;
+    q->backlog += buf->length;
+}
+
+static void qdisc_account_remove(qdisc_t* q, const net_buffer_t* buf) {
+    q->qlen--;
+    q->backlog -= buf->length;
+}
+
+/* ============================================================================
+ * pfifo_fast: three strict-priority bands
+ * ============================================================================ */
+
+#define PFIFO_BANDS   3
+#define PFIFO_LIMIT   1000
+
+/* Same band layout as the classic TOS priority map: 0 is served first */
+static const uint8_t pfifo_prio2band[NET_PRIO_MAX + 1] = { 1, 2, 2, 2, 1, 2, 0, 0 };
+
+typedef struct pfifo_priv {
+    struct list_head band[PFIFO_BANDS];
+} pfifo_priv_t;
+
+static status_t pfifo_init(qdisc_t* q) {
+    pfifo_priv_t* p = (pfifo_priv_t*)qdisc_priv(q);
+    for (int i = 0; i < PFIFO_BANDS; i++) {
+        list_init(&p->band[i]);
+    }
+    q->limit = PFIFO_LIMIT;
+    return STATUS_OK;
+}
+
+static status_t pfifo_enqueue(qdisc_t* q, net_buffer_t* buf, uint64_t now) {
+    (void)now;
+    pfifo_priv_t* p = (pfifo_priv_t*)qdisc_priv(q);
+
+    if (q->qlen >= q->limit) {
+        q->stats.dropped++;
+        qdisc_buf_free(buf);
+        return STATUS_BUSY;
+    }
+
+    qdisc_list_append(&buf->list_node, &p->band[pfifo_prio2band[buf->priority]]);
+    qdisc_account_add(q, buf);
+    return STATUS_OK;
+}
+
+static net_buffer_t* pfifo_dequeue(qdisc_t* q, uint64_t now) {
+    (void)now;
+    pfifo_priv_t* p = (pfifo_priv_t*)qdisc_priv(q);
+
+    for (int i = 0; i < PFIFO_BANDS; i++) {
+        net_buffer_t* buf = qdisc_list_pop(&p->band[i]);
+        if (buf) {
+            qdisc_account_remove(q, buf);
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+static void pfifo_reset(qdisc_t* q) {
+    net_buffer_t* buf;
+    while ((buf = pfifo_dequeue(q, 0)) != NULL) {
+        qdisc_buf_free(buf);
+    }
+}
+
+static const qdisc_ops_t pfifo_fast_ops = {
+    .name = "pfifo_fast",
+    .flags = QDISC_F_CAN_BYPASS,
+    .priv_size = sizeof(pfifo_priv_t),
+    .init = pfifo_init,
+    .enqueue = pfifo_enqueue,
+    .dequeue = pfifo_dequeue,
+    .reset = pfifo_reset,
+};
+
+/* ============================================================================
+ * fq_codel: per-flow DRR with CoDel AQM (RFC 8289, RFC 8290)
+ * ============================================================================ */
+
+#define FQ_CODEL_FLOWS        1024
+#define FQ_CODEL_LIMIT        1024
+#define FQ_CODEL_QUANTUM      QDISC_FRAME_MAX
+#define FQ_CODEL_DROP_BATCH   64
+#define CODEL_TARGET_NS       (5ULL * NSEC_PER_MSEC)
+#define CODEL_INTERVAL_NS     (100ULL * NSEC_PER_MSEC)
+
+typedef struct codel_vars {
+    uint64_t first_above_ns;   /* When sojourn time will have been above target for an interval */
+    uint64_t drop_next_ns;
+    uint32_t count;
+    uint32_t lastcount;
+    bool dropping;
+} codel_vars_t;
+
+typedef struct fq_codel_flow {
+    struct list_head packets;
+    struct list_head node;     /* On new_flows or old_flows while active */
+    int32_t deficit;
+    uint32_t qlen;
+    uint32_t backlog;
+    bool active;
+    codel_vars_t cvars;
+} fq_codel_flow_t;
+
+typedef struct fq_codel_priv {
+    struct list_head new_flows;
+    struct list_head old_flows;
+    fq_codel_flow_t flows[FQ_CODEL_FLOWS];
+} fq_codel_priv_t;
+
+static uint64_t codel_isqrt(uint64_t x) {
+    uint64_t r = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return r;
+}
+
+/* Next drop time: t + interval / sqrt(count) */
+static uint64_t codel_control_law(uint64_t t, uint32_t count) {
+    return t + CODEL_INTERVAL_NS * 1024 / codel_isqrt((uint64_t)count << 20);
+}
+
+/* Set CE on an ECN-capable IPv4 packet instead of dropping it */
+static bool qdisc_ecn_mark(net_buffer_t* buf) {
+    if (buf->length < sizeof(eth_header_t) + sizeof(ipv4_header_t)) {
+        return false;
+    }
+
+    eth_header_t* eth = (eth_header_t*)net_buffer_head(buf);
+    if (ntohs(eth->ethertype) != ETHERTYPE_IP) {
+        return false;
+    }
+
+    ipv4_header_t* ip = (ipv4_header_t*)(net_buffer_head(buf) + sizeof(eth_header_t));
+    uint8_t ecn = ip->dscp_ecn & 0x03;
+    if (ecn == 0) {
+        return false;
+    }
+
+    if (ecn != 0x03) {
+        ip->dscp_ecn |= 0x03;
+        ip->checksum = 0;
+        ip->checksum = ip_checksum(ip, (size_t)(ip->version_ihl & 0x0F) * 4);
+    }
+    return true;
+}
+
+static net_buffer_t* fq_codel_pop(qdisc_t* q, fq_codel_flow_t* f) {
+    net_buffer_t* buf = qdisc_list_pop(&f->packets);
+    if (buf) {
+        f->qlen--;
+        f->backlog -= buf->length;
+        qdisc_account_remove(q, buf);
+    }
+    return buf;
+}
+
+static bool codel_should_drop(codel_vars_t* v, const fq_codel_flow_t* f,
+                              const net_buffer_t* buf, uint64_t now) {
+    uint64_t sojourn = now - buf->enqueue_ns;
+
+    /* Never drop the last full-sized packet of a flow */
+    if (sojourn < CODEL_TARGET_NS || f->backlog <= QDISC_FRAME_MAX) {
+        v->first_above_ns = 0;
+        return false;
+    }
+
+    if (v->first_above_ns == 0) {
+        v->first_above_ns = now + CODEL_INTERVAL_NS;
+        return false;
+    }
+    return now >= v->first_above_ns;
+}
+
+/* Signal congestion with buf: true if it was marked and should still be sent */
+static bool codel_congested(qdisc_t* q, net_buffer_t* buf) {
+    if (qdisc_ecn_mark(buf)) {
+        q->stats.ecn_marked++;
+        return true;
+    }
+    q->stats.codel_dropped++;
+    qdisc_buf_free(buf);
+    return false;
+}
+
+static net_buffer_t* codel_dequeue(qdisc_t* q, fq_codel_flow_t* f, uint64_t now) {
+    codel_vars_t* v = &f->cvars;
+
+    net_buffer_t* buf = fq_codel_pop(q, f);
+    if (!buf) {
+        v->dropping = false;
+        return NULL;
+    }
+
+    bool drop = codel_should_drop(v, f, buf, now);
+
+    if (v->dropping) {
+        if (!drop) {
+            v->dropping = false;
+            return buf;
+        }
+
+        while (v->dropping && now >= v->drop_next_ns) {
+            v->count++;
+            if (codel_congested(q, buf)) {
+                v->drop_next_ns = codel_control_law(v->drop_next_ns, v->count);
+                return buf;
+            }
+
+            buf = fq_codel_pop(q, f);
+            if (!buf || !codel_should_drop(v, f, buf, now)) {
+                v->dropping = false;
+            } else {
+                v->drop_next_ns = codel_control_law(v->drop_next_ns, v->count);
+            }
+        }
+        return buf;
+    }
+
+    if (drop) {
+        if (!codel_congested(q, buf)) {
+            buf = fq_codel_pop(q, f);
+            if (buf) {
+                codel_should_drop(v, f, buf, now);
+            }
+        }
+
+        /* Resume near the previous drop rate if the last episode ended recently */
+        v->dropping = true;
+        uint32_t delta = v->count - v->lastcount;
+        if (delta > 1 && (int64_t)(now - v->drop_next_ns) < (int64_t)(16 * CODEL_INTERVAL_NS)) {
+            v->count = delta;
+        } else {
+            v->count = 1;
+        }
+        v->lastcount = v->count;
+        v->drop_next_ns = codel_control_law(now, v->count);
+    }
+    return buf;
+}
+
+static status_t fq_codel_init(qdisc_t* q) {
+    fq_codel_priv_t* p = (fq_codel_priv_t*)qdisc_priv(q);
+
+    list_init(&p->new_flows);
+    list_init(&p->old_flows);
+    for (uint32_t i = 0; i < FQ_CODEL_FLOWS; i++) {
+        list_init(&p->flows[i].packets);
+    }
+    q->limit = FQ_CODEL_LIMIT;
+    return STATUS_OK;
+}
+
+/* Over the limit: drop from the head of the flow with the largest backlog */
+static void fq_codel_drop_fattest(qdisc_t* q) {
+    fq_codel_priv_t* p = (fq_codel_priv_t*)qdisc_priv(q);
+    fq_codel_flow_t* fat = &p->flows[0];
+
+    for (uint32_t i = 1; i < FQ_CODEL_FLOWS; i++) {
+        if (p->flows[i].backlog > fat->backlog) {
+            fat = &p->flows[i];
+        }
+    }
+
+    /* Drop a batch so the scan is paid once per many packets */
+    uint32_t threshold = fat->backlog / 2;
+    for (uint32_t i = 0; i < FQ_CODEL_DROP_BATCH && fat->backlog > threshold; i++) {
+        net_buffer_t* buf = fq_codel_pop(q, fat);
+        if (!buf) {
+            break;
+        }
+        q->stats.dropped++;
+        qdisc_buf_free(buf);
+    }
+}
+
+static status_t fq_codel_enqueue(qdisc_t* q, net_buffer_t* buf, uint64_t now) {
+    (void)now;
+    fq_codel_priv_t* p = (fq_codel_priv_t*)qdisc_priv(q);
+    fq_codel_flow_t* f = &p->flows[buf->flow_hash % FQ_CODEL_FLOWS];
+
+    qdisc_list_append(&buf->list_node, &f->packets);
+    f->qlen++;
+    f->backlog += buf->length;
+    qdisc_account_add(q, buf);
+
+    if (!f->active) {
+        f->active = true;
+        f->deficit = FQ_CODEL_QUANTUM;
+        qdisc_list_append(&f->node, &p->new_flows);
+    }
+
+    if (q->qlen > q->limit) {
+        fq_codel_drop_fattest(q);
+    }
+    return STATUS_OK;
+}
+
+static net_buffer_t* fq_codel_dequeue(qdisc_t* q, uint64_t now) {
+    fq_codel_priv_t* p = (fq_codel_priv_t*)qdisc_priv(q);
+
+    for (;;) {
+        struct list_head* head = &p->new_flows;
+        if (list_empty(head)) {
+            head = &p->old_flows;
+            if (list_empty(head)) {
+                return NULL;
+            }
+        }
+
+        fq_codel_flow_t* f = list_entry(head->next, fq_codel_flow_t, node);
+
+        if (f->deficit <= 0) {
+            f->deficit += FQ_CODEL_QUANTUM;
+            list_del(&f->node);
+            qdisc_list_append(&f->node, &p->old_flows);
+            continue;
+        }
+
+        net_buffer_t* buf = codel_dequeue(q, f, now);
+        if (!buf) {
+            /* A drained new flow waits one round on old_flows so it cannot
+             * claim new-flow priority again by sending in short bursts */
+            list_del(&f->node);
+            if (head == &p->new_flows && !list_empty(&p->old_flows)) {
+                qdisc_list_append(&f->node, &p->old_flows);
+            } else {
+                f->active = false;
+            }
+            continue;
+        }
+
+        f->deficit -= (int32_t)buf->length;
+        return buf;
+    }
+}
+
+static void fq_codel_reset(qdisc_t* q) {
+    fq_codel_priv_t* p = (fq_codel_priv_t*)qdisc_priv(q);
+
+    for (uint32_t i = 0; i < FQ_CODEL_FLOWS; i++) {
+        fq_codel_flow_t* f = &p->flows[i];
+        net_buffer_t* buf;
+        while ((buf = fq_codel_pop(q, f)) != NULL) {
+            qdisc_buf_free(buf);
+        }
+        f->active = false;
+        f->cvars = (codel_vars_t){0};
+    }
+    list_init(&p->new_flows);
+    list_init(&p->old_flows);
+}
+
+static const qdisc_ops_t fq_codel_ops = {
+    .name = "fq_codel",
+    .flags = QDISC_F_CAN_BYPASS,
+    .priv_size = sizeof(fq_codel_priv_t),
+    .init = fq_codel_init,
+    .enqueue = fq_codel_enqueue,
+    .dequeue = fq_codel_dequeue,
+    .reset = fq_codel_reset,
+};
+
+/* ============================================================================
+ * fq: per-flow round robin with pacing
+ * ============================================================================ */
+
+#define FQ_FLOWS            1024
+#define FQ_LIMIT            1024
+#define FQ_FLOW_LIMIT       100
+#define FQ_QUANTUM          (2 * QDISC_FRAME_MAX)
+
+#define FQ_FLOW_IDLE        0
+#define FQ_FLOW_ACTIVE      1    /* On new_flows or old_flows */
+#define FQ_FLOW_THROTTLED   2    /* On throttled, waiting for time_next_ns */
+
+typedef struct fq_flow {
+    struct list_head packets;
+    struct list_head node;
+    int32_t credit;
+    uint32_t qlen;
+    uint64_t time_next_ns;
+    uint8_t state;
+} fq_flow_t;
+
+typedef struct fq_priv {
+    struct list_head new_flows;
+    struct list_head old_flows;
+    struct list_head throttled;   /* Sorted by time_next_ns */
+    uint32_t maxrate;             /* Cap on every flow's rate, 0 = none */
+    fq_flow_t flows[FQ_FLOWS];
+} fq_priv_t;
+
+static status_t fq_init(qdisc_t* q) {
+    fq_priv_t* p = (fq_priv_t*)qdisc_priv(q);
+
+    list_init(&p->new_flows);
+    list_init(&p->old_flows);
+    list_init(&p->throttled);
+    for (uint32_t i = 0; i < FQ_FLOWS; i++) {
+        list_init(&p->flows[i].packets);
+    }
+    q->limit = FQ_LIMIT;
+    return STATUS_OK;
+}
+
+static status_t fq_enqueue(qdisc_t* q, net_buffer_t* buf, uint64_t now) {
+    (void)now;
+    fq_priv_t* p = (fq_priv_t*)qdisc_priv(q);
+    fq_flow_t* f = &p->flows[buf->flow_hash % FQ_FLOWS];
+
+    if (q->qlen >= q->limit || f->qlen >= FQ_FLOW_LIMIT) {
+        q->stats.dropped++;
+        qdisc_buf_free(buf);
+        return STATUS_BUSY;
+    }
+
+    qdisc_list_append(&buf->list_node, &f->packets);
+    f->qlen++;
+    qdisc_account_add(q, buf);
+
+    if (f->state == FQ_FLOW_IDLE) {
+        f->state = FQ_FLOW_ACTIVE;
+        if (f->credit < FQ_QUANTUM) {
+            f->credit = FQ_QUANTUM;
+        }
+        qdisc_list_append(&f->node, &p->new_flows);
+    }
+    return STATUS_OK;
+}
+
+static void fq_throttle(fq_priv_t* p, fq_flow_t* f) {
+    struct list_head* pos = p->throttled.prev;
+    while (pos != &p->throttled &&
+           list_entry(pos, fq_flow_t, node)->time_next_ns > f->time_next_ns) {
+        pos = pos->prev;
+    }
+    list_add(&f->node, pos);
+    f->state = FQ_FLOW_THROTTLED;
+}
+
+static void fq_unthrottle(fq_priv_t* p, uint64_t now) {
+    while (!list_empty(&p->throttled)) {
+        fq_flow_t* f = list_entry(p->throttled.next, fq_flow_t, node);
+        if (f->time_next_ns > now) {
+            break;
+        }
+        list_del(&f->node);
+        f->state = FQ_FLOW_ACTIVE;
+        qdisc_list_append(&f->node, &p->old_flows);
+    }
+}
+
+static net_buffer_t* fq_dequeue(qdisc_t* q, uint64_t now) {
+    fq_priv_t* p = (fq_priv_t*)qdisc_priv(q);
+
+    fq_unthrottle(p, now);
+    q->watchdog_ns = 0;
+
+    for (;;) {
+        struct list_head* head = &p->new_flows;
+        if (list_empty(head)) {
+            head = &p->old_flows;
+            if (list_empty(head)) {
+                if (!list_empty(&p->throttled)) {
+                    q->watchdog_ns = list_entry(p->throttled.next, fq_flow_t, node)->time_next_ns;
+                }
+                return NULL;
+            }
+        }
+
+        fq_flow_t* f = list_entry(head->next, fq_flow_t, node);
+
+        if (f->credit <= 0) {
+            f->credit += FQ_QUANTUM;
+            list_del(&f->node);
+            qdisc_list_append(&f->node, &p->old_flows);
+            continue;
+        }
+
+        if (f->qlen == 0) {
+            list_del(&f->node);
+            if (head == &p->new_flows && !list_empty(&p->old_flows)) {
+                qdisc_list_append(&f->node, &p->old_flows);
+            } else {
+                f->state = FQ_FLOW_IDLE;
+            }
+            continue;
+        }
+
+        if (f->time_next_ns > now) {
+            list_del(&f->node);
+            fq_throttle(p, f);
+            q->stats.throttled++;
+            continue;
+        }
+
+        net_buffer_t* buf = qdisc_list_pop(&f->packets);
+        f->qlen--;
+        qdisc_account_remove(q, buf);
+        f->credit -= (int32_t)buf->length;
+
+        uint32_t rate = buf->pacing_rate;
+        if (p->maxrate && (!rate || rate > p->maxrate)) {
+            rate = p->maxrate;
+        }
+        if (rate) {
+            f->time_next_ns = now + (uint64_t)buf->length * NSEC_PER_SEC / rate;
+        }
+        return buf;
+    }
+}
+
+static void fq_reset(qdisc_t* q) {
+    fq_priv_t* p = (fq_priv_t*)qdisc_priv(q);
+
+    for (uint32_t i = 0; i < FQ_FLOWS; i++) {
+        fq_flow_t* f = &p->flows[i];
+        net_buffer_t* buf;
+        while ((buf = qdisc_list_pop(&f->packets)) != NULL) {
+            qdisc_account_remove(q, buf);
+            qdisc_buf_free(buf);
+        }
+        f->qlen = 0;
+        f->state = FQ_FLOW_IDLE;
+    }
+    list_init(&p->new_flows);
+    list_init(&p->old_flows);
+    list_init(&p->throttled);
+    q->watchdog_ns = 0;
+}
+
+static const qdisc_ops_t fq_ops = {
+    .name = "fq",
+    .flags = 0,
+    .priv_size = sizeof(fq_priv_t),
+    .init = fq_init,
+    .enqueue = fq_enqueue,
+    .dequeue = fq_dequeue,
+    .reset = fq_reset,
+};
+
+/* ============================================================================
+ * Registry
+ * ============================================================================ */
+
+static const qdisc_ops_t* qdisc_kinds[QDISC_MAX_KINDS] = {
+    &pfifo_fast_ops,
+    &fq_codel_ops,
+    &fq_ops,
+};
+static uint32_t qdisc_kind_count = 3;
+static uint32_t qdisc_kinds_lock = 0;
+
+static bool qdisc_name_equals(const char* a, const char* b) {
+    for (uint32_t i = 0; i < QDISC_NAME_MAX; i++) {
+        if (a[i] != b[i]) {
+            return false;
+        }
+        if (!a[i]) {
+            return true;
+        }
+    }
+    return true;
+}
+
+static const qdisc_ops_t* qdisc_find(const char* kind) {
+    const qdisc_ops_t* found = NULL;
+
+    __sync_lock_test_and_set(&qdisc_kinds_lock, 1);
+    for (uint32_t i = 0; i < qdisc_kind_count; i++) {
+        if (qdisc_name_equals(qdisc_kinds[i]->name, kind)) {
+            found = qdisc_kinds[i];
+            break;
+        }
+    }
+    __sync_lock_release(&qdisc_kinds_lock);
+    return found;
+}
+
+/* Register an additional qdisc kind; ops must stay valid forever */
+status_t qdisc_register(const qdisc_ops_t* ops) {
+    if (!ops || !ops->name[0] || !ops->init || !ops->enqueue || !ops->dequeue || !ops->reset) {
+        return STATUS_INVALID;
+    }
+
+    if (qdisc_find(ops->name)) {
+        return STATUS_EXISTS;
+    }
+
+    __sync_lock_test_and_set(&qdisc_kinds_lock, 1);
+    if (qdisc_kind_count >= QDISC_MAX_KINDS) {
+        __sync_lock_release(&qdisc_kinds_lock);
+        return STATUS_NOMEM;
+    }
+    qdisc_kinds[qdisc_kind_count++] = ops;
+    __sync_lock_release(&qdisc_kinds_lock);
+
+    KLOG_INFO("QDISC", "Registered qdisc %s", ops->name);
+    return STATUS_OK;
+}
+
+status_t qdisc_create(net_interface_t* iface, const char* kind, qdisc_t** out_qdisc) {
+    if (!iface || !kind || !out_qdisc) {
+        return STATUS_INVALID;
+    }
+
+    const qdisc_ops_t* ops = qdisc_find(kind);
+    if (!ops) {
+        return STATUS_NOTFOUND;
+    }
+
+    size_t pages = PAGES_FOR(sizeof(qdisc_t) + ops->priv_size);
+    qdisc_t* q = (qdisc_t*)pmm_alloc_pages(pages);
+    if (!q) {
+        return STATUS_NOMEM;
+    }
+    memset(q, 0, pages * PAGE_SIZE);
+
+    q->ops = ops;
+    q->iface = iface;
+    q->pages = pages;
+
+    status_t status = ops->init(q);
+    if (FAILED(status)) {
+        pmm_free_pages((paddr_t)q, pages);
+        return status;
+    }
+
+    *out_qdisc = q;
+    return STATUS_OK;
+}
+
+/* The qdisc must already be unreachable from its interface */
+void qdisc_destroy(qdisc_t* q) {
+    if (!q) {
+        return;
+    }
+
+    while (__sync_lock_test_and_set(&q->running, 1)) {
+        __asm__ volatile("pause");
+    }
+    __sync_lock_test_and_set(&q->lock, 1);
+    if (q->requeued) {
+        qdisc_buf_free(q->requeued);
+        q->requeued = NULL;
+    }
+    q->ops->reset(q);
+    __sync_lock_release(&q->lock);
+
+    pmm_free_pages((paddr_t)q, q->pages);
+}
+
+/* Pin the interface's qdisc against replacement while it is in use */
+static qdisc_t* qdisc_get(net_interface_t* iface) {
+    __sync_fetch_and_add(&iface->qdisc_users, 1);
+    return __atomic_load_n(&iface->qdisc, __ATOMIC_ACQUIRE);
+}
+
+static void qdisc_put(net_interface_t* iface) {
+    __sync_fetch_and_sub(&iface->qdisc_users, 1);
+}
+
+status_t net_interface_set_qdisc(net_interface_t* iface, const char* kind) {
+    if (!iface) {
+        return STATUS_INVALID;
+    }
+
+    qdisc_t* q = NULL;
+    if (kind) {
+        status_t status = qdisc_create(iface, kind, &q);
+        if (FAILED(status)) {
+            return status;
+        }
+    }
+
+    qdisc_t* old = __atomic_exchange_n(&iface->qdisc, q, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&iface->qdisc_users, __ATOMIC_ACQUIRE) != 0) {
+        __asm__ volatile("pause");
+    }
+    qdisc_destroy(old);
+
+    KLOG_INFO("QDISC", "%s: qdisc %s", iface->name, kind ? kind : "none");
+    return STATUS_OK;
+}
+
+status_t qdisc_get_stats(net_interface_t* iface, qdisc_stats_t* stats) {
+    if (!iface || !stats) {
+        return STATUS_INVALID;
+    }
+
+    qdisc_t* q = qdisc_get(iface);
+    if (!q) {
+        qdisc_put(iface);
+        return STATUS_NOTFOUND;
+    }
+
+    __sync_lock_test_and_set(&q->lock, 1);
+    *stats = q->stats;
+    stats->qlen = q->qlen + (q->requeued ? 1 : 0);
+    stats->backlog = q->backlog + (q->requeued ? (uint32_t)q->requeued->length : 0);
+    __sync_lock_release(&q->lock);
+
+    qdisc_put(iface);
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Byte queue limits
+ * ============================================================================ */
+
+static bool bql_avail(const net_bql_t* bql) {
+    return !bql->enabled || __atomic_load_n(&bql->inflight, __ATOMIC_RELAXED) < bql->limit;
+}
+
+static void bql_sent(net_bql_t* bql, uint32_t bytes) {
+    if (bql->enabled) {
+        __sync_fetch_and_add(&bql->inflight, bytes);
+    }
+}
+
+static void bql_completed(net_bql_t* bql, uint32_t bytes, uint64_t now) {
+    if (!bql->enabled) {
+        return;
+    }
+
+    uint32_t inflight = __atomic_load_n(&bql->inflight, __ATOMIC_RELAXED);
+    if (bytes > inflight) {
+        bytes = inflight;
+    }
+    inflight = __sync_sub_and_fetch(&bql->inflight, bytes);
+
+    if (bql->limited) {
+        if (inflight == 0) {
+            /* The ring ran dry while the qdisc was holding packets back */
+            uint32_t grow = bql->limit / 4 > bytes ? bql->limit / 4 : bytes;
+            bql->limit = bql->limit + grow < bql->max_limit ? bql->limit + grow : bql->max_limit;
+            bql->slack = UINT32_MAX;
+            bql->slack_start_ns = now;
+        } else if (inflight < bql->slack) {
+            bql->slack = inflight;
+        }
+    }
+
+    /* Data that was always still queued at completion time was never needed */
+    if (now - bql->slack_start_ns >= BQL_SLACK_HOLD_NS) {
+        if (bql->slack != UINT32_MAX) {
+            uint32_t shrink = bql->slack < bql->limit ? bql->slack : bql->limit;
+            bql->limit = bql->limit - shrink > bql->min_limit ? bql->limit - shrink : bql->min_limit;
+        }
+        bql->slack = UINT32_MAX;
+        bql->slack_start_ns = now;
+    }
+
+    bql->limited = false;
+}
+
+/* Called by a driver that reports TX completions through net_tx_complete() */
+void net_bql_enable(net_interface_t* iface, uint32_t max_bytes) {
+    if (!iface) {
+        return;
+    }
+
+    net_bql_t* bql = &iface->bql;
+    bql->min_limit = 2 * QDISC_FRAME_MAX;
+    bql->max_limit = max_bytes > bql->min_limit ? max_bytes : bql->min_limit;
+    bql->limit = bql->min_limit;
+    bql->inflight = 0;
+    bql->slack = UINT32_MAX;
+    bql->slack_start_ns = perf_timestamp_ns();
+    bql->limited = false;
+    __atomic_store_n(&bql->enabled, true, __ATOMIC_RELEASE);
+}
+
+/* ============================================================================
+ * Transmit path
+ * ============================================================================ */
+
+/*
+ * Account what the driver took. A super-packet refused part way (BUSY) has
+ * still put its first segments on the wire, so packets and bytes count even
+ * when the call failed.
+ */
+static void qdisc_account_tx(qdisc_t* q, net_interface_t* iface, uint32_t packets,
+                             uint32_t bytes, status_t result) {
+    iface->tx_packets += packets;
+    iface->tx_bytes += bytes;
+    if (FAILED(result) && result != STATUS_BUSY) {
+        iface->tx_errors++;
+    }
+
+    if (bytes) {
+        bql_sent(&iface->bql, bytes);
+    }
+    if (q) {
+        q->stats.sent_packets += packets;
+        q->stats.sent_bytes += bytes;
+    }
+}
+
+static uint32_t qdisc_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+    return h;
+}
+
+/* Flow hash for frames without socket metadata: IPv4 5-tuple, else ethertype */
+static uint32_t qdisc_flow_hash(const uint8_t* frame, size_t length) {
+    if (length < sizeof(eth_header_t)) {
+        return 0;
+    }
+
+    const eth_header_t* eth = (const eth_header_t*)frame;
+    uint16_t ethertype = ntohs(eth->ethertype);
+    if (ethertype != ETHERTYPE_IP || length < sizeof(eth_header_t) + sizeof(ipv4_header_t)) {
+        return qdisc_mix(ethertype);
+    }
+
+    const ipv4_header_t* ip = (const ipv4_header_t*)(frame + sizeof(eth_header_t));
+    uint32_t src, dst;
+    memcpy(&src, ip->src.addr, 4);
+    memcpy(&dst, ip->dst.addr, 4);
+
+    uint32_t ports = 0;
+    size_t l4 = sizeof(eth_header_t) + (size_t)(ip->version_ihl & 0x0F) * 4;
+    if ((ip->protocol == IP_PROTO_UDP || ip->protocol == IP_PROTO_TCP) && length >= l4 + 4) {
+        memcpy(&ports, frame + l4, 4);
+    }
+
+    return qdisc_mix(src ^ qdisc_mix(dst ^ qdisc_mix(ports ^ ip->protocol)));
+}
+
+/* Transmit priority: socket priority, then the AI hook, then DSCP */
+uint8_t qdisc_classify(const void* frame, size_t length, const qdisc_meta_t* meta) {
+    /* DSCP class selector to priority; LE and CS1 are background traffic */
+    static const uint8_t cs2prio[8] = {
+        NET_PRIO_BESTEFFORT, NET_PRIO_BULK, NET_PRIO_BESTEFFORT, NET_PRIO_INTERACTIVE_BULK,
+        NET_PRIO_INTERACTIVE, NET_PRIO_INTERACTIVE, NET_PRIO_CONTROL, NET_PRIO_CONTROL,
+    };
+
+    if (meta && meta->priority) {
+        return meta->priority > NET_PRIO_MAX ? NET_PRIO_MAX : meta->priority;
+    }
+
+    uint32_t ai_priority = ai_get_packet_priority((void*)frame, length);
+    if (ai_priority) {
+        return ai_priority > NET_PRIO_MAX ? NET_PRIO_MAX : (uint8_t)ai_priority;
+    }
+
+    if (length < sizeof(eth_header_t)) {
+        return NET_PRIO_BESTEFFORT;
+    }
+
+    const eth_header_t* eth = (const eth_header_t*)frame;
+    uint16_t ethertype = ntohs(eth->ethertype);
+    if (ethertype == ETHERTYPE_ARP) {
+        return NET_PRIO_CONTROL;
+    }
+    if (ethertype != ETHERTYPE_IP || length < sizeof(eth_header_t) + sizeof(ipv4_header_t)) {
+        return NET_PRIO_BESTEFFORT;
+    }
+
+    const ipv4_header_t* ip = (const ipv4_header_t*)((const uint8_t*)frame + sizeof(eth_header_t));
+    uint8_t dscp = ip->dscp_ecn >> 2;
+    if (dscp == 1) {
+        return NET_PRIO_BULK;
+    }
+    return cs2prio[dscp >> 3];
+}
+
+/*
+ * Feed the driver until the qdisc is empty, the ring is at its byte limit
+ * or the driver refuses a frame. Whoever holds `running` owns the dequeue
+ * side; a caller that loses the race leaves its packet to the owner, which
+ * rechecks for new arrivals before letting go.
+ */
+static void qdisc_run_at(qdisc_t* q, uint64_t now) {
+    net_interface_t* iface = q->iface;
+
+    for (;;) {
+        if (__sync_lock_test_and_set(&q->running, 1)) {
+            return;
+        }
+        uint64_t seen = __atomic_load_n(&q->stats.enqueued, __ATOMIC_ACQUIRE);
+
+        for (;;) {
+            if (!bql_avail(&iface->bql)) {
+                /* A polled driver may have finished frames nobody has reaped yet */
+                if (iface->tx_reclaim) {
+                    iface->tx_reclaim(iface);
+                }
+                if (!bql_avail(&iface->bql)) {
+                    if (q->qlen || q->requeued) {
+                        iface->bql.limited = true;
+                    }
+                    break;
+                }
+            }
+
+            __sync_lock_test_and_set(&q->lock, 1);
+            net_buffer_t* buf = q->requeued;
+            if (buf) {
+                q->requeued = NULL;
+            } else {
+                buf = q->ops->dequeue(q, now);
+            }
+            __sync_lock_release(&q->lock);
+
+            if (!buf) {
+                break;
+            }
+
+            uint32_t packets, bytes;
+            status_t result = net_dev_xmit(iface, buf, &packets, &bytes);
+            qdisc_account_tx(q, iface, packets, bytes, result);
+            if (result == STATUS_BUSY) {
+                /* Ring full; the next TX completion restarts the queue (and
+                 * a partly sent super-packet resumes where it stopped) */
+                __sync_lock_test_and_set(&q->lock, 1);
+                q->requeued = buf;
+                q->stats.requeues++;
+                __sync_lock_release(&q->lock);
+                break;
+            }
+
+            qdisc_buf_free(buf);
+        }
+
+        __sync_lock_release(&q->running);
+        if (__atomic_load_n(&q->stats.enqueued, __ATOMIC_ACQUIRE) == seen) {
+            return;
+        }
+    }
+}
+
+/* Send straight to the driver when nothing is queued ahead of the packet */
+static bool qdisc_try_bypass(qdisc_t* q, net_buffer_t* buf, status_t* out_result) {
+    net_interface_t* iface = q->iface;
+
+    if (!(q->ops->flags & QDISC_F_CAN_BYPASS) || !bql_avail(&iface->bql)) {
+        return false;
+    }
+    if (__sync_lock_test_and_set(&q->running, 1)) {
+        return false;
+    }
+
+    __sync_lock_test_and_set(&q->lock, 1);
+    bool empty = q->qlen == 0 && !q->requeued;
+    __sync_lock_release(&q->lock);
+
+    if (!empty) {
+        __sync_lock_release(&q->running);
+        return false;
+    }
+
+    uint32_t packets, bytes;
+    status_t result = net_dev_xmit(iface, buf, &packets, &bytes);
+    if (result == STATUS_BUSY && !bytes) {
+        __sync_lock_release(&q->running);
+        return false;
+    }
+
+    qdisc_account_tx(q, iface, packets, bytes, result);
+    q->stats.bypassed++;
+    if (result == STATUS_BUSY) {
+        /* Part of a super-packet went out; the rest waits at the head of the queue */
+        __sync_lock_test_and_set(&q->lock, 1);
+        q->requeued = buf;
+        q->stats.requeues++;
+        __sync_lock_release(&q->lock);
+        result = STATUS_OK;
+    } else {
+        qdisc_buf_free(buf);
+    }
+    __sync_lock_release(&q->running);
+
+    *out_result = result;
+    return true;
+}
+
+/* Enqueue buf (taking ownership) and run the qdisc */
+static status_t qdisc_xmit_at(net_interface_t* iface, net_buffer_t* buf,
+                              const qdisc_meta_t* meta, uint64_t now) {
+    qdisc_t* q = qdisc_get(iface);
+    status_t result;
+
+    if (!q) {
+        uint32_t packets, bytes;
+        result = net_dev_xmit(iface, buf, &packets, &bytes);
+        qdisc_account_tx(NULL, iface, packets, bytes, result);
+        qdisc_put(iface);
+        qdisc_buf_free(buf);
+        return result;
+    }
+
+    const uint8_t* frame = net_buffer_head(buf);
+    buf->flow_hash = meta && meta->flow_hash ? meta->flow_hash
+                                             : qdisc_flow_hash(frame, buf->length);
+    buf->pacing_rate = meta ? meta->pacing_rate : 0;
+    buf->priority = qdisc_classify(frame, buf->length, meta);
+    buf->enqueue_ns = now;
+
+    if (qdisc_try_bypass(q, buf, &result)) {
+        qdisc_put(iface);
+        return result;
+    }
+
+    __sync_lock_test_and_set(&q->lock, 1);
+    result = q->ops->enqueue(q, buf, now);
+    if (SUCCESS(result)) {
+        __atomic_fetch_add(&q->stats.enqueued, 1, __ATOMIC_RELEASE);
+    }
+    __sync_lock_release(&q->lock);
+
+    qdisc_run_at(q, now);
+    qdisc_put(iface);
+    return result;
+}
+
+static net_buffer_t* qdisc_buffer_copy(const void* frame, size_t length) {
+    net_buffer_t* buf = net_buffer_alloc(length);
+    if (buf) {
+        memcpy(buf->data, frame, length);
+        buf->length = length;
+    }
+    return buf;
+}
+
+/* Queue a complete Ethernet frame or super-packet; STATUS_BUSY means the qdisc dropped it */
+status_t qdisc_xmit_buffer(net_interface_t* iface, net_buffer_t* buf, const qdisc_meta_t* meta) {
+    if (!iface || !buf || !iface->send) {
+        if (buf) {
+            qdisc_buf_free(buf);
+        }
+        return STATUS_INVALID;
+    }
+    return qdisc_xmit_at(iface, buf, meta, perf_timestamp_ns());
+}
+
+/* Copying variant of qdisc_xmit_buffer() for a single frame */
+status_t qdisc_xmit(net_interface_t* iface, const void* frame, size_t length,
+                    const qdisc_meta_t* meta) {
+    if (!iface || !frame || length > NET_BUF_SIZE || !iface->send) {
+        return STATUS_INVALID;
+    }
+
+    net_buffer_t* buf = qdisc_buffer_copy(frame, length);
+    if (!buf) {
+        return STATUS_NOMEM;
+    }
+    return qdisc_xmit_at(iface, buf, meta, perf_timestamp_ns());
+}
+
+void qdisc_run(net_interface_t* iface) {
+    if (!iface) {
+        return;
+    }
+
+    qdisc_t* q = qdisc_get(iface);
+    if (q) {
+        qdisc_run_at(q, perf_timestamp_ns());
+    }
+    qdisc_put(iface);
+}
+
+static void net_tx_complete_at(net_interface_t* iface, uint32_t bytes, uint64_t now) {
+    bql_completed(&iface->bql, bytes, now);
+
+    qdisc_t* q = qdisc_get(iface);
+    if (q) {
+        qdisc_run_at(q, now);
+    }
+    qdisc_put(iface);
+}
+
+/* Driver TX completion: frees ring space and restarts the queue */
+void net_tx_complete(net_interface_t* iface, uint32_t packets, uint32_t bytes) {
+    if (!iface || (!packets && !bytes)) {
+        return;
+    }
+    net_tx_complete_at(iface, bytes, perf_timestamp_ns());
+}
+
+void net_tx_poll(void) {
+    uint64_t now = perf_timestamp_ns();
+
+    for (uint8_t i = 0; i < NET_MAX_INTERFACES; i++) {
+        net_interface_t* iface = net_get_interface(i);
+        if (!iface || !iface->send) {
+            continue;
+        }
+
+        qdisc_t* q = qdisc_get(iface);
+        if (q && (q->qlen || q->requeued)) {
+            if (iface->tx_reclaim) {
+                iface->tx_reclaim(iface);
+            }
+            if (!q->watchdog_ns || q->watchdog_ns <= now) {
+                qdisc_run_at(q, now);
+            }
+        }
+        qdisc_put(iface);
+    }
+}
+
+/* ============================================================================
+ * Latency benchmark
+ * ============================================================================ */
+
+#define QBENCH_RING         256
+#define QBENCH_PING_NS      (10ULL * NSEC_PER_MSEC)
+#define QBENCH_WARMUP_NS    (1000ULL * NSEC_PER_MSEC)
+#define QBENCH_BULK_FRAME   QDISC_FRAME_MAX
+#define QBENCH_PING_FRAME   98
+#define QBENCH_BULK_HASH    0xB01Cu
+#define QBENCH_PING_HASH    0x9196u
+
+typedef struct qbench_slot {
+    uint64_t done_ns;         /* When the frame has left the wire */
+    uint64_t stamp_ns;        /* Ping send time, 0 for bulk */
+    uint32_t length;
+} qbench_slot_t;
+
+typedef struct qbench_sim {
+    net_interface_t iface;
+    uint64_t now;
+    uint64_t link_bps;
+    uint64_t wire_free_ns;    /* When the last queued frame finishes */
+    qbench_slot_t ring[QBENCH_RING];
+    uint32_t head;
+    uint32_t count;
+    uint64_t bulk_bytes;
+    uint64_t* samples;
+    uint32_t max_samples;
+    uint32_t pings;
+} qbench_sim_t;
+
+static qbench_sim_t* qbench;
+
+static uint64_t qbench_wire_ns(uint64_t bytes, uint64_t link_bps) {
+    return bytes * 8 * NSEC_PER_SEC / link_bps;
+}
+
+/* Simulated driver: a FIFO ring draining onto a fixed-rate wire */
+static status_t qbench_send(net_interface_t* iface, const void* data, size_t length) {
+    (void)iface;
+    qbench_sim_t* s = qbench;
+
+    if (s->count == QBENCH_RING) {
+        return STATUS_BUSY;
+    }
+
+    qbench_slot_t* slot = &s->ring[(s->head + s->count) % QBENCH_RING];
+    uint64_t start = s->wire_free_ns > s->now ? s->wire_free_ns : s->now;
+    slot->done_ns = start + qbench_wire_ns(length, s->link_bps);
+    slot->length = (uint32_t)length;
+    slot->stamp_ns = 0;
+
+    const uint8_t* frame = (const uint8_t*)data;
+    const ipv4_header_t* ip = (const ipv4_header_t*)(frame + sizeof(eth_header_t));
+    if (length == QBENCH_PING_FRAME && ip->protocol == IP_PROTO_ICMP) {
+        memcpy(&slot->stamp_ns, frame + sizeof(eth_header_t) + sizeof(ipv4_header_t) +
+               sizeof(icmp_header_t), sizeof(uint64_t));
+    }
+
+    s->wire_free_ns = slot->done_ns;
+    s->count++;
+    return STATUS_OK;
+}
+
+static void qbench_complete(qbench_sim_t* s) {
+    while (s->count && s->ring[s->head].done_ns <= s->now) {
+        qbench_slot_t* slot = &s->ring[s->head];
+        if (slot->stamp_ns) {
+            if (slot->stamp_ns >= QBENCH_WARMUP_NS && s->pings < s->max_samples) {
+                s->samples[s->pings++] = slot->done_ns - slot->stamp_ns;
+            }
+        } else if (s->now >= QBENCH_WARMUP_NS) {
+            s->bulk_bytes += slot->length;
+        }
+        s->head = (s->head + 1) % QBENCH_RING;
+        s->count--;
+        net_tx_complete_at(&s->iface, slot->length, s->now);
+    }
+}
+
+static void qbench_frame(uint8_t* frame, size_t length, uint8_t protocol) {
+    memset(frame, 0, length);
+
+    eth_header_t* eth = (eth_header_t*)frame;
+    eth->ethertype = htons(ETHERTYPE_IP);
+
+    ipv4_header_t* ip = (ipv4_header_t*)(frame + sizeof(eth_header_t));
+    ip->version_ihl = 0x45;
+    ip->total_length = htons((uint16_t)(length - sizeof(eth_header_t)));
+    ip->ttl = 64;
+    ip->protocol = protocol;
+    ip->src.addr[0] = 10;
+    ip->dst.addr[0] = 10;
+    ip->dst.addr[3] = 2;
+}
+
+static void qbench_xmit(qbench_sim_t* s, const uint8_t* frame, size_t length,
+                        const qdisc_meta_t* meta) {
+    net_buffer_t* buf = qdisc_buffer_copy(frame, length);
+    if (buf) {
+        qdisc_xmit_at(&s->iface, buf, meta, s->now);
+    }
+}
+
+static void qbench_sort(uint64_t* v, uint32_t n) {
+    for (uint32_t gap = n / 2; gap > 0; gap /= 2) {
+        for (uint32_t i = gap; i < n; i++) {
+            uint64_t x = v[i];
+            uint32_t j = i;
+            while (j >= gap && v[j - gap] > x) {
+                v[j] = v[j - gap];
+                j -= gap;
+            }
+            v[j] = x;
+        }
+    }
+}
+
+status_t qdisc_benchmark(const qdisc_bench_config_t* config, qdisc_bench_result_t* result) {
+    if (!config || !result || !config->link_mbps || !config->bulk_load_pct ||
+        config->duration_ms * NSEC_PER_MSEC <= QBENCH_WARMUP_NS) {
+        return STATUS_INVALID;
+    }
+
+    size_t sim_pages = PAGES_FOR(sizeof(qbench_sim_t));
+    qbench_sim_t* s = (qbench_sim_t*)pmm_alloc_pages(sim_pages);
+    if (!s) {
+        return STATUS_NOMEM;
+    }
+    memset(s, 0, sim_pages * PAGE_SIZE);
+
+    uint64_t end = (uint64_t)config->duration_ms * NSEC_PER_MSEC;
+    s->max_samples = (uint32_t)(end / QBENCH_PING_NS) + 1;
+    size_t sample_pages = PAGES_FOR(s->max_samples * sizeof(uint64_t));
+    s->samples = (uint64_t*)pmm_alloc_pages(sample_pages);
+    if (!s->samples) {
+        pmm_free_pages((paddr_t)s, sim_pages);
+        return STATUS_NOMEM;
+    }
+
+    s->link_bps = (uint64_t)config->link_mbps * 1000000ULL;
+    s->iface.up = true;
+    s->iface.send = qbench_send;
+    memcpy(s->iface.name, "bench0", 7);
+    qbench = s;
+
+    status_t status = qdisc_create(&s->iface, config->kind ? config->kind : "pfifo_fast",
+                                   &s->iface.qdisc);
+    if (FAILED(status)) {
+        pmm_free_pages((paddr_t)s->samples, sample_pages);
+        pmm_free_pages((paddr_t)s, sim_pages);
+        return status;
+    }
+
+    if (config->bql) {
+        net_bql_enable(&s->iface, QBENCH_RING * QBENCH_BULK_FRAME);
+        s->iface.bql.slack_start_ns = 0;
+    }
+
+    uint8_t bulk[QBENCH_BULK_FRAME];
+    uint8_t ping[QBENCH_PING_FRAME];
+    qbench_frame(bulk, sizeof(bulk), IP_PROTO_UDP);
+    qbench_frame(ping, sizeof(ping), IP_PROTO_ICMP);
+
+    qdisc_meta_t bulk_meta = { QBENCH_BULK_HASH, config->bulk_pacing_rate, 0 };
+    qdisc_meta_t ping_meta = { QBENCH_PING_HASH, 0, config->ping_priority };
+
+    uint64_t bulk_gap = qbench_wire_ns(QBENCH_BULK_FRAME, s->link_bps) * 100 / config->bulk_load_pct;
+    uint64_t next_bulk = 0;
+    uint64_t next_ping = QBENCH_PING_NS / 2;
+    qdisc_t* q = s->iface.qdisc;
+
+    while (s->now < end) {
+        /* Advance virtual time to the next event */
+        uint64_t t = next_bulk < next_ping ? next_bulk : next_ping;
+        if (s->count && s->ring[s->head].done_ns < t) {
+            t = s->ring[s->head].done_ns;
+        }
+        if (q->watchdog_ns && q->watchdog_ns < t) {
+            t = q->watchdog_ns;
+        }
+        s->now = t > s->now ? t : s->now;
+
+        qbench_complete(s);
+
+        if (next_bulk <= s->now) {
+            qbench_xmit(s, bulk, sizeof(bulk), &bulk_meta);
+            next_bulk += bulk_gap;
+        }
+        if (next_ping <= s->now) {
+            memcpy(ping + sizeof(eth_header_t) + sizeof(ipv4_header_t) + sizeof(icmp_header_t),
+                   &s->now, sizeof(uint64_t));
+            qbench_xmit(s, ping, sizeof(ping), &ping_meta);
+            next_ping += QBENCH_PING_NS;
+        }
+        if (q->watchdog_ns && q->watchdog_ns <= s->now) {
+            qdisc_run_at(q, s->now);
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->pings = s->pings;
+    if (s->pings) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < s->pings; i++) {
+            sum += s->samples[i];
+        }
+        qbench_sort(s->samples, s->pings);
+        result->ping_avg_ns = sum / s->pings;
+        result->ping_p99_ns = s->samples[(uint64_t)s->pings * 99 / 100];
+        result->ping_max_ns = s->samples[s->pings - 1];
+    }
+    result->bulk_goodput_bps = s->bulk_bytes * 8 * NSEC_PER_SEC / (end - QBENCH_WARMUP_NS);
+    result->bql_limit = config->bql ? s->iface.bql.limit : 0;
+    result->stats = q->stats;
+    result->stats.qlen = q->qlen;
+    result->stats.backlog = q->backlog;
+
+    s->iface.qdisc = NULL;
+    qdisc_destroy(q);
+    qbench = NULL;
+    pmm_free_pages((paddr_t)s->samples, sample_pages);
+    pmm_free_pages((paddr_t)s, sim_pages);
+    return STATUS_OK;
+}
+
+/*
+ * The same load over the real stack: UDP sockets on 127.0.0.1 go through
+ * IP, the FIB and the qdisc under test on "lo", whose driver is swapped
+ * for a 256-slot ring draining at link_mbps in real time. Pings are small
+ * datagrams on their own socket, timed from udp_send to udp_recv.
+ */
+
+#define QLO_PORT_BULK       40100
+#define QLO_PORT_PING       40101
+#define QLO_BULK_DGRAM      (QBENCH_BULK_FRAME - sizeof(eth_header_t) - \
+                             sizeof(ipv4_header_t) - sizeof(udp_header_t))
+
+typedef struct qlo_slot {
+    uint64_t done_ns;
+    uint32_t length;
+    uint8_t frame[QDISC_FRAME_MAX];
+} qlo_slot_t;
+
+typedef struct qlo_wire {
+    net_interface_t* iface;
+    uint64_t link_bps;
+    uint64_t wire_free_ns;
+    qlo_slot_t ring[QBENCH_RING];
+    uint32_t head;
+    uint32_t count;
+} qlo_wire_t;
+
+static qlo_wire_t* qlo;
+
+/* Stand-in driver for lo: frames are copied onto a fixed-rate wire */
+static status_t qlo_send(net_interface_t* iface, const void* data, size_t length) {
+    (void)iface;
+    qlo_wire_t* w = qlo;
+
+    if (length > QDISC_FRAME_MAX) {
+        return STATUS_INVALID;
+    }
+    if (w->count == QBENCH_RING) {
+        return STATUS_BUSY;
+    }
+
+    uint64_t now = perf_timestamp_ns();
+    qlo_slot_t* slot = &w->ring[(w->head + w->count) % QBENCH_RING];
+    uint64_t start = w->wire_free_ns > now ? w->wire_free_ns : now;
+    slot->done_ns = start + qbench_wire_ns(length, w->link_bps);
+    slot->length = (uint32_t)length;
+    memcpy(slot->frame, data, length);
+
+    w->wire_free_ns = slot->done_ns;
+    w->count++;
+    return STATUS_OK;
+}
+
+/* Receive frames that have left the wire, then report them complete */
+static void qlo_complete(qlo_wire_t* w, uint64_t now) {
+    while (w->count && w->ring[w->head].done_ns <= now) {
+        qlo_slot_t* slot = &w->ring[w->head];
+        uint32_t length = slot->length;
+        net_receive_packet(w->iface, slot->frame, length);
+        w->head = (w->head + 1) % QBENCH_RING;
+        w->count--;
+        net_tx_complete(w->iface, 1, length);
+    }
+}
+
+static net_interface_t* qlo_find(void) {
+    for (uint8_t i = 0; i < NET_MAX_INTERFACES; i++) {
+        net_interface_t* iface = net_get_interface(i);
+        if (iface && qdisc_name_equals(iface->name, "lo")) {
+            return iface;
+        }
+    }
+    return NULL;
+}
+
+static status_t qlo_socket(uint16_t port, uint16_t peer, socket_t** out_sock) {
+    ipv4_addr_t lo = {{127, 0, 0, 1}};
+    status_t status = net_socket_create(SOCKET_TYPE_UDP, IP_PROTO_UDP, out_sock);
+    if (SUCCESS(status)) {
+        status = net_socket_bind(*out_sock, &lo, port);
+    }
+    if (SUCCESS(status) && peer) {
+        status = net_socket_connect(*out_sock, &lo, peer);
+    }
+    return status;
+}
+
+status_t qdisc_loopback_benchmark(const qdisc_bench_config_t* config,
+                                  qdisc_bench_result_t* result) {
+    if (!config || !result || !config->link_mbps || !config->bulk_load_pct ||
+        config->duration_ms * NSEC_PER_MSEC <= QBENCH_WARMUP_NS) {
+        return STATUS_INVALID;
+    }
+
+    net_interface_t* lo = qlo_find();
+    if (!lo || !lo->send) {
+        return STATUS_NOTFOUND;
+    }
+
+    uint64_t duration = (uint64_t)config->duration_ms * NSEC_PER_MSEC;
+    uint32_t max_samples = (uint32_t)(duration / QBENCH_PING_NS) + 1;
+    size_t wire_pages = PAGES_FOR(sizeof(qlo_wire_t));
+    size_t sample_pages = PAGES_FOR(max_samples * sizeof(uint64_t));
+    qlo_wire_t* w = (qlo_wire_t*)pmm_alloc_pages(wire_pages);
+    uint64_t* samples = (uint64_t*)pmm_alloc_pages(sample_pages);
+    socket_t* socks[4] = { NULL, NULL, NULL, NULL };
+    status_t status = STATUS_NOMEM;
+
+    if (!w || !samples) {
+        goto out;
+    }
+    memset(w, 0, sizeof(*w));
+    w->iface = lo;
+    w->link_bps = (uint64_t)config->link_mbps * 1000000ULL;
+
+    /* bulk sender, bulk sink, ping sender, ping sink */
+    if (FAILED(status = qlo_socket(QLO_PORT_BULK, QLO_PORT_BULK + 2, &socks[0])) ||
+        FAILED(status = qlo_socket(QLO_PORT_BULK + 2, 0, &socks[1])) ||
+        FAILED(status = qlo_socket(QLO_PORT_PING, QLO_PORT_PING + 2, &socks[2])) ||
+        FAILED(status = qlo_socket(QLO_PORT_PING + 2, 0, &socks[3]))) {
+        goto out;
+    }
+    net_socket_set_pacing_rate(socks[0], config->bulk_pacing_rate);
+    net_socket_set_priority(socks[2], config->ping_priority);
+
+    net_bql_t saved_bql = lo->bql;
+    status_t (*saved_send)(net_interface_t*, const void*, size_t) = lo->send;
+    status = net_interface_set_qdisc(lo, config->kind ? config->kind : "pfifo_fast");
+    if (FAILED(status)) {
+        goto out;
+    }
+    qlo = w;
+    lo->send = qlo_send;
+    if (config->bql) {
+        net_bql_enable(lo, QBENCH_RING * QBENCH_BULK_FRAME);
+    }
+
+    uint8_t bulk[QLO_BULK_DGRAM];
+    memset(bulk, 0xB5, sizeof(bulk));
+    uint8_t dgram[QLO_BULK_DGRAM];
+    uint64_t bulk_gap = qbench_wire_ns(QBENCH_BULK_FRAME, w->link_bps) * 100 / config->bulk_load_pct;
+    uint64_t bulk_bytes = 0;
+    uint32_t pings = 0;
+
+    uint64_t start = perf_timestamp_ns();
+    uint64_t warm = start + QBENCH_WARMUP_NS;
+    uint64_t end = start + duration;
+    uint64_t next_bulk = start;
+    uint64_t next_ping = start + QBENCH_PING_NS / 2;
+
+    for (uint64_t now = start; now < end; now = perf_timestamp_ns()) {
+        qlo_complete(w, now);
+        net_tx_poll();
+
+        if (next_bulk <= now) {
+            udp_send(socks[0], bulk, sizeof(bulk));
+            next_bulk += bulk_gap;
+        }
+        if (next_ping <= now) {
+            uint64_t stamp = perf_timestamp_ns();
+            udp_send(socks[2], &stamp, sizeof(stamp));
+            next_ping += QBENCH_PING_NS;
+        }
+
+        ssize_t n;
+        while ((n = udp_recv(socks[1], dgram, sizeof(dgram))) > 0) {
+            if (now >= warm) {
+                bulk_bytes += (uint64_t)n + sizeof(udp_header_t) + sizeof(ipv4_header_t) +
+                              sizeof(eth_header_t);
+            }
+        }
+        uint64_t stamp;
+        while (udp_recv(socks[3], &stamp, sizeof(stamp)) == sizeof(stamp)) {
+            if (stamp >= warm && pings < max_samples) {
+                samples[pings++] = perf_timestamp_ns() - stamp;
+            }
+        }
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->pings = pings;
+    if (pings) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < pings; i++) {
+            sum += samples[i];
+        }
+        qbench_sort(samples, pings);
+        result->ping_avg_ns = sum / pings;
+        result->ping_p99_ns = samples[(uint64_t)pings * 99 / 100];
+        result->ping_max_ns = samples[pings - 1];
+    }
+    result->bulk_goodput_bps = bulk_bytes * 8 * NSEC_PER_SEC / (end - warm);
+    result->bql_limit = config->bql ? lo->bql.limit : 0;
+    qdisc_get_stats(lo, &result->stats);
+
+    /* Put lo back as loopback_init left it; frames still on the wire are dropped */
+    net_interface_set_qdisc(lo, NULL);
+    lo->send = saved_send;
+    lo->bql = saved_bql;
+    qlo = NULL;
+    status = STATUS_OK;
+
+out:
+    for (int i = 0; i < 4; i++) {
+        if (socks[i]) {
+            net_socket_close(socks[i]);
+        }
+    }
+    if (samples) {
+        pmm_free_pages((paddr_t)samples, sample_pages);
+    }
+    if (w) {
+        pmm_free_pages((paddr_t)w, wire_pages);
+    }
+    return status;
+}
@@ -0,0 +1,979 @@
+/*
+ * IPv4 Routing
+ * Forwarding information base with longest-prefix match and ECMP
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "net.h"
+
+extern uint64_t perf_timestamp_ns(void);
+
+/*
+ * Table entries are 32 bits:
+ *   bit 31     extension: bits 0-23 index a 256-entry group
+ *   bits 24-29 depth (prefix length) of the route that owns a leaf
+ *   bits 0-23  next-hop group index for a leaf (0 = no route)
+ */
+#define FIB_ENTRY_EXT          0x80000000u
+#define FIB_ENTRY_DEPTH(e)     (((e) >> 24) & 0x3F)
+#define FIB_ENTRY_INDEX(e)     ((e) & 0x00FFFFFFu)
+#define FIB_LEAF(nhg, depth)   (((uint32_t)(depth) << 24) | (uint32_t)(nhg))
+
+#define FIB_ROOT_ENTRIES       65536
+#define FIB_GROUP_ENTRIES      256
+#define FIB_GROUPS_PER_CHUNK   64
+#define FIB_MAX_GROUPS         (1u << 18)
+#define FIB_GROUP_CHUNKS       (FIB_MAX_GROUPS / FIB_GROUPS_PER_CHUNK)
+/* A chunk is its groups followed by their free-list links, which readers never index */
+#define FIB_CHUNK_ENTRIES      (FIB_GROUPS_PER_CHUNK * FIB_GROUP_ENTRIES)
+#define FIB_CHUNK_BYTES        ((FIB_CHUNK_ENTRIES + FIB_GROUPS_PER_CHUNK) * sizeof(uint32_t))
+
+#define FIB_ROUTES_PER_CHUNK   4096
+#define FIB_ROUTE_CHUNKS       (FIB_MAX_ROUTES / FIB_ROUTES_PER_CHUNK)
+#define FIB_ROUTE_HASH_MIN     1024
+
+#define FIB_NHG_HASH_SIZE      256
+
+#define PAGES_FOR(bytes)       (((bytes) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+/* Shared set of next hops; routes reference one by index */
+typedef struct fib_nhgroup {
+    fib_nexthop_t nh[FIB_ECMP_MAX];
+    uint8_t count;
+    uint32_t refcount;
+    uint16_t hash_next;
+} fib_nhgroup_t;
+
+/* Control-plane record for one prefix */
+typedef struct fib_route {
+    uint32_t prefix;
+    uint8_t prefix_len;
+    uint8_t in_use;
+    uint16_t metric;
+    uint16_t nhg;
+    uint16_t reserved;
+    uint32_t hash_next;     /* Route index + 1; 0 ends the chain */
+} fib_route_t;
+
+struct fib_table {
+    /* Data plane */
+    uint32_t* root;
+    uint32_t* group_chunks[FIB_GROUP_CHUNKS];
+    uint32_t group_high;
+    uint32_t group_free;    /* Group index + 1; links kept after the chunk's groups */
+    uint32_t group_retired; /* Freed by this update; reusable after epoch_synchronize */
+    uint32_t groups_in_use;
+
+    /* Control plane */
+    fib_route_t* route_chunks[FIB_ROUTE_CHUNKS];
+    uint32_t route_high;
+    uint32_t route_free;
+    uint32_t route_count;
+    uint32_t* route_hash;
+    uint32_t route_hash_size;
+
+    fib_nhgroup_t nhg[FIB_MAX_NHGROUPS];
+    uint16_t nhg_hash[FIB_NHG_HASH_SIZE];
+    uint16_t nhg_free;
+    uint16_t nhg_retired;   /* Like group_retired, linked through hash_next */
+
+    uint32_t generation;
+    uint32_t lock;
+
+    /* Lock-free lookups are counted per epoch */
+    epoch_t readers;
+};
+
+/* Main table used by the IP layer */
+static fib_table_t* fib_main = NULL;
+
+/* Address helpers */
+static inline uint32_t fib_addr(const ipv4_addr_t* a) {
+    return ((uint32_t)a->addr[0] << 24) | ((uint32_t)a->addr[1] << 16) |
+           ((uint32_t)a->addr[2] << 8) | a->addr[3];
+}
+
+static inline void fib_to_addr(uint32_t v, ipv4_addr_t* a) {
+    a->addr[0] = v >> 24;
+    a->addr[1] = v >> 16;
+    a->addr[2] = v >> 8;
+    a->addr[3] = v;
+}
+
+static inline uint32_t fib_mask(uint8_t len) {
+    return len == 0 ? 0 : 0xFFFFFFFFu << (32 - len);
+}
+
+static inline uint32_t fib_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline void fib_lock(fib_table_t* t) {
+    while (__sync_lock_test_and_set(&t->lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+static inline void fib_unlock(fib_table_t* t) {
+    __sync_lock_release(&t->lock);
+}
+
+/* ============================================================================
+ * Data plane: DIR-16-8-8 table
+ * ============================================================================ */
+
+static inline uint32_t* fib_group(fib_table_t* t, uint32_t g) {
+    return t->group_chunks[g / FIB_GROUPS_PER_CHUNK] + (g % FIB_GROUPS_PER_CHUNK) * FIB_GROUP_ENTRIES;
+}
+
+static inline uint32_t* fib_group_link(fib_table_t* t, uint32_t g) {
+    return t->group_chunks[g / FIB_GROUPS_PER_CHUNK] + FIB_CHUNK_ENTRIES + g % FIB_GROUPS_PER_CHUNK;
+}
+
+/* Allocate a group with every entry set to 'fill' */
+static status_t fib_group_alloc(fib_table_t* t, uint32_t fill, uint32_t* out_g) {
+    uint32_t g;
+
+    if (t->group_free) {
+        g = t->group_free - 1;
+        t->group_free = *fib_group_link(t, g);
+    } else {
+        if (t->group_high >= FIB_MAX_GROUPS) {
+            return STATUS_NOMEM;
+        }
+        g = t->group_high;
+        uint32_t chunk = g / FIB_GROUPS_PER_CHUNK;
+        if (!t->group_chunks[chunk]) {
+            t->group_chunks[chunk] = (uint32_t*)pmm_alloc_pages(PAGES_FOR(FIB_CHUNK_BYTES));
+            if (!t->group_chunks[chunk]) {
+                return STATUS_NOMEM;
+            }
+        }
+        t->group_high++;
+    }
+
+    uint32_t* grp = fib_group(t, g);
+    for (uint32_t i = 0; i < FIB_GROUP_ENTRIES; i++) {
+        grp[i] = fill;
+    }
+
+    t->groups_in_use++;
+    *out_g = g;
+    return STATUS_OK;
+}
+
+/*
+ * Freed groups keep their entries and are never unmapped; they are
+ * retired until the update ends, so a lookup that raced with a collapse
+ * still reads the leaves it expects.
+ */
+static void fib_group_free(fib_table_t* t, uint32_t g) {
+    *fib_group_link(t, g) = t->group_retired;
+    t->group_retired = g + 1;
+    t->groups_in_use--;
+}
+
+/* Turn a leaf slot into an extension whose group inherits the leaf */
+static status_t fib_expand(fib_table_t* t, uint32_t* slot) {
+    uint32_t e = *slot;
+    if (e & FIB_ENTRY_EXT) {
+        return STATUS_OK;
+    }
+
+    uint32_t g;
+    status_t status = fib_group_alloc(t, e, &g);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    /* Group contents must be visible before the pointer to them */
+    __atomic_store_n(slot, FIB_ENTRY_EXT | g, __ATOMIC_RELEASE);
+    return STATUS_OK;
+}
+
+/* Fold a group whose entries are all the same leaf back into its parent */
+static void fib_collapse(fib_table_t* t, uint32_t* slot) {
+    uint32_t e = *slot;
+    if (!(e & FIB_ENTRY_EXT)) {
+        return;
+    }
+
+    uint32_t* grp = fib_group(t, FIB_ENTRY_INDEX(e));
+    uint32_t first = grp[0];
+    if (first & FIB_ENTRY_EXT) {
+        return;
+    }
+    for (uint32_t i = 1; i < FIB_GROUP_ENTRIES; i++) {
+        if (grp[i] != first) {
+            return;
+        }
+    }
+
+    __atomic_store_n(slot, first, __ATOMIC_RELEASE);
+    fib_group_free(t, FIB_ENTRY_INDEX(e));
+}
+
+/*
+ * Write 'leaf' into a slot and everything below it. Insert mode replaces
+ * leaves owned by routes no longer than 'len'; exact mode replaces only
+ * leaves owned by the route of length 'len' itself (delete/update).
+ */
+static void fib_apply(fib_table_t* t, uint32_t* slot, uint8_t len, uint32_t leaf, bool exact) {
+    uint32_t e = *slot;
+
+    if (e & FIB_ENTRY_EXT) {
+        uint32_t* grp = fib_group(t, FIB_ENTRY_INDEX(e));
+        for (uint32_t i = 0; i < FIB_GROUP_ENTRIES; i++) {
+            fib_apply(t, &grp[i], len, leaf, exact);
+        }
+        fib_collapse(t, slot);
+        return;
+    }
+
+    uint32_t depth = FIB_ENTRY_DEPTH(e);
+    /* Release: the next-hop group a new leaf names must be visible first */
+    if (exact ? depth == len : depth <= len) {
+        __atomic_store_n(slot, leaf, __ATOMIC_RELEASE);
+    }
+}
+
+/* Apply a leaf across the address range of prefix/len */
+static status_t fib_update(fib_table_t* t, uint32_t prefix, uint8_t len, uint32_t leaf, bool exact) {
+    if (len <= 16) {
+        uint32_t base = prefix >> 16;
+        uint32_t count = 1u << (16 - len);
+        for (uint32_t i = 0; i < count; i++) {
+            fib_apply(t, &t->root[base + i], len, leaf, exact);
+        }
+        return STATUS_OK;
+    }
+
+    uint32_t* slot16 = &t->root[prefix >> 16];
+    if (exact && !(*slot16 & FIB_ENTRY_EXT)) {
+        return STATUS_OK;   /* Nothing longer than /16 lives here */
+    }
+
+    status_t status = fib_expand(t, slot16);
+    if (FAILED(status)) {
+        return status;
+    }
+    uint32_t* grp2 = fib_group(t, FIB_ENTRY_INDEX(*slot16));
+
+    if (len <= 24) {
+        uint32_t base = (prefix >> 8) & 0xFF;
+        uint32_t count = 1u << (24 - len);
+        for (uint32_t i = 0; i < count; i++) {
+            fib_apply(t, &grp2[base + i], len, leaf, exact);
+        }
+    } else {
+        uint32_t* slot24 = &grp2[(prefix >> 8) & 0xFF];
+        if (!exact || (*slot24 & FIB_ENTRY_EXT)) {
+            status = fib_expand(t, slot24);
+            if (FAILED(status)) {
+                fib_collapse(t, slot16);
+                return status;
+            }
+
+            uint32_t* grp3 = fib_group(t, FIB_ENTRY_INDEX(*slot24));
+            uint32_t base = prefix & 0xFF;
+            uint32_t count = 1u << (32 - len);
+            for (uint32_t i = 0; i < count; i++) {
+                fib_apply(t, &grp3[base + i], len, leaf, exact);
+            }
+            fib_collapse(t, slot24);
+        }
+    }
+
+    fib_collapse(t, slot16);
+    return STATUS_OK;
+}
+
+/* Longest-prefix match: at most three dependent loads */
+static inline uint32_t fib_match(fib_table_t* t, uint32_t dst) {
+    uint32_t e = __atomic_load_n(&t->root[dst >> 16], __ATOMIC_ACQUIRE);
+    if (e & FIB_ENTRY_EXT) {
+        e = __atomic_load_n(&fib_group(t, FIB_ENTRY_INDEX(e))[(dst >> 8) & 0xFF], __ATOMIC_ACQUIRE);
+        if (e & FIB_ENTRY_EXT) {
+            e = __atomic_load_n(&fib_group(t, FIB_ENTRY_INDEX(e))[dst & 0xFF], __ATOMIC_ACQUIRE);
+        }
+    }
+    return e;
+}
+
+/* ============================================================================
+ * Next-hop groups
+ * ============================================================================ */
+
+static uint32_t fib_nhg_hash(const fib_nexthop_t* nh, uint8_t count) {
+    uint32_t h = count;
+    for (uint8_t i = 0; i < count; i++) {
+        h = fib_mix(h ^ fib_addr(&nh[i].gateway) ^ ((uint32_t)nh[i].iface_id << 24));
+    }
+    return h % FIB_NHG_HASH_SIZE;
+}
+
+static bool fib_nh_equal(const fib_nexthop_t* a, const fib_nexthop_t* b) {
+    return a->iface_id == b->iface_id && ipv4_addr_equals(&a->gateway, &b->gateway);
+}
+
+/* Canonical member order so equal sets share one group */
+static bool fib_nh_less(const fib_nexthop_t* a, const fib_nexthop_t* b) {
+    if (a->iface_id != b->iface_id) {
+        return a->iface_id < b->iface_id;
+    }
+    return fib_addr(&a->gateway) < fib_addr(&b->gateway);
+}
+
+/* Find or create the group for a sorted set; takes a reference */
+static uint16_t fib_nhg_get(fib_table_t* t, const fib_nexthop_t* nh, uint8_t count) {
+    uint32_t bucket = fib_nhg_hash(nh, count);
+
+    for (uint16_t i = t->nhg_hash[bucket]; i; i = t->nhg[i].hash_next) {
+        fib_nhgroup_t* g = &t->nhg[i];
+        if (g->count != count) {
+            continue;
+        }
+        bool same = true;
+        for (uint8_t j = 0; j < count && same; j++) {
+            same = fib_nh_equal(&g->nh[j], &nh[j]);
+        }
+        if (same) {
+            g->refcount++;
+            return i;
+        }
+    }
+
+    uint16_t idx = t->nhg_free;
+    if (!idx) {
+        return 0;
+    }
+    fib_nhgroup_t* g = &t->nhg[idx];
+    t->nhg_free = g->hash_next;
+
+    for (uint8_t j = 0; j < count; j++) {
+        g->nh[j] = nh[j];
+    }
+    g->count = count;
+    g->refcount = 1;
+    g->hash_next = t->nhg_hash[bucket];
+    t->nhg_hash[bucket] = idx;
+    return idx;
+}
+
+static void fib_nhg_put(fib_table_t* t, uint16_t idx) {
+    fib_nhgroup_t* g = &t->nhg[idx];
+    if (!idx || --g->refcount > 0) {
+        return;
+    }
+
+    uint32_t bucket = fib_nhg_hash(g->nh, g->count);
+    uint16_t* link = &t->nhg_hash[bucket];
+    while (*link && *link != idx) {
+        link = &t->nhg[*link].hash_next;
+    }
+    if (*link) {
+        *link = g->hash_next;
+    }
+
+    /* Contents stay intact for lookups until the update retires the group */
+    g->hash_next = t->nhg_retired;
+    t->nhg_retired = idx;
+}
+
+/* End of an update: wait out lookups, then make retired slots reusable */
+static void fib_reclaim(fib_table_t* t) {
+    if (!t->group_retired && !t->nhg_retired) {
+        return;
+    }
+    epoch_synchronize(&t->readers);
+
+    while (t->group_retired) {
+        uint32_t g = t->group_retired - 1;
+        t->group_retired = *fib_group_link(t, g);
+        *fib_group_link(t, g) = t->group_free;
+        t->group_free = g + 1;
+    }
+    while (t->nhg_retired) {
+        uint16_t idx = t->nhg_retired;
+        t->nhg_retired = t->nhg[idx].hash_next;
+        t->nhg[idx].count = 0;
+        t->nhg[idx].hash_next = t->nhg_free;
+        t->nhg_free = idx;
+    }
+}
+
+/* ============================================================================
+ * Control plane: prefix records
+ * ============================================================================ */
+
+static inline fib_route_t* fib_route_at(fib_table_t* t, uint32_t idx) {
+    return &t->route_chunks[idx / FIB_ROUTES_PER_CHUNK][idx % FIB_ROUTES_PER_CHUNK];
+}
+
+static inline uint32_t fib_route_bucket(fib_table_t* t, uint32_t prefix, uint8_t len) {
+    return fib_mix(prefix ^ ((uint32_t)len * 0x9E3779B9u)) & (t->route_hash_size - 1);
+}
+
+static fib_route_t* fib_route_find(fib_table_t* t, uint32_t prefix, uint8_t len) {
+    for (uint32_t i = t->route_hash[fib_route_bucket(t, prefix, len)]; i; ) {
+        fib_route_t* r = fib_route_at(t, i - 1);
+        if (r->prefix == prefix && r->prefix_len == len) {
+            return r;
+        }
+        i = r->hash_next;
+    }
+    return NULL;
+}
+
+/* Double the prefix hash once it is fuller than one entry per bucket */
+static status_t fib_route_hash_grow(fib_table_t* t) {
+    uint32_t new_size = t->route_hash_size * 2;
+    uint32_t* new_hash = (uint32_t*)pmm_alloc_pages(PAGES_FOR(new_size * sizeof(uint32_t)));
+    if (!new_hash) {
+        return STATUS_NOMEM;
+    }
+    memset(new_hash, 0, new_size * sizeof(uint32_t));
+
+    uint32_t* old_hash = t->route_hash;
+    uint32_t old_size = t->route_hash_size;
+    t->route_hash = new_hash;
+    t->route_hash_size = new_size;
+
+    for (uint32_t idx = 0; idx < t->route_high; idx++) {
+        fib_route_t* r = fib_route_at(t, idx);
+        if (!r->in_use) {
+            continue;
+        }
+        uint32_t bucket = fib_route_bucket(t, r->prefix, r->prefix_len);
+        r->hash_next = new_hash[bucket];
+        new_hash[bucket] = idx + 1;
+    }
+
+    pmm_free_pages((paddr_t)old_hash, PAGES_FOR(old_size * sizeof(uint32_t)));
+    return STATUS_OK;
+}
+
+static fib_route_t* fib_route_insert(fib_table_t* t, uint32_t prefix, uint8_t len) {
+    if (t->route_count >= t->route_hash_size && t->route_hash_size < FIB_MAX_ROUTES) {
+        if (FAILED(fib_route_hash_grow(t))) {
+            return NULL;
+        }
+    }
+
+    uint32_t idx;
+    if (t->route_free) {
+        idx = t->route_free - 1;
+        t->route_free = fib_route_at(t, idx)->hash_next;
+    } else {
+        if (t->route_high >= FIB_MAX_ROUTES) {
+            return NULL;
+        }
+        idx = t->route_high;
+        uint32_t chunk = idx / FIB_ROUTES_PER_CHUNK;
+        if (!t->route_chunks[chunk]) {
+            t->route_chunks[chunk] = (fib_route_t*)pmm_alloc_pages(
+                PAGES_FOR(FIB_ROUTES_PER_CHUNK * sizeof(fib_route_t)));
+            if (!t->route_chunks[chunk]) {
+                return NULL;
+            }
+        }
+        t->route_high++;
+    }
+
+    fib_route_t* r = fib_route_at(t, idx);
+    r->prefix = prefix;
+    r->prefix_len = len;
+    r->in_use = 1;
+    r->metric = 0;
+    r->nhg = 0;
+
+    uint32_t bucket = fib_route_bucket(t, prefix, len);
+    r->hash_next = t->route_hash[bucket];
+    t->route_hash[bucket] = idx + 1;
+    t->route_count++;
+    return r;
+}
+
+static void fib_route_remove(fib_table_t* t, fib_route_t* r) {
+    uint32_t* link = &t->route_hash[fib_route_bucket(t, r->prefix, r->prefix_len)];
+    while (*link && fib_route_at(t, *link - 1) != r) {
+        link = &fib_route_at(t, *link - 1)->hash_next;
+    }
+    if (!*link) {
+        return;
+    }
+
+    uint32_t idx = *link - 1;
+    *link = r->hash_next;
+
+    r->in_use = 0;
+    r->hash_next = t->route_free;
+    t->route_free = idx + 1;
+    t->route_count--;
+}
+
+/* Leaf for the longest route strictly shorter than len covering prefix */
+static uint32_t fib_covering_leaf(fib_table_t* t, uint32_t prefix, uint8_t len) {
+    for (int l = (int)len - 1; l >= 0; l--) {
+        fib_route_t* r = fib_route_find(t, prefix & fib_mask(l), (uint8_t)l);
+        if (r) {
+            return FIB_LEAF(r->nhg, l);
+        }
+    }
+    return 0;
+}
+
+/* Point a route at a new next-hop group and rewrite its leaves */
+static status_t fib_route_set_nhg(fib_table_t* t, fib_route_t* r, uint16_t nhg) {
+    status_t status = fib_update(t, r->prefix, r->prefix_len, FIB_LEAF(nhg, r->prefix_len), true);
+    if (FAILED(status)) {
+        return status;
+    }
+    fib_nhg_put(t, r->nhg);
+    r->nhg = nhg;
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Table API
+ * ============================================================================ */
+
+fib_table_t* fib_table_create(void) {
+    fib_table_t* t = (fib_table_t*)pmm_alloc_pages(PAGES_FOR(sizeof(fib_table_t)));
+    if (!t) {
+        return NULL;
+    }
+    memset(t, 0, sizeof(fib_table_t));
+
+    t->root = (uint32_t*)pmm_alloc_pages(PAGES_FOR(FIB_ROOT_ENTRIES * sizeof(uint32_t)));
+    t->route_hash_size = FIB_ROUTE_HASH_MIN;
+    t->route_hash = (uint32_t*)pmm_alloc_pages(PAGES_FOR(FIB_ROUTE_HASH_MIN * sizeof(uint32_t)));
+    if (!t->root || !t->route_hash) {
+        fib_table_destroy(t);
+        return NULL;
+    }
+    memset(t->root, 0, FIB_ROOT_ENTRIES * sizeof(uint32_t));
+    memset(t->route_hash, 0, FIB_ROUTE_HASH_MIN * sizeof(uint32_t));
+
+    /* Group 0 means "no route"; chain the rest onto the free list */
+    for (uint16_t i = FIB_MAX_NHGROUPS - 1; i >= 1; i--) {
+        t->nhg[i].hash_next = t->nhg_free;
+        t->nhg_free = i;
+    }
+
+    return t;
+}
+
+void fib_table_destroy(fib_table_t* t) {
+    if (!t) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < FIB_GROUP_CHUNKS; i++) {
+        if (t->group_chunks[i]) {
+            pmm_free_pages((paddr_t)t->group_chunks[i], PAGES_FOR(FIB_CHUNK_BYTES));
+        }
+    }
+    for (uint32_t i = 0; i < FIB_ROUTE_CHUNKS; i++) {
+        if (t->route_chunks[i]) {
+            pmm_free_pages((paddr_t)t->route_chunks[i],
+                           PAGES_FOR(FIB_ROUTES_PER_CHUNK * sizeof(fib_route_t)));
+        }
+    }
+    if (t->route_hash) {
+        pmm_free_pages((paddr_t)t->route_hash, PAGES_FOR(t->route_hash_size * sizeof(uint32_t)));
+    }
+    if (t->root) {
+        pmm_free_pages((paddr_t)t->root, PAGES_FOR(FIB_ROOT_ENTRIES * sizeof(uint32_t)));
+    }
+    pmm_free_pages((paddr_t)t, PAGES_FOR(sizeof(fib_table_t)));
+}
+
+/*
+ * Add a next hop for prefix/len. A lower metric replaces the existing
+ * next hops, an equal metric joins them as an ECMP member, and a higher
+ * metric is refused.
+ */
+status_t fib_table_add(fib_table_t* t, uint32_t prefix, uint8_t prefix_len,
+                       const fib_nexthop_t* nh, uint16_t metric) {
+    if (!t || !nh || prefix_len > 32) {
+        return STATUS_INVALID;
+    }
+    prefix &= fib_mask(prefix_len);
+
+    fib_lock(t);
+
+    status_t status = STATUS_OK;
+    fib_route_t* r = fib_route_find(t, prefix, prefix_len);
+
+    if (!r) {
+        uint16_t nhg = fib_nhg_get(t, nh, 1);
+        if (!nhg) {
+            fib_unlock(t);
+            return STATUS_NOMEM;
+        }
+
+        r = fib_route_insert(t, prefix, prefix_len);
+        if (!r) {
+            fib_nhg_put(t, nhg);
+            fib_unlock(t);
+            return STATUS_NOMEM;
+        }
+        r->metric = metric;
+        r->nhg = nhg;
+
+        status = fib_update(t, prefix, prefix_len, FIB_LEAF(nhg, prefix_len), false);
+        if (FAILED(status)) {
+            fib_update(t, prefix, prefix_len, fib_covering_leaf(t, prefix, prefix_len), true);
+            fib_nhg_put(t, nhg);
+            fib_route_remove(t, r);
+        }
+    } else if (metric > r->metric) {
+        status = STATUS_EXISTS;
+    } else {
+        fib_nexthop_t set[FIB_ECMP_MAX];
+        uint8_t count = 0;
+
+        if (metric == r->metric) {
+            fib_nhgroup_t* cur = &t->nhg[r->nhg];
+            for (uint8_t i = 0; i < cur->count; i++) {
+                if (fib_nh_equal(&cur->nh[i], nh)) {
+                    fib_unlock(t);
+                    return STATUS_EXISTS;
+                }
+            }
+            if (cur->count >= FIB_ECMP_MAX) {
+                fib_unlock(t);
+                return STATUS_NOMEM;
+            }
+            for (uint8_t i = 0; i < cur->count; i++) {
+                set[count++] = cur->nh[i];
+            }
+        }
+
+        /* Insertion-sort the new member into canonical order */
+        uint8_t pos = count;
+        while (pos > 0 && fib_nh_less(nh, &set[pos - 1])) {
+            set[pos] = set[pos - 1];
+            pos--;
+        }
+        set[pos] = *nh;
+        count++;
+
+        uint16_t nhg = fib_nhg_get(t, set, count);
+        if (!nhg) {
+            status = STATUS_NOMEM;
+        } else {
+            status = fib_route_set_nhg(t, r, nhg);
+            if (FAILED(status)) {
+                fib_nhg_put(t, nhg);
+            } else {
+                r->metric = metric;
+            }
+        }
+    }
+
+    if (SUCCESS(status)) {
+        __atomic_add_fetch(&t->generation, 1, __ATOMIC_RELEASE);
+    }
+
+    fib_reclaim(t);
+    fib_unlock(t);
+    return status;
+}
+
+/* Remove one next hop (or every next hop if nh is NULL) from prefix/len */
+status_t fib_table_delete(fib_table_t* t, uint32_t prefix, uint8_t prefix_len,
+                          const fib_nexthop_t* nh) {
+    if (!t || prefix_len > 32) {
+        return STATUS_INVALID;
+    }
+    prefix &= fib_mask(prefix_len);
+
+    fib_lock(t);
+
+    fib_route_t* r = fib_route_find(t, prefix, prefix_len);
+    if (!r) {
+        fib_unlock(t);
+        return STATUS_NOTFOUND;
+    }
+
+    status_t status = STATUS_OK;
+    fib_nhgroup_t* cur = &t->nhg[r->nhg];
+    fib_nexthop_t set[FIB_ECMP_MAX];
+    uint8_t count = 0;
+
+    if (nh) {
+        bool found = false;
+        for (uint8_t i = 0; i < cur->count; i++) {
+            if (fib_nh_equal(&cur->nh[i], nh)) {
+                found = true;
+            } else {
+                set[count++] = cur->nh[i];
+            }
+        }
+        if (!found) {
+            fib_unlock(t);
+            return STATUS_NOTFOUND;
+        }
+    }
+
+    if (count > 0) {
+        uint16_t nhg = fib_nhg_get(t, set, count);
+        status = nhg ? fib_route_set_nhg(t, r, nhg) : STATUS_NOMEM;
+        if (FAILED(status) && nhg) {
+            fib_nhg_put(t, nhg);
+        }
+    } else {
+        /* Hand the range back to the covering route; shrinking never allocates */
+        fib_update(t, prefix, prefix_len, fib_covering_leaf(t, prefix, prefix_len), true);
+        fib_nhg_put(t, r->nhg);
+        fib_route_remove(t, r);
+    }
+
+    if (SUCCESS(status)) {
+        __atomic_add_fetch(&t->generation, 1, __ATOMIC_RELEASE);
+    }
+
+    fib_reclaim(t);
+    fib_unlock(t);
+    return status;
+}
+
+/* Lock-free lookup; flow_hash picks among ECMP members */
+status_t fib_table_lookup(fib_table_t* t, uint32_t dst, uint32_t flow_hash,
+                          fib_nexthop_t* out_nh, uint8_t* out_prefix_len) {
+    if (!t || !out_nh) {
+        return STATUS_INVALID;
+    }
+
+    uint32_t reader = epoch_read_lock(&t->readers);
+
+    uint32_t e = fib_match(t, dst);
+    uint32_t idx = FIB_ENTRY_INDEX(e);
+    const fib_nhgroup_t* g = idx && idx < FIB_MAX_NHGROUPS ? &t->nhg[idx] : NULL;
+    uint8_t count = g ? __atomic_load_n(&g->count, __ATOMIC_RELAXED) : 0;
+    if (count == 0 || count > FIB_ECMP_MAX) {
+        epoch_read_unlock(&t->readers, reader);
+        return STATUS_NOTFOUND;
+    }
+
+    /* Hash-threshold selection keeps most flows in place when members change */
+    uint32_t member = count == 1 ? 0 : (uint32_t)(((uint64_t)flow_hash * count) >> 32);
+    *out_nh = g->nh[member];
+    epoch_read_unlock(&t->readers, reader);
+
+    if (out_prefix_len) {
+        *out_prefix_len = FIB_ENTRY_DEPTH(e);
+    }
+    return STATUS_OK;
+}
+
+/* ============================================================================
+ * Main table
+ * ============================================================================ */
+
+status_t fib_init(void) {
+    if (fib_main) {
+        return STATUS_EXISTS;
+    }
+
+    fib_main = fib_table_create();
+    if (!fib_main) {
+        return STATUS_NOMEM;
+    }
+
+    KLOG_INFO("ROUTE", "IPv4 FIB initialized");
+    return STATUS_OK;
+}
+
+status_t route_add(const ipv4_addr_t* prefix, uint8_t prefix_len, const ipv4_addr_t* gateway,
+                   uint8_t iface_id, uint16_t metric) {
+    if (!prefix || iface_id >= NET_MAX_INTERFACES) {
+        return STATUS_INVALID;
+    }
+
+    fib_nexthop_t nh = {0};
+    if (gateway) {
+        ipv4_addr_copy(&nh.gateway, gateway);
+    }
+    nh.iface_id = iface_id;
+
+    return fib_table_add(fib_main, fib_addr(prefix), prefix_len, &nh, metric);
+}
+
+status_t route_delete(const ipv4_addr_t* prefix, uint8_t prefix_len, const ipv4_addr_t* gateway,
+                      uint8_t iface_id) {
+    if (!prefix) {
+        return STATUS_INVALID;
+    }
+
+    fib_nexthop_t nh = {0};
+    if (gateway) {
+        ipv4_addr_copy(&nh.gateway, gateway);
+    }
+    nh.iface_id = iface_id;
+
+    return fib_table_delete(fib_main, fib_addr(prefix), prefix_len, gateway ? &nh : NULL);
+}
+
+/* Drop every next hop that leaves through an interface */
+status_t route_delete_iface(uint8_t iface_id) {
+    fib_table_t* t = fib_main;
+    if (!t) {
+        return STATUS_INVALID;
+    }
+
+    for (uint32_t idx = 0; idx < t->route_high; idx++) {
+        fib_route_t* r = fib_route_at(t, idx);
+        if (!r->in_use) {
+            continue;
+        }
+
+        fib_nhgroup_t* g = &t->nhg[r->nhg];
+        for (int i = (int)g->count - 1; i >= 0; i--) {
+            if (g->nh[i].iface_id == iface_id) {
+                fib_nexthop_t nh = g->nh[i];
+                fib_table_delete(t, r->prefix, r->prefix_len, &nh);
+                if (!r->in_use) {
+                    break;
+                }
+                g = &t->nhg[r->nhg];
+            }
+        }
+    }
+
+    return STATUS_OK;
+}
+
+status_t route_lookup(const ipv4_addr_t* dst, uint32_t flow_hash, route_result_t* out) {
+    if (!dst || !out || !fib_main) {
+        return STATUS_INVALID;
+    }
+
+    fib_nexthop_t nh;
+    status_t status = fib_table_lookup(fib_main, fib_addr(dst), flow_hash, &nh, &out->prefix_len);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    out->iface = net_get_interface(nh.iface_id);
+    if (!out->iface || !out->iface->up) {
+        return STATUS_NOTFOUND;
+    }
+
+    if (fib_addr(&nh.gateway) == 0) {
+        ipv4_addr_copy(&out->next_hop, dst);
+    } else {
+        ipv4_addr_copy(&out->next_hop, &nh.gateway);
+    }
+    return STATUS_OK;
+}
+
+/* Cached routes compare against this; any FIB or neighbour change bumps it */
+uint32_t route_generation(void) {
+    return fib_main ? __atomic_load_n(&fib_main->generation, __ATOMIC_ACQUIRE) : 0;
+}
+
+void route_invalidate(void) {
+    if (fib_main) {
+        __atomic_add_fetch(&fib_main->generation, 1, __ATOMIC_RELEASE);
+    }
+}
+
+uint32_t route_flow_hash(const ipv4_addr_t* src, const ipv4_addr_t* dst, uint8_t protocol,
+                         uint16_t src_port, uint16_t dst_port) {
+    uint32_t h = fib_mix(fib_addr(dst) ^ 0x9E3779B9u);
+    h = fib_mix(h ^ (src ? fib_addr(src) : 0));
+    h = fib_mix(h ^ ((uint32_t)src_port << 16 | dst_port) ^ ((uint32_t)protocol << 8));
+    return h;
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+/* Prefix-length mix loosely shaped like a full Internet table */
+static uint8_t fib_bench_len(uint32_t r) {
+    uint32_t p = r % 100;
+    if (p < 55) return 24;
+    if (p < 65) return 22 + (r >> 8) % 2;
+    if (p < 85) return 17 + (r >> 8) % 5;
+    if (p < 95) return 8 + (r >> 8) % 9;
+    return 25 + (r >> 8) % 8;
+}
+
+static inline uint32_t fib_bench_rand(uint32_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/*
+ * Build a scratch table of route_count synthetic prefixes spread over
+ * eight ECMP-capable next hops, then time random lookups against it.
+ */
+status_t fib_benchmark(uint32_t route_count, uint32_t lookups, fib_bench_result_t* result) {
+    if (!result || route_count > FIB_MAX_ROUTES || lookups == 0) {
+        return STATUS_INVALID;
+    }
+
+    fib_table_t* t = fib_table_create();
+    if (!t) {
+        return STATUS_NOMEM;
+    }
+
+    uint32_t seed = 0x12345678;
+    uint32_t added = 0;
+
+    uint64_t start = perf_timestamp_ns();
+    while (added < route_count) {
+        uint32_t r = fib_bench_rand(&seed);
+        uint8_t len = fib_bench_len(r);
+        fib_nexthop_t nh = {0};
+        fib_to_addr(0x0A000001u + (r & 7), &nh.gateway);
+        nh.iface_id = 0;
+
+        status_t status = fib_table_add(t, fib_bench_rand(&seed), len, &nh, FIB_METRIC_DEFAULT);
+        if (status == STATUS_NOMEM) {
+            break;
+        }
+        if (SUCCESS(status)) {
+            added++;
+        }
+    }
+    uint64_t insert_ns = perf_timestamp_ns() - start;
+
+    uint32_t hits = 0;
+    fib_nexthop_t nh;
+    start = perf_timestamp_ns();
+    for (uint32_t i = 0; i < lookups; i++) {
+        uint32_t dst = fib_bench_rand(&seed);
+        if (SUCCESS(fib_table_lookup(t, dst, dst, &nh, NULL))) {
+            hits++;
+        }
+    }
+    uint64_t lookup_ns = perf_timestamp_ns() - start;
+
+    result->routes = added;
+    result->lookups = lookups;
+    result->groups = t->groups_in_use;
+    result->table_bytes = (uint64_t)FIB_ROOT_ENTRIES * sizeof(uint32_t) +
+                          (uint64_t)t->group_high * FIB_GROUP_ENTRIES * sizeof(uint32_t);
+    result->insert_ns = insert_ns;
+    result->lookup_ns = lookup_ns;
+    result->lookups_per_sec = lookup_ns ? (uint64_t)lookups * 1000000000ULL / lookup_ns : 0;
+
+    KLOG_INFO("ROUTE", "FIB bench: %u routes, %u groups, %llu lookups/s (%u hits)",
+              added, t->groups_in_use, result->lookups_per_sec, hits);
+
+    fib_table_destroy(t);
+    return STATUS_OK;
+}
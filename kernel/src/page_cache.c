@@ -0,0 +1,473 @@
+/*
+ * Page Cache
+ * File pages shared between mappings, with clock eviction of unmapped pages
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "page_cache.h"
+
+typedef struct page_cache_entry {
+    vfs_node_t* node;
+    uint64_t index;
+    paddr_t page;
+    uint32_t maps;             /* Map references; mapped pages are never evicted */
+    bool referenced;           /* Second chance for the clock */
+    bool readahead;            /* Read ahead and not yet accessed */
+    bool in_use;
+    struct page_cache_entry* hash_next;
+} page_cache_entry_t;
+
+static page_cache_entry_t cache_entries[PAGE_CACHE_PAGES];
+static page_cache_entry_t* cache_hash[PAGE_CACHE_HASH];
+static uint32_t cache_clock;
+static uint32_t cache_lock;
+static page_cache_stats_t cache_stats;
+
+static ALWAYS_INLINE void cache_acquire(void) {
+    while (__sync_lock_test_and_set(&cache_lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+static ALWAYS_INLINE void cache_release(void) {
+    __sync_lock_release(&cache_lock);
+}
+
+static ALWAYS_INLINE uint32_t cache_bucket(vfs_node_t* node, uint64_t index) {
+    uint64_t key = ((uint64_t)(uintptr_t)node >> 6) ^ (index * 0x9E3779B97F4A7C15ULL);
+    return (uint32_t)(key >> 32) % PAGE_CACHE_HASH;
+}
+
+/* Caller holds the cache lock */
+static page_cache_entry_t* cache_find(vfs_node_t* node, uint64_t index) {
+    for (page_cache_entry_t* e = cache_hash[cache_bucket(node, index)]; e; e = e->hash_next) {
+        if (e->node == node && e->index == index) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/* Unhash an entry and free its page; caller holds the lock and drops the node ref */
+static void cache_remove(page_cache_entry_t* entry) {
+    page_cache_entry_t** link = &cache_hash[cache_bucket(entry->node, entry->index)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+
+    if (entry->readahead) {
+        cache_stats.readahead_wasted++;
+    }
+    pmm_free_page(entry->page);
+    entry->in_use = false;
+    entry->node = NULL;
+    cache_stats.cached--;
+}
+
+/* Find a free entry, evicting an unmapped page if needed; caller holds the lock */
+static page_cache_entry_t* cache_alloc_entry(vfs_node_t** out_evicted) {
+    *out_evicted = NULL;
+
+    for (uint32_t scanned = 0; scanned < 2 * PAGE_CACHE_PAGES; scanned++) {
+        page_cache_entry_t* entry = &cache_entries[cache_clock];
+        cache_clock = (cache_clock + 1) % PAGE_CACHE_PAGES;
+
+        if (!entry->in_use) {
+            return entry;
+        }
+        if (entry->maps) {
+            continue;
+        }
+        if (entry->referenced) {
+            entry->referenced = false;
+            continue;
+        }
+
+        *out_evicted = entry->node;
+        cache_remove(entry);
+        cache_stats.evictions++;
+        return entry;
+    }
+    return NULL;
+}
+
+/* Read one page of a file; bytes past EOF read as zero */
+static status_t cache_fill(vfs_node_t* node, uint64_t index, paddr_t page) {
+    uint8_t* data = (uint8_t*)page;
+    ssize_t n = 0;
+
+    if (node->file_ops && node->file_ops->read && index * PAGE_SIZE < node->size) {
+        n = node->file_ops->read(node, data, PAGE_SIZE, index * PAGE_SIZE);
+        if (n < 0) {
+            return (status_t)n;
+        }
+    }
+
+    for (size_t i = (size_t)n; i < PAGE_SIZE; i++) {
+        data[i] = 0;
+    }
+    return STATUS_OK;
+}
+
+/* Insert a page; returns the entry (existing if someone raced us), NULL if full */
+static page_cache_entry_t* cache_insert(vfs_node_t* node, uint64_t index, paddr_t page,
+                                        bool readahead, bool* out_raced) {
+    vfs_node_t* evicted = NULL;
+
+    cache_acquire();
+
+    page_cache_entry_t* entry = cache_find(node, index);
+    *out_raced = entry != NULL;
+    if (!entry) {
+        entry = cache_alloc_entry(&evicted);
+        if (entry) {
+            uint32_t bucket = cache_bucket(node, index);
+            entry->node = node;
+            entry->index = index;
+            entry->page = page;
+            entry->maps = 0;
+            entry->referenced = false;
+            entry->readahead = readahead;
+            entry->in_use = true;
+            entry->hash_next = cache_hash[bucket];
+            cache_hash[bucket] = entry;
+            cache_stats.cached++;
+            vfs_node_ref(node);
+        }
+    }
+
+    cache_release();
+
+    if (evicted) {
+        vfs_node_unref(evicted);
+    }
+    return entry;
+}
+
+/*
+ * Read missing pages [index, index + count) into the cache, in one request
+ * when the file system takes vectors; caller does not hold the lock. Returns
+ * how many of them are now cached, or a negative status if none are.
+ */
+static ssize_t cache_read_run(vfs_node_t* node, uint64_t index, uint32_t count, bool readahead) {
+    paddr_t pages[PAGE_CACHE_BATCH];
+    vfs_iovec_t iov[PAGE_CACHE_BATCH];
+    uint32_t allocated = 0;
+    uint32_t filled = 0;
+    status_t status = STATUS_OK;
+
+    count = MIN(count, (uint32_t)PAGE_CACHE_BATCH);
+    for (; allocated < count; allocated++) {
+        pages[allocated] = pmm_alloc_page();
+        if (!pages[allocated]) {
+            status = STATUS_NOMEM;
+            break;
+        }
+        iov[allocated].base = (void*)pages[allocated];
+        iov[allocated].len = PAGE_SIZE;
+    }
+
+    uint64_t offset = index * PAGE_SIZE;
+    if (allocated > 1 && node->file_ops && node->file_ops->readv && offset < node->size) {
+        ssize_t n = node->file_ops->readv(node, iov, allocated, offset);
+        if (n < 0) {
+            status = (status_t)n;
+        } else {
+            /* A short read ends at EOF; the rest reads as zero */
+            for (size_t i = (size_t)n; i < (size_t)allocated * PAGE_SIZE; i++) {
+                ((uint8_t*)pages[i / PAGE_SIZE])[i % PAGE_SIZE] = 0;
+            }
+            filled = allocated;
+        }
+    } else {
+        for (; filled < allocated; filled++) {
+            status_t fill = cache_fill(node, index + filled, pages[filled]);
+            if (FAILED(fill)) {
+                status = fill;
+                break;
+            }
+        }
+    }
+
+    /* Insert the filled prefix; a full cache stops it like a failed read */
+    uint32_t inserted = 0;
+    for (uint32_t i = 0; i < allocated; i++) {
+        bool raced = false;
+        if (i == inserted && i < filled) {
+            if (cache_insert(node, index + i, pages[i], readahead, &raced)) {
+                inserted++;
+                if (!raced) {
+                    continue;
+                }
+            } else {
+                status = STATUS_NOMEM;
+            }
+        }
+        pmm_free_page(pages[i]);
+    }
+
+    return inserted ? (ssize_t)inserted : (ssize_t)status;
+}
+
+/*
+ * Read the missing pages of [index, index + count), batching runs of them;
+ * returns the pages read and sets *out_cached to the pages now cached.
+ */
+static uint32_t cache_read_range(vfs_node_t* node, uint64_t index, uint32_t count,
+                                 bool readahead, uint32_t* out_cached) {
+    uint64_t last = (node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t end = MIN(index + count, last);
+    uint32_t cached = 0;
+    uint32_t read = 0;
+
+    for (uint64_t i = index; i < end;) {
+        /* Extend over the missing pages that follow */
+        uint32_t run = 0;
+        cache_acquire();
+        while (i + run < end && run < PAGE_CACHE_BATCH && !cache_find(node, i + run)) {
+            run++;
+        }
+        cache_release();
+
+        if (run == 0) {
+            cached++;
+            i++;
+            continue;
+        }
+
+        ssize_t n = cache_read_run(node, i, run, readahead);
+        if (n <= 0) {
+            break;
+        }
+        read += (uint32_t)n;
+        cached += (uint32_t)n;
+        i += (uint64_t)n;
+        if ((uint32_t)n < run) {
+            break;
+        }
+    }
+
+    if (out_cached) {
+        *out_cached = cached;
+    }
+    return read;
+}
+
+/* First access to a read-ahead page; caller holds the lock */
+static ALWAYS_INLINE void cache_touch(page_cache_entry_t* entry) {
+    entry->referenced = true;
+    if (entry->readahead) {
+        entry->readahead = false;
+        cache_stats.readahead_used++;
+    }
+}
+
+/* Take a map reference on a cached page; returns 0 if not cached */
+static paddr_t cache_map(vfs_node_t* node, uint64_t index, bool count_hit) {
+    paddr_t page = 0;
+
+    cache_acquire();
+    page_cache_entry_t* entry = cache_find(node, index);
+    if (entry) {
+        if (entry->maps++ == 0) {
+            cache_stats.mapped++;
+        }
+        cache_touch(entry);
+        if (count_hit) {
+            cache_stats.hits++;
+        }
+        page = entry->page;
+    }
+    cache_release();
+
+    return page;
+}
+
+status_t page_cache_get(vfs_node_t* node, uint64_t index, paddr_t* out_page) {
+    if (!node || !out_page) {
+        return STATUS_INVALID;
+    }
+
+    paddr_t page = cache_map(node, index, true);
+    if (!page) {
+        __sync_fetch_and_add(&cache_stats.misses, 1);
+        ssize_t n = cache_read_run(node, index, 1, false);
+        if (n < 0) {
+            return (status_t)n;
+        }
+        /* Evicted again before we could map it means the cache is full of mapped pages */
+        page = cache_map(node, index, false);
+        if (!page) {
+            return STATUS_NOMEM;
+        }
+    }
+
+    *out_page = page;
+    return STATUS_OK;
+}
+
+paddr_t page_cache_lookup(vfs_node_t* node, uint64_t index) {
+    return node ? cache_map(node, index, true) : 0;
+}
+
+void page_cache_put(vfs_node_t* node, uint64_t index) {
+    cache_acquire();
+    page_cache_entry_t* entry = cache_find(node, index);
+    if (entry && entry->maps && --entry->maps == 0) {
+        cache_stats.mapped--;
+    }
+    cache_release();
+}
+
+uint32_t page_cache_readahead(vfs_node_t* node, uint64_t index, uint32_t count) {
+    if (!node) {
+        return 0;
+    }
+
+    uint32_t cached;
+    uint32_t read = cache_read_range(node, index, count, true, &cached);
+    __sync_fetch_and_add(&cache_stats.readahead, read);
+    return cached;
+}
+
+uint32_t page_cache_ra_access(vfs_node_t* node, ra_state_t* ra, uint64_t index, uint32_t count) {
+    if (!node || !ra) {
+        return 0;
+    }
+
+    cache_acquire();
+    bool cached = cache_find(node, index) != NULL;
+    cache_release();
+
+    ra_run_t runs[RA_MAX_RUNS];
+    uint64_t pages = (node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t n = ra_access(ra, index, count, pages, cached, runs);
+
+    uint32_t read = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        read += cache_read_range(node, runs[i].index, runs[i].count, true, NULL);
+    }
+
+    ra->stats.prefetched += read;
+    __sync_fetch_and_add(&cache_stats.readahead, read);
+    return read;
+}
+
+ssize_t page_cache_read(vfs_node_t* node, void* buffer, size_t size, uint64_t offset) {
+    if (!node || (!buffer && size)) {
+        return STATUS_INVALID;
+    }
+
+    uint8_t* dst = (uint8_t*)buffer;
+    size_t done = 0;
+    bool filled = false;
+
+    while (done < size) {
+        uint64_t pos = offset + done;
+        uint64_t index = pos / PAGE_SIZE;
+        size_t skip = (size_t)(pos % PAGE_SIZE);
+        size_t chunk = MIN(size - done, PAGE_SIZE - skip);
+
+        cache_acquire();
+        page_cache_entry_t* entry = cache_find(node, index);
+        if (entry) {
+            memcpy(dst + done, (const uint8_t*)entry->page + skip, chunk);
+            cache_touch(entry);
+            if (!filled) {
+                cache_stats.hits++;
+            }
+        }
+        cache_release();
+
+        if (entry) {
+            done += chunk;
+            filled = false;
+            continue;
+        }
+
+        /* Still missing right after a fill: the cache is full of mapped pages */
+        if (filled) {
+            ssize_t n = node->file_ops && node->file_ops->read ?
+                        node->file_ops->read(node, dst + done, chunk, pos) : 0;
+            if (n <= 0) {
+                return done ? (ssize_t)done : n;
+            }
+            done += (size_t)n;
+            filled = false;
+            continue;
+        }
+
+        /* Read the rest of the request's missing pages together */
+        uint64_t end = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+        uint32_t count = (uint32_t)MIN(end - index, (uint64_t)PAGE_CACHE_BATCH);
+        uint32_t read = cache_read_range(node, index, count, false, NULL);
+        __sync_fetch_and_add(&cache_stats.misses, read);
+        filled = true;
+    }
+
+    return (ssize_t)done;
+}
+
+void page_cache_refresh(vfs_node_t* node, uint64_t offset, uint64_t len) {
+    if (!node || len == 0 || cache_stats.cached == 0) {
+        return;
+    }
+
+    uint64_t first = offset / PAGE_SIZE;
+    uint64_t last = (offset + MIN(len, UINT64_MAX - offset) - 1) / PAGE_SIZE;
+
+    /* Mapped pages are updated in place so every mapping sees the write */
+    cache_acquire();
+    if (last - first < PAGE_CACHE_PAGES) {
+        for (uint64_t i = first; i <= last; i++) {
+            page_cache_entry_t* entry = cache_find(node, i);
+            if (entry) {
+                cache_fill(node, i, entry->page);
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < PAGE_CACHE_PAGES; i++) {
+            page_cache_entry_t* entry = &cache_entries[i];
+            if (entry->in_use && entry->node == node && entry->index >= first &&
+                entry->index <= last) {
+                cache_fill(node, entry->index, entry->page);
+            }
+        }
+    }
+    cache_release();
+}
+
+void page_cache_drop(vfs_node_t* node, uint64_t index, uint64_t count) {
+    if (!node) {
+        return;
+    }
+
+    uint64_t end = count ? index + count : UINT64_MAX;
+    uint32_t dropped = 0;
+
+    cache_acquire();
+    for (uint32_t i = 0; i < PAGE_CACHE_PAGES; i++) {
+        page_cache_entry_t* entry = &cache_entries[i];
+        if (entry->in_use && entry->node == node && entry->index >= index &&
+            entry->index < end && entry->maps == 0) {
+            cache_remove(entry);
+            dropped++;
+        }
+    }
+    cache_release();
+
+    /* Each page held its own reference; the node outlives the loop via the caller's */
+    while (dropped--) {
+        vfs_node_unref(node);
+    }
+}
+
+void page_cache_get_stats(page_cache_stats_t* stats) {
+    if (stats) {
+        cache_acquire();
+        *stats = cache_stats;
+        cache_release();
+    }
+}
@@ -399,7 +399,7 @@ status_t pe_apply_relocations(pe_context_t* ctx, uintptr_t new_base) {
     return STATUS_OK;
 }
 
-/* Resolve imports (stub - requires DLL loading) */
+/* Resolve imports (DLLs are loaded and bound by the Win32 persona) */
 status_t pe_resolve_imports(pe_context_t* ctx) {
     if (!ctx) {
         return STATUS_INVALID;
@@ -423,8 +423,7 @@ status_t pe_resolve_imports(pe_context_t* ctx) {
         return STATUS_OK;  // No imports
     }
 
-    /* Note: Full import resolution requires DLL loading and symbol lookup */
-    /* This is a placeholder for the Win32 persona layer */
+    /* The persona's loader (win32_loader.c) maps each DLL and fills the IAT */
 
     KLOG_DEBUG("PE", "Import resolution deferred to Win32 persona");
 
@@ -10,9 +10,86 @@
 #include "elf.h"
 #include "vfs.h"
 
+extern uint64_t perf_cycles(void);
+
 /* Global process manager */
 static process_manager_t process_manager = {0};
 
+/* Pending state-change reports (process_t.report) */
+#define PROCESS_REPORT_STOPPED    1
+#define PROCESS_REPORT_CONTINUED  2
+
+/* Process handles and the event queues they can be registered with */
+#define PROCESS_MAX_PIDFDS   1024
+#define PROCESS_MAX_EVQS     64
+#define PIDFD_MAX_WATCH      4
+#define EVQ_MAX_EVENTS       256
+
+struct process_pidfd {
+    pid_t pid;
+    process_t* process;        // NULL once the process has been reaped
+    uint32_t refs;             // File descriptors referring to this handle
+    bool exited;
+    struct list_head node;     // On process->pidfds
+    struct {
+        process_evq_t* evq;    // NULL = free slot
+        uint64_t cookie;
+    } watch[PIDFD_MAX_WATCH];
+    bool in_use;
+};
+
+struct process_evq {
+    wait_queue_t waiters;
+    process_event_t ready[EVQ_MAX_EVENTS];
+    uint32_t head;
+    uint32_t count;
+    uint32_t registered;       // Watches yet to fire; count + registered never exceeds the ring
+    bool in_use;
+};
+
+static process_pidfd_t pidfd_pool[PROCESS_MAX_PIDFDS];
+static process_evq_t evq_pool[PROCESS_MAX_EVQS];
+
+static ALWAYS_INLINE void wait_lock(void) {
+    while (__sync_lock_test_and_set(&process_manager.wait_lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+static ALWAYS_INLINE void wait_unlock(void) {
+    __sync_lock_release(&process_manager.wait_lock);
+}
+
+/* PID hash; caller holds process_manager.lock */
+static void pid_hash_insert(process_t* process) {
+    uint32_t bucket = (uint32_t)(process->pid % PROCESS_PID_HASH);
+    process->hash_next = process_manager.pid_hash[bucket];
+    process_manager.pid_hash[bucket] = process;
+}
+
+static void pid_hash_remove(process_t* process) {
+    process_t** link = &process_manager.pid_hash[process->pid % PROCESS_PID_HASH];
+    while (*link) {
+        if (*link == process) {
+            *link = process->hash_next;
+            process->hash_next = NULL;
+            return;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+/* Return a process slot to the free pool */
+static void process_free_slot(process_t* process) {
+    __sync_lock_test_and_set(&process_manager.lock, 1);
+    list_del(&process->list_node);
+    pid_hash_remove(process);
+    process_manager.process_count--;
+    process->state = PROCESS_STATE_DEAD;
+    process->in_use = false;
+    __sync_lock_release(&process_manager.lock);
+}
+
 /* Helper: Memory copy */
 static UNUSED void process_memcpy(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
@@ -169,8 +246,18 @@ status_t process_create(process_t** out_process) {
     /* Set working directory to root */
     process_strcpy(process->cwd, "/", VFS_MAX_PATH);
 
+    /* Wait state */
+    wait_queue_init(&process->child_waiters);
+    list_init(&process->zombies);
+    list_init(&process->reports);
+    list_init(&process->zombie_node);
+    list_init(&process->report_node);
+    list_init(&process->pidfds);
+    wait_queue_init(&process->vfork_waiters);
+
     /* Add to process list */
     list_add(&process->list_node, &process_manager.process_list);
+    pid_hash_insert(process);
     process_manager.process_count++;
 
     __sync_lock_release(&process_manager.lock);
@@ -180,13 +267,29 @@ status_t process_create(process_t** out_process) {
     return STATUS_OK;
 }
 
-/* Fork process (duplicate) */
-status_t process_fork(process_t* parent, process_t** out_child) {
-    if (!parent || !out_child) {
-        return STATUS_INVALID;
+/* Undo process_create_child() for a child nobody has seen yet */
+static void process_discard_child(process_t* child) {
+    for (uint32_t i = 0; i < PROCESS_MAX_FDS; i++) {
+        if (child->fds[i].in_use) {
+            process_fd_free(child, i);
+        }
     }
 
-    /* Create new process */
+    if (child->aspace && !(child->flags & PROCESS_FLAG_VFORK)) {
+        vmm_destroy_address_space(child->aspace);
+    }
+    child->aspace = NULL;
+
+    if (child->elf_ctx) {
+        elf_free_context(child->elf_ctx);
+        child->elf_ctx = NULL;
+    }
+
+    process_free_slot(child);
+}
+
+/* Create a child inheriting everything from parent except memory */
+static status_t process_create_child(process_t* parent, process_t** out_child) {
     process_t* child = NULL;
     status_t status = process_create(&child);
     if (FAILED(status)) {
@@ -207,16 +310,6 @@ status_t process_fork(process_t* parent, process_t** out_child) {
     /* Copy working directory */
     process_strcpy(child->cwd, parent->cwd, VFS_MAX_PATH);
 
-    /* Copy address space (COW would be implemented here) */
-    if (parent->aspace) {
-        status = process_copy_address_space(parent->aspace, &child->aspace);
-        if (FAILED(status)) {
-            child->in_use = false;
-            process_manager.process_count--;
-            return status;
-        }
-    }
-
     /* Copy heap information */
     child->heap_start = parent->heap_start;
     child->heap_end = parent->heap_end;
@@ -225,14 +318,35 @@ status_t process_fork(process_t* parent, process_t** out_child) {
     /* Clone file descriptors */
     status = process_fd_clone_all(parent, child);
     if (FAILED(status)) {
-        if (child->aspace) {
-            vmm_destroy_address_space(child->aspace);
-        }
-        child->in_use = false;
-        process_manager.process_count--;
+        process_discard_child(child);
+        return status;
+    }
+
+    *out_child = child;
+    return STATUS_OK;
+}
+
+/* Fork process (duplicate) */
+status_t process_fork(process_t* parent, process_t** out_child) {
+    if (!parent || !out_child) {
+        return STATUS_INVALID;
+    }
+
+    process_t* child = NULL;
+    status_t status = process_create_child(parent, &child);
+    if (FAILED(status)) {
         return status;
     }
 
+    /* Copy address space (COW would be implemented here) */
+    if (parent->aspace) {
+        status = process_copy_address_space(parent->aspace, &child->aspace);
+        if (FAILED(status)) {
+            process_discard_child(child);
+            return status;
+        }
+    }
+
     /* Add child to parent's child list */
     process_add_child(parent, child->pid);
 
@@ -244,6 +358,191 @@ status_t process_fork(process_t* parent, process_t** out_child) {
     return STATUS_OK;
 }
 
+/* vfork: share the parent's address space instead of copying it */
+status_t process_vfork(process_t* parent, process_t** out_child) {
+    if (!parent || !out_child) {
+        return STATUS_INVALID;
+    }
+
+    process_t* child = NULL;
+    status_t status = process_create_child(parent, &child);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    child->aspace = parent->aspace;
+    child->flags |= PROCESS_FLAG_VFORK;
+
+    status = process_add_child(parent, child->pid);
+    if (FAILED(status)) {
+        process_discard_child(child);
+        return status;
+    }
+
+    child->state = PROCESS_STATE_READY;
+
+    *out_child = child;
+    KLOG_DEBUG("PROCESS", "vfork: parent PID %d -> child PID %d", parent->pid, child->pid);
+    return STATUS_OK;
+}
+
+/* Give a vfork child's borrowed address space back to the parent */
+static void process_vfork_release(process_t* child) {
+    wait_lock();
+    if (child->flags & PROCESS_FLAG_VFORK) {
+        child->flags &= ~PROCESS_FLAG_VFORK;
+        child->aspace = NULL;
+        wait_queue_wake_all(&child->vfork_waiters);
+    }
+    wait_unlock();
+}
+
+/* Block the parent until a vfork child has exec'd or exited */
+status_t process_vfork_wait(process_t* child) {
+    if (!child) {
+        return STATUS_INVALID;
+    }
+
+    wait_lock();
+    while (child->flags & PROCESS_FLAG_VFORK) {
+        if (FAILED(wait_queue_sleep(&child->vfork_waiters, &process_manager.wait_lock))) {
+            wait_unlock();
+            return STATUS_BUSY;
+        }
+    }
+    wait_unlock();
+    return STATUS_OK;
+}
+
+/* Put an open file at a specific descriptor, closing what was there */
+static void process_fd_install(process_t* process, int fd, void* file, uint32_t flags) {
+    if (process->fds[fd].in_use) {
+        process_fd_free(process, fd);
+    }
+
+    process->fds[fd].file = file;
+    process->fds[fd].flags = flags;
+    process->fds[fd].ref_count = 1;
+    process->fds[fd].in_use = true;
+    process->fd_count++;
+}
+
+/* Apply posix_spawn file actions and attributes to a child not yet running */
+static status_t process_spawn_setup(process_t* child, const process_spawn_attr_t* attr) {
+    for (uint32_t i = 0; i < attr->action_count; i++) {
+        const process_spawn_action_t* action = &attr->actions[i];
+        status_t status;
+
+        switch (action->type) {
+        case PROCESS_SPAWN_OPEN: {
+            if (action->fd < 0 || action->fd >= PROCESS_MAX_FDS || !action->path) {
+                return STATUS_INVALID;
+            }
+            vfs_file_t* file = NULL;
+            status = vfs_open(action->path, action->oflags, action->mode, &file);
+            if (FAILED(status)) {
+                return status;
+            }
+            process_fd_install(child, action->fd, file, action->oflags);
+            break;
+        }
+
+        case PROCESS_SPAWN_CLOSE:
+            status = process_fd_free(child, action->fd);
+            if (FAILED(status)) {
+                return status;
+            }
+            break;
+
+        case PROCESS_SPAWN_DUP2:
+            if (action->newfd < 0 || action->newfd >= PROCESS_MAX_FDS ||
+                !process_fd_get(child, action->fd)) {
+                return STATUS_INVALID;
+            }
+            if (action->fd != action->newfd) {
+                status = process_fd_dup(child, action->fd, action->newfd);
+                if (FAILED(status)) {
+                    return status;
+                }
+            }
+            break;
+
+        case PROCESS_SPAWN_CHDIR: {
+            vfs_stat_t stat;
+            if (!action->path) {
+                return STATUS_INVALID;
+            }
+            status = vfs_stat(action->path, &stat);
+            if (FAILED(status)) {
+                return status;
+            }
+            if (stat.type != VFS_TYPE_DIR) {
+                return STATUS_INVALID;
+            }
+            process_strcpy(child->cwd, action->path, VFS_MAX_PATH);
+            break;
+        }
+
+        default:
+            return STATUS_INVALID;
+        }
+    }
+
+    if (attr->flags & PROCESS_SPAWN_SETPGROUP) {
+        child->pgid = attr->pgid ? attr->pgid : child->pid;
+    }
+
+    if (attr->flags & PROCESS_SPAWN_RESETIDS) {
+        child->euid = child->uid;
+        child->egid = child->gid;
+    }
+
+    return STATUS_OK;
+}
+
+/* Create a child running path without duplicating the parent's memory */
+status_t process_spawn(process_t* parent, const char* path, char* const argv[], char* const envp[],
+                       const process_spawn_attr_t* attr, process_t** out_child) {
+    if (!parent || !path || !out_child) {
+        return STATUS_INVALID;
+    }
+
+    if (parent->child_count >= PROCESS_MAX_CHILDREN) {
+        return STATUS_NOMEM;
+    }
+
+    process_t* child = NULL;
+    status_t status = process_create_child(parent, &child);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    if (attr) {
+        status = process_spawn_setup(child, attr);
+        if (FAILED(status)) {
+            process_discard_child(child);
+            return status;
+        }
+    }
+
+    /* The child starts with no address space, so exec has nothing to tear down */
+    status = process_exec(child, path, argv, envp);
+    if (FAILED(status)) {
+        process_discard_child(child);
+        return status;
+    }
+
+    status = process_add_child(parent, child->pid);
+    if (FAILED(status)) {
+        process_discard_child(child);
+        return status;
+    }
+
+    *out_child = child;
+    KLOG_INFO("PROCESS", "Spawned %s: parent PID %d -> child PID %d", path, parent->pid, child->pid);
+    return STATUS_OK;
+}
+
 /* Execute new program */
 status_t process_exec(process_t* process, const char* path, char* const argv[], char* const envp[]) {
     if (!process || !path) {
@@ -294,8 +593,10 @@ status_t process_exec(process_t* process, const char* path, char* const argv[],
         return status;
     }
 
-    /* Destroy old address space if exists */
-    if (process->aspace) {
+    /* Destroy old address space if exists; a vfork child hands it back instead */
+    if (process->flags & PROCESS_FLAG_VFORK) {
+        process_vfork_release(process);
+    } else if (process->aspace) {
         vmm_destroy_address_space(process->aspace);
         process->aspace = NULL;
     }
@@ -365,8 +666,112 @@ status_t process_exec(process_t* process, const char* path, char* const argv[],
     return STATUS_OK;
 }
 
-/* Exit process */
-status_t process_exit(process_t* process, int exit_code) {
+/* Queue an event on an event queue; caller holds the wait lock */
+static void evq_push(process_evq_t* evq, uint64_t cookie, pid_t pid) {
+    if (evq->count < EVQ_MAX_EVENTS) {
+        process_event_t* ev = &evq->ready[(evq->head + evq->count) % EVQ_MAX_EVENTS];
+        ev->cookie = cookie;
+        ev->pid = pid;
+        evq->count++;
+    }
+    wait_queue_wake_all(&evq->waiters);
+}
+
+/* Fire every pidfd watching an exited process; caller holds the wait lock */
+static void pidfd_notify_exit(process_t* process) {
+    struct list_head* pos;
+    list_for_each(pos, &process->pidfds) {
+        process_pidfd_t* pidfd = list_entry(pos, process_pidfd_t, node);
+        pidfd->exited = true;
+
+        for (uint32_t i = 0; i < PIDFD_MAX_WATCH; i++) {
+            process_evq_t* evq = pidfd->watch[i].evq;
+            if (evq) {
+                pidfd->watch[i].evq = NULL;
+                evq->registered--;
+                evq_push(evq, pidfd->watch[i].cookie, pidfd->pid);
+            }
+        }
+    }
+}
+
+/* Free everything a zombie still holds; caller holds the wait lock */
+static void process_release(process_t* process) {
+    struct list_head* pos;
+    struct list_head* n;
+
+    /* Open pidfds outlive the process; they now only remember that it exited */
+    list_for_each_safe(pos, n, &process->pidfds) {
+        process_pidfd_t* pidfd = list_entry(pos, process_pidfd_t, node);
+        pidfd->process = NULL;
+        list_del(&pidfd->node);
+    }
+
+    list_del(&process->zombie_node);
+    list_del(&process->report_node);
+
+    if (process->aspace) {
+        vmm_destroy_address_space(process->aspace);
+        process->aspace = NULL;
+    }
+
+    if (process->elf_ctx) {
+        elf_free_context(process->elf_ctx);
+        process->elf_ctx = NULL;
+    }
+
+    process_free_slot(process);
+}
+
+/* Queue a stop/continue report for the parent; caller holds the wait lock */
+static void process_report(process_t* process, uint8_t report, int wait_status) {
+    process->wait_status = wait_status;
+    process->report = report;
+    list_del(&process->report_node);
+
+    process_t* parent = process_find_by_pid(process->parent_pid);
+    if (parent) {
+        list_add(&process->report_node, parent->reports.prev);
+        wait_queue_wake_all(&parent->child_waiters);
+    }
+}
+
+/* Hand an exiting process's children to init; caller holds the wait lock */
+static void process_reparent_children(process_t* process) {
+    process_t* init = process_find_by_pid(1);
+    if (init == process) {
+        init = NULL;
+    }
+
+    for (uint32_t i = 0; i < process->child_count; i++) {
+        process_t* child = process_find_by_pid(process->children[i]);
+        if (!child) {
+            continue;
+        }
+
+        list_del(&child->report_node);
+        child->report = 0;
+
+        if (init && SUCCESS(process_add_child(init, child->pid))) {
+            child->parent_pid = init->pid;
+            if (child->state == PROCESS_STATE_ZOMBIE) {
+                list_del(&child->zombie_node);
+                list_add(&child->zombie_node, init->zombies.prev);
+                wait_queue_wake_all(&init->child_waiters);
+            }
+        } else {
+            /* Nobody left to wait for it */
+            child->parent_pid = 0;
+            if (child->state == PROCESS_STATE_ZOMBIE) {
+                process_release(child);
+            }
+        }
+    }
+    process->child_count = 0;
+}
+
+/* Terminate a process with the given wait status */
+static status_t process_terminate(process_t* process, int exit_code, int wait_status) {
     if (!process) {
         return STATUS_INVALID;
     }
@@ -375,9 +780,6 @@ status_t process_exit(process_t* process, int exit_code) {
 
     __sync_lock_test_and_set(&process->lock, 1);
 
-    process->state = PROCESS_STATE_ZOMBIE;
-    process->exit_code = exit_code;
-
     /* Close all file descriptors */
     for (uint32_t i = 0; i < PROCESS_MAX_FDS; i++) {
         if (process->fds[i].in_use) {
@@ -392,100 +794,179 @@ status_t process_exit(process_t* process, int exit_code) {
         }
     }
 
-    /* Reparent children to init (PID 1) */
-    for (uint32_t i = 0; i < process->child_count; i++) {
-        process_t* child = process_find_by_pid(process->children[i]);
-        if (child) {
-            child->parent_pid = 1;
-        }
+    __sync_lock_release(&process->lock);
+
+    wait_lock();
+
+    if (process->state == PROCESS_STATE_ZOMBIE || process->state == PROCESS_STATE_DEAD) {
+        wait_unlock();
+        return STATUS_INVALID;
     }
 
-    __sync_lock_release(&process->lock);
+    process->state = PROCESS_STATE_ZOMBIE;
+    process->exit_code = exit_code;
 
-    /* If no parent, directly free resources */
-    process_t* parent = process_find_by_pid(process->parent_pid);
-    if (!parent) {
-        /* Free address space */
-        if (process->aspace) {
-            vmm_destroy_address_space(process->aspace);
-            process->aspace = NULL;
-        }
+    /* A vfork child must not take the parent's memory with it */
+    if (process->flags & PROCESS_FLAG_VFORK) {
+        process->flags &= ~PROCESS_FLAG_VFORK;
+        process->aspace = NULL;
+        wait_queue_wake_all(&process->vfork_waiters);
+    }
 
-        /* Free ELF context */
-        if (process->elf_ctx) {
-            elf_free_context(process->elf_ctx);
-            process->elf_ctx = NULL;
-        }
+    process->wait_status = wait_status;
+    process->flags &= ~PROCESS_FLAG_STOPPED;
+    list_del(&process->report_node);
+    process->report = 0;
+
+    process_reparent_children(process);
+    pidfd_notify_exit(process);
 
-        process->state = PROCESS_STATE_DEAD;
+    /* Queue the zombie for the parent, or free it now if there is none */
+    process_t* parent = process_find_by_pid(process->parent_pid);
+    if (parent && parent != process) {
+        list_add(&process->zombie_node, parent->zombies.prev);
+        wait_queue_wake_all(&parent->child_waiters);
+    } else {
+        process_release(process);
     }
 
+    wait_unlock();
     return STATUS_OK;
 }
 
-/* Wait for child process */
-status_t process_wait(process_t* parent, pid_t child_pid, int* status, uint32_t options) {
+/* Exit process */
+status_t process_exit(process_t* process, int exit_code) {
+    return process_terminate(process, exit_code, PROCESS_STATUS_EXITED(exit_code));
+}
+
+/* Whether a pending stop/continue report matches the wait options */
+static bool process_report_wanted(const process_t* child, uint32_t options) {
+    return (child->report == PROCESS_REPORT_STOPPED && (options & PROCESS_WUNTRACED)) ||
+           (child->report == PROCESS_REPORT_CONTINUED && (options & PROCESS_WCONTINUED));
+}
+
+/*
+ * Wait for a child to exit (or, with WUNTRACED/WCONTINUED, to stop or
+ * continue). Blocks on the parent's wait queue until process_exit() or a
+ * stop/continue report wakes it; with WNOHANG returns STATUS_BUSY when
+ * children exist but none has changed state.
+ */
+status_t process_wait(process_t* parent, pid_t child_pid, int* status, uint32_t options,
+                      pid_t* out_pid) {
     if (!parent) {
         return STATUS_INVALID;
     }
 
-    /* Find zombie child */
-    process_t* child = NULL;
+    wait_lock();
 
-    if (child_pid > 0) {
-        /* Wait for specific child */
-        child = process_find_by_pid(child_pid);
-        if (!child || child->parent_pid != parent->pid) {
-            return STATUS_NOTFOUND;
-        }
+    for (;;) {
+        process_t* child = NULL;
 
-        if (child->state != PROCESS_STATE_ZOMBIE) {
-            return STATUS_INVALID;  // Would block in real implementation
+        if (child_pid != PID_INVALID) {
+            /* Wait for specific child */
+            child = process_find_by_pid(child_pid);
+            if (!child || child->parent_pid != parent->pid) {
+                wait_unlock();
+                return STATUS_NOTFOUND;
+            }
+            if (child->state != PROCESS_STATE_ZOMBIE && !process_report_wanted(child, options)) {
+                child = NULL;
+            }
+        } else {
+            /* Wait for any child: the oldest zombie, then the oldest wanted report */
+            if (parent->child_count == 0) {
+                wait_unlock();
+                return STATUS_NOTFOUND;
+            }
+            if (!list_empty(&parent->zombies)) {
+                child = list_entry(parent->zombies.next, process_t, zombie_node);
+            } else if (options & (PROCESS_WUNTRACED | PROCESS_WCONTINUED)) {
+                struct list_head* pos;
+                list_for_each(pos, &parent->reports) {
+                    process_t* candidate = list_entry(pos, process_t, report_node);
+                    if (process_report_wanted(candidate, options)) {
+                        child = candidate;
+                        break;
+                    }
+                }
+            }
         }
-    } else {
-        /* Wait for any child */
-        for (uint32_t i = 0; i < parent->child_count; i++) {
-            process_t* candidate = process_find_by_pid(parent->children[i]);
-            if (candidate && candidate->state == PROCESS_STATE_ZOMBIE) {
-                child = candidate;
-                break;
+
+        if (child) {
+            int wait_status = child->wait_status;
+            pid_t pid = child->pid;
+
+            if (child->state == PROCESS_STATE_ZOMBIE) {
+                process_remove_child(parent, pid);
+                process_release(child);
+                process_manager.reaped++;
+                KLOG_DEBUG("PROCESS", "Reaped zombie process PID %d (status 0x%x)", pid, wait_status);
+            } else {
+                list_del(&child->report_node);
+                child->report = 0;
             }
+
+            wait_unlock();
+            if (status) {
+                *status = wait_status;
+            }
+            if (out_pid) {
+                *out_pid = pid;
+            }
+            return STATUS_OK;
         }
 
-        if (!child) {
-            return STATUS_INVALID;  // Would block in real implementation
+        if ((options & PROCESS_WNOHANG) ||
+            FAILED(wait_queue_sleep(&parent->child_waiters, &process_manager.wait_lock))) {
+            wait_unlock();
+            return STATUS_BUSY;
         }
     }
+}
 
-    /* Get exit status */
-    if (status) {
-        *status = child->exit_code;
+/* Stop a process; the parent sees it with PROCESS_WUNTRACED */
+status_t process_stop(process_t* process, int signal) {
+    if (!process) {
+        return STATUS_INVALID;
     }
 
-    /* Remove from parent's child list */
-    process_remove_child(parent, child->pid);
-
-    /* Free child resources */
-    if (child->aspace) {
-        vmm_destroy_address_space(child->aspace);
-        child->aspace = NULL;
+    wait_lock();
+    if (process->state == PROCESS_STATE_ZOMBIE || process->state == PROCESS_STATE_DEAD) {
+        wait_unlock();
+        return STATUS_INVALID;
     }
 
-    if (child->elf_ctx) {
-        elf_free_context(child->elf_ctx);
-        child->elf_ctx = NULL;
+    if (!(process->flags & PROCESS_FLAG_STOPPED)) {
+        process->flags |= PROCESS_FLAG_STOPPED;
+        for (uint32_t i = 0; i < PROCESS_MAX_THREADS; i++) {
+            if (process->threads[i].in_use) {
+                process->threads[i].state = PROCESS_STATE_BLOCKED;
+            }
+        }
+        process_report(process, PROCESS_REPORT_STOPPED, PROCESS_STATUS_STOPPED(signal));
     }
 
-    /* Remove from process list */
-    __sync_lock_test_and_set(&process_manager.lock, 1);
-    list_del(&child->list_node);
-    process_manager.process_count--;
-    __sync_lock_release(&process_manager.lock);
+    wait_unlock();
+    return STATUS_OK;
+}
 
-    child->state = PROCESS_STATE_DEAD;
-    child->in_use = false;
+/* Resume a stopped process; the parent sees it with PROCESS_WCONTINUED */
+status_t process_continue(process_t* process) {
+    if (!process) {
+        return STATUS_INVALID;
+    }
 
-    KLOG_INFO("PROCESS", "Reaped zombie process PID %d (exit code: %d)", child->pid, child->exit_code);
+    wait_lock();
+    if (process->flags & PROCESS_FLAG_STOPPED) {
+        process->flags &= ~PROCESS_FLAG_STOPPED;
+        for (uint32_t i = 0; i < PROCESS_MAX_THREADS; i++) {
+            if (process->threads[i].in_use) {
+                process->threads[i].state = PROCESS_STATE_READY;
+            }
+        }
+        process_report(process, PROCESS_REPORT_CONTINUED, PROCESS_STATUS_CONTINUED);
+    }
+    wait_unlock();
     return STATUS_OK;
 }
 
@@ -496,8 +977,221 @@ status_t process_kill(pid_t pid, int signal) {
         return STATUS_NOTFOUND;
     }
 
-    /* For now, simply exit the process */
-    return process_exit(process, signal);
+    if (signal == PROCESS_SIGSTOP) {
+        return process_stop(process, signal);
+    }
+    if (signal == PROCESS_SIGCONT) {
+        return process_continue(process);
+    }
+
+    /* No signal delivery yet: every other signal terminates */
+    return process_terminate(process, signal, PROCESS_STATUS_SIGNALED(signal));
+}
+
+/* ============================================================================
+ * Process handles (pidfd) and event queues
+ * ============================================================================ */
+
+static void pidfd_get(process_pidfd_t* pidfd) {
+    wait_lock();
+    pidfd->refs++;
+    wait_unlock();
+}
+
+static void pidfd_put(process_pidfd_t* pidfd) {
+    wait_lock();
+    if (--pidfd->refs == 0) {
+        for (uint32_t i = 0; i < PIDFD_MAX_WATCH; i++) {
+            if (pidfd->watch[i].evq) {
+                pidfd->watch[i].evq->registered--;
+                pidfd->watch[i].evq = NULL;
+            }
+        }
+        if (pidfd->process) {
+            list_del(&pidfd->node);
+            pidfd->process = NULL;
+        }
+        pidfd->in_use = false;
+    }
+    wait_unlock();
+}
+
+static process_pidfd_t* pidfd_from_fd(process_t* caller, int fd) {
+    file_descriptor_t* entry = process_fd_get(caller, fd);
+    if (!entry || !(entry->flags & PROCESS_FD_PIDFD)) {
+        return NULL;
+    }
+    return (process_pidfd_t*)entry->file;
+}
+
+/* Open a handle to a live or zombie process */
+status_t process_pidfd_open(process_t* caller, pid_t pid, int* out_fd) {
+    if (!caller || !out_fd) {
+        return STATUS_INVALID;
+    }
+
+    wait_lock();
+
+    process_t* target = process_find_by_pid(pid);
+    if (!target || target->state == PROCESS_STATE_DEAD) {
+        wait_unlock();
+        return STATUS_NOTFOUND;
+    }
+
+    process_pidfd_t* pidfd = NULL;
+    for (uint32_t i = 0; i < PROCESS_MAX_PIDFDS; i++) {
+        if (!pidfd_pool[i].in_use) {
+            pidfd = &pidfd_pool[i];
+            break;
+        }
+    }
+    if (!pidfd) {
+        wait_unlock();
+        return STATUS_NOMEM;
+    }
+
+    process_memset(pidfd, 0, sizeof(*pidfd));
+    pidfd->pid = pid;
+    pidfd->process = target;
+    pidfd->refs = 1;
+    pidfd->exited = target->state == PROCESS_STATE_ZOMBIE;
+    pidfd->in_use = true;
+    list_add(&pidfd->node, &target->pidfds);
+
+    wait_unlock();
+
+    int fd = process_fd_alloc(caller, pidfd, PROCESS_FD_PIDFD);
+    if (fd < 0) {
+        pidfd_put(pidfd);
+        return STATUS_NOMEM;
+    }
+
+    *out_fd = fd;
+    return STATUS_OK;
+}
+
+/* process_wait() on the process a pidfd refers to; it must be the caller's child */
+status_t process_pidfd_wait(process_t* caller, int fd, int* status, uint32_t options) {
+    process_pidfd_t* pidfd = pidfd_from_fd(caller, fd);
+    if (!pidfd) {
+        return STATUS_INVALID;
+    }
+
+    /* Once reaped, the PID may belong to someone else */
+    wait_lock();
+    bool reaped = pidfd->process == NULL;
+    wait_unlock();
+    if (reaped) {
+        return STATUS_NOTFOUND;
+    }
+
+    return process_wait(caller, pidfd->pid, status, options, NULL);
+}
+
+status_t process_evq_create(process_evq_t** out_evq) {
+    if (!out_evq) {
+        return STATUS_INVALID;
+    }
+
+    wait_lock();
+    for (uint32_t i = 0; i < PROCESS_MAX_EVQS; i++) {
+        process_evq_t* evq = &evq_pool[i];
+        if (!evq->in_use) {
+            wait_queue_init(&evq->waiters);
+            evq->head = 0;
+            evq->count = 0;
+            evq->registered = 0;
+            evq->in_use = true;
+            wait_unlock();
+            *out_evq = evq;
+            return STATUS_OK;
+        }
+    }
+    wait_unlock();
+    return STATUS_NOMEM;
+}
+
+void process_evq_destroy(process_evq_t* evq) {
+    if (!evq) {
+        return;
+    }
+
+    wait_lock();
+    for (uint32_t i = 0; i < PROCESS_MAX_PIDFDS && evq->registered; i++) {
+        process_pidfd_t* pidfd = &pidfd_pool[i];
+        for (uint32_t w = 0; pidfd->in_use && w < PIDFD_MAX_WATCH; w++) {
+            if (pidfd->watch[w].evq == evq) {
+                pidfd->watch[w].evq = NULL;
+                evq->registered--;
+            }
+        }
+    }
+    evq->count = 0;
+    evq->in_use = false;
+    wait_unlock();
+}
+
+/* Report the pidfd's process exit on evq once; fires at once if it already exited */
+status_t process_evq_add_pidfd(process_evq_t* evq, process_t* caller, int fd, uint64_t cookie) {
+    process_pidfd_t* pidfd = caller ? pidfd_from_fd(caller, fd) : NULL;
+    if (!evq || !pidfd) {
+        return STATUS_INVALID;
+    }
+
+    wait_lock();
+
+    if (evq->count + evq->registered >= EVQ_MAX_EVENTS) {
+        wait_unlock();
+        return STATUS_NOMEM;
+    }
+
+    if (pidfd->exited) {
+        evq_push(evq, cookie, pidfd->pid);
+        wait_unlock();
+        return STATUS_OK;
+    }
+
+    for (uint32_t i = 0; i < PIDFD_MAX_WATCH; i++) {
+        if (!pidfd->watch[i].evq) {
+            pidfd->watch[i].evq = evq;
+            pidfd->watch[i].cookie = cookie;
+            evq->registered++;
+            wait_unlock();
+            return STATUS_OK;
+        }
+    }
+
+    wait_unlock();
+    return STATUS_NOMEM;
+}
+
+status_t process_evq_wait(process_evq_t* evq, process_event_t* events, uint32_t max,
+                          uint32_t options, uint32_t* out_count) {
+    if (!evq || !events || max == 0 || !out_count) {
+        return STATUS_INVALID;
+    }
+
+    *out_count = 0;
+    wait_lock();
+
+    while (evq->count == 0) {
+        if ((options & PROCESS_WNOHANG) ||
+            FAILED(wait_queue_sleep(&evq->waiters, &process_manager.wait_lock))) {
+            wait_unlock();
+            return STATUS_BUSY;
+        }
+    }
+
+    uint32_t n = 0;
+    while (evq->count && n < max) {
+        events[n++] = evq->ready[evq->head];
+        evq->head = (evq->head + 1) % EVQ_MAX_EVENTS;
+        evq->count--;
+    }
+
+    wait_unlock();
+    *out_count = n;
+    return STATUS_OK;
 }
 
 /* Create thread */
@@ -528,10 +1222,11 @@ status_t thread_create(process_t* process, vaddr_t entry_point, vaddr_t stack_pt
     thread->user_stack = stack_ptr;
     thread->kernel_stack = 0;  // Would allocate kernel stack
     thread->state = PROCESS_STATE_READY;
-    thread->priority = 10;
+    thread->priority = PRIORITY_NORMAL;
     thread->cpu_time = 0;
     thread->process = process;
     thread->in_use = true;
+    sched_init_thread(thread);
 
     process->thread_count++;
 
@@ -548,6 +1243,17 @@ status_t thread_exit(thread_t* thread, int exit_code) {
         return STATUS_INVALID;
     }
 
+    /* Give back any deadline reservation so admission can reuse it */
+    if (thread->dl_runtime) {
+        sched_set_deadline(thread, 0, 0, 0);
+    }
+    /* Release held mutexes to their waiters, then drop what is left of the boost */
+    kmutex_thread_exit(thread);
+    /* Close out any inherited priority so the inversion is accounted */
+    if (thread->pi_donor) {
+        sched_pi_boost(thread, NULL);
+    }
+
     thread->state = PROCESS_STATE_DEAD;
     thread->in_use = false;
     thread->process->thread_count--;
@@ -562,10 +1268,23 @@ status_t thread_exit(thread_t* thread, int exit_code) {
 
 /* Find process by PID */
 process_t* process_find_by_pid(pid_t pid) {
-    for (uint32_t i = 0; i < PROCESS_MAX_COUNT; i++) {
-        if (process_manager.processes[i].in_use &&
-            process_manager.processes[i].pid == pid) {
-            return &process_manager.processes[i];
+    for (process_t* p = process_manager.pid_hash[pid % PROCESS_PID_HASH]; p; p = p->hash_next) {
+        if (p->pid == pid && p->in_use) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Find a live thread of a process by TID */
+thread_t* process_find_thread(process_t* process, tid_t tid) {
+    if (!process || tid == 0) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < PROCESS_MAX_THREADS; i++) {
+        if (process->threads[i].in_use && process->threads[i].tid == tid) {
+            return &process->threads[i];
         }
     }
     return NULL;
@@ -621,7 +1340,9 @@ status_t process_fd_free(process_t* process, int fd) {
     }
 
     /* Close file if this is the last reference */
-    if (process->fds[fd].ref_count == 1 && process->fds[fd].file) {
+    if (process->fds[fd].flags & PROCESS_FD_PIDFD) {
+        pidfd_put((process_pidfd_t*)process->fds[fd].file);
+    } else if (process->fds[fd].ref_count == 1 && process->fds[fd].file) {
         vfs_close((vfs_file_t*)process->fds[fd].file);
     }
 
@@ -665,6 +1386,10 @@ status_t process_fd_dup(process_t* process, int oldfd, int newfd) {
         process_fd_free(process, newfd);
     }
 
+    if (process->fds[oldfd].flags & PROCESS_FD_PIDFD) {
+        pidfd_get((process_pidfd_t*)process->fds[oldfd].file);
+    }
+
     /* Allocate new fd if newfd is -1 */
     if (newfd < 0) {
         newfd = process_fd_alloc(process, process->fds[oldfd].file, process->fds[oldfd].flags);
@@ -675,6 +1400,10 @@ status_t process_fd_dup(process_t* process, int oldfd, int newfd) {
         process->fd_count++;
     }
 
+    if (newfd < 0 && (process->fds[oldfd].flags & PROCESS_FD_PIDFD)) {
+        pidfd_put((process_pidfd_t*)process->fds[oldfd].file);
+    }
+
     __sync_lock_release(&process->lock);
     return (newfd >= 0) ? STATUS_OK : STATUS_NOMEM;
 }
@@ -687,6 +1416,9 @@ status_t process_fd_clone_all(process_t* parent, process_t* child) {
 
     for (int i = 0; i < PROCESS_MAX_FDS; i++) {
         if (parent->fds[i].in_use) {
+            if (parent->fds[i].flags & PROCESS_FD_PIDFD) {
+                pidfd_get((process_pidfd_t*)parent->fds[i].file);
+            }
             child->fds[i] = parent->fds[i];
             child->fds[i].ref_count++;
             child->fd_count++;
@@ -747,7 +1479,11 @@ status_t process_brk(process_t* process, vaddr_t new_brk, vaddr_t* out_brk) {
 
         for (size_t i = 0; i < pages_to_free; i++) {
             vaddr_t vaddr = new_brk_page + (i * PAGE_SIZE);
-            vmm_unmap_page(process->aspace, vaddr);
+            paddr_t paddr;
+            if (SUCCESS(vmm_get_physical(process->aspace, vaddr, &paddr))) {
+                vmm_unmap_page(process->aspace, vaddr);
+                pmm_free_page(PAGE_ALIGN_DOWN(paddr));
+            }
         }
     }
 
@@ -758,6 +1494,92 @@ status_t process_brk(process_t* process, vaddr_t new_brk, vaddr_t* out_brk) {
     return STATUS_OK;
 }
 
+/* Map anonymous memory or a file; pages are faulted in on first touch */
+status_t process_mmap(process_t* process, vaddr_t addr, size_t length, uint32_t prot, uint32_t flags,
+                      int fd, uint64_t offset, vaddr_t* out_addr) {
+    if (!process || !process->aspace || !out_addr || length == 0 ||
+        (offset & (PAGE_SIZE - 1)) || (addr & (PAGE_SIZE - 1))) {
+        return STATUS_INVALID;
+    }
+    if (!(flags & PROCESS_MAP_SHARED) == !(flags & PROCESS_MAP_PRIVATE)) {
+        return STATUS_INVALID;
+    }
+
+    vfs_node_t* node = NULL;
+    if (!(flags & PROCESS_MAP_ANONYMOUS)) {
+        file_descriptor_t* desc = process_fd_get(process, fd);
+        if (!desc || (desc->flags & PROCESS_FD_PIDFD)) {
+            return STATUS_INVALID;
+        }
+        vfs_file_t* file = (vfs_file_t*)desc->file;
+        if ((file->flags & 3) == VFS_O_WRONLY) {
+            return STATUS_DENIED;
+        }
+        node = file->node;
+    }
+
+    uint64_t pte_flags = PTE_USER;
+    if (prot & PROCESS_PROT_WRITE) {
+        pte_flags |= PTE_WRITE;
+    }
+    if (!(prot & PROCESS_PROT_EXEC)) {
+        pte_flags |= PTE_NX;
+    }
+
+    size_t size = PAGE_ALIGN_UP(length);
+    vaddr_t start = addr;
+    if (flags & PROCESS_MAP_FIXED) {
+        if (!addr) {
+            return STATUS_INVALID;
+        }
+        /* MAP_FIXED replaces whatever was there */
+        vmm_remove_range(process->aspace, addr, size);
+    } else {
+        start = vmm_find_free_range(process->aspace, addr ? addr : PROCESS_MMAP_BASE, size);
+        if (addr && start != addr) {
+            start = vmm_find_free_range(process->aspace, PROCESS_MMAP_BASE, size);
+        }
+        if (!start) {
+            return STATUS_NOMEM;
+        }
+    }
+
+    status_t status;
+    if (node) {
+        uint32_t vm_flags = (flags & PROCESS_MAP_SHARED) ? VM_SHARED : 0;
+        status = vmm_add_file_region(process->aspace, start, size, pte_flags, node, offset, vm_flags);
+    } else {
+        status = vmm_add_region(process->aspace, start, size, pte_flags, VM_REGION_MMAP);
+    }
+    if (FAILED(status)) {
+        return status;
+    }
+
+    if (flags & PROCESS_MAP_POPULATE) {
+        /* Like Linux, a partial populate still leaves a valid mapping */
+        vmm_populate(process->aspace, start, size);
+    }
+
+    *out_addr = start;
+    return STATUS_OK;
+}
+
+/* Unmap a range, freeing its pages */
+status_t process_munmap(process_t* process, vaddr_t addr, size_t length) {
+    if (!process || !process->aspace) {
+        return STATUS_INVALID;
+    }
+    return vmm_remove_range(process->aspace, addr, length);
+}
+
+/* Access pattern and lifetime hints for a mapped range */
+status_t process_madvise(process_t* process, vaddr_t addr, size_t length, uint32_t advice) {
+    if (!process || !process->aspace) {
+        return STATUS_INVALID;
+    }
+    return vmm_madvise(process->aspace, addr, length, advice);
+}
+
 /* Copy address space (simple copy, COW would be better) */
 status_t process_copy_address_space(address_space_t* src, address_space_t** out_dest) {
     if (!src || !out_dest) {
@@ -860,13 +1682,19 @@ status_t process_copy_address_space(address_space_t* src, address_space_t** out_
                         dst_ptr[i] = src_ptr[i];
                     }
 
-                    /* Set page table entry */
-                    dst_pt->entries[pt_idx] = dst_page | (pte & 0xFFF);
+                    /* Set page table entry; the copy is private, not a page cache page */
+                    dst_pt->entries[pt_idx] = dst_page | (pte & 0xFFF & ~PTE_CACHED);
                 }
             }
         }
     }
 
+    status = vmm_clone_regions(src, dest);
+    if (FAILED(status)) {
+        vmm_destroy_address_space(dest);
+        return status;
+    }
+
     *out_dest = dest;
     return STATUS_OK;
 }
@@ -946,33 +1774,139 @@ status_t process_remove_child(process_t* parent, pid_t child_pid) {
     return STATUS_OK;
 }
 
-/* Cleanup zombie processes */
-void process_cleanup_zombies(void) {
-    for (uint32_t i = 0; i < PROCESS_MAX_COUNT; i++) {
-        if (process_manager.processes[i].in_use &&
-            process_manager.processes[i].state == PROCESS_STATE_ZOMBIE) {
-
-            process_t* zombie = &process_manager.processes[i];
+/* ============================================================================
+ * Spawn benchmark
+ * ============================================================================ */
+
+#define SPAWN_BENCH_BASE     0x10000000UL
+#define SPAWN_BENCH_FORK     0
+#define SPAWN_BENCH_VFORK    1
+#define SPAWN_BENCH_SPAWN    2
+
+/* vmm_destroy_address_space() only frees page tables; release the frames we mapped */
+static void spawn_bench_free_range(address_space_t* aspace, vaddr_t base, size_t pages) {
+    for (size_t i = 0; i < pages; i++) {
+        paddr_t paddr;
+        if (SUCCESS(vmm_get_physical(aspace, base + i * PAGE_SIZE, &paddr))) {
+            vmm_unmap_page(aspace, base + i * PAGE_SIZE);
+            pmm_free_page(paddr);
+        }
+    }
+}
 
-            /* If parent doesn't exist, clean up immediately */
-            process_t* parent = process_find_by_pid(zombie->parent_pid);
-            if (!parent) {
-                if (zombie->aspace) {
-                    vmm_destroy_address_space(zombie->aspace);
-                    zombie->aspace = NULL;
-                }
+/* One create + exec + reap; returns the cycles spent, excluding frame cleanup */
+static status_t spawn_bench_once(process_t* parent, const char* path, int mode,
+                                 size_t parent_pages, uint64_t* cycles) {
+    char* argv[] = { (char*)path, NULL };
+    char* envp[] = { NULL };
+    process_t* child = NULL;
+    status_t status;
 
-                if (zombie->elf_ctx) {
-                    elf_free_context(zombie->elf_ctx);
-                    zombie->elf_ctx = NULL;
-                }
+    uint64_t start = perf_cycles();
+    uint64_t excluded = 0;
 
-                zombie->state = PROCESS_STATE_DEAD;
-                zombie->in_use = false;
-                process_manager.process_count--;
+    if (mode == SPAWN_BENCH_SPAWN) {
+        status = process_spawn(parent, path, argv, envp, NULL, &child);
+    } else {
+        status = mode == SPAWN_BENCH_FORK ? process_fork(parent, &child)
+                                          : process_vfork(parent, &child);
+        if (SUCCESS(status)) {
+            if (mode == SPAWN_BENCH_FORK && child->aspace) {
+                uint64_t t = perf_cycles();
+                spawn_bench_free_range(child->aspace, SPAWN_BENCH_BASE, parent_pages);
+                excluded += perf_cycles() - t;
             }
+            status = process_exec(child, path, argv, envp);
+            if (FAILED(status)) {
+                process_exit(child, 127);
+            }
+        }
+    }
+    if (FAILED(status)) {
+        if (child) {
+            process_wait(parent, child->pid, NULL, PROCESS_WNOHANG, NULL);
+        }
+        return status;
+    }
+
+    uint64_t t = perf_cycles();
+    if (child->aspace) {
+        spawn_bench_free_range(child->aspace, 0x7FFFFFFFE000UL - 64 * PAGE_SIZE, 64);
+    }
+    excluded += perf_cycles() - t;
+
+    process_exit(child, 0);
+    status = process_wait(parent, child->pid, NULL, PROCESS_WNOHANG, NULL);
+
+    *cycles = perf_cycles() - start - excluded;
+    return status;
+}
+
+/*
+ * Average cycles for fork+exec, vfork+exec and spawn of path (plus exit and
+ * reap) from a parent with parent_pages of touched memory. The ELF image is
+ * read through the VFS on every exec, as it would be for real.
+ */
+status_t process_spawn_benchmark(const char* path, size_t parent_pages, uint32_t iterations,
+                                 process_spawn_bench_result_t* result) {
+    if (!path || !result || iterations == 0) {
+        return STATUS_INVALID;
+    }
+
+    process_t* parent = NULL;
+    status_t status = process_create(&parent);
+    if (FAILED(status)) {
+        return status;
+    }
+    parent->state = PROCESS_STATE_RUNNING;
+
+    status = vmm_create_address_space(&parent->aspace);
+    for (size_t i = 0; SUCCESS(status) && i < parent_pages; i++) {
+        paddr_t paddr = pmm_alloc_page();
+        if (!paddr) {
+            status = STATUS_NOMEM;
+            break;
+        }
+        status = vmm_map_page(parent->aspace, SPAWN_BENCH_BASE + i * PAGE_SIZE, paddr,
+                              PTE_USER | PTE_WRITE);
+        if (FAILED(status)) {
+            pmm_free_page(paddr);
+        }
+    }
+
+    uint64_t totals[3] = {0, 0, 0};
+    for (int mode = 0; SUCCESS(status) && mode < 3; mode++) {
+        for (uint32_t i = 0; SUCCESS(status) && i < iterations; i++) {
+            uint64_t cycles = 0;
+            status = spawn_bench_once(parent, path, mode, parent_pages, &cycles);
+            totals[mode] += cycles;
+        }
+    }
+
+    if (SUCCESS(status)) {
+        result->fork_exec_cycles = totals[SPAWN_BENCH_FORK] / iterations;
+        result->vfork_exec_cycles = totals[SPAWN_BENCH_VFORK] / iterations;
+        result->spawn_cycles = totals[SPAWN_BENCH_SPAWN] / iterations;
+    }
+
+    if (parent->aspace) {
+        spawn_bench_free_range(parent->aspace, SPAWN_BENCH_BASE, parent_pages);
+    }
+    process_exit(parent, 0);
+    return status;
+}
+
+/* Free zombies whose parent is gone (process_exit() normally does this itself) */
+void process_cleanup_zombies(void) {
+    wait_lock();
+    for (uint32_t i = 0; i < PROCESS_MAX_COUNT; i++) {
+        process_t* zombie = &process_manager.processes[i];
+        if (zombie->in_use && zombie->state == PROCESS_STATE_ZOMBIE &&
+            !process_find_by_pid(zombie->parent_pid)) {
+            process_release(zombie);
         }
     }
+    wait_unlock();
 }
 
 /* Get process statistics */
@@ -997,6 +1931,7 @@ status_t process_get_stats(process_stats_t* stats) {
             stats->total_cpu_time += process_manager.processes[i].cpu_time;
         }
     }
+    stats->reaped = process_manager.reaped;
 
     return STATUS_OK;
 }
@@ -0,0 +1,234 @@
+/*
+ * Red-Black Tree
+ * Insert and erase rebalancing (CLRS), with NULL leaves counted as black
+ */
+
+#include "kernel.h"
+#include "rbtree.h"
+
+static void rb_set_child(struct rb_root* root, struct rb_node* parent,
+                         struct rb_node* old, struct rb_node* new_node) {
+    if (!parent) {
+        root->node = new_node;
+    } else if (parent->left == old) {
+        parent->left = new_node;
+    } else {
+        parent->right = new_node;
+    }
+}
+
+static void rb_rotate_left(struct rb_root* root, struct rb_node* node) {
+    struct rb_node* pivot = node->right;
+
+    node->right = pivot->left;
+    if (pivot->left) {
+        pivot->left->parent = node;
+    }
+
+    pivot->parent = node->parent;
+    rb_set_child(root, node->parent, node, pivot);
+
+    pivot->left = node;
+    node->parent = pivot;
+}
+
+static void rb_rotate_right(struct rb_root* root, struct rb_node* node) {
+    struct rb_node* pivot = node->left;
+
+    node->left = pivot->right;
+    if (pivot->right) {
+        pivot->right->parent = node;
+    }
+
+    pivot->parent = node->parent;
+    rb_set_child(root, node->parent, node, pivot);
+
+    pivot->right = node;
+    node->parent = pivot;
+}
+
+static ALWAYS_INLINE bool rb_is_red(const struct rb_node* node) {
+    return node && node->red;
+}
+
+void rb_insert_color(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* parent;
+
+    while ((parent = node->parent) && parent->red) {
+        struct rb_node* gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            struct rb_node* uncle = gparent->right;
+            if (rb_is_red(uncle)) {
+                /* Recolor and continue from the grandparent */
+                uncle->red = false;
+                parent->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_right(root, gparent);
+        } else {
+            struct rb_node* uncle = gparent->left;
+            if (rb_is_red(uncle)) {
+                uncle->red = false;
+                parent->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            rb_rotate_left(root, gparent);
+        }
+    }
+
+    root->node->red = false;
+}
+
+/* Restore black height after removing a black node; child may be NULL */
+static void rb_erase_fixup(struct rb_root* root, struct rb_node* child, struct rb_node* parent) {
+    while (child != root->node && !rb_is_red(child)) {
+        if (child == parent->left) {
+            struct rb_node* sibling = parent->right;
+            if (rb_is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = true;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                rb_rotate_right(root, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            rb_rotate_left(root, parent);
+        } else {
+            struct rb_node* sibling = parent->left;
+            if (rb_is_red(sibling)) {
+                sibling->red = false;
+                parent->red = true;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if (!rb_is_red(sibling->left) && !rb_is_red(sibling->right)) {
+                sibling->red = true;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if (!rb_is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                rb_rotate_left(root, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            rb_rotate_right(root, parent);
+        }
+        child = root->node;
+    }
+
+    if (child) {
+        child->red = false;
+    }
+}
+
+void rb_erase(struct rb_node* node, struct rb_root* root) {
+    struct rb_node* child;
+    struct rb_node* parent;
+    bool removed_red;
+
+    if (node->left && node->right) {
+        /* Replace node with its successor, which has no left child */
+        struct rb_node* successor = node->right;
+        while (successor->left) {
+            successor = successor->left;
+        }
+
+        child = successor->right;
+        parent = successor->parent;
+        removed_red = successor->red;
+
+        if (parent == node) {
+            parent = successor;
+        } else {
+            parent->left = child;
+            if (child) {
+                child->parent = parent;
+            }
+            successor->right = node->right;
+            node->right->parent = successor;
+        }
+
+        successor->left = node->left;
+        node->left->parent = successor;
+        successor->parent = node->parent;
+        successor->red = node->red;
+        rb_set_child(root, node->parent, node, successor);
+    } else {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+
+        if (child) {
+            child->parent = parent;
+        }
+        rb_set_child(root, parent, node, child);
+    }
+
+    if (!removed_red) {
+        rb_erase_fixup(root, child, parent);
+    }
+}
+
+struct rb_node* rb_first(const struct rb_root* root) {
+    struct rb_node* node = root->node;
+    if (!node) {
+        return NULL;
+    }
+    while (node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+struct rb_node* rb_next(const struct rb_node* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (struct rb_node*)node;
+    }
+
+    struct rb_node* parent;
+    while ((parent = node->parent) && node == parent->right) {
+        node = parent;
+    }
+    return parent;
+}
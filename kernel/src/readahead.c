@@ -0,0 +1,276 @@
+/*
+ * Read-ahead
+ * Stream detection and adaptive read-ahead windows
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+#include "readahead.h"
+#include "ai_hooks.h"
+
+void ra_init(ra_state_t* ra) {
+    memset(ra, 0, sizeof(*ra));
+}
+
+void ra_advise(ra_state_t* ra, uint32_t advice) {
+    ra->advice = advice;
+    if (advice == RA_ADVICE_RANDOM) {
+        ra->pattern = RA_NONE;
+        ra->ahead = 0;
+    }
+}
+
+/* Page of the step k past the current one; false once it leaves the file */
+static bool ra_step_page(const ra_state_t* ra, uint32_t k, uint64_t pages, uint64_t* out) {
+    int64_t page;
+    if (ra->pattern == RA_LOOP) {
+        page = (int64_t)ra->loop_start + (int64_t)((ra->loop_pos + k) % ra->loop_steps) * ra->stride;
+    } else {
+        page = (int64_t)ra->cur + (int64_t)k * ra->stride;
+    }
+
+    if (page < 0 || (uint64_t)page >= pages) {
+        return false;
+    }
+    *out = (uint64_t)page;
+    return true;
+}
+
+static uint32_t ra_min_steps(const ra_state_t* ra) {
+    return MAX(RA_MIN_PAGES / ra->unit, 1u);
+}
+
+/* Gap pages a run may bridge: no more than the step it joins, so at most half of a run is gap */
+static uint32_t ra_max_gap(const ra_state_t* ra) {
+    return MIN(ra->unit, (uint32_t)RA_MAX_GAP);
+}
+
+/*
+ * Bounded by the pages the window spans, at least RA_MAX_RUNS steps, and by
+ * the loop. Steps too far apart to merge each take a run of their own.
+ */
+static uint32_t ra_max_steps(const ra_state_t* ra) {
+    uint32_t steps = RA_MAX_PAGES / ra->unit;
+    uint64_t span = (uint64_t)(ra->stride < 0 ? -ra->stride : ra->stride);
+    if (span > ra->unit) {
+        uint32_t spanned = span - ra->unit <= ra_max_gap(ra) ? (uint32_t)(RA_MAX_PAGES / span) : 0;
+        steps = MIN(steps, MAX(spanned, (uint32_t)RA_MAX_RUNS));
+    }
+    if (ra->pattern == RA_LOOP) {
+        steps = MIN(steps, ra->loop_steps);
+    }
+    return MAX(steps, 1u);
+}
+
+/* Read-ahead steps that were never used; the next window starts smaller */
+static void ra_waste(ra_state_t* ra, uint32_t steps) {
+    ra->stats.wasted += (uint64_t)steps * ra->unit;
+    ra->wasted = true;
+    ra->window = MAX(ra->window / 2, ra_min_steps(ra));
+}
+
+static void ra_drop_ahead(ra_state_t* ra) {
+    if (ra->ahead) {
+        ra_waste(ra, ra->ahead);
+        ra->ahead = 0;
+    }
+}
+
+void ra_release(ra_state_t* ra) {
+    ra_drop_ahead(ra);
+}
+
+/* Steps the access moves the stream on by, 0 if it leaves the stream */
+static uint32_t ra_continues(const ra_state_t* ra, uint64_t index, uint64_t end, uint64_t pages) {
+    uint64_t next;
+    if (ra->pattern == RA_NONE || !ra_step_page(ra, 1, pages, &next)) {
+        return 0;
+    }
+
+    /* Sequential: any access from the previous one on that covers the next page */
+    if (ra->stride == 1) {
+        if (index <= next && end > next && (index >= ra->last || index == next)) {
+            return (uint32_t)(end - next);
+        }
+        return 0;
+    }
+    return index == next && end - index == ra->unit ? 1 : 0;
+}
+
+static void ra_advance(ra_state_t* ra, uint32_t steps) {
+    ra->run_steps += steps;
+    if (ra->pattern == RA_LOOP) {
+        ra->loop_pos = (ra->loop_pos + steps) % ra->loop_steps;
+        ra->cur = (uint64_t)((int64_t)ra->loop_start + (int64_t)ra->loop_pos * ra->stride);
+    } else {
+        ra->cur = (uint64_t)((int64_t)ra->cur + (int64_t)steps * ra->stride);
+    }
+}
+
+/* The access left the stream: a loop, a new stream, or a candidate stride */
+static void ra_restart(ra_state_t* ra, uint64_t index, uint64_t end, uint32_t count) {
+    /* Back at the first page of a long enough run: the run repeats */
+    if (ra->pattern != RA_NONE && ra->pattern != RA_LOOP && index == ra->run_start &&
+        ra->run_steps >= RA_LOOP_STEPS && (ra->stride == 1 || count == ra->unit)) {
+        ra_drop_ahead(ra);
+        ra->pattern = RA_LOOP;
+        ra->loop_start = ra->run_start;
+        ra->loop_steps = ra->run_steps;
+        ra->loop_pos = ra->stride == 1 ? (count - 1) % ra->loop_steps : 0;
+        ra->cur = (uint64_t)((int64_t)ra->loop_start + (int64_t)ra->loop_pos * ra->stride);
+        return;
+    }
+
+    ra_drop_ahead(ra);
+    ra->window = 0;
+
+    bool contiguous = ra->accesses > 1 && index >= ra->last && index <= ra->last_end &&
+                      end > ra->last_end;
+    if (contiguous || ra->advice == RA_ADVICE_SEQUENTIAL || (ra->accesses == 1 && index == 0)) {
+        ra->pattern = RA_SEQUENTIAL;
+        ra->stride = 1;
+        ra->unit = 1;
+        ra->cur = end - 1;
+        ra->run_start = contiguous ? ra->last : index;
+        ra->run_steps = (uint32_t)MIN(end - ra->run_start, (uint64_t)UINT32_MAX);
+        return;
+    }
+
+    /* The same gap twice in a row confirms a strided or reverse stream */
+    int64_t delta = (int64_t)index - (int64_t)ra->last;
+    if (ra->pattern == RA_NONE && ra->accesses > 2 && delta != 0 && delta == ra->stride &&
+        count == ra->unit) {
+        ra->pattern = delta > 0 ? RA_STRIDED : RA_REVERSE;
+        ra->cur = index;
+        ra->run_start = (uint64_t)((int64_t)index - 2 * delta);
+        ra->run_steps = 3;
+        return;
+    }
+
+    ra->pattern = RA_NONE;
+    ra->stride = delta;
+    ra->unit = count;
+}
+
+/* Add a step to the last run when it is at most max_gap pages away; *gap gets the pages bridged */
+static bool ra_merge(ra_run_t* run, uint64_t page, uint32_t len, uint32_t max_gap, uint32_t* gap) {
+    uint64_t end = run->index + run->count;
+    if (page >= end && page - end <= max_gap) {
+        *gap = (uint32_t)(page - end);
+        run->count = (uint32_t)(page + len - run->index);
+        return true;
+    }
+    if (page + len <= run->index && run->index - (page + len) <= max_gap) {
+        *gap = (uint32_t)(run->index - (page + len));
+        run->count = (uint32_t)(end - page);
+        run->index = page;
+        return true;
+    }
+    return false;
+}
+
+/* Top the window up once half of it is consumed; it doubles while nothing is wasted */
+static uint32_t ra_fill(ra_state_t* ra, uint32_t count, uint64_t pages, ra_run_t* runs) {
+    uint32_t max = ra_max_steps(ra);
+
+    if (ra->window == 0) {
+        ra->window = ra->stride == 1 ? MAX((uint32_t)RA_MIN_PAGES, 2 * count) : ra_min_steps(ra);
+        ra->window = MIN(ra->window, max);
+    } else if (ra->ahead * 2 > ra->window) {
+        return 0;
+    } else if (!ra->wasted) {
+        ra->window = MIN(ra->window * 2, max);
+    }
+    ra->wasted = false;
+
+    uint32_t n = 0;
+    uint32_t k = ra->ahead + 1;
+    uint32_t max_gap = ra_max_gap(ra);
+    for (; k <= ra->window; k++) {
+        uint64_t page;
+        if (!ra_step_page(ra, k, pages, &page)) {
+            break;
+        }
+
+        /* Bridged pages are read but never a step of the stream */
+        uint32_t len = (uint32_t)MIN((uint64_t)ra->unit, pages - page);
+        uint32_t gap;
+        if (n && ra_merge(&runs[n - 1], page, len, max_gap, &gap)) {
+            ra->stats.wasted += gap;
+            continue;
+        } else if (n == RA_MAX_RUNS) {
+            break;
+        } else {
+            runs[n].index = page;
+            runs[n].count = len;
+            n++;
+        }
+    }
+
+    ra->ahead = k - 1;
+    if (n) {
+        ra->stats.windows++;
+    }
+    return n;
+}
+
+/* No stream: the AI_HOOK_IO model may still know where the next access goes */
+static uint32_t ra_predict(ra_state_t* ra, uint64_t index, uint32_t count, uint64_t pages,
+                           ra_run_t* runs) {
+    uint64_t next = ai_predict_readahead(index, count, index + count);
+    if (next == index + count || next >= pages) {
+        return 0;
+    }
+
+    runs[0].index = next;
+    runs[0].count = (uint32_t)MIN((uint64_t)count, pages - next);
+    ra->stats.windows++;
+    return 1;
+}
+
+uint32_t ra_access(ra_state_t* ra, uint64_t index, uint32_t count, uint64_t pages, bool cached,
+                   ra_run_t* runs) {
+    count = MAX(count, 1u);
+    uint64_t end = index + count;
+
+    /* Another look at the pages just accessed, e.g. small records, is not a step */
+    if (ra->accesses && index == ra->last && end <= ra->last_end) {
+        return 0;
+    }
+    ra->accesses++;
+
+    uint32_t n = 0;
+    if (ra->advice != RA_ADVICE_RANDOM) {
+        uint32_t steps = ra_continues(ra, index, end, pages);
+        if (steps) {
+            /* Steps read ahead are used if still cached, wasted if evicted first */
+            uint32_t reached = MIN(steps, ra->ahead);
+            if (reached && cached) {
+                ra->stats.used += (uint64_t)reached * ra->unit;
+            } else if (reached) {
+                ra_waste(ra, reached);
+            }
+            ra->ahead -= reached;
+            ra_advance(ra, steps);
+        } else {
+            ra_restart(ra, index, end, count);
+        }
+
+        n = ra->pattern == RA_NONE ? ra_predict(ra, index, count, pages, runs) :
+                                     ra_fill(ra, count, pages, runs);
+    }
+
+    ra->last = index;
+    ra->last_end = end;
+    return n;
+}
+
+const char* ra_pattern_name(ra_pattern_t pattern) {
+    switch (pattern) {
+    case RA_SEQUENTIAL: return "sequential";
+    case RA_STRIDED:    return "strided";
+    case RA_REVERSE:    return "reverse";
+    case RA_LOOP:       return "loop";
+    default:            return "none";
+    }
+}
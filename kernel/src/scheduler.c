@@ -1,23 +1,81 @@
 /*
  * Process and Thread Scheduler
- * Priority-based preemptive scheduler with SMP support
+ * Deadline (EDF + CBS) class, then strict real-time, then a fair class
+ * ordered by virtual runtime
  */
 
 #include "kernel.h"
 #include "microkernel.h"
 #include "process.h"
+#include "rbtree.h"
+#include "ai_hooks.h"
+
+extern uint64_t perf_timestamp_ns(void);
+
+/* One CPU's runnable threads; the running thread is not queued */
+typedef struct sched_rq {
+    struct rb_root dl_tree;            // Deadline threads by absolute deadline
+    struct rb_node* dl_leftmost;
+    struct list_head dl_throttled;     // Out of budget until their next period
+    uint64_t dl_bw;                    // Admitted bandwidth, SCHED_DL_BW_SHIFT fixed point
+    uint64_t dl_throttles;
+
+    struct list_head rt_queue;         // PRIORITY_REALTIME, FIFO
+    struct rb_root fair_tree;          // Fair threads by vruntime
+    struct rb_node* leftmost;          // Cached rb_first(&fair_tree)
+    uint32_t nr_fair;
+    uint64_t fair_weight;              // Total weight of queued fair threads
+    uint64_t min_vruntime;             // Monotonic floor for placing threads
+    thread_t* current;
+    uint64_t clock;                    // Nanoseconds
+    bool need_resched;
+
+    uint64_t time_slice_ns;            // Real-time round-robin quantum
+    uint64_t latency_ns;               // Period in which every fair thread runs
+    uint64_t min_granularity_ns;       // Shortest fair slice
+    uint64_t wakeup_granularity_ns;    // vruntime lead a waker needs to preempt
+
+    uint64_t context_switches;
+    uint64_t wakeups;
+    uint64_t wakeup_latency_total_ns;
+    uint64_t wakeup_latency_max_ns;
+    sched_pi_stats_t pi;
+
+    bool ai_hook;                      // Consult the AI_HOOK_SCHEDULER model on ticks
+    uint64_t ai_decisions;
+    uint64_t ai_preemptions;
+    uint64_t schedules;
+} sched_rq_t;
 
 /* Global scheduler state */
 static struct {
     bool initialized;
     sched_config_t config;
-    struct list_head ready_queues[5];  // One per priority level
+    sched_rq_t rq;
     struct list_head all_threads;
-    thread_t* current_thread;
-    uint64_t total_context_switches;
     uint32_t lock;
 } scheduler = {0};
 
+/* Load weight per nice level, -20..19; each step is about 10% CPU */
+static const uint32_t sched_nice_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+/* Default nice for the fair priorities */
+static const int8_t sched_priority_nice[PRIORITY_REALTIME] = {
+    [PRIORITY_IDLE] = 19,
+    [PRIORITY_LOW] = 5,
+    [PRIORITY_NORMAL] = 0,
+    [PRIORITY_HIGH] = -5,
+};
+
 /* Simple spinlock operations */
 static ALWAYS_INLINE void sched_lock(void) {
     __sync_lock_test_and_set(&scheduler.lock, 1);
@@ -27,26 +85,502 @@ static ALWAYS_INLINE void sched_unlock(void) {
     __sync_lock_release(&scheduler.lock);
 }
 
+/* 2 = deadline, 1 = real-time, 0 = fair; a higher class always preempts */
+static ALWAYS_INLINE int sched_base_rank(const thread_t* thread) {
+    return thread->dl_runtime ? 2 : thread->priority < PRIORITY_REALTIME ? 0 : 1;
+}
+
+/* Class the thread runs in, including one inherited from a blocked waiter */
+static ALWAYS_INLINE int sched_class_rank(const thread_t* thread) {
+    int rank = sched_base_rank(thread);
+    return thread->pi_donor && thread->pi_rank > rank ? thread->pi_rank : rank;
+}
+
+static ALWAYS_INLINE bool sched_is_deadline(const thread_t* thread) {
+    return sched_class_rank(thread) == 2;
+}
+
+static ALWAYS_INLINE bool sched_is_fair(const thread_t* thread) {
+    return sched_class_rank(thread) == 0;
+}
+
+/* Wrap-safe ordering of vruntimes and clock values */
+static ALWAYS_INLINE bool vruntime_before(uint64_t a, uint64_t b) {
+    return (int64_t)(a - b) < 0;
+}
+
+/* EDF key: its own deadline, or an earlier one inherited from a waiter */
+static ALWAYS_INLINE uint64_t sched_dl_key(const thread_t* thread) {
+    if (thread->pi_donor && thread->pi_rank == 2 &&
+        (!thread->dl_runtime || vruntime_before(thread->pi_deadline, thread->dl_abs_deadline))) {
+        return thread->pi_deadline;
+    }
+    return thread->dl_abs_deadline;
+}
+
+static void rq_init(sched_rq_t* rq, uint64_t time_slice_ns) {
+    rq->dl_tree = RB_ROOT;
+    rq->dl_leftmost = NULL;
+    list_init(&rq->dl_throttled);
+    rq->dl_bw = 0;
+    rq->dl_throttles = 0;
+
+    list_init(&rq->rt_queue);
+    rq->fair_tree = RB_ROOT;
+    rq->leftmost = NULL;
+    rq->nr_fair = 0;
+    rq->fair_weight = 0;
+    rq->min_vruntime = 0;
+    rq->current = NULL;
+    rq->clock = 0;
+    rq->need_resched = false;
+
+    rq->time_slice_ns = time_slice_ns;
+    rq->latency_ns = time_slice_ns;
+    rq->min_granularity_ns = time_slice_ns / 8;
+    rq->wakeup_granularity_ns = time_slice_ns / 8;
+
+    rq->context_switches = 0;
+    rq->wakeups = 0;
+    rq->wakeup_latency_total_ns = 0;
+    rq->wakeup_latency_max_ns = 0;
+    rq->pi = (sched_pi_stats_t){0};
+
+    rq->ai_hook = false;
+    rq->ai_decisions = 0;
+    rq->ai_preemptions = 0;
+    rq->schedules = 0;
+}
+
+static ALWAYS_INLINE thread_t* rq_leftmost(sched_rq_t* rq) {
+    return rq->leftmost ? rb_entry(rq->leftmost, thread_t, run_node) : NULL;
+}
+
+static void update_min_vruntime(sched_rq_t* rq) {
+    thread_t* curr = rq->current;
+    thread_t* first = rq_leftmost(rq);
+    uint64_t vruntime;
+
+    if (curr && sched_is_fair(curr) && curr->state == PROC_STATE_RUNNING) {
+        vruntime = curr->vruntime;
+        if (first && vruntime_before(first->vruntime, vruntime)) {
+            vruntime = first->vruntime;
+        }
+    } else if (first) {
+        vruntime = first->vruntime;
+    } else {
+        return;
+    }
+
+    if (vruntime_before(rq->min_vruntime, vruntime)) {
+        rq->min_vruntime = vruntime;
+    }
+}
+
+/* Charge the running thread for time since it was last accounted */
+static void update_curr(sched_rq_t* rq) {
+    thread_t* curr = rq->current;
+    if (!curr || (int64_t)(rq->clock - curr->exec_start) <= 0) {
+        return;
+    }
+
+    uint64_t delta = rq->clock - curr->exec_start;
+    curr->exec_start = rq->clock;
+    curr->cpu_time += delta;
+
+    if (curr->dl_runtime) {
+        curr->dl_budget -= (int64_t)delta;
+        if (curr->dl_budget <= 0 && curr->pi_donor) {
+            /* Never throttle a lock holder someone is waiting for; postpone instead */
+            while (curr->dl_budget <= 0) {
+                curr->dl_abs_deadline += curr->dl_period;
+                curr->dl_budget += (int64_t)curr->dl_runtime;
+            }
+        } else if (curr->dl_budget <= 0 && !curr->dl_throttled) {
+            curr->dl_throttled = true;
+            rq->dl_throttles++;
+            rq->need_resched = true;
+        }
+    }
+    if (sched_is_fair(curr)) {
+        curr->vruntime += delta * SCHED_NICE_0_WEIGHT / curr->weight;
+        update_min_vruntime(rq);
+    }
+}
+
+static void fair_enqueue(sched_rq_t* rq, thread_t* thread) {
+    struct rb_node** link = &rq->fair_tree.node;
+    struct rb_node* parent = NULL;
+    bool leftmost = true;
+
+    /* Equal vruntimes go right, so same-weight threads rotate in FIFO order */
+    while (*link) {
+        parent = *link;
+        if (vruntime_before(thread->vruntime, rb_entry(parent, thread_t, run_node)->vruntime)) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_link_node(&thread->run_node, parent, link);
+    rb_insert_color(&thread->run_node, &rq->fair_tree);
+    if (leftmost) {
+        rq->leftmost = &thread->run_node;
+    }
+
+    rq->nr_fair++;
+    rq->fair_weight += thread->weight;
+}
+
+static void fair_dequeue(sched_rq_t* rq, thread_t* thread) {
+    if (rq->leftmost == &thread->run_node) {
+        rq->leftmost = rb_next(&thread->run_node);
+    }
+    rb_erase(&thread->run_node, &rq->fair_tree);
+
+    rq->nr_fair--;
+    rq->fair_weight -= thread->weight;
+}
+
+static ALWAYS_INLINE thread_t* rq_dl_leftmost(sched_rq_t* rq) {
+    return rq->dl_leftmost ? rb_entry(rq->dl_leftmost, thread_t, run_node) : NULL;
+}
+
+static void dl_enqueue(sched_rq_t* rq, thread_t* thread) {
+    struct rb_node** link = &rq->dl_tree.node;
+    struct rb_node* parent = NULL;
+    bool leftmost = true;
+
+    while (*link) {
+        parent = *link;
+        if (vruntime_before(sched_dl_key(thread), sched_dl_key(rb_entry(parent, thread_t, run_node)))) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = false;
+        }
+    }
+
+    rb_link_node(&thread->run_node, parent, link);
+    rb_insert_color(&thread->run_node, &rq->dl_tree);
+    if (leftmost) {
+        rq->dl_leftmost = &thread->run_node;
+    }
+}
+
+static void dl_dequeue(sched_rq_t* rq, thread_t* thread) {
+    if (rq->dl_leftmost == &thread->run_node) {
+        rq->dl_leftmost = rb_next(&thread->run_node);
+    }
+    rb_erase(&thread->run_node, &rq->dl_tree);
+}
+
+/*
+ * CBS wakeup rule: keep the current deadline only if the budget left can
+ * be spent before it without exceeding runtime/period; otherwise start a
+ * fresh period. This stops a thread that slept from bunching its runtime.
+ */
+static void dl_wakeup(sched_rq_t* rq, thread_t* thread) {
+    uint64_t now = rq->clock;
+    if (!vruntime_before(now, thread->dl_abs_deadline) || thread->dl_budget <= 0 ||
+        (uint64_t)thread->dl_budget * thread->dl_period >
+        (thread->dl_abs_deadline - now) * thread->dl_runtime) {
+        thread->dl_abs_deadline = now + thread->dl_deadline;
+        thread->dl_budget = (int64_t)thread->dl_runtime;
+    }
+}
+
+static ALWAYS_INLINE uint64_t dl_next_period(const thread_t* thread) {
+    return thread->dl_abs_deadline - thread->dl_deadline + thread->dl_period;
+}
+
+/* Soonest replenishment among throttled threads, 0 if none */
+static uint64_t dl_next_replenish(sched_rq_t* rq) {
+    uint64_t next = 0;
+    struct list_head* pos;
+    list_for_each(pos, &rq->dl_throttled) {
+        thread_t* thread = list_entry(pos, thread_t, dl_throttle_node);
+        uint64_t at = dl_next_period(thread);
+        if (!next || vruntime_before(at, next)) {
+            next = at;
+        }
+    }
+    return next;
+}
+
+static void check_preempt_wakeup(sched_rq_t* rq, thread_t* thread);
+
+/* Refill throttled threads whose next period has started */
+static void dl_replenish(sched_rq_t* rq) {
+    struct list_head* pos;
+    struct list_head* n;
+    list_for_each_safe(pos, n, &rq->dl_throttled) {
+        thread_t* thread = list_entry(pos, thread_t, dl_throttle_node);
+        if (vruntime_before(rq->clock, dl_next_period(thread))) {
+            continue;
+        }
+
+        /* Pay back any overrun out of the following periods */
+        while (thread->dl_budget <= 0) {
+            thread->dl_abs_deadline += thread->dl_period;
+            thread->dl_budget += (int64_t)thread->dl_runtime;
+        }
+        if (!vruntime_before(rq->clock, thread->dl_abs_deadline)) {
+            thread->dl_abs_deadline = rq->clock + thread->dl_deadline;
+            thread->dl_budget = (int64_t)thread->dl_runtime;
+        }
+
+        list_del(&thread->dl_throttle_node);
+        thread->dl_throttled = false;
+
+        /* Woken while throttled: it becomes runnable now */
+        if (thread->state == PROC_STATE_READY) {
+            dl_enqueue(rq, thread);
+            thread->on_rq = true;
+            check_preempt_wakeup(rq, thread);
+        }
+    }
+}
+
+/* Wall-clock slice of the running fair thread for the current load */
+static uint64_t sched_slice(sched_rq_t* rq, thread_t* thread) {
+    uint64_t nr = rq->nr_fair + 1;
+    uint64_t period = rq->latency_ns;
+    if (nr * rq->min_granularity_ns > period) {
+        period = nr * rq->min_granularity_ns;
+    }
+    return period * thread->weight / (rq->fair_weight + thread->weight);
+}
+
+/* Does a newly runnable thread deserve the CPU now? */
+static void check_preempt_wakeup(sched_rq_t* rq, thread_t* thread) {
+    thread_t* curr = rq->current;
+    if (!curr || curr->state != PROC_STATE_RUNNING) {
+        rq->need_resched = true;
+        return;
+    }
+
+    int rank = sched_class_rank(thread);
+    int curr_rank = sched_class_rank(curr);
+    if (rank != curr_rank) {
+        if (rank > curr_rank) {
+            rq->need_resched = true;
+        }
+        return;
+    }
+
+    update_curr(rq);
+
+    /* EDF: the earlier deadline runs */
+    if (sched_is_deadline(thread)) {
+        if (vruntime_before(sched_dl_key(thread), sched_dl_key(curr))) {
+            rq->need_resched = true;
+        }
+        return;
+    }
+    if (!sched_is_fair(thread)) {
+        return;
+    }
+
+    /* The lead is measured in the waker's virtual time */
+    uint64_t gran = rq->wakeup_granularity_ns * SCHED_NICE_0_WEIGHT / thread->weight;
+    if ((int64_t)(curr->vruntime - thread->vruntime) > (int64_t)gran) {
+        rq->need_resched = true;
+    }
+}
+
+/* Offer the tick to an installed scheduler model; it can only preempt earlier */
+static bool sched_ai_preempt(sched_rq_t* rq, thread_t* curr, thread_t* first, uint64_t ran) {
+    if (!rq->ai_hook || !first || !ai_model_present(AI_HOOK_SCHEDULER)) {
+        return false;
+    }
+
+    rq->ai_decisions++;
+    if (!ai_should_preempt(curr->tid, first->tid, ran, (int64_t)(curr->vruntime - first->vruntime))) {
+        return false;
+    }
+    rq->ai_preemptions++;
+    return true;
+}
+
+/* Has the running thread used its slice? */
+static void check_preempt_tick(sched_rq_t* rq) {
+    thread_t* curr = rq->current;
+    if (!curr || curr->state != PROC_STATE_RUNNING) {
+        return;
+    }
+
+    uint64_t ran = curr->cpu_time - curr->slice_start;
+
+    if (sched_is_deadline(curr)) {
+        thread_t* first = rq_dl_leftmost(rq);
+        if (first && vruntime_before(sched_dl_key(first), sched_dl_key(curr))) {
+            rq->need_resched = true;
+        }
+        return;
+    }
+
+    if (rq->dl_leftmost) {
+        rq->need_resched = true;
+        return;
+    }
+
+    if (!sched_is_fair(curr)) {
+        if (ran >= rq->time_slice_ns && !list_empty(&rq->rt_queue)) {
+            rq->need_resched = true;
+        }
+        return;
+    }
+
+    if (!list_empty(&rq->rt_queue)) {
+        rq->need_resched = true;
+        return;
+    }
+
+    if (ran >= sched_slice(rq, curr)) {
+        rq->need_resched = true;
+        return;
+    }
+
+    /* Far ahead of the next thread: give way once past the minimum granularity */
+    thread_t* first = rq_leftmost(rq);
+    if (first && ran >= rq->min_granularity_ns &&
+        (int64_t)(curr->vruntime - first->vruntime) > (int64_t)sched_slice(rq, curr)) {
+        rq->need_resched = true;
+        return;
+    }
+
+    if (sched_ai_preempt(rq, curr, first, ran)) {
+        rq->need_resched = true;
+    }
+}
+
+static void rq_enqueue(sched_rq_t* rq, thread_t* thread, bool wakeup) {
+    thread->state = PROC_STATE_READY;
+
+    if (sched_is_deadline(thread)) {
+        /* A throttled thread is queued by dl_replenish() at its next period */
+        if (thread->dl_throttled) {
+            return;
+        }
+        if (wakeup && thread->dl_runtime) {
+            dl_wakeup(rq, thread);
+        }
+        dl_enqueue(rq, thread);
+    } else if (!sched_is_fair(thread)) {
+        list_add(&thread->list_node, rq->rt_queue.prev);
+    } else {
+        /* Sleepers keep up to half a period of credit; new threads get none */
+        uint64_t floor = rq->min_vruntime;
+        if (wakeup && thread->cpu_time) {
+            floor -= rq->latency_ns / 2;
+        }
+        if (vruntime_before(thread->vruntime, floor)) {
+            thread->vruntime = floor;
+        }
+        fair_enqueue(rq, thread);
+    }
+    thread->on_rq = true;
+
+    if (wakeup) {
+        thread->wake_time = rq->clock ? rq->clock : 1;
+        check_preempt_wakeup(rq, thread);
+    }
+}
+
+static void rq_dequeue(sched_rq_t* rq, thread_t* thread) {
+    if (!thread->on_rq) {
+        return;
+    }
+
+    if (sched_is_deadline(thread)) {
+        dl_dequeue(rq, thread);
+    } else if (sched_is_fair(thread)) {
+        fair_dequeue(rq, thread);
+    } else {
+        list_del(&thread->list_node);
+    }
+    thread->on_rq = false;
+}
+
+/* Earliest deadline first, then real-time, then the fair thread with the least vruntime */
+static thread_t* pick_next_thread(sched_rq_t* rq) {
+    thread_t* thread = rq_dl_leftmost(rq);
+
+    if (!thread && !list_empty(&rq->rt_queue)) {
+        thread = list_entry(rq->rt_queue.next, thread_t, list_node);
+    }
+    if (!thread) {
+        thread = rq_leftmost(rq);
+    }
+
+    if (thread) {
+        rq_dequeue(rq, thread);
+    }
+    return thread;
+}
+
+/* Requeue the previous thread if still runnable and make the next one current */
+static thread_t* rq_schedule(sched_rq_t* rq) {
+    update_curr(rq);
+    rq->schedules++;
+
+    thread_t* prev = rq->current;
+    if (prev && prev->dl_throttled) {
+        if (prev->state == PROC_STATE_RUNNING) {
+            prev->state = PROC_STATE_READY;
+        }
+        list_add(&prev->dl_throttle_node, rq->dl_throttled.prev);
+    } else if (prev && !prev->on_rq &&
+               (prev->state == PROC_STATE_RUNNING || prev->state == PROC_STATE_READY)) {
+        rq_enqueue(rq, prev, false);
+    }
+    dl_replenish(rq);
+
+    thread_t* next = pick_next_thread(rq);
+    rq->need_resched = false;
+    rq->current = next;
+
+    if (next) {
+        next->state = PROC_STATE_RUNNING;
+        next->exec_start = rq->clock;
+        next->slice_start = next->cpu_time;
+
+        if (next->wake_time) {
+            uint64_t latency = rq->clock - next->wake_time;
+            rq->wakeups++;
+            rq->wakeup_latency_total_ns += latency;
+            if (latency > rq->wakeup_latency_max_ns) {
+                rq->wakeup_latency_max_ns = latency;
+            }
+            next->wake_time = 0;
+        }
+
+        if (next != prev) {
+            rq->context_switches++;
+        }
+    }
+    update_min_vruntime(rq);
+    return next;
+}
+
 /* Initialize scheduler */
 status_t sched_init(sched_config_t* config) {
     if (scheduler.initialized) {
         return STATUS_EXISTS;
     }
 
-    if (!config) {
+    if (!config || config->time_slice_ns == 0) {
         return STATUS_INVALID;
     }
 
     scheduler.config = *config;
-
-    /* Initialize ready queues */
-    for (int i = 0; i < 5; i++) {
-        list_init(&scheduler.ready_queues[i]);
-    }
+    rq_init(&scheduler.rq, config->time_slice_ns);
+    scheduler.rq.ai_hook = true;
 
     list_init(&scheduler.all_threads);
-    scheduler.current_thread = NULL;
-    scheduler.total_context_switches = 0;
     scheduler.initialized = true;
 
     return STATUS_OK;
@@ -54,57 +588,264 @@ status_t sched_init(sched_config_t* config) {
 
 /* Get current running thread */
 thread_t* sched_get_current_thread(void) {
-    return scheduler.current_thread;
+    return scheduler.rq.current;
 }
 
-/* Add thread to ready queue */
-void sched_add_thread(thread_t* thread) {
+/* Weight for nice, raised to an inherited weight while boosted */
+static void sched_apply_nice(thread_t* thread, int nice) {
+    thread->nice = nice;
+    thread->weight = sched_nice_weight[nice - SCHED_NICE_MIN];
+    if (thread->pi_donor && thread->pi_weight > thread->weight) {
+        thread->weight = thread->pi_weight;
+    }
+}
+
+/* Reset scheduling state of a new thread */
+void sched_init_thread(thread_t* thread) {
+    if (thread->priority > PRIORITY_REALTIME) {
+        thread->priority = PRIORITY_REALTIME;
+    }
+
+    thread->pi_donor = NULL;
+    thread->ipc_donor = NULL;
+    thread->pi_blocked_on = NULL;
+    list_init(&thread->pi_held);
+
+    sched_apply_nice(thread, thread->priority < PRIORITY_REALTIME ?
+                             sched_priority_nice[thread->priority] : 0);
+    thread->vruntime = 0;
+    thread->exec_start = 0;
+    thread->slice_start = 0;
+    thread->wake_time = 0;
+    thread->on_rq = false;
+
+    thread->dl_runtime = 0;
+    thread->dl_deadline = 0;
+    thread->dl_period = 0;
+    thread->dl_abs_deadline = 0;
+    thread->dl_budget = 0;
+    thread->dl_throttled = false;
+    list_init(&thread->dl_throttle_node);
+}
+
+/* Does a outrank b's own (uninherited) parameters? */
+static bool sched_above_base(const thread_t* a, const thread_t* b) {
+    int ra = sched_class_rank(a);
+    int rb = sched_base_rank(b);
+    if (ra != rb) {
+        return ra > rb;
+    }
+    if (ra == 2) {
+        return vruntime_before(sched_dl_key(a), b->dl_abs_deadline);
+    }
+    return ra == 0 && a->weight > sched_nice_weight[b->nice - SCHED_NICE_MIN];
+}
+
+bool sched_prio_higher(const thread_t* a, const thread_t* b) {
+    int ra = sched_class_rank(a);
+    int rb = sched_class_rank(b);
+    if (ra != rb) {
+        return ra > rb;
+    }
+    if (ra == 2) {
+        return vruntime_before(sched_dl_key(a), sched_dl_key(b));
+    }
+    return ra == 0 && a->weight > b->weight;
+}
+
+/* Run thread with donor's class, deadline or weight; donor NULL restores its own */
+static void rq_pi_boost(sched_rq_t* rq, thread_t* thread, thread_t* donor) {
+    if (donor && !sched_above_base(donor, thread)) {
+        donor = NULL;
+    }
+
+    /* Losing a boost may let a queued thread outrank the running one */
+    if (thread == rq->current) {
+        update_curr(rq);
+        rq->need_resched = !donor;
+    }
+
+    bool queued = thread->on_rq;
+    rq_dequeue(rq, thread);
+
+    if (donor && !thread->pi_donor) {
+        rq->pi.boosts++;
+        thread->pi_since = rq->clock;
+    } else if (!donor && thread->pi_donor) {
+        uint64_t duration = rq->clock - thread->pi_since;
+        rq->pi.inversions++;
+        rq->pi.inversion_total_ns += duration;
+        rq->pi.inversion_max_ns = MAX(rq->pi.inversion_max_ns, duration);
+    }
+
+    thread->pi_donor = donor;
+    if (donor) {
+        thread->pi_rank = (uint8_t)sched_class_rank(donor);
+        thread->pi_deadline = sched_dl_key(donor);
+        thread->pi_weight = donor->weight;
+    }
+    sched_apply_nice(thread, thread->nice);
+
+    /* A throttled reservation must not keep a waiter blocked */
+    if (donor && thread->dl_throttled) {
+        list_del(&thread->dl_throttle_node);
+        thread->dl_throttled = false;
+        thread->dl_budget = (int64_t)thread->dl_runtime;
+        queued = queued || thread->state == PROC_STATE_READY;
+    }
+
+    if (queued) {
+        rq_enqueue(rq, thread, false);
+    }
+}
+
+void sched_pi_boost(thread_t* thread, thread_t* donor) {
     if (!thread) {
         return;
     }
 
     sched_lock();
+    scheduler.rq.clock = perf_timestamp_ns();
+    rq_pi_boost(&scheduler.rq, thread, donor);
+    sched_unlock();
+}
 
-    if (thread->priority > PRIORITY_REALTIME) {
-        thread->priority = PRIORITY_REALTIME;
+void sched_get_pi_stats(sched_pi_stats_t* stats) {
+    if (stats) {
+        *stats = scheduler.rq.pi;
     }
+}
 
-    thread->state = PROC_STATE_READY;
-    list_add(&thread->list_node, &scheduler.ready_queues[thread->priority]);
+/* Change a thread's fair-class weight */
+status_t sched_set_nice(thread_t* thread, int nice) {
+    if (!thread || nice < SCHED_NICE_MIN || nice > SCHED_NICE_MAX) {
+        return STATUS_INVALID;
+    }
+
+    sched_lock();
+
+    sched_rq_t* rq = &scheduler.rq;
+    bool queued = thread->on_rq && sched_is_fair(thread);
+
+    if (thread == rq->current) {
+        rq->clock = perf_timestamp_ns();
+        update_curr(rq);
+    }
+    if (queued) {
+        fair_dequeue(rq, thread);
+    }
+    sched_apply_nice(thread, nice);
+    if (queued) {
+        fair_enqueue(rq, thread);
+    }
 
     sched_unlock();
+    return STATUS_OK;
 }
 
-/* Remove thread from ready queue */
-void sched_remove_thread(thread_t* thread) {
+static ALWAYS_INLINE uint64_t dl_bandwidth(uint64_t runtime, uint64_t period) {
+    return runtime ? (runtime << SCHED_DL_BW_SHIFT) / period : 0;
+}
+
+/* Admission control and class change; caller holds the lock and set rq->clock */
+static status_t rq_set_deadline(sched_rq_t* rq, thread_t* thread, uint64_t runtime,
+                                uint64_t deadline, uint64_t period) {
+    uint64_t old_bw = dl_bandwidth(thread->dl_runtime, thread->dl_period);
+    uint64_t new_bw = dl_bandwidth(runtime, period);
+    uint64_t limit = ((uint64_t)SCHED_DL_BW_LIMIT_PERMILLE << SCHED_DL_BW_SHIFT) / 1000;
+
+    if (rq->dl_bw - old_bw + new_bw > limit) {
+        return STATUS_BUSY;
+    }
+
+    if (thread == rq->current) {
+        update_curr(rq);
+        rq->need_resched = true;
+    }
+
+    bool runnable = thread->on_rq || (thread->dl_throttled && thread->state == PROC_STATE_READY);
+    rq_dequeue(rq, thread);
+    if (thread->dl_throttled) {
+        list_del(&thread->dl_throttle_node);
+        thread->dl_throttled = false;
+    }
+
+    rq->dl_bw = rq->dl_bw - old_bw + new_bw;
+    thread->dl_runtime = runtime;
+    thread->dl_deadline = deadline;
+    thread->dl_period = period;
+    thread->dl_abs_deadline = rq->clock + deadline;
+    thread->dl_budget = (int64_t)runtime;
+
+    if (runnable) {
+        rq_enqueue(rq, thread, false);
+    }
+    return STATUS_OK;
+}
+
+/* Join, change or leave the deadline class */
+status_t sched_set_deadline(thread_t* thread, uint64_t runtime_ns, uint64_t deadline_ns, uint64_t period_ns) {
+    if (!thread) {
+        return STATUS_INVALID;
+    }
+
+    if (runtime_ns) {
+        if (period_ns == 0) {
+            period_ns = deadline_ns;
+        }
+        if (runtime_ns < SCHED_DL_MIN_RUNTIME_NS || runtime_ns > deadline_ns ||
+            deadline_ns > period_ns || period_ns > (1ULL << 43)) {
+            return STATUS_INVALID;
+        }
+    } else {
+        deadline_ns = 0;
+        period_ns = 0;
+    }
+
+    sched_lock();
+    scheduler.rq.clock = perf_timestamp_ns();
+    status_t status = rq_set_deadline(&scheduler.rq, thread, runtime_ns, deadline_ns, period_ns);
+    sched_unlock();
+
+    return status;
+}
+
+/* Make a thread runnable (new or woken) */
+void sched_add_thread(thread_t* thread) {
     if (!thread) {
         return;
     }
 
     sched_lock();
 
-    list_del(&thread->list_node);
-    thread->state = PROC_STATE_BLOCKED;
+    if (thread->priority > PRIORITY_REALTIME) {
+        thread->priority = PRIORITY_REALTIME;
+    }
+    if (thread->weight == 0) {
+        sched_init_thread(thread);
+    }
+
+    sched_rq_t* rq = &scheduler.rq;
+    if (!thread->on_rq && !(thread == rq->current && thread->state == PROC_STATE_RUNNING)) {
+        rq->clock = perf_timestamp_ns();
+        rq_enqueue(rq, thread, true);
+    }
 
     sched_unlock();
 }
 
-/* Pick next thread to run */
-static thread_t* pick_next_thread(void) {
-    /* Priority-based selection: check from highest to lowest priority */
-    for (int prio = PRIORITY_REALTIME; prio >= PRIORITY_IDLE; prio--) {
-        if (!list_empty(&scheduler.ready_queues[prio])) {
-            struct list_head* node = scheduler.ready_queues[prio].next;
-            thread_t* thread = list_entry(node, thread_t, list_node);
+/* Take a thread off the run queue */
+void sched_remove_thread(thread_t* thread) {
+    if (!thread) {
+        return;
+    }
 
-            /* Remove from ready queue */
-            list_del(node);
+    sched_lock();
 
-            return thread;
-        }
-    }
+    rq_dequeue(&scheduler.rq, thread);
+    thread->state = PROC_STATE_BLOCKED;
 
-    return NULL;  // Idle thread
+    sched_unlock();
 }
 
 /* Context switch (architecture-specific - will be implemented in asm) */
@@ -118,42 +859,39 @@ void sched_schedule(void) {
 
     sched_lock();
 
-    thread_t* prev = scheduler.current_thread;
-    thread_t* next = pick_next_thread();
+    sched_rq_t* rq = &scheduler.rq;
+    rq->clock = perf_timestamp_ns();
 
-    if (!next) {
-        /* No runnable threads - stay in current or idle */
-        sched_unlock();
-        return;
+    thread_t* prev = rq->current;
+    thread_t* next = rq_schedule(rq);
+
+    sched_unlock();
+
+    /* Perform context switch */
+    if (prev && next && prev != next && prev->context && next->context) {
+        context_switch(prev->context, next->context);
     }
+}
 
-    if (prev == next) {
-        /* Same thread - just return to ready queue */
-        if (next->state == PROC_STATE_READY) {
-            list_add(&next->list_node, &scheduler.ready_queues[next->priority]);
-        }
-        sched_unlock();
+/* Timer tick */
+void sched_tick(void) {
+    if (!scheduler.initialized) {
         return;
     }
 
-    /* Update states */
-    if (prev) {
-        if (prev->state == PROC_STATE_RUNNING) {
-            prev->state = PROC_STATE_READY;
-            /* Add back to ready queue if still runnable */
-            list_add(&prev->list_node, &scheduler.ready_queues[prev->priority]);
-        }
-    }
+    sched_lock();
 
-    next->state = PROC_STATE_RUNNING;
-    scheduler.current_thread = next;
-    scheduler.total_context_switches++;
+    sched_rq_t* rq = &scheduler.rq;
+    rq->clock = perf_timestamp_ns();
+    update_curr(rq);
+    dl_replenish(rq);
+    check_preempt_tick(rq);
+    bool resched = rq->need_resched;
 
     sched_unlock();
 
-    /* Perform context switch */
-    if (prev && prev->context && next->context) {
-        context_switch(prev->context, next->context);
+    if (resched) {
+        sched_schedule();
     }
 }
 
@@ -163,7 +901,7 @@ void sched_yield(void) {
         return;
     }
 
-    thread_t* current = scheduler.current_thread;
+    thread_t* current = scheduler.rq.current;
     if (current) {
         current->state = PROC_STATE_READY;
     }
@@ -177,7 +915,7 @@ status_t thread_sleep(uint64_t nanoseconds) {
         return STATUS_ERROR;
     }
 
-    thread_t* current = scheduler.current_thread;
+    thread_t* current = scheduler.rq.current;
     if (!current) {
         return STATUS_ERROR;
     }
@@ -193,6 +931,59 @@ status_t thread_sleep(uint64_t nanoseconds) {
     return STATUS_OK;
 }
 
+/* Wait queues */
+void wait_queue_init(wait_queue_t* wq) {
+    list_init(&wq->waiters);
+    wq->lock = 0;
+}
+
+static ALWAYS_INLINE void wq_lock(uint32_t* lock) {
+    while (__sync_lock_test_and_set(lock, 1)) {
+        __asm__ volatile("pause");
+    }
+}
+
+status_t wait_queue_sleep(wait_queue_t* wq, uint32_t* lock) {
+    thread_t* current = scheduler.initialized ? scheduler.rq.current : NULL;
+    if (!current) {
+        return STATUS_BUSY;
+    }
+
+    /* A blocked thread is on no ready queue, so its list node is free */
+    wq_lock(&wq->lock);
+    sched_lock();
+    current->state = PROC_STATE_BLOCKED;
+    sched_unlock();
+    list_add(&current->list_node, wq->waiters.prev);
+    __sync_lock_release(&wq->lock);
+
+    __sync_lock_release(lock);
+    sched_schedule();
+    wq_lock(lock);
+    return STATUS_OK;
+}
+
+static void wq_wake(wait_queue_t* wq, bool all) {
+    wq_lock(&wq->lock);
+    while (!list_empty(&wq->waiters)) {
+        thread_t* thread = list_entry(wq->waiters.next, thread_t, list_node);
+        list_del(&thread->list_node);
+        sched_add_thread(thread);
+        if (!all) {
+            break;
+        }
+    }
+    __sync_lock_release(&wq->lock);
+}
+
+void wait_queue_wake_one(wait_queue_t* wq) {
+    wq_wake(wq, false);
+}
+
+void wait_queue_wake_all(wait_queue_t* wq) {
+    wq_wake(wq, true);
+}
+
 /* Thread yield syscall */
 status_t thread_yield(void) {
     sched_yield();
@@ -202,7 +993,7 @@ status_t thread_yield(void) {
 /* Get scheduler statistics */
 void sched_get_stats(uint64_t* context_switches, size_t* thread_count) {
     if (context_switches) {
-        *context_switches = scheduler.total_context_switches;
+        *context_switches = scheduler.rq.context_switches;
     }
 
     if (thread_count) {
@@ -214,3 +1005,349 @@ void sched_get_stats(uint64_t* context_switches, size_t* thread_count) {
         *thread_count = count;
     }
 }
+
+/* ============================================================================
+ * Scheduler benchmark
+ * ============================================================================ */
+
+#define SCHED_BENCH_MAX_THREADS  32
+#define SCHED_BENCH_DURATION_NS  2000000000ULL   /* Simulated time per scenario */
+#define SCHED_BENCH_TICK_NS      1000000ULL      /* 1000 Hz timer */
+#define SCHED_BENCH_IO_BURST_NS  100000ULL       /* IO thread: run 100 us ... */
+#define SCHED_BENCH_IO_SLEEP_NS  3000000ULL      /* ... then wait 3 ms for the device */
+
+static thread_t sched_bench_threads[SCHED_BENCH_MAX_THREADS];
+static sched_rq_t sched_bench_rq;
+
+typedef struct sched_bench_task {
+    uint64_t burst_ns;         /* Run this long per activation; 0 = CPU-bound */
+    uint64_t sleep_ns;         /* Then block this long (IO) ... */
+    uint64_t period_ns;        /* ... or until the next period (periodic) */
+    uint64_t burst_left;
+    uint64_t wake_at;          /* 0 = runnable */
+    uint64_t release;          /* Last wakeup */
+    bool released;             /* Woken and not yet running */
+    uint64_t activations;
+    uint64_t jitter_total_ns;
+    uint64_t jitter_max_ns;
+    uint64_t misses;
+} sched_bench_task_t;
+
+static thread_t* sched_bench_add(sched_bench_task_t* tasks, uint32_t index, uint32_t priority,
+                                 uint64_t burst_ns, uint64_t sleep_ns, uint64_t period_ns) {
+    thread_t* thread = &sched_bench_threads[index];
+    thread->tid = index + 1;
+    thread->priority = priority;
+    thread->cpu_time = 0;
+    thread->context = NULL;
+    sched_init_thread(thread);
+
+    sched_bench_task_t* task = &tasks[index];
+    task->burst_ns = burst_ns;
+    task->sleep_ns = sleep_ns;
+    task->period_ns = period_ns;
+    task->burst_left = burst_ns;
+    task->wake_at = 0;
+    task->release = 0;
+    task->released = period_ns != 0;
+    task->activations = 0;
+    task->jitter_total_ns = 0;
+    task->jitter_max_ns = 0;
+    task->misses = 0;
+
+    rq_enqueue(&sched_bench_rq, thread, false);
+    return thread;
+}
+
+/* Pick, and record release-to-running jitter of a periodic thread */
+static void sched_bench_schedule(sched_bench_task_t* tasks) {
+    sched_rq_t* rq = &sched_bench_rq;
+    thread_t* curr = rq_schedule(rq);
+    if (!curr) {
+        return;
+    }
+
+    sched_bench_task_t* task = &tasks[curr - sched_bench_threads];
+    if (task->released) {
+        uint64_t jitter = rq->clock - task->release;
+        task->released = false;
+        task->activations++;
+        task->jitter_total_ns += jitter;
+        task->jitter_max_ns = MAX(task->jitter_max_ns, jitter);
+    }
+}
+
+/* Advance a simulated CPU event by event: ticks, burst ends, wakeups, budget exhaustion */
+static uint64_t sched_bench_run(sched_bench_task_t* tasks, uint32_t count) {
+    sched_rq_t* rq = &sched_bench_rq;
+    uint64_t bursts = 0;
+
+    sched_bench_schedule(tasks);
+
+    while (rq->clock < SCHED_BENCH_DURATION_NS) {
+        thread_t* curr = rq->current;
+        sched_bench_task_t* task = curr ? &tasks[curr - sched_bench_threads] : NULL;
+
+        uint64_t until = (rq->clock / SCHED_BENCH_TICK_NS + 1) * SCHED_BENCH_TICK_NS;
+        if (task && task->burst_ns) {
+            until = MIN(until, rq->clock + task->burst_left);
+        }
+        if (curr && sched_is_deadline(curr) && curr->dl_budget > 0) {
+            until = MIN(until, rq->clock + (uint64_t)curr->dl_budget);
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (tasks[i].wake_at) {
+                until = MIN(until, tasks[i].wake_at);
+            }
+        }
+        uint64_t replenish = dl_next_replenish(rq);
+        if (replenish > rq->clock) {
+            until = MIN(until, replenish);
+        }
+
+        uint64_t ran = until - rq->clock;
+        rq->clock = until;
+        update_curr(rq);
+
+        if (task && task->burst_ns) {
+            task->burst_left -= ran;
+            if (task->burst_left == 0) {
+                uint64_t due = task->release + (curr->dl_deadline ? curr->dl_deadline : task->period_ns);
+                if (task->period_ns && rq->clock > due) {
+                    task->misses++;
+                }
+
+                if (task->period_ns) {
+                    task->wake_at = task->release + task->period_ns;
+                    while (task->wake_at <= rq->clock) {
+                        task->wake_at += task->period_ns;
+                    }
+                } else {
+                    task->wake_at = rq->clock + task->sleep_ns;
+                }
+                task->burst_left = task->burst_ns;
+                curr->state = PROC_STATE_BLOCKED;
+                rq->need_resched = true;
+                bursts++;
+            }
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (tasks[i].wake_at && tasks[i].wake_at <= rq->clock) {
+                tasks[i].wake_at = 0;
+                tasks[i].release = rq->clock;
+                tasks[i].released = tasks[i].period_ns != 0;
+                rq_enqueue(rq, &sched_bench_threads[i], true);
+            }
+        }
+        dl_replenish(rq);
+
+        if (rq->clock % SCHED_BENCH_TICK_NS == 0) {
+            check_preempt_tick(rq);
+        }
+        if (rq->need_resched || !rq->current) {
+            sched_bench_schedule(tasks);
+        }
+    }
+
+    return bursts;
+}
+
+status_t sched_benchmark(uint32_t cpu_threads, uint32_t io_threads, sched_bench_result_t* result) {
+    if (!result || cpu_threads < 1 || cpu_threads + io_threads > SCHED_BENCH_MAX_THREADS) {
+        return STATUS_INVALID;
+    }
+
+    uint64_t time_slice = scheduler.initialized ? scheduler.config.time_slice_ns : 10000000ULL;
+    sched_bench_task_t tasks[SCHED_BENCH_MAX_THREADS];
+    uint32_t count = cpu_threads + io_threads;
+
+    /* Mixed CPU and IO threads at the same priority */
+    rq_init(&sched_bench_rq, time_slice);
+    for (uint32_t i = 0; i < count; i++) {
+        bool io = i >= cpu_threads;
+        sched_bench_add(tasks, i, PRIORITY_NORMAL, io ? SCHED_BENCH_IO_BURST_NS : 0,
+                        SCHED_BENCH_IO_SLEEP_NS, 0);
+    }
+    result->io_bursts = sched_bench_run(tasks, count);
+    result->duration_ns = SCHED_BENCH_DURATION_NS;
+    result->context_switches = sched_bench_rq.context_switches;
+    result->wakeup_avg_ns = sched_bench_rq.wakeups ?
+        sched_bench_rq.wakeup_latency_total_ns / sched_bench_rq.wakeups : 0;
+    result->wakeup_max_ns = sched_bench_rq.wakeup_latency_max_ns;
+
+    /* Jain's index: (sum x)^2 / (n * sum x^2), in microseconds to stay in range */
+    uint64_t sum = 0;
+    uint64_t sum_sq = 0;
+    for (uint32_t i = 0; i < cpu_threads; i++) {
+        uint64_t us = sched_bench_threads[i].cpu_time / 1000;
+        sum += us;
+        sum_sq += us * us;
+    }
+    result->fairness_permille = sum_sq ? (uint32_t)(sum * sum * 1000 / (cpu_threads * sum_sq)) : 0;
+
+    /* Two CPU hogs, nice 0 against nice 5 */
+    rq_init(&sched_bench_rq, time_slice);
+    sched_bench_add(tasks, 0, PRIORITY_NORMAL, 0, 0, 0);
+    sched_bench_add(tasks, 1, PRIORITY_LOW, 0, 0, 0);
+    sched_bench_run(tasks, 2);
+    result->weighted_ratio_x100 = sched_bench_threads[1].cpu_time ?
+        (uint32_t)(sched_bench_threads[0].cpu_time * 100 / sched_bench_threads[1].cpu_time) : 0;
+
+    /* A low-priority thread next to a high-priority hog no longer starves */
+    rq_init(&sched_bench_rq, time_slice);
+    sched_bench_add(tasks, 0, PRIORITY_HIGH, 0, 0, 0);
+    sched_bench_add(tasks, 1, PRIORITY_LOW, 0, 0, 0);
+    sched_bench_run(tasks, 2);
+    result->low_share_permille = (uint32_t)(sched_bench_threads[1].cpu_time * 1000 / SCHED_BENCH_DURATION_NS);
+
+    return STATUS_OK;
+}
+
+/* Audio: 150 us every 1 ms; control loop: 400 us every 5 ms; runaway: spins forever */
+#define SCHED_DL_BENCH_AUDIO_NS     150000ULL
+#define SCHED_DL_BENCH_CONTROL_NS   400000ULL
+
+static void sched_dl_bench_setup(sched_bench_task_t* tasks, uint32_t background, bool deadline) {
+    sched_rq_t* rq = &sched_bench_rq;
+    rq_init(rq, scheduler.initialized ? scheduler.config.time_slice_ns : 10000000ULL);
+
+    thread_t* audio = sched_bench_add(tasks, 0, PRIORITY_HIGH, SCHED_DL_BENCH_AUDIO_NS, 0, 1000000ULL);
+    thread_t* control = sched_bench_add(tasks, 1, PRIORITY_HIGH, SCHED_DL_BENCH_CONTROL_NS, 0, 5000000ULL);
+    thread_t* runaway = sched_bench_add(tasks, 2, PRIORITY_HIGH, 0, 0, 0);
+    for (uint32_t i = 0; i < background; i++) {
+        sched_bench_add(tasks, 3 + i, PRIORITY_NORMAL, 0, 0, 0);
+    }
+
+    if (deadline) {
+        rq_set_deadline(rq, audio, 200000ULL, 1000000ULL, 1000000ULL);
+        rq_set_deadline(rq, control, 500000ULL, 5000000ULL, 5000000ULL);
+        rq_set_deadline(rq, runaway, 2000000ULL, 10000000ULL, 10000000ULL);
+    }
+}
+
+status_t sched_deadline_benchmark(uint32_t background_threads, sched_dl_bench_result_t* result) {
+    if (!result || background_threads + 3 > SCHED_BENCH_MAX_THREADS) {
+        return STATUS_INVALID;
+    }
+
+    sched_bench_task_t tasks[SCHED_BENCH_MAX_THREADS];
+    uint32_t count = background_threads + 3;
+
+    /* Deadline class: audio, control loop and a runaway reservation */
+    sched_dl_bench_setup(tasks, background_threads, true);
+    sched_bench_run(tasks, count);
+
+    result->activations = tasks[0].activations;
+    result->max_jitter_ns = tasks[0].jitter_max_ns;
+    result->avg_jitter_ns = tasks[0].activations ? tasks[0].jitter_total_ns / tasks[0].activations : 0;
+    result->deadline_misses = tasks[0].misses + tasks[1].misses;
+    result->hog_share_permille = (uint32_t)(sched_bench_threads[2].cpu_time * 1000 / SCHED_BENCH_DURATION_NS);
+
+    uint64_t background = 0;
+    for (uint32_t i = 3; i < count; i++) {
+        background += sched_bench_threads[i].cpu_time;
+    }
+    result->background_share_permille = (uint32_t)(background * 1000 / SCHED_BENCH_DURATION_NS);
+
+    /* The same threads as high-priority fair threads */
+    sched_dl_bench_setup(tasks, background_threads, false);
+    sched_bench_run(tasks, count);
+    result->fair_max_jitter_ns = tasks[0].jitter_max_ns;
+
+    /* Admission: 30% reservations until the 95% limit refuses one */
+    rq_init(&sched_bench_rq, 10000000ULL);
+    result->admitted = 0;
+    for (uint32_t i = 0; i < SCHED_BENCH_MAX_THREADS; i++) {
+        thread_t* thread = sched_bench_add(tasks, i, PRIORITY_NORMAL, 0, 0, 0);
+        if (FAILED(rq_set_deadline(&sched_bench_rq, thread, 3000000ULL, 10000000ULL, 10000000ULL))) {
+            break;
+        }
+        result->admitted++;
+    }
+
+    return STATUS_OK;
+}
+
+/*
+ * AI hook overhead: the mixed workload with the scheduler model off and on.
+ * Rounds alternate so both modes see the same cache and frequency state.
+ */
+#define SCHED_AI_BENCH_ROUNDS  32
+
+/* Preempt a thread that has run 2 ms while another waits with less vruntime */
+static const struct {
+    ai_model_header_t header;
+    ai_model_node_t nodes[5];
+} sched_ai_bench_model = {
+    .header = { AI_MODEL_MAGIC, AI_MODEL_TREE, 5, 1, 0 },
+    .nodes = {
+        { .feature = 2, .left = 1, .right = 2, .value = 2000000 },
+        { .feature = AI_MODEL_LEAF, .confidence = 90, .value = 0 },
+        { .feature = 3, .left = 3, .right = 4, .value = 0 },
+        { .feature = AI_MODEL_LEAF, .confidence = 80, .value = 0 },
+        { .feature = AI_MODEL_LEAF, .confidence = 90, .value = 1 },
+    },
+};
+
+status_t sched_ai_benchmark(uint32_t cpu_threads, uint32_t io_threads, const void* model,
+                            size_t model_size, sched_ai_bench_result_t* result) {
+    if (!result || cpu_threads < 1 || cpu_threads + io_threads > SCHED_BENCH_MAX_THREADS) {
+        return STATUS_INVALID;
+    }
+    if (!model) {
+        model = &sched_ai_bench_model;
+        model_size = sizeof(sched_ai_bench_model);
+    }
+
+    ai_model_t* compiled;
+    status_t status = ai_model_compile(model, model_size, &compiled);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    /* The model is live for the duration; the installed one is put back after */
+    ai_model_t* saved = ai_model_swap(AI_HOOK_SCHEDULER, compiled);
+    bool decisions = g_ai_decision_enabled;
+    g_ai_decision_enabled = true;
+
+    uint64_t time_slice = scheduler.initialized ? scheduler.config.time_slice_ns : 10000000ULL;
+    sched_bench_task_t tasks[SCHED_BENCH_MAX_THREADS];
+    uint32_t count = cpu_threads + io_threads;
+    uint64_t elapsed[2] = {0, 0};
+
+    *result = (sched_ai_bench_result_t){0};
+    for (uint32_t round = 0; round < SCHED_AI_BENCH_ROUNDS; round++) {
+        for (uint32_t hook = 0; hook < 2; hook++) {
+            rq_init(&sched_bench_rq, time_slice);
+            sched_bench_rq.ai_hook = hook;
+            for (uint32_t i = 0; i < count; i++) {
+                bool io = i >= cpu_threads;
+                sched_bench_add(tasks, i, PRIORITY_NORMAL, io ? SCHED_BENCH_IO_BURST_NS : 0,
+                                SCHED_BENCH_IO_SLEEP_NS, 0);
+            }
+
+            uint64_t start = perf_timestamp_ns();
+            sched_bench_run(tasks, count);
+            elapsed[hook] += perf_timestamp_ns() - start;
+
+            result->schedules[hook] += sched_bench_rq.schedules;
+            result->context_switches[hook] += sched_bench_rq.context_switches;
+            result->decisions += sched_bench_rq.ai_decisions;
+            result->ai_preemptions += sched_bench_rq.ai_preemptions;
+        }
+    }
+
+    g_ai_decision_enabled = decisions;
+    ai_model_free(ai_model_swap(AI_HOOK_SCHEDULER, saved));
+
+    for (uint32_t hook = 0; hook < 2; hook++) {
+        result->ns_per_schedule[hook] = result->schedules[hook] ?
+            elapsed[hook] / result->schedules[hook] : 0;
+    }
+    /* Charge the hook run's extra schedules at the baseline rate, the rest to the decisions */
+    uint64_t baseline = result->ns_per_schedule[0] * result->schedules[1];
+    result->ns_per_decision = result->decisions && elapsed[1] > baseline ?
+        (elapsed[1] - baseline) / result->decisions : 0;
+    return STATUS_OK;
+}
@@ -6,6 +6,10 @@
 #include "kernel.h"
 #include "microkernel.h"
 #include "vfs.h"
+#include "page_cache.h"
+
+/* Mount records hold two full paths and span more than one page */
+#define VFS_MOUNT_PAGES ((sizeof(vfs_mount_t) + PAGE_SIZE - 1) / PAGE_SIZE)
 
 /* Global VFS state */
 static struct {
@@ -81,7 +85,7 @@ void vfs_shutdown(void) {
         if (mount->private_data) {
             pmm_free_page((paddr_t)mount->private_data);
         }
-        pmm_free_page((paddr_t)mount);
+        pmm_free_pages((paddr_t)mount, VFS_MOUNT_PAGES);
     }
 
     vfs_state.initialized = false;
@@ -144,7 +148,7 @@ status_t vfs_mount(const char* device, const char* mount_point, const char* fs_t
     }
 
     /* Allocate mount structure */
-    vfs_mount_t* mount = (vfs_mount_t*)pmm_alloc_page();
+    vfs_mount_t* mount = (vfs_mount_t*)pmm_alloc_pages(VFS_MOUNT_PAGES);
     if (!mount) {
         return STATUS_NOMEM;
     }
@@ -165,7 +169,7 @@ status_t vfs_mount(const char* device, const char* mount_point, const char* fs_t
     if (fs->ops->mount) {
         status_t status = fs->ops->mount(mount, device, flags);
         if (FAILED(status)) {
-            pmm_free_page((paddr_t)mount);
+            pmm_free_pages((paddr_t)mount, VFS_MOUNT_PAGES);
             KLOG_ERROR("VFS", "Failed to mount %s: %d", fs_type, status);
             return status;
         }
@@ -316,7 +320,8 @@ status_t vfs_resolve_path(const char* path, vfs_node_t** out_node) {
     char component[VFS_MAX_NAME];
     int comp_idx = 0;
 
-    while (*p) {
+    /* Loop through the terminator so the final component is looked up too */
+    for (;;) {
         if (*p == '/' || *p == '\0') {
             if (comp_idx > 0) {
                 component[comp_idx] = '\0';
@@ -387,10 +392,7 @@ void vfs_node_free(vfs_node_t* node) {
         return;
     }
 
-    if (node->private_data) {
-        pmm_free_page((paddr_t)node->private_data);
-    }
-
+    /* private_data belongs to the filesystem driver (ramdisk points it into its own table) */
     pmm_free_page((paddr_t)node);
 }
 
@@ -421,6 +423,11 @@ status_t vfs_open(const char* path, uint32_t flags, uint32_t mode, vfs_file_t**
     vfs_node_t* node = NULL;
     status_t status = vfs_resolve_path(path, &node);
 
+    if (SUCCESS(status) && (flags & VFS_O_CREAT) && (flags & VFS_O_EXCL)) {
+        vfs_node_unref(node);
+        return STATUS_EXISTS;
+    }
+
     /* Handle O_CREAT */
     if (FAILED(status) && (flags & VFS_O_CREAT)) {
         /* Extract parent directory and filename */
@@ -479,6 +486,17 @@ status_t vfs_open(const char* path, uint32_t flags, uint32_t mode, vfs_file_t**
         }
     }
 
+    /* Handle O_TRUNC on writable opens */
+    if ((flags & VFS_O_TRUNC) && (flags & (VFS_O_WRONLY | VFS_O_RDWR)) &&
+        node->file_ops && node->file_ops->truncate) {
+        status = node->file_ops->truncate(node, 0);
+        if (FAILED(status)) {
+            vfs_node_unref(node);
+            return status;
+        }
+        page_cache_refresh(node, 0, UINT64_MAX);
+    }
+
     /* Allocate file descriptor */
     vfs_file_t* file = (vfs_file_t*)pmm_alloc_page();
     if (!file) {
@@ -490,6 +508,8 @@ status_t vfs_open(const char* path, uint32_t flags, uint32_t mode, vfs_file_t**
     file->offset = 0;
     file->flags = flags;
     file->ref_count = 1;
+    file->advice = VFS_ADV_NORMAL;
+    ra_init(&file->ra);
 
     *out_file = file;
     return STATUS_OK;
@@ -501,6 +521,7 @@ status_t vfs_close(vfs_file_t* file) {
         return STATUS_INVALID;
     }
 
+    ra_release(&file->ra);
     if (file->node) {
         if (file->node->file_ops && file->node->file_ops->close) {
             file->node->file_ops->close(file->node);
@@ -512,6 +533,55 @@ status_t vfs_close(vfs_file_t* file) {
     return STATUS_OK;
 }
 
+/* Regular files on a backing device are read through the page cache */
+static bool vfs_read_cached(vfs_file_t* file) {
+    vfs_node_t* node = file->node;
+    return node->type == VFS_TYPE_FILE && node->mount &&
+           !(node->mount->flags & VFS_MOUNT_MEMORY);
+}
+
+/* Vectored read through the page cache, read-ahead driven by the file's tracker */
+static ssize_t vfs_cached_readv(vfs_file_t* file, const vfs_iovec_t* iov, uint32_t iovcnt,
+                                uint64_t pos) {
+    vfs_node_t* node = file->node;
+    if (pos >= node->size) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        total += iov[i].len;
+    }
+    total = MIN(total, node->size - pos);
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t first = pos / PAGE_SIZE;
+    uint64_t count = (pos + total - 1) / PAGE_SIZE - first + 1;
+    page_cache_ra_access(node, &file->ra, first, (uint32_t)MIN(count, (uint64_t)UINT32_MAX));
+
+    ssize_t done = 0;
+    for (uint32_t i = 0; i < iovcnt && (uint64_t)done < total; i++) {
+        size_t len = (size_t)MIN((uint64_t)iov[i].len, total - (uint64_t)done);
+        if (len == 0) {
+            continue;
+        }
+        ssize_t n = page_cache_read(node, iov[i].base, len, pos + (uint64_t)done);
+        if (n < 0) {
+            if (done == 0) {
+                done = n;
+            }
+            break;
+        }
+        done += n;
+        if ((size_t)n < len) {
+            break;
+        }
+    }
+    return done;
+}
+
 /* Read from file */
 ssize_t vfs_read(vfs_file_t* file, void* buffer, size_t size) {
     if (!file || !file->node || !buffer) {
@@ -522,7 +592,13 @@ ssize_t vfs_read(vfs_file_t* file, void* buffer, size_t size) {
         return -1;
     }
 
-    ssize_t result = file->node->file_ops->read(file->node, buffer, size, file->offset);
+    ssize_t result;
+    if (vfs_read_cached(file)) {
+        vfs_iovec_t iov = { buffer, size };
+        result = vfs_cached_readv(file, &iov, 1, file->offset);
+    } else {
+        result = file->node->file_ops->read(file->node, buffer, size, file->offset);
+    }
     if (result > 0) {
         file->offset += result;
     }
@@ -542,31 +618,346 @@ ssize_t vfs_write(vfs_file_t* file, const void* buffer, size_t size) {
 
     ssize_t result = file->node->file_ops->write(file->node, buffer, size, file->offset);
     if (result > 0) {
+        page_cache_refresh(file->node, file->offset, (uint64_t)result);
         file->offset += result;
     }
 
     return result;
 }
 
+/* Seek */
+status_t vfs_seek(vfs_file_t* file, int64_t offset, int whence, uint64_t* out_offset) {
+    if (!file || !file->node) {
+        return STATUS_INVALID;
+    }
+
+    int64_t base;
+    switch (whence) {
+        case VFS_SEEK_SET: base = 0; break;
+        case VFS_SEEK_CUR: base = (int64_t)file->offset; break;
+        case VFS_SEEK_END: base = (int64_t)file->node->size; break;
+        default: return STATUS_INVALID;
+    }
+
+    if (base + offset < 0) {
+        return STATUS_INVALID;
+    }
+
+    file->offset = (uint64_t)(base + offset);
+    if (out_offset) {
+        *out_offset = file->offset;
+    }
+    return STATUS_OK;
+}
+
+/* Validate a vector and return its total length, or -1 if it is malformed */
+static int64_t vfs_iov_total(const vfs_iovec_t* iov, uint32_t iovcnt) {
+    if (!iov || iovcnt > VFS_IOV_MAX) {
+        return -1;
+    }
+
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        if (iov[i].len && !iov[i].base) {
+            return -1;
+        }
+        total += iov[i].len;
+        if (total > (uint64_t)INT64_MAX) {
+            return -1;
+        }
+    }
+    return (int64_t)total;
+}
+
+/* Vectored read at offset (negative offset = file position) */
+ssize_t vfs_preadv(vfs_file_t* file, const vfs_iovec_t* iov, uint32_t iovcnt, int64_t offset) {
+    if (!file || !file->node) {
+        return STATUS_INVALID;
+    }
+    if ((file->flags & 0x3) == VFS_O_WRONLY) {
+        return STATUS_DENIED;
+    }
+    if (vfs_iov_total(iov, iovcnt) < 0) {
+        return STATUS_INVALID;
+    }
+
+    vfs_file_ops_t* ops = file->node->file_ops;
+    if (!ops || (!ops->readv && !ops->read)) {
+        return STATUS_NOSUPPORT;
+    }
+
+    uint64_t pos = offset < 0 ? file->offset : (uint64_t)offset;
+    ssize_t done = 0;
+
+    if (vfs_read_cached(file)) {
+        done = vfs_cached_readv(file, iov, iovcnt, pos);
+    } else if (ops->readv) {
+        done = ops->readv(file->node, iov, iovcnt, pos);
+    } else {
+        for (uint32_t i = 0; i < iovcnt; i++) {
+            if (iov[i].len == 0) {
+                continue;
+            }
+            ssize_t n = ops->read(file->node, iov[i].base, iov[i].len, pos + done);
+            if (n < 0) {
+                if (done == 0) {
+                    done = n;
+                }
+                break;
+            }
+            done += n;
+            if ((size_t)n < iov[i].len) {
+                break;  /* End of file */
+            }
+        }
+    }
+
+    if (done > 0 && offset < 0) {
+        file->offset += done;
+    }
+    return done;
+}
+
+/* Vectored write at offset (negative offset = file position) */
+ssize_t vfs_pwritev(vfs_file_t* file, const vfs_iovec_t* iov, uint32_t iovcnt,
+                    int64_t offset, uint32_t flags) {
+    if (!file || !file->node) {
+        return STATUS_INVALID;
+    }
+    if ((file->flags & 0x3) == VFS_O_RDONLY) {
+        return STATUS_DENIED;
+    }
+    if (vfs_iov_total(iov, iovcnt) < 0) {
+        return STATUS_INVALID;
+    }
+
+    vfs_file_ops_t* ops = file->node->file_ops;
+    if (!ops || (!ops->writev && !ops->write)) {
+        return STATUS_NOSUPPORT;
+    }
+
+    bool append = (flags & VFS_RW_APPEND) || (offset < 0 && (file->flags & VFS_O_APPEND));
+    uint64_t pos = append ? file->node->size : (offset < 0 ? file->offset : (uint64_t)offset);
+    ssize_t done = 0;
+
+    if (ops->writev) {
+        done = ops->writev(file->node, iov, iovcnt, pos);
+    } else {
+        for (uint32_t i = 0; i < iovcnt; i++) {
+            if (iov[i].len == 0) {
+                continue;
+            }
+            ssize_t n = ops->write(file->node, iov[i].base, iov[i].len, pos + done);
+            if (n < 0) {
+                if (done == 0) {
+                    done = n;
+                }
+                break;
+            }
+            done += n;
+            if ((size_t)n < iov[i].len) {
+                break;
+            }
+        }
+    }
+
+    if (done > 0) {
+        page_cache_refresh(file->node, pos, (uint64_t)done);
+    }
+    if (done > 0 && offset < 0) {
+        file->offset = pos + done;
+    }
+    if (done > 0 && (flags & VFS_RW_SYNC) && ops->flush) {
+        status_t status = ops->flush(file->node);
+        if (FAILED(status)) {
+            return status;
+        }
+    }
+    return done;
+}
+
+/* Positional read */
+ssize_t vfs_pread(vfs_file_t* file, void* buffer, size_t size, int64_t offset) {
+    vfs_iovec_t iov = { buffer, size };
+    return vfs_preadv(file, &iov, 1, offset);
+}
+
+/* Positional write */
+ssize_t vfs_pwrite(vfs_file_t* file, const void* buffer, size_t size, int64_t offset) {
+    vfs_iovec_t iov = { (void*)buffer, size };
+    return vfs_pwritev(file, &iov, 1, offset, 0);
+}
+
+/* Preallocate backing store for a range */
+status_t vfs_fallocate(vfs_file_t* file, uint32_t mode, uint64_t offset, uint64_t len) {
+    if (!file || !file->node || len == 0 || (mode & ~VFS_ALLOC_KEEP_SIZE)) {
+        return STATUS_INVALID;
+    }
+    if ((file->flags & 0x3) == VFS_O_RDONLY) {
+        return STATUS_DENIED;
+    }
+
+    vfs_file_ops_t* ops = file->node->file_ops;
+    if (!ops || !ops->allocate) {
+        return STATUS_NOSUPPORT;
+    }
+    return ops->allocate(file->node, mode, offset, len);
+}
+
+/* Record an access pattern hint and pass it to the filesystem */
+status_t vfs_fadvise(vfs_file_t* file, uint64_t offset, uint64_t len, uint32_t advice) {
+    if (!file || !file->node || advice > VFS_ADV_NOREUSE) {
+        return STATUS_INVALID;
+    }
+
+    /* Whole-file hints change how later reads are treated */
+    if (offset == 0 && len == 0 && advice <= VFS_ADV_SEQUENTIAL) {
+        file->advice = advice;
+        ra_advise(&file->ra, advice);
+    }
+
+    /* The range is wanted soon: start reading it now */
+    if (advice == VFS_ADV_WILLNEED && vfs_read_cached(file) && file->node->size > offset) {
+        uint64_t end = len ? MIN(offset + len, file->node->size) : file->node->size;
+        uint64_t first = offset / PAGE_SIZE;
+        uint64_t count = (end + PAGE_SIZE - 1) / PAGE_SIZE - first;
+        page_cache_readahead(file->node, first, (uint32_t)MIN(count, (uint64_t)RA_MAX_PAGES));
+    }
+
+    /* Unmapped cached copies of the range are no longer wanted */
+    if (advice == VFS_ADV_DONTNEED) {
+        uint64_t first = offset / PAGE_SIZE;
+        uint64_t count = len ? (offset + len + PAGE_SIZE - 1) / PAGE_SIZE - first : 0;
+        page_cache_drop(file->node, first, count);
+    }
+
+    vfs_file_ops_t* ops = file->node->file_ops;
+    if (ops && ops->advise) {
+        return ops->advise(file->node, offset, len, advice);
+    }
+    return STATUS_OK;
+}
+
+/* Read-ahead counters of an open file */
+status_t vfs_readahead_stats(vfs_file_t* file, ra_stats_t* stats) {
+    if (!file || !stats) {
+        return STATUS_INVALID;
+    }
+    *stats = file->ra.stats;
+    return STATUS_OK;
+}
+
+/*
+ * Copy a range between two open files without returning to the caller.
+ * Data moves through a kernel bounce buffer of VFS_COPY_CHUNK_PAGES pages.
+ */
+#define VFS_COPY_CHUNK_PAGES 16
+ssize_t vfs_copy_range(vfs_file_t* in, int64_t in_offset,
+                       vfs_file_t* out, int64_t out_offset, size_t len) {
+    if (!in || !in->node || !out || !out->node) {
+        return STATUS_INVALID;
+    }
+    if ((in->flags & 0x3) == VFS_O_WRONLY || (out->flags & 0x3) == VFS_O_RDONLY) {
+        return STATUS_DENIED;
+    }
+
+    vfs_file_ops_t* in_ops = in->node->file_ops;
+    vfs_file_ops_t* out_ops = out->node->file_ops;
+    if (!in_ops || !in_ops->read || !out_ops || !out_ops->write) {
+        return STATUS_NOSUPPORT;
+    }
+
+    uint64_t src = in_offset < 0 ? in->offset : (uint64_t)in_offset;
+    uint64_t dst = (out->flags & VFS_O_APPEND) ? out->node->size
+                 : (out_offset < 0 ? out->offset : (uint64_t)out_offset);
+
+    /* Overlapping copies within one file are undefined; refuse them */
+    if (in->node == out->node && src < dst + len && dst < src + len) {
+        return STATUS_INVALID;
+    }
+
+    uint8_t* bounce = (uint8_t*)pmm_alloc_pages(VFS_COPY_CHUNK_PAGES);
+    if (!bounce) {
+        return STATUS_NOMEM;
+    }
+
+    ssize_t done = 0;
+    while ((size_t)done < len) {
+        size_t chunk = MIN(len - (size_t)done, VFS_COPY_CHUNK_PAGES * PAGE_SIZE);
+        ssize_t n = in_ops->read(in->node, bounce, chunk, src + done);
+        if (n <= 0) {
+            if (n < 0 && done == 0) {
+                done = n;
+            }
+            break;
+        }
+
+        ssize_t w = out_ops->write(out->node, bounce, (size_t)n, dst + done);
+        if (w < 0) {
+            if (done == 0) {
+                done = w;
+            }
+            break;
+        }
+        done += w;
+        if (w < n) {
+            break;
+        }
+    }
+
+    pmm_free_pages((paddr_t)bounce, VFS_COPY_CHUNK_PAGES);
+
+    if (done > 0) {
+        page_cache_refresh(out->node, dst, (uint64_t)done);
+        if (in_offset < 0) {
+            in->offset += done;
+        }
+        if (out_offset < 0) {
+            out->offset = dst + done;
+        }
+    }
+    return done;
+}
+
 /* File statistics */
+static void vfs_node_stat(const vfs_node_t* node, vfs_stat_t* stat) {
+    stat->inode = node->inode;
+    stat->mode = node->mode;
+    stat->type = node->type;
+    stat->uid = node->uid;
+    stat->gid = node->gid;
+    stat->size = node->size;
+    stat->atime = node->atime;
+    stat->mtime = node->mtime;
+    stat->ctime = node->ctime;
+    stat->nlink = node->nlink;
+    stat->blocks = (node->size + 4095) / 4096;
+    stat->block_size = 4096;
+}
+
 status_t vfs_fstat(vfs_file_t* file, vfs_stat_t* stat) {
     if (!file || !file->node || !stat) {
         return STATUS_INVALID;
     }
 
-    stat->inode = file->node->inode;
-    stat->mode = file->node->mode;
-    stat->type = file->node->type;
-    stat->uid = file->node->uid;
-    stat->gid = file->node->gid;
-    stat->size = file->node->size;
-    stat->atime = file->node->atime;
-    stat->mtime = file->node->mtime;
-    stat->ctime = file->node->ctime;
-    stat->nlink = file->node->nlink;
-    stat->blocks = (file->node->size + 4095) / 4096;
-    stat->block_size = 4096;
+    vfs_node_stat(file->node, stat);
+    return STATUS_OK;
+}
+
+/* Stat by path, without opening the node */
+status_t vfs_stat(const char* path, vfs_stat_t* stat) {
+    if (!path || !stat) {
+        return STATUS_INVALID;
+    }
+
+    vfs_node_t* node;
+    status_t status = vfs_resolve_path(path, &node);
+    if (FAILED(status)) {
+        return status;
+    }
 
+    vfs_node_stat(node, stat);
+    vfs_node_unref(node);
     return STATUS_OK;
 }
 
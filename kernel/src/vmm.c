@@ -6,6 +6,8 @@
 #include "kernel.h"
 #include "microkernel.h"
 #include "vmm.h"
+#include "vfs.h"
+#include "page_cache.h"
 
 /* Kernel address space */
 static address_space_t kernel_address_space = {0};
@@ -14,8 +16,13 @@ static address_space_t* current_aspace = NULL;
 /* VMM statistics */
 static vmm_stats_t vmm_stats = {0};
 
-/* VMM lock */
-static volatile uint32_t UNUSED vmm_lock = 0;
+/* VMM lock (region pool) */
+static volatile uint32_t vmm_lock = 0;
+
+/* Region descriptors */
+#define VMM_MAX_REGIONS 4096
+static vm_region_t region_pool[VMM_MAX_REGIONS];
+static bool region_used[VMM_MAX_REGIONS];
 
 /* Helper: Allocate page table */
 static page_table_t* alloc_page_table(void) {
@@ -131,8 +138,8 @@ status_t vmm_create_address_space(address_space_t** out_aspace) {
         aspace->pml4_virt->entries[i] = 0;
     }
 
-    /* Copy kernel mappings (upper half) */
-    for (int i = 256; i < 512; i++) {
+    /* Copy kernel mappings (upper half), once vmm_init has built them */
+    for (int i = 256; i < 512 && kernel_address_space.pml4_virt; i++) {
         aspace->pml4_virt->entries[i] = kernel_address_space.pml4_virt->entries[i];
     }
 
@@ -153,6 +160,9 @@ status_t vmm_destroy_address_space(address_space_t* aspace) {
         return STATUS_INVALID;
     }
 
+    /* Release demand-paged memory before the tables that map it */
+    vmm_release_regions(aspace);
+
     __sync_lock_test_and_set(&aspace->lock, 1);
 
     /* Free all page tables (only user half) */
@@ -342,6 +352,12 @@ status_t vmm_get_physical(address_space_t* aspace, vaddr_t vaddr, paddr_t* out_p
     return STATUS_OK;
 }
 
+/* Check whether a page is mapped */
+bool vmm_is_mapped(address_space_t* aspace, vaddr_t vaddr) {
+    paddr_t paddr;
+    return SUCCESS(vmm_get_physical(aspace, vaddr, &paddr));
+}
+
 /* Identity map region */
 status_t vmm_identity_map(paddr_t start, size_t size, uint32_t flags) {
     vaddr_t vaddr = start;
@@ -373,10 +389,805 @@ address_space_t* vmm_get_current_address_space(void) {
     return current_aspace;
 }
 
+/* ============================================================================
+ * Regions and demand paging
+ * ============================================================================ */
+
+/* Find the PTE for a page; NULL if a table is missing and create is false */
+static pte_t* vmm_pte(address_space_t* aspace, vaddr_t vaddr, bool create) {
+    page_table_t* table = aspace->pml4_virt;
+    uint32_t index[3] = { VADDR_PML4_INDEX(vaddr), VADDR_PDPT_INDEX(vaddr), VADDR_PD_INDEX(vaddr) };
+
+    for (int level = 0; level < 3; level++) {
+        pte_t entry = table->entries[index[level]];
+        if (entry & PTE_PRESENT) {
+            table = (page_table_t*)PHYS_TO_VIRT_DIRECT(PTE_GET_ADDR(entry));
+        } else if (create) {
+            table = get_or_create_table(table, index[level]);
+            if (!table) {
+                return NULL;
+            }
+        } else {
+            return NULL;
+        }
+    }
+    return &table->entries[VADDR_PT_INDEX(vaddr)];
+}
+
+/* Install a user PTE, keeping bits vmm_map_page() would strip (NX, software bits) */
+static status_t region_set_pte(address_space_t* aspace, vaddr_t vaddr, paddr_t paddr, uint64_t flags) {
+    pte_t* pte = vmm_pte(aspace, vaddr, true);
+    if (!pte) {
+        return STATUS_NOMEM;
+    }
+
+    *pte = (paddr & PTE_ADDR_MASK) | flags | PTE_PRESENT;
+    vmm_stats.total_pages_mapped++;
+    vmm_stats.user_pages++;
+    return STATUS_OK;
+}
+
+static ALWAYS_INLINE uint64_t region_index(const vm_region_t* region, vaddr_t vaddr) {
+    return (region->offset + (vaddr - region->start)) / PAGE_SIZE;
+}
+
+/* PTE flags for a region; private file pages start read-only so writes copy them */
+static ALWAYS_INLINE uint64_t region_pte_flags(const vm_region_t* region, bool cached) {
+    uint64_t flags = region->flags & (PTE_WRITE | PTE_USER | PTE_NX);
+    if (cached) {
+        flags = (flags & ~PTE_WRITE) | PTE_CACHED;
+    }
+    return flags;
+}
+
+/* Unmap one page and release its frame */
+static void region_release_page(vm_region_t* region, vaddr_t vaddr, pte_t* pte) {
+    pte_t old = *pte;
+    *pte = 0;
+    tlb_flush_page(vaddr);
+    vmm_stats.total_pages_mapped--;
+
+    if (old & PTE_CACHED) {
+        page_cache_put(region->node, region_index(region, vaddr));
+    } else {
+        pmm_free_page(PTE_GET_ADDR(old));
+    }
+}
+
+/* Release every mapped page of a region in [start, end), skipping missing tables */
+static void region_release_range(address_space_t* aspace, vm_region_t* region, vaddr_t start, vaddr_t end) {
+    vaddr_t vaddr = start;
+    while (vaddr < end) {
+        pte_t* pte = vmm_pte(aspace, vaddr, false);
+        if (!pte) {
+            vaddr = (vaddr + MB(2)) & ~(MB(2) - 1);
+            continue;
+        }
+        if (*pte & PTE_PRESENT) {
+            region_release_page(region, vaddr, pte);
+        }
+        vaddr += PAGE_SIZE;
+    }
+}
+
+static vm_region_t* region_alloc(void) {
+    while (__sync_lock_test_and_set(&vmm_lock, 1)) {
+        __asm__ volatile("pause");
+    }
+    vm_region_t* region = NULL;
+    for (uint32_t i = 0; i < VMM_MAX_REGIONS; i++) {
+        if (!region_used[i]) {
+            region_used[i] = true;
+            region = &region_pool[i];
+            break;
+        }
+    }
+    __sync_lock_release(&vmm_lock);
+
+    if (region) {
+        region->node = NULL;
+        region->offset = 0;
+        region->advice = VM_MADV_NORMAL;
+        region->vm_flags = 0;
+        ra_init(&region->ra);
+        list_init(&region->list_node);
+    }
+    return region;
+}
+
+static void region_free(address_space_t* aspace, vm_region_t* region) {
+    list_del(&region->list_node);
+    aspace->region_count--;
+    aspace->total_size -= region->end - region->start;
+
+    if (region->node) {
+        ra_release(&region->ra);
+        vfs_node_unref(region->node);
+    }
+
+    __sync_lock_test_and_set(&vmm_lock, 1);
+    region_used[region - region_pool] = false;
+    __sync_lock_release(&vmm_lock);
+}
+
+/* Insert keeping the list sorted by address; fails on overlap */
+static status_t region_insert(address_space_t* aspace, vm_region_t* region) {
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* other = list_entry(pos, vm_region_t, list_node);
+        if (other->start >= region->end) {
+            break;
+        }
+        if (other->end > region->start) {
+            return STATUS_EXISTS;
+        }
+    }
+
+    list_add(&region->list_node, pos->prev);
+    aspace->region_count++;
+    aspace->total_size += region->end - region->start;
+    return STATUS_OK;
+}
+
+/* Split a region at a page boundary; the upper half is returned */
+static vm_region_t* region_split(address_space_t* aspace, vm_region_t* region, vaddr_t at) {
+    vm_region_t* upper = region_alloc();
+    if (!upper) {
+        return NULL;
+    }
+
+    *upper = *region;
+    upper->start = at;
+    if (upper->node) {
+        upper->offset = region->offset + (at - region->start);
+        vfs_node_ref(upper->node);
+    }
+
+    region->end = at;
+    list_add(&upper->list_node, &region->list_node);
+    aspace->region_count++;
+    return upper;
+}
+
+static status_t region_create(address_space_t* aspace, vaddr_t start, size_t size, uint64_t flags,
+                              uint32_t type, vfs_node_t* node, uint64_t offset, uint32_t vm_flags) {
+    if (!aspace || size == 0 || (start & (PAGE_SIZE - 1)) || (offset & (PAGE_SIZE - 1)) ||
+        start + size < start || start + size > VM_REGION_USER_END) {
+        return STATUS_INVALID;
+    }
+
+    vm_region_t* region = region_alloc();
+    if (!region) {
+        return STATUS_NOMEM;
+    }
+
+    region->start = start;
+    region->end = start + PAGE_ALIGN_UP(size);
+    region->flags = flags | PTE_USER;
+    region->type = type;
+    region->node = node;
+    region->offset = offset;
+    region->vm_flags = vm_flags;
+
+    status_t status = region_insert(aspace, region);
+    if (FAILED(status)) {
+        region->node = NULL;
+        __sync_lock_test_and_set(&vmm_lock, 1);
+        region_used[region - region_pool] = false;
+        __sync_lock_release(&vmm_lock);
+        return status;
+    }
+
+    if (node) {
+        vfs_node_ref(node);
+    }
+    return STATUS_OK;
+}
+
+/* Add anonymous region */
+status_t vmm_add_region(address_space_t* aspace, vaddr_t start, size_t size, uint64_t flags, uint32_t type) {
+    return region_create(aspace, start, size, flags, type, NULL, 0, 0);
+}
+
+/* Add file-backed region */
+status_t vmm_add_file_region(address_space_t* aspace, vaddr_t start, size_t size, uint64_t flags,
+                             vfs_node_t* node, uint64_t offset, uint32_t vm_flags) {
+    if (!node) {
+        return STATUS_INVALID;
+    }
+    /* Shared mappings have no write-back path; only read-only ones are allowed */
+    if ((vm_flags & VM_SHARED) && (flags & PTE_WRITE)) {
+        return STATUS_NOSUPPORT;
+    }
+    return region_create(aspace, start, size, flags, VM_REGION_MMAP, node, offset, vm_flags);
+}
+
+/* Find region containing addr */
+vm_region_t* vmm_find_region(address_space_t* aspace, vaddr_t addr) {
+    if (!aspace) {
+        return NULL;
+    }
+
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (addr < region->start) {
+            break;
+        }
+        if (addr < region->end) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+/* First fit over the sorted region list */
+vaddr_t vmm_find_free_range(address_space_t* aspace, vaddr_t hint, size_t size) {
+    if (!aspace || size == 0) {
+        return 0;
+    }
+
+    vaddr_t candidate = PAGE_ALIGN_UP(hint);
+    size = PAGE_ALIGN_UP(size);
+
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (region->end <= candidate) {
+            continue;
+        }
+        if (region->start >= candidate + size) {
+            break;
+        }
+        candidate = region->end;
+    }
+
+    return candidate + size <= VM_REGION_USER_END ? candidate : 0;
+}
+
+/* Remove region starting at start */
+status_t vmm_remove_region(address_space_t* aspace, vaddr_t start) {
+    vm_region_t* region = vmm_find_region(aspace, start);
+    if (!region || region->start != start) {
+        return STATUS_NOTFOUND;
+    }
+
+    region_release_range(aspace, region, region->start, region->end);
+    region_free(aspace, region);
+    return STATUS_OK;
+}
+
+/* Split regions so that [start, end) begins and ends on region boundaries */
+static status_t region_isolate(address_space_t* aspace, vaddr_t start, vaddr_t end) {
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (region->start >= end) {
+            break;
+        }
+        if (region->end <= start) {
+            continue;
+        }
+        if (region->start < start && !region_split(aspace, region, start)) {
+            return STATUS_NOMEM;
+        }
+        if (region->end > end && region->start < end && !region_split(aspace, region, end)) {
+            return STATUS_NOMEM;
+        }
+    }
+    return STATUS_OK;
+}
+
+/* Unmap a range, trimming or splitting straddling regions */
+status_t vmm_remove_range(address_space_t* aspace, vaddr_t start, size_t size) {
+    if (!aspace || (start & (PAGE_SIZE - 1)) || size == 0) {
+        return STATUS_INVALID;
+    }
+
+    vaddr_t end = start + PAGE_ALIGN_UP(size);
+    status_t status = region_isolate(aspace, start, end);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    struct list_head* pos;
+    struct list_head* n;
+    list_for_each_safe(pos, n, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (region->start >= start && region->end <= end) {
+            region_release_range(aspace, region, region->start, region->end);
+            region_free(aspace, region);
+        }
+    }
+    return STATUS_OK;
+}
+
+/* Tear down all regions */
+void vmm_release_regions(address_space_t* aspace) {
+    struct list_head* pos;
+    struct list_head* n;
+    list_for_each_safe(pos, n, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        region_release_range(aspace, region, region->start, region->end);
+        region_free(aspace, region);
+    }
+}
+
+/* Copy region descriptors for fork; pages are copied separately */
+status_t vmm_clone_regions(address_space_t* src, address_space_t* dst) {
+    struct list_head* pos;
+    list_for_each(pos, &src->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        status_t status = region_create(dst, region->start, region->end - region->start,
+                                        region->flags, region->type, region->node,
+                                        region->offset, region->vm_flags);
+        if (FAILED(status)) {
+            return status;
+        }
+        vm_region_t* copy = vmm_find_region(dst, region->start);
+        copy->advice = region->advice;
+        ra_advise(&copy->ra, region->advice);
+    }
+    return STATUS_OK;
+}
+
+/* Frame for a fault; under memory pressure, MADV_FREE pages of the space go first */
+static paddr_t region_alloc_frame(address_space_t* aspace) {
+    paddr_t frame = pmm_alloc_page();
+    if (!frame && vmm_reclaim_lazy(aspace)) {
+        frame = pmm_alloc_page();
+    }
+    return frame;
+}
+
+/* Zero-filled page(s) for an anonymous fault; VM_HUGEPAGE fills the 2 MiB extent */
+static status_t anon_fault(address_space_t* aspace, vm_region_t* region, vaddr_t vaddr) {
+    vaddr_t start = vaddr;
+    vaddr_t end = vaddr + PAGE_SIZE;
+
+    if (region->vm_flags & VM_HUGEPAGE) {
+        start = MAX(vaddr & ~(MB(2) - 1), region->start);
+        end = MIN((vaddr & ~(MB(2) - 1)) + MB(2), region->end);
+    }
+
+    for (vaddr_t va = start; va < end; va += PAGE_SIZE) {
+        pte_t* pte = vmm_pte(aspace, va, false);
+        if (pte && (*pte & PTE_PRESENT)) {
+            continue;
+        }
+
+        paddr_t frame = region_alloc_frame(aspace);
+        if (!frame) {
+            return va == vaddr ? STATUS_NOMEM : STATUS_OK;
+        }
+
+        uint64_t* words = (uint64_t*)PHYS_TO_VIRT_DIRECT(frame);
+        for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+            words[i] = 0;
+        }
+
+        status_t status = region_set_pte(aspace, va, frame, region_pte_flags(region, false));
+        if (FAILED(status)) {
+            pmm_free_page(frame);
+            return status;
+        }
+        if (va != vaddr) {
+            vmm_stats.fault_around_pages++;
+        }
+    }
+    return STATUS_OK;
+}
+
+/* Fault-around window: aligned around the fault, or ahead of it for sequential access */
+static void fault_around_window(vm_region_t* region, vaddr_t vaddr, vaddr_t* out_start, vaddr_t* out_end) {
+    vaddr_t start;
+    if (region->advice == VM_MADV_SEQUENTIAL) {
+        start = vaddr + PAGE_SIZE;
+    } else {
+        start = vaddr & ~((vaddr_t)VM_FAULT_AROUND_PAGES * PAGE_SIZE - 1);
+    }
+    *out_end = MIN(start + VM_FAULT_AROUND_PAGES * PAGE_SIZE, region->end);
+    *out_start = MAX(start, region->start);
+}
+
+/* Map cached neighbours of a file fault so the next accesses do not fault */
+static void file_fault_around(address_space_t* aspace, vm_region_t* region, vaddr_t vaddr) {
+    vaddr_t start, end;
+    fault_around_window(region, vaddr, &start, &end);
+
+    uint64_t file_pages = (region->node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t flags = region_pte_flags(region, true);
+
+    for (vaddr_t va = start; va < end; va += PAGE_SIZE) {
+        uint64_t index = region_index(region, va);
+        if (va == vaddr || index >= file_pages) {
+            continue;
+        }
+
+        pte_t* pte = vmm_pte(aspace, va, false);
+        if (pte && (*pte & PTE_PRESENT)) {
+            continue;
+        }
+
+        paddr_t page = page_cache_lookup(region->node, index);
+        if (!page) {
+            continue;
+        }
+        if (FAILED(region_set_pte(aspace, va, page, flags))) {
+            page_cache_put(region->node, index);
+            break;
+        }
+        vmm_stats.fault_around_pages++;
+    }
+}
+
+/* Private copy of a page for a write to a read-only mapped page */
+static status_t cow_fault(address_space_t* aspace, vm_region_t* region, vaddr_t vaddr, pte_t* pte) {
+    if (!(*pte & PTE_CACHED)) {
+        /* Already private (e.g. copied by fork): just allow the write */
+        *pte |= PTE_WRITE;
+        tlb_flush_page(vaddr);
+        return STATUS_OK;
+    }
+
+    paddr_t frame = region_alloc_frame(aspace);
+    if (!frame) {
+        return STATUS_NOMEM;
+    }
+
+    uint64_t* src = (uint64_t*)PHYS_TO_VIRT_DIRECT(PTE_GET_ADDR(*pte));
+    uint64_t* dst = (uint64_t*)PHYS_TO_VIRT_DIRECT(frame);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        dst[i] = src[i];
+    }
+
+    page_cache_put(region->node, region_index(region, vaddr));
+    *pte = frame | region_pte_flags(region, false) | PTE_PRESENT;
+    tlb_flush_page(vaddr);
+    return STATUS_OK;
+}
+
+/* Resolve a fault at vaddr inside region */
+static status_t region_fault(address_space_t* aspace, vm_region_t* region, vaddr_t vaddr,
+                             bool write, bool around) {
+    vaddr &= ~(vaddr_t)(PAGE_SIZE - 1);
+
+    if (write && !(region->flags & PTE_WRITE)) {
+        return STATUS_DENIED;
+    }
+
+    pte_t* pte = vmm_pte(aspace, vaddr, false);
+    if (pte && (*pte & PTE_PRESENT)) {
+        if (write && !(*pte & PTE_WRITE)) {
+            return cow_fault(aspace, region, vaddr, pte);
+        }
+        return STATUS_OK;   /* Mapped meanwhile, e.g. by fault-around */
+    }
+
+    if (!region->node) {
+        return anon_fault(aspace, region, vaddr);
+    }
+
+    uint64_t index = region_index(region, vaddr);
+    if (index * PAGE_SIZE >= region->node->size) {
+        return STATUS_INVALID;   /* Beyond end of file */
+    }
+
+    /*
+     * Read the fault-around window so fault-around finds its pages. Faults of
+     * a stream arrive a window apart, so the tracker sees whole windows and
+     * reads ahead of them.
+     */
+    if (around && region->advice != VM_MADV_RANDOM) {
+        vaddr_t start, end;
+        fault_around_window(region, vaddr, &start, &end);
+        start = MIN(start, vaddr);
+        uint64_t first = region_index(region, start);
+        uint32_t count = (uint32_t)((end - start) / PAGE_SIZE);
+        page_cache_ra_access(region->node, &region->ra, first, count);
+        page_cache_readahead(region->node, first, count);
+    }
+
+    paddr_t page;
+    status_t status = page_cache_get(region->node, index, &page);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    status = region_set_pte(aspace, vaddr, page, region_pte_flags(region, true));
+    if (FAILED(status)) {
+        page_cache_put(region->node, index);
+        return status;
+    }
+
+    if (write) {
+        status = cow_fault(aspace, region, vaddr, vmm_pte(aspace, vaddr, false));
+        if (FAILED(status)) {
+            return status;
+        }
+    }
+
+    if (around && region->advice != VM_MADV_RANDOM) {
+        file_fault_around(aspace, region, vaddr);
+    }
+    return STATUS_OK;
+}
+
+/* Resolve a fault in aspace (error_code as pushed by the CPU) */
+status_t vmm_handle_fault(address_space_t* aspace, vaddr_t addr, uint32_t error_code) {
+    vm_region_t* region = vmm_find_region(aspace, addr);
+    if (!region) {
+        return STATUS_NOTFOUND;
+    }
+
+    vmm_stats.page_faults++;
+    return region_fault(aspace, region, addr, error_code & 0x2, true);
+}
+
+/* Pre-fault a range (MAP_POPULATE) */
+status_t vmm_populate(address_space_t* aspace, vaddr_t start, size_t size) {
+    if (!aspace) {
+        return STATUS_INVALID;
+    }
+
+    vaddr_t end = start + PAGE_ALIGN_UP(size);
+    for (vaddr_t va = start & ~(vaddr_t)(PAGE_SIZE - 1); va < end; va += PAGE_SIZE) {
+        vm_region_t* region = vmm_find_region(aspace, va);
+        if (!region) {
+            return STATUS_NOTFOUND;
+        }
+
+        pte_t* pte = vmm_pte(aspace, va, false);
+        if (pte && (*pte & PTE_PRESENT)) {
+            continue;
+        }
+
+        /* Read the rest of the range in one pass instead of page by page */
+        if (region->node && va == start) {
+            page_cache_readahead(region->node, region_index(region, va),
+                                 (uint32_t)MIN((end - va) / PAGE_SIZE, PAGE_CACHE_PAGES / 2));
+        }
+
+        status_t status = region_fault(aspace, region, va, false, false);
+        if (FAILED(status)) {
+            return status;
+        }
+        vmm_stats.populated_pages++;
+    }
+    return STATUS_OK;
+}
+
+/* Memory hints */
+status_t vmm_madvise(address_space_t* aspace, vaddr_t start, size_t size, uint32_t advice) {
+    if (!aspace || (start & (PAGE_SIZE - 1))) {
+        return STATUS_INVALID;
+    }
+    if (size == 0) {
+        return STATUS_OK;
+    }
+
+    vaddr_t end = start + PAGE_ALIGN_UP(size);
+    bool per_region = advice == VM_MADV_NORMAL || advice == VM_MADV_RANDOM ||
+                      advice == VM_MADV_SEQUENTIAL || advice == VM_MADV_HUGEPAGE ||
+                      advice == VM_MADV_NOHUGEPAGE;
+
+    if (!per_region && advice != VM_MADV_WILLNEED && advice != VM_MADV_DONTNEED &&
+        advice != VM_MADV_FREE) {
+        return STATUS_INVALID;
+    }
+
+    /* Hints stored on the region apply to exactly the range given */
+    if (per_region) {
+        status_t status = region_isolate(aspace, start, end);
+        if (FAILED(status)) {
+            return status;
+        }
+    }
+
+    bool found = false;
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (region->start >= end) {
+            break;
+        }
+        if (region->end <= start) {
+            continue;
+        }
+        found = true;
+
+        vaddr_t from = MAX(start, region->start);
+        vaddr_t to = MIN(end, region->end);
+
+        switch (advice) {
+        case VM_MADV_NORMAL:
+        case VM_MADV_RANDOM:
+        case VM_MADV_SEQUENTIAL:
+            region->advice = advice;
+            ra_advise(&region->ra, advice);
+            break;
+
+        case VM_MADV_HUGEPAGE:
+            region->vm_flags |= VM_HUGEPAGE;
+            break;
+
+        case VM_MADV_NOHUGEPAGE:
+            region->vm_flags &= ~VM_HUGEPAGE;
+            break;
+
+        case VM_MADV_WILLNEED:
+            /* Anonymous memory has no backing store to prefetch from */
+            if (region->node) {
+                page_cache_readahead(region->node, region_index(region, from),
+                                     (uint32_t)MIN((to - from) / PAGE_SIZE, PAGE_CACHE_PAGES / 2));
+            }
+            break;
+
+        case VM_MADV_DONTNEED:
+            region_release_range(aspace, region, from, to);
+            break;
+
+        case VM_MADV_FREE:
+            if (region->node) {
+                return STATUS_INVALID;
+            }
+            /* Clean pages are reclaimable until written again */
+            for (vaddr_t va = from; va < to; va += PAGE_SIZE) {
+                pte_t* pte = vmm_pte(aspace, va, false);
+                if (!pte) {
+                    va = ((va + MB(2)) & ~(MB(2) - 1)) - PAGE_SIZE;
+                    continue;
+                }
+                if (*pte & PTE_PRESENT) {
+                    *pte = (*pte | PTE_LAZYFREE) & ~PTE_DIRTY;
+                    tlb_flush_page(va);
+                }
+            }
+            break;
+        }
+    }
+
+    return found ? STATUS_OK : STATUS_NOTFOUND;
+}
+
+/* Read-ahead counters of a file mapping */
+status_t vmm_readahead_stats(address_space_t* aspace, vaddr_t addr, ra_stats_t* stats) {
+    if (!aspace || !stats) {
+        return STATUS_INVALID;
+    }
+
+    vm_region_t* region = vmm_find_region(aspace, addr);
+    if (!region || !region->node) {
+        return STATUS_NOTFOUND;
+    }
+
+    *stats = region->ra.stats;
+    return STATUS_OK;
+}
+
+/* Reclaim MADV_FREE pages that stayed clean */
+size_t vmm_reclaim_lazy(address_space_t* aspace) {
+    if (!aspace) {
+        return 0;
+    }
+
+    size_t freed = 0;
+    struct list_head* pos;
+    list_for_each(pos, &aspace->regions) {
+        vm_region_t* region = list_entry(pos, vm_region_t, list_node);
+        if (region->node) {
+            continue;
+        }
+
+        for (vaddr_t va = region->start; va < region->end; va += PAGE_SIZE) {
+            pte_t* pte = vmm_pte(aspace, va, false);
+            if (!pte) {
+                va = ((va + MB(2)) & ~(MB(2) - 1)) - PAGE_SIZE;
+                continue;
+            }
+            if ((*pte & (PTE_PRESENT | PTE_LAZYFREE)) != (PTE_PRESENT | PTE_LAZYFREE)) {
+                continue;
+            }
+            if (*pte & PTE_DIRTY) {
+                /* Written after MADV_FREE: the data is live again */
+                *pte &= ~PTE_LAZYFREE;
+                continue;
+            }
+            region_release_page(region, va, pte);
+            freed++;
+        }
+    }
+
+    vmm_stats.lazy_freed += freed;
+    return freed;
+}
+
+/* ============================================================================
+ * Sequential-scan fault benchmark
+ * ============================================================================ */
+
+#define VMM_BENCH_BASE  0x200000000UL
+
+static size_t vmm_bench_scan(address_space_t* aspace, vfs_node_t* node, size_t pages,
+                             uint32_t advice, bool populate) {
+    if (FAILED(vmm_add_file_region(aspace, VMM_BENCH_BASE, pages * PAGE_SIZE, PTE_USER, node, 0, 0))) {
+        return 0;
+    }
+    vmm_madvise(aspace, VMM_BENCH_BASE, pages * PAGE_SIZE, advice);
+    if (populate) {
+        vmm_populate(aspace, VMM_BENCH_BASE, pages * PAGE_SIZE);
+    }
+
+    size_t before = vmm_stats.page_faults;
+    for (size_t i = 0; i < pages; i++) {
+        vaddr_t va = VMM_BENCH_BASE + i * PAGE_SIZE;
+        if (!vmm_is_mapped(aspace, va)) {
+            vmm_handle_fault(aspace, va, 0x4);
+        }
+    }
+    size_t faults = vmm_stats.page_faults - before;
+
+    vmm_remove_region(aspace, VMM_BENCH_BASE);
+    return faults;
+}
+
+status_t vmm_scan_benchmark(const char* path, vmm_scan_bench_result_t* result) {
+    if (!path || !result) {
+        return STATUS_INVALID;
+    }
+
+    vfs_file_t* file = NULL;
+    status_t status = vfs_open(path, VFS_O_RDONLY, 0, &file);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    address_space_t* aspace = NULL;
+    status = vmm_create_address_space(&aspace);
+    if (FAILED(status)) {
+        vfs_close(file);
+        return status;
+    }
+
+    vfs_node_t* node = file->node;
+    size_t pages = (node->size + PAGE_SIZE - 1) / PAGE_SIZE;
+    result->pages = pages;
+
+    page_cache_drop(node, 0, 0);
+    result->faults_no_around = vmm_bench_scan(aspace, node, pages, VM_MADV_RANDOM, false);
+    page_cache_drop(node, 0, 0);
+    result->faults_cold = vmm_bench_scan(aspace, node, pages, VM_MADV_NORMAL, false);
+    result->faults_warm = vmm_bench_scan(aspace, node, pages, VM_MADV_NORMAL, false);
+    page_cache_drop(node, 0, 0);
+    result->faults_sequential = vmm_bench_scan(aspace, node, pages, VM_MADV_SEQUENTIAL, false);
+    page_cache_drop(node, 0, 0);
+    result->faults_populate = vmm_bench_scan(aspace, node, pages, VM_MADV_NORMAL, true);
+    page_cache_drop(node, 0, 0);
+
+    vmm_destroy_address_space(aspace);
+    vfs_close(file);
+    return STATUS_OK;
+}
+
 /* Page fault handler */
 void vmm_page_fault_handler(vaddr_t fault_addr, uint32_t error_code) {
     vmm_stats.page_faults++;
 
+    /*
+     * Demand paging: not-present and copy-on-write faults inside a region.
+     * An instruction fetch is only refused from an NX region, or from a
+     * page that is already present (the PTE itself forbids it).
+     */
+    if (current_aspace) {
+        vm_region_t* region = vmm_find_region(current_aspace, fault_addr);
+        bool fetch = error_code & 0x10;
+        bool exec_denied = fetch && region && ((region->flags & PTE_NX) || (error_code & 0x1));
+        if (region && !exec_denied &&
+            SUCCESS(region_fault(current_aspace, region, fault_addr, error_code & 0x2, true))) {
+            return;
+        }
+    }
+
     KLOG_ERROR("VMM", "Page fault at 0x%llx (error: 0x%x)", fault_addr, error_code);
 
     /* Determine cause */
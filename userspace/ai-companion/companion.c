@@ -9,13 +9,22 @@
 #include <ctype.h>
 #include <time.h>
 #include "companion.h"
+#include "pattern_match.h"
+#include "intent_model.h"
+
+/* Below this the keyword rules decide the intent */
+#define COMPANION_MODEL_CONFIDENCE 0.6f
 
 /* Global companion state */
 static struct {
     bool initialized;
     uint64_t next_action_id;
+    intent_model_t* model;          // Optional on-device intent model
+    infer_arena_t arena;            // Activations, reset per request
 } companion_state = {0};
 
+static pattern_set_t* companion_keyword_matcher(void);
+
 /* Initialize companion */
 status_t companion_init(companion_context_t** out_ctx) {
     if (!out_ctx) {
@@ -50,6 +59,26 @@ status_t companion_init(companion_context_t** out_ctx) {
     companion_state.initialized = true;
     companion_state.next_action_id = 1;
 
+    /* Compile the keyword tables up front rather than on the first request */
+    companion_keyword_matcher();
+
+    /* The intent model is optional; keyword rules cover its absence */
+    const char* model_path = getenv(INTENT_MODEL_ENV);
+    if (!model_path) {
+        model_path = INTENT_MODEL_PATH;
+    }
+    if (!companion_state.model && SUCCESS(intent_model_load(model_path, &companion_state.model))) {
+        if (SUCCESS(infer_arena_init(&companion_state.arena, INTENT_ARENA_SIZE))) {
+            printf("[AI COMPANION] Intent model loaded (%s kernels)\n", infer_isa_name(infer_isa_active()));
+        } else {
+            intent_model_free(companion_state.model);
+            companion_state.model = NULL;
+        }
+    }
+    if (!companion_state.model) {
+        printf("[AI COMPANION] No intent model, using keyword rules\n");
+    }
+
     *out_ctx = ctx;
 
     printf("[AI COMPANION] Initialized\n");
@@ -70,6 +99,12 @@ void companion_shutdown(companion_context_t* ctx) {
         companion_free_action_card(ctx->pending_action);
     }
 
+    if (companion_state.model) {
+        intent_model_free(companion_state.model);
+        infer_arena_destroy(&companion_state.arena);
+        companion_state.model = NULL;
+    }
+
     free(ctx);
 
     printf("[AI COMPANION] Shutdown\n");
@@ -168,131 +203,276 @@ void companion_set_permission(action_card_t* card, permission_level_t permission
     }
 }
 
-/* Parse intent from input */
-action_type_t companion_parse_intent(const char* input) {
-    if (!input) {
-        return ACTION_TYPE_COMMAND;
+/* Keyword tables, compiled into a single automaton */
+enum {
+    MATCH_INTENT,
+    MATCH_IMPACT,
+    MATCH_PERMISSION,
+    MATCH_TABLES,
+};
+
+static const struct {
+    const char* keyword;
+    uint32_t table;
+    uint32_t value;
+    int32_t priority;   // Lower wins within a table
+} companion_keywords[] = {
+    /* Intents, ranked in the order they were historically checked */
+    { "install",        MATCH_INTENT, ACTION_TYPE_INSTALL,  0 },
+    { "add package",    MATCH_INTENT, ACTION_TYPE_INSTALL,  0 },
+    { "change setting", MATCH_INTENT, ACTION_TYPE_SETTINGS, 1 },
+    { "configure",      MATCH_INTENT, ACTION_TYPE_SETTINGS, 1 },
+    { "set",            MATCH_INTENT, ACTION_TYPE_SETTINGS, 1 },
+    { "create file",    MATCH_INTENT, ACTION_TYPE_FILE_OP,  2 },
+    { "delete file",    MATCH_INTENT, ACTION_TYPE_FILE_OP,  2 },
+    { "copy",           MATCH_INTENT, ACTION_TYPE_FILE_OP,  2 },
+    { "move",           MATCH_INTENT, ACTION_TYPE_FILE_OP,  2 },
+    { "connect",        MATCH_INTENT, ACTION_TYPE_NETWORK,  3 },
+    { "network",        MATCH_INTENT, ACTION_TYPE_NETWORK,  3 },
+    { "wifi",           MATCH_INTENT, ACTION_TYPE_NETWORK,  3 },
+    { "reboot",         MATCH_INTENT, ACTION_TYPE_SYSTEM,   4 },
+    { "shutdown",       MATCH_INTENT, ACTION_TYPE_SYSTEM,   4 },
+    { "restart",        MATCH_INTENT, ACTION_TYPE_SYSTEM,   4 },
+    { "generate code",  MATCH_INTENT, ACTION_TYPE_CODE,     5 },
+    { "write script",   MATCH_INTENT, ACTION_TYPE_CODE,     5 },
+    { "run code",       MATCH_INTENT, ACTION_TYPE_CODE,     5 },
+
+    /* Impact, most severe first */
+    { "rm -rf /",       MATCH_IMPACT, IMPACT_CRITICAL, 0 },
+    { "format",         MATCH_IMPACT, IMPACT_CRITICAL, 0 },
+    { "dd if=",         MATCH_IMPACT, IMPACT_CRITICAL, 0 },
+    { "rm -rf",         MATCH_IMPACT, IMPACT_HIGH,     1 },
+    { "shutdown",       MATCH_IMPACT, IMPACT_HIGH,     1 },
+    { "reboot",         MATCH_IMPACT, IMPACT_HIGH,     1 },
+    { "rm ",            MATCH_IMPACT, IMPACT_MEDIUM,   2 },
+    { "kill",           MATCH_IMPACT, IMPACT_MEDIUM,   2 },
+    { "chmod",          MATCH_IMPACT, IMPACT_MEDIUM,   2 },
+    { "mkdir",          MATCH_IMPACT, IMPACT_LOW,      3 },
+    { "touch",          MATCH_IMPACT, IMPACT_LOW,      3 },
+    { "cp",             MATCH_IMPACT, IMPACT_LOW,      3 },
+
+    /* Permission, highest first */
+    { "sudo",           MATCH_PERMISSION, PERM_ROOT,  0 },
+    { "su ",            MATCH_PERMISSION, PERM_ROOT,  0 },
+    { "/etc/",          MATCH_PERMISSION, PERM_ROOT,  0 },
+    { "/sys/",          MATCH_PERMISSION, PERM_ROOT,  0 },
+    { "systemctl",      MATCH_PERMISSION, PERM_ADMIN, 1 },
+    { "service",        MATCH_PERMISSION, PERM_ADMIN, 1 },
+    { "firewall",       MATCH_PERMISSION, PERM_ADMIN, 1 },
+    { "iptables",       MATCH_PERMISSION, PERM_ADMIN, 1 },
+};
+
+#define COMPANION_KEYWORD_COUNT (sizeof(companion_keywords) / sizeof(companion_keywords[0]))
+
+static pattern_set_t* keyword_set;
+
+/* Build the keyword automaton on first use */
+static pattern_set_t* companion_keyword_matcher(void) {
+    if (keyword_set) {
+        return keyword_set;
+    }
+
+    pattern_set_t* set = pattern_set_create();
+    if (!set) {
+        return NULL;
+    }
+    for (size_t i = 0; i < COMPANION_KEYWORD_COUNT; i++) {
+        if (pattern_set_add(set, companion_keywords[i].keyword, companion_keywords[i].table,
+                            companion_keywords[i].value, companion_keywords[i].priority) < 0) {
+            pattern_set_destroy(set);
+            return NULL;
+        }
+    }
+    if (pattern_set_compile(set) < 0) {
+        pattern_set_destroy(set);
+        return NULL;
     }
 
-    /* Convert to lowercase for matching */
-    char lower[512] = {0};
-    for (size_t i = 0; i < sizeof(lower) - 1 && input[i]; i++) {
-        lower[i] = tolower(input[i]);
+    keyword_set = set;
+    return keyword_set;
+}
+
+/*
+ * Reference scanners: one strstr per keyword over a lowercased copy. Used
+ * when the automaton cannot be allocated and as the benchmark baseline.
+ */
+static void lowercase_copy(char* lower, size_t size, const char* input) {
+    size_t i = 0;
+    for (; i < size - 1 && input[i]; i++) {
+        lower[i] = (char)tolower((unsigned char)input[i]);
     }
+    lower[i] = '\0';
+}
+
+static action_type_t legacy_parse_intent(const char* input) {
+    char lower[512];
+    lowercase_copy(lower, sizeof(lower), input);
 
-    /* Check for install keywords */
     if (strstr(lower, "install") || strstr(lower, "add package")) {
         return ACTION_TYPE_INSTALL;
     }
-
-    /* Check for settings keywords */
     if (strstr(lower, "change setting") || strstr(lower, "configure") || strstr(lower, "set")) {
         return ACTION_TYPE_SETTINGS;
     }
-
-    /* Check for file operations */
     if (strstr(lower, "create file") || strstr(lower, "delete file") ||
         strstr(lower, "copy") || strstr(lower, "move")) {
         return ACTION_TYPE_FILE_OP;
     }
-
-    /* Check for network operations */
     if (strstr(lower, "connect") || strstr(lower, "network") || strstr(lower, "wifi")) {
         return ACTION_TYPE_NETWORK;
     }
-
-    /* Check for system operations */
     if (strstr(lower, "reboot") || strstr(lower, "shutdown") || strstr(lower, "restart")) {
         return ACTION_TYPE_SYSTEM;
     }
-
-    /* Check for code operations */
     if (strstr(lower, "generate code") || strstr(lower, "write script") || strstr(lower, "run code")) {
         return ACTION_TYPE_CODE;
     }
-
-    /* Default to command */
     return ACTION_TYPE_COMMAND;
 }
 
-/* Check if requires clarification */
-bool companion_requires_clarification(const char* input) {
-    if (!input || strlen(input) < 5) {
-        return true;
-    }
-
-    /* Check for ambiguous terms */
-    if (strstr(input, "it") || strstr(input, "that") || strstr(input, "this")) {
-        return true;
-    }
-
-    return false;
-}
-
-/* Assess impact level */
-impact_level_t companion_assess_impact(const char* command) {
-    if (!command) {
-        return IMPACT_SAFE;
-    }
-
-    char lower[512] = {0};
-    for (size_t i = 0; i < sizeof(lower) - 1 && command[i]; i++) {
-        lower[i] = tolower(command[i]);
-    }
+static impact_level_t legacy_assess_impact(const char* command) {
+    char lower[512];
+    lowercase_copy(lower, sizeof(lower), command);
 
-    /* Critical operations */
     if (strstr(lower, "rm -rf /") || strstr(lower, "format") || strstr(lower, "dd if=")) {
         return IMPACT_CRITICAL;
     }
-
-    /* High impact */
     if (strstr(lower, "rm -rf") || strstr(lower, "shutdown") || strstr(lower, "reboot")) {
         return IMPACT_HIGH;
     }
-
-    /* Medium impact */
     if (strstr(lower, "rm ") || strstr(lower, "kill") || strstr(lower, "chmod")) {
         return IMPACT_MEDIUM;
     }
-
-    /* Low impact */
     if (strstr(lower, "mkdir") || strstr(lower, "touch") || strstr(lower, "cp")) {
         return IMPACT_LOW;
     }
-
-    /* Safe (read-only) */
     return IMPACT_SAFE;
 }
 
-/* Check if requires permission */
-bool companion_requires_permission(const char* command, permission_level_t* out_level) {
-    if (!command) {
-        return false;
-    }
-
-    char lower[512] = {0};
-    for (size_t i = 0; i < sizeof(lower) - 1 && command[i]; i++) {
-        lower[i] = tolower(command[i]);
-    }
+static bool legacy_requires_permission(const char* command, permission_level_t* out_level) {
+    char lower[512];
+    lowercase_copy(lower, sizeof(lower), command);
 
-    /* Root-level operations */
     if (strstr(lower, "sudo") || strstr(lower, "su ") ||
         strstr(lower, "/etc/") || strstr(lower, "/sys/")) {
         if (out_level) *out_level = PERM_ROOT;
         return true;
     }
-
-    /* Admin-level operations */
     if (strstr(lower, "systemctl") || strstr(lower, "service") ||
         strstr(lower, "firewall") || strstr(lower, "iptables")) {
         if (out_level) *out_level = PERM_ADMIN;
         return true;
     }
-
     if (out_level) *out_level = PERM_USER;
     return false;
 }
 
+/* Best match per table while scanning */
+typedef struct match_accum {
+    int32_t priority[MATCH_TABLES];
+    uint32_t value[MATCH_TABLES];
+    uint32_t intent_mask;
+    uint32_t hits;
+} match_accum_t;
+
+static bool accumulate_keyword(const pattern_match_t* match, void* arg) {
+    match_accum_t* acc = (match_accum_t*)arg;
+    acc->hits++;
+    if (match->table == MATCH_INTENT) {
+        acc->intent_mask |= 1u << match->value;
+    }
+    if (match->priority < acc->priority[match->table]) {
+        acc->priority[match->table] = match->priority;
+        acc->value[match->table] = match->value;
+    }
+    return true;
+}
+
+/* Classify input */
+void companion_match(const char* input, companion_match_t* out) {
+    if (!out) {
+        return;
+    }
+    out->intent = ACTION_TYPE_COMMAND;
+    out->intent_mask = 0;
+    out->impact = IMPACT_SAFE;
+    out->permission = PERM_USER;
+    out->needs_permission = false;
+    out->keywords = 0;
+    if (!input) {
+        return;
+    }
+
+    pattern_set_t* set = companion_keyword_matcher();
+    if (!set) {
+        out->intent = legacy_parse_intent(input);
+        out->intent_mask = out->intent == ACTION_TYPE_COMMAND ? 0 : 1u << out->intent;
+        out->impact = legacy_assess_impact(input);
+        out->needs_permission = legacy_requires_permission(input, &out->permission);
+        return;
+    }
+
+    match_accum_t acc = { .intent_mask = 0, .hits = 0 };
+    for (int t = 0; t < MATCH_TABLES; t++) {
+        acc.priority[t] = INT32_MAX;
+        acc.value[t] = 0;
+    }
+    pattern_set_scan(set, input, accumulate_keyword, &acc);
+
+    if (acc.priority[MATCH_INTENT] != INT32_MAX) {
+        out->intent = (action_type_t)acc.value[MATCH_INTENT];
+    }
+    if (acc.priority[MATCH_IMPACT] != INT32_MAX) {
+        out->impact = (impact_level_t)acc.value[MATCH_IMPACT];
+    }
+    if (acc.priority[MATCH_PERMISSION] != INT32_MAX) {
+        out->permission = (permission_level_t)acc.value[MATCH_PERMISSION];
+        out->needs_permission = true;
+    }
+    out->intent_mask = acc.intent_mask;
+    out->keywords = acc.hits;
+}
+
+/* Parse intent from input */
+action_type_t companion_parse_intent(const char* input) {
+    companion_match_t match;
+    companion_match(input, &match);
+    return match.intent;
+}
+
+/* Check if requires clarification */
+bool companion_requires_clarification(const char* input) {
+    if (!input || strlen(input) < 5) {
+        return true;
+    }
+
+    /* Check for ambiguous terms */
+    if (strstr(input, "it") || strstr(input, "that") || strstr(input, "this")) {
+        return true;
+    }
+
+    return false;
+}
+
+/* Assess impact level */
+impact_level_t companion_assess_impact(const char* command) {
+    companion_match_t match;
+    companion_match(command, &match);
+    return match.impact;
+}
+
+/* Check if requires permission */
+bool companion_requires_permission(const char* command, permission_level_t* out_level) {
+    if (!command) {
+        return false;
+    }
+
+    companion_match_t match;
+    companion_match(command, &match);
+    if (out_level) *out_level = match.permission;
+    return match.needs_permission;
+}
+
 /* Process user input */
 companion_response_t* companion_process_input(companion_context_t* ctx, const char* input) {
     if (!ctx || !input) {
@@ -316,8 +496,18 @@ companion_response_t* companion_process_input(companion_context_t* ctx, const ch
         return response;
     }
 
-    /* Parse intent */
-    action_type_t intent = companion_parse_intent(input);
+    /* Classify intent, impact and permission in one pass */
+    companion_match_t match;
+    companion_match(input, &match);
+    action_type_t intent = match.intent;
+
+    /* Prefer the intent model when it is confident */
+    intent_prediction_t prediction = { .entity_count = 0 };
+    if (companion_state.model &&
+        SUCCESS(intent_model_predict(companion_state.model, &companion_state.arena, input, &prediction)) &&
+        prediction.confidence >= COMPANION_MODEL_CONFIDENCE) {
+        intent = prediction.intent;
+    }
 
     /* Create action card */
     action_card_t* card = companion_create_action_card(input, intent);
@@ -339,7 +529,7 @@ companion_response_t* companion_process_input(companion_context_t* ctx, const ch
 
         case ACTION_TYPE_FILE_OP:
             companion_add_step(card, "Execute file operation", input);
-            companion_set_impact(card, companion_assess_impact(input));
+            companion_set_impact(card, match.impact);
             break;
 
         case ACTION_TYPE_SETTINGS:
@@ -351,11 +541,9 @@ companion_response_t* companion_process_input(companion_context_t* ctx, const ch
         case ACTION_TYPE_COMMAND:
         default:
             companion_add_step(card, "Execute command", input);
-            companion_set_impact(card, companion_assess_impact(input));
-
-            permission_level_t perm;
-            if (companion_requires_permission(input, &perm)) {
-                companion_set_permission(card, perm);
+            companion_set_impact(card, match.impact);
+            if (match.needs_permission) {
+                companion_set_permission(card, match.permission);
             }
             break;
     }
@@ -371,6 +559,18 @@ companion_response_t* companion_process_input(companion_context_t* ctx, const ch
              card->permission == PERM_USER ? "User" :
              card->permission == PERM_ADMIN ? "Admin" : "Root");
 
+    /* Entities the model found in the request */
+    size_t used = strlen(card->summary);
+    for (uint32_t i = 0; i < prediction.entity_count && used < sizeof(card->summary); i++) {
+        int n = snprintf(card->summary + used, sizeof(card->summary) - used, "%s%s %s",
+                         i == 0 ? "\nTargets: " : ", ",
+                         intent_entity_name(prediction.entities[i].type), prediction.entities[i].text);
+        if (n < 0) {
+            break;
+        }
+        used += (size_t)n;
+    }
+
     /* Store as pending action */
     ctx->pending_action = card;
     ctx->state = COMPANION_STATE_AWAITING_APPROVAL;
@@ -530,3 +730,152 @@ void companion_set_verbose(companion_context_t* ctx, bool enable) {
         ctx->verbose = enable;
     }
 }
+
+/* Benchmark inputs: requests and commands of the sizes the companion sees */
+static const char* bench_inputs[] = {
+    "Install nginx",
+    "please add package htop and configure it to start at boot",
+    "Create file /home/user/notes.txt with the meeting summary",
+    "Connect to the office WiFi network named Limitless-5G",
+    "Show me the current directory",
+    "List all files in the downloads folder sorted by size",
+    "sudo systemctl restart networking.service",
+    "rm -rf /tmp/build-cache && mkdir -p /tmp/build-cache",
+    "dd if=/dev/zero of=/dev/sdb bs=4M status=progress",
+    "chmod 600 ~/.ssh/id_ed25519 && kill -HUP $(pidof sshd)",
+    "generate code for a small HTTP server in C that serves the current directory",
+    "Reboot the machine after the update finishes",
+    "find /var/log -name '*.log' -mtime +30 -print0 | xargs -0 gzip -9",
+    "Open the photo editor and crop the last screenshot to the visible window",
+    "tar -C /opt/app042/ -xzf release.tar.gz && touch /opt/app042/.installed",
+    "What is using all the memory right now? Summarize the top processes for me "
+    "and tell me which of them have been running for more than a day, which ones "
+    "belong to services, and whether any of them look like they are leaking",
+};
+
+#define BENCH_INPUT_COUNT (sizeof(bench_inputs) / sizeof(bench_inputs[0]))
+#define BENCH_RULES 256
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Earliest rule whose pattern occurs in the input */
+static bool first_rule_match(const pattern_match_t* match, void* arg) {
+    uint32_t* best = (uint32_t*)arg;
+    if (match->value < *best) {
+        *best = match->value;
+    }
+    return true;
+}
+
+static uint32_t legacy_first_rule(char rules[][32], uint32_t count, const char* input) {
+    for (uint32_t r = 0; r < count; r++) {
+        if (strstr(input, rules[r])) {
+            return r;
+        }
+    }
+    return UINT32_MAX;
+}
+
+/* Benchmark keyword and rule matching */
+status_t companion_benchmark_match(uint32_t iterations, companion_match_bench_t* out) {
+    if (!out || iterations == 0) {
+        return STATUS_INVALID;
+    }
+    memset(out, 0, sizeof(*out));
+
+    pattern_set_t* keywords = companion_keyword_matcher();
+    pattern_set_t* rules = pattern_set_create();
+    char (*rule_text)[32] = calloc(BENCH_RULES, sizeof(*rule_text));
+    if (!keywords || !rules || !rule_text) {
+        pattern_set_destroy(rules);
+        free(rule_text);
+        return STATUS_NOMEM;
+    }
+
+    /* Consent-style rules: a handful of common words, then per-application paths */
+    static const char* common[] = { "apt install", "pip install", "curl ", "/etc/", "systemctl" };
+    for (uint32_t r = 0; r < BENCH_RULES; r++) {
+        if (r < sizeof(common) / sizeof(common[0])) {
+            snprintf(rule_text[r], sizeof(rule_text[r]), "%s", common[r]);
+        } else {
+            snprintf(rule_text[r], sizeof(rule_text[r]), "/opt/app%03u/", r);
+        }
+        pattern_set_add(rules, rule_text[r], 0, r, (int32_t)r);
+    }
+    pattern_set_compile(rules);
+
+    out->inputs = BENCH_INPUT_COUNT;
+    out->iterations = iterations;
+    out->keywords = pattern_set_count(keywords);
+    out->keyword_states = pattern_set_states(keywords);
+    out->rules = BENCH_RULES;
+    out->rule_states = pattern_set_states(rules);
+    out->identical = true;
+
+    /* Both methods must agree before their speed means anything */
+    for (size_t i = 0; i < BENCH_INPUT_COUNT; i++) {
+        const char* in = bench_inputs[i];
+        companion_match_t m;
+        companion_match(in, &m);
+        permission_level_t perm;
+        bool needs = legacy_requires_permission(in, &perm);
+        uint32_t best = UINT32_MAX;
+        pattern_set_scan(rules, in, first_rule_match, &best);
+        if (m.intent != legacy_parse_intent(in) || m.impact != legacy_assess_impact(in) ||
+            m.needs_permission != needs || m.permission != perm ||
+            best != legacy_first_rule(rule_text, BENCH_RULES, in)) {
+            out->identical = false;
+        }
+        out->bytes += strlen(in);
+    }
+    out->bytes *= iterations;
+
+    volatile uint32_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < BENCH_INPUT_COUNT; i++) {
+            permission_level_t perm;
+            sink += (uint32_t)legacy_parse_intent(bench_inputs[i]);
+            sink += (uint32_t)legacy_assess_impact(bench_inputs[i]);
+            sink += legacy_requires_permission(bench_inputs[i], &perm);
+        }
+    }
+    out->keyword_legacy_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < BENCH_INPUT_COUNT; i++) {
+            companion_match_t m;
+            companion_match(bench_inputs[i], &m);
+            sink += (uint32_t)m.intent + (uint32_t)m.impact + m.needs_permission;
+        }
+    }
+    out->keyword_automaton_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < BENCH_INPUT_COUNT; i++) {
+            sink += legacy_first_rule(rule_text, BENCH_RULES, bench_inputs[i]);
+        }
+    }
+    out->rule_legacy_ns = bench_now_ns() - start;
+
+    start = bench_now_ns();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < BENCH_INPUT_COUNT; i++) {
+            uint32_t best = UINT32_MAX;
+            pattern_set_scan(rules, bench_inputs[i], first_rule_match, &best);
+            sink += best;
+        }
+    }
+    out->rule_automaton_ns = bench_now_ns() - start;
+    (void)sink;
+
+    pattern_set_destroy(rules);
+    free(rule_text);
+    return STATUS_OK;
+}
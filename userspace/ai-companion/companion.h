@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "kernel.h"
 
 /* Action types */
 typedef enum {
@@ -159,6 +160,36 @@ bool companion_is_safe_operation(const char* command);
 bool companion_requires_permission(const char* command, permission_level_t* out_level);
 impact_level_t companion_assess_impact(const char* command);
 
+/* Intent, impact and permission keywords from one pass over the input */
+typedef struct companion_match {
+    action_type_t intent;           // Highest-priority intent, ACTION_TYPE_COMMAND if none
+    uint32_t intent_mask;           // Every intent matched, one bit per action_type_t
+    impact_level_t impact;          // Most severe impact keyword
+    permission_level_t permission;  // Highest permission keyword
+    bool needs_permission;
+    uint32_t keywords;              // Keyword occurrences found
+} companion_match_t;
+
+void companion_match(const char* input, companion_match_t* out);
+
+/* Keyword matcher throughput, automaton against per-keyword strstr scans */
+typedef struct companion_match_bench {
+    uint32_t inputs;
+    uint64_t iterations;
+    uint64_t bytes;                 // Input bytes classified per method
+    uint32_t keywords;
+    uint32_t keyword_states;
+    uint64_t keyword_legacy_ns;
+    uint64_t keyword_automaton_ns;
+    uint32_t rules;                 // Synthetic consent-style rule table
+    uint32_t rule_states;
+    uint64_t rule_legacy_ns;
+    uint64_t rule_automaton_ns;
+    bool identical;                 // Both methods agreed on every input
+} companion_match_bench_t;
+
+status_t companion_benchmark_match(uint32_t iterations, companion_match_bench_t* out);
+
 /* History */
 void companion_add_to_history(companion_context_t* ctx, action_card_t* card);
 action_card_t* companion_get_last_action(companion_context_t* ctx);
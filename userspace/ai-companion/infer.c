@@ -0,0 +1,534 @@
+/*
+ * LimitlessOS AI Companion - Inference Runtime
+ * Quantized GEMM kernels, weight file mapping and the activation arena
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "infer.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/* One token against all rows of a weight matrix */
+typedef void (*gemm_row_fn)(const infer_tensor_t* w, const int8_t* x, float x_scale,
+                            const float* bias, bool relu, float* y);
+
+static float finish(int32_t dot, float w_scale, float x_scale, const float* bias, uint32_t r, bool relu) {
+    float v = (float)dot * w_scale * x_scale + (bias ? bias[r] : 0.0f);
+    return (relu && v < 0.0f) ? 0.0f : v;
+}
+
+/* Int4 groups hold columns 0-15 in the low nibbles and 16-31 in the high nibbles */
+static void unpack_s4(const uint8_t* p, int8_t* out) {
+    for (int i = 0; i < 16; i++) {
+        out[i] = (int8_t)((p[i] & 0x0f) - 8);
+        out[i + 16] = (int8_t)((p[i] >> 4) - 8);
+    }
+}
+
+/* Portable kernels */
+static void gemm_s8_scalar(const infer_tensor_t* w, const int8_t* x, float x_scale,
+                           const float* bias, bool relu, float* y) {
+    const int8_t* row = (const int8_t*)w->data;
+    for (uint32_t r = 0; r < w->rows; r++, row += w->cols) {
+        int32_t dot = 0;
+        for (uint32_t c = 0; c < w->cols; c++) {
+            dot += (int32_t)row[c] * (int32_t)x[c];
+        }
+        y[r] = finish(dot, w->scales[r], x_scale, bias, r, relu);
+    }
+}
+
+static void gemm_s4_scalar(const infer_tensor_t* w, const int8_t* x, float x_scale,
+                           const float* bias, bool relu, float* y) {
+    uint32_t groups = w->cols / INFER_BLOCK;
+    const uint8_t* p = (const uint8_t*)w->data;
+    const float* scale = w->scales;
+    int8_t unpacked[INFER_BLOCK];
+    for (uint32_t r = 0; r < w->rows; r++) {
+        float acc = 0.0f;
+        for (uint32_t g = 0; g < groups; g++, p += INFER_BLOCK / 2, scale++) {
+            unpack_s4(p, unpacked);
+            int32_t dot = 0;
+            for (uint32_t c = 0; c < INFER_BLOCK; c++) {
+                dot += (int32_t)unpacked[c] * (int32_t)x[g * INFER_BLOCK + c];
+            }
+            acc += (float)dot * *scale;
+        }
+        float v = acc * x_scale + (bias ? bias[r] : 0.0f);
+        y[r] = (relu && v < 0.0f) ? 0.0f : v;
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * vpmaddubsw and vpdpbusd multiply unsigned by signed bytes. Folding the sign
+ * of x into w lets both take |x| as the unsigned side; with |x|, |w| <= 127 the
+ * 16-bit pair sums of vpmaddubsw cannot saturate.
+ */
+#define DOT_AVX2(acc, ax, sw) \
+    _mm256_add_epi32((acc), _mm256_madd_epi16(_mm256_maddubs_epi16((ax), (sw)), _mm256_set1_epi16(1)))
+#define DOT_AVX512_VNNI(acc, ax, sw)  _mm256_dpbusd_epi32((acc), (ax), (sw))
+#define DOT_AVX_VNNI(acc, ax, sw)     _mm256_dpbusd_avx_epi32((acc), (ax), (sw))
+
+#define HSUM_EPI32(v, out) do { \
+        __m128i s_ = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256((v), 1)); \
+        s_ = _mm_add_epi32(s_, _mm_shuffle_epi32(s_, 0x4e)); \
+        s_ = _mm_add_epi32(s_, _mm_shuffle_epi32(s_, 0xb1)); \
+        (out) = _mm_cvtsi128_si32(s_); \
+    } while (0)
+
+#define HSUM_PS(v, out) do { \
+        __m128 s_ = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps((v), 1)); \
+        s_ = _mm_add_ps(s_, _mm_movehl_ps(s_, s_)); \
+        s_ = _mm_add_ss(s_, _mm_movehdup_ps(s_)); \
+        (out) = _mm_cvtss_f32(s_); \
+    } while (0)
+
+/* Int8: four rows per pass so each activation block is loaded once */
+#define DEFINE_GEMM_S8(suffix, isa, DOT) \
+__attribute__((target(isa))) \
+static void gemm_s8_##suffix(const infer_tensor_t* w, const int8_t* x, float x_scale, \
+                             const float* bias, bool relu, float* y) { \
+    const int8_t* base = (const int8_t*)w->data; \
+    uint32_t cols = w->cols; \
+    uint32_t r = 0; \
+    for (; r + 4 <= w->rows; r += 4) { \
+        const int8_t* w0 = base + (size_t)r * cols; \
+        __m256i a0 = _mm256_setzero_si256(), a1 = a0, a2 = a0, a3 = a0; \
+        for (uint32_t c = 0; c < cols; c += INFER_BLOCK) { \
+            __m256i xv = _mm256_loadu_si256((const __m256i*)(x + c)); \
+            __m256i ax = _mm256_sign_epi8(xv, xv); \
+            a0 = DOT(a0, ax, _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w0 + c)), xv)); \
+            a1 = DOT(a1, ax, _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w0 + cols + c)), xv)); \
+            a2 = DOT(a2, ax, _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w0 + 2 * cols + c)), xv)); \
+            a3 = DOT(a3, ax, _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w0 + 3 * cols + c)), xv)); \
+        } \
+        int32_t d; \
+        HSUM_EPI32(a0, d); y[r] = finish(d, w->scales[r], x_scale, bias, r, relu); \
+        HSUM_EPI32(a1, d); y[r + 1] = finish(d, w->scales[r + 1], x_scale, bias, r + 1, relu); \
+        HSUM_EPI32(a2, d); y[r + 2] = finish(d, w->scales[r + 2], x_scale, bias, r + 2, relu); \
+        HSUM_EPI32(a3, d); y[r + 3] = finish(d, w->scales[r + 3], x_scale, bias, r + 3, relu); \
+    } \
+    for (; r < w->rows; r++) { \
+        const int8_t* w0 = base + (size_t)r * cols; \
+        __m256i a0 = _mm256_setzero_si256(); \
+        for (uint32_t c = 0; c < cols; c += INFER_BLOCK) { \
+            __m256i xv = _mm256_loadu_si256((const __m256i*)(x + c)); \
+            a0 = DOT(a0, _mm256_sign_epi8(xv, xv), \
+                     _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w0 + c)), xv)); \
+        } \
+        int32_t d; \
+        HSUM_EPI32(a0, d); y[r] = finish(d, w->scales[r], x_scale, bias, r, relu); \
+    } \
+}
+
+/* Int4: unpack a 32-column group into one vector, scale per group in float */
+#define DEFINE_GEMM_S4(suffix, isa, DOT) \
+__attribute__((target(isa))) \
+static void gemm_s4_##suffix(const infer_tensor_t* w, const int8_t* x, float x_scale, \
+                             const float* bias, bool relu, float* y) { \
+    uint32_t groups = w->cols / INFER_BLOCK; \
+    const uint8_t* p = (const uint8_t*)w->data; \
+    const float* scale = w->scales; \
+    const __m128i low = _mm_set1_epi8(0x0f); \
+    const __m256i eight = _mm256_set1_epi8(8); \
+    for (uint32_t r = 0; r < w->rows; r++) { \
+        __m256 acc = _mm256_setzero_ps(); \
+        for (uint32_t g = 0; g < groups; g++, p += INFER_BLOCK / 2, scale++) { \
+            __m128i packed = _mm_loadu_si128((const __m128i*)p); \
+            __m256i wv = _mm256_set_m128i(_mm_and_si128(_mm_srli_epi16(packed, 4), low), \
+                                          _mm_and_si128(packed, low)); \
+            wv = _mm256_sub_epi8(wv, eight); \
+            __m256i xv = _mm256_loadu_si256((const __m256i*)(x + g * INFER_BLOCK)); \
+            __m256i d = DOT(_mm256_setzero_si256(), _mm256_sign_epi8(xv, xv), _mm256_sign_epi8(wv, xv)); \
+            acc = _mm256_fmadd_ps(_mm256_cvtepi32_ps(d), _mm256_set1_ps(*scale), acc); \
+        } \
+        float v; \
+        HSUM_PS(acc, v); \
+        v = v * x_scale + (bias ? bias[r] : 0.0f); \
+        y[r] = (relu && v < 0.0f) ? 0.0f : v; \
+    } \
+}
+
+DEFINE_GEMM_S8(avx2, "avx2,fma", DOT_AVX2)
+DEFINE_GEMM_S4(avx2, "avx2,fma", DOT_AVX2)
+DEFINE_GEMM_S8(avx512_vnni, "avx2,fma,avx512vl,avx512vnni", DOT_AVX512_VNNI)
+DEFINE_GEMM_S4(avx512_vnni, "avx2,fma,avx512vl,avx512vnni", DOT_AVX512_VNNI)
+DEFINE_GEMM_S8(avx_vnni, "avx2,fma,avxvnni", DOT_AVX_VNNI)
+DEFINE_GEMM_S4(avx_vnni, "avx2,fma,avxvnni", DOT_AVX_VNNI)
+
+#endif /* __x86_64__ */
+
+static const struct {
+    const char* name;
+    gemm_row_fn s8;
+    gemm_row_fn s4;
+} isa_kernels[INFER_ISA_COUNT] = {
+    [INFER_ISA_SCALAR] = { "scalar", gemm_s8_scalar, gemm_s4_scalar },
+#if defined(__x86_64__)
+    [INFER_ISA_AVX2] = { "avx2", gemm_s8_avx2, gemm_s4_avx2 },
+    [INFER_ISA_AVX512_VNNI] = { "avx512-vnni", gemm_s8_avx512_vnni, gemm_s4_avx512_vnni },
+    [INFER_ISA_AVX_VNNI] = { "avx-vnni", gemm_s8_avx_vnni, gemm_s4_avx_vnni },
+#else
+    [INFER_ISA_AVX2] = { "avx2", NULL, NULL },
+    [INFER_ISA_AVX512_VNNI] = { "avx512-vnni", NULL, NULL },
+    [INFER_ISA_AVX_VNNI] = { "avx-vnni", NULL, NULL },
+#endif
+};
+
+static struct {
+    bool detected;
+    bool supported[INFER_ISA_COUNT];
+    infer_isa_t best;
+    infer_isa_t active;
+} dispatch;
+
+static void detect(void) {
+    if (dispatch.detected) {
+        return;
+    }
+    dispatch.supported[INFER_ISA_SCALAR] = true;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    dispatch.supported[INFER_ISA_AVX2] = avx2;
+    dispatch.supported[INFER_ISA_AVX512_VNNI] = avx2 && __builtin_cpu_supports("avx512vl") &&
+                                                __builtin_cpu_supports("avx512vnni");
+    dispatch.supported[INFER_ISA_AVX_VNNI] = avx2 && __builtin_cpu_supports("avxvnni");
+#endif
+    dispatch.best = INFER_ISA_SCALAR;
+    for (int i = INFER_ISA_COUNT - 1; i > 0; i--) {
+        if (dispatch.supported[i]) {
+            dispatch.best = (infer_isa_t)i;
+            break;
+        }
+    }
+    dispatch.active = dispatch.best;
+    dispatch.detected = true;
+}
+
+/* Best instruction set on this CPU */
+infer_isa_t infer_isa_detect(void) {
+    detect();
+    return dispatch.best;
+}
+
+/* Instruction set in use */
+infer_isa_t infer_isa_active(void) {
+    detect();
+    return dispatch.active;
+}
+
+/* Force an instruction set, falling back to the best supported below it */
+infer_isa_t infer_isa_select(infer_isa_t isa) {
+    detect();
+    if ((uint32_t)isa >= INFER_ISA_COUNT) {
+        isa = INFER_ISA_COUNT - 1;
+    }
+    while (isa > INFER_ISA_SCALAR && !dispatch.supported[isa]) {
+        isa--;
+    }
+    dispatch.active = isa;
+    return isa;
+}
+
+/* Instruction set name */
+const char* infer_isa_name(infer_isa_t isa) {
+    return (uint32_t)isa < INFER_ISA_COUNT ? isa_kernels[isa].name : "unknown";
+}
+
+/* Quantize one row */
+float infer_quantize(const float* x, uint32_t n, int8_t* q) {
+    float max = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        float a = fabsf(x[i]);
+        if (a > max) {
+            max = a;
+        }
+    }
+    if (max == 0.0f) {
+        memset(q, 0, n);
+        return 0.0f;
+    }
+    float inv = 127.0f / max;
+    for (uint32_t i = 0; i < n; i++) {
+        q[i] = (int8_t)lrintf(x[i] * inv);
+    }
+    return max / 127.0f;
+}
+
+/* Matrix multiply against quantized weights */
+void infer_gemm(const infer_tensor_t* w, const int8_t* x, const float* x_scale, uint32_t tokens,
+                const float* bias, bool relu, float* y) {
+    detect();
+    gemm_row_fn fn = w->type == INFER_S4 ? isa_kernels[dispatch.active].s4 : isa_kernels[dispatch.active].s8;
+    for (uint32_t t = 0; t < tokens; t++) {
+        fn(w, x + (size_t)t * w->cols, x_scale[t], bias, relu, y + (size_t)t * w->rows);
+    }
+}
+
+/* Arena */
+status_t infer_arena_init(infer_arena_t* arena, size_t size) {
+    if (!arena || size == 0) {
+        return STATUS_INVALID;
+    }
+    arena->base = aligned_alloc(INFER_ALIGN, (size + INFER_ALIGN - 1) & ~(size_t)(INFER_ALIGN - 1));
+    if (!arena->base) {
+        return STATUS_NOMEM;
+    }
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    return STATUS_OK;
+}
+
+void infer_arena_destroy(infer_arena_t* arena) {
+    if (arena) {
+        free(arena->base);
+        arena->base = NULL;
+        arena->size = arena->used = 0;
+    }
+}
+
+void* infer_arena_alloc(infer_arena_t* arena, size_t size) {
+    size_t start = (arena->used + INFER_ALIGN - 1) & ~(size_t)(INFER_ALIGN - 1);
+    if (start > arena->size || size > arena->size - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return arena->base + start;
+}
+
+void infer_arena_reset(infer_arena_t* arena) {
+    arena->used = 0;
+}
+
+/* Weight file writer */
+static uint64_t align_up(uint64_t v) {
+    return (v + INFER_ALIGN - 1) & ~(uint64_t)(INFER_ALIGN - 1);
+}
+
+static uint64_t tensor_bytes(infer_type_t type, uint32_t rows, uint32_t cols, uint64_t* scale_bytes) {
+    switch (type) {
+        case INFER_S8:
+            *scale_bytes = (uint64_t)rows * sizeof(float);
+            return (uint64_t)rows * cols;
+        case INFER_S4:
+            *scale_bytes = (uint64_t)rows * (cols / INFER_BLOCK) * sizeof(float);
+            return (uint64_t)rows * cols / 2;
+        case INFER_F32:
+        default:
+            *scale_bytes = 0;
+            return (uint64_t)rows * cols * sizeof(float);
+    }
+}
+
+/* Quantize one source tensor into its file representation */
+static void quantize_tensor(const infer_tensor_source_t* src, uint32_t cols, uint8_t* data, float* scales) {
+    for (uint32_t r = 0; r < src->rows; r++) {
+        const float* row = src->data + (size_t)r * src->cols;
+        if (src->type == INFER_F32) {
+            memcpy(data + (size_t)r * cols * sizeof(float), row, (size_t)src->cols * sizeof(float));
+            continue;
+        }
+        if (src->type == INFER_S8) {
+            float padded[cols];
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, row, (size_t)src->cols * sizeof(float));
+            scales[r] = infer_quantize(padded, cols, (int8_t*)data + (size_t)r * cols);
+            continue;
+        }
+
+        uint32_t groups = cols / INFER_BLOCK;
+        for (uint32_t g = 0; g < groups; g++) {
+            float v[INFER_BLOCK] = { 0 };
+            float max = 0.0f;
+            for (uint32_t c = 0; c < INFER_BLOCK; c++) {
+                uint32_t col = g * INFER_BLOCK + c;
+                v[c] = col < src->cols ? row[col] : 0.0f;
+                if (fabsf(v[c]) > max) {
+                    max = fabsf(v[c]);
+                }
+            }
+            float scale = max / 7.0f;
+            scales[(size_t)r * groups + g] = scale;
+            uint8_t* out = data + ((size_t)r * groups + g) * (INFER_BLOCK / 2);
+            for (uint32_t c = 0; c < INFER_BLOCK / 2; c++) {
+                long lo = scale > 0.0f ? lrintf(v[c] / scale) : 0;
+                long hi = scale > 0.0f ? lrintf(v[c + 16] / scale) : 0;
+                lo = lo < -8 ? -8 : lo > 7 ? 7 : lo;
+                hi = hi < -8 ? -8 : hi > 7 ? 7 : hi;
+                out[c] = (uint8_t)((lo + 8) | ((hi + 8) << 4));
+            }
+        }
+    }
+}
+
+status_t infer_weights_write(const char* path, const infer_tensor_source_t* tensors, uint32_t count) {
+    if (!path || !tensors || count == 0) {
+        return STATUS_INVALID;
+    }
+
+    infer_tensor_desc_t* desc = calloc(count, sizeof(infer_tensor_desc_t));
+    if (!desc) {
+        return STATUS_NOMEM;
+    }
+
+    uint64_t offset = align_up(sizeof(infer_file_header_t) + (uint64_t)count * sizeof(infer_tensor_desc_t));
+    for (uint32_t i = 0; i < count; i++) {
+        const infer_tensor_source_t* src = &tensors[i];
+        uint32_t cols = src->type == INFER_F32 ? src->cols : infer_padded(src->cols);
+        snprintf(desc[i].name, sizeof(desc[i].name), "%s", src->name);
+        desc[i].type = src->type;
+        desc[i].rows = src->rows;
+        desc[i].cols = cols;
+        desc[i].data_offset = offset;
+        desc[i].data_size = tensor_bytes(src->type, src->rows, cols, &desc[i].scale_size);
+        offset = align_up(offset + desc[i].data_size);
+        if (desc[i].scale_size) {
+            desc[i].scale_offset = offset;
+            offset = align_up(offset + desc[i].scale_size);
+        }
+    }
+
+    uint8_t* image = calloc(1, offset);
+    if (!image) {
+        free(desc);
+        return STATUS_NOMEM;
+    }
+    infer_file_header_t* header = (infer_file_header_t*)image;
+    header->magic = INFER_MAGIC;
+    header->version = INFER_VERSION;
+    header->tensor_count = count;
+    header->file_size = offset;
+    memcpy(image + sizeof(*header), desc, (size_t)count * sizeof(infer_tensor_desc_t));
+    for (uint32_t i = 0; i < count; i++) {
+        quantize_tensor(&tensors[i], desc[i].cols, image + desc[i].data_offset,
+                        desc[i].scale_size ? (float*)(image + desc[i].scale_offset) : NULL);
+    }
+
+    /* Write beside the target and rename so a running companion never maps a torn file */
+    char tmp[4096];
+    status_t status = STATUS_ERROR;
+    if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", path) < sizeof(tmp)) {
+        FILE* f = fopen(tmp, "wb");
+        if (f) {
+            bool ok = fwrite(image, 1, offset, f) == offset;
+            ok = (fclose(f) == 0) && ok;
+            if (ok && rename(tmp, path) == 0) {
+                status = STATUS_OK;
+            } else {
+                unlink(tmp);
+            }
+        }
+    }
+
+    free(image);
+    free(desc);
+    return status;
+}
+
+/* Map a weight file; tensors point straight into the mapping */
+status_t infer_weights_open(const char* path, infer_weights_t** out) {
+    if (!path || !out) {
+        return STATUS_INVALID;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return STATUS_NOTFOUND;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < sizeof(infer_file_header_t)) {
+        close(fd);
+        return STATUS_INVALID;
+    }
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return STATUS_NOMEM;
+    }
+    madvise(map, size, MADV_WILLNEED);
+
+    const infer_file_header_t* header = (const infer_file_header_t*)map;
+    if (header->magic != INFER_MAGIC || header->version != INFER_VERSION || header->file_size != size ||
+        header->tensor_count == 0 ||
+        header->tensor_count > (size - sizeof(*header)) / sizeof(infer_tensor_desc_t)) {
+        munmap(map, size);
+        return STATUS_INVALID;
+    }
+
+    infer_weights_t* weights = calloc(1, sizeof(infer_weights_t));
+    infer_tensor_t* tensors = calloc(header->tensor_count, sizeof(infer_tensor_t));
+    if (!weights || !tensors) {
+        free(weights);
+        free(tensors);
+        munmap(map, size);
+        return STATUS_NOMEM;
+    }
+
+    const infer_tensor_desc_t* desc = (const infer_tensor_desc_t*)((const uint8_t*)map + sizeof(*header));
+    for (uint32_t i = 0; i < header->tensor_count; i++) {
+        const infer_tensor_desc_t* d = &desc[i];
+        uint64_t scale_bytes;
+        bool valid = d->name[INFER_NAME_MAX - 1] == '\0' && d->type <= INFER_S4 && d->rows > 0 && d->cols > 0 &&
+                     (d->type == INFER_F32 || d->cols % INFER_BLOCK == 0) &&
+                     d->data_size == tensor_bytes((infer_type_t)d->type, d->rows, d->cols, &scale_bytes) &&
+                     d->scale_size == scale_bytes &&
+                     d->data_offset % INFER_ALIGN == 0 && d->scale_offset % INFER_ALIGN == 0 &&
+                     d->data_offset <= size && d->data_size <= size - d->data_offset &&
+                     d->scale_offset <= size && d->scale_size <= size - d->scale_offset &&
+                     (d->scale_size == 0 || d->scale_offset != 0);
+        if (!valid) {
+            free(tensors);
+            free(weights);
+            munmap(map, size);
+            return STATUS_INVALID;
+        }
+        tensors[i].name = d->name;
+        tensors[i].type = (infer_type_t)d->type;
+        tensors[i].rows = d->rows;
+        tensors[i].cols = d->cols;
+        tensors[i].data = (const uint8_t*)map + d->data_offset;
+        tensors[i].scales = d->scale_size ? (const float*)((const uint8_t*)map + d->scale_offset) : NULL;
+    }
+
+    weights->map = map;
+    weights->size = size;
+    weights->tensor_count = header->tensor_count;
+    weights->tensors = tensors;
+    *out = weights;
+    return STATUS_OK;
+}
+
+void infer_weights_close(infer_weights_t* weights) {
+    if (!weights) {
+        return;
+    }
+    munmap(weights->map, weights->size);
+    free(weights->tensors);
+    free(weights);
+}
+
+const infer_tensor_t* infer_weights_find(const infer_weights_t* weights, const char* name) {
+    for (uint32_t i = 0; weights && i < weights->tensor_count; i++) {
+        if (strcmp(weights->tensors[i].name, name) == 0) {
+            return &weights->tensors[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,127 @@
+#ifndef LIMITLESS_AI_INFER_H
+#define LIMITLESS_AI_INFER_H
+
+/*
+ * LimitlessOS AI Companion - Inference Runtime
+ * CPU-only quantized inference: int8/int4 GEMM kernels with ISA dispatch,
+ * an arena for activations and memory-mapped weight files
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "kernel.h"
+
+/* Weight file: header, tensor table, then 64-byte aligned tensor data */
+#define INFER_MAGIC         0x4d574c4cu  /* "LLWM" */
+#define INFER_VERSION       1
+#define INFER_ALIGN         64
+#define INFER_BLOCK         32           /* Quantized columns are padded to this */
+#define INFER_NAME_MAX      32
+
+/* Tensor element types */
+typedef enum {
+    INFER_F32,          // Float, used for biases
+    INFER_S8,           // Int8, one scale per row
+    INFER_S4,           // Int4, one scale per 32-column group
+} infer_type_t;
+
+/* Kernel instruction sets, slowest first */
+typedef enum {
+    INFER_ISA_SCALAR,
+    INFER_ISA_AVX2,     // vpmaddubsw on sign-folded operands
+    INFER_ISA_AVX512_VNNI,  // vpdpbusd, EVEX encoded on 256-bit vectors
+    INFER_ISA_AVX_VNNI, // vpdpbusd, VEX encoded
+    INFER_ISA_COUNT
+} infer_isa_t;
+
+typedef struct infer_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tensor_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint8_t pad[40];
+} infer_file_header_t;
+
+typedef struct infer_tensor_desc {
+    char name[INFER_NAME_MAX];
+    uint32_t type;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t reserved;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t scale_offset;      // Row (s8) or group (s4) scales, 0 for f32
+    uint64_t scale_size;
+} infer_tensor_desc_t;
+
+/* A tensor inside a mapped weight file */
+typedef struct infer_tensor {
+    const char* name;
+    infer_type_t type;
+    uint32_t rows;
+    uint32_t cols;
+    const void* data;           // Points into the mapping
+    const float* scales;
+} infer_tensor_t;
+
+/* Mapped weight file */
+typedef struct infer_weights {
+    void* map;
+    size_t size;
+    uint32_t tensor_count;
+    infer_tensor_t* tensors;
+} infer_weights_t;
+
+/* Float tensor handed to the writer, which quantizes it */
+typedef struct infer_tensor_source {
+    const char* name;
+    infer_type_t type;
+    uint32_t rows;
+    uint32_t cols;              // Padded with zeros to INFER_BLOCK when quantized
+    const float* data;
+} infer_tensor_source_t;
+
+/* Bump allocator for activations, reset per request */
+typedef struct infer_arena {
+    uint8_t* base;
+    size_t size;
+    size_t used;
+    size_t peak;
+} infer_arena_t;
+
+/* Weight files */
+status_t infer_weights_write(const char* path, const infer_tensor_source_t* tensors, uint32_t count);
+status_t infer_weights_open(const char* path, infer_weights_t** out);
+void infer_weights_close(infer_weights_t* weights);
+const infer_tensor_t* infer_weights_find(const infer_weights_t* weights, const char* name);
+
+/* Arena */
+status_t infer_arena_init(infer_arena_t* arena, size_t size);
+void infer_arena_destroy(infer_arena_t* arena);
+void* infer_arena_alloc(infer_arena_t* arena, size_t size);
+void infer_arena_reset(infer_arena_t* arena);
+
+/* Kernel dispatch */
+infer_isa_t infer_isa_detect(void);
+infer_isa_t infer_isa_active(void);
+infer_isa_t infer_isa_select(infer_isa_t isa);  // Clamped to what the CPU supports
+const char* infer_isa_name(infer_isa_t isa);
+
+/* Symmetric per-row quantization to [-127, 127]; returns the scale */
+float infer_quantize(const float* x, uint32_t n, int8_t* q);
+
+/*
+ * y[t][r] = x_scale[t] * dot(x[t], w[r]) + bias[r], optionally ReLU'd.
+ * x is tokens rows of w->cols int8 values; w is s8 or s4.
+ */
+void infer_gemm(const infer_tensor_t* w, const int8_t* x, const float* x_scale, uint32_t tokens,
+                const float* bias, bool relu, float* y);
+
+/* Padded column count for a logical width */
+static inline uint32_t infer_padded(uint32_t cols) {
+    return (cols + INFER_BLOCK - 1) / INFER_BLOCK * INFER_BLOCK;
+}
+
+#endif /* LIMITLESS_AI_INFER_H */
@@ -0,0 +1,304 @@
+/*
+ * LimitlessOS AI Companion - Intent and Entity Model
+ * Tokenizer, weight loading and quantized forward pass
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "intent_model.h"
+
+struct intent_model {
+    infer_weights_t* weights;
+    const infer_tensor_t* embed;
+    const infer_tensor_t* intent_w1;
+    const infer_tensor_t* intent_b1;
+    const infer_tensor_t* intent_w2;
+    const infer_tensor_t* intent_b2;
+    const infer_tensor_t* entity_w1;
+    const infer_tensor_t* entity_b1;
+    const infer_tensor_t* entity_w2;
+    const infer_tensor_t* entity_b2;
+};
+
+static const char* entity_names[ENTITY_TYPES] = {
+    [ENTITY_NONE] = "none",
+    [ENTITY_PACKAGE] = "package",
+    [ENTITY_PATH] = "path",
+    [ENTITY_SERVICE] = "service",
+    [ENTITY_HOST] = "host",
+    [ENTITY_NETWORK] = "network",
+    [ENTITY_SETTING] = "setting",
+};
+
+const char* intent_entity_name(entity_type_t type) {
+    return (uint32_t)type < ENTITY_TYPES ? entity_names[type] : "unknown";
+}
+
+/* FNV-1a over a feature kind and the lowercased bytes */
+static uint32_t feature_hash(char kind, const char* s, uint32_t len) {
+    uint32_t h = 2166136261u;
+    h = (h ^ (uint8_t)kind) * 16777619u;
+    for (uint32_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)tolower((unsigned char)s[i])) * 16777619u;
+    }
+    return h % INTENT_BUCKETS;
+}
+
+/* Coarse token shape: paths, file names, numbers, flags, identifiers */
+static uint32_t token_shape(const char* s, uint32_t len) {
+    uint32_t shape = 0;
+    bool alpha = true;
+    for (uint32_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '/' || c == '~') shape |= 1;
+        else if (c == '.') shape |= 2;
+        else if (isdigit(c)) shape |= 4;
+        else if (c == '-' || c == '_' || c == '@' || c == ':') shape |= (i == 0 && c == '-') ? 8 : 16;
+        if (!isalpha(c)) alpha = false;
+    }
+    if (alpha) shape |= 32;
+    shape |= (len <= 1 ? 0u : len <= 3 ? 1u : len <= 6 ? 2u : 3u) << 6;
+    return shape;
+}
+
+/* Split on whitespace, trimming quotes and sentence punctuation */
+uint32_t intent_tokenize(const char* input, intent_token_t* tokens, uint32_t max) {
+    uint32_t count = 0;
+    const char* p = input;
+    while (p && *p && count < max) {
+        while (*p && isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (!*p) {
+            break;
+        }
+        const char* s = p;
+        while (*p && !isspace((unsigned char)*p)) {
+            p++;
+        }
+        uint32_t len = (uint32_t)(p - s);
+        while (len && strchr("\"'`(", s[0])) {
+            s++;
+            len--;
+        }
+        while (len && strchr("\"'`),;:!?", s[len - 1])) {
+            len--;
+        }
+        if (len > 1 && s[len - 1] == '.') {
+            len--;
+        }
+        if (!len) {
+            continue;
+        }
+
+        intent_token_t* t = &tokens[count++];
+        t->start = (uint32_t)(s - input);
+        t->length = len;
+        uint32_t affix = len < 3 ? len : 3;
+        char shape[4];
+        uint32_t bits = token_shape(s, len);
+        memcpy(shape, &bits, sizeof(shape));
+        t->features[0] = feature_hash('w', s, len);
+        t->features[1] = feature_hash('p', s, affix);
+        t->features[2] = feature_hash('s', s + len - affix, affix);
+        t->features[3] = feature_hash('h', shape, sizeof(shape));
+    }
+    return count;
+}
+
+static bool check(const infer_tensor_t* t, bool dense, uint32_t rows, uint32_t cols) {
+    if (!t || t->rows != rows) {
+        return false;
+    }
+    if (!dense) {
+        return t->type == INFER_F32 && t->cols == cols;
+    }
+    return (t->type == INFER_S8 || t->type == INFER_S4) && t->cols == infer_padded(cols);
+}
+
+/* Load model */
+status_t intent_model_load(const char* path, intent_model_t** out) {
+    if (!path || !out) {
+        return STATUS_INVALID;
+    }
+
+    infer_weights_t* weights = NULL;
+    status_t status = infer_weights_open(path, &weights);
+    if (FAILED(status)) {
+        return status;
+    }
+
+    intent_model_t* model = calloc(1, sizeof(intent_model_t));
+    if (!model) {
+        infer_weights_close(weights);
+        return STATUS_NOMEM;
+    }
+    model->weights = weights;
+    model->embed = infer_weights_find(weights, "embed");
+    model->intent_w1 = infer_weights_find(weights, "intent.w1");
+    model->intent_b1 = infer_weights_find(weights, "intent.b1");
+    model->intent_w2 = infer_weights_find(weights, "intent.w2");
+    model->intent_b2 = infer_weights_find(weights, "intent.b2");
+    model->entity_w1 = infer_weights_find(weights, "entity.w1");
+    model->entity_b1 = infer_weights_find(weights, "entity.b1");
+    model->entity_w2 = infer_weights_find(weights, "entity.w2");
+    model->entity_b2 = infer_weights_find(weights, "entity.b2");
+
+    bool valid = model->embed && model->embed->type == INFER_S8 &&
+                 model->embed->rows == INTENT_BUCKETS && model->embed->cols == INTENT_DIM &&
+                 check(model->intent_w1, true, INTENT_HIDDEN, INTENT_DIM) &&
+                 check(model->intent_b1, false, 1, INTENT_HIDDEN) &&
+                 check(model->intent_w2, true, INTENT_CLASSES, INTENT_HIDDEN) &&
+                 check(model->intent_b2, false, 1, INTENT_CLASSES) &&
+                 check(model->entity_w1, true, ENTITY_HIDDEN, INTENT_WINDOW * INTENT_DIM) &&
+                 check(model->entity_b1, false, 1, ENTITY_HIDDEN) &&
+                 check(model->entity_w2, true, ENTITY_TYPES, ENTITY_HIDDEN) &&
+                 check(model->entity_b2, false, 1, ENTITY_TYPES);
+    if (!valid) {
+        intent_model_free(model);
+        return STATUS_INVALID;
+    }
+
+    *out = model;
+    return STATUS_OK;
+}
+
+/* Free model */
+void intent_model_free(intent_model_t* model) {
+    if (model) {
+        infer_weights_close(model->weights);
+        free(model);
+    }
+}
+
+/* Quantize each row of a float matrix into arena buffers */
+static int8_t* quantize_rows(infer_arena_t* arena, const float* x, uint32_t rows, uint32_t cols, float** scales) {
+    int8_t* q = infer_arena_alloc(arena, (size_t)rows * cols);
+    *scales = infer_arena_alloc(arena, (size_t)rows * sizeof(float));
+    if (!q || !*scales) {
+        return NULL;
+    }
+    for (uint32_t r = 0; r < rows; r++) {
+        (*scales)[r] = infer_quantize(x + (size_t)r * cols, cols, q + (size_t)r * cols);
+    }
+    return q;
+}
+
+/* Run the model on one request */
+status_t intent_model_predict(intent_model_t* model, infer_arena_t* arena, const char* input,
+                              intent_prediction_t* out) {
+    if (!model || !arena || !input || !out) {
+        return STATUS_INVALID;
+    }
+    memset(out, 0, sizeof(*out));
+    out->intent = ACTION_TYPE_COMMAND;
+
+    intent_token_t tokens[INTENT_MAX_TOKENS];
+    uint32_t n = intent_tokenize(input, tokens, INTENT_MAX_TOKENS);
+    out->tokens = n;
+    if (n == 0) {
+        return STATUS_OK;
+    }
+
+    infer_arena_reset(arena);
+    const uint32_t window = INTENT_WINDOW * INTENT_DIM;
+    float* embed = infer_arena_alloc(arena, (size_t)n * INTENT_DIM * sizeof(float));
+    float* pooled = infer_arena_alloc(arena, INTENT_DIM * sizeof(float));
+    float* hidden = infer_arena_alloc(arena, INTENT_HIDDEN * sizeof(float));
+    float* logits = infer_arena_alloc(arena, INTENT_CLASSES * sizeof(float));
+    float* context = infer_arena_alloc(arena, (size_t)n * window * sizeof(float));
+    float* tag_hidden = infer_arena_alloc(arena, (size_t)n * ENTITY_HIDDEN * sizeof(float));
+    float* tags = infer_arena_alloc(arena, (size_t)n * ENTITY_TYPES * sizeof(float));
+    if (!embed || !pooled || !hidden || !logits || !context || !tag_hidden || !tags) {
+        return STATUS_NOMEM;
+    }
+
+    /* Token vectors: sum of the dequantized feature embeddings */
+    const int8_t* table = (const int8_t*)model->embed->data;
+    memset(pooled, 0, INTENT_DIM * sizeof(float));
+    for (uint32_t t = 0; t < n; t++) {
+        float* e = embed + (size_t)t * INTENT_DIM;
+        memset(e, 0, INTENT_DIM * sizeof(float));
+        for (uint32_t f = 0; f < INTENT_FEATURES; f++) {
+            uint32_t row = tokens[t].features[f];
+            const int8_t* q = table + (size_t)row * INTENT_DIM;
+            float scale = model->embed->scales[row];
+            for (uint32_t d = 0; d < INTENT_DIM; d++) {
+                e[d] += (float)q[d] * scale;
+            }
+        }
+        for (uint32_t d = 0; d < INTENT_DIM; d++) {
+            pooled[d] += e[d] / (float)n;
+        }
+    }
+
+    /* Intent: mean-pooled tokens through one hidden layer */
+    float* scale;
+    int8_t* q = quantize_rows(arena, pooled, 1, INTENT_DIM, &scale);
+    if (!q) {
+        return STATUS_NOMEM;
+    }
+    infer_gemm(model->intent_w1, q, scale, 1, (const float*)model->intent_b1->data, true, hidden);
+    q = quantize_rows(arena, hidden, 1, INTENT_HIDDEN, &scale);
+    if (!q) {
+        return STATUS_NOMEM;
+    }
+    infer_gemm(model->intent_w2, q, scale, 1, (const float*)model->intent_b2->data, false, logits);
+
+    float max = logits[0];
+    uint32_t best = 0;
+    for (uint32_t c = 1; c < INTENT_CLASSES; c++) {
+        if (logits[c] > max) {
+            max = logits[c];
+            best = c;
+        }
+    }
+    float sum = 0.0f;
+    for (uint32_t c = 0; c < INTENT_CLASSES; c++) {
+        sum += expf(logits[c] - max);
+    }
+    out->intent = (action_type_t)best;
+    out->confidence = 1.0f / sum;
+
+    /* Entities: each token with its neighbours, batched as one GEMM */
+    for (uint32_t t = 0; t < n; t++) {
+        float* z = context + (size_t)t * window;
+        for (uint32_t w = 0; w < INTENT_WINDOW; w++) {
+            int32_t src = (int32_t)t + (int32_t)w - INTENT_WINDOW / 2;
+            if (src < 0 || src >= (int32_t)n) {
+                memset(z + w * INTENT_DIM, 0, INTENT_DIM * sizeof(float));
+            } else {
+                memcpy(z + w * INTENT_DIM, embed + (size_t)src * INTENT_DIM, INTENT_DIM * sizeof(float));
+            }
+        }
+    }
+    q = quantize_rows(arena, context, n, window, &scale);
+    if (!q) {
+        return STATUS_NOMEM;
+    }
+    infer_gemm(model->entity_w1, q, scale, n, (const float*)model->entity_b1->data, true, tag_hidden);
+    q = quantize_rows(arena, tag_hidden, n, ENTITY_HIDDEN, &scale);
+    if (!q) {
+        return STATUS_NOMEM;
+    }
+    infer_gemm(model->entity_w2, q, scale, n, (const float*)model->entity_b2->data, false, tags);
+
+    for (uint32_t t = 0; t < n && out->entity_count < INTENT_MAX_ENTITIES; t++) {
+        const float* row = tags + (size_t)t * ENTITY_TYPES;
+        uint32_t tag = 0;
+        for (uint32_t k = 1; k < ENTITY_TYPES; k++) {
+            if (row[k] > row[tag]) {
+                tag = k;
+            }
+        }
+        if (tag != ENTITY_NONE) {
+            intent_entity_t* entity = &out->entities[out->entity_count++];
+            entity->type = (entity_type_t)tag;
+            snprintf(entity->text, sizeof(entity->text), "%.*s", (int)tokens[t].length, input + tokens[t].start);
+        }
+    }
+    return STATUS_OK;
+}
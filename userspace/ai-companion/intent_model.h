@@ -0,0 +1,107 @@
+#ifndef LIMITLESS_AI_INTENT_MODEL_H
+#define LIMITLESS_AI_INTENT_MODEL_H
+
+/*
+ * LimitlessOS AI Companion - Intent and Entity Model
+ * Hashed token features, a pooled intent classifier and a windowed entity
+ * tagger, run with the quantized inference runtime
+ */
+
+#include "companion.h"
+#include "infer.h"
+
+/* Model dimensions */
+#define INTENT_BUCKETS          4096    // Hashed feature embeddings
+#define INTENT_FEATURES         4       // Word, prefix, suffix and shape per token
+#define INTENT_DIM              64      // Token embedding width
+#define INTENT_HIDDEN           128     // Intent classifier hidden layer
+#define INTENT_WINDOW           3       // Tokens seen by the entity tagger
+#define ENTITY_HIDDEN           64      // Entity tagger hidden layer
+#define INTENT_CLASSES          (ACTION_TYPE_CODE + 1)
+#define INTENT_MAX_TOKENS       64
+#define INTENT_MAX_ENTITIES     8
+
+#define INTENT_ARENA_SIZE       (256 * 1024)
+#define INTENT_MODEL_PATH       "/usr/share/limitless/companion/intent.lwm"
+#define INTENT_MODEL_ENV        "LIMITLESS_COMPANION_MODEL"
+
+/* Entity tags */
+typedef enum {
+    ENTITY_NONE,
+    ENTITY_PACKAGE,
+    ENTITY_PATH,
+    ENTITY_SERVICE,
+    ENTITY_HOST,
+    ENTITY_NETWORK,     // Wireless network name
+    ENTITY_SETTING,
+    ENTITY_TYPES
+} entity_type_t;
+
+typedef struct intent_entity {
+    entity_type_t type;
+    char text[128];
+} intent_entity_t;
+
+/* Model output */
+typedef struct intent_prediction {
+    action_type_t intent;
+    float confidence;                   // Softmax probability of the intent
+    uint32_t tokens;
+    intent_entity_t entities[INTENT_MAX_ENTITIES];
+    uint32_t entity_count;
+} intent_prediction_t;
+
+/* Token with its hashed features */
+typedef struct intent_token {
+    uint32_t start;
+    uint32_t length;
+    uint32_t features[INTENT_FEATURES];
+} intent_token_t;
+
+typedef struct intent_model intent_model_t;
+
+/* Model API */
+status_t intent_model_load(const char* path, intent_model_t** out);
+void intent_model_free(intent_model_t* model);
+status_t intent_model_predict(intent_model_t* model, infer_arena_t* arena, const char* input,
+                              intent_prediction_t* out);
+uint32_t intent_tokenize(const char* input, intent_token_t* tokens, uint32_t max);
+const char* intent_entity_name(entity_type_t type);
+
+/* Training on the built-in synthetic request corpus */
+typedef struct intent_train_config {
+    uint32_t examples;
+    uint32_t epochs;
+    uint64_t seed;
+    infer_type_t dense_type;            // INFER_S8 or INFER_S4 for the GEMM weights
+} intent_train_config_t;
+
+status_t intent_model_train(const char* path, const intent_train_config_t* config);
+
+/* Accuracy and latency, per weight type and instruction set */
+typedef struct intent_bench_run {
+    infer_type_t type;
+    infer_isa_t isa;
+    uint64_t requests;
+    uint64_t tokens;
+    uint64_t total_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+} intent_bench_run_t;
+
+typedef struct intent_model_bench {
+    uint32_t train_examples;
+    uint32_t test_examples;
+    uint64_t train_ns;
+    uint64_t file_size[2];              // Int8 and int4 weight files
+    float intent_accuracy[2];
+    float entity_f1[2];
+    float rules_accuracy;               // Keyword rules on the same test set
+    size_t arena_peak;
+    uint32_t run_count;
+    intent_bench_run_t runs[2 * INFER_ISA_COUNT];
+} intent_model_bench_t;
+
+status_t intent_model_benchmark(const char* dir, uint32_t requests, intent_model_bench_t* out);
+
+#endif /* LIMITLESS_AI_INTENT_MODEL_H */
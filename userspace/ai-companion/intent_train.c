@@ -0,0 +1,630 @@
+/*
+ * LimitlessOS AI Companion - Intent Model Training
+ * Synthetic request corpus, float training, quantized export and benchmark
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include "intent_model.h"
+
+/* Slot vocabularies; every fifth value is held out for the test set */
+static const char* packages[] = {
+    "nginx", "vim", "htop", "firefox", "python3", "docker", "git", "gcc", "clang", "nodejs",
+    "postgresql", "redis", "curl", "wget", "tmux", "neovim", "emacs", "gimp", "inkscape", "vlc",
+    "blender", "rustc", "golang", "openssh-server", "apache2", "mariadb", "ffmpeg", "libreoffice",
+    "thunderbird", "zsh", "fish", "ripgrep", "fd-find", "jq", "cmake", "ninja-build", "valgrind",
+    "gdb", "strace", "wireshark", "nmap", "kubectl", "terraform", "ansible", "qemu", "sqlite3",
+};
+static const char* services[] = {
+    "sshd", "nginx", "apache2", "docker", "bluetooth", "cups", "networkmanager", "postgresql",
+    "redis", "cron", "systemd-resolved", "ntpd", "avahi-daemon", "mysql", "firewalld", "containerd",
+    "pipewire", "gdm", "udisks2", "tailscaled",
+};
+static const char* hosts[] = {
+    "example.com", "github.com", "192.168.1.1", "10.0.0.5", "google.com", "api.limitless.dev",
+    "server01", "nas.local", "8.8.8.8", "router.lan", "mail.example.org", "ftp.debian.org",
+    "172.16.4.20", "build-box", "db.internal", "1.1.1.1", "gitlab.com", "archive.org",
+};
+static const char* networks[] = {
+    "Home-5G", "CoffeeShop", "Office-WiFi", "eduroam", "Guest", "MyHotspot", "Airport_Free",
+    "Library-Net", "Starlink-1234", "NETGEAR42", "xfinitywifi", "Linksys", "TP-Link_9F",
+    "HotelLobby", "Pixel_7", "CampusNet",
+};
+static const char* settings[] = {
+    "brightness", "volume", "theme", "wallpaper", "timezone", "keyboard-layout", "dark-mode",
+    "bluetooth", "night-light", "font-size", "screensaver", "resolution", "language", "hostname",
+    "proxy", "dns", "power-profile", "mouse-speed",
+};
+static const char* values[] = {
+    "low", "high", "dark", "light", "50%", "utc", "us", "large", "small", "1920x1080", "french",
+    "max", "off", "quiet", "performance", "30", "auto",
+};
+static const char* dirs[] = {
+    "/home/user", "~", "~/documents", "/tmp", "./build", "/var/log", "/etc", "~/projects/app",
+    "/opt/data", "../src", "~/downloads", "/srv/www", "~/pictures", "/mnt/backup",
+};
+static const char* names[] = {
+    "notes", "report", "photo", "config", "main", "backup", "todo", "data", "index", "readme",
+    "server", "budget", "draft", "invoice", "setup", "results", "app", "schema",
+};
+static const char* extensions[] = {
+    ".txt", ".pdf", ".jpg", ".conf", ".c", ".py", ".log", ".md", ".csv", "", ".sh", ".json", ".tar.gz",
+};
+static const char* languages[] = { "python", "c", "rust", "bash", "go", "javascript", "lua" };
+static const char* tasks[] = {
+    "renames photos by date", "backs up my documents", "parses csv files", "counts words",
+    "downloads a web page", "resizes images", "checks disk space", "sorts a list of numbers",
+    "watches a folder for changes", "sends an email", "merges two json files",
+};
+static const char* words[] = { "error", "todo", "password", "main", "warning", "timeout", "fixme" };
+
+/* Templates: words separated by spaces, slots in braces */
+static const struct {
+    action_type_t intent;
+    const char* text;
+} templates[] = {
+    { ACTION_TYPE_INSTALL, "install {pkg}" },
+    { ACTION_TYPE_INSTALL, "please install {pkg}" },
+    { ACTION_TYPE_INSTALL, "add package {pkg}" },
+    { ACTION_TYPE_INSTALL, "can you install {pkg} for me" },
+    { ACTION_TYPE_INSTALL, "i need {pkg} on this machine" },
+    { ACTION_TYPE_INSTALL, "get me {pkg}" },
+    { ACTION_TYPE_INSTALL, "download and install {pkg}" },
+    { ACTION_TYPE_INSTALL, "set up {pkg}" },
+    { ACTION_TYPE_INSTALL, "apt install {pkg}" },
+    { ACTION_TYPE_INSTALL, "lpm install {pkg} {pkg}" },
+    { ACTION_TYPE_INSTALL, "add {pkg} to the system" },
+    { ACTION_TYPE_INSTALL, "put {pkg} on my laptop" },
+    { ACTION_TYPE_INSTALL, "grab the latest {pkg}" },
+    { ACTION_TYPE_INSTALL, "i want to use {pkg}" },
+
+    { ACTION_TYPE_SETTINGS, "change the {setting} to {value}" },
+    { ACTION_TYPE_SETTINGS, "set {setting} to {value}" },
+    { ACTION_TYPE_SETTINGS, "configure the {setting}" },
+    { ACTION_TYPE_SETTINGS, "turn on {setting}" },
+    { ACTION_TYPE_SETTINGS, "turn off {setting}" },
+    { ACTION_TYPE_SETTINGS, "enable {setting}" },
+    { ACTION_TYPE_SETTINGS, "disable {setting}" },
+    { ACTION_TYPE_SETTINGS, "make the {setting} {value}" },
+    { ACTION_TYPE_SETTINGS, "switch {setting} to {value}" },
+    { ACTION_TYPE_SETTINGS, "adjust the {setting}" },
+    { ACTION_TYPE_SETTINGS, "i prefer {value} {setting}" },
+    { ACTION_TYPE_SETTINGS, "update my {setting} preference" },
+
+    { ACTION_TYPE_FILE_OP, "create file {path}" },
+    { ACTION_TYPE_FILE_OP, "delete file {path}" },
+    { ACTION_TYPE_FILE_OP, "delete {path}" },
+    { ACTION_TYPE_FILE_OP, "remove {path}" },
+    { ACTION_TYPE_FILE_OP, "copy {path} to {path}" },
+    { ACTION_TYPE_FILE_OP, "move {path} to {path}" },
+    { ACTION_TYPE_FILE_OP, "rename {path} to {path}" },
+    { ACTION_TYPE_FILE_OP, "make a folder called {path}" },
+    { ACTION_TYPE_FILE_OP, "create a new directory {path}" },
+    { ACTION_TYPE_FILE_OP, "back up {path} into {path}" },
+    { ACTION_TYPE_FILE_OP, "duplicate {path}" },
+    { ACTION_TYPE_FILE_OP, "cp {path} {path}" },
+    { ACTION_TYPE_FILE_OP, "mv {path} {path}" },
+    { ACTION_TYPE_FILE_OP, "rm {path}" },
+    { ACTION_TYPE_FILE_OP, "mkdir {path}" },
+    { ACTION_TYPE_FILE_OP, "compress {path} into {path}" },
+
+    { ACTION_TYPE_NETWORK, "connect to {ssid}" },
+    { ACTION_TYPE_NETWORK, "join the {ssid} network" },
+    { ACTION_TYPE_NETWORK, "connect to wifi {ssid}" },
+    { ACTION_TYPE_NETWORK, "disconnect from {ssid}" },
+    { ACTION_TYPE_NETWORK, "ping {host}" },
+    { ACTION_TYPE_NETWORK, "is {host} reachable" },
+    { ACTION_TYPE_NETWORK, "check my connection to {host}" },
+    { ACTION_TYPE_NETWORK, "what is my ip address" },
+    { ACTION_TYPE_NETWORK, "show network interfaces" },
+    { ACTION_TYPE_NETWORK, "forget the {ssid} network" },
+    { ACTION_TYPE_NETWORK, "ssh into {host}" },
+    { ACTION_TYPE_NETWORK, "trace the route to {host}" },
+    { ACTION_TYPE_NETWORK, "curl {host}" },
+    { ACTION_TYPE_NETWORK, "get online with {ssid}" },
+
+    { ACTION_TYPE_SYSTEM, "reboot" },
+    { ACTION_TYPE_SYSTEM, "restart the computer" },
+    { ACTION_TYPE_SYSTEM, "shut down" },
+    { ACTION_TYPE_SYSTEM, "power off the machine" },
+    { ACTION_TYPE_SYSTEM, "restart {svc}" },
+    { ACTION_TYPE_SYSTEM, "stop the {svc} service" },
+    { ACTION_TYPE_SYSTEM, "start {svc}" },
+    { ACTION_TYPE_SYSTEM, "reload {svc}" },
+    { ACTION_TYPE_SYSTEM, "put the machine to sleep" },
+    { ACTION_TYPE_SYSTEM, "reboot now" },
+    { ACTION_TYPE_SYSTEM, "systemctl restart {svc}" },
+    { ACTION_TYPE_SYSTEM, "check the status of {svc}" },
+    { ACTION_TYPE_SYSTEM, "enable {svc} at boot" },
+    { ACTION_TYPE_SYSTEM, "log me out" },
+
+    { ACTION_TYPE_CODE, "write a script that {task}" },
+    { ACTION_TYPE_CODE, "generate code that {task}" },
+    { ACTION_TYPE_CODE, "write a {lang} program that {task}" },
+    { ACTION_TYPE_CODE, "run code in {path}" },
+    { ACTION_TYPE_CODE, "create a {lang} function that {task}" },
+    { ACTION_TYPE_CODE, "run the script {path}" },
+    { ACTION_TYPE_CODE, "execute {path}" },
+    { ACTION_TYPE_CODE, "compile {path}" },
+    { ACTION_TYPE_CODE, "write a {lang} script that {task}" },
+    { ACTION_TYPE_CODE, "help me code something that {task}" },
+
+    { ACTION_TYPE_COMMAND, "list files" },
+    { ACTION_TYPE_COMMAND, "list all files in {path}" },
+    { ACTION_TYPE_COMMAND, "show me the current directory" },
+    { ACTION_TYPE_COMMAND, "what time is it" },
+    { ACTION_TYPE_COMMAND, "show disk usage" },
+    { ACTION_TYPE_COMMAND, "how much memory is free" },
+    { ACTION_TYPE_COMMAND, "find {path}" },
+    { ACTION_TYPE_COMMAND, "search for {word} in {path}" },
+    { ACTION_TYPE_COMMAND, "ls -la {path}" },
+    { ACTION_TYPE_COMMAND, "cat {path}" },
+    { ACTION_TYPE_COMMAND, "show running processes" },
+    { ACTION_TYPE_COMMAND, "who is logged in" },
+    { ACTION_TYPE_COMMAND, "print the date" },
+    { ACTION_TYPE_COMMAND, "show the contents of {path}" },
+    { ACTION_TYPE_COMMAND, "count lines in {path}" },
+    { ACTION_TYPE_COMMAND, "what is using the cpu" },
+    { ACTION_TYPE_COMMAND, "tail {path}" },
+    { ACTION_TYPE_COMMAND, "open {path}" },
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+#define TEMPLATE_COUNT COUNT(templates)
+#define TEST_EXAMPLES 2000
+
+typedef struct train_example {
+    char text[256];
+    action_type_t intent;
+    uint32_t tokens;
+    uint8_t tags[INTENT_MAX_TOKENS];
+} train_example_t;
+
+static uint64_t next_random(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static float uniform(uint64_t* rng, float range) {
+    return ((float)(next_random(rng) >> 40) / (float)(1u << 24) * 2.0f - 1.0f) * range;
+}
+
+/* Pick a vocabulary entry from the training or held-out partition */
+static const char* pick(uint64_t* rng, const char** list, size_t count, bool test) {
+    for (;;) {
+        size_t i = (size_t)(next_random(rng) % count);
+        if ((i % 5 == 0) == test) {
+            return list[i];
+        }
+    }
+}
+
+static void append(train_example_t* ex, size_t* len, const char* word, entity_type_t tag) {
+    int n = snprintf(ex->text + *len, sizeof(ex->text) - *len, "%s%s", *len ? " " : "", word);
+    if (n > 0 && *len + (size_t)n < sizeof(ex->text) && ex->tokens < INTENT_MAX_TOKENS) {
+        *len += (size_t)n;
+        ex->tags[ex->tokens++] = (uint8_t)tag;
+    }
+}
+
+/* Expand a random template; slot values and their tags are recorded per token */
+static void generate(uint64_t* rng, bool test, train_example_t* ex) {
+    memset(ex, 0, sizeof(*ex));
+    uint32_t index = (uint32_t)(next_random(rng) % TEMPLATE_COUNT);
+    ex->intent = templates[index].intent;
+
+    size_t len = 0;
+    if (next_random(rng) % 6 == 0) {
+        append(ex, &len, next_random(rng) % 2 ? "please" : "hey", ENTITY_NONE);
+    }
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%s", templates[index].text);
+    for (char* save = NULL, *word = strtok_r(buf, " ", &save); word; word = strtok_r(NULL, " ", &save)) {
+        char path[128];
+        if (strcmp(word, "{pkg}") == 0) {
+            append(ex, &len, pick(rng, packages, COUNT(packages), test), ENTITY_PACKAGE);
+        } else if (strcmp(word, "{svc}") == 0) {
+            append(ex, &len, pick(rng, services, COUNT(services), test), ENTITY_SERVICE);
+        } else if (strcmp(word, "{host}") == 0) {
+            append(ex, &len, pick(rng, hosts, COUNT(hosts), test), ENTITY_HOST);
+        } else if (strcmp(word, "{ssid}") == 0) {
+            append(ex, &len, pick(rng, networks, COUNT(networks), test), ENTITY_NETWORK);
+        } else if (strcmp(word, "{setting}") == 0) {
+            append(ex, &len, pick(rng, settings, COUNT(settings), test), ENTITY_SETTING);
+        } else if (strcmp(word, "{path}") == 0) {
+            const char* name = pick(rng, names, COUNT(names), test);
+            const char* ext = extensions[next_random(rng) % COUNT(extensions)];
+            if (next_random(rng) % 3 == 0) {
+                snprintf(path, sizeof(path), "%s%s", name, ext);
+            } else {
+                snprintf(path, sizeof(path), "%s/%s%s", dirs[next_random(rng) % COUNT(dirs)], name, ext);
+            }
+            append(ex, &len, path, ENTITY_PATH);
+        } else if (strcmp(word, "{value}") == 0) {
+            append(ex, &len, values[next_random(rng) % COUNT(values)], ENTITY_NONE);
+        } else if (strcmp(word, "{lang}") == 0) {
+            append(ex, &len, languages[next_random(rng) % COUNT(languages)], ENTITY_NONE);
+        } else if (strcmp(word, "{word}") == 0) {
+            append(ex, &len, words[next_random(rng) % COUNT(words)], ENTITY_NONE);
+        } else if (strcmp(word, "{task}") == 0) {
+            char task[128];
+            snprintf(task, sizeof(task), "%s", tasks[next_random(rng) % COUNT(tasks)]);
+            for (char* s2 = NULL, *w = strtok_r(task, " ", &s2); w; w = strtok_r(NULL, " ", &s2)) {
+                append(ex, &len, w, ENTITY_NONE);
+            }
+        } else {
+            append(ex, &len, word, ENTITY_NONE);
+        }
+    }
+
+    /* Casing and punctuation the tokenizer has to see through */
+    if (next_random(rng) % 3 == 0) {
+        ex->text[0] = (char)toupper((unsigned char)ex->text[0]);
+    }
+    uint64_t tail = next_random(rng) % 5;
+    if (tail == 0 && len + 1 < sizeof(ex->text)) {
+        strcat(ex->text, "?");
+    } else if (tail == 1 && len + 1 < sizeof(ex->text)) {
+        strcat(ex->text, ".");
+    }
+}
+
+/* Float parameters while training */
+typedef struct float_model {
+    float* embed;                                   // INTENT_BUCKETS x INTENT_DIM
+    float w1[INTENT_HIDDEN][INTENT_DIM];
+    float b1[INTENT_HIDDEN];
+    float w2[INTENT_CLASSES][INTENT_HIDDEN];
+    float b2[INTENT_CLASSES];
+    float e1[ENTITY_HIDDEN][INTENT_WINDOW * INTENT_DIM];
+    float eb1[ENTITY_HIDDEN];
+    float e2[ENTITY_TYPES][ENTITY_HIDDEN];
+    float eb2[ENTITY_TYPES];
+} float_model_t;
+
+static void xavier(uint64_t* rng, float* w, uint32_t rows, uint32_t cols) {
+    float range = sqrtf(6.0f / (float)(rows + cols));
+    for (uint32_t i = 0; i < rows * cols; i++) {
+        w[i] = uniform(rng, range);
+    }
+}
+
+static void softmax(float* x, uint32_t n) {
+    float max = x[0];
+    for (uint32_t i = 1; i < n; i++) {
+        if (x[i] > max) max = x[i];
+    }
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] = expf(x[i] - max);
+        sum += x[i];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        x[i] /= sum;
+    }
+}
+
+/* One SGD step on one example, cross-entropy on the intent and on every token tag */
+static void train_step(float_model_t* m, const train_example_t* ex, float lr) {
+    intent_token_t tokens[INTENT_MAX_TOKENS];
+    uint32_t n = intent_tokenize(ex->text, tokens, INTENT_MAX_TOKENS);
+    if (n == 0 || n != ex->tokens) {
+        return;
+    }
+
+    static float emb[INTENT_MAX_TOKENS][INTENT_DIM];
+    static float grad[INTENT_MAX_TOKENS][INTENT_DIM];
+    float pooled[INTENT_DIM] = { 0 };
+    memset(grad, 0, sizeof(grad));
+    for (uint32_t t = 0; t < n; t++) {
+        for (uint32_t d = 0; d < INTENT_DIM; d++) {
+            float v = 0.0f;
+            for (uint32_t f = 0; f < INTENT_FEATURES; f++) {
+                v += m->embed[(size_t)tokens[t].features[f] * INTENT_DIM + d];
+            }
+            emb[t][d] = v;
+            pooled[d] += v / (float)n;
+        }
+    }
+
+    /* Intent head */
+    float a1[INTENT_HIDDEN], h1[INTENT_HIDDEN], p[INTENT_CLASSES];
+    for (uint32_t h = 0; h < INTENT_HIDDEN; h++) {
+        float v = m->b1[h];
+        for (uint32_t d = 0; d < INTENT_DIM; d++) v += m->w1[h][d] * pooled[d];
+        a1[h] = v;
+        h1[h] = v > 0.0f ? v : 0.0f;
+    }
+    for (uint32_t c = 0; c < INTENT_CLASSES; c++) {
+        float v = m->b2[c];
+        for (uint32_t h = 0; h < INTENT_HIDDEN; h++) v += m->w2[c][h] * h1[h];
+        p[c] = v;
+    }
+    softmax(p, INTENT_CLASSES);
+    p[ex->intent] -= 1.0f;
+
+    float da1[INTENT_HIDDEN];
+    for (uint32_t h = 0; h < INTENT_HIDDEN; h++) {
+        float g = 0.0f;
+        for (uint32_t c = 0; c < INTENT_CLASSES; c++) g += p[c] * m->w2[c][h];
+        da1[h] = a1[h] > 0.0f ? g : 0.0f;
+    }
+    for (uint32_t c = 0; c < INTENT_CLASSES; c++) {
+        for (uint32_t h = 0; h < INTENT_HIDDEN; h++) m->w2[c][h] -= lr * p[c] * h1[h];
+        m->b2[c] -= lr * p[c];
+    }
+    for (uint32_t d = 0; d < INTENT_DIM; d++) {
+        float g = 0.0f;
+        for (uint32_t h = 0; h < INTENT_HIDDEN; h++) g += da1[h] * m->w1[h][d];
+        for (uint32_t t = 0; t < n; t++) grad[t][d] += g / (float)n;
+    }
+    for (uint32_t h = 0; h < INTENT_HIDDEN; h++) {
+        for (uint32_t d = 0; d < INTENT_DIM; d++) m->w1[h][d] -= lr * da1[h] * pooled[d];
+        m->b1[h] -= lr * da1[h];
+    }
+
+    /* Entity head, one window per token */
+    const uint32_t window = INTENT_WINDOW * INTENT_DIM;
+    for (uint32_t t = 0; t < n; t++) {
+        float z[INTENT_WINDOW * INTENT_DIM];
+        for (uint32_t w = 0; w < INTENT_WINDOW; w++) {
+            int32_t src = (int32_t)t + (int32_t)w - INTENT_WINDOW / 2;
+            for (uint32_t d = 0; d < INTENT_DIM; d++) {
+                z[w * INTENT_DIM + d] = (src < 0 || src >= (int32_t)n) ? 0.0f : emb[src][d];
+            }
+        }
+        float a3[ENTITY_HIDDEN], h3[ENTITY_HIDDEN], q[ENTITY_TYPES];
+        for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) {
+            float v = m->eb1[h];
+            for (uint32_t i = 0; i < window; i++) v += m->e1[h][i] * z[i];
+            a3[h] = v;
+            h3[h] = v > 0.0f ? v : 0.0f;
+        }
+        for (uint32_t k = 0; k < ENTITY_TYPES; k++) {
+            float v = m->eb2[k];
+            for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) v += m->e2[k][h] * h3[h];
+            q[k] = v;
+        }
+        softmax(q, ENTITY_TYPES);
+        q[ex->tags[t]] -= 1.0f;
+
+        float da3[ENTITY_HIDDEN];
+        for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) {
+            float g = 0.0f;
+            for (uint32_t k = 0; k < ENTITY_TYPES; k++) g += q[k] * m->e2[k][h];
+            da3[h] = a3[h] > 0.0f ? g : 0.0f;
+        }
+        for (uint32_t k = 0; k < ENTITY_TYPES; k++) {
+            for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) m->e2[k][h] -= lr * q[k] * h3[h];
+            m->eb2[k] -= lr * q[k];
+        }
+        for (uint32_t i = 0; i < window; i++) {
+            float g = 0.0f;
+            for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) g += da3[h] * m->e1[h][i];
+            int32_t src = (int32_t)t + (int32_t)(i / INTENT_DIM) - INTENT_WINDOW / 2;
+            if (src >= 0 && src < (int32_t)n) {
+                grad[src][i % INTENT_DIM] += g;
+            }
+        }
+        for (uint32_t h = 0; h < ENTITY_HIDDEN; h++) {
+            for (uint32_t i = 0; i < window; i++) m->e1[h][i] -= lr * da3[h] * z[i];
+            m->eb1[h] -= lr * da3[h];
+        }
+    }
+
+    for (uint32_t t = 0; t < n; t++) {
+        for (uint32_t f = 0; f < INTENT_FEATURES; f++) {
+            float* row = m->embed + (size_t)tokens[t].features[f] * INTENT_DIM;
+            for (uint32_t d = 0; d < INTENT_DIM; d++) row[d] -= lr * grad[t][d];
+        }
+    }
+}
+
+/* Train on the synthetic corpus and write a quantized weight file */
+status_t intent_model_train(const char* path, const intent_train_config_t* config) {
+    if (!path || !config || config->examples == 0 ||
+        (config->dense_type != INFER_S8 && config->dense_type != INFER_S4)) {
+        return STATUS_INVALID;
+    }
+
+    float_model_t* m = calloc(1, sizeof(float_model_t));
+    train_example_t* corpus = calloc(config->examples, sizeof(train_example_t));
+    if (m) {
+        m->embed = calloc((size_t)INTENT_BUCKETS * INTENT_DIM, sizeof(float));
+    }
+    if (!m || !m->embed || !corpus) {
+        if (m) free(m->embed);
+        free(m);
+        free(corpus);
+        return STATUS_NOMEM;
+    }
+
+    uint64_t rng = config->seed ? config->seed : 0x9e3779b97f4a7c15ULL;
+    for (uint32_t i = 0; i < (uint32_t)INTENT_BUCKETS * INTENT_DIM; i++) {
+        m->embed[i] = uniform(&rng, 0.1f);
+    }
+    xavier(&rng, &m->w1[0][0], INTENT_HIDDEN, INTENT_DIM);
+    xavier(&rng, &m->w2[0][0], INTENT_CLASSES, INTENT_HIDDEN);
+    xavier(&rng, &m->e1[0][0], ENTITY_HIDDEN, INTENT_WINDOW * INTENT_DIM);
+    xavier(&rng, &m->e2[0][0], ENTITY_TYPES, ENTITY_HIDDEN);
+    for (uint32_t i = 0; i < config->examples; i++) {
+        generate(&rng, false, &corpus[i]);
+    }
+
+    uint32_t epochs = config->epochs ? config->epochs : 6;
+    for (uint32_t e = 0; e < epochs; e++) {
+        float lr = 0.03f / (1.0f + (float)e);
+        for (uint32_t i = 0; i < config->examples; i++) {
+            /* Visit the corpus in a fresh order every epoch */
+            uint32_t j = i + (uint32_t)(next_random(&rng) % (config->examples - i));
+            train_example_t tmp = corpus[i];
+            corpus[i] = corpus[j];
+            corpus[j] = tmp;
+            train_step(m, &corpus[i], lr);
+        }
+    }
+
+    infer_type_t dense = config->dense_type;
+    infer_tensor_source_t tensors[] = {
+        { "embed", INFER_S8, INTENT_BUCKETS, INTENT_DIM, m->embed },
+        { "intent.w1", dense, INTENT_HIDDEN, INTENT_DIM, &m->w1[0][0] },
+        { "intent.b1", INFER_F32, 1, INTENT_HIDDEN, m->b1 },
+        { "intent.w2", dense, INTENT_CLASSES, INTENT_HIDDEN, &m->w2[0][0] },
+        { "intent.b2", INFER_F32, 1, INTENT_CLASSES, m->b2 },
+        { "entity.w1", dense, ENTITY_HIDDEN, INTENT_WINDOW * INTENT_DIM, &m->e1[0][0] },
+        { "entity.b1", INFER_F32, 1, ENTITY_HIDDEN, m->eb1 },
+        { "entity.w2", dense, ENTITY_TYPES, ENTITY_HIDDEN, &m->e2[0][0] },
+        { "entity.b2", INFER_F32, 1, ENTITY_TYPES, m->eb2 },
+    };
+    status_t status = infer_weights_write(path, tensors, COUNT(tensors));
+
+    free(m->embed);
+    free(m);
+    free(corpus);
+    return status;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Intent accuracy and micro-averaged entity F1 over tagged tokens */
+static void evaluate(intent_model_t* model, infer_arena_t* arena, const train_example_t* test, uint32_t count,
+                     float* accuracy, float* f1) {
+    uint32_t correct = 0;
+    uint64_t tp = 0, fp = 0, fn = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        intent_prediction_t pred;
+        if (FAILED(intent_model_predict(model, arena, test[i].text, &pred))) {
+            continue;
+        }
+        correct += pred.intent == test[i].intent;
+
+        /* Entities come back in token order; rebuild the per-token tags */
+        intent_token_t tokens[INTENT_MAX_TOKENS];
+        uint32_t n = intent_tokenize(test[i].text, tokens, INTENT_MAX_TOKENS);
+        uint32_t e = 0;
+        for (uint32_t t = 0; t < n && t < test[i].tokens; t++) {
+            uint32_t tag = ENTITY_NONE;
+            if (e < pred.entity_count && strlen(pred.entities[e].text) == tokens[t].length &&
+                strncmp(pred.entities[e].text, test[i].text + tokens[t].start, tokens[t].length) == 0) {
+                tag = pred.entities[e++].type;
+            }
+            uint32_t gold = test[i].tags[t];
+            if (tag != ENTITY_NONE && tag == gold) tp++;
+            if (tag != ENTITY_NONE && tag != gold) fp++;
+            if (gold != ENTITY_NONE && tag != gold) fn++;
+        }
+    }
+    *accuracy = count ? (float)correct / (float)count : 0.0f;
+    *f1 = tp ? 2.0f * (float)tp / (float)(2 * tp + fp + fn) : 0.0f;
+}
+
+/* Train int8 and int4 models, then measure accuracy and latency on every instruction set */
+status_t intent_model_benchmark(const char* dir, uint32_t requests, intent_model_bench_t* out) {
+    if (!dir || !out || requests == 0) {
+        return STATUS_INVALID;
+    }
+    memset(out, 0, sizeof(*out));
+
+    train_example_t* test = calloc(TEST_EXAMPLES, sizeof(train_example_t));
+    uint64_t* latency = calloc(requests, sizeof(uint64_t));
+    infer_arena_t arena = { 0 };
+    if (!test || !latency || FAILED(infer_arena_init(&arena, INTENT_ARENA_SIZE))) {
+        free(test);
+        free(latency);
+        return STATUS_NOMEM;
+    }
+
+    uint64_t rng = 0x5eed5eed5eedULL;
+    uint32_t rules_correct = 0;
+    for (uint32_t i = 0; i < TEST_EXAMPLES; i++) {
+        generate(&rng, true, &test[i]);
+        rules_correct += companion_parse_intent(test[i].text) == test[i].intent;
+    }
+    out->test_examples = TEST_EXAMPLES;
+    out->rules_accuracy = (float)rules_correct / TEST_EXAMPLES;
+
+    status_t status = STATUS_OK;
+    infer_isa_t best = infer_isa_detect();
+    static const infer_type_t types[2] = { INFER_S8, INFER_S4 };
+    for (int v = 0; v < 2 && SUCCESS(status); v++) {
+        char path[4096];
+        if ((size_t)snprintf(path, sizeof(path), "%s/intent-%s.lwm", dir, v ? "s4" : "s8") >= sizeof(path)) {
+            status = STATUS_INVALID;
+            break;
+        }
+
+        intent_train_config_t config = { .examples = 20000, .epochs = 6, .seed = 1, .dense_type = types[v] };
+        uint64_t start = now_ns();
+        status = intent_model_train(path, &config);
+        if (FAILED(status)) {
+            break;
+        }
+        if (v == 0) {
+            out->train_ns = now_ns() - start;
+            out->train_examples = config.examples;
+        }
+
+        intent_model_t* model = NULL;
+        status = intent_model_load(path, &model);
+        if (FAILED(status)) {
+            break;
+        }
+        out->file_size[v] = 0;
+        FILE* f = fopen(path, "rb");
+        if (f) {
+            fseek(f, 0, SEEK_END);
+            out->file_size[v] = (uint64_t)ftell(f);
+            fclose(f);
+        }
+        infer_isa_select(best);
+        evaluate(model, &arena, test, TEST_EXAMPLES, &out->intent_accuracy[v], &out->entity_f1[v]);
+
+        for (int isa = INFER_ISA_SCALAR; isa < INFER_ISA_COUNT; isa++) {
+            if (infer_isa_select((infer_isa_t)isa) != (infer_isa_t)isa) {
+                continue;
+            }
+            intent_bench_run_t* run = &out->runs[out->run_count++];
+            run->type = types[v];
+            run->isa = (infer_isa_t)isa;
+            run->requests = requests;
+            for (uint32_t r = 0; r < requests; r++) {
+                intent_prediction_t pred;
+                uint64_t t0 = now_ns();
+                intent_model_predict(model, &arena, test[r % TEST_EXAMPLES].text, &pred);
+                latency[r] = now_ns() - t0;
+                run->total_ns += latency[r];
+                run->tokens += pred.tokens;
+            }
+            qsort(latency, requests, sizeof(uint64_t), compare_u64);
+            run->p50_ns = latency[requests / 2];
+            run->p99_ns = latency[(uint64_t)requests * 99 / 100];
+        }
+        infer_isa_select(best);
+        intent_model_free(model);
+    }
+
+    out->arena_peak = arena.peak;
+    infer_arena_destroy(&arena);
+    free(test);
+    free(latency);
+    return status;
+}
@@ -5,7 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "companion.h"
+#include "intent_model.h"
 
 void print_banner(void) {
     printf("\n");
@@ -102,7 +104,84 @@ void handle_user_decision(companion_context_t* ctx, action_card_t* card) {
     }
 }
 
+/* Compare the keyword automaton with per-keyword scans */
+static int run_match_bench(uint32_t iterations) {
+    companion_match_bench_t r;
+    if (FAILED(companion_benchmark_match(iterations, &r))) {
+        fprintf(stderr, "ERROR: Matcher benchmark failed\n");
+        return 1;
+    }
+
+    double mb = (double)r.bytes / 1e6;
+    printf("Inputs:    %u x %llu iterations, %.1f MB\n", r.inputs, (unsigned long long)r.iterations, mb);
+    printf("Keywords:  %u patterns, %u states\n", r.keywords, r.keyword_states);
+    printf("  strstr:    %8.1f ms  %7.1f MB/s\n", (double)r.keyword_legacy_ns / 1e6,
+           r.keyword_legacy_ns ? mb / ((double)r.keyword_legacy_ns / 1e9) : 0.0);
+    printf("  automaton: %8.1f ms  %7.1f MB/s\n", (double)r.keyword_automaton_ns / 1e6,
+           r.keyword_automaton_ns ? mb / ((double)r.keyword_automaton_ns / 1e9) : 0.0);
+    printf("Rules:     %u patterns, %u states\n", r.rules, r.rule_states);
+    printf("  strstr:    %8.1f ms  %7.1f MB/s\n", (double)r.rule_legacy_ns / 1e6,
+           r.rule_legacy_ns ? mb / ((double)r.rule_legacy_ns / 1e9) : 0.0);
+    printf("  automaton: %8.1f ms  %7.1f MB/s\n", (double)r.rule_automaton_ns / 1e6,
+           r.rule_automaton_ns ? mb / ((double)r.rule_automaton_ns / 1e9) : 0.0);
+    printf("Result:    %s\n", r.identical ? "both methods agree on every input" : "MISMATCH");
+    return r.identical ? 0 : 1;
+}
+
+/* Train the intent model and write its weight file */
+static int run_train_model(const char* path, bool int4) {
+    intent_train_config_t config = {
+        .examples = 20000,
+        .epochs = 6,
+        .seed = 1,
+        .dense_type = int4 ? INFER_S4 : INFER_S8,
+    };
+    if (FAILED(intent_model_train(path, &config))) {
+        fprintf(stderr, "ERROR: Cannot train the intent model into %s\n", path);
+        return 1;
+    }
+    printf("Wrote %s (%s weights)\n", path, int4 ? "int4" : "int8");
+    return 0;
+}
+
+/* Accuracy, throughput and latency of the intent model */
+static int run_model_bench(const char* dir, uint32_t requests) {
+    intent_model_bench_t r;
+    if (FAILED(intent_model_benchmark(dir, requests, &r))) {
+        fprintf(stderr, "ERROR: Model benchmark failed\n");
+        return 1;
+    }
+
+    printf("Training:  %u synthetic requests in %.2f s\n", r.train_examples, (double)r.train_ns / 1e9);
+    printf("Test set:  %u requests with held-out slot values\n", r.test_examples);
+    printf("Accuracy:  keyword rules %.1f%% intent\n", r.rules_accuracy * 100.0f);
+    for (int v = 0; v < 2; v++) {
+        printf("           %s model %.1f%% intent, entity F1 %.3f, %.0f KB weights\n", v ? "int4" : "int8",
+               r.intent_accuracy[v] * 100.0f, r.entity_f1[v], (double)r.file_size[v] / 1024.0);
+    }
+    printf("Arena:     %zu bytes peak\n", r.arena_peak);
+    for (uint32_t i = 0; i < r.run_count; i++) {
+        const intent_bench_run_t* run = &r.runs[i];
+        double secs = (double)run->total_ns / 1e9;
+        printf("%s %-12s %9.0f tokens/s  p50 %6.1f us  p99 %6.1f us\n",
+               run->type == INFER_S4 ? "int4" : "int8", infer_isa_name(run->isa),
+               secs > 0 ? (double)run->tokens / secs : 0.0,
+               (double)run->p50_ns / 1e3, (double)run->p99_ns / 1e3);
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-match") == 0) {
+        return run_match_bench(argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : 100000);
+    }
+    if (argc > 2 && strcmp(argv[1], "--train-model") == 0) {
+        return run_train_model(argv[2], argc > 3 && strcmp(argv[3], "--int4") == 0);
+    }
+    if (argc > 3 && strcmp(argv[1], "--bench-model") == 0) {
+        return run_model_bench(argv[2], (uint32_t)strtoul(argv[3], NULL, 10));
+    }
+
     print_banner();
 
     /* Initialize companion */
@@ -74,6 +74,7 @@
 #define DARWIN_SYS_ftruncate    201
 #define DARWIN_SYS_mmap         197
 #define DARWIN_SYS___sysctl     202
+#define DARWIN_SYS_posix_spawn  244
 #define DARWIN_SYS_getdtablesize 89
 
 /* Mach syscalls (Mach traps) */
@@ -151,9 +152,87 @@ typedef uint32_t mach_port_t;
 typedef uint32_t mach_port_name_t;
 typedef int kern_return_t;
 
+typedef kern_return_t mach_msg_return_t;
+typedef uint32_t mach_port_right_t;
+typedef uint32_t mach_port_type_t;
+
 #define MACH_PORT_NULL          0
+#define MACH_PORT_DEAD          0xFFFFFFFFu
+#define MACH_PORT_VALID(name)   ((name) != MACH_PORT_NULL && (name) != MACH_PORT_DEAD)
+
 #define KERN_SUCCESS            0
+#define KERN_INVALID_ADDRESS    1
+#define KERN_NO_SPACE           3
+#define KERN_INVALID_ARGUMENT   4
 #define KERN_FAILURE            5
+#define KERN_RESOURCE_SHORTAGE  6
+#define KERN_NOT_IN_SET         12
+#define KERN_INVALID_NAME       15
+#define KERN_INVALID_TASK       16
+#define KERN_INVALID_RIGHT      17
+#define KERN_INVALID_VALUE      18
+#define KERN_UREFS_OVERFLOW     19
+
+/* Port rights, and the type bits a name carries for each */
+#define MACH_PORT_RIGHT_SEND        0
+#define MACH_PORT_RIGHT_RECEIVE     1
+#define MACH_PORT_RIGHT_SEND_ONCE   2
+#define MACH_PORT_RIGHT_PORT_SET    3
+#define MACH_PORT_RIGHT_DEAD_NAME   4
+
+#define MACH_PORT_TYPE(right)       (1u << ((right) + 16))
+#define MACH_PORT_TYPE_SEND         MACH_PORT_TYPE(MACH_PORT_RIGHT_SEND)
+#define MACH_PORT_TYPE_RECEIVE      MACH_PORT_TYPE(MACH_PORT_RIGHT_RECEIVE)
+#define MACH_PORT_TYPE_SEND_ONCE    MACH_PORT_TYPE(MACH_PORT_RIGHT_SEND_ONCE)
+#define MACH_PORT_TYPE_PORT_SET     MACH_PORT_TYPE(MACH_PORT_RIGHT_PORT_SET)
+#define MACH_PORT_TYPE_DEAD_NAME    MACH_PORT_TYPE(MACH_PORT_RIGHT_DEAD_NAME)
+
+#define MACH_PORT_QLIMIT_DEFAULT    5
+
+/* Right dispositions on send; received rights arrive as the PORT_* types */
+#define MACH_MSG_TYPE_MOVE_RECEIVE      16
+#define MACH_MSG_TYPE_MOVE_SEND         17
+#define MACH_MSG_TYPE_MOVE_SEND_ONCE    18
+#define MACH_MSG_TYPE_COPY_SEND         19
+#define MACH_MSG_TYPE_MAKE_SEND         20
+#define MACH_MSG_TYPE_MAKE_SEND_ONCE    21
+#define MACH_MSG_TYPE_PORT_RECEIVE      MACH_MSG_TYPE_MOVE_RECEIVE
+#define MACH_MSG_TYPE_PORT_SEND         MACH_MSG_TYPE_MOVE_SEND
+#define MACH_MSG_TYPE_PORT_SEND_ONCE    MACH_MSG_TYPE_MOVE_SEND_ONCE
+
+#define MACH_MSGH_BITS(remote, local)   ((remote) | ((local) << 8))
+#define MACH_MSGH_BITS_REMOTE(bits)     ((bits) & 0x1f)
+#define MACH_MSGH_BITS_LOCAL(bits)      (((bits) >> 8) & 0x1f)
+#define MACH_MSGH_BITS_COMPLEX          0x80000000u
+
+/* mach_msg options */
+#define MACH_SEND_MSG           0x00000001
+#define MACH_RCV_MSG            0x00000002
+#define MACH_RCV_LARGE          0x00000004
+#define MACH_SEND_TIMEOUT       0x00000010
+#define MACH_RCV_TIMEOUT        0x00000100
+#define MACH_MSG_TIMEOUT_NONE   0
+
+/* mach_msg returns */
+#define MACH_MSG_SUCCESS            0x00000000
+#define MACH_SEND_INVALID_DATA      0x10000002
+#define MACH_SEND_INVALID_DEST      0x10000003
+#define MACH_SEND_TIMED_OUT         0x10000004
+#define MACH_SEND_INVALID_REPLY     0x10000005
+#define MACH_SEND_INVALID_RIGHT     0x10000007
+#define MACH_SEND_MSG_TOO_SMALL     0x10000008
+#define MACH_SEND_TOO_LARGE         0x1000000a
+#define MACH_SEND_NO_BUFFER         0x1000000d
+#define MACH_SEND_INVALID_TYPE      0x1000000f
+#define MACH_SEND_INVALID_HEADER    0x10000010
+#define MACH_RCV_INVALID_NAME       0x10004002
+#define MACH_RCV_TIMED_OUT          0x10004003
+#define MACH_RCV_TOO_LARGE          0x10004004
+#define MACH_RCV_PORT_CHANGED       0x10004006
+#define MACH_RCV_PORT_DIED          0x10004009
+
+#define MACH_MSG_SIZE_MAX           (64 * 1024)     // Inline bytes per message
+#define MACH_NOTIFY_SEND_ONCE       0107            // Sent through a send-once right destroyed unused
 
 /* Mach message header */
 typedef struct mach_msg_header {
@@ -165,6 +244,41 @@ typedef struct mach_msg_header {
     uint32_t msgh_id;
 } mach_msg_header_t;
 
+/* Complex messages: a descriptor count, then descriptors, then inline data */
+typedef struct mach_msg_body {
+    uint32_t msgh_descriptor_count;
+} mach_msg_body_t;
+
+#define MACH_MSG_PORT_DESCRIPTOR        0
+#define MACH_MSG_OOL_DESCRIPTOR         1
+
+#define MACH_MSG_PHYSICAL_COPY          0
+#define MACH_MSG_VIRTUAL_COPY           1
+
+typedef struct __attribute__((packed, aligned(4))) mach_msg_port_descriptor {
+    mach_port_t name;
+    uint32_t pad1;
+    uint16_t pad2;
+    uint8_t disposition;
+    uint8_t type;
+} mach_msg_port_descriptor_t;
+
+/* Out-of-line memory; deallocate hands the sender's pages over instead of copying them */
+typedef struct __attribute__((packed, aligned(4))) mach_msg_ool_descriptor {
+    void* address;
+    uint8_t deallocate;
+    uint8_t copy;
+    uint8_t pad1;
+    uint8_t type;
+    uint32_t size;
+} mach_msg_ool_descriptor_t;
+
+/* Appended after every received message; rcv_size must leave room for it */
+typedef struct mach_msg_trailer {
+    uint32_t msgh_trailer_type;
+    uint32_t msgh_trailer_size;
+} mach_msg_trailer_t;
+
 /* Mach task/thread info */
 typedef struct {
     uint32_t suspend_count;
@@ -214,6 +328,9 @@ long darwin_read(int fd, void* buf, size_t count);
 long darwin_write(int fd, const void* buf, size_t count);
 long darwin_lseek(int fd, long offset, int whence);
 int darwin_fork(void);
+int darwin_vfork(void);
+int darwin_posix_spawn(int* pid, const char* path, const void* file_actions,
+                       const void* attr, char* const argv[], char* const envp[]);
 int darwin_execve(const char* path, char* const argv[], char* const envp[]);
 void darwin_exit(int status);
 int darwin_wait4(int pid, int* status, int options, void* rusage);
@@ -246,6 +363,47 @@ kern_return_t mach_msg_trap(mach_msg_header_t* msg, uint32_t option, uint32_t se
 kern_return_t task_for_pid(mach_port_t target_tport, int pid, mach_port_t* t);
 kern_return_t pid_for_task(mach_port_t t, int* pid);
 
+/*
+ * Mach IPC (macos_mach.c)
+ * Ports live in a per-task name table; mach_msg with both MACH_SEND_MSG and
+ * MACH_RCV_MSG delivers straight into a blocked receiver and waits for the
+ * reply under one lock hold.
+ */
+int mach_ipc_init(macos_context_t* ctx);
+mach_msg_return_t mach_msg(mach_msg_header_t* msg, uint32_t option, uint32_t send_size,
+                           uint32_t rcv_size, mach_port_t rcv_name, uint32_t timeout, mach_port_t notify);
+kern_return_t mach_port_allocate(mach_port_t task, mach_port_right_t right, mach_port_name_t* out_name);
+kern_return_t mach_port_deallocate(mach_port_t task, mach_port_name_t name);
+kern_return_t mach_port_mod_refs(mach_port_t task, mach_port_name_t name, mach_port_right_t right, int delta);
+kern_return_t mach_port_insert_right(mach_port_t task, mach_port_name_t name, mach_port_t port,
+                                     uint32_t disposition);
+kern_return_t mach_port_move_member(mach_port_t task, mach_port_name_t member, mach_port_name_t after);
+kern_return_t mach_port_type(mach_port_t task, mach_port_name_t name, mach_port_type_t* out_type);
+kern_return_t vm_deallocate(mach_port_t task, uintptr_t address, size_t size);
+
+typedef struct mach_ipc_stats {
+    uint64_t traps;
+    uint64_t ports_allocated;
+    uint64_t messages_sent;
+    uint64_t messages_received;
+    uint64_t handoffs;          // Copied straight into a blocked receiver's buffer
+    uint64_t ool_pages_moved;   // Out-of-line pages transferred by remapping
+    uint64_t ool_bytes_copied;
+} mach_ipc_stats_t;
+
+void mach_ipc_get_stats(mach_ipc_stats_t* out_stats);
+
+/* MIG-style request/reply between a client and a server thread receiving on a port set */
+typedef struct mach_ipc_bench_result {
+    uint64_t rpc_ns;            // Simple request and reply
+    uint64_t rpc_ool_move_ns;   // ool_bytes out-of-line each way, pages moved
+    uint64_t rpc_ool_copy_ns;   // ool_bytes out-of-line each way, copied
+    uint64_t pipe_rpc_ns;       // The simple exchange over a pair of pipes, for comparison
+    uint64_t handoffs;          // Replies and requests that skipped the queue
+} mach_ipc_bench_result_t;
+
+int mach_ipc_benchmark(uint32_t iterations, uint32_t ool_bytes, mach_ipc_bench_result_t* out_result);
+
 /* sysctl */
 int darwin_sysctl(int* name, uint32_t namelen, void* oldp, size_t* oldlenp,
                   void* newp, size_t newlen);
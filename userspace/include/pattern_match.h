@@ -0,0 +1,49 @@
+/*
+ * Multi-Pattern Matcher
+ * Case-insensitive Aho-Corasick automaton over keyword and rule tables
+ */
+
+#ifndef PATTERN_MATCH_H
+#define PATTERN_MATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PATTERN_MAX_LENGTH 255
+
+/* Opaque compiled pattern set */
+typedef struct pattern_set pattern_set_t;
+
+/* One occurrence of a pattern in the scanned text */
+typedef struct pattern_match {
+    uint32_t table;          /* Caller's table (intent, impact, rule, ...) */
+    uint32_t value;          /* Caller's value for the pattern */
+    int32_t priority;        /* Lower wins when tables are resolved */
+    uint32_t end;            /* Offset one past the last matched byte */
+} pattern_match_t;
+
+/* Called for every match in text order; return false to stop the scan */
+typedef bool (*pattern_match_fn)(const pattern_match_t* match, void* arg);
+
+/* Create and destroy a pattern set */
+pattern_set_t* pattern_set_create(void);
+void pattern_set_destroy(pattern_set_t* set);
+
+/*
+ * Add a pattern. Insertion extends the trie in place; the transition table
+ * is relinked once, on the next scan or compile, however many were added.
+ */
+int pattern_set_add(pattern_set_t* set, const char* pattern, uint32_t table, uint32_t value, int32_t priority);
+
+/* Relink failure links and the transition table now instead of lazily */
+int pattern_set_compile(pattern_set_t* set);
+
+/* Scan a NUL-terminated string in one pass; returns the number of matches reported */
+size_t pattern_set_scan(pattern_set_t* set, const char* text, pattern_match_fn fn, void* arg);
+
+/* Size of the set */
+uint32_t pattern_set_count(const pattern_set_t* set);
+uint32_t pattern_set_states(const pattern_set_t* set);
+
+#endif /* PATTERN_MATCH_H */
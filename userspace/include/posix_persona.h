@@ -43,6 +43,44 @@ int posix_execve(const char *path, char *const argv[], char *const envp[]);
 pid_t posix_waitpid(pid_t pid, int *status, int options);
 void posix_exit(int status);
 
+/* vfork: the child borrows the caller's memory until it execs or exits */
+pid_t posix_vfork(void);
+
+/* posix_spawn: fork+exec in one call, without copying the caller's memory */
+#define POSIX_SPAWN_RESETIDS     0x0001
+#define POSIX_SPAWN_SETPGROUP    0x0002
+#define POSIX_SPAWN_MAX_ACTIONS  16
+
+typedef struct {
+    int count;
+    struct {
+        int type;              // Open, close, dup2 or chdir
+        int fd;
+        int newfd;
+        int oflag;
+        mode_t mode;
+        const char *path;
+    } actions[POSIX_SPAWN_MAX_ACTIONS];
+} posix_spawn_file_actions_t;
+
+typedef struct {
+    short flags;
+    pid_t pgroup;
+} posix_spawnattr_t;
+
+int posix_spawn(pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp, char *const argv[], char *const envp[]);
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *file_actions);
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *file_actions);
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *file_actions, int fd,
+                                     const char *path, int oflag, mode_t mode);
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *file_actions, int fd);
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *file_actions, int fd, int newfd);
+int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t *file_actions, const char *path);
+int posix_spawnattr_init(posix_spawnattr_t *attr);
+int posix_spawnattr_setflags(posix_spawnattr_t *attr, short flags);
+int posix_spawnattr_setpgroup(posix_spawnattr_t *attr, pid_t pgroup);
+
 int posix_mkdir(const char *path, mode_t mode);
 int posix_rmdir(const char *path);
 int posix_unlink(const char *path);
@@ -31,6 +31,9 @@ typedef struct server_config {
     uint16_t management_port;    /* Remote management port */
     char hostname[256];          /* Server hostname */
     char cluster_name[128];      /* Cluster name */
+    char audit_log_dir[256];     /* Audit segment directory (empty: default) */
+    uint16_t cluster_port;       /* Gossip UDP port (0: default) */
+    uint16_t health_port;        /* Health HTTP endpoint port (0: disabled) */
 } server_config_t;
 
 /* Remote management protocols */
@@ -87,6 +90,17 @@ typedef struct service_health {
     char status_message[256];
 } service_health_t;
 
+/* Health check latency histogram (bucket i counts checks of [2^i, 2^(i+1)) us) */
+#define HEALTH_LATENCY_BUCKETS 32
+
+typedef struct health_latency {
+    uint64_t buckets[HEALTH_LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t timeouts;
+    uint64_t total_us;
+    uint64_t max_us;
+} health_latency_t;
+
 /* Cluster node info */
 typedef struct cluster_node {
     char node_id[64];
@@ -98,6 +112,21 @@ typedef struct cluster_node {
     service_health_t health;
 } cluster_node_t;
 
+/* Cluster membership counters */
+typedef struct cluster_stats {
+    uint32_t members_alive;      /* Excluding this node */
+    uint32_t members_suspect;
+    uint32_t members_dead;
+    uint64_t probes;
+    uint64_t indirect_probes;
+    uint64_t packets_sent;
+    uint64_t packets_received;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t join_time_us;       /* CLOCK_MONOTONIC, as are the times below */
+    uint64_t last_change_us;     /* Last membership change (convergence) */
+} cluster_stats_t;
+
 /* Resource limits (for containers/isolation) */
 typedef struct resource_limits {
     uint64_t max_memory_bytes;
@@ -157,13 +186,32 @@ int server_authenticate_enterprise(const char* username, const char* password, c
 int server_cache_credentials(const char* username, const char* credential_hash);
 int server_validate_cached_credentials(const char* username, const char* credential_hash);
 
-/* Health monitoring */
+/* Health monitoring
+ *
+ * Registered checks run in a worker pool on their own intervals with a
+ * per-check timeout. server_get_all_health returns the cached results
+ * without running anything.
+ */
+int server_health_start(uint16_t http_port);
+void server_health_stop(void);
 int server_check_health(service_health_t* health);
 int server_register_health_check(const char* service_name,
                                   int (*check_fn)(service_health_t* health));
+int server_register_health_check_ex(const char* service_name,
+                                     int (*check_fn)(service_health_t* health),
+                                     uint32_t interval_ms, uint32_t timeout_ms);
 int server_get_all_health(service_health_t* services, uint32_t* count, uint32_t max);
+int server_get_health_latency(const char* service_name, health_latency_t* latency);
 
-/* Clustering */
+/* Clustering
+ *
+ * Membership is SWIM-style gossip over UDP; leader_ip names any existing
+ * member ("ip[:port]") to join through. Leadership is a renewable lease held
+ * by the lowest-id live member.
+ */
+int server_cluster_start(const char* cluster_name, const char* seed, uint16_t port);
+void server_cluster_stop(void);
+int server_get_cluster_stats(cluster_stats_t* stats);
 int server_join_cluster(const char* cluster_name, const char* leader_ip);
 int server_leave_cluster(void);
 int server_get_cluster_nodes(cluster_node_t* nodes, uint32_t* count, uint32_t max);
@@ -175,7 +223,17 @@ int server_set_resource_limits(const resource_limits_t* limits);
 int server_get_resource_usage(resource_limits_t* usage);
 int server_enforce_limits(void);
 
-/* Audit logging */
+/* Audit logging
+ *
+ * server_audit_log only claims a slot in a lock-free queue; a writer thread
+ * appends the events to rotating segment files and fsyncs them per batch.
+ * On a full queue the caller waits briefly, then the event is dropped; drops
+ * are counted and logged as an AUDIT_SECURITY_ALERT record.
+ */
+int server_audit_init(const char* directory);
+void server_audit_shutdown(void);
+int server_audit_flush(void);
+uint64_t server_audit_dropped(void);
 int server_audit_log(audit_event_type_t type, const char* user, const char* action,
                      const char* resource, bool success, const char* details);
 int server_get_audit_log(audit_entry_t* entries, uint32_t* count, uint32_t max,
@@ -20,6 +20,7 @@ typedef void* HKEY;
 typedef unsigned long DWORD;
 typedef unsigned short WORD;
 typedef unsigned char BYTE;
+typedef BYTE* LPBYTE;
 typedef long LONG;
 typedef int BOOL;
 typedef char* LPSTR;
@@ -71,8 +72,23 @@ typedef size_t SIZE_T;
 /* Memory allocation types */
 #define MEM_COMMIT    0x00001000
 #define MEM_RESERVE   0x00002000
+#define MEM_DECOMMIT  0x00004000
 #define MEM_RELEASE   0x00008000
 
+/* Reservations start on this boundary, as on Windows */
+#define WIN32_ALLOCATION_GRANULARITY 0x10000
+
+/* Heap flags */
+#define HEAP_NO_SERIALIZE             0x00000001
+#define HEAP_GENERATE_EXCEPTIONS      0x00000004
+#define HEAP_ZERO_MEMORY              0x00000008
+#define HEAP_REALLOC_IN_PLACE_ONLY    0x00000010
+#define HEAP_CREATE_ENABLE_EXECUTE    0x00040000
+
+/* HeapSetInformation classes */
+#define HeapCompatibilityInformation  0
+#define HEAP_LFH                      2
+
 /* Memory protection */
 #define PAGE_NOACCESS          0x01
 #define PAGE_READONLY          0x02
@@ -89,6 +105,11 @@ typedef size_t SIZE_T;
 #define ERROR_NOT_ENOUGH_MEMORY 8
 #define ERROR_INVALID_PARAMETER 87
 #define ERROR_CALL_NOT_IMPLEMENTED 120
+#define ERROR_MOD_NOT_FOUND     126
+#define ERROR_PROC_NOT_FOUND    127
+#define ERROR_BAD_EXE_FORMAT    193
+#define ERROR_DLL_INIT_FAILED   1114
+#define ERROR_INVALID_ADDRESS   487
 
 /* Process creation flags */
 #define CREATE_NEW_CONSOLE        0x00000010
@@ -117,6 +138,9 @@ typedef struct {
     DWORD dwThreadId;
 } PROCESS_INFORMATION;
 
+/* STARTUPINFO flags */
+#define STARTF_USESTDHANDLES    0x00000100
+
 /* STARTUPINFO */
 typedef struct {
     DWORD cb;
@@ -153,6 +177,16 @@ typedef struct {
     HANDLE hEvent;
 } OVERLAPPED;
 
+/*
+ * Handles are slots in a table that grows a chunk at a time and never
+ * moves, so lookups need no lock. A HANDLE carries its slot index and
+ * the slot's generation, which CloseHandle bumps: a stale or forged
+ * handle fails the lookup instead of reaching whatever reuses the slot.
+ * Values stay multiples of 4, as on Windows.
+ */
+#define WIN32_HANDLE_CHUNK      256
+#define WIN32_HANDLE_MAX_CHUNKS 1024    /* 262144 open handles */
+
 /* Win32 Persona Context */
 typedef struct win32_context {
     /* Process information */
@@ -160,9 +194,10 @@ typedef struct win32_context {
     uint32_t thread_id;
 
     /* Handles */
-    void** handle_table;
-    uint32_t max_handles;
-    uint32_t next_handle;
+    void* handle_chunks[WIN32_HANDLE_MAX_CHUNKS];
+    uint32_t handle_capacity;   // Slots in allocated chunks
+    uint32_t handles_open;
+    uint32_t free_handle;       // Free list head, slot index + 1 (0 = empty)
 
     /* Environment */
     char** environment;
@@ -209,12 +244,36 @@ LPVOID VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType,
 
 BOOL VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
 
+BOOL VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, DWORD* lpflOldProtect);
+
+/*
+ * Heaps hand out small blocks (up to 16 KiB) from 64 KiB slabs, one size
+ * class per slab, with classes spaced at most 1/8 apart like the Windows
+ * low-fragmentation heap. The process heap gives each thread a cache of
+ * free blocks per class, so most HeapAlloc/HeapFree calls take no lock.
+ * Private heaps from HeapCreate skip the lock entirely with
+ * HEAP_NO_SERIALIZE, and HeapDestroy unmaps all their memory at once.
+ * Larger blocks get their own mapping.
+ */
 HANDLE GetProcessHeap(void);
 
+HANDLE HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize);
+
+BOOL HeapDestroy(HANDLE hHeap);
+
 LPVOID HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes);
 
+LPVOID HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes);
+
 BOOL HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
 
+/* Usable size of a block, which may exceed what was asked for */
+SIZE_T HeapSize(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem);
+
+/* Every heap already uses low-fragmentation buckets; HEAP_LFH is accepted */
+BOOL HeapSetInformation(HANDLE hHeap, int HeapInformationClass, LPVOID HeapInformation,
+                        SIZE_T HeapInformationLength);
+
 /* Process Management */
 BOOL CreateProcessA(LPCSTR lpApplicationName, LPSTR lpCommandLine,
                     SECURITY_ATTRIBUTES* lpProcessAttributes,
@@ -266,7 +325,17 @@ void GetSystemTime(void* lpSystemTime);
 DWORD GetTickCount(void);
 void Sleep(DWORD dwMilliseconds);
 
-/* Module/DLL Management */
+/* Module/DLL Management
+ *
+ * A DLL's file is opened and indexed once and shared by every module
+ * mapped from it: page-aligned sections map straight from the file, so
+ * read-only pages are shared and writable ones copied on write. Imports
+ * are bound in one pass at load time; GetProcAddress hashes the name.
+ * HMODULE is the image base.
+ */
+#define DLL_PROCESS_DETACH 0
+#define DLL_PROCESS_ATTACH 1
+
 HMODULE LoadLibraryA(LPCSTR lpLibFileName);
 BOOL FreeLibrary(HMODULE hLibModule);
 void* GetProcAddress(HMODULE hModule, LPCSTR lpProcName);
@@ -295,4 +364,63 @@ typedef struct win32_stats {
 
 int win32_get_stats(win32_stats_t* out_stats);
 
+/* Heap engine (win32_heap.c) */
+typedef struct win32_heap_stats {
+    uint64_t allocations;
+    uint64_t heaps;             // Heaps created, process heap included
+    uint64_t committed;         // Bytes in slabs and large blocks, all heaps
+    uint64_t reserved;          // Bytes reserved through VirtualAlloc
+    uint64_t virtual_calls;     // VirtualAlloc/VirtualFree/VirtualProtect
+} win32_heap_stats_t;
+
+void win32_heap_get_stats(win32_heap_stats_t* out_stats);
+
+/* malloc-bench style: random sizes over a per-thread working set, against libc */
+typedef struct win32_heap_bench_result {
+    uint64_t heap_ns;           // Process heap, one thread, per alloc+free
+    uint64_t libc_ns;
+    uint64_t heap_mt_ns;        // All threads at once, wall time per operation pair
+    uint64_t libc_mt_ns;
+    uint64_t private_ns;        // HEAP_NO_SERIALIZE private heap, one thread
+    uint64_t destroy_ns;        // HeapDestroy with the working set still allocated
+} win32_heap_bench_result_t;
+
+int win32_heap_benchmark(uint32_t threads, uint32_t iterations, win32_heap_bench_result_t* out_result);
+
+/* Module loader (win32_loader.c) */
+typedef struct win32_loader_stats {
+    uint64_t modules_loaded;
+    uint64_t images_opened;     // Files parsed and indexed
+    uint64_t images_shared;     // Loads served from an already indexed image
+    uint64_t imports_bound;
+    uint64_t relocations;       // Fixups applied to images not at their preferred base
+} win32_loader_stats_t;
+
+void win32_loader_get_stats(win32_loader_stats_t* out_stats);
+
+/* Writes an EXE importing from dll_count generated DLLs into dir and times loading it */
+typedef struct win32_loader_bench_result {
+    uint64_t cold_start_ns;     // First load, nothing indexed yet
+    uint64_t warm_start_ns;     // Later loads sharing the indexed images
+    uint64_t unload_ns;
+    uint64_t imports_per_start;
+    uint64_t proc_hash_ns;      // GetProcAddress by name
+    uint64_t proc_bsearch_ns;   // Binary search over the export name table, for comparison
+} win32_loader_bench_result_t;
+
+int win32_loader_benchmark(const char* dir, uint32_t dll_count, uint32_t iterations,
+                           win32_loader_bench_result_t* out_result);
+
+/* Handle table churn: open_handles stay open while others are closed and reopened */
+typedef struct win32_handle_bench_result {
+    uint64_t alloc_free_ns;     // Table-only allocate + close pair
+    uint64_t lookup_ns;         // Handle to object
+    uint64_t create_close_ns;   // CreateFileA + CloseHandle pair (0 without a path)
+    uint64_t stale_rejected;    // Closed handles refused after their slot was reused
+    uint32_t capacity;          // Slots allocated at the end
+} win32_handle_bench_result_t;
+
+int win32_handle_benchmark(const char* path, uint32_t open_handles, uint32_t iterations,
+                           win32_handle_bench_result_t* out_result);
+
 #endif /* LIMITLESS_WIN32_PERSONA_H */
@@ -0,0 +1,256 @@
+/*
+ * Hosted Kernel Benchmarks
+ * Drives the benchmark entry points of kernel subsystems linked into a
+ * normal process, the way the persona benchmarks drive theirs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "kernel.h"
+#include "net.h"
+#include "netfilter.h"
+#include "qdisc.h"
+
+extern status_t host_kernel_init(void);
+extern status_t host_spawn_setup(const char* path, size_t image_size);
+extern status_t host_spawn_benchmark(const char* path, size_t parent_pages, uint32_t iterations,
+                                     uint64_t cycles[3]);
+extern uint32_t host_process_selftest(uint64_t* reap_cycles);
+extern status_t host_sched_benchmark(uint32_t cpu_threads, uint32_t io_threads, uint64_t out[7]);
+extern status_t host_sched_deadline_benchmark(uint32_t background_threads, uint64_t out[8]);
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s OPTION\n", prog);
+    printf("  --bench-firewall [PACKETS]  Decision tree, linear walk and conntrack at 10 to 10000 rules\n");
+    printf("  --bench-fib [LOOKUPS]       Random longest-prefix lookups at 1k to 1M routes\n");
+    printf("  --bench-qdisc [MBPS [SECONDS]]  Ping latency under bulk load, simulated and over lo\n");
+    printf("  --bench-offload [MEGABYTES] UDP over lo, GSO/TSO transmit and GRO receive\n");
+    printf("  --bench-spawn [ITERATIONS]  fork+exec, vfork+exec and spawn of a 16 KiB image\n");
+    printf("  --bench-sched               Fair class: mixed CPU/IO fairness, nice weighting, wakeup latency\n");
+    printf("  --bench-deadline [HOGS]     Periodic deadline threads against fair CPU hogs\n");
+    printf("  --test-process              Exit, stop/continue, kill, pidfd and reparenting checks\n");
+}
+
+static uint32_t arg_u32(int argc, char** argv, int index, uint32_t fallback) {
+    return argc > index ? (uint32_t)strtoul(argv[index], NULL, 10) : fallback;
+}
+
+static double per(uint64_t total, uint32_t count) {
+    return count ? (double)total / count : 0.0;
+}
+
+static int run_firewall_bench(uint32_t packets) {
+    static const uint32_t rule_counts[] = { 10, 100, 1000, 10000 };
+
+    printf("%8s %8s %10s %12s %14s %16s %10s\n", "rules", "nodes", "tree KiB",
+           "tree ns/pkt", "linear ns/pkt", "tracked ns/pkt", "mismatch");
+    for (size_t i = 0; i < sizeof(rule_counts) / sizeof(rule_counts[0]); i++) {
+        fw_bench_result_t r;
+        if (FAILED(fw_benchmark(rule_counts[i], packets, &r))) {
+            fprintf(stderr, "ERROR: Firewall benchmark failed at %u rules\n", rule_counts[i]);
+            return 1;
+        }
+        printf("%8u %8u %10llu %12.1f %14.1f %16.1f %10u\n", r.rules, r.nodes,
+               (unsigned long long)(r.tree_bytes / 1024), per(r.tree_ns, r.packets),
+               per(r.linear_ns, r.packets), per(r.tracked_ns, r.packets), r.mismatches);
+        if (r.mismatches) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_fib_bench(uint32_t lookups) {
+    static const uint32_t route_counts[] = { 1000, 10000, 100000, 1000000 };
+
+    printf("%8s %8s %10s %12s %12s %14s\n", "routes", "groups", "table KiB",
+           "insert ns", "lookup ns", "lookups/s");
+    for (size_t i = 0; i < sizeof(route_counts) / sizeof(route_counts[0]); i++) {
+        fib_bench_result_t r;
+        if (FAILED(fib_benchmark(route_counts[i], lookups, &r))) {
+            fprintf(stderr, "ERROR: FIB benchmark failed at %u routes\n", route_counts[i]);
+            return 1;
+        }
+        printf("%8u %8u %10llu %12.1f %12.1f %14llu\n", r.routes, r.groups,
+               (unsigned long long)(r.table_bytes / 1024), per(r.insert_ns, r.routes),
+               per(r.lookup_ns, r.lookups), (unsigned long long)r.lookups_per_sec);
+    }
+    return 0;
+}
+
+static void print_qdisc_result(const char* name, const qdisc_bench_result_t* r) {
+    printf("%-32s %9.3f %9.3f %9.3f %10.1f %6u %8llu\n", name, r->ping_avg_ns / 1e6,
+           r->ping_p99_ns / 1e6, r->ping_max_ns / 1e6, r->bulk_goodput_bps / 1e6,
+           r->bql_limit, (unsigned long long)r->stats.dropped);
+}
+
+static int run_qdisc_bench(uint32_t link_mbps, uint32_t seconds) {
+    static const struct {
+        const char* name;
+        qdisc_bench_config_t config;
+    } cases[] = {
+        { "pfifo_fast",                    { "pfifo_fast", 0, 150, 0, 0, 0, false } },
+        { "pfifo_fast + BQL",              { "pfifo_fast", 0, 150, 0, 0, 0, true } },
+        { "pfifo_fast + BQL, ping prio 6", { "pfifo_fast", 0, 150, 0, 0, 6, true } },
+        { "fq_codel",                      { "fq_codel", 0, 150, 0, 0, 0, false } },
+        { "fq_codel + BQL",                { "fq_codel", 0, 150, 0, 0, 0, true } },
+        { "fq + BQL, bulk paced 90%",      { "fq", 0, 150, 0, 0, 0, true } },
+    };
+
+    for (int lo = 0; lo < 2; lo++) {
+        printf("%s%s, %u Mbit/s, bulk at 150%%, %u s\n", lo ? "\n" : "",
+               lo ? "Real UDP over lo" : "Simulated link (virtual time)", link_mbps, seconds);
+        printf("%-32s %9s %9s %9s %10s %6s %8s\n", "qdisc", "avg ms", "p99 ms", "max ms",
+               "bulk Mb/s", "BQL", "drops");
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            qdisc_bench_config_t config = cases[i].config;
+            config.link_mbps = link_mbps;
+            config.duration_ms = seconds * 1000;
+            if (strcmp(config.kind, "fq") == 0) {
+                config.bulk_pacing_rate = link_mbps * 1000000 / 8 / 100 * 90;
+            }
+
+            qdisc_bench_result_t r;
+            status_t status = lo ? qdisc_loopback_benchmark(&config, &r)
+                                 : qdisc_benchmark(&config, &r);
+            if (FAILED(status)) {
+                fprintf(stderr, "ERROR: Qdisc benchmark failed for %s\n", cases[i].name);
+                return 1;
+            }
+            print_qdisc_result(cases[i].name, &r);
+        }
+    }
+    return 0;
+}
+
+static int run_offload_bench(uint32_t megabytes) {
+    net_offload_bench_result_t r;
+    if (FAILED(net_offload_benchmark(megabytes, &r))) {
+        fprintf(stderr, "ERROR: Offload benchmark failed\n");
+        return 1;
+    }
+
+    printf("%llu MB per case, cycles per payload byte\n", (unsigned long long)(r.bytes >> 20));
+    printf("  UDP over lo, 1472 B writes   %.3f\n", r.lo_udp_cpb / 1000.0);
+    printf("  UDP over lo, 64 KB GSO       %.3f\n", r.lo_gso_cpb / 1000.0);
+    printf("  TCP TX, software GSO         %.3f\n", r.sw_gso_cpb / 1000.0);
+    printf("  TCP TX, TSO                  %.3f\n", r.tso_cpb / 1000.0);
+    printf("  TCP RX, no GRO               %.3f\n", r.rx_cpb / 1000.0);
+    printf("  TCP RX, GRO                  %.3f (%llu merged)\n", r.gro_cpb / 1000.0,
+           (unsigned long long)r.gro_merged);
+    printf("Mismatches: %u\n", r.mismatches);
+    return r.mismatches ? 1 : 0;
+}
+
+static int run_spawn_bench(uint32_t iterations) {
+    static const size_t parent_pages[] = { 16, 4096, 262144 };
+    static const char* path = "/spawn.elf";
+
+    if (FAILED(host_spawn_setup(path, 16384))) {
+        fprintf(stderr, "ERROR: Cannot set up the spawn benchmark\n");
+        return 1;
+    }
+
+    printf("%12s %16s %16s %16s\n", "parent", "fork+exec", "vfork+exec", "spawn");
+    for (size_t i = 0; i < sizeof(parent_pages) / sizeof(parent_pages[0]); i++) {
+        uint64_t cycles[3];
+        /* Fewer rounds for big parents, whose fork copies every page */
+        uint64_t scaled = (uint64_t)iterations * 64 / parent_pages[i];
+        uint32_t n = scaled > iterations ? iterations : scaled ? (uint32_t)scaled : 1;
+        if (FAILED(host_spawn_benchmark(path, parent_pages[i], n, cycles))) {
+            fprintf(stderr, "ERROR: Spawn benchmark failed with %zu parent pages\n", parent_pages[i]);
+            return 1;
+        }
+        printf("%8zu KiB %9llu cycles %9llu cycles %9llu cycles\n", parent_pages[i] * 4,
+               (unsigned long long)cycles[0], (unsigned long long)cycles[1],
+               (unsigned long long)cycles[2]);
+    }
+    return 0;
+}
+
+static int run_sched_bench(void) {
+    static const uint32_t thread_counts[] = { 4, 16 };
+
+    printf("%14s %9s %12s %12s %10s %10s\n", "cpu+io", "fairness", "wakeup avg", "wakeup max",
+           "io bursts", "switches");
+    uint64_t r[7];
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        uint32_t n = thread_counts[i];
+        if (FAILED(host_sched_benchmark(n, n, r))) {
+            fprintf(stderr, "ERROR: Scheduler benchmark failed with %u+%u threads\n", n, n);
+            return 1;
+        }
+        printf("%7u + %-4u %9.3f %9.1f us %9.1f us %10llu %10llu\n", n, n, r[0] / 1000.0,
+               r[3] / 1000.0, r[4] / 1000.0, (unsigned long long)r[5], (unsigned long long)r[6]);
+    }
+    /* The weighting and starvation scenarios do not depend on the thread counts */
+    printf("nice 0 : nice 5 CPU ratio: %.2f (ideal 3.05)\n", r[1] / 100.0);
+    printf("LOW next to a HIGH hog:    %.1f%% CPU (ideal 9.7%%)\n", r[2] / 10.0);
+    return 0;
+}
+
+static int run_deadline_bench(uint32_t hogs) {
+    uint64_t r[8];
+    if (FAILED(host_sched_deadline_benchmark(hogs, r))) {
+        fprintf(stderr, "ERROR: Deadline benchmark failed with %u background threads\n", hogs);
+        return 1;
+    }
+    printf("Deadline class, %u fair hogs:\n", hogs);
+    printf("  audio activations:     %llu\n", (unsigned long long)r[0]);
+    printf("  jitter avg / max:      %.1f / %.1f us\n", r[2] / 1000.0, r[1] / 1000.0);
+    printf("  deadline misses:       %llu\n", (unsigned long long)r[3]);
+    printf("  runaway thread:        %.1f%% CPU (reserved 20.0%%)\n", r[5] / 10.0);
+    printf("  background hogs:       %.1f%% CPU\n", r[6] / 10.0);
+    printf("As PRIORITY_HIGH fair threads, max jitter: %.1f us\n", r[4] / 1000.0);
+    printf("30%% reservations admitted: %llu\n", (unsigned long long)r[7]);
+    return r[3] ? 1 : 0;
+}
+
+static int run_process_test(void) {
+    uint64_t reap_cycles = 0;
+    uint32_t failures = host_process_selftest(&reap_cycles);
+    printf("Process lifecycle: %s (%u failed checks)\n", failures ? "FAIL" : "ok", failures);
+    printf("fork/exit/reap:    %llu cycles\n", (unsigned long long)reap_cycles);
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    /* Hosted pages come from malloc; keep freed ones in the heap like the PMM's free lists */
+    mallopt(M_MMAP_THRESHOLD, 64 << 20);
+    mallopt(M_TRIM_THRESHOLD, 256 << 20);
+
+    if (FAILED(host_kernel_init()) || FAILED(net_init())) {
+        fprintf(stderr, "ERROR: Failed to bring up the hosted kernel\n");
+        return 1;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--bench-firewall") == 0) {
+        return run_firewall_bench(arg_u32(argc, argv, 2, 3000000));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-fib") == 0) {
+        return run_fib_bench(arg_u32(argc, argv, 2, 10000000));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-qdisc") == 0) {
+        return run_qdisc_bench(arg_u32(argc, argv, 2, 100), arg_u32(argc, argv, 3, 5));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-offload") == 0) {
+        return run_offload_bench(arg_u32(argc, argv, 2, 64));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-spawn") == 0) {
+        return run_spawn_bench(arg_u32(argc, argv, 2, 1000));
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-sched") == 0) {
+        return run_sched_bench();
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-deadline") == 0) {
+        return run_deadline_bench(arg_u32(argc, argv, 2, 16));
+    }
+    if (argc > 1 && strcmp(argv[1], "--test-process") == 0) {
+        return run_process_test();
+    }
+
+    print_usage(argv[0]);
+    return argc > 1 ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Hosted Benchmark Shim
+ * Clocks for kernel code run as a normal process. The kernel's
+ * perf_timestamp_ns assumes a 2.4 GHz TSC; hosted numbers use the
+ * monotonic clock instead so they are comparable across machines.
+ */
+
+#include <time.h>
+#include "kernel.h"
+#include "perf.h"
+
+uint64_t perf_timestamp_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t perf_cycles(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+struct cpu_context;
+
+/* Hosted benchmarks run on one thread; a real switch would lose the process stack */
+void context_switch(struct cpu_context* old_ctx, struct cpu_context* new_ctx) {
+    (void)old_ctx;
+    (void)new_ctx;
+    kernel_panic("context_switch in a hosted build");
+}
@@ -0,0 +1,185 @@
+/*
+ * Hosted Process Benchmark Setup
+ * Writes the executable the spawn benchmark launches and runs it, and
+ * checks the process lifecycle. Kept apart from bench_kernel.c: the
+ * process headers clash with libc.
+ */
+
+#include "kernel.h"
+#include "elf.h"
+#include "vfs.h"
+#include "process.h"
+#include "perf.h"
+
+/* A static x86-64 executable: one read/execute PT_LOAD of image_size bytes */
+static status_t host_spawn_image(const char* path, size_t image_size) {
+    static uint8_t image[16384];
+    if (image_size > sizeof(image) || image_size < sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr)) {
+        return STATUS_INVALID;
+    }
+
+    memset(image, 0xCC, image_size);
+    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)image;
+    memset(ehdr, 0, sizeof(*ehdr));
+    memcpy(ehdr->e_ident, "\x7F" "ELF", 4);
+    ehdr->e_ident[4] = ELFCLASS64;
+    ehdr->e_ident[5] = ELFDATA2LSB;
+    ehdr->e_ident[6] = EV_CURRENT;
+    ehdr->e_type = ET_EXEC;
+    ehdr->e_machine = EM_X86_64;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_entry = 0x400000 + sizeof(Elf64_Ehdr) + sizeof(Elf64_Phdr);
+    ehdr->e_phoff = sizeof(Elf64_Ehdr);
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_phentsize = sizeof(Elf64_Phdr);
+    ehdr->e_phnum = 1;
+
+    Elf64_Phdr* phdr = (Elf64_Phdr*)(ehdr + 1);
+    memset(phdr, 0, sizeof(*phdr));
+    phdr->p_type = PT_LOAD;
+    phdr->p_flags = PF_R | PF_X;
+    phdr->p_vaddr = 0x400000;
+    phdr->p_paddr = 0x400000;
+    phdr->p_filesz = image_size;
+    phdr->p_memsz = image_size;
+    phdr->p_align = PAGE_SIZE;
+
+    vfs_file_t* file;
+    status_t status = vfs_open(path, VFS_O_WRONLY | VFS_O_CREAT | VFS_O_TRUNC, 0755, &file);
+    if (FAILED(status)) {
+        return status;
+    }
+    ssize_t written = vfs_write(file, image, image_size);
+    vfs_close(file);
+    return written == (ssize_t)image_size ? STATUS_OK : STATUS_ERROR;
+}
+
+status_t host_spawn_setup(const char* path, size_t image_size) {
+    status_t status = process_init();
+    if (FAILED(status) && status != STATUS_EXISTS) {
+        return status;
+    }
+    return host_spawn_image(path, image_size);
+}
+
+/* Average cycles for fork+exec, vfork+exec and spawn, in that order */
+status_t host_spawn_benchmark(const char* path, size_t parent_pages, uint32_t iterations,
+                              uint64_t cycles[3]) {
+    process_spawn_bench_result_t r;
+    status_t status = process_spawn_benchmark(path, parent_pages, iterations, &r);
+    if (SUCCESS(status)) {
+        cycles[0] = r.fork_exec_cycles;
+        cycles[1] = r.vfork_exec_cycles;
+        cycles[2] = r.spawn_cycles;
+    }
+    return status;
+}
+
+#define HOST_CHECK(cond)                                                        \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            KLOG_ERROR("TEST", "line %d: %s", __LINE__, #cond);                 \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+/*
+ * Lifecycle checks for exit and reap, stop/continue reports, kill,
+ * pidfd/event-queue notification and orphan reparenting, on a fresh
+ * process table. Returns the number of failed checks; *reap_cycles gets
+ * the average cost of one fork/exit/reap cycle.
+ */
+uint32_t host_process_selftest(uint64_t* reap_cycles) {
+    uint32_t failures = 0;
+    process_t* init = NULL;
+    process_t* parent = NULL;
+    process_t* child = NULL;
+    process_t* orphan = NULL;
+    process_t* zombie = NULL;
+    int st = 0;
+    pid_t pid = 0;
+
+    status_t status = process_init();
+    HOST_CHECK(SUCCESS(status) || status == STATUS_EXISTS);
+    HOST_CHECK(SUCCESS(process_create(&init)) && init->pid == 1);
+    init->state = PROCESS_STATE_RUNNING;
+    HOST_CHECK(SUCCESS(process_fork(init, &parent)));
+    parent->state = PROCESS_STATE_RUNNING;
+
+    /* Exit and reap */
+    HOST_CHECK(SUCCESS(process_fork(parent, &child)));
+    pid_t child_pid = child->pid;
+    HOST_CHECK(process_wait(parent, 0, &st, PROCESS_WNOHANG, &pid) == STATUS_BUSY);
+    process_exit(child, 7);
+    HOST_CHECK(SUCCESS(process_wait(parent, 0, &st, PROCESS_WNOHANG, &pid)));
+    HOST_CHECK(pid == child_pid && st == PROCESS_STATUS_EXITED(7));
+    HOST_CHECK(process_find_by_pid(child_pid) == NULL);
+
+    /* Stop and continue are each reported once, and only when asked for */
+    HOST_CHECK(SUCCESS(process_fork(parent, &child)));
+    child_pid = child->pid;
+    HOST_CHECK(SUCCESS(process_kill(child_pid, PROCESS_SIGSTOP)));
+    HOST_CHECK(process_wait(parent, child_pid, &st, PROCESS_WNOHANG, NULL) == STATUS_BUSY);
+    HOST_CHECK(SUCCESS(process_wait(parent, child_pid, &st, PROCESS_WNOHANG | PROCESS_WUNTRACED,
+                                    NULL)));
+    HOST_CHECK(st == PROCESS_STATUS_STOPPED(PROCESS_SIGSTOP));
+    HOST_CHECK(process_wait(parent, child_pid, &st, PROCESS_WNOHANG | PROCESS_WUNTRACED,
+                            NULL) == STATUS_BUSY);
+    HOST_CHECK(SUCCESS(process_kill(child_pid, PROCESS_SIGCONT)));
+    HOST_CHECK(SUCCESS(process_wait(parent, child_pid, &st, PROCESS_WNOHANG | PROCESS_WCONTINUED,
+                                    NULL)));
+    HOST_CHECK(st == PROCESS_STATUS_CONTINUED);
+
+    /* Kill: the pidfd's event queue reports the exit once, then the pidfd reaps */
+    int fd = -1;
+    process_evq_t* evq = NULL;
+    process_event_t events[2];
+    uint32_t count = 0;
+    HOST_CHECK(SUCCESS(process_pidfd_open(parent, child_pid, &fd)));
+    HOST_CHECK(SUCCESS(process_evq_create(&evq)));
+    HOST_CHECK(SUCCESS(process_evq_add_pidfd(evq, parent, fd, 0xC0FFEE)));
+    HOST_CHECK(process_evq_wait(evq, events, 2, PROCESS_WNOHANG, &count) == STATUS_BUSY);
+    HOST_CHECK(SUCCESS(process_kill(child_pid, PROCESS_SIGKILL)));
+    HOST_CHECK(SUCCESS(process_evq_wait(evq, events, 2, PROCESS_WNOHANG, &count)));
+    HOST_CHECK(count == 1 && events[0].cookie == 0xC0FFEE && events[0].pid == child_pid);
+    HOST_CHECK(process_evq_wait(evq, events, 2, PROCESS_WNOHANG, &count) == STATUS_BUSY);
+    HOST_CHECK(SUCCESS(process_pidfd_wait(parent, fd, &st, PROCESS_WNOHANG)));
+    HOST_CHECK(st == PROCESS_STATUS_SIGNALED(PROCESS_SIGKILL));
+    HOST_CHECK(process_pidfd_wait(parent, fd, &st, PROCESS_WNOHANG) == STATUS_NOTFOUND);
+    process_evq_destroy(evq);
+    process_fd_free(parent, fd);
+
+    /* Orphans go to init, together with zombies nobody reaped */
+    HOST_CHECK(SUCCESS(process_fork(parent, &child)));
+    child_pid = child->pid;
+    HOST_CHECK(SUCCESS(process_fork(child, &orphan)));
+    HOST_CHECK(SUCCESS(process_fork(child, &zombie)));
+    pid_t orphan_pid = orphan->pid;
+    pid_t zombie_pid = zombie->pid;
+    process_exit(zombie, 3);
+    process_exit(child, 0);
+    HOST_CHECK(orphan->parent_pid == 1);
+    HOST_CHECK(SUCCESS(process_wait(init, zombie_pid, &st, PROCESS_WNOHANG, NULL)));
+    HOST_CHECK(st == PROCESS_STATUS_EXITED(3));
+    HOST_CHECK(SUCCESS(process_wait(parent, child_pid, &st, PROCESS_WNOHANG, NULL)));
+    process_exit(orphan, 0);
+    HOST_CHECK(SUCCESS(process_wait(init, 0, &st, PROCESS_WNOHANG, &pid)) && pid == orphan_pid);
+
+    /* Cost of one fork/exit/reap cycle */
+    const uint32_t rounds = 10000;
+    uint64_t start = perf_cycles();
+    for (uint32_t i = 0; i < rounds; i++) {
+        if (FAILED(process_fork(parent, &child))) {
+            failures++;
+            break;
+        }
+        process_exit(child, 0);
+        process_wait(parent, 0, NULL, PROCESS_WNOHANG, NULL);
+    }
+    *reap_cycles = (perf_cycles() - start) / rounds;
+
+    process_exit(parent, 0);
+    process_wait(init, 0, NULL, PROCESS_WNOHANG, NULL);
+    process_exit(init, 0);
+    return failures;
+}
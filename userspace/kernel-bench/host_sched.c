@@ -0,0 +1,51 @@
+/*
+ * Hosted Scheduler Benchmarks
+ * Runs the scheduler's simulated workloads and hands the results back as
+ * plain integers. Kept apart from bench_kernel.c: microkernel.h clashes
+ * with libc.
+ */
+
+#include "kernel.h"
+#include "microkernel.h"
+
+/*
+ * Mixed CPU/IO workload. out[] gets, in order: Jain fairness (permille),
+ * nice 0 : nice 5 ratio (x100), LOW share next to HIGH (permille), wakeup
+ * average and maximum (ns), IO bursts, context switches.
+ */
+status_t host_sched_benchmark(uint32_t cpu_threads, uint32_t io_threads, uint64_t out[7]) {
+    sched_bench_result_t r;
+    status_t status = sched_benchmark(cpu_threads, io_threads, &r);
+    if (SUCCESS(status)) {
+        out[0] = r.fairness_permille;
+        out[1] = r.weighted_ratio_x100;
+        out[2] = r.low_share_permille;
+        out[3] = r.wakeup_avg_ns;
+        out[4] = r.wakeup_max_ns;
+        out[5] = r.io_bursts;
+        out[6] = r.context_switches;
+    }
+    return status;
+}
+
+/*
+ * Periodic audio thread against background hogs. out[] gets, in order:
+ * activations, deadline-class maximum and average jitter (ns), deadline
+ * misses, the same thread's maximum jitter as a fair thread (ns), runaway
+ * and background CPU share (permille), 30% reservations admitted.
+ */
+status_t host_sched_deadline_benchmark(uint32_t background_threads, uint64_t out[8]) {
+    sched_dl_bench_result_t r;
+    status_t status = sched_deadline_benchmark(background_threads, &r);
+    if (SUCCESS(status)) {
+        out[0] = r.activations;
+        out[1] = r.max_jitter_ns;
+        out[2] = r.avg_jitter_ns;
+        out[3] = r.deadline_misses;
+        out[4] = r.fair_max_jitter_ns;
+        out[5] = r.hog_share_permille;
+        out[6] = r.background_share_permille;
+        out[7] = r.admitted;
+    }
+    return status;
+}
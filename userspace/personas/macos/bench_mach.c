@@ -0,0 +1,42 @@
+/*
+ * macOS Persona Benchmark
+ * Hosted driver for the Mach IPC benchmark
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "macos_persona.h"
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s OPTION\n", prog);
+    printf("  --bench-ipc [ITERATIONS [OOL_BYTES]]  Request/reply over ports against a pipe pair\n");
+}
+
+static uint32_t arg_u32(int argc, char** argv, int index, uint32_t fallback) {
+    return argc > index ? (uint32_t)strtoul(argv[index], NULL, 10) : fallback;
+}
+
+static int run_ipc_bench(uint32_t iterations, uint32_t ool_bytes) {
+    mach_ipc_bench_result_t r;
+    if (mach_ipc_benchmark(iterations, ool_bytes, &r) < 0) {
+        fprintf(stderr, "ERROR: Mach IPC benchmark failed\n");
+        return 1;
+    }
+
+    printf("RPC:       %llu ns per request and reply, pipes %llu ns\n",
+           (unsigned long long)r.rpc_ns, (unsigned long long)r.pipe_rpc_ns);
+    printf("OOL:       %u bytes each way, %llu ns moved, %llu ns copied\n", ool_bytes,
+           (unsigned long long)r.rpc_ool_move_ns, (unsigned long long)r.rpc_ool_copy_ns);
+    printf("Handoffs:  %llu messages copied straight to a waiting receiver\n", (unsigned long long)r.handoffs);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-ipc") == 0) {
+        return run_ipc_bench(arg_u32(argc, argv, 2, 100000), arg_u32(argc, argv, 3, 65536));
+    }
+
+    print_usage(argv[0]);
+    return argc > 1 ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * POSIX Persona Syscall Throughput Benchmark
+ * Measures common file I/O patterns through the persona and the VFS, and
+ * cold reads of a disk image through the page cache and read-ahead.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "posix.h"
+#include "page_cache.h"
+#include "vmm.h"
+
+extern status_t host_kernel_init(void);
+
+#define BENCH_FILE_SIZE   (4 * 1024 * 1024)
+#define BENCH_BLOCK       4096
+#define BENCH_SMALL       256
+#define BENCH_IOVECS      16
+#define BENCH_ITERATIONS  20000
+
+/* Cold reads: a disk image behind a simulated device */
+#define BENCH_IMAGE_PATH   "/tmp/bench_posix.img"
+#define BENCH_IMAGE_SIZE   (8 * 1024 * 1024)
+#define BENCH_IMAGE_PAGES  (BENCH_IMAGE_SIZE / BENCH_BLOCK)
+#define BENCH_STRIDE       4                /* Pages between strided reads */
+#define BENCH_DEV_LATENCY  50000            /* ns per request */
+#define BENCH_DEV_NS_PER_KB 1000            /* ns per KiB transferred (~1 GB/s) */
+
+static uint8_t bench_buf[BENCH_FILE_SIZE / 4];
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Print one result line; ops are syscalls issued by the pattern */
+static void bench_report(const char* name, posix_context_t* ctx, const posix_io_stats_t* before,
+                         uint64_t ops, uint64_t bytes, uint64_t elapsed_ns) {
+    double secs = elapsed_ns / 1e9;
+    uint64_t calls = ctx->io_stats.kernel_calls - before->kernel_calls;
+    uint64_t syscalls = ctx->io_stats.syscalls - before->syscalls;
+
+    printf("%-28s %10.0f ops/s %9.1f MB/s %6.2f kcalls/op %8.1f ns/op\n",
+           name, ops / secs, bytes / secs / (1024.0 * 1024.0),
+           syscalls ? (double)calls / ops : 0.0, (double)elapsed_ns / ops);
+}
+
+static int64_t bench_open(posix_context_t* ctx, const char* path) {
+    return posix_syscall(ctx, SYS_open, (uint64_t)path, 0x242, 0644, 0, 0, 0);  // O_RDWR | O_CREAT | O_TRUNC
+}
+
+/* Sequential 4 KiB writes, then positional 4 KiB reads at pseudo-random offsets */
+static void bench_block_io(posix_context_t* ctx) {
+    int64_t fd = bench_open(ctx, "/bench.dat");
+    posix_io_stats_t before = ctx->io_stats;
+    uint64_t ops = BENCH_FILE_SIZE / BENCH_BLOCK;
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < ops; i++) {
+        posix_syscall(ctx, SYS_write, fd, (uint64_t)bench_buf, BENCH_BLOCK, 0, 0, 0);
+    }
+    bench_report("write 4K sequential", ctx, &before, ops, ops * BENCH_BLOCK, bench_now_ns() - start);
+
+    before = ctx->io_stats;
+    uint32_t seed = 12345;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint64_t block = (seed >> 8) % (BENCH_FILE_SIZE / BENCH_BLOCK);
+        posix_syscall(ctx, SYS_pread64, fd, (uint64_t)bench_buf, BENCH_BLOCK, block * BENCH_BLOCK, 0, 0);
+    }
+    bench_report("pread64 4K random", ctx, &before, BENCH_ITERATIONS,
+                 (uint64_t)BENCH_ITERATIONS * BENCH_BLOCK, bench_now_ns() - start);
+
+    posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
+}
+
+/* Scattered small records: one write per record versus one writev per batch */
+static void bench_vectored(posix_context_t* ctx) {
+    int64_t fd = bench_open(ctx, "/records.dat");
+    posix_io_stats_t before = ctx->io_stats;
+    uint64_t batches = BENCH_ITERATIONS / BENCH_IOVECS;
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < batches * BENCH_IOVECS; i++) {
+        posix_syscall(ctx, SYS_write, fd, (uint64_t)(bench_buf + (i % BENCH_IOVECS) * BENCH_SMALL),
+                      BENCH_SMALL, 0, 0, 0);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("write 256B x16 (per record)", ctx, &before, batches * BENCH_IOVECS,
+                 batches * BENCH_IOVECS * BENCH_SMALL, elapsed);
+
+    posix_iovec_t iov[BENCH_IOVECS];
+    for (int i = 0; i < BENCH_IOVECS; i++) {
+        iov[i].base = bench_buf + i * BENCH_SMALL;
+        iov[i].len = BENCH_SMALL;
+    }
+
+    posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_SET, 0, 0, 0);
+    before = ctx->io_stats;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < batches; i++) {
+        posix_syscall(ctx, SYS_writev, fd, (uint64_t)iov, BENCH_IOVECS, 0, 0, 0);
+    }
+    elapsed = bench_now_ns() - start;
+    bench_report("writev 16x256B (batched)", ctx, &before, batches,
+                 batches * BENCH_IOVECS * BENCH_SMALL, elapsed);
+
+    posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_SET, 0, 0, 0);
+    before = ctx->io_stats;
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < batches; i++) {
+        posix_syscall(ctx, SYS_preadv2, fd, (uint64_t)iov, BENCH_IOVECS,
+                      (i * BENCH_IOVECS * BENCH_SMALL) % (BENCH_FILE_SIZE / 4), 0, 0);
+    }
+    elapsed = bench_now_ns() - start;
+    bench_report("preadv2 16x256B", ctx, &before, batches,
+                 batches * BENCH_IOVECS * BENCH_SMALL, elapsed);
+
+    posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
+}
+
+/* Whole-file copy: read/write through a user buffer versus copy_file_range */
+static void bench_copy(posix_context_t* ctx) {
+    int64_t src = posix_syscall(ctx, SYS_open, (uint64_t)"/bench.dat", 0, 0, 0, 0, 0);
+    int64_t dst = bench_open(ctx, "/bench.copy");
+    posix_io_stats_t before = ctx->io_stats;
+    uint64_t ops = 0;
+
+    uint64_t start = bench_now_ns();
+    for (;;) {
+        int64_t n = posix_syscall(ctx, SYS_read, src, (uint64_t)bench_buf, sizeof(bench_buf), 0, 0, 0);
+        ops++;
+        if (n <= 0) {
+            break;
+        }
+        posix_syscall(ctx, SYS_write, dst, (uint64_t)bench_buf, n, 0, 0, 0);
+        ops++;
+    }
+    bench_report("copy via read/write", ctx, &before, ops, BENCH_FILE_SIZE, bench_now_ns() - start);
+
+    posix_syscall(ctx, SYS_close, dst, 0, 0, 0, 0, 0);
+    dst = bench_open(ctx, "/bench.copy");
+    before = ctx->io_stats;
+    ops = 0;
+
+    int64_t off_in = 0;
+    start = bench_now_ns();
+    while (off_in < BENCH_FILE_SIZE) {
+        if (posix_syscall(ctx, SYS_copy_file_range, src, (uint64_t)&off_in, dst, 0,
+                          BENCH_FILE_SIZE - off_in, 0) <= 0) {
+            break;
+        }
+        ops++;
+    }
+    bench_report("copy_file_range", ctx, &before, ops, BENCH_FILE_SIZE, bench_now_ns() - start);
+
+    posix_syscall(ctx, SYS_close, dst, 0, 0, 0, 0, 0);
+    posix_syscall(ctx, SYS_close, src, 0, 0, 0, 0, 0);
+}
+
+/* Open/close churn on an existing file */
+static void bench_open_close(posix_context_t* ctx) {
+    posix_io_stats_t before = ctx->io_stats;
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < BENCH_ITERATIONS; i++) {
+        int64_t fd = posix_syscall(ctx, SYS_open, (uint64_t)"/bench.dat", 0, 0, 0, 0, 0);
+        if (fd < 0) {
+            printf("ERROR: open failed (%lld)\n", (long long)fd);
+            return;
+        }
+        posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
+    }
+    bench_report("open+close", ctx, &before, 2 * BENCH_ITERATIONS, 0, bench_now_ns() - start);
+}
+
+/* ============================================================================
+ * Cold reads. The image file stands in for a block device: every request
+ * pays a fixed latency plus transfer time, so batching and read-ahead show
+ * up as they would on hardware.
+ * ============================================================================ */
+
+static int bench_image_fd = -1;
+static uint64_t bench_dev_requests;
+static uint64_t bench_dev_bytes;
+
+static void bench_dev_wait(size_t bytes) {
+    uint64_t until = bench_now_ns() + BENCH_DEV_LATENCY + bytes / 1024 * BENCH_DEV_NS_PER_KB;
+    bench_dev_requests++;
+    bench_dev_bytes += bytes;
+    while (bench_now_ns() < until) {
+    }
+}
+
+static ssize_t bench_image_read(vfs_node_t* node, void* buffer, size_t size, uint64_t offset) {
+    (void)node;
+    ssize_t n = pread(bench_image_fd, buffer, size, (off_t)offset);
+    bench_dev_wait(size);
+    return n < 0 ? STATUS_ERROR : n;
+}
+
+static ssize_t bench_image_readv(vfs_node_t* node, const vfs_iovec_t* iov, uint32_t iovcnt,
+                                 uint64_t offset) {
+    (void)node;
+    /* vfs_iovec_t is layout-compatible with struct iovec */
+    ssize_t n = preadv(bench_image_fd, (const struct iovec*)iov, (int)iovcnt, (off_t)offset);
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        bytes += iov[i].len;
+    }
+    bench_dev_wait(bytes);
+    return n < 0 ? STATUS_ERROR : n;
+}
+
+static vfs_file_ops_t bench_image_ops = {
+    .read = bench_image_read,
+    .readv = bench_image_readv,
+};
+
+static vfs_mount_t bench_image_mount;
+
+typedef enum { COLD_SEQUENTIAL, COLD_STRIDED, COLD_REVERSE, COLD_RANDOM } bench_cold_t;
+
+/* One cold pass over the image: empty cache, fresh tracker */
+static void bench_cold_pass(vfs_node_t* node, bench_cold_t pattern, const char* name, bool ra) {
+    vfs_file_t file = { .node = node, .ref_count = 1 };
+    ra_init(&file.ra);
+    vfs_fadvise(&file, 0, 0, ra ? VFS_ADV_NORMAL : VFS_ADV_RANDOM);
+    page_cache_drop(node, 0, 0);
+
+    uint64_t requests = bench_dev_requests;
+    uint64_t reads = 0;
+    uint32_t seed = 12345;
+
+    uint64_t start = bench_now_ns();
+    switch (pattern) {
+    case COLD_SEQUENTIAL:
+        while (vfs_read(&file, bench_buf, BENCH_BLOCK) > 0) {
+            reads++;
+        }
+        break;
+    case COLD_STRIDED:
+        for (uint64_t page = 0; page < BENCH_IMAGE_PAGES; page += BENCH_STRIDE, reads++) {
+            vfs_pread(&file, bench_buf, BENCH_BLOCK, (int64_t)(page * BENCH_BLOCK));
+        }
+        break;
+    case COLD_REVERSE:
+        for (uint64_t page = BENCH_IMAGE_PAGES; page-- > 0; reads++) {
+            vfs_pread(&file, bench_buf, BENCH_BLOCK, (int64_t)(page * BENCH_BLOCK));
+        }
+        break;
+    case COLD_RANDOM:
+        for (; reads < BENCH_IMAGE_PAGES / BENCH_STRIDE; reads++) {
+            seed = seed * 1103515245 + 12345;
+            uint64_t page = (seed >> 8) % BENCH_IMAGE_PAGES;
+            vfs_pread(&file, bench_buf, BENCH_BLOCK, (int64_t)(page * BENCH_BLOCK));
+        }
+        break;
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    /* As vfs_close would: what is still ahead was never used */
+    ra_release(&file.ra);
+    ra_stats_t stats;
+    vfs_readahead_stats(&file, &stats);
+    printf("%-20s %-3s %9.1f MB/s %6llu dev reqs %6llu ahead %6llu used %6llu wasted  %s\n",
+           name, ra ? "on" : "off", reads * BENCH_BLOCK / (elapsed / 1e9) / (1024.0 * 1024.0),
+           (unsigned long long)(bench_dev_requests - requests),
+           (unsigned long long)stats.prefetched, (unsigned long long)stats.used,
+           (unsigned long long)stats.wasted, ra_pattern_name((ra_pattern_t)file.ra.pattern));
+}
+
+static void bench_cold_read(void) {
+    bench_image_fd = open(BENCH_IMAGE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (bench_image_fd < 0) {
+        printf("ERROR: cannot create %s\n", BENCH_IMAGE_PATH);
+        return;
+    }
+    for (uint64_t off = 0; off < BENCH_IMAGE_SIZE; off += sizeof(bench_buf)) {
+        memset(bench_buf, (int)(off / sizeof(bench_buf)), sizeof(bench_buf));
+        if (pwrite(bench_image_fd, bench_buf, sizeof(bench_buf), (off_t)off) < 0) {
+            printf("ERROR: cannot write %s\n", BENCH_IMAGE_PATH);
+            close(bench_image_fd);
+            return;
+        }
+    }
+
+    vfs_node_t* node = vfs_node_alloc();
+    node->type = VFS_TYPE_FILE;
+    node->size = BENCH_IMAGE_SIZE;
+    node->file_ops = &bench_image_ops;
+    node->mount = &bench_image_mount;
+
+    printf("\n=== Cold Reads (%d MiB image, %d us per device request) ===\n",
+           BENCH_IMAGE_SIZE >> 20, BENCH_DEV_LATENCY / 1000);
+    static const struct { bench_cold_t pattern; const char* name; } passes[] = {
+        { COLD_SEQUENTIAL, "read 4K sequential" },
+        { COLD_STRIDED,    "pread 4K stride 4" },
+        { COLD_REVERSE,    "pread 4K reverse" },
+        { COLD_RANDOM,     "pread 4K random" },
+    };
+    for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); i++) {
+        bench_cold_pass(node, passes[i].pattern, passes[i].name, false);
+        bench_cold_pass(node, passes[i].pattern, passes[i].name, true);
+    }
+
+    page_cache_drop(node, 0, 0);
+    vfs_node_unref(node);
+    close(bench_image_fd);
+    unlink(BENCH_IMAGE_PATH);
+}
+
+/* Faults taken touching every page of a mapped file, per mapping strategy */
+static void bench_fault_scan(posix_context_t* ctx) {
+    int64_t fd = bench_open(ctx, "/scan.dat");
+    for (uint64_t off = 0; off < BENCH_FILE_SIZE; off += sizeof(bench_buf)) {
+        posix_syscall(ctx, SYS_write, fd, (uint64_t)bench_buf, sizeof(bench_buf), 0, 0, 0);
+    }
+    posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
+
+    vmm_scan_bench_result_t r;
+    if (FAILED(vmm_scan_benchmark("/scan.dat", &r))) {
+        printf("ERROR: Fault scan benchmark failed\n");
+        return;
+    }
+
+    printf("\n=== Mapped Scan (%zu pages, faults per strategy) ===\n", r.pages);
+    printf("%-28s %8zu\n", "MADV_RANDOM (no fault-around)", r.faults_no_around);
+    printf("%-28s %8zu\n", "default, cold", r.faults_cold);
+    printf("%-28s %8zu\n", "default, cached", r.faults_warm);
+    printf("%-28s %8zu\n", "MADV_SEQUENTIAL, cold", r.faults_sequential);
+    printf("%-28s %8zu\n", "MAP_POPULATE", r.faults_populate);
+}
+
+int main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+
+    if (FAILED(host_kernel_init()) || FAILED(posix_init())) {
+        printf("ERROR: Failed to initialize POSIX persona\n");
+        return 1;
+    }
+
+    posix_context_t* ctx = NULL;
+    if (FAILED(posix_create_context(&ctx))) {
+        printf("ERROR: Failed to create context\n");
+        return 1;
+    }
+
+    memset(bench_buf, 0xA5, sizeof(bench_buf));
+
+    printf("\n=== POSIX Persona Syscall Throughput ===\n");
+    bench_block_io(ctx);
+    bench_vectored(ctx);
+    bench_copy(ctx);
+    bench_open_close(ctx);
+    bench_cold_read();
+    bench_fault_scan(ctx);
+
+    printf("\nTotal: %llu syscalls, %llu kernel calls, %llu bytes read, %llu bytes written\n",
+           (unsigned long long)ctx->io_stats.syscalls, (unsigned long long)ctx->io_stats.kernel_calls,
+           (unsigned long long)ctx->io_stats.bytes_read, (unsigned long long)ctx->io_stats.bytes_written);
+
+    posix_destroy_context(ctx);
+    return 0;
+}
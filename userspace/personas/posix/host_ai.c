@@ -0,0 +1,37 @@
+/*
+ * Hosted AI Hook Shim
+ * No AI models are installed in hosted builds, so every hook keeps its
+ * default. Kept apart from host_kernel.c: the kernel headers it needs
+ * clash with libc.
+ */
+
+#include "kernel.h"
+#include "ai_hooks.h"
+
+bool g_ai_decision_enabled = false;
+uint32_t g_ai_model_mask = 0;
+
+bool ai_model_eval(ai_hook_type_t hook_type, const int64_t input[AI_MODEL_INPUTS],
+                   ai_model_result_t* result) {
+    (void)hook_type;
+    (void)input;
+    (void)result;
+    return false;
+}
+
+status_t ai_model_compile(const void* blob, size_t size, ai_model_t** out) {
+    (void)blob;
+    (void)size;
+    (void)out;
+    return STATUS_NOSUPPORT;
+}
+
+void ai_model_free(ai_model_t* model) {
+    (void)model;
+}
+
+ai_model_t* ai_model_swap(ai_hook_type_t hook_type, ai_model_t* model) {
+    (void)hook_type;
+    (void)model;
+    return NULL;
+}
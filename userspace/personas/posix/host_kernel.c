@@ -0,0 +1,65 @@
+/*
+ * Hosted Kernel Shim
+ * Lets the persona tests run the real kernel VFS and ramdisk as a normal
+ * process: page allocation and logging map onto libc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "kernel.h"
+#include "vfs.h"
+
+extern status_t ramdisk_register(void);
+
+/* Kernel logging */
+void kernel_log(log_level_t level, const char* subsystem, const char* format, ...) {
+    if (level < LOG_WARN) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%s] ", subsystem);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+void kernel_panic(const char* message) {
+    fprintf(stderr, "[PANIC] %s\n", message);
+    abort();
+}
+
+/* Physical pages */
+paddr_t pmm_alloc_pages(size_t count) {
+    return (paddr_t)aligned_alloc(PAGE_SIZE, count * PAGE_SIZE);
+}
+
+void pmm_free_pages(paddr_t base, size_t count) {
+    (void)count;
+    free((void*)base);
+}
+
+paddr_t pmm_alloc_page(void) {
+    return pmm_alloc_pages(1);
+}
+
+void pmm_free_page(paddr_t page) {
+    free((void*)page);
+}
+
+/* Bring up the VFS with a ramdisk root, as kernel_main does at boot */
+status_t host_kernel_init(void) {
+    status_t status = vfs_init();
+    if (FAILED(status) && status != STATUS_EXISTS) {
+        return status;
+    }
+
+    status = ramdisk_register();
+    if (FAILED(status) && status != STATUS_EXISTS) {
+        return status;
+    }
+
+    return vfs_mount(NULL, "/", "ramdisk", 0);
+}
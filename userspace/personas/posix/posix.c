@@ -75,7 +75,7 @@ status_t posix_create_context(posix_context_t** out_ctx) {
 
     *out_ctx = ctx;
 
-    printf("[POSIX] Created context for PID %llu\n", ctx->pid);
+    printf("[POSIX] Created context for PID %llu\n", (unsigned long long)ctx->pid);
     return STATUS_OK;
 }
 
@@ -131,9 +131,14 @@ void posix_free_fd(posix_context_t* ctx, int fd) {
         ctx->fds[fd].active = false;
         ctx->fds[fd].flags = 0;
         if (ctx->fds[fd].private_data) {
-            free(ctx->fds[fd].private_data);
+            vfs_close((vfs_file_t*)ctx->fds[fd].private_data);
             ctx->fds[fd].private_data = NULL;
         }
+
+        /* POSIX hands out the lowest free descriptor */
+        if (fd >= 3 && (uint32_t)fd < ctx->next_fd) {
+            ctx->next_fd = fd;
+        }
     }
 }
 
@@ -145,6 +150,134 @@ fd_entry_t* posix_get_fd(posix_context_t* ctx, int fd) {
     return &ctx->fds[fd];
 }
 
+/* Translate a kernel status into a negative errno */
+static int64_t posix_status_errno(status_t status) {
+    switch (status) {
+        case STATUS_OK:        return 0;
+        case STATUS_NOMEM:     return -ENOMEM;
+        case STATUS_INVALID:   return -EINVAL;
+        case STATUS_NOTFOUND:  return -ENOENT;
+        case STATUS_BUSY:      return -EBUSY;
+        case STATUS_DENIED:    return -EBADF;
+        case STATUS_EXISTS:    return -EEXIST;
+        case STATUS_NOSUPPORT: return -EOPNOTSUPP;
+        default:               return -EIO;
+    }
+}
+
+/* Byte count from the VFS, or a negative status, as a syscall result */
+static int64_t posix_io_result(ssize_t result) {
+    return result >= 0 ? result : posix_status_errno((status_t)result);
+}
+
+/* VFS file behind an fd; console fds have none */
+static vfs_file_t* posix_get_file(posix_context_t* ctx, int fd) {
+    fd_entry_t* fde = posix_get_fd(ctx, fd);
+    return fde ? (vfs_file_t*)fde->private_data : NULL;
+}
+
+/* Vectored transfer on stdin/stdout/stderr, which stay on the host console */
+static int64_t posix_console_rw(int fd, const posix_iovec_t* iov, int iovcnt) {
+    int64_t done = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        size_t n;
+        if (fd == STDIN_FILENO) {
+            n = fread(iov[i].base, 1, iov[i].len, stdin);
+        } else {
+            n = fwrite(iov[i].base, 1, iov[i].len, fd == STDOUT_FILENO ? stdout : stderr);
+        }
+        done += n;
+        if (n < iov[i].len) {
+            break;
+        }
+    }
+    return done;
+}
+
+/* Shared body of read/readv/pread64/preadv2 (offset < 0 = file position) */
+static int64_t posix_do_readv(posix_context_t* ctx, int fd, const posix_iovec_t* iov,
+                              int iovcnt, int64_t offset) {
+    fd_entry_t* fde = posix_get_fd(ctx, fd);
+    if (!fde) {
+        return -EBADF;
+    }
+    if (!iov) {
+        return -EFAULT;
+    }
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+
+    ctx->io_stats.syscalls++;
+
+    vfs_file_t* file = (vfs_file_t*)fde->private_data;
+    if (!file) {
+        if (offset >= 0) {
+            return -ESPIPE;
+        }
+        return fd == STDIN_FILENO ? posix_console_rw(fd, iov, iovcnt) : -EBADF;
+    }
+
+    ctx->io_stats.kernel_calls++;
+    int64_t result = posix_io_result(vfs_preadv(file, iov, (uint32_t)iovcnt, offset));
+    if (result > 0) {
+        ctx->io_stats.bytes_read += result;
+    }
+    return result;
+}
+
+/* Shared body of write/writev/pwrite64/pwritev2 */
+static int64_t posix_do_writev(posix_context_t* ctx, int fd, const posix_iovec_t* iov,
+                               int iovcnt, int64_t offset, uint32_t vfs_flags) {
+    fd_entry_t* fde = posix_get_fd(ctx, fd);
+    if (!fde) {
+        return -EBADF;
+    }
+    if (!iov) {
+        return -EFAULT;
+    }
+    if (iovcnt < 0 || iovcnt > IOV_MAX) {
+        return -EINVAL;
+    }
+
+    ctx->io_stats.syscalls++;
+
+    vfs_file_t* file = (vfs_file_t*)fde->private_data;
+    if (!file) {
+        if (offset >= 0) {
+            return -ESPIPE;
+        }
+        return fd != STDIN_FILENO ? posix_console_rw(fd, iov, iovcnt) : -EBADF;
+    }
+
+    ctx->io_stats.kernel_calls++;
+    int64_t result = posix_io_result(vfs_pwritev(file, iov, (uint32_t)iovcnt, offset, vfs_flags));
+    if (result > 0) {
+        ctx->io_stats.bytes_written += result;
+    }
+    return result;
+}
+
+/* Translate RWF_* flags for the v2 calls */
+static int64_t posix_rwf_flags(int flags, bool write, uint32_t* out_vfs_flags) {
+    if (flags & ~(RWF_HIPRI | RWF_DSYNC | RWF_SYNC | RWF_NOWAIT | RWF_APPEND)) {
+        return -EOPNOTSUPP;
+    }
+    if (!write && (flags & (RWF_DSYNC | RWF_SYNC | RWF_APPEND))) {
+        return -EINVAL;
+    }
+
+    /* HIPRI and NOWAIT are satisfied trivially: VFS transfers never sleep on the caller's behalf */
+    *out_vfs_flags = 0;
+    if (flags & (RWF_DSYNC | RWF_SYNC)) {
+        *out_vfs_flags |= VFS_RW_SYNC;
+    }
+    if (flags & RWF_APPEND) {
+        *out_vfs_flags |= VFS_RW_APPEND;
+    }
+    return 0;
+}
+
 /* Syscall dispatcher */
 int64_t posix_syscall(posix_context_t* ctx, uint64_t syscall_num,
                       uint64_t arg1, uint64_t arg2, uint64_t arg3,
@@ -166,6 +299,43 @@ int64_t posix_syscall(posix_context_t* ctx, uint64_t syscall_num,
         case SYS_close:
             return posix_sys_close(ctx, (int)arg1);
 
+        case SYS_lseek:
+            return posix_sys_lseek(ctx, (int)arg1, (int64_t)arg2, (int)arg3);
+
+        case SYS_pread64:
+            return posix_sys_pread64(ctx, (int)arg1, (void*)arg2, (size_t)arg3, (int64_t)arg4);
+
+        case SYS_pwrite64:
+            return posix_sys_pwrite64(ctx, (int)arg1, (const void*)arg2, (size_t)arg3, (int64_t)arg4);
+
+        case SYS_readv:
+            return posix_sys_readv(ctx, (int)arg1, (const posix_iovec_t*)arg2, (int)arg3);
+
+        case SYS_writev:
+            return posix_sys_writev(ctx, (int)arg1, (const posix_iovec_t*)arg2, (int)arg3);
+
+        case SYS_preadv2:
+            /* arg4/arg5 are pos_l/pos_h; on x86_64 pos_l carries the whole offset */
+            return posix_sys_preadv2(ctx, (int)arg1, (const posix_iovec_t*)arg2, (int)arg3,
+                                     (int64_t)arg4, (int)arg6);
+
+        case SYS_pwritev2:
+            return posix_sys_pwritev2(ctx, (int)arg1, (const posix_iovec_t*)arg2, (int)arg3,
+                                      (int64_t)arg4, (int)arg6);
+
+        case SYS_fadvise64:
+            return posix_sys_fadvise64(ctx, (int)arg1, (int64_t)arg2, (int64_t)arg3, (int)arg4);
+
+        case SYS_fallocate:
+            return posix_sys_fallocate(ctx, (int)arg1, (int)arg2, (int64_t)arg3, (int64_t)arg4);
+
+        case SYS_sendfile:
+            return posix_sys_sendfile(ctx, (int)arg1, (int)arg2, (int64_t*)arg3, (size_t)arg4);
+
+        case SYS_copy_file_range:
+            return posix_sys_copy_file_range(ctx, (int)arg1, (int64_t*)arg2, (int)arg3,
+                                             (int64_t*)arg4, (size_t)arg5, (unsigned int)arg6);
+
         case SYS_getpid:
             return posix_sys_getpid(ctx);
 
@@ -198,50 +368,29 @@ int64_t posix_syscall(posix_context_t* ctx, uint64_t syscall_num,
             return 0;
 
         default:
-            printf("[POSIX] Unimplemented syscall: %llu\n", syscall_num);
+            printf("[POSIX] Unimplemented syscall: %llu\n", (unsigned long long)syscall_num);
             return -ENOSYS;
     }
 }
 
 /* Syscall: read */
 int64_t posix_sys_read(posix_context_t* ctx, int fd, void* buf, size_t count) {
-    fd_entry_t* fde = posix_get_fd(ctx, fd);
-    if (!fde) {
-        return -EBADF;
-    }
-
     if (!buf) {
         return -EFAULT;
     }
 
-    /* TODO: Implement actual file I/O via VFS */
-    if (fd == STDIN_FILENO) {
-        /* Read from stdin */
-        return fread(buf, 1, count, stdin);
-    }
-
-    return -ENOSYS;
+    posix_iovec_t iov = { buf, count };
+    return posix_do_readv(ctx, fd, &iov, 1, -1);
 }
 
 /* Syscall: write */
 int64_t posix_sys_write(posix_context_t* ctx, int fd, const void* buf, size_t count) {
-    fd_entry_t* fde = posix_get_fd(ctx, fd);
-    if (!fde) {
-        return -EBADF;
-    }
-
     if (!buf) {
         return -EFAULT;
     }
 
-    /* TODO: Implement actual file I/O via VFS */
-    if (fd == STDOUT_FILENO) {
-        return fwrite(buf, 1, count, stdout);
-    } else if (fd == STDERR_FILENO) {
-        return fwrite(buf, 1, count, stderr);
-    }
-
-    return -ENOSYS;
+    posix_iovec_t iov = { (void*)buf, count };
+    return posix_do_writev(ctx, fd, &iov, 1, -1, 0);
 }
 
 /* Syscall: open */
@@ -250,14 +399,36 @@ int64_t posix_sys_open(posix_context_t* ctx, const char* path, int flags, int mo
         return -EFAULT;
     }
 
+    /* Resolve relative paths against the working directory */
+    char full_path[VFS_MAX_PATH];
+    if (path[0] == '/') {
+        snprintf(full_path, sizeof(full_path), "%s", path);
+    } else if (snprintf(full_path, sizeof(full_path), "%s/%s",
+                        strcmp(ctx->cwd, "/") == 0 ? "" : ctx->cwd, path) >= (int)sizeof(full_path)) {
+        return -EINVAL;
+    }
+
     int fd = posix_alloc_fd(ctx);
     if (fd < 0) {
         return fd;
     }
 
-    /* TODO: Open file via VFS */
-    printf("[POSIX] open(%s, %d, %d) -> fd %d (stub)\n", path, flags, mode, fd);
+    /* Linux O_* values match VFS_O_* bit for bit */
+    uint32_t vfs_flags = (uint32_t)flags & (VFS_O_WRONLY | VFS_O_RDWR | VFS_O_CREAT | VFS_O_EXCL |
+                                            VFS_O_TRUNC | VFS_O_APPEND | VFS_O_NONBLOCK |
+                                            VFS_O_DIRECTORY);
 
+    vfs_file_t* file = NULL;
+    ctx->io_stats.syscalls++;
+    ctx->io_stats.kernel_calls++;
+    status_t status = vfs_open(full_path, vfs_flags, (uint32_t)mode & 07777, &file);
+    if (FAILED(status)) {
+        posix_free_fd(ctx, fd);
+        return posix_status_errno(status);
+    }
+
+    ctx->fds[fd].flags = vfs_flags;
+    ctx->fds[fd].private_data = file;
     return fd;
 }
 
@@ -269,6 +440,10 @@ int64_t posix_sys_close(posix_context_t* ctx, int fd) {
             return -EBADF;
         }
 
+        if (fde->private_data) {
+            ctx->io_stats.syscalls++;
+            ctx->io_stats.kernel_calls++;
+        }
         posix_free_fd(ctx, fd);
         return 0;
     }
@@ -276,6 +451,187 @@ int64_t posix_sys_close(posix_context_t* ctx, int fd) {
     return -EINVAL;
 }
 
+/* Syscall: lseek */
+int64_t posix_sys_lseek(posix_context_t* ctx, int fd, int64_t offset, int whence) {
+    if (!posix_get_fd(ctx, fd)) {
+        return -EBADF;
+    }
+
+    vfs_file_t* file = posix_get_file(ctx, fd);
+    if (!file) {
+        return -ESPIPE;
+    }
+
+    uint64_t new_offset = 0;
+    ctx->io_stats.syscalls++;
+    ctx->io_stats.kernel_calls++;
+    status_t status = vfs_seek(file, offset, whence, &new_offset);
+    if (FAILED(status)) {
+        return posix_status_errno(status);
+    }
+    return (int64_t)new_offset;
+}
+
+/* Syscall: pread64 */
+int64_t posix_sys_pread64(posix_context_t* ctx, int fd, void* buf, size_t count, int64_t offset) {
+    if (!buf) {
+        return -EFAULT;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    posix_iovec_t iov = { buf, count };
+    return posix_do_readv(ctx, fd, &iov, 1, offset);
+}
+
+/* Syscall: pwrite64 */
+int64_t posix_sys_pwrite64(posix_context_t* ctx, int fd, const void* buf, size_t count, int64_t offset) {
+    if (!buf) {
+        return -EFAULT;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    posix_iovec_t iov = { (void*)buf, count };
+    return posix_do_writev(ctx, fd, &iov, 1, offset, 0);
+}
+
+/* Syscall: readv */
+int64_t posix_sys_readv(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt) {
+    return posix_do_readv(ctx, fd, iov, iovcnt, -1);
+}
+
+/* Syscall: writev */
+int64_t posix_sys_writev(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt) {
+    return posix_do_writev(ctx, fd, iov, iovcnt, -1, 0);
+}
+
+/* Syscall: preadv2 (offset -1 = current position) */
+int64_t posix_sys_preadv2(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt,
+                          int64_t offset, int flags) {
+    uint32_t vfs_flags;
+    int64_t err = posix_rwf_flags(flags, false, &vfs_flags);
+    if (err < 0) {
+        return err;
+    }
+    if (offset < -1) {
+        return -EINVAL;
+    }
+
+    return posix_do_readv(ctx, fd, iov, iovcnt, offset);
+}
+
+/* Syscall: pwritev2 (offset -1 = current position) */
+int64_t posix_sys_pwritev2(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt,
+                           int64_t offset, int flags) {
+    uint32_t vfs_flags;
+    int64_t err = posix_rwf_flags(flags, true, &vfs_flags);
+    if (err < 0) {
+        return err;
+    }
+    if (offset < -1) {
+        return -EINVAL;
+    }
+
+    return posix_do_writev(ctx, fd, iov, iovcnt, offset, vfs_flags);
+}
+
+/* Syscall: fadvise64 */
+int64_t posix_sys_fadvise64(posix_context_t* ctx, int fd, int64_t offset, int64_t len, int advice) {
+    if (!posix_get_fd(ctx, fd)) {
+        return -EBADF;
+    }
+
+    vfs_file_t* file = posix_get_file(ctx, fd);
+    if (!file) {
+        return -ESPIPE;
+    }
+    if (offset < 0 || len < 0 || advice < VFS_ADV_NORMAL || advice > VFS_ADV_NOREUSE) {
+        return -EINVAL;
+    }
+
+    ctx->io_stats.syscalls++;
+    ctx->io_stats.kernel_calls++;
+    return posix_status_errno(vfs_fadvise(file, (uint64_t)offset, (uint64_t)len, (uint32_t)advice));
+}
+
+/* Syscall: fallocate */
+int64_t posix_sys_fallocate(posix_context_t* ctx, int fd, int mode, int64_t offset, int64_t len) {
+    if (!posix_get_fd(ctx, fd)) {
+        return -EBADF;
+    }
+
+    vfs_file_t* file = posix_get_file(ctx, fd);
+    if (!file) {
+        return -ESPIPE;
+    }
+    if (mode & ~FALLOC_FL_KEEP_SIZE) {
+        return -EOPNOTSUPP;
+    }
+    if (offset < 0 || len <= 0) {
+        return -EINVAL;
+    }
+
+    ctx->io_stats.syscalls++;
+    ctx->io_stats.kernel_calls++;
+    status_t status = vfs_fallocate(file, (mode & FALLOC_FL_KEEP_SIZE) ? VFS_ALLOC_KEEP_SIZE : 0,
+                                    (uint64_t)offset, (uint64_t)len);
+    if (status == STATUS_NOMEM) {
+        return -ENOSPC;
+    }
+    return posix_status_errno(status);
+}
+
+/* Shared body of sendfile/copy_file_range: one in-kernel copy, no user bounce */
+static int64_t posix_do_copy(posix_context_t* ctx, int fd_in, int64_t* off_in,
+                             int fd_out, int64_t* off_out, size_t len) {
+    if (!posix_get_fd(ctx, fd_in) || !posix_get_fd(ctx, fd_out)) {
+        return -EBADF;
+    }
+
+    vfs_file_t* in = posix_get_file(ctx, fd_in);
+    vfs_file_t* out = posix_get_file(ctx, fd_out);
+    if (!in || !out) {
+        return -EINVAL;
+    }
+    if ((off_in && *off_in < 0) || (off_out && *off_out < 0)) {
+        return -EINVAL;
+    }
+
+    ctx->io_stats.syscalls++;
+    ctx->io_stats.kernel_calls++;
+    ssize_t copied = vfs_copy_range(in, off_in ? *off_in : -1, out, off_out ? *off_out : -1, len);
+    if (copied < 0) {
+        return posix_status_errno((status_t)copied);
+    }
+
+    if (off_in) {
+        *off_in += copied;
+    }
+    if (off_out) {
+        *off_out += copied;
+    }
+    ctx->io_stats.bytes_read += copied;
+    ctx->io_stats.bytes_written += copied;
+    return copied;
+}
+
+/* Syscall: sendfile (out_fd position always advances) */
+int64_t posix_sys_sendfile(posix_context_t* ctx, int out_fd, int in_fd, int64_t* offset, size_t count) {
+    return posix_do_copy(ctx, in_fd, offset, out_fd, NULL, count);
+}
+
+/* Syscall: copy_file_range */
+int64_t posix_sys_copy_file_range(posix_context_t* ctx, int fd_in, int64_t* off_in,
+                                  int fd_out, int64_t* off_out, size_t len, unsigned int flags) {
+    if (flags != 0) {
+        return -EINVAL;
+    }
+    return posix_do_copy(ctx, fd_in, off_in, fd_out, off_out, len);
+}
+
 /* Syscall: getpid */
 int64_t posix_sys_getpid(posix_context_t* ctx) {
     return ctx->pid;
@@ -310,7 +666,7 @@ int64_t posix_sys_brk(posix_context_t* ctx, uint64_t addr) {
 
 /* Syscall: exit */
 int64_t posix_sys_exit(posix_context_t* ctx, int status) {
-    printf("[POSIX] Process %llu exited with status %d\n", ctx->pid, status);
+    printf("[POSIX] Process %llu exited with status %d\n", (unsigned long long)ctx->pid, status);
 
     /* TODO: Terminate process via kernel */
     exit(status);
@@ -369,7 +725,7 @@ status_t posix_exec(posix_context_t* ctx, const char* path, char* const argv[],
         return status;
     }
 
-    printf("[POSIX] Would execute %s at 0x%llx\n", path, elf_info.entry_point);
+    printf("[POSIX] Would execute %s at 0x%llx\n", path, (unsigned long long)elf_info.entry_point);
 
     /* TODO: Setup stack, load ELF, jump to entry point */
 
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include "vfs.h"
 
 /* POSIX syscall numbers (x86_64 Linux ABI) */
 #define SYS_read           0
@@ -27,6 +28,10 @@
 #define SYS_rt_sigaction  13
 #define SYS_rt_sigprocmask 14
 #define SYS_ioctl         16
+#define SYS_pread64       17
+#define SYS_pwrite64      18
+#define SYS_readv         19
+#define SYS_writev        20
 #define SYS_access        21
 #define SYS_pipe          22
 #define SYS_select        23
@@ -34,6 +39,7 @@
 #define SYS_dup           32
 #define SYS_dup2          33
 #define SYS_getpid        39
+#define SYS_sendfile      40
 #define SYS_fork          57
 #define SYS_execve        59
 #define SYS_exit          60
@@ -45,6 +51,11 @@
 #define SYS_setgid        106
 #define SYS_geteuid       107
 #define SYS_getegid       108
+#define SYS_fadvise64     221
+#define SYS_fallocate     285
+#define SYS_copy_file_range 326
+#define SYS_preadv2       327
+#define SYS_pwritev2      328
 #define SYS_socket        41
 #define SYS_connect       42
 #define SYS_accept        43
@@ -60,6 +71,22 @@
 #define SYS_rmdir         84
 #define SYS_unlink        87
 
+/* preadv2/pwritev2 flags */
+#define RWF_HIPRI   0x01
+#define RWF_DSYNC   0x02
+#define RWF_SYNC    0x04
+#define RWF_NOWAIT  0x08
+#define RWF_APPEND  0x10
+
+/* fallocate modes */
+#define FALLOC_FL_KEEP_SIZE 0x01
+
+/* Maximum iovec count per readv/writev */
+#define IOV_MAX VFS_IOV_MAX
+
+/* struct iovec; shares layout with vfs_iovec_t so vectors pass through unchanged */
+typedef vfs_iovec_t posix_iovec_t;
+
 /* File descriptor table */
 #define MAX_FDS 1024
 
@@ -70,6 +97,17 @@ typedef struct fd_entry {
     void* private_data;
 } fd_entry_t;
 
+/*
+ * File I/O counters. Each file syscall should cost exactly one kernel call,
+ * however many iovecs it carries; kernel_calls / syscalls shows that.
+ */
+typedef struct posix_io_stats {
+    uint64_t syscalls;
+    uint64_t kernel_calls;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} posix_io_stats_t;
+
 /* Process context for POSIX persona */
 typedef struct posix_context {
     uint64_t pid;
@@ -96,6 +134,9 @@ typedef struct posix_context {
     /* Memory */
     uint64_t brk_start;
     uint64_t brk_current;
+
+    /* File I/O accounting */
+    posix_io_stats_t io_stats;
 } posix_context_t;
 
 /* ELF loader */
@@ -124,6 +165,20 @@ int64_t posix_sys_read(posix_context_t* ctx, int fd, void* buf, size_t count);
 int64_t posix_sys_write(posix_context_t* ctx, int fd, const void* buf, size_t count);
 int64_t posix_sys_open(posix_context_t* ctx, const char* path, int flags, int mode);
 int64_t posix_sys_close(posix_context_t* ctx, int fd);
+int64_t posix_sys_lseek(posix_context_t* ctx, int fd, int64_t offset, int whence);
+int64_t posix_sys_pread64(posix_context_t* ctx, int fd, void* buf, size_t count, int64_t offset);
+int64_t posix_sys_pwrite64(posix_context_t* ctx, int fd, const void* buf, size_t count, int64_t offset);
+int64_t posix_sys_readv(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt);
+int64_t posix_sys_writev(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt);
+int64_t posix_sys_preadv2(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt,
+                          int64_t offset, int flags);
+int64_t posix_sys_pwritev2(posix_context_t* ctx, int fd, const posix_iovec_t* iov, int iovcnt,
+                           int64_t offset, int flags);
+int64_t posix_sys_fadvise64(posix_context_t* ctx, int fd, int64_t offset, int64_t len, int advice);
+int64_t posix_sys_fallocate(posix_context_t* ctx, int fd, int mode, int64_t offset, int64_t len);
+int64_t posix_sys_sendfile(posix_context_t* ctx, int out_fd, int in_fd, int64_t* offset, size_t count);
+int64_t posix_sys_copy_file_range(posix_context_t* ctx, int fd_in, int64_t* off_in,
+                                  int fd_out, int64_t* off_out, size_t len, unsigned int flags);
 int64_t posix_sys_fork(posix_context_t* ctx);
 int64_t posix_sys_execve(posix_context_t* ctx, const char* path, char* const argv[], char* const envp[]);
 int64_t posix_sys_exit(posix_context_t* ctx, int status);
@@ -167,6 +222,9 @@ fd_entry_t* posix_get_fd(posix_context_t* ctx, int fd);
 #define EINVAL  22
 #define ENFILE  23
 #define EMFILE  24
+#define ENOSPC  28
+#define ESPIPE  29
 #define ENOSYS  38
+#define EOPNOTSUPP 95
 
 #endif /* LIMITLESS_POSIX_PERSONA_H */
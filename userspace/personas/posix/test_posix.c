@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <string.h>
 #include "posix.h"
+#include "page_cache.h"
+
+extern status_t host_kernel_init(void);
 
 void test_basic_syscalls(void) {
     printf("\n=== Testing Basic Syscalls ===\n");
@@ -19,19 +22,19 @@ void test_basic_syscalls(void) {
 
     /* Test getpid */
     int64_t pid = posix_syscall(ctx, SYS_getpid, 0, 0, 0, 0, 0, 0);
-    printf("getpid() = %lld\n", pid);
+    printf("getpid() = %lld\n", (long long)pid);
 
     /* Test getuid */
     int64_t uid = posix_syscall(ctx, SYS_getuid, 0, 0, 0, 0, 0, 0);
-    printf("getuid() = %lld\n", uid);
+    printf("getuid() = %lld\n", (long long)uid);
 
     /* Test getgid */
     int64_t gid = posix_syscall(ctx, SYS_getgid, 0, 0, 0, 0, 0, 0);
-    printf("getgid() = %lld\n", gid);
+    printf("getgid() = %lld\n", (long long)gid);
 
     /* Test brk */
     int64_t brk = posix_syscall(ctx, SYS_brk, 0, 0, 0, 0, 0, 0);
-    printf("brk(0) = 0x%llx\n", brk);
+    printf("brk(0) = 0x%llx\n", (unsigned long long)brk);
 
     posix_destroy_context(ctx);
 }
@@ -45,21 +48,210 @@ void test_file_io(void) {
     /* Test write to stdout */
     const char* msg = "Hello from POSIX persona!\n";
     int64_t written = posix_syscall(ctx, SYS_write, STDOUT_FILENO, (uint64_t)msg, strlen(msg), 0, 0, 0);
-    printf("write() returned %lld\n", written);
+    printf("write() returned %lld\n", (long long)written);
 
     /* Test open */
-    int64_t fd = posix_syscall(ctx, SYS_open, (uint64_t)"/tmp/test.txt", 0x42, 0644, 0, 0, 0);  // O_RDWR | O_CREAT
-    printf("open() returned fd %lld\n", fd);
+    int64_t fd = posix_syscall(ctx, SYS_open, (uint64_t)"/test.txt", 0x42, 0644, 0, 0, 0);  // O_RDWR | O_CREAT
+    printf("open() returned fd %lld\n", (long long)fd);
 
     if (fd >= 0) {
+        /* Round trip through the VFS */
+        written = posix_syscall(ctx, SYS_write, fd, (uint64_t)msg, strlen(msg), 0, 0, 0);
+        printf("write(file) returned %lld (expected %zu)\n", (long long)written, strlen(msg));
+
+        char buf[64] = {0};
+        int64_t got = posix_syscall(ctx, SYS_pread64, fd, (uint64_t)buf, sizeof(buf) - 1, 0, 0, 0);
+        printf("pread64() returned %lld: %s", (long long)got, buf);
+
+        int64_t pos = posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_CUR, 0, 0, 0);
+        printf("lseek(CUR) = %lld (pread must not move it)\n", (long long)pos);
+
         /* Test close */
         int64_t result = posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
-        printf("close() returned %lld\n", result);
+        printf("close() returned %lld\n", (long long)result);
     }
 
+    /* Missing file without O_CREAT */
+    fd = posix_syscall(ctx, SYS_open, (uint64_t)"/missing.txt", 0, 0, 0, 0, 0);
+    printf("open(missing) returned %lld (expected -ENOENT = -2)\n", (long long)fd);
+
+    posix_destroy_context(ctx);
+}
+
+void test_vectored_io(void) {
+    printf("\n=== Testing Vectored and Positional I/O ===\n");
+
+    posix_context_t* ctx = NULL;
+    posix_create_context(&ctx);
+
+    int64_t fd = posix_syscall(ctx, SYS_open, (uint64_t)"/vec.dat", 0x242, 0644, 0, 0, 0);  // O_RDWR | O_CREAT | O_TRUNC
+
+    /* writev of three segments is a single kernel call */
+    posix_iovec_t out[3] = {
+        { "alpha-", 6 }, { "beta-", 5 }, { "gamma", 5 },
+    };
+    uint64_t calls_before = ctx->io_stats.kernel_calls;
+    int64_t result = posix_syscall(ctx, SYS_writev, fd, (uint64_t)out, 3, 0, 0, 0);
+    printf("writev(3 iovecs) returned %lld, kernel calls %llu (expected 16, 1)\n",
+           (long long)result, (unsigned long long)ctx->io_stats.kernel_calls - calls_before);
+
+    /* preadv2 at offset 6 scatters into two buffers */
+    char a[5] = {0}, b[6] = {0};
+    posix_iovec_t in[2] = { { a, 4 }, { b, 5 } };
+    result = posix_syscall(ctx, SYS_preadv2, fd, (uint64_t)in, 2, 6, 0, 0);
+    printf("preadv2(@6) returned %lld: '%s' '%s' (expected 'beta' '-gamm')\n", (long long)result, a, b);
+
+    /* pwritev2 with RWF_APPEND ignores the offset */
+    posix_iovec_t tail = { "!", 1 };
+    result = posix_syscall(ctx, SYS_pwritev2, fd, (uint64_t)&tail, 1, 0, 0, RWF_APPEND);
+    int64_t end = posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_END, 0, 0, 0);
+    printf("pwritev2(APPEND) returned %lld, size now %lld (expected 17)\n",
+           (long long)result, (long long)end);
+
+    result = posix_syscall(ctx, SYS_pwritev2, fd, (uint64_t)&tail, 1, 0, 0, 0x100);
+    printf("pwritev2(bad flag) returned %lld (expected -EOPNOTSUPP = -95)\n", (long long)result);
+
+    /* fallocate extends with zeroes; KEEP_SIZE does not */
+    result = posix_syscall(ctx, SYS_fallocate, fd, 0, 0, 4096, 0, 0);
+    end = posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_END, 0, 0, 0);
+    printf("fallocate(0, 4096) returned %lld, size now %lld\n", (long long)result, (long long)end);
+    result = posix_syscall(ctx, SYS_fallocate, fd, FALLOC_FL_KEEP_SIZE, 0, 65536, 0, 0);
+    end = posix_syscall(ctx, SYS_lseek, fd, 0, VFS_SEEK_END, 0, 0, 0);
+    printf("fallocate(KEEP_SIZE, 64K) returned %lld, size still %lld\n", (long long)result, (long long)end);
+
+    result = posix_syscall(ctx, SYS_fadvise64, fd, 0, 0, VFS_ADV_SEQUENTIAL, 0, 0);
+    printf("fadvise64(SEQUENTIAL) returned %lld\n", (long long)result);
+
+    /* copy_file_range and sendfile stay inside the kernel */
+    int64_t dst = posix_syscall(ctx, SYS_open, (uint64_t)"/copy.dat", 0x242, 0644, 0, 0, 0);
+    int64_t off_in = 6;
+    result = posix_syscall(ctx, SYS_copy_file_range, fd, (uint64_t)&off_in, dst, 0, 10, 0);
+    printf("copy_file_range(@6, 10) returned %lld, off_in now %lld\n", (long long)result, (long long)off_in);
+
+    int64_t off = 0;
+    result = posix_syscall(ctx, SYS_sendfile, dst, fd, (uint64_t)&off, 6, 0, 0);
+    char copy[32] = {0};
+    posix_syscall(ctx, SYS_pread64, dst, (uint64_t)copy, sizeof(copy) - 1, 0, 0, 0);
+    printf("sendfile(6) returned %lld, copy.dat = '%s' (expected 'beta-gammaalpha-')\n",
+           (long long)result, copy);
+
+    result = posix_syscall(ctx, SYS_sendfile, STDOUT_FILENO, fd, 0, 6, 0, 0);
+    printf("sendfile(to console) returned %lld (expected -EINVAL = -22)\n", (long long)result);
+
+    posix_syscall(ctx, SYS_close, dst, 0, 0, 0, 0, 0);
+    posix_syscall(ctx, SYS_close, fd, 0, 0, 0, 0, 0);
+
+    printf("io_stats: %llu syscalls, %llu kernel calls\n",
+           (unsigned long long)ctx->io_stats.syscalls, (unsigned long long)ctx->io_stats.kernel_calls);
+
     posix_destroy_context(ctx);
 }
 
+/* A device-backed file whose bytes are the low byte of their page number */
+#define RA_TEST_SIZE (64 * 4096 + 100)
+
+static ssize_t ra_test_read(vfs_node_t* node, void* buffer, size_t size, uint64_t offset) {
+    if (offset >= node->size) {
+        return 0;
+    }
+    size = offset + size > node->size ? node->size - offset : size;
+    for (size_t i = 0; i < size; i++) {
+        ((uint8_t*)buffer)[i] = (uint8_t)((offset + i) / 4096);
+    }
+    return (ssize_t)size;
+}
+
+static ssize_t ra_test_readv(vfs_node_t* node, const vfs_iovec_t* iov, uint32_t iovcnt,
+                             uint64_t offset) {
+    ssize_t done = 0;
+    for (uint32_t i = 0; i < iovcnt; i++) {
+        ssize_t n = ra_test_read(node, iov[i].base, iov[i].len, offset + done);
+        done += n;
+        if ((size_t)n < iov[i].len) {
+            break;
+        }
+    }
+    return done;
+}
+
+static vfs_file_ops_t ra_test_ops = { .read = ra_test_read, .readv = ra_test_readv };
+static vfs_mount_t ra_test_mount;
+
+/* Read pages at first + i * stride; returns pages whose data was wrong */
+static int ra_test_pass(vfs_file_t* file, int64_t first, int64_t stride, int count) {
+    uint8_t page[4096];
+    int bad = 0;
+    for (int i = 0; i < count; i++) {
+        int64_t index = first + i * stride;
+        ssize_t n = vfs_pread(file, page, sizeof(page), index * 4096);
+        if (n != (ssize_t)sizeof(page) || page[0] != (uint8_t)index || page[4095] != (uint8_t)index) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+void test_readahead(void) {
+    printf("\n=== Testing Read-Ahead ===\n");
+
+    vfs_node_t* node = vfs_node_alloc();
+    node->size = RA_TEST_SIZE;
+    node->file_ops = &ra_test_ops;
+    node->mount = &ra_test_mount;
+
+    static const struct { const char* name; int64_t first, stride; int count; } passes[] = {
+        { "sequential", 0, 1, 32 },
+        { "strided", 1, 5, 12 },
+        { "strided", 0, 2, 24 },
+        { "reverse", 63, -1, 32 },
+    };
+    for (size_t p = 0; p < sizeof(passes) / sizeof(passes[0]); p++) {
+        vfs_file_t file = { .node = node, .ref_count = 1 };
+        ra_init(&file.ra);
+        page_cache_drop(node, 0, 0);
+
+        int bad = ra_test_pass(&file, passes[p].first, passes[p].stride, passes[p].count);
+        printf("%-10s: pattern %s, %llu read ahead, %llu used, %d bad pages (expected %s, 0)\n",
+               passes[p].name, ra_pattern_name((ra_pattern_t)file.ra.pattern),
+               (unsigned long long)file.ra.stats.prefetched,
+               (unsigned long long)file.ra.stats.used, bad, passes[p].name);
+
+        /* Once released, every page read ahead was either used or wasted */
+        ra_release(&file.ra);
+        ra_stats_t* st = &file.ra.stats;
+        printf("%-10s: %llu used + %llu wasted of %llu read ahead (expected all accounted)\n",
+               passes[p].name, (unsigned long long)st->used, (unsigned long long)st->wasted,
+               (unsigned long long)st->prefetched);
+    }
+
+    /* The same eight pages three times over: a loop after the first pass */
+    vfs_file_t file = { .node = node, .ref_count = 1 };
+    ra_init(&file.ra);
+    page_cache_drop(node, 0, 0);
+    int bad = 0;
+    for (int pass = 0; pass < 3; pass++) {
+        bad += ra_test_pass(&file, 8, 1, 8);
+    }
+    printf("loop      : pattern %s, %d bad pages (expected loop, 0)\n",
+           ra_pattern_name((ra_pattern_t)file.ra.pattern), bad);
+
+    /* A read across EOF stops at the last byte */
+    uint8_t tail[8192];
+    ssize_t n = vfs_pread(&file, tail, sizeof(tail), 63 * 4096);
+    printf("read across EOF returned %lld, last byte %u (expected 4196, 64)\n",
+           (long long)n, n > 0 ? tail[n - 1] : 0);
+
+    ra_advise(&file.ra, RA_ADVICE_RANDOM);
+    uint64_t before = file.ra.stats.prefetched;
+    page_cache_drop(node, 0, 0);
+    bad = ra_test_pass(&file, 0, 1, 16);
+    printf("RANDOM advice: %llu read ahead, %d bad pages (expected 0, 0)\n",
+           (unsigned long long)(file.ra.stats.prefetched - before), bad);
+
+    page_cache_drop(node, 0, 0);
+    vfs_node_unref(node);
+}
+
 void test_unsupported_syscalls(void) {
     printf("\n=== Testing Unsupported Syscalls ===\n");
 
@@ -68,11 +260,11 @@ void test_unsupported_syscalls(void) {
 
     /* Test fork */
     int64_t result = posix_syscall(ctx, SYS_fork, 0, 0, 0, 0, 0, 0);
-    printf("fork() returned %lld (expected -ENOSYS = -38)\n", result);
+    printf("fork() returned %lld (expected -ENOSYS = -38)\n", (long long)result);
 
     /* Test execve */
     result = posix_syscall(ctx, SYS_execve, (uint64_t)"/bin/sh", 0, 0, 0, 0, 0);
-    printf("execve() returned %lld (expected -ENOSYS = -38)\n", result);
+    printf("execve() returned %lld (expected -ENOSYS = -38)\n", (long long)result);
 
     posix_destroy_context(ctx);
 }
@@ -83,8 +275,15 @@ int main(int argc, char** argv) {
     printf("POSIX Persona Test Suite\n");
     printf("========================================\n");
 
+    /* Bring up the VFS the persona sits on */
+    status_t status = host_kernel_init();
+    if (FAILED(status)) {
+        printf("ERROR: Failed to mount root filesystem\n");
+        return 1;
+    }
+
     /* Initialize persona */
-    status_t status = posix_init();
+    status = posix_init();
     if (FAILED(status)) {
         printf("ERROR: Failed to initialize POSIX persona\n");
         return 1;
@@ -93,6 +292,8 @@ int main(int argc, char** argv) {
     /* Run tests */
     test_basic_syscalls();
     test_file_io();
+    test_vectored_io();
+    test_readahead();
     test_unsupported_syscalls();
 
     printf("\n========================================\n");
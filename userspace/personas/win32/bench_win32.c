@@ -0,0 +1,85 @@
+/*
+ * Win32 Persona Benchmark
+ * Hosted driver for the persona's built-in benchmarks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "win32_persona.h"
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s OPTION\n", prog);
+    printf("  --bench-handles [OPEN [ITERATIONS [PATH]]]  Handle table churn, CreateFileA on PATH\n");
+    printf("  --bench-heap [THREADS [ITERATIONS]]         Process and private heaps against libc\n");
+    printf("  --bench-loader DIR [DLLS [ITERATIONS]]      Load an EXE importing from DLLS generated DLLs\n");
+}
+
+static uint32_t arg_u32(int argc, char** argv, int index, uint32_t fallback) {
+    return argc > index ? (uint32_t)strtoul(argv[index], NULL, 10) : fallback;
+}
+
+static int run_handle_bench(uint32_t open_handles, uint32_t iterations, const char* path) {
+    win32_handle_bench_result_t r;
+    if (win32_handle_benchmark(path, open_handles, iterations, &r) < 0) {
+        fprintf(stderr, "ERROR: Handle benchmark failed\n");
+        return 1;
+    }
+
+    printf("Handles:   %u open, %u churned, %u slots\n", open_handles, iterations, r.capacity);
+    printf("Table:     %llu ns alloc+close, %llu ns lookup\n",
+           (unsigned long long)r.alloc_free_ns, (unsigned long long)r.lookup_ns);
+    printf("Stale:     %llu closed handles rejected after reuse\n", (unsigned long long)r.stale_rejected);
+    if (path) {
+        printf("Files:     %llu ns CreateFileA+CloseHandle on %s\n",
+               (unsigned long long)r.create_close_ns, path);
+    }
+    return 0;
+}
+
+static int run_heap_bench(uint32_t threads, uint32_t iterations) {
+    win32_heap_bench_result_t r;
+    if (win32_heap_benchmark(threads, iterations, &r) < 0) {
+        fprintf(stderr, "ERROR: Heap benchmark failed\n");
+        return 1;
+    }
+
+    printf("Heap:      %llu ns alloc+free, libc %llu ns\n",
+           (unsigned long long)r.heap_ns, (unsigned long long)r.libc_ns);
+    printf("Threads:   %u, %llu ns per pair, libc %llu ns\n", threads,
+           (unsigned long long)r.heap_mt_ns, (unsigned long long)r.libc_mt_ns);
+    printf("Private:   %llu ns alloc+free with HEAP_NO_SERIALIZE\n", (unsigned long long)r.private_ns);
+    printf("Destroy:   %llu ns with the working set allocated\n", (unsigned long long)r.destroy_ns);
+    return 0;
+}
+
+static int run_loader_bench(const char* dir, uint32_t dll_count, uint32_t iterations) {
+    win32_loader_bench_result_t r;
+    if (win32_loader_benchmark(dir, dll_count, iterations, &r) < 0) {
+        fprintf(stderr, "ERROR: Loader benchmark failed\n");
+        return 1;
+    }
+
+    printf("Imports:   %u DLLs, %llu bound per start\n", dll_count, (unsigned long long)r.imports_per_start);
+    printf("Start:     %.1f us cold, %.1f us warm, %.1f us unload\n", (double)r.cold_start_ns / 1e3,
+           (double)r.warm_start_ns / 1e3, (double)r.unload_ns / 1e3);
+    printf("Exports:   %llu ns GetProcAddress, %llu ns binary search\n",
+           (unsigned long long)r.proc_hash_ns, (unsigned long long)r.proc_bsearch_ns);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-handles") == 0) {
+        return run_handle_bench(arg_u32(argc, argv, 2, 4096), arg_u32(argc, argv, 3, 1000000),
+                                argc > 4 ? argv[4] : NULL);
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-heap") == 0) {
+        return run_heap_bench(arg_u32(argc, argv, 2, 4), arg_u32(argc, argv, 3, 1000000));
+    }
+    if (argc > 2 && strcmp(argv[1], "--bench-loader") == 0) {
+        return run_loader_bench(argv[2], arg_u32(argc, argv, 3, 16), arg_u32(argc, argv, 4, 200));
+    }
+
+    print_usage(argv[0]);
+    return argc > 1 ? 1 : 0;
+}
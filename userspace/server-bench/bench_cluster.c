@@ -0,0 +1,164 @@
+/*
+ * Server Edition Cluster Benchmark
+ * Runs N gossip nodes as separate processes on loopback ports and reports
+ * how long membership takes to converge and what it costs in bandwidth
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "server_edition.h"
+
+#define BENCH_BASE_PORT   47000
+#define BENCH_MAX_NODES   128
+#define BENCH_POLL_US     10000
+
+/* What each node reports back through its pipe */
+typedef struct node_report {
+    uint64_t converged_us;       /* From the common start until every peer is alive; 0: never */
+    uint64_t elapsed_us;         /* From the node's join to the end of the run */
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t packets_sent;
+    uint32_t members_alive;
+    bool leader;
+} node_report_t;
+
+static void print_usage(const char* prog) {
+    printf("Usage: %s OPTION\n", prog);
+    printf("  --bench-cluster [NODES [SECONDS]]  Gossip convergence and bandwidth on loopback\n");
+}
+
+static uint32_t arg_u32(int argc, char** argv, int index, uint32_t fallback) {
+    return argc > index ? (uint32_t)strtoul(argv[index], NULL, 10) : fallback;
+}
+
+/* Same clock as the cluster's own timestamps */
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* One node: join through node 0, watch the membership, report at the end */
+static int run_node(uint32_t index, uint32_t nodes, uint64_t start_us, uint64_t end_us, int fd) {
+    char seed[32];
+    snprintf(seed, sizeof(seed), "127.0.0.1:%u", BENCH_BASE_PORT);
+
+    /* Quiet the per-node start-up line */
+    if (!freopen("/dev/null", "w", stderr)) {
+        return 1;
+    }
+    if (server_cluster_start("bench", index ? seed : NULL, (uint16_t)(BENCH_BASE_PORT + index)) < 0) {
+        return 1;
+    }
+
+    node_report_t report;
+    memset(&report, 0, sizeof(report));
+    cluster_stats_t stats;
+    while (now_us() < end_us) {
+        usleep(BENCH_POLL_US);
+        server_get_cluster_stats(&stats);
+        if (!report.converged_us && stats.members_alive == nodes - 1) {
+            report.converged_us = now_us() - start_us;
+        }
+    }
+
+    server_get_cluster_stats(&stats);
+    report.elapsed_us = now_us() - stats.join_time_us;
+    report.bytes_sent = stats.bytes_sent;
+    report.bytes_received = stats.bytes_received;
+    report.packets_sent = stats.packets_sent;
+    report.members_alive = stats.members_alive;
+    report.leader = server_is_cluster_leader();
+    server_cluster_stop();
+
+    return write(fd, &report, sizeof(report)) == sizeof(report) ? 0 : 1;
+}
+
+static int run_cluster_bench(uint32_t nodes, uint32_t seconds) {
+    if (nodes < 2 || nodes > BENCH_MAX_NODES || seconds < 1) {
+        fprintf(stderr, "ERROR: NODES must be 2 to %u and SECONDS at least 1\n", BENCH_MAX_NODES);
+        return 1;
+    }
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    fflush(stdout);
+    uint64_t start_us = now_us();
+    uint64_t end_us = start_us + seconds * 1000000ULL;
+    for (uint32_t i = 0; i < nodes; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            _exit(run_node(i, nodes, start_us, end_us, fds[1]));
+        }
+    }
+    close(fds[1]);
+
+    /* Reports are smaller than PIPE_BUF, so each arrives whole */
+    uint32_t reported = 0;
+    uint32_t converged = 0;
+    uint32_t leaders = 0;
+    uint64_t converge_max = 0;
+    uint64_t converge_total = 0;
+    double out_bps = 0.0;
+    double in_bps = 0.0;
+    double pps = 0.0;
+    node_report_t report;
+    while (read(fds[0], &report, sizeof(report)) == sizeof(report)) {
+        reported++;
+        leaders += report.leader;
+        if (report.converged_us) {
+            converged++;
+            converge_total += report.converged_us;
+            if (report.converged_us > converge_max) {
+                converge_max = report.converged_us;
+            }
+        }
+        if (report.elapsed_us) {
+            out_bps += report.bytes_sent * 1e6 / report.elapsed_us;
+            in_bps += report.bytes_received * 1e6 / report.elapsed_us;
+            pps += report.packets_sent * 1e6 / report.elapsed_us;
+        }
+    }
+    close(fds[0]);
+
+    int failed = 0;
+    int status;
+    while (wait(&status) > 0) {
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+
+    printf("%u nodes, %u s on loopback ports %u-%u:\n", nodes, seconds, BENCH_BASE_PORT,
+           BENCH_BASE_PORT + nodes - 1);
+    printf("  reported:     %u of %u nodes (%d failed)\n", reported, nodes, failed);
+    printf("  converged:    %u nodes, avg %.0f ms, max %.0f ms after start\n", converged,
+           converged ? converge_total / 1000.0 / converged : 0.0, converge_max / 1000.0);
+    printf("  leaders:      %u at the end of the run\n", leaders);
+    if (reported) {
+        printf("  per node:     %.0f B/s out, %.0f B/s in, %.1f packets/s out\n",
+               out_bps / reported, in_bps / reported, pps / reported);
+    }
+    return failed || converged != nodes || leaders != 1 ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--bench-cluster") == 0) {
+        return run_cluster_bench(arg_u32(argc, argv, 2, 16), arg_u32(argc, argv, 3, 10));
+    }
+
+    print_usage(argv[0]);
+    return argc > 1 ? 1 : 0;
+}
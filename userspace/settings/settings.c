@@ -5,11 +5,250 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "settings.h"
 
+#define SETTINGS_INDEX_INITIAL_BUCKETS 64
+
 /* Global settings database */
 static settings_db_t* g_settings_db = NULL;
 
+/* FNV-1a; 0 is reserved for empty image slots */
+static uint64_t settings_hash_key(const char* key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*key) {
+        hash ^= (uint8_t)*key++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/* Grow the in-memory index and rehash */
+static status_t settings_index_grow(void) {
+    uint32_t buckets = g_settings_db->index_buckets ?
+                       g_settings_db->index_buckets * 2 : SETTINGS_INDEX_INITIAL_BUCKETS;
+
+    setting_t** index = (setting_t**)calloc(buckets, sizeof(setting_t*));
+    if (!index) {
+        return STATUS_NOMEM;
+    }
+
+    for (setting_t* setting = g_settings_db->settings; setting; setting = setting->next) {
+        uint32_t bucket = (uint32_t)(setting->key_hash & (buckets - 1));
+        setting->hash_next = index[bucket];
+        index[bucket] = setting;
+    }
+
+    free(g_settings_db->index);
+    g_settings_db->index = index;
+    g_settings_db->index_buckets = buckets;
+
+    return STATUS_OK;
+}
+
+/* Copy a setting's value into an on-disk record */
+static void settings_fill_record(const setting_t* setting, settings_record_t* record) {
+    memset(record, 0, sizeof(*record));
+    record->key_hash = setting->key_hash;
+    strncpy(record->key, setting->key, sizeof(record->key) - 1);
+    record->type = setting->type;
+
+    switch (setting->type) {
+        case SETTING_TYPE_BOOL:
+            record->value.bool_value = setting->value.bool_value ? 1 : 0;
+            break;
+        case SETTING_TYPE_INT:
+            record->value.int_value = setting->value.int_value;
+            break;
+        case SETTING_TYPE_STRING:
+            strncpy(record->value.string_value, setting->value.string_value,
+                    sizeof(record->value.string_value) - 1);
+            break;
+        case SETTING_TYPE_ENUM:
+            record->value.enum_value = setting->value.enum_value;
+            break;
+        case SETTING_TYPE_COLOR:
+            record->value.color_value = setting->value.color_value;
+            break;
+    }
+}
+
+/* Apply an on-disk record to the matching registered setting */
+static void settings_apply_record(const settings_record_t* record) {
+    setting_t* setting = settings_find(record->key);
+    if (!setting || setting->type != (setting_type_t)record->type) {
+        return;
+    }
+
+    switch (setting->type) {
+        case SETTING_TYPE_BOOL:
+            setting->value.bool_value = record->value.bool_value != 0;
+            break;
+        case SETTING_TYPE_INT:
+            setting->value.int_value = record->value.int_value;
+            break;
+        case SETTING_TYPE_STRING:
+            memcpy(setting->value.string_value, record->value.string_value,
+                   sizeof(setting->value.string_value) - 1);
+            setting->value.string_value[sizeof(setting->value.string_value) - 1] = '\0';
+            break;
+        case SETTING_TYPE_ENUM:
+            setting->value.enum_value = record->value.enum_value;
+            break;
+        case SETTING_TYPE_COLOR:
+            setting->value.color_value = record->value.color_value;
+            break;
+    }
+}
+
+/* Probe the mapped image for a key */
+static const settings_record_t* settings_image_lookup(const char* key, uint64_t hash) {
+    const settings_image_header_t* image = g_settings_db->image;
+    if (!image) {
+        return NULL;
+    }
+
+    const settings_record_t* slots = (const settings_record_t*)(image + 1);
+    uint32_t mask = image->slot_count - 1;
+
+    for (uint32_t probe = 0; probe < image->slot_count; probe++) {
+        const settings_record_t* slot = &slots[(hash + probe) & mask];
+        if (slot->key_hash == 0) {
+            return NULL;
+        }
+        if (slot->key_hash == hash && strncmp(slot->key, key, sizeof(slot->key)) == 0) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+static void settings_image_unmap(void) {
+    if (g_settings_db->image) {
+        munmap((void*)g_settings_db->image, g_settings_db->image_size);
+        g_settings_db->image = NULL;
+        g_settings_db->image_size = 0;
+    }
+}
+
+/* Map the binary image read-only; a missing or malformed image is ignored */
+static bool settings_image_map(void) {
+    settings_image_unmap();
+
+    int fd = open(g_settings_db->image_file, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(settings_image_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const settings_image_header_t* header = (const settings_image_header_t*)map;
+    size_t expected = sizeof(*header) + (size_t)header->slot_count * sizeof(settings_record_t);
+    if (header->magic != SETTINGS_IMAGE_MAGIC || header->version != SETTINGS_IMAGE_VERSION ||
+        header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 ||
+        expected > (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return false;
+    }
+
+    g_settings_db->image = header;
+    g_settings_db->image_size = (size_t)st.st_size;
+    return true;
+}
+
+/*
+ * Replay the change log on top of the image. A torn tail record is cut off
+ * so appends start on a record boundary; *intact is false if that failed.
+ */
+static bool settings_log_replay(bool* intact) {
+    *intact = true;
+    int fd = open(g_settings_db->log_file, O_RDWR);
+    if (fd < 0) {
+        return false;
+    }
+
+    settings_record_t record;
+    uint32_t replayed = 0;
+    while (read(fd, &record, sizeof(record)) == (ssize_t)sizeof(record)) {
+        record.key[sizeof(record.key) - 1] = '\0';
+        settings_apply_record(&record);
+        replayed++;
+    }
+
+    off_t valid = (off_t)replayed * (off_t)sizeof(record);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (st.st_size != valid && ftruncate(fd, valid) < 0)) {
+        fprintf(stderr, "[SETTINGS] Cannot trim torn record from %s: %s\n",
+                g_settings_db->log_file, strerror(errno));
+        *intact = false;
+    }
+
+    close(fd);
+    g_settings_db->log_records = replayed;
+    return true;
+}
+
+static void settings_log_open(void) {
+    if (g_settings_db->log_fd >= 0) {
+        return;
+    }
+    g_settings_db->log_fd = open(g_settings_db->log_file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+/* Cut a short append back to the last whole record, or stop logging if that fails */
+static void settings_log_rollback(void) {
+    off_t valid = (off_t)g_settings_db->log_records * (off_t)sizeof(settings_record_t);
+    if (ftruncate(g_settings_db->log_fd, valid) < 0) {
+        fprintf(stderr, "[SETTINGS] Change log %s damaged, logging disabled until next save: %s\n",
+                g_settings_db->log_file, strerror(errno));
+        close(g_settings_db->log_fd);
+        g_settings_db->log_fd = -1;
+    }
+}
+
+static void settings_notify(const setting_t* setting) {
+    for (settings_subscriber_t* sub = g_settings_db->subscribers; sub; sub = sub->next) {
+        if (strncmp(setting->key, sub->key_prefix, sub->prefix_len) == 0) {
+            sub->callback(setting, sub->context);
+        }
+    }
+}
+
+/* Persist a single change as one appended record and push it to subscribers */
+static void settings_commit(setting_t* setting) {
+    g_settings_db->modified = true;
+
+    if (g_settings_db->log_fd >= 0) {
+        settings_record_t record;
+        settings_fill_record(setting, &record);
+        if (write(g_settings_db->log_fd, &record, sizeof(record)) == (ssize_t)sizeof(record)) {
+            g_settings_db->log_records++;
+            if (g_settings_db->log_records >= SETTINGS_LOG_COMPACT_THRESHOLD) {
+                settings_compact();
+            }
+        } else {
+            settings_log_rollback();
+        }
+    }
+
+    settings_notify(setting);
+}
+
 /* Initialize settings system */
 status_t settings_init(const char* config_file) {
     if (g_settings_db) {
@@ -24,6 +263,8 @@ status_t settings_init(const char* config_file) {
     g_settings_db->settings = NULL;
     g_settings_db->count = 0;
     g_settings_db->modified = false;
+    g_settings_db->log_fd = -1;
+    g_settings_db->next_subscriber_id = 1;
 
     if (config_file) {
         strncpy(g_settings_db->config_file, config_file, sizeof(g_settings_db->config_file) - 1);
@@ -31,6 +272,17 @@ status_t settings_init(const char* config_file) {
         strcpy(g_settings_db->config_file, "/etc/limitless/settings.conf");
     }
 
+    snprintf(g_settings_db->image_file, sizeof(g_settings_db->image_file), "%.4090s.db",
+             g_settings_db->config_file);
+    snprintf(g_settings_db->log_file, sizeof(g_settings_db->log_file), "%.4090s.log",
+             g_settings_db->config_file);
+
+    if (FAILED(settings_index_grow())) {
+        free(g_settings_db);
+        g_settings_db = NULL;
+        return STATUS_NOMEM;
+    }
+
     /* Register default settings */
     settings_register_defaults();
 
@@ -66,6 +318,18 @@ void settings_shutdown(void) {
         setting = next;
     }
 
+    settings_subscriber_t* sub = g_settings_db->subscribers;
+    while (sub) {
+        settings_subscriber_t* next = sub->next;
+        free(sub);
+        sub = next;
+    }
+
+    settings_image_unmap();
+    if (g_settings_db->log_fd >= 0) {
+        close(g_settings_db->log_fd);
+    }
+    free(g_settings_db->index);
     free(g_settings_db);
     g_settings_db = NULL;
 
@@ -110,12 +374,22 @@ status_t settings_register(const char* key, const char* name, const char* descri
     setting->max_value = INT64_MAX;
     setting->requires_restart = false;
     setting->requires_admin = false;
+    setting->key_hash = settings_hash_key(setting->key);
 
     /* Add to list */
     setting->next = g_settings_db->settings;
     g_settings_db->settings = setting;
     g_settings_db->count++;
 
+    /* Add to index, keeping load factor at or below 1 */
+    if (g_settings_db->count > g_settings_db->index_buckets) {
+        settings_index_grow();
+    } else {
+        uint32_t bucket = (uint32_t)(setting->key_hash & (g_settings_db->index_buckets - 1));
+        setting->hash_next = g_settings_db->index[bucket];
+        g_settings_db->index[bucket] = setting;
+    }
+
     return STATUS_OK;
 }
 
@@ -125,12 +399,13 @@ setting_t* settings_find(const char* key) {
         return NULL;
     }
 
-    setting_t* setting = g_settings_db->settings;
+    uint64_t hash = settings_hash_key(key);
+    setting_t* setting = g_settings_db->index[hash & (g_settings_db->index_buckets - 1)];
     while (setting) {
-        if (strcmp(setting->key, key) == 0) {
+        if (setting->key_hash == hash && strcmp(setting->key, key) == 0) {
             return setting;
         }
-        setting = setting->next;
+        setting = setting->hash_next;
     }
 
     return NULL;
@@ -148,7 +423,7 @@ status_t settings_set_bool(const char* key, bool value) {
     }
 
     setting->value.bool_value = value;
-    g_settings_db->modified = true;
+    settings_commit(setting);
 
     return STATUS_OK;
 }
@@ -170,7 +445,7 @@ status_t settings_set_int(const char* key, int64_t value) {
     }
 
     setting->value.int_value = value;
-    g_settings_db->modified = true;
+    settings_commit(setting);
 
     return STATUS_OK;
 }
@@ -187,7 +462,7 @@ status_t settings_set_string(const char* key, const char* value) {
     }
 
     strncpy(setting->value.string_value, value, sizeof(setting->value.string_value) - 1);
-    g_settings_db->modified = true;
+    settings_commit(setting);
 
     return STATUS_OK;
 }
@@ -239,13 +514,132 @@ status_t settings_get_string(const char* key, char* out_value, size_t max_len) {
     return STATUS_OK;
 }
 
-/* Load settings from file */
+/* Load settings from the binary image and change log */
 status_t settings_load(void) {
     if (!g_settings_db) {
         return STATUS_ERROR;
     }
 
-    FILE* file = fopen(g_settings_db->config_file, "r");
+    bool have_image = settings_image_map();
+    if (have_image) {
+        for (setting_t* setting = g_settings_db->settings; setting; setting = setting->next) {
+            const settings_record_t* record = settings_image_lookup(setting->key, setting->key_hash);
+            if (record) {
+                settings_apply_record(record);
+            }
+        }
+    }
+
+    bool log_intact;
+    bool have_log = settings_log_replay(&log_intact);
+
+    settings_log_open();
+
+    /* First boot after upgrade: migrate the legacy text config */
+    if (!have_image && !have_log) {
+        settings_import(g_settings_db->config_file);
+        settings_compact();
+    } else if (!log_intact) {
+        /* Appends would land after the torn record; fold the log into the image instead */
+        settings_compact();
+    }
+    g_settings_db->modified = false;
+
+    printf("[SETTINGS] Loaded from %s (%u log records)\n",
+           g_settings_db->image_file, g_settings_db->log_records);
+    return STATUS_OK;
+}
+
+/* Save settings: fold the change log into a fresh image */
+status_t settings_save(void) {
+    if (!g_settings_db) {
+        return STATUS_ERROR;
+    }
+
+    status_t status = settings_compact();
+    if (SUCCESS(status)) {
+        g_settings_db->modified = false;
+        printf("[SETTINGS] Saved to %s\n", g_settings_db->image_file);
+    }
+
+    return status;
+}
+
+/* Write a new image atomically and truncate the change log */
+status_t settings_compact(void) {
+    if (!g_settings_db) {
+        return STATUS_ERROR;
+    }
+
+    uint32_t slots = 16;
+    while (slots < g_settings_db->count * 2) {
+        slots *= 2;
+    }
+
+    size_t size = sizeof(settings_image_header_t) + (size_t)slots * sizeof(settings_record_t);
+    settings_image_header_t* header = (settings_image_header_t*)calloc(1, size);
+    if (!header) {
+        return STATUS_NOMEM;
+    }
+
+    header->magic = SETTINGS_IMAGE_MAGIC;
+    header->version = SETTINGS_IMAGE_VERSION;
+    header->slot_count = slots;
+    header->record_count = g_settings_db->count;
+
+    settings_record_t* records = (settings_record_t*)(header + 1);
+    for (setting_t* setting = g_settings_db->settings; setting; setting = setting->next) {
+        uint32_t slot = (uint32_t)(setting->key_hash & (slots - 1));
+        while (records[slot].key_hash != 0) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        settings_fill_record(setting, &records[slot]);
+    }
+
+    char tmp_file[4096 + 8];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", g_settings_db->image_file);
+
+    int fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(header);
+        return STATUS_ERROR;
+    }
+
+    bool ok = write(fd, header, size) == (ssize_t)size && fsync(fd) == 0;
+    close(fd);
+    free(header);
+
+    if (!ok || rename(tmp_file, g_settings_db->image_file) != 0) {
+        unlink(tmp_file);
+        return STATUS_ERROR;
+    }
+
+    /* The image now holds every logged change */
+    if (g_settings_db->log_fd >= 0) {
+        close(g_settings_db->log_fd);
+        g_settings_db->log_fd = -1;
+    }
+    /* On failure the log keeps whole records that agree with the image */
+    bool truncated = truncate(g_settings_db->log_file, 0) == 0;
+    if (truncated) {
+        g_settings_db->log_records = 0;
+    } else {
+        fprintf(stderr, "[SETTINGS] Cannot truncate %s: %s\n", g_settings_db->log_file, strerror(errno));
+    }
+    settings_log_open();
+
+    settings_image_map();
+
+    return truncated ? STATUS_OK : STATUS_ERROR;
+}
+
+/* Import settings from a text file (key=value) */
+status_t settings_import(const char* file_path) {
+    if (!g_settings_db || !file_path) {
+        return STATUS_ERROR;
+    }
+
+    FILE* file = fopen(file_path, "r");
     if (!file) {
         /* File doesn't exist yet - not an error */
         return STATUS_OK;
@@ -289,25 +683,25 @@ status_t settings_load(void) {
                     strncpy(setting->value.string_value, value, sizeof(setting->value.string_value) - 1);
                     break;
                 default:
-                    break;
+                    continue;
             }
+            settings_commit(setting);
         }
     }
 
     fclose(file);
-    g_settings_db->modified = false;
 
-    printf("[SETTINGS] Loaded from %s\n", g_settings_db->config_file);
+    printf("[SETTINGS] Imported from %s\n", file_path);
     return STATUS_OK;
 }
 
-/* Save settings to file */
-status_t settings_save(void) {
-    if (!g_settings_db) {
+/* Export settings to a text file (key=value) */
+status_t settings_export(const char* file_path) {
+    if (!g_settings_db || !file_path) {
         return STATUS_ERROR;
     }
 
-    FILE* file = fopen(g_settings_db->config_file, "w");
+    FILE* file = fopen(file_path, "w");
     if (!file) {
         return STATUS_ERROR;
     }
@@ -357,12 +751,61 @@ status_t settings_save(void) {
     }
 
     fclose(file);
-    g_settings_db->modified = false;
 
-    printf("[SETTINGS] Saved to %s\n", g_settings_db->config_file);
+    printf("[SETTINGS] Exported to %s\n", file_path);
+    return STATUS_OK;
+}
+
+/* Subscribe to changes of every key starting with key_prefix */
+status_t settings_subscribe(const char* key_prefix, settings_notify_fn callback,
+                           void* context, uint32_t* out_id) {
+    if (!g_settings_db || !callback) {
+        return STATUS_INVALID;
+    }
+
+    settings_subscriber_t* sub = (settings_subscriber_t*)calloc(1, sizeof(settings_subscriber_t));
+    if (!sub) {
+        return STATUS_NOMEM;
+    }
+
+    if (key_prefix) {
+        strncpy(sub->key_prefix, key_prefix, sizeof(sub->key_prefix) - 1);
+    }
+    sub->prefix_len = strlen(sub->key_prefix);
+    sub->callback = callback;
+    sub->context = context;
+    sub->id = g_settings_db->next_subscriber_id++;
+
+    sub->next = g_settings_db->subscribers;
+    g_settings_db->subscribers = sub;
+
+    if (out_id) {
+        *out_id = sub->id;
+    }
+
     return STATUS_OK;
 }
 
+/* Remove a subscription */
+status_t settings_unsubscribe(uint32_t id) {
+    if (!g_settings_db) {
+        return STATUS_INVALID;
+    }
+
+    settings_subscriber_t** link = &g_settings_db->subscribers;
+    while (*link) {
+        if ((*link)->id == id) {
+            settings_subscriber_t* sub = *link;
+            *link = sub->next;
+            free(sub);
+            return STATUS_OK;
+        }
+        link = &(*link)->next;
+    }
+
+    return STATUS_NOTFOUND;
+}
+
 /* Get system information */
 status_t settings_get_system_info(system_info_t* info) {
     if (!info) {
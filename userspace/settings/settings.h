@@ -7,6 +7,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 
 /* Setting types */
@@ -46,6 +47,10 @@ typedef struct setting {
     bool requires_restart;
     bool requires_admin;
 
+    /* Hashed index */
+    uint64_t key_hash;
+    struct setting* hash_next;
+
     struct setting* next;
 } setting_t;
 
@@ -60,12 +65,76 @@ typedef struct setting {
 #define CATEGORY_POWER      "power"
 #define CATEGORY_USERS      "users"
 
+/* Change notification callback */
+typedef void (*settings_notify_fn)(const setting_t* setting, void* context);
+
+/* Change subscriber */
+typedef struct settings_subscriber {
+    uint32_t id;
+    char key_prefix[128];
+    size_t prefix_len;
+    settings_notify_fn callback;
+    void* context;
+    struct settings_subscriber* next;
+} settings_subscriber_t;
+
+/*
+ * Binary store layout
+ *
+ * <config_file>.db is an open-addressed hash table of fixed-size records
+ * that is mmap'd and probed in place, so startup does no parsing at all.
+ * <config_file>.log holds records appended by each settings_set_* call and
+ * is folded back into the image once it grows past the compaction threshold.
+ * The text format at <config_file> is only used for import/export.
+ */
+#define SETTINGS_IMAGE_MAGIC      0x4244534C  /* "LSDB" */
+#define SETTINGS_IMAGE_VERSION    1
+#define SETTINGS_LOG_COMPACT_THRESHOLD 64
+
+typedef struct settings_record {
+    uint64_t key_hash;  /* 0 marks an empty slot */
+    char key[128];
+    uint32_t type;
+    uint32_t reserved;
+    union {
+        uint8_t bool_value;
+        int64_t int_value;
+        char string_value[256];
+        uint32_t enum_value;
+        uint32_t color_value;
+    } value;
+} settings_record_t;
+
+typedef struct settings_image_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;    /* Power of two */
+    uint32_t record_count;
+    uint64_t reserved;
+} settings_image_header_t;
+
 /* Settings database */
 typedef struct settings_db {
     setting_t* settings;
     uint32_t count;
     char config_file[4096];
     bool modified;
+
+    /* Hashed key index (chained through setting_t.hash_next) */
+    setting_t** index;
+    uint32_t index_buckets;
+
+    /* Binary store */
+    char image_file[4096];
+    char log_file[4096];
+    const settings_image_header_t* image;
+    size_t image_size;
+    int log_fd;
+    uint32_t log_records;
+
+    /* Change subscribers */
+    settings_subscriber_t* subscribers;
+    uint32_t next_subscriber_id;
 } settings_db_t;
 
 /* Settings API */
@@ -94,6 +163,12 @@ status_t settings_save(void);
 status_t settings_reset(const char* category);
 status_t settings_export(const char* file);
 status_t settings_import(const char* file);
+status_t settings_compact(void);
+
+/* Change notifications (key_prefix NULL or "" matches every key) */
+status_t settings_subscribe(const char* key_prefix, settings_notify_fn callback,
+                           void* context, uint32_t* out_id);
+status_t settings_unsubscribe(uint32_t id);
 
 /* Query */
 setting_t* settings_find(const char* key);
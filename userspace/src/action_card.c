@@ -9,6 +9,7 @@
 #include <time.h>
 #include <unistd.h>
 #include "action_card.h"
+#include "pattern_match.h"
 
 /* Maximum stored action cards */
 #define MAX_ACTION_CARDS 1024
@@ -20,6 +21,8 @@ static struct {
     uint32_t card_count;
     consent_rule_t rules[MAX_CONSENT_RULES];
     uint32_t rule_count;
+    pattern_set_t* rule_patterns;              /* Automaton over every rule pattern */
+    uint32_t open_rule[ACTION_CUSTOM + 1];     /* First pattern-less rule per type, plus one */
     action_card_settings_t settings;
     uint64_t next_id;
     bool initialized;
@@ -417,28 +420,59 @@ int action_card_undo(uint64_t action_id) {
     return result;
 }
 
-/* Check consent */
-consent_policy_t action_card_check_consent(action_type_t type, const char* command) {
+/* First active rule of a type, optionally only those without a pattern */
+static uint32_t first_consent_rule(action_type_t type, bool open_only) {
     for (uint32_t i = 0; i < action_state.rule_count; i++) {
         consent_rule_t* rule = &action_state.rules[i];
-        if (!rule->active) {
-            continue;
+        if (rule->active && rule->action_type == type && (!open_only || rule->pattern[0] == '\0')) {
+            return i;
         }
+    }
+    return UINT32_MAX;
+}
 
-        if (rule->action_type == type) {
-            /* Check pattern match if provided */
-            if (rule->pattern[0] != '\0' && command) {
-                /* Simple substring match (production would use regex) */
-                if (strstr(command, rule->pattern)) {
-                    return rule->policy;
-                }
-            } else {
-                return rule->policy;
+/* Rule scan state; rules rank by insertion order */
+typedef struct consent_scan {
+    action_type_t type;
+    uint32_t best;
+} consent_scan_t;
+
+static bool consent_rule_matched(const pattern_match_t* match, void* arg) {
+    consent_scan_t* scan = (consent_scan_t*)arg;
+    if (match->value < scan->best) {
+        consent_rule_t* rule = &action_state.rules[match->value];
+        if (rule->active && rule->action_type == scan->type) {
+            scan->best = match->value;
+        }
+    }
+    return true;
+}
+
+/* Check consent */
+consent_policy_t action_card_check_consent(action_type_t type, const char* command) {
+    consent_scan_t scan = { .type = type, .best = UINT32_MAX };
+
+    if (!command) {
+        /* Nothing to match against, so every rule of the type applies */
+        scan.best = first_consent_rule(type, false);
+    } else {
+        /* Rules without a pattern apply unconditionally */
+        if ((uint32_t)type <= ACTION_CUSTOM && action_state.open_rule[type]) {
+            scan.best = action_state.open_rule[type] - 1;
+            if (!action_state.rules[scan.best].active) {
+                scan.best = first_consent_rule(type, true);
             }
+        } else if ((uint32_t)type > ACTION_CUSTOM) {
+            scan.best = first_consent_rule(type, true);
+        }
+
+        /* One case-insensitive pass reports every patterned rule in the command */
+        if (action_state.rule_patterns) {
+            pattern_set_scan(action_state.rule_patterns, command, consent_rule_matched, &scan);
         }
     }
 
-    return CONSENT_ALWAYS_ASK;
+    return scan.best == UINT32_MAX ? CONSENT_ALWAYS_ASK : action_state.rules[scan.best].policy;
 }
 
 /* Add consent rule */
@@ -447,14 +481,31 @@ int action_card_add_consent_rule(action_type_t type, consent_policy_t policy, co
         return -1;
     }
 
-    consent_rule_t* rule = &action_state.rules[action_state.rule_count++];
+    uint32_t index = action_state.rule_count;
+    consent_rule_t* rule = &action_state.rules[index];
+    memset(rule, 0, sizeof(*rule));
     rule->action_type = type;
     rule->policy = policy;
     if (pattern) {
         strncpy(rule->pattern, pattern, sizeof(rule->pattern) - 1);
     }
+
+    if (rule->pattern[0] != '\0') {
+        /* Extend the automaton; it relinks on the next check */
+        if (!action_state.rule_patterns) {
+            action_state.rule_patterns = pattern_set_create();
+        }
+        if (!action_state.rule_patterns ||
+            pattern_set_add(action_state.rule_patterns, rule->pattern, (uint32_t)type, index, (int32_t)index) < 0) {
+            return -1;
+        }
+    } else if ((uint32_t)type <= ACTION_CUSTOM && !action_state.open_rule[type]) {
+        action_state.open_rule[type] = index + 1;
+    }
+
     rule->created_at = get_timestamp_ns();
     rule->active = true;
+    action_state.rule_count++;
 
     return 0;
 }
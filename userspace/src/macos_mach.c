@@ -0,0 +1,1816 @@
+/*
+ * macOS Persona - Mach IPC
+ * Ports with receive, send and send-once rights named through a per-task
+ * table, port sets, out-of-line memory, and mach_msg with a direct
+ * call/reply handoff between blocked threads
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "macos_persona.h"
+
+#define MACH_NAME_INDEX(name)   ((name) >> 8)
+#define MACH_NAME_GEN(name)     ((name) & 0xFF)
+#define MACH_NAME(index, gen)   (((index) << 8) | (gen))
+
+#define MACH_TABLE_INITIAL      64
+#define MACH_TABLE_MAX          (1u << 22)   /* Keeps every name below MACH_PORT_DEAD */
+#define MACH_UREFS_MAX          0xFFFF
+#define MACH_SPIN_LIMIT         2000         /* Polls of a waiter's done flag before sleeping */
+#define MACH_PAGE_SIZE          4096
+#define MACH_RETRY              (-1)         /* Internal wake result: state changed, look again */
+
+#define MACH_RIGHT_BITS         (MACH_PORT_TYPE_SEND | MACH_PORT_TYPE_SEND_ONCE)
+
+/* Port object flags */
+#define PORT_ACTIVE             0x1          /* Its receive right exists, held or in transit */
+#define PORT_KOBJECT            0x2          /* Task, thread and host ports: no receiver in this task */
+#define PORT_IN_TRANSIT         0x4          /* Receive right is inside a queued message */
+
+/* OOL descriptor pad1 while a message is in flight */
+#define OOL_MOVED               1            /* Sender's pages remapped; undo moves them back */
+#define OOL_COPIED              2
+#define OOL_COPIED_DEALLOC      3            /* Copied; sender's pages go once the send commits */
+
+struct mach_port_obj;
+struct mach_pset;
+
+/*
+ * A thread blocked in receive, or in send on a full queue. Waiters are
+ * pooled rather than freed, so a wake posted just as its thread exits is
+ * harmless.
+ */
+typedef struct mach_waiter {
+    struct mach_waiter* next;
+    mach_msg_header_t* buf;     // Where a handed-off message is copied out
+    uint32_t rcv_size;
+    int32_t result;             // Valid once done is set
+    uint32_t done;
+    sem_t wake;                 // Posted exactly once per wake
+} mach_waiter_t;
+
+/* A port descriptor's right, or the address an OOL region came from */
+typedef union mach_kmsg_slot {
+    struct mach_port_obj* port;
+    void* source;
+} mach_kmsg_slot_t;
+
+/* A message in flight; rights are held as port references until copyout */
+typedef struct mach_kmsg {
+    struct mach_kmsg* next;
+    struct mach_port_obj* dest;
+    struct mach_port_obj* reply;
+    uint8_t dest_type;          // MACH_MSG_TYPE_PORT_SEND or _SEND_ONCE
+    uint8_t reply_type;
+    bool heap;                  // Otherwise on the sender's stack, reading its buffer
+    uint32_t size;
+    uint32_t count;             // Descriptors
+    uint32_t prepared;          // Descriptors parsed and OOL regions handled
+    mach_msg_header_t* msg;
+    mach_kmsg_slot_t* slots;
+} mach_kmsg_t;
+
+typedef struct mach_port_obj {
+    uint32_t refs;              // Names, messages and in-transit rights referring to it
+    uint32_t flags;
+    mach_port_name_t name;      // This task's name for its receive/send rights, or MACH_PORT_NULL
+    uint32_t qcount;
+    uint32_t qlimit;
+    mach_kmsg_t* head;
+    mach_kmsg_t* tail;
+    mach_waiter_t* receivers;   // LIFO: the most recently idle server thread is cache-warm
+    mach_waiter_t* senders;     // Blocked on a full queue
+    struct mach_pset* pset;
+    struct mach_port_obj* member_next;
+    struct mach_port_obj* member_prev;
+    struct mach_port_obj* ready_next;   // On the set's list of members with messages
+    struct mach_port_obj* ready_prev;
+    bool ready;
+} mach_port_obj_t;
+
+typedef struct mach_pset {
+    mach_port_obj_t* members;
+    mach_port_obj_t* ready_head;
+    mach_port_obj_t* ready_tail;
+    mach_waiter_t* receivers;
+} mach_pset_t;
+
+/* One slot of the name table; a name is its index and generation */
+typedef struct mach_port_entry {
+    void* object;               // mach_port_obj_t, or mach_pset_t for a port set
+    mach_port_type_t type;      // MACH_PORT_TYPE_* bits; 0 = free
+    uint16_t urefs;             // User references on the send or dead-name right
+    uint8_t gen;
+    uint32_t next_free;
+} mach_port_entry_t;
+
+/* The task's IPC space; one lock covers names, ports and queues */
+static struct {
+    pthread_mutex_t lock;
+    mach_port_entry_t* table;
+    uint32_t size;
+    uint32_t free_head;         // 0 = none; index 0 is never a name
+    mach_port_name_t task_name;
+    mach_port_name_t thread_name;
+    mach_port_name_t host_name;
+    mach_port_name_t bootstrap_name;
+    bool spin;                  // Waiters poll briefly before sleeping on multiprocessors
+    pthread_key_t waiter_key;   // Returns a thread's waiter to idle_waiters when it exits
+    mach_waiter_t* idle_waiters;
+    mach_ipc_stats_t stats;
+} g_space = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t g_space_once = PTHREAD_ONCE_INIT;
+static __thread mach_waiter_t* t_waiter;
+static __thread mach_waiter_t* t_wake_pending;   /* Woken under the lock, posted after it */
+
+static void port_destroy(mach_port_obj_t* port);
+static void kmsg_destroy(mach_kmsg_t* kmsg);
+static void kmsg_deliver(mach_kmsg_t* kmsg);
+
+/* ============================================================================
+ * Name table
+ * ============================================================================ */
+
+static bool table_grow(void) {
+    uint32_t size = g_space.size ? g_space.size * 2 : MACH_TABLE_INITIAL;
+    if (size > MACH_TABLE_MAX) {
+        return false;
+    }
+
+    mach_port_entry_t* table = realloc(g_space.table, size * sizeof(*table));
+    if (!table) {
+        return false;
+    }
+    memset(&table[g_space.size], 0, (size - g_space.size) * sizeof(*table));
+
+    /* Chain the new slots in ascending order; slot 0 stays unused */
+    uint32_t first = g_space.size ? g_space.size : 1;
+    for (uint32_t i = first; i < size; i++) {
+        table[i].next_free = i + 1 < size ? i + 1 : g_space.free_head;
+    }
+    g_space.free_head = first;
+    g_space.table = table;
+    g_space.size = size;
+    return true;
+}
+
+/* May move the table; callers must not hold entry pointers across it */
+static mach_port_name_t entry_alloc(void* object, mach_port_type_t type, uint16_t urefs) {
+    if (!g_space.free_head && !table_grow()) {
+        return MACH_PORT_NULL;
+    }
+
+    uint32_t index = g_space.free_head;
+    mach_port_entry_t* entry = &g_space.table[index];
+    g_space.free_head = entry->next_free;
+    entry->object = object;
+    entry->type = type;
+    entry->urefs = urefs;
+    return MACH_NAME(index, entry->gen);
+}
+
+static void entry_free(mach_port_entry_t* entry) {
+    entry->object = NULL;
+    entry->type = 0;
+    entry->urefs = 0;
+    entry->gen++;
+    entry->next_free = g_space.free_head;
+    g_space.free_head = (uint32_t)(entry - g_space.table);
+}
+
+static inline mach_port_name_t entry_name(const mach_port_entry_t* entry) {
+    return MACH_NAME((uint32_t)(entry - g_space.table), entry->gen);
+}
+
+static void port_release(mach_port_obj_t* port) {
+    if (--port->refs == 0) {
+        free(port);
+    }
+}
+
+/* Turn a send right whose receiver is gone into a dead name */
+static void entry_kill(mach_port_entry_t* entry) {
+    mach_port_obj_t* port = entry->object;
+    if (port->name == entry_name(entry)) {
+        port->name = MACH_PORT_NULL;
+    }
+    if (entry->type & MACH_PORT_TYPE_SEND_ONCE) {
+        entry->urefs = 1;
+    }
+    entry->type = MACH_PORT_TYPE_DEAD_NAME;
+    entry->object = NULL;
+    port_release(port);
+}
+
+/* O(1): index into the table, then check the generation */
+static mach_port_entry_t* entry_lookup(mach_port_name_t name) {
+    uint32_t index = MACH_NAME_INDEX(name);
+    if (index == 0 || index >= g_space.size) {
+        return NULL;
+    }
+
+    mach_port_entry_t* entry = &g_space.table[index];
+    if (!entry->type || entry->gen != MACH_NAME_GEN(name)) {
+        return NULL;
+    }
+    if ((entry->type & MACH_RIGHT_BITS) && !(((mach_port_obj_t*)entry->object)->flags & PORT_ACTIVE)) {
+        entry_kill(entry);
+    }
+    return entry;
+}
+
+/* Drop type bits from a port's entry; true if that freed the entry and its port reference */
+static bool entry_drop(mach_port_entry_t* entry, mach_port_type_t bits) {
+    entry->type &= ~bits;
+    if (entry->type) {
+        return false;
+    }
+
+    mach_port_obj_t* port = entry->object;
+    if (port->name == entry_name(entry)) {
+        port->name = MACH_PORT_NULL;
+    }
+    entry_free(entry);
+    return true;
+}
+
+/* ============================================================================
+ * Waiting
+ * ============================================================================ */
+
+static void waiter_retire(void* arg) {
+    mach_waiter_t* waiter = arg;
+    pthread_mutex_lock(&g_space.lock);
+    waiter->next = g_space.idle_waiters;
+    g_space.idle_waiters = waiter;
+    pthread_mutex_unlock(&g_space.lock);
+}
+
+/* The calling thread's waiter, reset for a new wait; caller holds the lock */
+static mach_waiter_t* waiter_get(void) {
+    mach_waiter_t* waiter = t_waiter;
+    if (!waiter) {
+        waiter = g_space.idle_waiters;
+        if (waiter) {
+            g_space.idle_waiters = waiter->next;
+        } else {
+            waiter = calloc(1, sizeof(*waiter));
+            if (!waiter || sem_init(&waiter->wake, 0, 0) != 0) {
+                free(waiter);
+                return NULL;
+            }
+        }
+        t_waiter = waiter;
+        pthread_setspecific(g_space.waiter_key, waiter);
+    }
+    waiter->done = 0;
+    return waiter;
+}
+
+/*
+ * Caller holds the lock and has already unlinked waiter. The post waits for
+ * space_unlock(): a thread woken while we still hold the lock would only
+ * block on it again.
+ */
+static void waiter_wake(mach_waiter_t* waiter, int32_t result) {
+    waiter->result = result;
+    __atomic_store_n(&waiter->done, 1, __ATOMIC_RELEASE);
+    waiter->next = t_wake_pending;
+    t_wake_pending = waiter;
+}
+
+static void space_unlock(void) {
+    mach_waiter_t* waiter = t_wake_pending;
+    t_wake_pending = NULL;
+    pthread_mutex_unlock(&g_space.lock);
+
+    while (waiter) {
+        /* Once posted the waiter may run and reuse next */
+        mach_waiter_t* next = waiter->next;
+        sem_post(&waiter->wake);
+        waiter = next;
+    }
+}
+
+static void waiter_wake_all(mach_waiter_t** list, int32_t result) {
+    while (*list) {
+        mach_waiter_t* waiter = *list;
+        *list = waiter->next;
+        waiter_wake(waiter, result);
+    }
+}
+
+/*
+ * Block on list until woken. Called with the lock held and returns without
+ * it: whoever wakes us has already done our copyout, so a woken receiver
+ * goes straight back to its caller instead of queueing on the lock its
+ * waker may still hold.
+ */
+static int32_t waiter_wait(mach_waiter_t* waiter, mach_waiter_t** list, const struct timespec* deadline,
+                           int32_t timeout_result) {
+    waiter->next = *list;
+    *list = waiter;
+    space_unlock();
+
+    if (g_space.spin) {
+        for (uint32_t i = 0; i < MACH_SPIN_LIMIT && !__atomic_load_n(&waiter->done, __ATOMIC_ACQUIRE); i++) {
+            __asm__ volatile("pause");
+        }
+    }
+
+    for (;;) {
+        int rc = deadline ? sem_timedwait(&waiter->wake, deadline) : sem_wait(&waiter->wake);
+        if (rc == 0) {
+            return waiter->result;
+        }
+        if (errno != ETIMEDOUT) {
+            continue;
+        }
+
+        pthread_mutex_lock(&g_space.lock);
+        bool woken = waiter->done;
+        if (!woken) {
+            /* Nobody woke us, so we are still linked and the list still exists */
+            mach_waiter_t** link = list;
+            while (*link != waiter) {
+                link = &(*link)->next;
+            }
+            *link = waiter->next;
+        }
+        space_unlock();
+
+        if (!woken) {
+            return timeout_result;
+        }
+        /* Woken as the deadline passed; the post has happened, so take it */
+        deadline = NULL;
+    }
+}
+
+/* ============================================================================
+ * Ports and port sets
+ * ============================================================================ */
+
+static mach_port_obj_t* port_alloc(uint32_t flags) {
+    mach_port_obj_t* port = calloc(1, sizeof(*port));
+    if (port) {
+        port->flags = flags;
+        port->qlimit = MACH_PORT_QLIMIT_DEFAULT;
+    }
+    return port;
+}
+
+static void set_ready_add(mach_pset_t* set, mach_port_obj_t* port) {
+    port->ready = true;
+    port->ready_next = NULL;
+    port->ready_prev = set->ready_tail;
+    if (set->ready_tail) {
+        set->ready_tail->ready_next = port;
+    } else {
+        set->ready_head = port;
+    }
+    set->ready_tail = port;
+}
+
+static void set_ready_remove(mach_pset_t* set, mach_port_obj_t* port) {
+    if (port->ready_prev) {
+        port->ready_prev->ready_next = port->ready_next;
+    } else {
+        set->ready_head = port->ready_next;
+    }
+    if (port->ready_next) {
+        port->ready_next->ready_prev = port->ready_prev;
+    } else {
+        set->ready_tail = port->ready_prev;
+    }
+    port->ready = false;
+}
+
+static void port_join_set(mach_port_obj_t* port, mach_pset_t* set) {
+    port->pset = set;
+    port->member_prev = NULL;
+    port->member_next = set->members;
+    if (set->members) {
+        set->members->member_prev = port;
+    }
+    set->members = port;
+
+    if (port->head) {
+        set_ready_add(set, port);
+        waiter_wake_all(&set->receivers, MACH_RETRY);
+    }
+}
+
+static void port_leave_set(mach_port_obj_t* port) {
+    mach_pset_t* set = port->pset;
+    if (!set) {
+        return;
+    }
+
+    if (port->ready) {
+        set_ready_remove(set, port);
+    }
+    if (port->member_prev) {
+        port->member_prev->member_next = port->member_next;
+    } else {
+        set->members = port->member_next;
+    }
+    if (port->member_next) {
+        port->member_next->member_prev = port->member_prev;
+    }
+    port->pset = NULL;
+}
+
+static void pset_destroy(mach_pset_t* set) {
+    while (set->members) {
+        port_leave_set(set->members);
+    }
+    waiter_wake_all(&set->receivers, MACH_RCV_PORT_DIED);
+    free(set);
+}
+
+static void port_enqueue(mach_port_obj_t* port, mach_kmsg_t* kmsg) {
+    kmsg->next = NULL;
+    if (port->tail) {
+        port->tail->next = kmsg;
+    } else {
+        port->head = kmsg;
+    }
+    port->tail = kmsg;
+    port->qcount++;
+
+    if (port->pset && !port->ready && !(port->flags & PORT_IN_TRANSIT)) {
+        set_ready_add(port->pset, port);
+    }
+}
+
+static mach_kmsg_t* port_dequeue(mach_port_obj_t* port) {
+    mach_kmsg_t* kmsg = port->head;
+    port->head = kmsg->next;
+    if (!port->head) {
+        port->tail = NULL;
+        if (port->ready) {
+            set_ready_remove(port->pset, port);
+        }
+    }
+    port->qcount--;
+
+    if (port->senders && port->qcount < port->qlimit) {
+        mach_waiter_t* sender = port->senders;
+        port->senders = sender->next;
+        waiter_wake(sender, MACH_RETRY);
+    }
+    return kmsg;
+}
+
+/* The receive right is leaving this task's hands: threads receiving on it must look again */
+static void port_lose_receiver(mach_port_obj_t* port, int32_t result) {
+    port_leave_set(port);
+    waiter_wake_all(&port->receivers, result);
+}
+
+/* Destroy a receive right; the caller still owns its reference */
+static void port_destroy(mach_port_obj_t* port) {
+    port->flags &= ~(PORT_ACTIVE | PORT_IN_TRANSIT);
+    port_lose_receiver(port, MACH_RCV_PORT_DIED);
+    waiter_wake_all(&port->senders, MACH_RETRY);
+
+    while (port->head) {
+        kmsg_destroy(port_dequeue(port));
+    }
+}
+
+/* ============================================================================
+ * Rights in messages
+ * ============================================================================ */
+
+static inline bool disposition_valid(uint32_t disposition) {
+    return disposition >= MACH_MSG_TYPE_MOVE_RECEIVE && disposition <= MACH_MSG_TYPE_MAKE_SEND_ONCE;
+}
+
+static inline bool disposition_moves(uint32_t disposition) {
+    return disposition <= MACH_MSG_TYPE_MOVE_SEND_ONCE;
+}
+
+/* The right a message carries for a disposition */
+static uint8_t disposition_type(uint32_t disposition) {
+    switch (disposition) {
+        case MACH_MSG_TYPE_MOVE_RECEIVE:
+            return MACH_MSG_TYPE_PORT_RECEIVE;
+        case MACH_MSG_TYPE_MOVE_SEND_ONCE:
+        case MACH_MSG_TYPE_MAKE_SEND_ONCE:
+            return MACH_MSG_TYPE_PORT_SEND_ONCE;
+        default:
+            return MACH_MSG_TYPE_PORT_SEND;
+    }
+}
+
+/*
+ * Take the right a disposition names out of the space for a message and
+ * return its port with a reference for the message. With commit false it
+ * only checks that the right is there.
+ */
+static mach_port_obj_t* right_copyin(mach_port_name_t name, uint32_t disposition, bool commit) {
+    mach_port_entry_t* entry = entry_lookup(name);
+    if (!entry || (entry->type & (MACH_PORT_TYPE_PORT_SET | MACH_PORT_TYPE_DEAD_NAME))) {
+        return NULL;
+    }
+    mach_port_obj_t* port = entry->object;
+
+    switch (disposition) {
+        case MACH_MSG_TYPE_MOVE_RECEIVE:
+            if (!(entry->type & MACH_PORT_TYPE_RECEIVE)) {
+                return NULL;
+            }
+            if (commit) {
+                port_lose_receiver(port, MACH_RCV_PORT_CHANGED);
+                port->flags |= PORT_IN_TRANSIT;
+                if (!entry_drop(entry, MACH_PORT_TYPE_RECEIVE)) {
+                    port->refs++;
+                }
+            }
+            return port;
+
+        case MACH_MSG_TYPE_MOVE_SEND:
+            if (!(entry->type & MACH_PORT_TYPE_SEND)) {
+                return NULL;
+            }
+            if (commit && (--entry->urefs > 0 || !entry_drop(entry, MACH_PORT_TYPE_SEND))) {
+                port->refs++;
+            }
+            return port;
+
+        case MACH_MSG_TYPE_COPY_SEND:
+            if (!(entry->type & MACH_PORT_TYPE_SEND)) {
+                return NULL;
+            }
+            break;
+
+        case MACH_MSG_TYPE_MOVE_SEND_ONCE:
+            if (!(entry->type & MACH_PORT_TYPE_SEND_ONCE)) {
+                return NULL;
+            }
+            if (commit) {
+                entry_free(entry);
+            }
+            return port;
+
+        case MACH_MSG_TYPE_MAKE_SEND:
+        case MACH_MSG_TYPE_MAKE_SEND_ONCE:
+            if (!(entry->type & MACH_PORT_TYPE_RECEIVE)) {
+                return NULL;
+            }
+            break;
+
+        default:
+            return NULL;
+    }
+
+    if (commit) {
+        port->refs++;
+    }
+    return port;
+}
+
+/* Give the space a right the message carried; consumes the message's reference */
+static mach_port_name_t right_copyout(mach_port_obj_t* port, uint8_t type) {
+    if (!port) {
+        return MACH_PORT_NULL;
+    }
+    if (!(port->flags & PORT_ACTIVE)) {
+        port_release(port);
+        return MACH_PORT_DEAD;
+    }
+
+    if (type == MACH_MSG_TYPE_PORT_RECEIVE) {
+        port->flags &= ~PORT_IN_TRANSIT;
+    }
+
+    /* Send and receive rights for a port share one name; send-once rights never do */
+    if (type != MACH_MSG_TYPE_PORT_SEND_ONCE && port->name) {
+        mach_port_entry_t* entry = &g_space.table[MACH_NAME_INDEX(port->name)];
+        if (type == MACH_MSG_TYPE_PORT_RECEIVE) {
+            entry->type |= MACH_PORT_TYPE_RECEIVE;
+        } else if (!(entry->type & MACH_PORT_TYPE_SEND)) {
+            entry->type |= MACH_PORT_TYPE_SEND;
+            entry->urefs = 1;
+        } else if (entry->urefs < MACH_UREFS_MAX) {
+            entry->urefs++;
+        }
+        mach_port_name_t name = port->name;
+        port_release(port);
+        return name;
+    }
+
+    mach_port_type_t bits = type == MACH_MSG_TYPE_PORT_RECEIVE ? MACH_PORT_TYPE_RECEIVE :
+                            type == MACH_MSG_TYPE_PORT_SEND ? MACH_PORT_TYPE_SEND : MACH_PORT_TYPE_SEND_ONCE;
+    mach_port_name_t name = entry_alloc(port, bits, type == MACH_MSG_TYPE_PORT_RECEIVE ? 0 : 1);
+    if (!name) {
+        /* No room for the name: the right is lost, as if the message had been destroyed */
+        if (type == MACH_MSG_TYPE_PORT_RECEIVE) {
+            port_destroy(port);
+        }
+        port_release(port);
+        return MACH_PORT_NULL;
+    }
+    if (type != MACH_MSG_TYPE_PORT_SEND_ONCE) {
+        port->name = name;
+    }
+    return name;
+}
+
+/* A send-once right destroyed unused still sends exactly one message: the notification */
+static void send_once_notify(mach_port_obj_t* port) {
+    mach_kmsg_t* kmsg = NULL;
+    if ((port->flags & PORT_ACTIVE) && !(port->flags & PORT_KOBJECT)) {
+        kmsg = malloc(sizeof(*kmsg) + sizeof(mach_msg_header_t));
+    }
+    if (!kmsg) {
+        port_release(port);
+        return;
+    }
+
+    memset(kmsg, 0, sizeof(*kmsg));
+    kmsg->heap = true;
+    kmsg->size = sizeof(mach_msg_header_t);
+    kmsg->msg = (mach_msg_header_t*)(kmsg + 1);
+    memset(kmsg->msg, 0, sizeof(mach_msg_header_t));
+    kmsg->msg->msgh_id = MACH_NOTIFY_SEND_ONCE;
+    kmsg->dest = port;
+    kmsg->dest_type = MACH_MSG_TYPE_PORT_SEND_ONCE;
+    kmsg_deliver(kmsg);
+}
+
+static void right_destroy(mach_port_obj_t* port, uint8_t type) {
+    if (!port) {
+        return;
+    }
+    if (type == MACH_MSG_TYPE_PORT_RECEIVE) {
+        port_destroy(port);
+        port_release(port);
+    } else if (type == MACH_MSG_TYPE_PORT_SEND_ONCE) {
+        send_once_notify(port);
+    } else {
+        port_release(port);
+    }
+}
+
+/* ============================================================================
+ * Out-of-line memory
+ * ============================================================================ */
+
+static inline uintptr_t page_trunc(uintptr_t addr) {
+    return addr & ~(uintptr_t)(MACH_PAGE_SIZE - 1);
+}
+
+static inline uintptr_t page_round(uintptr_t addr) {
+    return (addr + MACH_PAGE_SIZE - 1) & ~(uintptr_t)(MACH_PAGE_SIZE - 1);
+}
+
+/*
+ * Give the receiver pages of its own. A page-aligned region the sender
+ * deallocates with a virtual copy is moved by remapping; anything else is
+ * copied into fresh pages.
+ */
+static mach_msg_return_t ool_copyin(mach_msg_ool_descriptor_t* desc, mach_kmsg_slot_t* slot) {
+    uintptr_t addr = (uintptr_t)desc->address;
+    size_t size = desc->size;
+    size_t len = page_round(size);
+
+    desc->pad1 = 0;
+    slot->source = desc->address;
+    if (!size) {
+        desc->address = NULL;
+        return MACH_MSG_SUCCESS;
+    }
+    if (!addr) {
+        return MACH_SEND_INVALID_DATA;
+    }
+
+#ifdef MREMAP_FIXED
+    if (desc->deallocate && desc->copy == MACH_MSG_VIRTUAL_COPY && addr == page_trunc(addr)) {
+        void* target = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (target != MAP_FAILED) {
+            void* moved = mremap((void*)addr, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+            if (moved != MAP_FAILED) {
+                desc->address = moved;
+                desc->pad1 = OOL_MOVED;
+                __atomic_fetch_add(&g_space.stats.ool_pages_moved, len / MACH_PAGE_SIZE, __ATOMIC_RELAXED);
+                return MACH_MSG_SUCCESS;
+            }
+            /* Not one mapping of whole pages: fall back to copying */
+            munmap(target, len);
+        }
+    }
+#endif
+
+    void* copy = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) {
+        return MACH_SEND_NO_BUFFER;
+    }
+    memcpy(copy, (void*)addr, size);
+    desc->address = copy;
+    desc->pad1 = desc->deallocate ? OOL_COPIED_DEALLOC : OOL_COPIED;
+    __atomic_fetch_add(&g_space.stats.ool_bytes_copied, size, __ATOMIC_RELAXED);
+    return MACH_MSG_SUCCESS;
+}
+
+/* Put a send that failed back the way the sender had it */
+static void ool_undo(mach_msg_ool_descriptor_t* desc, mach_kmsg_slot_t* slot) {
+    size_t len = page_round(desc->size);
+
+#ifdef MREMAP_FIXED
+    if (desc->pad1 == OOL_MOVED &&
+        mremap(desc->address, len, len, MREMAP_MAYMOVE | MREMAP_FIXED, slot->source) != MAP_FAILED) {
+        desc->pad1 = 0;
+        return;
+    }
+#else
+    (void)slot;
+#endif
+    if (desc->pad1) {
+        munmap(desc->address, len);
+    }
+    desc->pad1 = 0;
+}
+
+/* The send committed: release the sender's pages that were copied rather than moved */
+static void ool_commit(mach_msg_ool_descriptor_t* desc, mach_kmsg_slot_t* slot) {
+    if (desc->pad1 == OOL_COPIED_DEALLOC) {
+        uintptr_t start = page_trunc((uintptr_t)slot->source);
+        munmap((void*)start, page_round((uintptr_t)slot->source + desc->size) - start);
+    }
+    desc->pad1 = 0;
+}
+
+/* ============================================================================
+ * Messages
+ * ============================================================================ */
+
+#define KMSG_DESC(kmsg, off)    ((uint8_t*)(kmsg)->msg + (off))
+#define KMSG_DESC_TYPE(desc)    ((desc)[11])     /* Last byte of both descriptor layouts */
+#define KMSG_BODY_OFFSET        (sizeof(mach_msg_header_t) + sizeof(mach_msg_body_t))
+
+static mach_kmsg_t* kmsg_alloc(uint32_t size, uint32_t count) {
+    size_t msg_bytes = (size + 7) & ~7u;
+    mach_kmsg_t* kmsg = malloc(sizeof(*kmsg) + msg_bytes + count * sizeof(mach_kmsg_slot_t));
+    if (!kmsg) {
+        return NULL;
+    }
+
+    memset(kmsg, 0, sizeof(*kmsg));
+    kmsg->heap = true;
+    kmsg->size = size;
+    kmsg->count = count;
+    kmsg->msg = (mach_msg_header_t*)(kmsg + 1);
+    kmsg->slots = (mach_kmsg_slot_t*)((uint8_t*)kmsg->msg + msg_bytes);
+    memset(kmsg->slots, 0, count * sizeof(mach_kmsg_slot_t));
+    return kmsg;
+}
+
+static inline uint32_t desc_size(uint8_t type) {
+    return type == MACH_MSG_PORT_DESCRIPTOR ? sizeof(mach_msg_port_descriptor_t) : sizeof(mach_msg_ool_descriptor_t);
+}
+
+/* Undo everything copied in so far and free a complex message that was never sent */
+static void kmsg_abort(mach_kmsg_t* kmsg) {
+    uint32_t off = KMSG_BODY_OFFSET;
+    for (uint32_t i = 0; i < kmsg->prepared; i++) {
+        uint8_t* desc = KMSG_DESC(kmsg, off);
+        if (KMSG_DESC_TYPE(desc) == MACH_MSG_PORT_DESCRIPTOR) {
+            right_destroy(kmsg->slots[i].port, ((mach_msg_port_descriptor_t*)desc)->disposition);
+        } else {
+            ool_undo((mach_msg_ool_descriptor_t*)desc, &kmsg->slots[i]);
+        }
+        off += desc_size(KMSG_DESC_TYPE(desc));
+    }
+    free(kmsg);
+}
+
+/*
+ * Copy a complex message and its out-of-line memory; runs without the lock
+ * so page remapping and copies never stall other IPC. Port rights are taken
+ * later, under the lock.
+ */
+static mach_msg_return_t kmsg_prepare(const mach_msg_header_t* msg, uint32_t send_size, mach_kmsg_t** out_kmsg) {
+    if (send_size < KMSG_BODY_OFFSET) {
+        return MACH_SEND_MSG_TOO_SMALL;
+    }
+    uint32_t count = ((const mach_msg_body_t*)(msg + 1))->msgh_descriptor_count;
+    if (count > (send_size - KMSG_BODY_OFFSET) / sizeof(mach_msg_port_descriptor_t)) {
+        return MACH_SEND_MSG_TOO_SMALL;
+    }
+
+    mach_kmsg_t* kmsg = kmsg_alloc(send_size, count);
+    if (!kmsg) {
+        return MACH_SEND_NO_BUFFER;
+    }
+    memcpy(kmsg->msg, msg, send_size);
+
+    mach_msg_return_t mr = MACH_MSG_SUCCESS;
+    uint32_t off = KMSG_BODY_OFFSET;
+    for (uint32_t i = 0; i < count && mr == MACH_MSG_SUCCESS; i++) {
+        uint8_t* desc = KMSG_DESC(kmsg, off);
+        uint8_t type = off + sizeof(mach_msg_port_descriptor_t) <= send_size ? KMSG_DESC_TYPE(desc) : 0xFF;
+
+        if (type == MACH_MSG_PORT_DESCRIPTOR) {
+            mach_msg_port_descriptor_t* port_desc = (mach_msg_port_descriptor_t*)desc;
+            if (MACH_PORT_VALID(port_desc->name) && !disposition_valid(port_desc->disposition)) {
+                mr = MACH_SEND_INVALID_TYPE;
+                break;
+            }
+            /* Rights are taken under the lock; until then abort has nothing to destroy */
+            port_desc->pad1 = 0;
+            port_desc->pad2 = 0;
+        } else if (type == MACH_MSG_OOL_DESCRIPTOR && off + sizeof(mach_msg_ool_descriptor_t) <= send_size) {
+            mr = ool_copyin((mach_msg_ool_descriptor_t*)desc, &kmsg->slots[i]);
+            if (mr != MACH_MSG_SUCCESS) {
+                break;
+            }
+        } else {
+            mr = type == 0xFF || type == MACH_MSG_OOL_DESCRIPTOR ? MACH_SEND_MSG_TOO_SMALL : MACH_SEND_INVALID_TYPE;
+            break;
+        }
+        kmsg->prepared = i + 1;
+        off += desc_size(type);
+    }
+
+    if (mr != MACH_MSG_SUCCESS) {
+        kmsg_abort(kmsg);
+        return mr;
+    }
+    *out_kmsg = kmsg;
+    return MACH_MSG_SUCCESS;
+}
+
+/* Take the port rights a complex message carries; a failure destroys those already taken */
+static mach_msg_return_t kmsg_copyin_ports(mach_kmsg_t* kmsg, mach_port_obj_t* dest) {
+    uint32_t off = KMSG_BODY_OFFSET;
+    for (uint32_t i = 0; i < kmsg->count; i++) {
+        uint8_t* desc = KMSG_DESC(kmsg, off);
+        off += desc_size(KMSG_DESC_TYPE(desc));
+        if (KMSG_DESC_TYPE(desc) != MACH_MSG_PORT_DESCRIPTOR) {
+            continue;
+        }
+
+        mach_msg_port_descriptor_t* port_desc = (mach_msg_port_descriptor_t*)desc;
+        if (!MACH_PORT_VALID(port_desc->name)) {
+            port_desc->disposition = 0;
+            continue;
+        }
+
+        /* A port's receive right queued on itself could never be received */
+        mach_port_obj_t* port = right_copyin(port_desc->name, port_desc->disposition, false);
+        if (!port || (port == dest && port_desc->disposition == MACH_MSG_TYPE_MOVE_RECEIVE)) {
+            return MACH_SEND_INVALID_RIGHT;
+        }
+        kmsg->slots[i].port = right_copyin(port_desc->name, port_desc->disposition, true);
+        port_desc->disposition = disposition_type(port_desc->disposition);
+    }
+    return MACH_MSG_SUCCESS;
+}
+
+/* Hand the receiver its rights and the message; consumes the message's rights */
+static void kmsg_copyout(mach_kmsg_t* kmsg, mach_msg_header_t* buf) {
+    const mach_msg_header_t* src = kmsg->msg;
+    uint32_t complex = src->msgh_bits & MACH_MSGH_BITS_COMPLEX;
+    uint32_t id = src->msgh_id;
+
+    memcpy(buf + 1, src + 1, kmsg->size - sizeof(mach_msg_header_t));
+
+    /* The destination right only routed the message; the receiver has the receive right */
+    mach_port_name_t local = kmsg->dest->name;
+    port_release(kmsg->dest);
+
+    buf->msgh_bits = MACH_MSGH_BITS(kmsg->reply ? kmsg->reply_type : 0, kmsg->dest_type) | complex;
+    buf->msgh_size = kmsg->size;
+    buf->msgh_remote_port = right_copyout(kmsg->reply, kmsg->reply_type);
+    buf->msgh_local_port = local;
+    buf->msgh_reserved = 0;
+    buf->msgh_id = id;
+
+    if (complex) {
+        uint32_t off = KMSG_BODY_OFFSET;
+        for (uint32_t i = 0; i < kmsg->count; i++) {
+            uint8_t* desc = (uint8_t*)buf + off;
+            off += desc_size(KMSG_DESC_TYPE(desc));
+            if (KMSG_DESC_TYPE(desc) == MACH_MSG_PORT_DESCRIPTOR) {
+                mach_msg_port_descriptor_t* port_desc = (mach_msg_port_descriptor_t*)desc;
+                port_desc->name = right_copyout(kmsg->slots[i].port, port_desc->disposition);
+            } else {
+                ((mach_msg_ool_descriptor_t*)desc)->pad1 = 0;
+            }
+        }
+    }
+
+    mach_msg_trailer_t* trailer = (mach_msg_trailer_t*)((uint8_t*)buf + kmsg->size);
+    trailer->msgh_trailer_type = 0;
+    trailer->msgh_trailer_size = sizeof(mach_msg_trailer_t);
+    g_space.stats.messages_received++;
+}
+
+/* Destroy a message nobody will receive, with every right and page it carries */
+static void kmsg_destroy(mach_kmsg_t* kmsg) {
+    right_destroy(kmsg->dest, kmsg->dest_type);
+    right_destroy(kmsg->reply, kmsg->reply_type);
+
+    if (kmsg->msg->msgh_bits & MACH_MSGH_BITS_COMPLEX) {
+        uint32_t off = KMSG_BODY_OFFSET;
+        for (uint32_t i = 0; i < kmsg->count; i++) {
+            uint8_t* desc = KMSG_DESC(kmsg, off);
+            off += desc_size(KMSG_DESC_TYPE(desc));
+            if (KMSG_DESC_TYPE(desc) == MACH_MSG_PORT_DESCRIPTOR) {
+                right_destroy(kmsg->slots[i].port, ((mach_msg_port_descriptor_t*)desc)->disposition);
+            } else {
+                mach_msg_ool_descriptor_t* ool = (mach_msg_ool_descriptor_t*)desc;
+                if (ool->size) {
+                    munmap(ool->address, page_round(ool->size));
+                }
+            }
+        }
+    }
+    if (kmsg->heap) {
+        free(kmsg);
+    }
+}
+
+/* The receiver a message to port would go straight to, if any */
+static mach_waiter_t** port_waiters(mach_port_obj_t* port) {
+    if (port->receivers) {
+        return &port->receivers;
+    }
+    if (port->pset && port->pset->receivers && !(port->flags & PORT_IN_TRANSIT)) {
+        return &port->pset->receivers;
+    }
+    return NULL;
+}
+
+static inline bool handoff_fits(mach_waiter_t** list, uint32_t size) {
+    return list && size + sizeof(mach_msg_trailer_t) <= (*list)->rcv_size;
+}
+
+/*
+ * Deliver a message whose rights are committed. A blocked receiver gets it
+ * copied straight into its buffer; otherwise it is queued.
+ */
+static void kmsg_deliver(mach_kmsg_t* kmsg) {
+    mach_port_obj_t* port = kmsg->dest;
+    if (!(port->flags & PORT_ACTIVE)) {
+        kmsg_destroy(kmsg);
+        return;
+    }
+
+    mach_waiter_t** list = port_waiters(port);
+    if (handoff_fits(list, kmsg->size)) {
+        mach_waiter_t* waiter = *list;
+        *list = waiter->next;
+        kmsg_copyout(kmsg, waiter->buf);
+        waiter_wake(waiter, MACH_MSG_SUCCESS);
+        g_space.stats.handoffs++;
+        if (kmsg->heap) {
+            free(kmsg);
+        }
+        return;
+    }
+
+    /* Too big for the waiter's buffer: let it find the message and report the size */
+    if (list) {
+        mach_waiter_t* waiter = *list;
+        *list = waiter->next;
+        waiter_wake(waiter, MACH_RETRY);
+    }
+    port_enqueue(port, kmsg);
+}
+
+/*
+ * Send with the lock held. Header rights are checked first, then the body's
+ * port rights are taken, then the header's; nothing in the header is
+ * consumed unless the send succeeds. Owns complex either way.
+ */
+static mach_msg_return_t msg_send(mach_msg_header_t* msg, uint32_t send_size, mach_kmsg_t* complex,
+                                  bool poll, const struct timespec* deadline) {
+    uint32_t remote = MACH_MSGH_BITS_REMOTE(msg->msgh_bits);
+    uint32_t local = MACH_MSGH_BITS_LOCAL(msg->msgh_bits);
+    mach_port_name_t dest_name = msg->msgh_remote_port;
+    mach_port_name_t reply_name = msg->msgh_local_port;
+    mach_msg_return_t mr;
+
+    if (!disposition_valid(remote) || remote == MACH_MSG_TYPE_MOVE_RECEIVE ||
+        (MACH_PORT_VALID(reply_name) && (!disposition_valid(local) || local == MACH_MSG_TYPE_MOVE_RECEIVE))) {
+        mr = MACH_SEND_INVALID_HEADER;
+        goto fail;
+    }
+    if (!MACH_PORT_VALID(reply_name)) {
+        reply_name = MACH_PORT_NULL;
+    }
+
+    mach_port_obj_t* dest;
+    for (;;) {
+        dest = right_copyin(dest_name, remote, false);
+        if (!dest || (dest->flags & PORT_KOBJECT)) {
+            /* Kernel object ports have no in-process server behind them yet */
+            mr = MACH_SEND_INVALID_DEST;
+            goto fail;
+        }
+        if (reply_name) {
+            mach_port_entry_t* entry = entry_lookup(reply_name);
+            bool twice = reply_name == dest_name && disposition_moves(remote) && disposition_moves(local) &&
+                         (remote == MACH_MSG_TYPE_MOVE_SEND_ONCE || entry->urefs < 2);
+            if (twice || !right_copyin(reply_name, local, false)) {
+                mr = MACH_SEND_INVALID_REPLY;
+                goto fail;
+            }
+        }
+
+        /* Send-once messages are never refused for a full queue */
+        if (remote == MACH_MSG_TYPE_MOVE_SEND_ONCE || remote == MACH_MSG_TYPE_MAKE_SEND_ONCE ||
+            dest->qcount < dest->qlimit) {
+            break;
+        }
+        mach_waiter_t* waiter = poll ? NULL : waiter_get();
+        if (!waiter) {
+            mr = poll ? MACH_SEND_TIMED_OUT : MACH_SEND_NO_BUFFER;
+            goto fail;
+        }
+        mr = waiter_wait(waiter, &dest->senders, deadline, MACH_SEND_TIMED_OUT);
+        pthread_mutex_lock(&g_space.lock);
+        if (mr == MACH_SEND_TIMED_OUT) {
+            goto fail;
+        }
+    }
+
+    mach_kmsg_t stack_kmsg;
+    mach_kmsg_t* kmsg = complex;
+    if (complex) {
+        mr = kmsg_copyin_ports(complex, dest);
+        if (mr != MACH_MSG_SUCCESS) {
+            goto fail;
+        }
+        /* The body may have moved rights the header names */
+        if (!right_copyin(dest_name, remote, false) || (reply_name && !right_copyin(reply_name, local, false))) {
+            mr = MACH_SEND_INVALID_DEST;
+            goto fail;
+        }
+    } else if (handoff_fits(port_waiters(dest), send_size)) {
+        /* Fast path: copied once, sender's buffer to receiver's, without allocating */
+        memset(&stack_kmsg, 0, sizeof(stack_kmsg));
+        stack_kmsg.msg = msg;
+        stack_kmsg.size = send_size;
+        kmsg = &stack_kmsg;
+    } else {
+        kmsg = kmsg_alloc(send_size, 0);
+        if (!kmsg) {
+            return MACH_SEND_NO_BUFFER;
+        }
+        memcpy(kmsg->msg, msg, send_size);
+    }
+
+    /* Copies and makes first, so a move of the same name cannot leave them nothing to copy */
+    if (reply_name && !disposition_moves(local)) {
+        kmsg->reply = right_copyin(reply_name, local, true);
+    }
+    kmsg->dest = right_copyin(dest_name, remote, true);
+    if (reply_name && disposition_moves(local)) {
+        kmsg->reply = right_copyin(reply_name, local, true);
+    }
+    kmsg->dest_type = disposition_type(remote);
+    kmsg->reply_type = reply_name ? disposition_type(local) : 0;
+
+    if (complex) {
+        uint32_t off = KMSG_BODY_OFFSET;
+        for (uint32_t i = 0; i < complex->count; i++) {
+            uint8_t* desc = KMSG_DESC(complex, off);
+            off += desc_size(KMSG_DESC_TYPE(desc));
+            if (KMSG_DESC_TYPE(desc) == MACH_MSG_OOL_DESCRIPTOR) {
+                ool_commit((mach_msg_ool_descriptor_t*)desc, &complex->slots[i]);
+            }
+        }
+    }
+
+    g_space.stats.messages_sent++;
+    kmsg_deliver(kmsg);
+    return MACH_MSG_SUCCESS;
+
+fail:
+    if (complex) {
+        kmsg_abort(complex);
+    }
+    return mr;
+}
+
+/* Receive; called with the lock held and returns without it */
+static mach_msg_return_t msg_receive(mach_msg_header_t* msg, uint32_t option, uint32_t rcv_size,
+                                     mach_port_name_t name, bool poll, const struct timespec* deadline) {
+    mach_msg_return_t mr;
+    for (;;) {
+        mach_port_entry_t* entry = entry_lookup(name);
+        if (!entry || !(entry->type & (MACH_PORT_TYPE_RECEIVE | MACH_PORT_TYPE_PORT_SET))) {
+            mr = MACH_RCV_INVALID_NAME;
+            break;
+        }
+
+        mach_port_obj_t* port;
+        mach_waiter_t** list;
+        if (entry->type & MACH_PORT_TYPE_PORT_SET) {
+            mach_pset_t* set = entry->object;
+            port = set->ready_head;
+            list = &set->receivers;
+        } else {
+            mach_port_obj_t* self = entry->object;
+            port = self->head ? self : NULL;
+            list = &self->receivers;
+        }
+
+        if (port) {
+            mach_kmsg_t* kmsg = port->head;
+            if (kmsg->size + sizeof(mach_msg_trailer_t) > rcv_size) {
+                /* MACH_RCV_LARGE leaves the message queued and reports its size */
+                if (rcv_size >= sizeof(mach_msg_header_t)) {
+                    msg->msgh_size = kmsg->size;
+                }
+                if (!(option & MACH_RCV_LARGE)) {
+                    kmsg_destroy(port_dequeue(port));
+                }
+                mr = MACH_RCV_TOO_LARGE;
+                break;
+            }
+            kmsg_copyout(port_dequeue(port), msg);
+            free(kmsg);
+            mr = MACH_MSG_SUCCESS;
+            break;
+        }
+
+        mach_waiter_t* waiter = poll ? NULL : waiter_get();
+        if (!waiter) {
+            mr = poll ? MACH_RCV_TIMED_OUT : KERN_RESOURCE_SHORTAGE;
+            break;
+        }
+        waiter->buf = msg;
+        waiter->rcv_size = rcv_size;
+        mr = waiter_wait(waiter, list, deadline, MACH_RCV_TIMED_OUT);
+        if (mr != MACH_RETRY) {
+            return mr;
+        }
+        pthread_mutex_lock(&g_space.lock);
+    }
+
+    space_unlock();
+    return mr;
+}
+
+/* sem_timedwait() measures deadlines against CLOCK_REALTIME */
+static void deadline_after(struct timespec* ts, uint32_t timeout_ms) {
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += timeout_ms / 1000;
+    ts->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+/* ============================================================================
+ * Space setup
+ * ============================================================================ */
+
+static mach_port_name_t kobject_port(void) {
+    mach_port_obj_t* port = port_alloc(PORT_ACTIVE | PORT_KOBJECT);
+    if (!port) {
+        return MACH_PORT_NULL;
+    }
+    mach_port_name_t name = entry_alloc(port, MACH_PORT_TYPE_SEND, 1);
+    if (!name) {
+        free(port);
+        return MACH_PORT_NULL;
+    }
+    port->refs = 1;
+    port->name = name;
+    return name;
+}
+
+static void mach_space_init(void) {
+    pthread_mutex_lock(&g_space.lock);
+    g_space.spin = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+    pthread_key_create(&g_space.waiter_key, waiter_retire);
+    g_space.task_name = kobject_port();
+    g_space.thread_name = kobject_port();
+    g_space.host_name = kobject_port();
+    g_space.bootstrap_name = kobject_port();
+    space_unlock();
+}
+
+static inline void mach_space_get(void) {
+    pthread_once(&g_space_once, mach_space_init);
+}
+
+static inline bool task_valid(mach_port_t task) {
+    return task == g_space.task_name;
+}
+
+int mach_ipc_init(macos_context_t* ctx) {
+    mach_space_get();
+    if (!g_space.task_name) {
+        return -1;
+    }
+    if (ctx) {
+        ctx->task_port = g_space.task_name;
+        ctx->thread_port = g_space.thread_name;
+        ctx->host_port = g_space.host_name;
+        ctx->bootstrap_port = g_space.bootstrap_name;
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Traps
+ * ============================================================================ */
+
+mach_msg_return_t mach_msg(mach_msg_header_t* msg, uint32_t option, uint32_t send_size,
+                           uint32_t rcv_size, mach_port_t rcv_name, uint32_t timeout, mach_port_t notify) {
+    (void)notify;
+    mach_space_get();
+
+    if (!msg) {
+        return (option & MACH_SEND_MSG) ? MACH_SEND_INVALID_DATA : MACH_RCV_INVALID_NAME;
+    }
+
+    mach_kmsg_t* complex = NULL;
+    if (option & MACH_SEND_MSG) {
+        if (send_size < sizeof(mach_msg_header_t) || (send_size & 3)) {
+            return MACH_SEND_MSG_TOO_SMALL;
+        }
+        if (send_size > MACH_MSG_SIZE_MAX) {
+            return MACH_SEND_TOO_LARGE;
+        }
+        if (msg->msgh_bits & MACH_MSGH_BITS_COMPLEX) {
+            mach_msg_return_t mr = kmsg_prepare(msg, send_size, &complex);
+            if (mr != MACH_MSG_SUCCESS) {
+                return mr;
+            }
+        }
+    }
+
+    struct timespec deadline;
+    bool timed = (option & (MACH_SEND_TIMEOUT | MACH_RCV_TIMEOUT)) && timeout;
+    if (timed) {
+        deadline_after(&deadline, timeout);
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+
+    /* Send and receive under one lock hold: the reply cannot slip past between them */
+    mach_msg_return_t mr = MACH_MSG_SUCCESS;
+    if (option & MACH_SEND_MSG) {
+        mr = msg_send(msg, send_size, complex, (option & MACH_SEND_TIMEOUT) && !timeout,
+                      (option & MACH_SEND_TIMEOUT) && timed ? &deadline : NULL);
+    }
+    if (mr == MACH_MSG_SUCCESS && (option & MACH_RCV_MSG)) {
+        return msg_receive(msg, option, rcv_size, rcv_name, (option & MACH_RCV_TIMEOUT) && !timeout,
+                           (option & MACH_RCV_TIMEOUT) && timed ? &deadline : NULL);
+    }
+
+    space_unlock();
+    return mr;
+}
+
+kern_return_t mach_msg_trap(mach_msg_header_t* msg, uint32_t option, uint32_t send_size,
+                             uint32_t rcv_size, mach_port_t rcv_name, uint32_t timeout, mach_port_t notify) {
+    return mach_msg(msg, option, send_size, rcv_size, rcv_name, timeout, notify);
+}
+
+mach_port_t mach_reply_port(void) {
+    mach_port_name_t name = MACH_PORT_NULL;
+    mach_space_get();
+    if (mach_port_allocate(g_space.task_name, MACH_PORT_RIGHT_RECEIVE, &name) != KERN_SUCCESS) {
+        return MACH_PORT_NULL;
+    }
+    return name;
+}
+
+kern_return_t mach_port_allocate(mach_port_t task, mach_port_right_t right, mach_port_name_t* out_name) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+    if (!out_name) {
+        return KERN_INVALID_ARGUMENT;
+    }
+
+    void* object = NULL;
+    mach_port_type_t type = MACH_PORT_TYPE(right);
+    if (right == MACH_PORT_RIGHT_RECEIVE) {
+        object = port_alloc(PORT_ACTIVE);
+    } else if (right == MACH_PORT_RIGHT_PORT_SET) {
+        object = calloc(1, sizeof(mach_pset_t));
+    } else if (right != MACH_PORT_RIGHT_DEAD_NAME) {
+        return KERN_INVALID_VALUE;
+    }
+    if (right != MACH_PORT_RIGHT_DEAD_NAME && !object) {
+        return KERN_RESOURCE_SHORTAGE;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+    mach_port_name_t name = entry_alloc(object, type, right == MACH_PORT_RIGHT_DEAD_NAME ? 1 : 0);
+    if (name && right == MACH_PORT_RIGHT_RECEIVE) {
+        ((mach_port_obj_t*)object)->refs = 1;
+        ((mach_port_obj_t*)object)->name = name;
+        g_space.stats.ports_allocated++;
+    }
+    space_unlock();
+
+    if (!name) {
+        free(object);
+        return KERN_NO_SPACE;
+    }
+    *out_name = name;
+    return KERN_SUCCESS;
+}
+
+/* Adjust user references on a send or dead-name right; the name goes when they reach zero */
+static kern_return_t entry_mod_urefs(mach_port_entry_t* entry, mach_port_type_t bit, int delta) {
+    int urefs = (int)entry->urefs + delta;
+    if (urefs < 0) {
+        return KERN_INVALID_VALUE;
+    }
+    if (urefs > MACH_UREFS_MAX) {
+        return KERN_UREFS_OVERFLOW;
+    }
+
+    entry->urefs = (uint16_t)urefs;
+    if (urefs == 0) {
+        if (bit == MACH_PORT_TYPE_DEAD_NAME) {
+            entry_free(entry);
+        } else {
+            mach_port_obj_t* port = entry->object;
+            if (entry_drop(entry, bit)) {
+                port_release(port);
+            }
+        }
+    }
+    return KERN_SUCCESS;
+}
+
+static kern_return_t mod_refs_locked(mach_port_name_t name, mach_port_right_t right, int delta) {
+    mach_port_entry_t* entry = entry_lookup(name);
+    mach_port_type_t bit = MACH_PORT_TYPE(right);
+    if (!entry) {
+        return KERN_INVALID_NAME;
+    }
+    if (!(entry->type & bit)) {
+        return KERN_INVALID_RIGHT;
+    }
+    if (delta == 0) {
+        return KERN_SUCCESS;
+    }
+    if (right == MACH_PORT_RIGHT_SEND || right == MACH_PORT_RIGHT_DEAD_NAME) {
+        return entry_mod_urefs(entry, bit, delta);
+    }
+    if (delta != -1) {
+        return KERN_INVALID_VALUE;
+    }
+
+    if (right == MACH_PORT_RIGHT_PORT_SET) {
+        pset_destroy(entry->object);
+        entry_free(entry);
+    } else if (right == MACH_PORT_RIGHT_SEND_ONCE) {
+        mach_port_obj_t* port = entry->object;
+        entry_free(entry);
+        send_once_notify(port);
+    } else {
+        /* Destroying the receive right: send rights under the same name become a dead name */
+        mach_port_obj_t* port = entry->object;
+        entry->type &= ~MACH_PORT_TYPE_RECEIVE;
+        port_destroy(port);
+        if (entry->type) {
+            entry_kill(entry);
+        } else {
+            port->name = MACH_PORT_NULL;
+            entry_free(entry);
+            port_release(port);
+        }
+    }
+    return KERN_SUCCESS;
+}
+
+kern_return_t mach_port_mod_refs(mach_port_t task, mach_port_name_t name, mach_port_right_t right, int delta) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+    if (right > MACH_PORT_RIGHT_DEAD_NAME) {
+        return KERN_INVALID_VALUE;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+    kern_return_t kr = mod_refs_locked(name, right, delta);
+    space_unlock();
+    return kr;
+}
+
+/* Releases one user reference on whichever send, send-once or dead-name right the name holds */
+kern_return_t mach_port_deallocate(mach_port_t task, mach_port_name_t name) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+
+    kern_return_t kr = KERN_INVALID_NAME;
+    mach_port_entry_t* entry = entry_lookup(name);
+    if (entry) {
+        mach_port_type_t type = entry->type;
+        kr = (type & MACH_PORT_TYPE_SEND) ? mod_refs_locked(name, MACH_PORT_RIGHT_SEND, -1) :
+             (type & MACH_PORT_TYPE_SEND_ONCE) ? mod_refs_locked(name, MACH_PORT_RIGHT_SEND_ONCE, -1) :
+             (type & MACH_PORT_TYPE_DEAD_NAME) ? mod_refs_locked(name, MACH_PORT_RIGHT_DEAD_NAME, -1) :
+             KERN_INVALID_RIGHT;
+    }
+
+    space_unlock();
+    return kr;
+}
+
+/* Only send rights under the port's own name, the way mach_port_insert_right is used in practice */
+kern_return_t mach_port_insert_right(mach_port_t task, mach_port_name_t name, mach_port_t port,
+                                     uint32_t disposition) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+    if (name != port || disposition_type(disposition) != MACH_MSG_TYPE_PORT_SEND ||
+        !disposition_valid(disposition)) {
+        return KERN_INVALID_VALUE;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+
+    kern_return_t kr = KERN_SUCCESS;
+    mach_port_entry_t* entry = entry_lookup(name);
+    if (!entry) {
+        kr = KERN_INVALID_NAME;
+    } else if (!right_copyin(name, disposition, false)) {
+        kr = KERN_INVALID_RIGHT;
+    } else if ((entry->type & MACH_PORT_TYPE_SEND) && entry->urefs == MACH_UREFS_MAX &&
+               disposition != MACH_MSG_TYPE_MOVE_SEND) {
+        kr = KERN_UREFS_OVERFLOW;
+    } else {
+        right_copyout(right_copyin(name, disposition, true), MACH_MSG_TYPE_PORT_SEND);
+    }
+
+    space_unlock();
+    return kr;
+}
+
+kern_return_t mach_port_move_member(mach_port_t task, mach_port_name_t member, mach_port_name_t after) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    g_space.stats.traps++;
+
+    kern_return_t kr = KERN_SUCCESS;
+    mach_port_entry_t* entry = entry_lookup(member);
+    mach_port_entry_t* set_entry = after ? entry_lookup(after) : NULL;
+    if (!entry || (after && !set_entry)) {
+        kr = KERN_INVALID_NAME;
+    } else if (!(entry->type & MACH_PORT_TYPE_RECEIVE) ||
+               (set_entry && !(set_entry->type & MACH_PORT_TYPE_PORT_SET))) {
+        kr = KERN_INVALID_RIGHT;
+    } else {
+        mach_port_obj_t* port = entry->object;
+        if (!after && !port->pset) {
+            kr = KERN_NOT_IN_SET;
+        } else {
+            port_leave_set(port);
+            if (set_entry) {
+                port_join_set(port, set_entry->object);
+            }
+        }
+    }
+
+    space_unlock();
+    return kr;
+}
+
+kern_return_t mach_port_type(mach_port_t task, mach_port_name_t name, mach_port_type_t* out_type) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+    if (!out_type) {
+        return KERN_INVALID_ARGUMENT;
+    }
+
+    pthread_mutex_lock(&g_space.lock);
+    mach_port_entry_t* entry = entry_lookup(name);
+    if (entry) {
+        *out_type = entry->type;
+    }
+    space_unlock();
+    return entry ? KERN_SUCCESS : KERN_INVALID_NAME;
+}
+
+kern_return_t vm_deallocate(mach_port_t task, uintptr_t address, size_t size) {
+    mach_space_get();
+    if (!task_valid(task)) {
+        return KERN_INVALID_TASK;
+    }
+    if (!size) {
+        return KERN_SUCCESS;
+    }
+
+    uintptr_t start = page_trunc(address);
+    return munmap((void*)start, page_round(address + size) - start) == 0 ? KERN_SUCCESS : KERN_INVALID_ADDRESS;
+}
+
+void mach_ipc_get_stats(mach_ipc_stats_t* out_stats) {
+    if (!out_stats) {
+        return;
+    }
+    pthread_mutex_lock(&g_space.lock);
+    *out_stats = g_space.stats;
+    space_unlock();
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+#define BENCH_MSG_ECHO      1000
+#define BENCH_MSG_OOL       1001
+#define BENCH_MSG_QUIT      1002
+#define BENCH_REPLY_BASE    100         /* MIG replies use the request id plus 100 */
+
+typedef struct bench_simple {
+    mach_msg_header_t head;
+    uint32_t arg;
+} bench_simple_t;
+
+typedef struct bench_ool {
+    mach_msg_header_t head;
+    mach_msg_body_t body;
+    mach_msg_ool_descriptor_t data;
+    uint32_t arg;
+} bench_ool_t;
+
+typedef union bench_buffer {
+    mach_msg_header_t head;
+    bench_simple_t simple;
+    bench_ool_t ool;
+    uint8_t bytes[sizeof(bench_ool_t) + sizeof(mach_msg_trailer_t)];
+} bench_buffer_t;
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * MIG-style server loop: each reply goes out in the same call that waits for
+ * the next request, which lands in the reply's buffer, so the two swap
+ */
+static void* bench_server(void* arg) {
+    mach_port_name_t set = *(mach_port_name_t*)arg;
+    bench_buffer_t buffers[2];
+    bench_buffer_t* in = &buffers[0];
+    bench_buffer_t* out = &buffers[1];
+
+    mach_msg_return_t mr = mach_msg(&in->head, MACH_RCV_MSG, 0, sizeof(*in), set, MACH_MSG_TIMEOUT_NONE,
+                                    MACH_PORT_NULL);
+    while (mr == MACH_MSG_SUCCESS) {
+        uint32_t id = in->head.msgh_id;
+        uint32_t size = sizeof(bench_simple_t);
+
+        memset(&out->ool, 0, sizeof(out->ool));
+        out->head.msgh_bits = MACH_MSGH_BITS(MACH_MSGH_BITS_REMOTE(in->head.msgh_bits), 0);
+        out->head.msgh_remote_port = in->head.msgh_remote_port;
+        out->head.msgh_id = id + BENCH_REPLY_BASE;
+
+        if (id == BENCH_MSG_OOL) {
+            /* Hand the region straight back, deallocating our copy of it */
+            out->head.msgh_bits |= MACH_MSGH_BITS_COMPLEX;
+            out->ool.body.msgh_descriptor_count = 1;
+            out->ool.data = in->ool.data;
+            out->ool.data.deallocate = 1;
+            out->ool.arg = in->ool.arg + 1;
+            size = sizeof(bench_ool_t);
+        } else {
+            out->simple.arg = in->simple.arg + 1;
+        }
+
+        if (id == BENCH_MSG_QUIT) {
+            mach_msg(&out->head, MACH_SEND_MSG, size, 0, MACH_PORT_NULL, MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+            break;
+        }
+        mr = mach_msg(&out->head, MACH_SEND_MSG | MACH_RCV_MSG, size, sizeof(*out), set,
+                      MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+
+        bench_buffer_t* next = out;
+        out = in;
+        in = next;
+    }
+    return NULL;
+}
+
+static mach_msg_return_t bench_call(bench_buffer_t* buf, mach_port_name_t service, mach_port_name_t reply,
+                                    uint32_t id, uint32_t size) {
+    buf->head.msgh_bits |= MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MAKE_SEND_ONCE);
+    buf->head.msgh_remote_port = service;
+    buf->head.msgh_local_port = reply;
+    buf->head.msgh_id = id;
+    mach_msg_return_t mr = mach_msg(&buf->head, MACH_SEND_MSG | MACH_RCV_MSG, size, sizeof(*buf), reply,
+                                    MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+    if (mr == MACH_MSG_SUCCESS && buf->head.msgh_id != id + BENCH_REPLY_BASE) {
+        mr = KERN_FAILURE;
+    }
+    return mr;
+}
+
+/* Times OOL round trips; move hands pages over both ways, copy duplicates them */
+static uint64_t bench_ool(mach_port_name_t service, mach_port_name_t reply, uint32_t iterations,
+                          uint32_t ool_bytes, bool move) {
+    uint8_t* region = mmap(NULL, ool_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return 0;
+    }
+    memset(region, 0x5A, ool_bytes);
+
+    bench_buffer_t buf;
+    uint64_t start = bench_now_ns();
+    uint32_t i;
+    for (i = 0; i < iterations; i++) {
+        memset(&buf.ool, 0, sizeof(buf.ool));
+        buf.head.msgh_bits = MACH_MSGH_BITS_COMPLEX;
+        buf.ool.body.msgh_descriptor_count = 1;
+        buf.ool.data.address = region;
+        buf.ool.data.size = ool_bytes;
+        buf.ool.data.deallocate = move;
+        buf.ool.data.copy = move ? MACH_MSG_VIRTUAL_COPY : MACH_MSG_PHYSICAL_COPY;
+        buf.ool.data.type = MACH_MSG_OOL_DESCRIPTOR;
+        buf.ool.arg = i;
+
+        if (bench_call(&buf, service, reply, BENCH_MSG_OOL, sizeof(bench_ool_t)) != MACH_MSG_SUCCESS ||
+            ((uint8_t*)buf.ool.data.address)[ool_bytes - 1] != 0x5A) {
+            break;
+        }
+        if (move) {
+            region = buf.ool.data.address;
+        } else {
+            vm_deallocate(g_space.task_name, (uintptr_t)buf.ool.data.address, ool_bytes);
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    munmap(region, ool_bytes);
+    return i == iterations ? elapsed / iterations : 0;
+}
+
+typedef struct bench_pipes {
+    int request[2];
+    int reply[2];
+} bench_pipes_t;
+
+static void* bench_pipe_server(void* arg) {
+    bench_pipes_t* pipes = arg;
+    uint32_t value;
+    while (read(pipes->request[0], &value, sizeof(value)) == sizeof(value) && value != UINT32_MAX) {
+        value++;
+        if (write(pipes->reply[1], &value, sizeof(value)) != sizeof(value)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t bench_pipe_rpc(uint32_t iterations) {
+    bench_pipes_t pipes;
+    if (pipe(pipes.request) != 0) {
+        return 0;
+    }
+    if (pipe(pipes.reply) != 0) {
+        close(pipes.request[0]);
+        close(pipes.request[1]);
+        return 0;
+    }
+
+    pthread_t server;
+    uint64_t result = 0;
+    if (pthread_create(&server, NULL, bench_pipe_server, &pipes) == 0) {
+        uint64_t start = bench_now_ns();
+        uint32_t i;
+        for (i = 0; i < iterations; i++) {
+            uint32_t value = i;
+            if (write(pipes.request[1], &value, sizeof(value)) != sizeof(value) ||
+                read(pipes.reply[0], &value, sizeof(value)) != sizeof(value) || value != i + 1) {
+                break;
+            }
+        }
+        if (i == iterations) {
+            result = (bench_now_ns() - start) / iterations;
+        }
+
+        uint32_t quit = UINT32_MAX;
+        if (write(pipes.request[1], &quit, sizeof(quit)) != sizeof(quit)) {
+            close(pipes.request[1]);
+            pipes.request[1] = -1;
+        }
+        pthread_join(server, NULL);
+    }
+
+    close(pipes.request[0]);
+    if (pipes.request[1] >= 0) {
+        close(pipes.request[1]);
+    }
+    close(pipes.reply[0]);
+    close(pipes.reply[1]);
+    return result;
+}
+
+int mach_ipc_benchmark(uint32_t iterations, uint32_t ool_bytes, mach_ipc_bench_result_t* out_result) {
+    if (!out_result || iterations == 0) {
+        return -1;
+    }
+    memset(out_result, 0, sizeof(*out_result));
+    if (mach_ipc_init(NULL) != 0) {
+        return -1;
+    }
+
+    mach_port_t task = g_space.task_name;
+    mach_port_name_t service = MACH_PORT_NULL;
+    mach_port_name_t set = MACH_PORT_NULL;
+    mach_port_name_t reply = mach_reply_port();
+    if (!reply ||
+        mach_port_allocate(task, MACH_PORT_RIGHT_RECEIVE, &service) != KERN_SUCCESS ||
+        mach_port_insert_right(task, service, service, MACH_MSG_TYPE_MAKE_SEND) != KERN_SUCCESS ||
+        mach_port_allocate(task, MACH_PORT_RIGHT_PORT_SET, &set) != KERN_SUCCESS ||
+        mach_port_move_member(task, service, set) != KERN_SUCCESS) {
+        return -1;
+    }
+
+    pthread_t server;
+    if (pthread_create(&server, NULL, bench_server, &set) != 0) {
+        return -1;
+    }
+
+    mach_ipc_stats_t before;
+    mach_ipc_get_stats(&before);
+
+    bench_buffer_t buf;
+    int result = 0;
+    uint64_t start = bench_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        buf.head.msgh_bits = 0;
+        buf.simple.arg = i;
+        if (bench_call(&buf, service, reply, BENCH_MSG_ECHO, sizeof(bench_simple_t)) != MACH_MSG_SUCCESS ||
+            buf.simple.arg != i + 1) {
+            result = -1;
+            break;
+        }
+    }
+    out_result->rpc_ns = (bench_now_ns() - start) / iterations;
+
+    if (result == 0 && ool_bytes) {
+        out_result->rpc_ool_move_ns = bench_ool(service, reply, iterations, ool_bytes, true);
+        out_result->rpc_ool_copy_ns = bench_ool(service, reply, iterations, ool_bytes, false);
+        if (!out_result->rpc_ool_move_ns || !out_result->rpc_ool_copy_ns) {
+            result = -1;
+        }
+    }
+
+    mach_ipc_stats_t after;
+    mach_ipc_get_stats(&after);
+    out_result->handoffs = after.handoffs - before.handoffs;
+
+    /* The server answers quit even after a failure, so the join always returns */
+    buf.head.msgh_bits = 0;
+    if (bench_call(&buf, service, reply, BENCH_MSG_QUIT, sizeof(bench_simple_t)) != MACH_MSG_SUCCESS) {
+        mach_port_mod_refs(task, set, MACH_PORT_RIGHT_PORT_SET, -1);
+        set = MACH_PORT_NULL;
+    }
+    pthread_join(server, NULL);
+
+    if (set) {
+        mach_port_mod_refs(task, set, MACH_PORT_RIGHT_PORT_SET, -1);
+    }
+    mach_port_mod_refs(task, service, MACH_PORT_RIGHT_RECEIVE, -1);
+    mach_port_deallocate(task, service);
+    mach_port_mod_refs(task, reply, MACH_PORT_RIGHT_RECEIVE, -1);
+
+    out_result->pipe_rpc_ns = bench_pipe_rpc(iterations);
+    return result;
+}
@@ -24,11 +24,10 @@ int macos_persona_init(void) {
     g_macos_ctx.max_fds = 1024;
     g_macos_ctx.darwin_errno = 0;
 
-    /* Initialize Mach ports (fake for now) */
-    g_macos_ctx.task_port = 0x1000;
-    g_macos_ctx.thread_port = 0x2000;
-    g_macos_ctx.host_port = 0x3000;
-    g_macos_ctx.bootstrap_port = 0x4000;
+    /* Task, thread, host and bootstrap ports come from the task's IPC space */
+    if (mach_ipc_init(&g_macos_ctx) != 0) {
+        return -1;
+    }
 
     return 0;
 }
@@ -199,6 +198,50 @@ int darwin_fork(void) {
     return result;
 }
 
+/* vfork + execve is the common launch idiom; the child borrows our memory instead of copying it */
+int darwin_vfork(void) {
+    pid_t result = posix_vfork();
+
+    if (result < 0) {
+        darwin_errno = posix_errno_to_darwin(errno);
+        return -1;
+    }
+
+    g_macos_stats.syscalls_translated++;
+    g_macos_stats.bsd_syscalls++;
+
+    if (result == 0) {
+        g_macos_ctx.pid = getpid();
+        g_macos_ctx.ppid = getppid();
+    } else {
+        g_macos_stats.processes_created++;
+    }
+
+    return result;
+}
+
+/* Darwin's file action and attribute lists use the persona's posix_spawn layout */
+int darwin_posix_spawn(int* pid, const char* path, const void* file_actions,
+                       const void* attr, char* const argv[], char* const envp[]) {
+    pid_t child;
+    int error = posix_spawn(&child, path, (const posix_spawn_file_actions_t*)file_actions,
+                            (const posix_spawnattr_t*)attr, argv, envp);
+
+    g_macos_stats.syscalls_translated++;
+    g_macos_stats.bsd_syscalls++;
+
+    if (error != 0) {
+        darwin_errno = posix_errno_to_darwin(error);
+        return -1;
+    }
+
+    if (pid) {
+        *pid = child;
+    }
+    g_macos_stats.processes_created++;
+    return 0;
+}
+
 int darwin_execve(const char* path, char* const argv[], char* const envp[]) {
     int result = execve(path, argv, envp);
 
@@ -466,31 +509,6 @@ mach_port_t mach_host_self(void) {
     return g_macos_ctx.host_port;
 }
 
-mach_port_t mach_reply_port(void) {
-    g_macos_stats.syscalls_translated++;
-    g_macos_stats.mach_traps++;
-    /* Allocate new reply port */
-    static mach_port_t next_port = 0x5000;
-    return next_port++;
-}
-
-kern_return_t mach_msg_trap(mach_msg_header_t* msg, uint32_t option, uint32_t send_size,
-                             uint32_t rcv_size, mach_port_t rcv_name, uint32_t timeout, mach_port_t notify) {
-    (void)msg;
-    (void)option;
-    (void)send_size;
-    (void)rcv_size;
-    (void)rcv_name;
-    (void)timeout;
-    (void)notify;
-
-    g_macos_stats.syscalls_translated++;
-    g_macos_stats.mach_traps++;
-
-    /* Stub - mach_msg requires full Mach IPC implementation */
-    return KERN_FAILURE;
-}
-
 kern_return_t task_for_pid(mach_port_t target_tport, int pid, mach_port_t* t) {
     (void)target_tport;
     (void)pid;
@@ -554,6 +572,13 @@ long darwin_syscall(long number, long arg1, long arg2, long arg3, long arg4, lon
         case DARWIN_SYS_fork:
             return darwin_fork();
 
+        case DARWIN_SYS_vfork:
+            return darwin_vfork();
+
+        case DARWIN_SYS_posix_spawn:
+            return darwin_posix_spawn((int*)arg1, (const char*)arg2, (const void*)arg3,
+                                      (const void*)arg4, (char* const*)arg5, (char* const*)arg6);
+
         case DARWIN_SYS_read:
             return darwin_read((int)arg1, (void*)arg2, (size_t)arg3);
 
@@ -617,6 +642,23 @@ long darwin_syscall(long number, long arg1, long arg2, long arg3, long arg4, lon
         case DARWIN_SYS_mprotect:
             return darwin_mprotect((void*)arg1, (size_t)arg2, (int)arg3);
 
+        case MACH_TRAP_mach_reply_port:
+            return mach_reply_port();
+
+        case MACH_TRAP_mach_thread_self:
+            return mach_thread_self();
+
+        case MACH_TRAP_mach_task_self:
+            return mach_task_self();
+
+        case MACH_TRAP_mach_host_self:
+            return mach_host_self();
+
+        case MACH_TRAP_mach_msg_trap:
+            /* The notify port is the trap's seventh argument; nothing here uses it */
+            return mach_msg_trap((mach_msg_header_t*)arg1, (uint32_t)arg2, (uint32_t)arg3, (uint32_t)arg4,
+                                 (mach_port_t)arg5, (uint32_t)arg6, MACH_PORT_NULL);
+
         default:
             darwin_errno = DARWIN_ENOSYS;
             return -1;
@@ -629,7 +671,10 @@ int macos_get_stats(macos_stats_t* out_stats) {
 
     out_stats->syscalls_translated = g_macos_stats.syscalls_translated;
     out_stats->bsd_syscalls = g_macos_stats.bsd_syscalls;
-    out_stats->mach_traps = g_macos_stats.mach_traps;
+    mach_ipc_stats_t ipc;
+    mach_ipc_get_stats(&ipc);
+
+    out_stats->mach_traps = g_macos_stats.mach_traps + ipc.traps;
     out_stats->files_opened = g_macos_stats.files_opened;
     out_stats->processes_created = g_macos_stats.processes_created;
     out_stats->mmap_calls = g_macos_stats.mmap_calls;
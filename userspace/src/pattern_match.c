@@ -0,0 +1,267 @@
+/*
+ * Multi-Pattern Matcher Implementation
+ * Aho-Corasick trie compiled to a byte-class transition table
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pattern_match.h"
+
+/* Trie node; children are kept as a sibling list until compiled */
+typedef struct pm_node {
+    int32_t child;              // First child
+    int32_t sibling;            // Next child of the same parent
+    int32_t pattern;            // First pattern ending here, -1 if none
+    uint8_t cls;                // Byte class of the edge into this node
+} pm_node_t;
+
+typedef struct pm_pattern {
+    uint32_t table;
+    uint32_t value;
+    int32_t priority;
+    int32_t next;               // Next pattern ending at the same node
+} pm_pattern_t;
+
+struct pattern_set {
+    pm_node_t* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+
+    pm_pattern_t* patterns;
+    uint32_t pattern_count;
+    uint32_t pattern_capacity;
+
+    /* Bytes that occur in no pattern share class 0; case pairs share a class */
+    uint8_t cls[256];
+    uint32_t classes;
+
+    /* Compiled automaton, node_count x classes */
+    int32_t* delta;
+    int32_t* report;            // Node whose patterns to report on entry, 0 if none
+    int32_t* dict;              // Next node on the failure chain with patterns
+    bool dirty;
+};
+
+static uint8_t fold(uint8_t c) {
+    return (c >= 'A' && c <= 'Z') ? (uint8_t)(c + ('a' - 'A')) : c;
+}
+
+static int grow(void** array, uint32_t* capacity, uint32_t needed, size_t size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    uint32_t cap = *capacity ? *capacity : 64;
+    while (cap < needed) {
+        cap *= 2;
+    }
+    void* p = realloc(*array, (size_t)cap * size);
+    if (!p) {
+        return -1;
+    }
+    *array = p;
+    *capacity = cap;
+    return 0;
+}
+
+/* Create pattern set */
+pattern_set_t* pattern_set_create(void) {
+    pattern_set_t* set = (pattern_set_t*)calloc(1, sizeof(pattern_set_t));
+    if (!set) {
+        return NULL;
+    }
+    if (grow((void**)&set->nodes, &set->node_capacity, 1, sizeof(pm_node_t)) < 0) {
+        free(set);
+        return NULL;
+    }
+    set->nodes[0] = (pm_node_t){ .child = -1, .sibling = -1, .pattern = -1, .cls = 0 };
+    set->node_count = 1;
+    set->classes = 1;
+    set->dirty = true;
+    return set;
+}
+
+/* Destroy pattern set */
+void pattern_set_destroy(pattern_set_t* set) {
+    if (!set) {
+        return;
+    }
+    free(set->nodes);
+    free(set->patterns);
+    free(set->delta);
+    free(set->report);
+    free(set->dict);
+    free(set);
+}
+
+/* Add pattern */
+int pattern_set_add(pattern_set_t* set, const char* pattern, uint32_t table, uint32_t value, int32_t priority) {
+    if (!set || !pattern) {
+        return -1;
+    }
+    size_t len = strlen(pattern);
+    if (len == 0 || len > PATTERN_MAX_LENGTH) {
+        return -1;
+    }
+
+    /* Reserve up front so a failed allocation never leaves half a path */
+    if (grow((void**)&set->nodes, &set->node_capacity, set->node_count + (uint32_t)len, sizeof(pm_node_t)) < 0 ||
+        grow((void**)&set->patterns, &set->pattern_capacity, set->pattern_count + 1, sizeof(pm_pattern_t)) < 0) {
+        return -1;
+    }
+
+    int32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = fold((uint8_t)pattern[i]);
+        if (!set->cls[c]) {
+            set->cls[c] = (uint8_t)set->classes;
+            if (c >= 'a' && c <= 'z') {
+                set->cls[c - ('a' - 'A')] = (uint8_t)set->classes;
+            }
+            set->classes++;
+        }
+
+        int32_t next = set->nodes[node].child;
+        while (next >= 0 && set->nodes[next].cls != set->cls[c]) {
+            next = set->nodes[next].sibling;
+        }
+        if (next < 0) {
+            next = (int32_t)set->node_count++;
+            set->nodes[next] = (pm_node_t){
+                .child = -1,
+                .sibling = set->nodes[node].child,
+                .pattern = -1,
+                .cls = set->cls[c],
+            };
+            set->nodes[node].child = next;
+        }
+        node = next;
+    }
+
+    int32_t index = (int32_t)set->pattern_count++;
+    set->patterns[index] = (pm_pattern_t){
+        .table = table,
+        .value = value,
+        .priority = priority,
+        .next = set->nodes[node].pattern,
+    };
+    set->nodes[node].pattern = index;
+    set->dirty = true;
+    return 0;
+}
+
+/* Compute failure links breadth-first and fill the transition table */
+int pattern_set_compile(pattern_set_t* set) {
+    if (!set) {
+        return -1;
+    }
+    if (!set->dirty) {
+        return 0;
+    }
+
+    uint32_t n = set->node_count;
+    uint32_t nc = set->classes;
+    int32_t* delta = (int32_t*)malloc((size_t)n * nc * sizeof(int32_t));
+    int32_t* report = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+    int32_t* dict = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+    int32_t* fail = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+    int32_t* queue = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+    if (!delta || !report || !dict || !fail || !queue) {
+        free(delta);
+        free(report);
+        free(dict);
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    memset(delta, 0, (size_t)nc * sizeof(int32_t));
+    report[0] = 0;
+    dict[0] = 0;
+    fail[0] = 0;
+
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        int32_t u = queue[head++];
+        int32_t* row = delta + (size_t)u * nc;
+
+        /* Missing edges follow the failure link, whose row is already final */
+        if (u != 0) {
+            memcpy(row, delta + (size_t)fail[u] * nc, (size_t)nc * sizeof(int32_t));
+        }
+
+        for (int32_t v = set->nodes[u].child; v >= 0; v = set->nodes[v].sibling) {
+            uint8_t c = set->nodes[v].cls;
+            int32_t f = (u == 0) ? 0 : row[c];
+            fail[v] = f;
+            dict[v] = set->nodes[f].pattern >= 0 ? f : dict[f];
+            report[v] = set->nodes[v].pattern >= 0 ? v : dict[v];
+            row[c] = v;
+            queue[tail++] = v;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    free(set->delta);
+    free(set->report);
+    free(set->dict);
+    set->delta = delta;
+    set->report = report;
+    set->dict = dict;
+    set->dirty = false;
+    return 0;
+}
+
+/* Scan text */
+size_t pattern_set_scan(pattern_set_t* set, const char* text, pattern_match_fn fn, void* arg) {
+    if (!set || !text) {
+        return 0;
+    }
+    if (set->dirty && pattern_set_compile(set) < 0) {
+        return 0;
+    }
+
+    const int32_t* delta = set->delta;
+    const int32_t* report = set->report;
+    const uint8_t* cls = set->cls;
+    size_t nc = set->classes;
+    size_t found = 0;
+    int32_t state = 0;
+
+    for (const uint8_t* p = (const uint8_t*)text; *p; p++) {
+        state = delta[(size_t)state * nc + cls[*p]];
+        if (!report[state]) {
+            continue;
+        }
+        for (int32_t t = report[state]; t; t = set->dict[t]) {
+            for (int32_t i = set->nodes[t].pattern; i >= 0; i = set->patterns[i].next) {
+                found++;
+                if (fn) {
+                    const pm_pattern_t* pat = &set->patterns[i];
+                    pattern_match_t match = {
+                        .table = pat->table,
+                        .value = pat->value,
+                        .priority = pat->priority,
+                        .end = (uint32_t)(p - (const uint8_t*)text + 1),
+                    };
+                    if (!fn(&match, arg)) {
+                        return found;
+                    }
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/* Number of patterns */
+uint32_t pattern_set_count(const pattern_set_t* set) {
+    return set ? set->pattern_count : 0;
+}
+
+/* Number of automaton states */
+uint32_t pattern_set_states(const pattern_set_t* set) {
+    return set ? set->node_count : 0;
+}
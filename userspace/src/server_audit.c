@@ -0,0 +1,923 @@
+/*
+ * Server Edition Audit Log
+ * Lock-free event queue drained by a writer thread into a segmented,
+ * append-only on-disk store with a sparse timestamp index
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef SERVER_AUDIT_COMPRESS
+#include <zlib.h>
+#endif
+#include "server_edition.h"
+
+#define AUDIT_DEFAULT_DIR        "/var/log/limitless/audit"
+#define AUDIT_QUEUE_SIZE         4096                /* Power of two */
+#define AUDIT_QUEUE_MASK         (AUDIT_QUEUE_SIZE - 1)
+#define AUDIT_SEGMENT_MAX_BYTES  (16 * 1024 * 1024)
+#define AUDIT_MAX_SEGMENTS       1024                /* Oldest segment retired beyond this */
+#define AUDIT_INDEX_STRIDE       64                  /* One index entry per N records */
+#define AUDIT_WRITE_BUFFER       (64 * 1024)
+#define AUDIT_IDLE_WAIT_NS       10000000ULL         /* Writer idle poll (10 ms) */
+#define AUDIT_FLUSH_TIMEOUT_US   1000000ULL
+#define AUDIT_ENQUEUE_WAIT_US    20000ULL            /* Caller waits this long on a full queue */
+#define AUDIT_RECORD_MAGIC       0x52445541          /* "AUDR" */
+
+/* Queue slot; sequence implements the bounded MPSC ring handshake */
+typedef struct audit_slot {
+    uint64_t sequence;
+    audit_entry_t entry;
+} audit_slot_t;
+
+/* On-disk record: header followed by the unterminated string fields */
+typedef struct audit_record_header {
+    uint32_t magic;
+    uint16_t length;           /* Header + payload */
+    uint8_t type;
+    uint8_t success;
+    uint64_t id;
+    uint64_t timestamp;
+    uint16_t user_len;
+    uint16_t source_ip_len;
+    uint16_t action_len;
+    uint16_t resource_len;
+    uint16_t details_len;
+    uint16_t reserved[3];
+} audit_record_header_t;
+
+/* Segment file */
+typedef struct audit_segment {
+    uint32_t number;
+    uint64_t bytes;            /* Uncompressed size */
+    bool compressed;
+} audit_segment_t;
+
+/* Sparse timestamp index entry */
+typedef struct audit_index_entry {
+    uint64_t timestamp;
+    uint32_t segment;          /* Position in segments[] */
+    uint32_t offset;           /* Uncompressed byte offset in segment */
+} audit_index_entry_t;
+
+/* Segment reader (zlib reads plain and compressed segments alike) */
+typedef struct audit_reader {
+#ifdef SERVER_AUDIT_COMPRESS
+    gzFile file;
+#else
+    FILE* file;
+#endif
+} audit_reader_t;
+
+static struct {
+    bool running;
+    char directory[256];
+
+    /* Event queue */
+    audit_slot_t* queue;
+    uint64_t enqueue_pos;
+    uint64_t dequeue_pos;      /* Writer thread only */
+    uint64_t committed;        /* Records handled: durable, or lost to a failed write */
+    uint64_t dropped;          /* Records lost to a full queue */
+    uint64_t dropped_logged;   /* Drops already recorded in the log (writer only) */
+    uint64_t next_id;
+
+    /* Writer thread */
+    pthread_t writer;
+    sem_t wakeup;
+    uint32_t writer_idle;
+
+    /* Callers blocked on a full queue or a flush; the writer signals progress */
+    pthread_mutex_t progress_lock;
+    pthread_cond_t progress;
+    uint32_t progress_waiters;
+    int fd;
+    uint8_t* buffer;
+    size_t buffered;
+
+    /* Segments and index (written by the writer, read under index_lock) */
+    pthread_rwlock_t index_lock;
+    audit_segment_t segments[AUDIT_MAX_SEGMENTS];
+    uint32_t segment_count;
+    audit_index_entry_t* index;
+    uint32_t index_count;
+    uint32_t index_capacity;
+    uint64_t records_written;
+} audit_state = { .fd = -1 };
+
+/* Absolute CLOCK_MONOTONIC deadline for the progress condition */
+static void audit_deadline(struct timespec* deadline, uint64_t timeout_us) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += (time_t)(timeout_us / 1000000ULL);
+    deadline->tv_nsec += (long)(timeout_us % 1000000ULL) * 1000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/* Get current timestamp (microseconds) */
+static uint64_t get_timestamp_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void audit_segment_path(const audit_segment_t* segment, bool compressed,
+                               char* path, size_t size) {
+    snprintf(path, size, "%s/audit-%08u.seg%s", audit_state.directory,
+             segment->number, compressed ? ".gz" : "");
+}
+
+static int audit_mkdirs(const char* dir) {
+    char path[256];
+    strncpy(path, dir, sizeof(path) - 1);
+    path[sizeof(path) - 1] = '\0';
+
+    for (char* p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(path, 0750) < 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+
+    if (mkdir(path, 0750) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Reader helpers */
+static int audit_reader_open(audit_reader_t* reader, const audit_segment_t* segment,
+                             uint32_t offset) {
+    char path[320];
+    audit_segment_path(segment, segment->compressed, path, sizeof(path));
+
+#ifdef SERVER_AUDIT_COMPRESS
+    reader->file = gzopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    if (offset && gzseek(reader->file, offset, SEEK_SET) < 0) {
+        gzclose(reader->file);
+        return -1;
+    }
+#else
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    if (offset && fseek(reader->file, offset, SEEK_SET) != 0) {
+        fclose(reader->file);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static size_t audit_reader_read(audit_reader_t* reader, void* buf, size_t len) {
+#ifdef SERVER_AUDIT_COMPRESS
+    int n = gzread(reader->file, buf, (unsigned)len);
+    return n > 0 ? (size_t)n : 0;
+#else
+    return fread(buf, 1, len, reader->file);
+#endif
+}
+
+static void audit_reader_close(audit_reader_t* reader) {
+#ifdef SERVER_AUDIT_COMPRESS
+    gzclose(reader->file);
+#else
+    fclose(reader->file);
+#endif
+}
+
+/* Read and decode the next record; false at end of segment or torn tail */
+static bool audit_read_record(audit_reader_t* reader, audit_entry_t* entry, size_t* out_len) {
+    audit_record_header_t hdr;
+    if (audit_reader_read(reader, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.magic != AUDIT_RECORD_MAGIC) {
+        return false;
+    }
+
+    struct {
+        char* dest;
+        size_t size;
+        uint16_t len;
+    } fields[] = {
+        { entry->user, sizeof(entry->user), hdr.user_len },
+        { entry->source_ip, sizeof(entry->source_ip), hdr.source_ip_len },
+        { entry->action, sizeof(entry->action), hdr.action_len },
+        { entry->resource, sizeof(entry->resource), hdr.resource_len },
+        { entry->details, sizeof(entry->details), hdr.details_len },
+    };
+
+    size_t payload = 0;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (fields[i].len >= fields[i].size ||
+            audit_reader_read(reader, fields[i].dest, fields[i].len) != fields[i].len) {
+            return false;
+        }
+        fields[i].dest[fields[i].len] = '\0';
+        payload += fields[i].len;
+    }
+
+    if (sizeof(hdr) + payload != hdr.length) {
+        return false;
+    }
+
+    entry->id = hdr.id;
+    entry->type = (audit_event_type_t)hdr.type;
+    entry->timestamp = hdr.timestamp;
+    entry->success = hdr.success != 0;
+
+    if (out_len) {
+        *out_len = hdr.length;
+    }
+    return true;
+}
+
+/* Append an index entry (caller holds index_lock for writing) */
+static void audit_index_add(uint64_t timestamp, uint32_t segment, uint32_t offset) {
+    if (audit_state.index_count == audit_state.index_capacity) {
+        uint32_t capacity = audit_state.index_capacity ? audit_state.index_capacity * 2 : 1024;
+        audit_index_entry_t* index = realloc(audit_state.index, capacity * sizeof(*index));
+        if (!index) {
+            return;
+        }
+        audit_state.index = index;
+        audit_state.index_capacity = capacity;
+    }
+
+    audit_index_entry_t* entry = &audit_state.index[audit_state.index_count++];
+    entry->timestamp = timestamp;
+    entry->segment = segment;
+    entry->offset = offset;
+}
+
+/* Drop the oldest segment and its index entries (caller holds index_lock) */
+static void audit_retire_oldest(void) {
+    char path[320];
+    audit_segment_path(&audit_state.segments[0], audit_state.segments[0].compressed,
+                       path, sizeof(path));
+    unlink(path);
+
+    memmove(&audit_state.segments[0], &audit_state.segments[1],
+            (audit_state.segment_count - 1) * sizeof(audit_segment_t));
+    audit_state.segment_count--;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < audit_state.index_count; i++) {
+        if (audit_state.index[i].segment == 0) {
+            continue;
+        }
+        audit_state.index[kept] = audit_state.index[i];
+        audit_state.index[kept].segment--;
+        kept++;
+    }
+    audit_state.index_count = kept;
+}
+
+#ifdef SERVER_AUDIT_COMPRESS
+/* Compress a sealed segment; readers switch over once the flag flips */
+static void audit_compress_segment(uint32_t position) {
+    audit_segment_t segment = audit_state.segments[position];
+    char plain_path[320];
+    char gz_path[320];
+    audit_segment_path(&segment, false, plain_path, sizeof(plain_path));
+    audit_segment_path(&segment, true, gz_path, sizeof(gz_path));
+
+    FILE* in = fopen(plain_path, "rb");
+    gzFile out = gzopen(gz_path, "wb6");
+    if (!in || !out) {
+        if (in) fclose(in);
+        if (out) gzclose(out);
+        unlink(gz_path);
+        return;
+    }
+
+    char chunk[16384];
+    size_t n;
+    bool ok = true;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+        if (gzwrite(out, chunk, (unsigned)n) != (int)n) {
+            ok = false;
+            break;
+        }
+    }
+    fclose(in);
+    ok = (gzclose(out) == Z_OK) && ok;
+
+    if (!ok) {
+        unlink(gz_path);
+        return;
+    }
+
+    pthread_rwlock_wrlock(&audit_state.index_lock);
+    /* Segment may have been retired meanwhile; match by number */
+    for (uint32_t i = 0; i < audit_state.segment_count; i++) {
+        if (audit_state.segments[i].number == segment.number) {
+            audit_state.segments[i].compressed = true;
+            unlink(plain_path);
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&audit_state.index_lock);
+}
+#endif
+
+/* Wake callers waiting for queue space or a flush (writer only) */
+static void audit_signal_progress(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&audit_state.progress_waiters, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&audit_state.progress_lock);
+        pthread_cond_broadcast(&audit_state.progress);
+        pthread_mutex_unlock(&audit_state.progress_lock);
+    }
+}
+
+/*
+ * Write out buffered records and make them durable as one group. Every
+ * record dequeued so far is counted as handled even when the write fails,
+ * so flushes never wait on records that will not reach the disk.
+ */
+static int audit_commit_buffer(uint64_t* pending) {
+    int result = 0;
+
+    /* Slots behind dequeue_pos are already free */
+    audit_signal_progress();
+
+    size_t done = 0;
+    while (audit_state.fd >= 0 && done < audit_state.buffered) {
+        ssize_t n = write(audit_state.fd, audit_state.buffer + done, audit_state.buffered - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        done += (size_t)n;
+    }
+    if (audit_state.fd >= 0 && done) {
+        fdatasync(audit_state.fd);
+    }
+    audit_state.buffered = 0;
+
+    __atomic_add_fetch(&audit_state.committed, *pending, __ATOMIC_RELEASE);
+    *pending = 0;
+    audit_signal_progress();
+    return result;
+}
+
+/* Open a fresh segment, sealing the current one */
+static int audit_rotate(void) {
+    uint32_t sealed = UINT32_MAX;
+    if (audit_state.fd >= 0) {
+        close(audit_state.fd);
+        audit_state.fd = -1;
+        sealed = audit_state.segment_count - 1;
+    }
+
+    pthread_rwlock_wrlock(&audit_state.index_lock);
+    if (audit_state.segment_count == AUDIT_MAX_SEGMENTS) {
+        audit_retire_oldest();
+        if (sealed != UINT32_MAX) {
+            sealed--;
+        }
+    }
+
+    audit_segment_t* segment = &audit_state.segments[audit_state.segment_count];
+    segment->number = audit_state.segment_count ?
+                      audit_state.segments[audit_state.segment_count - 1].number + 1 : 0;
+    segment->bytes = 0;
+    segment->compressed = false;
+
+    char path[320];
+    audit_segment_path(segment, false, path, sizeof(path));
+    audit_state.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0640);
+    if (audit_state.fd >= 0) {
+        audit_state.segment_count++;
+    }
+    pthread_rwlock_unlock(&audit_state.index_lock);
+
+#ifdef SERVER_AUDIT_COMPRESS
+    if (sealed != UINT32_MAX) {
+        audit_compress_segment(sealed);
+    }
+#else
+    (void)sealed;
+#endif
+
+    return audit_state.fd >= 0 ? 0 : -1;
+}
+
+/*
+ * Encode one entry into the write buffer. pending counts the dequeued
+ * records not yet committed; the caller adds this entry to it afterwards.
+ */
+static void audit_encode(const audit_entry_t* entry, uint64_t* pending) {
+    audit_record_header_t hdr = {0};
+    hdr.magic = AUDIT_RECORD_MAGIC;
+    hdr.type = (uint8_t)entry->type;
+    hdr.success = entry->success ? 1 : 0;
+    hdr.id = entry->id;
+    hdr.timestamp = entry->timestamp;
+    hdr.user_len = (uint16_t)strnlen(entry->user, sizeof(entry->user) - 1);
+    hdr.source_ip_len = (uint16_t)strnlen(entry->source_ip, sizeof(entry->source_ip) - 1);
+    hdr.action_len = (uint16_t)strnlen(entry->action, sizeof(entry->action) - 1);
+    hdr.resource_len = (uint16_t)strnlen(entry->resource, sizeof(entry->resource) - 1);
+    hdr.details_len = (uint16_t)strnlen(entry->details, sizeof(entry->details) - 1);
+    hdr.length = (uint16_t)(sizeof(hdr) + hdr.user_len + hdr.source_ip_len +
+                            hdr.action_len + hdr.resource_len + hdr.details_len);
+
+    if (audit_state.fd < 0) {
+        return;
+    }
+
+    audit_segment_t* segment = &audit_state.segments[audit_state.segment_count - 1];
+    if (segment->bytes + hdr.length > AUDIT_SEGMENT_MAX_BYTES) {
+        audit_commit_buffer(pending);
+        if (audit_rotate() < 0) {
+            return;
+        }
+        segment = &audit_state.segments[audit_state.segment_count - 1];
+    }
+
+    if (audit_state.buffered + hdr.length > AUDIT_WRITE_BUFFER) {
+        audit_commit_buffer(pending);
+    }
+
+    if (audit_state.records_written % AUDIT_INDEX_STRIDE == 0 || segment->bytes == 0) {
+        pthread_rwlock_wrlock(&audit_state.index_lock);
+        audit_index_add(entry->timestamp, audit_state.segment_count - 1, (uint32_t)segment->bytes);
+        pthread_rwlock_unlock(&audit_state.index_lock);
+    }
+
+    uint8_t* out = audit_state.buffer + audit_state.buffered;
+    memcpy(out, &hdr, sizeof(hdr));
+    out += sizeof(hdr);
+    memcpy(out, entry->user, hdr.user_len);
+    out += hdr.user_len;
+    memcpy(out, entry->source_ip, hdr.source_ip_len);
+    out += hdr.source_ip_len;
+    memcpy(out, entry->action, hdr.action_len);
+    out += hdr.action_len;
+    memcpy(out, entry->resource, hdr.resource_len);
+    out += hdr.resource_len;
+    memcpy(out, entry->details, hdr.details_len);
+
+    audit_state.buffered += hdr.length;
+    segment->bytes += hdr.length;
+    audit_state.records_written++;
+}
+
+/* Leave a record of events shed on a full queue, so the gap shows in the log itself */
+static void audit_record_drops(uint64_t* pending) {
+    uint64_t dropped = __atomic_load_n(&audit_state.dropped, __ATOMIC_RELAXED);
+    if (dropped == audit_state.dropped_logged) {
+        return;
+    }
+
+    audit_entry_t entry = {0};
+    entry.id = __atomic_fetch_add(&audit_state.next_id, 1, __ATOMIC_RELAXED);
+    entry.type = AUDIT_SECURITY_ALERT;
+    entry.timestamp = get_timestamp_us();
+    entry.success = false;
+    strcpy(entry.user, "system");
+    strcpy(entry.action, "audit_events_dropped");
+    snprintf(entry.details, sizeof(entry.details), "%lu events dropped on full queue",
+             (unsigned long)(dropped - audit_state.dropped_logged));
+    audit_encode(&entry, pending);
+    audit_state.dropped_logged = dropped;
+}
+
+static bool audit_queue_pending(void) {
+    audit_slot_t* slot = &audit_state.queue[audit_state.dequeue_pos & AUDIT_QUEUE_MASK];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == audit_state.dequeue_pos + 1;
+}
+
+/* Writer thread: drain everything queued, then group-commit it */
+static void* audit_writer_main(void* arg) {
+    (void)arg;
+
+    for (;;) {
+        bool running = __atomic_load_n(&audit_state.running, __ATOMIC_ACQUIRE);
+        uint64_t pending = 0;
+
+        audit_record_drops(&pending);
+
+        while (audit_queue_pending()) {
+            uint64_t pos = audit_state.dequeue_pos;
+            audit_slot_t* slot = &audit_state.queue[pos & AUDIT_QUEUE_MASK];
+
+            audit_encode(&slot->entry, &pending);
+            pending++;
+
+            __atomic_store_n(&slot->sequence, pos + AUDIT_QUEUE_SIZE, __ATOMIC_RELEASE);
+            audit_state.dequeue_pos = pos + 1;
+        }
+
+        if (pending || audit_state.buffered) {
+            audit_commit_buffer(&pending);
+            continue;
+        }
+
+        if (!running) {
+            break;
+        }
+
+        __atomic_store_n(&audit_state.writer_idle, 1, __ATOMIC_SEQ_CST);
+        if (!audit_queue_pending()) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += AUDIT_IDLE_WAIT_NS;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait(&audit_state.wakeup, &deadline);
+        }
+        __atomic_store_n(&audit_state.writer_idle, 0, __ATOMIC_SEQ_CST);
+    }
+
+    return NULL;
+}
+
+static int audit_segment_compare(const void* a, const void* b) {
+    uint32_t na = ((const audit_segment_t*)a)->number;
+    uint32_t nb = ((const audit_segment_t*)b)->number;
+    return (na > nb) - (na < nb);
+}
+
+/* Rebuild segment list and sparse index from segments of earlier runs */
+static void audit_recover(void) {
+    DIR* dir = opendir(audit_state.directory);
+    if (!dir) {
+        return;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(dir)) && audit_state.segment_count < AUDIT_MAX_SEGMENTS - 1) {
+        unsigned number;
+        char suffix[8] = {0};
+        if (sscanf(de->d_name, "audit-%8u.seg%7s", &number, suffix) < 1) {
+            continue;
+        }
+
+        audit_segment_t* segment = &audit_state.segments[audit_state.segment_count++];
+        segment->number = number;
+        segment->compressed = strcmp(suffix, ".gz") == 0;
+        segment->bytes = 0;
+    }
+    closedir(dir);
+
+    qsort(audit_state.segments, audit_state.segment_count, sizeof(audit_segment_t),
+          audit_segment_compare);
+
+    uint64_t max_id = 0;
+    audit_entry_t entry;
+    for (uint32_t i = 0; i < audit_state.segment_count; i++) {
+        audit_segment_t* segment = &audit_state.segments[i];
+        audit_reader_t reader;
+        if (audit_reader_open(&reader, segment, 0) < 0) {
+            continue;
+        }
+
+        size_t len;
+        while (audit_read_record(&reader, &entry, &len)) {
+            if (audit_state.records_written % AUDIT_INDEX_STRIDE == 0 || segment->bytes == 0) {
+                audit_index_add(entry.timestamp, i, (uint32_t)segment->bytes);
+            }
+            segment->bytes += len;
+            audit_state.records_written++;
+            if (entry.id > max_id) {
+                max_id = entry.id;
+            }
+        }
+        audit_reader_close(&reader);
+    }
+
+    audit_state.next_id = max_id + 1;
+}
+
+/* Free everything init and the writer built, so a later init starts clean */
+static void audit_release(void) {
+    if (audit_state.fd >= 0) {
+        close(audit_state.fd);
+        audit_state.fd = -1;
+    }
+
+    free(audit_state.queue);
+    free(audit_state.buffer);
+    free(audit_state.index);
+    audit_state.queue = NULL;
+    audit_state.buffer = NULL;
+    audit_state.index = NULL;
+    audit_state.index_count = 0;
+    audit_state.index_capacity = 0;
+    memset(audit_state.segments, 0, sizeof(audit_state.segments));
+    audit_state.segment_count = 0;
+    audit_state.records_written = 0;
+    audit_state.enqueue_pos = 0;
+    audit_state.dequeue_pos = 0;
+    audit_state.committed = 0;
+    audit_state.buffered = 0;
+    audit_state.writer_idle = 0;
+
+    pthread_rwlock_destroy(&audit_state.index_lock);
+    sem_destroy(&audit_state.wakeup);
+    pthread_cond_destroy(&audit_state.progress);
+    pthread_mutex_destroy(&audit_state.progress_lock);
+}
+
+/* Start the audit pipeline */
+int server_audit_init(const char* directory) {
+    if (audit_state.running) {
+        return -1;
+    }
+
+    strncpy(audit_state.directory, directory && directory[0] ? directory : AUDIT_DEFAULT_DIR,
+            sizeof(audit_state.directory) - 1);
+
+    audit_state.queue = calloc(AUDIT_QUEUE_SIZE, sizeof(audit_slot_t));
+    audit_state.buffer = malloc(AUDIT_WRITE_BUFFER);
+    if (!audit_state.queue || !audit_state.buffer) {
+        free(audit_state.queue);
+        free(audit_state.buffer);
+        audit_state.queue = NULL;
+        audit_state.buffer = NULL;
+        return -1;
+    }
+
+    for (uint64_t i = 0; i < AUDIT_QUEUE_SIZE; i++) {
+        audit_state.queue[i].sequence = i;
+    }
+    audit_state.enqueue_pos = 0;
+    audit_state.dequeue_pos = 0;
+    audit_state.committed = 0;
+    audit_state.dropped = 0;
+    audit_state.dropped_logged = 0;
+    audit_state.next_id = 1;
+    audit_state.buffered = 0;
+
+    pthread_rwlock_init(&audit_state.index_lock, NULL);
+    sem_init(&audit_state.wakeup, 0, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&audit_state.progress, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&audit_state.progress_lock, NULL);
+    audit_state.progress_waiters = 0;
+
+    if (audit_mkdirs(audit_state.directory) == 0) {
+        audit_recover();
+        audit_rotate();
+    }
+    if (audit_state.fd < 0) {
+        fprintf(stderr, "[AUDIT] Cannot write to %s; audit events will not be persisted\n",
+                audit_state.directory);
+    }
+
+    audit_state.running = true;
+    if (pthread_create(&audit_state.writer, NULL, audit_writer_main, NULL) != 0) {
+        audit_state.running = false;
+        audit_release();
+        return -1;
+    }
+
+    fprintf(stderr, "[AUDIT] Writing to %s (%lu records recovered)\n",
+            audit_state.directory, (unsigned long)audit_state.records_written);
+    return 0;
+}
+
+/* Drain the queue and stop the writer */
+void server_audit_shutdown(void) {
+    if (!audit_state.running) {
+        return;
+    }
+
+    __atomic_store_n(&audit_state.running, false, __ATOMIC_RELEASE);
+    sem_post(&audit_state.wakeup);
+    pthread_join(audit_state.writer, NULL);
+
+    audit_release();
+
+    uint64_t dropped = __atomic_load_n(&audit_state.dropped, __ATOMIC_RELAXED);
+    if (dropped) {
+        fprintf(stderr, "[AUDIT] %lu events dropped on full queue\n", (unsigned long)dropped);
+    }
+}
+
+/* Events shed on a full queue since init */
+uint64_t server_audit_dropped(void) {
+    return __atomic_load_n(&audit_state.dropped, __ATOMIC_RELAXED);
+}
+
+/* Wait until every event queued so far is durable */
+int server_audit_flush(void) {
+    if (!audit_state.running) {
+        return -1;
+    }
+
+    uint64_t target = __atomic_load_n(&audit_state.enqueue_pos, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&audit_state.committed, __ATOMIC_ACQUIRE) >= target) {
+        return 0;
+    }
+
+    struct timespec deadline;
+    audit_deadline(&deadline, AUDIT_FLUSH_TIMEOUT_US);
+
+    int result = 0;
+    pthread_mutex_lock(&audit_state.progress_lock);
+    __atomic_add_fetch(&audit_state.progress_waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&audit_state.committed, __ATOMIC_ACQUIRE) < target) {
+        sem_post(&audit_state.wakeup);
+        if (pthread_cond_timedwait(&audit_state.progress, &audit_state.progress_lock,
+                                   &deadline) == ETIMEDOUT) {
+            result = __atomic_load_n(&audit_state.committed, __ATOMIC_ACQUIRE) < target ? -1 : 0;
+            break;
+        }
+    }
+    __atomic_sub_fetch(&audit_state.progress_waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&audit_state.progress_lock);
+
+    return result;
+}
+
+/* Audit log: claim a queue slot and return; never blocks on I/O */
+int server_audit_log(audit_event_type_t type, const char* user, const char* action,
+                     const char* resource, bool success, const char* details) {
+    if (!user || !action) {
+        return -1;
+    }
+
+    if (!audit_state.running) {
+        return -1;
+    }
+
+    audit_slot_t* slot;
+    struct timespec deadline = {0};
+    uint64_t pos = __atomic_load_n(&audit_state.enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        slot = &audit_state.queue[pos & AUDIT_QUEUE_MASK];
+        uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&audit_state.enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            /*
+             * Writer is behind by a full queue: wake it and sleep until it
+             * frees slots. Past the deadline, shed the event rather than
+             * stall the caller; the writer logs how many were lost.
+             */
+            if (!deadline.tv_sec) {
+                audit_deadline(&deadline, AUDIT_ENQUEUE_WAIT_US);
+            }
+            bool timed_out = false;
+            pthread_mutex_lock(&audit_state.progress_lock);
+            __atomic_add_fetch(&audit_state.progress_waiters, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&audit_state.writer_idle, 0, __ATOMIC_SEQ_CST)) {
+                sem_post(&audit_state.wakeup);
+            }
+            if ((int64_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos) < 0) {
+                timed_out = pthread_cond_timedwait(&audit_state.progress,
+                                                   &audit_state.progress_lock,
+                                                   &deadline) == ETIMEDOUT;
+            }
+            __atomic_sub_fetch(&audit_state.progress_waiters, 1, __ATOMIC_RELAXED);
+            pthread_mutex_unlock(&audit_state.progress_lock);
+            if (timed_out) {
+                __atomic_add_fetch(&audit_state.dropped, 1, __ATOMIC_RELAXED);
+                return -1;
+            }
+            pos = __atomic_load_n(&audit_state.enqueue_pos, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&audit_state.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    audit_entry_t* entry = &slot->entry;
+    entry->id = __atomic_fetch_add(&audit_state.next_id, 1, __ATOMIC_RELAXED);
+    entry->type = type;
+    entry->timestamp = get_timestamp_us();
+    entry->success = success;
+    entry->source_ip[0] = '\0';
+    strncpy(entry->user, user, sizeof(entry->user) - 1);
+    entry->user[sizeof(entry->user) - 1] = '\0';
+    strncpy(entry->action, action, sizeof(entry->action) - 1);
+    entry->action[sizeof(entry->action) - 1] = '\0';
+    strncpy(entry->resource, resource ?: "", sizeof(entry->resource) - 1);
+    entry->resource[sizeof(entry->resource) - 1] = '\0';
+    strncpy(entry->details, details ?: "", sizeof(entry->details) - 1);
+    entry->details[sizeof(entry->details) - 1] = '\0';
+
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    if (__atomic_exchange_n(&audit_state.writer_idle, 0, __ATOMIC_SEQ_CST)) {
+        sem_post(&audit_state.wakeup);
+    }
+
+    return 0;
+}
+
+/* Open a segment copied out of segments[]; it may have been compressed since */
+static int audit_reader_open_copy(audit_reader_t* reader, audit_segment_t* segment,
+                                  uint32_t offset) {
+    if (audit_reader_open(reader, segment, offset) == 0) {
+        return 0;
+    }
+    segment->compressed = !segment->compressed;
+    return audit_reader_open(reader, segment, offset);
+}
+
+/*
+ * Get audit log: binary search the sparse index, then scan forward. The
+ * segments to scan are copied under index_lock and read without it, so a
+ * slow query does not hold up the writer's index updates.
+ */
+int server_get_audit_log(audit_entry_t* entries, uint32_t* count, uint32_t max,
+                         uint64_t since_timestamp) {
+    if (!entries || !count) {
+        return -1;
+    }
+
+    *count = 0;
+    server_audit_flush();
+
+    pthread_rwlock_rdlock(&audit_state.index_lock);
+
+    if (audit_state.index_count == 0) {
+        pthread_rwlock_unlock(&audit_state.index_lock);
+        return 0;
+    }
+
+    /* Last index entry strictly before since_timestamp */
+    uint32_t lo = 0;
+    uint32_t hi = audit_state.index_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (audit_state.index[mid].timestamp < since_timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /* Step back one more to absorb small cross-thread timestamp reordering */
+    uint32_t start = lo >= 2 ? lo - 2 : 0;
+    uint32_t first = audit_state.index[start].segment;
+    uint32_t offset = audit_state.index[start].offset;
+    uint32_t segment_count = audit_state.segment_count - first;
+    audit_segment_t* segments = malloc(segment_count * sizeof(*segments));
+    if (!segments) {
+        pthread_rwlock_unlock(&audit_state.index_lock);
+        return -1;
+    }
+    /* bytes is the writer's to update; a reader only needs the file name */
+    for (uint32_t i = 0; i < segment_count; i++) {
+        segments[i].number = audit_state.segments[first + i].number;
+        segments[i].compressed = audit_state.segments[first + i].compressed;
+        segments[i].bytes = 0;
+    }
+
+    pthread_rwlock_unlock(&audit_state.index_lock);
+
+    /* A segment retired meanwhile fails to open and is skipped */
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < segment_count && n < max; i++, offset = 0) {
+        audit_reader_t reader;
+        if (audit_reader_open_copy(&reader, &segments[i], offset) < 0) {
+            continue;
+        }
+
+        while (n < max && audit_read_record(&reader, &entries[n], NULL)) {
+            if (entries[n].timestamp >= since_timestamp) {
+                n++;
+            }
+        }
+        audit_reader_close(&reader);
+    }
+    free(segments);
+
+    *count = n;
+    return 0;
+}
@@ -0,0 +1,1123 @@
+/*
+ * Server Edition Cluster Membership
+ * SWIM-style gossip over UDP: randomized probing with indirect probes,
+ * suspicion with incarnation numbers, piggybacked dissemination, and a
+ * leader lease granted by a majority of members
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include "server_edition.h"
+
+#define MAX_CLUSTER_NODES 256
+
+/* Protocol tuning */
+#define SWIM_DEFAULT_PORT        7946
+#define SWIM_PROBE_INTERVAL_US   200000ULL   /* Protocol period */
+#define SWIM_ACK_TIMEOUT_US      60000ULL    /* Direct probe timeout before PING_REQ */
+#define SWIM_INDIRECT_PROBES     3           /* k members asked to probe on our behalf */
+#define SWIM_SUSPICION_MULT      4           /* Suspicion timeout = mult * log2(n) * period */
+#define SWIM_RETRANSMIT_MULT     3           /* Piggyback each update mult * log2(n) times */
+#define SWIM_MAX_PIGGYBACK       8
+#define SWIM_LEASE_US            2000000ULL  /* Leader lease */
+#define SWIM_RELAY_SLOTS         64
+#define SWIM_ID_LEN              32
+#define SWIM_MAX_PACKET          1400
+#define SWIM_MAGIC               0x4D495753  /* "SWIM" */
+
+/* Message types */
+enum {
+    SWIM_MSG_PING = 1,
+    SWIM_MSG_ACK,
+    SWIM_MSG_PING_REQ,
+    SWIM_MSG_JOIN,
+    SWIM_MSG_SYNC,
+    SWIM_MSG_LEASE,             /* Lease request; seq is the round's term */
+    SWIM_MSG_LEASE_ACK,         /* Lease granted for that term */
+};
+
+/* Update kinds carried in dissemination */
+enum {
+    SWIM_UPDATE_ALIVE = 1,
+    SWIM_UPDATE_SUSPECT,
+    SWIM_UPDATE_DEAD,
+    SWIM_UPDATE_LEADER,
+    SWIM_UPDATE_LEFT,           /* Dead by choice; no longer counts towards a quorum */
+};
+
+typedef enum swim_state {
+    SWIM_STATE_ALIVE,
+    SWIM_STATE_SUSPECT,
+    SWIM_STATE_DEAD,
+} swim_state_t;
+
+/* Wire format */
+typedef struct swim_header {
+    uint32_t magic;
+    uint32_t cluster_hash;
+    uint8_t type;
+    uint8_t update_count;
+    uint16_t sender_port;
+    uint32_t seq;
+    uint32_t target_ip;         /* PING_REQ target (network order) */
+    uint16_t target_port;       /* PING_REQ target (host order) */
+    uint16_t reserved;
+    uint32_t sender_incarnation;
+    char sender_id[SWIM_ID_LEN];
+} swim_header_t;
+
+typedef struct swim_update {
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t port;              /* Host order */
+    uint32_t ip;                /* Network order; 0 means "sender of this packet" */
+    uint32_t incarnation;       /* Leader term for SWIM_UPDATE_LEADER */
+    uint32_t lease_ms;
+    char node_id[SWIM_ID_LEN];
+} swim_update_t;
+
+/* Member */
+typedef struct swim_member {
+    bool in_use;
+    cluster_node_t node;
+    struct sockaddr_in addr;
+    swim_state_t state;
+    uint32_t incarnation;
+    uint64_t state_changed_us;
+    bool left;
+} swim_member_t;
+
+/* Pending dissemination */
+typedef struct swim_broadcast {
+    bool in_use;
+    swim_update_t update;
+    uint32_t transmits;
+} swim_broadcast_t;
+
+/* Indirect probe forwarded on behalf of another member */
+typedef struct swim_relay {
+    uint32_t seq;
+    uint32_t origin_seq;
+    struct sockaddr_in origin;
+    uint64_t expires_us;
+} swim_relay_t;
+
+static struct {
+    bool running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int sock;
+    uint16_t port;
+    uint32_t cluster_hash;
+
+    /* Self */
+    char self_id[SWIM_ID_LEN];
+    uint32_t incarnation;
+    bool leaving;
+    struct sockaddr_in seed;
+    bool has_seed;
+
+    /* Membership */
+    swim_member_t members[MAX_CLUSTER_NODES];
+    uint32_t probe_order[MAX_CLUSTER_NODES];
+    uint32_t probe_order_count;
+    uint32_t probe_cursor;
+
+    /* Outstanding probe */
+    int32_t probe_target;
+    uint32_t probe_seq;
+    uint64_t probe_sent_us;
+    bool probe_acked;
+    bool probe_indirect_sent;
+    uint64_t next_probe_us;
+    uint32_t next_seq;
+
+    swim_broadcast_t broadcasts[MAX_CLUSTER_NODES + 1];
+    swim_relay_t relays[SWIM_RELAY_SLOTS];
+
+    /* Leader lease */
+    char leader_id[SWIM_ID_LEN];
+    uint32_t leader_term;
+    uint64_t lease_expiry_us;
+
+    /* Our lease round in flight; every round runs under a fresh term */
+    bool round_active;
+    uint32_t round_term;
+    uint64_t round_start_us;
+    uint32_t round_grants;
+    bool round_granted[MAX_CLUSTER_NODES];
+
+    /* Our promise not to grant anyone else a lease before it runs out */
+    char granted_id[SWIM_ID_LEN];
+    uint64_t granted_until_us;
+
+    cluster_stats_t stats;
+} cluster_state = { .sock = -1 };
+
+/* Monotonic timestamp (microseconds); leases and timeouts must not jump with the wall clock */
+static uint64_t get_timestamp_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static uint32_t hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* ceil(log2(n + 1)), at least 1 */
+static uint32_t swim_log2_members(void) {
+    uint32_t n = cluster_state.stats.members_alive + cluster_state.stats.members_suspect + 1;
+    uint32_t log = 0;
+    while ((1u << log) < n) {
+        log++;
+    }
+    return log ? log : 1;
+}
+
+static void swim_recount(void) {
+    cluster_state.stats.members_alive = 0;
+    cluster_state.stats.members_suspect = 0;
+    cluster_state.stats.members_dead = 0;
+
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (!m->in_use) {
+            continue;
+        }
+        switch (m->state) {
+            case SWIM_STATE_ALIVE: cluster_state.stats.members_alive++; break;
+            case SWIM_STATE_SUSPECT: cluster_state.stats.members_suspect++; break;
+            case SWIM_STATE_DEAD: cluster_state.stats.members_dead++; break;
+        }
+    }
+}
+
+static swim_member_t* swim_find(const char* node_id) {
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && strncmp(m->node.node_id, node_id, SWIM_ID_LEN) == 0) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static swim_member_t* swim_find_addr(const struct sockaddr_in* addr) {
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+            m->addr.sin_port == addr->sin_port) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/* Queue an update for piggybacking, replacing older news about the same node */
+static void swim_enqueue(uint8_t kind, const char* node_id, uint32_t incarnation,
+                         const struct sockaddr_in* addr, uint32_t lease_ms) {
+    swim_broadcast_t* slot = NULL;
+
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES + 1; i++) {
+        swim_broadcast_t* b = &cluster_state.broadcasts[i];
+        bool same_topic = b->in_use &&
+                          ((kind == SWIM_UPDATE_LEADER) == (b->update.kind == SWIM_UPDATE_LEADER)) &&
+                          (kind == SWIM_UPDATE_LEADER ||
+                           strncmp(b->update.node_id, node_id, SWIM_ID_LEN) == 0);
+        if (same_topic) {
+            slot = b;
+            break;
+        }
+        if (!b->in_use && !slot) {
+            slot = b;
+        }
+    }
+
+    if (!slot) {
+        return;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->in_use = true;
+    slot->update.kind = kind;
+    slot->update.incarnation = incarnation;
+    slot->update.lease_ms = lease_ms;
+    strncpy(slot->update.node_id, node_id, SWIM_ID_LEN - 1);
+    if (addr) {
+        slot->update.ip = addr->sin_addr.s_addr;
+        slot->update.port = ntohs(addr->sin_port);
+    }
+}
+
+/* Pick the least-transmitted updates; retire those sent log(n) * mult times */
+static uint8_t swim_collect_piggyback(swim_update_t* out, uint32_t max) {
+    uint32_t limit = SWIM_RETRANSMIT_MULT * swim_log2_members();
+    bool taken[MAX_CLUSTER_NODES + 1] = {false};
+    uint64_t now = get_timestamp_us();
+    uint8_t count = 0;
+
+    while (count < max) {
+        int32_t best = -1;
+        for (uint32_t i = 0; i < MAX_CLUSTER_NODES + 1; i++) {
+            swim_broadcast_t* b = &cluster_state.broadcasts[i];
+            if (b->in_use && !taken[i] &&
+                (best < 0 || b->transmits < cluster_state.broadcasts[best].transmits)) {
+                best = (int32_t)i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+
+        taken[best] = true;
+        swim_broadcast_t* b = &cluster_state.broadcasts[best];
+        swim_update_t* u = &out[count++];
+        *u = b->update;
+
+        /* Leases travel as time remaining so forwarded copies never extend them */
+        if (u->kind == SWIM_UPDATE_LEADER && u->incarnation == cluster_state.leader_term &&
+            strncmp(u->node_id, cluster_state.leader_id, SWIM_ID_LEN) == 0) {
+            u->lease_ms = cluster_state.lease_expiry_us > now ?
+                          (uint32_t)((cluster_state.lease_expiry_us - now) / 1000) : 0;
+        }
+
+        if (++b->transmits >= limit) {
+            b->in_use = false;
+        }
+    }
+
+    return count;
+}
+
+static void swim_send(uint8_t type, uint32_t seq, const struct sockaddr_in* to,
+                      const struct sockaddr_in* target) {
+    uint8_t packet[SWIM_MAX_PACKET];
+    swim_header_t* hdr = (swim_header_t*)packet;
+    memset(hdr, 0, sizeof(*hdr));
+
+    hdr->magic = SWIM_MAGIC;
+    hdr->cluster_hash = cluster_state.cluster_hash;
+    hdr->type = type;
+    hdr->sender_port = cluster_state.port;
+    hdr->seq = seq;
+    hdr->sender_incarnation = cluster_state.incarnation;
+    memcpy(hdr->sender_id, cluster_state.self_id, SWIM_ID_LEN);
+    if (target) {
+        hdr->target_ip = target->sin_addr.s_addr;
+        hdr->target_port = ntohs(target->sin_port);
+    }
+
+    swim_update_t* updates = (swim_update_t*)(hdr + 1);
+    hdr->update_count = swim_collect_piggyback(updates, SWIM_MAX_PIGGYBACK);
+
+    size_t len = sizeof(*hdr) + hdr->update_count * sizeof(swim_update_t);
+    if (sendto(cluster_state.sock, packet, len, 0, (const struct sockaddr*)to, sizeof(*to)) > 0) {
+        cluster_state.stats.packets_sent++;
+        cluster_state.stats.bytes_sent += len;
+    }
+}
+
+/* Send the full alive membership to a joining node */
+static void swim_send_sync(const struct sockaddr_in* to) {
+    uint8_t packet[SWIM_MAX_PACKET];
+    swim_header_t* hdr = (swim_header_t*)packet;
+    swim_update_t* updates = (swim_update_t*)(hdr + 1);
+    const uint32_t per_packet = (SWIM_MAX_PACKET - sizeof(*hdr)) / sizeof(swim_update_t);
+
+    uint32_t i = 0;
+    while (i < MAX_CLUSTER_NODES) {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->magic = SWIM_MAGIC;
+        hdr->cluster_hash = cluster_state.cluster_hash;
+        hdr->type = SWIM_MSG_SYNC;
+        hdr->sender_port = cluster_state.port;
+        hdr->sender_incarnation = cluster_state.incarnation;
+        memcpy(hdr->sender_id, cluster_state.self_id, SWIM_ID_LEN);
+
+        for (; i < MAX_CLUSTER_NODES && hdr->update_count < per_packet; i++) {
+            swim_member_t* m = &cluster_state.members[i];
+            if (!m->in_use || m->state == SWIM_STATE_DEAD || !m->node.node_id[0]) {
+                continue;
+            }
+            swim_update_t* u = &updates[hdr->update_count++];
+            memset(u, 0, sizeof(*u));
+            u->kind = SWIM_UPDATE_ALIVE;
+            u->ip = m->addr.sin_addr.s_addr;
+            u->port = ntohs(m->addr.sin_port);
+            u->incarnation = m->incarnation;
+            strncpy(u->node_id, m->node.node_id, SWIM_ID_LEN - 1);
+        }
+
+        if (cluster_state.leader_id[0] && hdr->update_count < per_packet) {
+            swim_update_t* u = &updates[hdr->update_count++];
+            memset(u, 0, sizeof(*u));
+            u->kind = SWIM_UPDATE_LEADER;
+            u->incarnation = cluster_state.leader_term;
+            uint64_t now = get_timestamp_us();
+            u->lease_ms = cluster_state.lease_expiry_us > now ?
+                          (uint32_t)((cluster_state.lease_expiry_us - now) / 1000) : 0;
+            memcpy(u->node_id, cluster_state.leader_id, SWIM_ID_LEN);
+        }
+
+        if (hdr->update_count == 0) {
+            break;
+        }
+
+        size_t len = sizeof(*hdr) + hdr->update_count * sizeof(swim_update_t);
+        if (sendto(cluster_state.sock, packet, len, 0, (const struct sockaddr*)to, sizeof(*to)) > 0) {
+            cluster_state.stats.packets_sent++;
+            cluster_state.stats.bytes_sent += len;
+        }
+    }
+}
+
+static void swim_set_state(swim_member_t* m, swim_state_t state, uint32_t incarnation) {
+    bool changed = m->state != state;
+    m->state = state;
+    m->incarnation = incarnation;
+    m->node.active = state != SWIM_STATE_DEAD;
+    if (state == SWIM_STATE_ALIVE) {
+        m->left = false;
+    }
+
+    if (changed) {
+        m->state_changed_us = get_timestamp_us();
+        cluster_state.stats.last_change_us = m->state_changed_us;
+        swim_recount();
+    }
+}
+
+static swim_member_t* swim_add(const char* node_id, const struct sockaddr_in* addr,
+                               uint32_t incarnation) {
+    swim_member_t* slot = NULL;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (!m->in_use) {
+            slot = m;
+            break;
+        }
+        /* Recycle the longest-dead member if the table is full */
+        if (m->state == SWIM_STATE_DEAD &&
+            (!slot || m->state_changed_us < slot->state_changed_us)) {
+            slot = m;
+        }
+    }
+    if (!slot) {
+        return NULL;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->in_use = true;
+    slot->addr = *addr;
+    slot->state = SWIM_STATE_DEAD;
+    strncpy(slot->node.node_id, node_id, SWIM_ID_LEN - 1);
+    strncpy(slot->node.hostname, node_id, sizeof(slot->node.hostname) - 1);
+    snprintf(slot->node.ip_address, sizeof(slot->node.ip_address), "%s:%u",
+             inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+    slot->node.last_heartbeat = get_timestamp_us();
+
+    swim_set_state(slot, SWIM_STATE_ALIVE, incarnation);
+    return slot;
+}
+
+/* Apply one disseminated update (SWIM precedence rules) */
+static void swim_apply(const swim_update_t* u, const swim_header_t* hdr,
+                       const struct sockaddr_in* from) {
+    char node_id[SWIM_ID_LEN];
+    memcpy(node_id, u->node_id, SWIM_ID_LEN);
+    node_id[SWIM_ID_LEN - 1] = '\0';
+
+    if (u->kind == SWIM_UPDATE_LEADER) {
+        uint64_t now = get_timestamp_us();
+        if (strcmp(node_id, cluster_state.self_id) == 0) {
+            /* Only our own lease rounds extend our lease; echoes just carry the term */
+            if (u->incarnation > cluster_state.leader_term) {
+                cluster_state.leader_term = u->incarnation;
+            }
+            return;
+        }
+
+        uint64_t expiry = now + (uint64_t)u->lease_ms * 1000;
+        bool same = u->incarnation == cluster_state.leader_term &&
+                    strcmp(node_id, cluster_state.leader_id) == 0;
+        bool forward = false;
+
+        if (same) {
+            if (u->lease_ms == 0) {
+                /* Lease handed back; so is our promise to that leader */
+                forward = cluster_state.lease_expiry_us > now;
+                cluster_state.lease_expiry_us = now;
+                if (strncmp(cluster_state.granted_id, node_id, SWIM_ID_LEN) == 0) {
+                    cluster_state.granted_until_us = now;
+                }
+            } else if (expiry > cluster_state.lease_expiry_us) {
+                forward = expiry > cluster_state.lease_expiry_us + SWIM_LEASE_US / 4;
+                cluster_state.lease_expiry_us = expiry;
+            }
+        } else if (u->incarnation > cluster_state.leader_term ||
+                   (u->incarnation == cluster_state.leader_term &&
+                    (!cluster_state.leader_id[0] || now >= cluster_state.lease_expiry_us ||
+                     strcmp(node_id, cluster_state.leader_id) < 0))) {
+            memcpy(cluster_state.leader_id, node_id, SWIM_ID_LEN);
+            cluster_state.leader_term = u->incarnation;
+            cluster_state.lease_expiry_us = expiry;
+            forward = true;
+        }
+
+        if (forward) {
+            swim_enqueue(SWIM_UPDATE_LEADER, node_id, u->incarnation, NULL, u->lease_ms);
+        }
+        return;
+    }
+
+    /* News about ourselves: refute suspicion by bumping our incarnation */
+    if (strcmp(node_id, cluster_state.self_id) == 0) {
+        if (u->kind != SWIM_UPDATE_ALIVE && !cluster_state.leaving &&
+            u->incarnation >= cluster_state.incarnation) {
+            cluster_state.incarnation = u->incarnation + 1;
+            swim_enqueue(SWIM_UPDATE_ALIVE, cluster_state.self_id, cluster_state.incarnation,
+                         NULL, 0);
+        }
+        return;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (u->ip) {
+        addr.sin_addr.s_addr = u->ip;
+        addr.sin_port = htons(u->port);
+    } else {
+        addr.sin_addr = from->sin_addr;
+        addr.sin_port = htons(hdr->sender_port);
+    }
+
+    swim_member_t* m = swim_find(node_id);
+
+    switch (u->kind) {
+        case SWIM_UPDATE_ALIVE:
+            if (!m) {
+                if (swim_add(node_id, &addr, u->incarnation)) {
+                    swim_enqueue(SWIM_UPDATE_ALIVE, node_id, u->incarnation, &addr, 0);
+                }
+            } else if (u->incarnation > m->incarnation) {
+                m->addr = addr;
+                swim_set_state(m, SWIM_STATE_ALIVE, u->incarnation);
+                swim_enqueue(SWIM_UPDATE_ALIVE, node_id, u->incarnation, &addr, 0);
+            }
+            break;
+
+        case SWIM_UPDATE_SUSPECT:
+            if (m && m->state != SWIM_STATE_DEAD &&
+                ((m->state == SWIM_STATE_ALIVE && u->incarnation >= m->incarnation) ||
+                 u->incarnation > m->incarnation)) {
+                swim_set_state(m, SWIM_STATE_SUSPECT, u->incarnation);
+                swim_enqueue(SWIM_UPDATE_SUSPECT, node_id, u->incarnation, &m->addr, 0);
+            }
+            break;
+
+        case SWIM_UPDATE_DEAD:
+            if (m && m->state != SWIM_STATE_DEAD && u->incarnation >= m->incarnation) {
+                swim_set_state(m, SWIM_STATE_DEAD, u->incarnation);
+                swim_enqueue(SWIM_UPDATE_DEAD, node_id, u->incarnation, &m->addr, 0);
+            }
+            break;
+
+        case SWIM_UPDATE_LEFT:
+            if (m && !m->left && u->incarnation >= m->incarnation) {
+                m->left = true;
+                swim_set_state(m, SWIM_STATE_DEAD, u->incarnation);
+                swim_enqueue(SWIM_UPDATE_LEFT, node_id, u->incarnation, &m->addr, 0);
+            }
+            break;
+    }
+}
+
+/* Members whose grants a lease needs: everyone with a known id who has not left, dead or not,
+ * so a partition that declares the other side dead cannot elect a second leader */
+static uint32_t swim_quorum(void) {
+    uint32_t voters = 1;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->node.node_id[0] && !m->left) {
+            voters++;
+        }
+    }
+    return voters / 2 + 1;
+}
+
+/* Promise candidate the lease unless it is already promised to someone else */
+static bool swim_grant(const char* candidate, uint64_t now) {
+    if (now < cluster_state.granted_until_us &&
+        strncmp(cluster_state.granted_id, candidate, SWIM_ID_LEN) != 0) {
+        return false;
+    }
+    memset(cluster_state.granted_id, 0, SWIM_ID_LEN);
+    strncpy(cluster_state.granted_id, candidate, SWIM_ID_LEN - 1);
+    cluster_state.granted_until_us = now + SWIM_LEASE_US;
+    return true;
+}
+
+/* A majority granted the round: the lease runs from when it was requested, before any grant */
+static void swim_lease_check(void) {
+    if (!cluster_state.round_active || cluster_state.round_grants < swim_quorum()) {
+        return;
+    }
+    cluster_state.round_active = false;
+    if (cluster_state.round_term < cluster_state.leader_term) {
+        return;
+    }
+
+    memcpy(cluster_state.leader_id, cluster_state.self_id, SWIM_ID_LEN);
+    cluster_state.leader_term = cluster_state.round_term;
+    cluster_state.lease_expiry_us = cluster_state.round_start_us + SWIM_LEASE_US;
+
+    uint64_t now = get_timestamp_us();
+    if (now < cluster_state.lease_expiry_us) {
+        swim_enqueue(SWIM_UPDATE_LEADER, cluster_state.self_id, cluster_state.leader_term, NULL,
+                     (uint32_t)((cluster_state.lease_expiry_us - now) / 1000));
+    }
+}
+
+/* Ask every member we can reach to grant us the lease under a new term */
+static void swim_lease_round(uint64_t now) {
+    if (!swim_grant(cluster_state.self_id, now)) {
+        return;
+    }
+
+    /* Never reuse a term, so a late grant from an earlier round cannot count */
+    cluster_state.round_active = true;
+    cluster_state.round_term = (cluster_state.leader_term > cluster_state.round_term ?
+                                cluster_state.leader_term : cluster_state.round_term) + 1;
+    cluster_state.round_start_us = now;
+    cluster_state.round_grants = 1;
+    memset(cluster_state.round_granted, 0, sizeof(cluster_state.round_granted));
+
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->node.node_id[0] && !m->left && m->state != SWIM_STATE_DEAD) {
+            swim_send(SWIM_MSG_LEASE, cluster_state.round_term, &m->addr, NULL);
+        }
+    }
+    swim_lease_check();
+}
+
+/* Any packet from a member is proof of life */
+static swim_member_t* swim_touch_sender(const swim_header_t* hdr, const struct sockaddr_in* from) {
+    char node_id[SWIM_ID_LEN];
+    memcpy(node_id, hdr->sender_id, SWIM_ID_LEN);
+    node_id[SWIM_ID_LEN - 1] = '\0';
+
+    struct sockaddr_in addr = *from;
+    addr.sin_port = htons(hdr->sender_port);
+
+    swim_member_t* m = swim_find(node_id);
+    if (!m) {
+        /* Seed entries are created before their id is known */
+        m = swim_find_addr(&addr);
+        if (m && !m->node.node_id[0]) {
+            strncpy(m->node.node_id, node_id, SWIM_ID_LEN - 1);
+            strncpy(m->node.hostname, node_id, sizeof(m->node.hostname) - 1);
+            m->incarnation = hdr->sender_incarnation;
+            swim_enqueue(SWIM_UPDATE_ALIVE, node_id, m->incarnation, &m->addr, 0);
+        } else {
+            m = swim_add(node_id, &addr, hdr->sender_incarnation);
+            if (m) {
+                swim_enqueue(SWIM_UPDATE_ALIVE, node_id, hdr->sender_incarnation, &addr, 0);
+            }
+        }
+    } else if (hdr->sender_incarnation > m->incarnation) {
+        m->addr = addr;
+        swim_set_state(m, SWIM_STATE_ALIVE, hdr->sender_incarnation);
+        swim_enqueue(SWIM_UPDATE_ALIVE, node_id, m->incarnation, &addr, 0);
+    }
+
+    if (m) {
+        m->node.last_heartbeat = get_timestamp_us();
+    }
+    return m;
+}
+
+static void swim_handle_packet(const uint8_t* packet, size_t len, const struct sockaddr_in* from) {
+    if (len < sizeof(swim_header_t)) {
+        return;
+    }
+
+    const swim_header_t* hdr = (const swim_header_t*)packet;
+    if (hdr->magic != SWIM_MAGIC || hdr->cluster_hash != cluster_state.cluster_hash ||
+        len < sizeof(*hdr) + hdr->update_count * sizeof(swim_update_t)) {
+        return;
+    }
+
+    cluster_state.stats.packets_received++;
+    cluster_state.stats.bytes_received += len;
+
+    swim_member_t* sender = swim_touch_sender(hdr, from);
+
+    const swim_update_t* updates = (const swim_update_t*)(hdr + 1);
+    for (uint8_t i = 0; i < hdr->update_count; i++) {
+        swim_apply(&updates[i], hdr, from);
+    }
+
+    struct sockaddr_in reply_to = *from;
+    reply_to.sin_port = htons(hdr->sender_port);
+
+    switch (hdr->type) {
+        case SWIM_MSG_JOIN:
+            swim_send_sync(&reply_to);
+            /* fall through */
+        case SWIM_MSG_PING:
+            swim_send(SWIM_MSG_ACK, hdr->seq, &reply_to, NULL);
+            break;
+
+        case SWIM_MSG_ACK:
+            if (cluster_state.probe_target >= 0 && hdr->seq == cluster_state.probe_seq) {
+                cluster_state.probe_acked = true;
+                break;
+            }
+            for (uint32_t i = 0; i < SWIM_RELAY_SLOTS; i++) {
+                swim_relay_t* r = &cluster_state.relays[i];
+                if (r->expires_us && r->seq == hdr->seq) {
+                    swim_send(SWIM_MSG_ACK, r->origin_seq, &r->origin, NULL);
+                    r->expires_us = 0;
+                    break;
+                }
+            }
+            break;
+
+        case SWIM_MSG_PING_REQ: {
+            struct sockaddr_in target;
+            memset(&target, 0, sizeof(target));
+            target.sin_family = AF_INET;
+            target.sin_addr.s_addr = hdr->target_ip;
+            target.sin_port = htons(hdr->target_port);
+
+            uint32_t seq = cluster_state.next_seq++;
+            swim_relay_t* r = &cluster_state.relays[seq % SWIM_RELAY_SLOTS];
+            r->seq = seq;
+            r->origin_seq = hdr->seq;
+            r->origin = reply_to;
+            r->expires_us = get_timestamp_us() + SWIM_PROBE_INTERVAL_US;
+
+            swim_send(SWIM_MSG_PING, seq, &target, NULL);
+            break;
+        }
+
+        case SWIM_MSG_LEASE: {
+            char candidate[SWIM_ID_LEN];
+            memcpy(candidate, hdr->sender_id, SWIM_ID_LEN);
+            candidate[SWIM_ID_LEN - 1] = '\0';
+            if (swim_grant(candidate, get_timestamp_us())) {
+                swim_send(SWIM_MSG_LEASE_ACK, hdr->seq, &reply_to, NULL);
+            }
+            break;
+        }
+
+        case SWIM_MSG_LEASE_ACK:
+            if (sender && cluster_state.round_active && hdr->seq == cluster_state.round_term) {
+                uint32_t index = (uint32_t)(sender - cluster_state.members);
+                if (!cluster_state.round_granted[index]) {
+                    cluster_state.round_granted[index] = true;
+                    cluster_state.round_grants++;
+                    swim_lease_check();
+                }
+            }
+            break;
+
+        case SWIM_MSG_SYNC:
+        default:
+            break;
+    }
+}
+
+/* Rebuild the randomized round-robin probe order */
+static void swim_shuffle(void) {
+    cluster_state.probe_order_count = 0;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->state != SWIM_STATE_DEAD) {
+            cluster_state.probe_order[cluster_state.probe_order_count++] = i;
+        }
+    }
+
+    for (uint32_t i = cluster_state.probe_order_count; i > 1; i--) {
+        uint32_t j = (uint32_t)rand() % i;
+        uint32_t tmp = cluster_state.probe_order[i - 1];
+        cluster_state.probe_order[i - 1] = cluster_state.probe_order[j];
+        cluster_state.probe_order[j] = tmp;
+    }
+    cluster_state.probe_cursor = 0;
+}
+
+static void swim_probe_next(uint64_t now) {
+    /* Close out the previous probe */
+    if (cluster_state.probe_target >= 0 && !cluster_state.probe_acked) {
+        swim_member_t* m = &cluster_state.members[cluster_state.probe_target];
+        if (m->in_use && !m->node.node_id[0]) {
+            /* Seed never answered; nothing to disseminate */
+            swim_set_state(m, SWIM_STATE_DEAD, 0);
+        } else if (m->in_use && m->state == SWIM_STATE_ALIVE) {
+            swim_set_state(m, SWIM_STATE_SUSPECT, m->incarnation);
+            swim_enqueue(SWIM_UPDATE_SUSPECT, m->node.node_id, m->incarnation, &m->addr, 0);
+        }
+    }
+    cluster_state.probe_target = -1;
+
+    for (uint32_t attempts = 0; attempts <= cluster_state.probe_order_count; attempts++) {
+        if (cluster_state.probe_cursor >= cluster_state.probe_order_count) {
+            swim_shuffle();
+            if (cluster_state.probe_order_count == 0) {
+                /* Isolated: keep knocking on the seed */
+                if (cluster_state.has_seed) {
+                    swim_send(SWIM_MSG_JOIN, cluster_state.next_seq++, &cluster_state.seed, NULL);
+                }
+                return;
+            }
+        }
+
+        uint32_t index = cluster_state.probe_order[cluster_state.probe_cursor++];
+        swim_member_t* m = &cluster_state.members[index];
+        if (!m->in_use || m->state == SWIM_STATE_DEAD) {
+            continue;
+        }
+
+        cluster_state.probe_target = (int32_t)index;
+        cluster_state.probe_seq = cluster_state.next_seq++;
+        cluster_state.probe_sent_us = now;
+        cluster_state.probe_acked = false;
+        cluster_state.probe_indirect_sent = false;
+        cluster_state.stats.probes++;
+
+        swim_send(m->node.node_id[0] ? SWIM_MSG_PING : SWIM_MSG_JOIN,
+                  cluster_state.probe_seq, &m->addr, NULL);
+        return;
+    }
+}
+
+/* Ask k random live members to probe the unresponsive target */
+static void swim_probe_indirect(void) {
+    swim_member_t* target = &cluster_state.members[cluster_state.probe_target];
+    uint32_t candidates[MAX_CLUSTER_NODES];
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->state == SWIM_STATE_ALIVE && (int32_t)i != cluster_state.probe_target &&
+            m->node.node_id[0]) {
+            candidates[n++] = i;
+        }
+    }
+
+    for (uint32_t k = 0; k < SWIM_INDIRECT_PROBES && n > 0; k++) {
+        uint32_t pick = (uint32_t)rand() % n;
+        swim_send(SWIM_MSG_PING_REQ, cluster_state.probe_seq,
+                  &cluster_state.members[candidates[pick]].addr, &target->addr);
+        candidates[pick] = candidates[--n];
+        cluster_state.stats.indirect_probes++;
+    }
+
+    cluster_state.probe_indirect_sent = true;
+}
+
+/* Confirm suspects whose timeout expired */
+static void swim_expire_suspects(uint64_t now) {
+    uint64_t timeout = SWIM_SUSPICION_MULT * swim_log2_members() * SWIM_PROBE_INTERVAL_US;
+
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->state == SWIM_STATE_SUSPECT && now - m->state_changed_us > timeout) {
+            swim_set_state(m, SWIM_STATE_DEAD, m->incarnation);
+            swim_enqueue(SWIM_UPDATE_DEAD, m->node.node_id, m->incarnation, &m->addr, 0);
+        }
+    }
+}
+
+/* Lease-based leader: lowest live id claims an expired lease, and claims and renewals only
+ * count once a majority of members granted them; an unanswered round is retried every period */
+static void swim_maintain_leader(uint64_t now) {
+    bool self_leader = strcmp(cluster_state.leader_id, cluster_state.self_id) == 0;
+
+    if (cluster_state.round_active && now - cluster_state.round_start_us < SWIM_PROBE_INTERVAL_US) {
+        return;
+    }
+    cluster_state.round_active = false;
+
+    if (self_leader && now < cluster_state.lease_expiry_us) {
+        if (cluster_state.lease_expiry_us - now < SWIM_LEASE_US / 2 && !cluster_state.leaving) {
+            swim_lease_round(now);
+        }
+        return;
+    }
+
+    bool lease_valid = cluster_state.leader_id[0] && now < cluster_state.lease_expiry_us;
+    if (lease_valid) {
+        swim_member_t* leader = swim_find(cluster_state.leader_id);
+        lease_valid = leader && leader->state != SWIM_STATE_DEAD;
+    }
+    if (lease_valid || cluster_state.leaving) {
+        return;
+    }
+
+    uint32_t known = 0;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->state == SWIM_STATE_ALIVE && m->node.node_id[0]) {
+            if (strcmp(m->node.node_id, cluster_state.self_id) < 0) {
+                return;
+            }
+            known++;
+        }
+    }
+
+    /* A joining node waits until it has heard from the cluster */
+    if (cluster_state.has_seed && known == 0) {
+        return;
+    }
+
+    swim_lease_round(now);
+}
+
+static void* swim_thread_main(void* arg) {
+    (void)arg;
+    uint8_t packet[SWIM_MAX_PACKET];
+
+    while (__atomic_load_n(&cluster_state.running, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = { .fd = cluster_state.sock, .events = POLLIN };
+        int ready = poll(&pfd, 1, 10);
+
+        pthread_mutex_lock(&cluster_state.lock);
+
+        if (ready > 0 && (pfd.revents & POLLIN)) {
+            struct sockaddr_in from;
+            socklen_t from_len = sizeof(from);
+            ssize_t n;
+            while ((n = recvfrom(cluster_state.sock, packet, sizeof(packet), MSG_DONTWAIT,
+                                 (struct sockaddr*)&from, &from_len)) > 0) {
+                swim_handle_packet(packet, (size_t)n, &from);
+                from_len = sizeof(from);
+            }
+        }
+
+        uint64_t now = get_timestamp_us();
+        if (now >= cluster_state.next_probe_us) {
+            swim_probe_next(now);
+            cluster_state.next_probe_us = now + SWIM_PROBE_INTERVAL_US;
+        } else if (cluster_state.probe_target >= 0 && !cluster_state.probe_acked &&
+                   !cluster_state.probe_indirect_sent &&
+                   now - cluster_state.probe_sent_us > SWIM_ACK_TIMEOUT_US) {
+            swim_probe_indirect();
+        }
+
+        swim_expire_suspects(now);
+        swim_maintain_leader(now);
+
+        pthread_mutex_unlock(&cluster_state.lock);
+    }
+
+    return NULL;
+}
+
+static int swim_parse_addr(const char* text, uint16_t default_port, struct sockaddr_in* addr) {
+    char host[64];
+    strncpy(host, text, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+
+    uint16_t port = default_port;
+    char* colon = strchr(host, ':');
+    if (colon) {
+        *colon = '\0';
+        port = (uint16_t)atoi(colon + 1);
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    return inet_pton(AF_INET, host, &addr->sin_addr) == 1 ? 0 : -1;
+}
+
+/* Start gossiping; seed is "ip[:port]" of any existing member, or NULL to bootstrap */
+int server_cluster_start(const char* cluster_name, const char* seed, uint16_t port) {
+    if (!cluster_name || cluster_state.running) {
+        return -1;
+    }
+
+    memset(&cluster_state, 0, sizeof(cluster_state));
+    cluster_state.port = port ? port : SWIM_DEFAULT_PORT;
+    cluster_state.cluster_hash = hash_name(cluster_name);
+    cluster_state.probe_target = -1;
+    cluster_state.next_seq = 1;
+
+    char hostname[64] = "node";
+    gethostname(hostname, sizeof(hostname));
+    hostname[sizeof(hostname) - 1] = '\0';
+    snprintf(cluster_state.self_id, SWIM_ID_LEN, "%.24s-%u", hostname, cluster_state.port);
+
+    cluster_state.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (cluster_state.sock < 0) {
+        return -1;
+    }
+
+    struct sockaddr_in bind_addr;
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bind_addr.sin_port = htons(cluster_state.port);
+    if (bind(cluster_state.sock, (struct sockaddr*)&bind_addr, sizeof(bind_addr)) < 0) {
+        close(cluster_state.sock);
+        cluster_state.sock = -1;
+        return -1;
+    }
+
+    srand((unsigned)(get_timestamp_us() ^ cluster_state.port));
+    pthread_mutex_init(&cluster_state.lock, NULL);
+
+    /* Seed entry; its id is learned from the first reply */
+    struct sockaddr_in seed_addr;
+    if (seed && swim_parse_addr(seed, cluster_state.port, &seed_addr) == 0 &&
+        !(seed_addr.sin_port == htons(cluster_state.port) &&
+          (seed_addr.sin_addr.s_addr == htonl(INADDR_LOOPBACK) ||
+           seed_addr.sin_addr.s_addr == htonl(INADDR_ANY)))) {
+        cluster_state.seed = seed_addr;
+        cluster_state.has_seed = true;
+        swim_add("", &seed_addr, 0);
+    }
+
+    cluster_state.stats.join_time_us = get_timestamp_us();
+    cluster_state.running = true;
+    if (pthread_create(&cluster_state.thread, NULL, swim_thread_main, NULL) != 0) {
+        cluster_state.running = false;
+        close(cluster_state.sock);
+        cluster_state.sock = -1;
+        return -1;
+    }
+
+    fprintf(stderr, "[CLUSTER] %s gossiping on UDP port %u\n",
+            cluster_state.self_id, cluster_state.port);
+    return 0;
+}
+
+/* Announce departure and stop */
+void server_cluster_stop(void) {
+    if (!cluster_state.running) {
+        return;
+    }
+
+    pthread_mutex_lock(&cluster_state.lock);
+    cluster_state.leaving = true;
+    swim_enqueue(SWIM_UPDATE_LEFT, cluster_state.self_id, cluster_state.incarnation + 1, NULL, 0);
+    cluster_state.incarnation++;
+    if (strcmp(cluster_state.leader_id, cluster_state.self_id) == 0) {
+        /* Hand back the lease immediately */
+        swim_enqueue(SWIM_UPDATE_LEADER, cluster_state.self_id, cluster_state.leader_term, NULL, 0);
+    }
+
+    /* Push the news to a few members directly */
+    uint32_t sent = 0;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES && sent < SWIM_INDIRECT_PROBES; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->state == SWIM_STATE_ALIVE) {
+            swim_send(SWIM_MSG_PING, cluster_state.next_seq++, &m->addr, NULL);
+            sent++;
+        }
+    }
+    pthread_mutex_unlock(&cluster_state.lock);
+
+    __atomic_store_n(&cluster_state.running, false, __ATOMIC_RELEASE);
+    pthread_join(cluster_state.thread, NULL);
+    pthread_mutex_destroy(&cluster_state.lock);
+
+    close(cluster_state.sock);
+    cluster_state.sock = -1;
+}
+
+/* Get cluster nodes */
+int server_get_cluster_nodes(cluster_node_t* nodes, uint32_t* count, uint32_t max) {
+    if (!nodes || !count) {
+        return -1;
+    }
+
+    *count = 0;
+    if (!cluster_state.running) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&cluster_state.lock);
+
+    bool lease_valid = get_timestamp_us() < cluster_state.lease_expiry_us;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < MAX_CLUSTER_NODES && n < max; i++) {
+        swim_member_t* m = &cluster_state.members[i];
+        if (m->in_use && m->node.active && m->node.node_id[0]) {
+            nodes[n] = m->node;
+            nodes[n].is_leader = lease_valid &&
+                                 strcmp(m->node.node_id, cluster_state.leader_id) == 0;
+            n++;
+        }
+    }
+
+    pthread_mutex_unlock(&cluster_state.lock);
+
+    *count = n;
+    return 0;
+}
+
+/* Send heartbeat: re-announce ourselves and probe immediately */
+int server_send_heartbeat(void) {
+    if (!cluster_state.running) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&cluster_state.lock);
+    swim_enqueue(SWIM_UPDATE_ALIVE, cluster_state.self_id, cluster_state.incarnation, NULL, 0);
+    cluster_state.next_probe_us = 0;
+    pthread_mutex_unlock(&cluster_state.lock);
+
+    return 0;
+}
+
+/* Check if this node holds the leader lease */
+bool server_is_cluster_leader(void) {
+    if (!cluster_state.running) {
+        return false;
+    }
+
+    pthread_mutex_lock(&cluster_state.lock);
+    bool leader = strcmp(cluster_state.leader_id, cluster_state.self_id) == 0 &&
+                  get_timestamp_us() < cluster_state.lease_expiry_us;
+    pthread_mutex_unlock(&cluster_state.lock);
+
+    return leader;
+}
+
+/* Membership and bandwidth counters */
+int server_get_cluster_stats(cluster_stats_t* stats) {
+    if (!stats) {
+        return -1;
+    }
+
+    if (!cluster_state.running) {
+        memset(stats, 0, sizeof(*stats));
+        return 0;
+    }
+
+    pthread_mutex_lock(&cluster_state.lock);
+    *stats = cluster_state.stats;
+    pthread_mutex_unlock(&cluster_state.lock);
+
+    return 0;
+}
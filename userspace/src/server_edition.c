@@ -8,25 +8,11 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <sys/sysinfo.h>
 #include "server_edition.h"
 
 /* Maximum sizes */
 #define MAX_SERVICES 128
-#define MAX_CLUSTER_NODES 256
-#define MAX_AUDIT_ENTRIES 10000
-#define MAX_HEALTH_CHECKS 64
-
-/* Health check function pointer */
-typedef int (*health_check_fn_t)(service_health_t* health);
-
-/* Registered health check */
-typedef struct health_check {
-    char service_name[128];
-    health_check_fn_t check_fn;
-    bool active;
-} health_check_t;
 
 /* Global server state */
 static struct {
@@ -36,25 +22,9 @@ static struct {
     bool remote_mgmt_enabled;
     remote_protocol_t remote_protocol;
     enterprise_login_config_t enterprise_config;
-    cluster_node_t cluster_nodes[MAX_CLUSTER_NODES];
-    uint32_t cluster_node_count;
-    char local_node_id[64];
-    bool is_leader;
     resource_limits_t limits;
-    audit_entry_t* audit_log;
-    uint32_t audit_count;
-    uint64_t next_audit_id;
-    health_check_t health_checks[MAX_HEALTH_CHECKS];
-    uint32_t health_check_count;
 } server_state = {0};
 
-/* Get current timestamp (microseconds) */
-static uint64_t get_timestamp_us(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
-}
-
 /* Initialize server edition */
 int server_edition_init(const server_config_t* config) {
     if (server_state.initialized) {
@@ -83,12 +53,6 @@ int server_edition_init(const server_config_t* config) {
     /* Initialize enterprise login (disabled by default) */
     server_state.enterprise_config.enabled = false;
 
-    /* Initialize cluster state */
-    server_state.cluster_node_count = 0;
-    server_state.is_leader = false;
-    snprintf(server_state.local_node_id, sizeof(server_state.local_node_id),
-             "node-%lu", (unsigned long)getpid());
-
     /* Initialize resource limits (unlimited by default) */
     server_state.limits.max_memory_bytes = UINT64_MAX;
     server_state.limits.max_cpu_percent = 100;
@@ -97,16 +61,15 @@ int server_edition_init(const server_config_t* config) {
     server_state.limits.max_file_descriptors = 65536;
     server_state.limits.max_processes = 4096;
 
-    /* Allocate audit log */
-    server_state.audit_log = calloc(MAX_AUDIT_ENTRIES, sizeof(audit_entry_t));
-    if (!server_state.audit_log) {
+    /* Start audit writer */
+    if (server_audit_init(server_state.config.audit_log_dir) != 0) {
         return -1;
     }
-    server_state.audit_count = 0;
-    server_state.next_audit_id = 1;
 
-    /* Initialize health checks */
-    server_state.health_check_count = 0;
+    /* Start health check scheduler */
+    if (server_health_start(server_state.config.health_port) != 0) {
+        return -1;
+    }
 
     server_state.initialized = true;
 
@@ -241,83 +204,18 @@ int server_validate_cached_credentials(const char* username, const char* credent
     return 0;
 }
 
-/* Check health */
-int server_check_health(service_health_t* health) {
-    if (!health) {
-        return -1;
-    }
-
-    /* Get system info */
-    struct sysinfo si;
-    if (sysinfo(&si) == 0) {
-        health->uptime_seconds = si.uptime;
-        health->memory_usage_mb = (si.totalram - si.freeram) / (1024 * 1024);
-    }
-
-    /* Determine status */
-    if (health->cpu_usage < 70 && health->memory_usage_mb < 1024) {
-        health->status = HEALTH_OK;
-        strncpy(health->status_message, "Operating normally", 255);
-    } else if (health->cpu_usage < 90 && health->memory_usage_mb < 2048) {
-        health->status = HEALTH_WARNING;
-        strncpy(health->status_message, "High resource usage", 255);
-    } else {
-        health->status = HEALTH_CRITICAL;
-        strncpy(health->status_message, "Critical resource usage", 255);
-    }
-
-    health->last_check_timestamp = get_timestamp_us();
-    return 0;
-}
-
-/* Register health check */
-int server_register_health_check(const char* service_name, health_check_fn_t check_fn) {
-    if (!service_name || !check_fn) {
-        return -1;
-    }
-
-    if (server_state.health_check_count >= MAX_HEALTH_CHECKS) {
-        return -1;
-    }
-
-    health_check_t* hc = &server_state.health_checks[server_state.health_check_count++];
-    strncpy(hc->service_name, service_name, sizeof(hc->service_name) - 1);
-    hc->check_fn = check_fn;
-    hc->active = true;
-
-    return 0;
-}
-
-/* Get all health statuses */
-int server_get_all_health(service_health_t* services, uint32_t* count, uint32_t max) {
-    if (!services || !count) {
-        return -1;
-    }
-
-    uint32_t n = 0;
-    for (uint32_t i = 0; i < server_state.health_check_count && n < max; i++) {
-        if (!server_state.health_checks[i].active) {
-            continue;
-        }
-
-        service_health_t* health = &services[n++];
-        strncpy(health->service_name, server_state.health_checks[i].service_name,
-                sizeof(health->service_name) - 1);
-
-        /* Run health check */
-        server_state.health_checks[i].check_fn(health);
-    }
-
-    *count = n;
-    return 0;
-}
-
 /* Join cluster */
 int server_join_cluster(const char* cluster_name, const char* leader_ip) {
     if (!cluster_name || !leader_ip) {
         return -1;
     }
 
+    if (server_cluster_start(cluster_name, leader_ip, server_state.config.cluster_port) != 0) {
+        server_audit_log(AUDIT_CONFIG_CHANGE, "system", "join_cluster",
+                         cluster_name, false, "Cluster transport failed to start");
+        return -1;
+    }
+
     strncpy(server_state.config.cluster_name, cluster_name,
             sizeof(server_state.config.cluster_name) - 1);
     server_state.config.clustering_enabled = true;
@@ -334,6 +232,7 @@ int server_join_cluster(const char* cluster_name, const char* leader_ip) {
 
 /* Leave cluster */
 int server_leave_cluster(void) {
+    server_cluster_stop();
     server_state.config.clustering_enabled = false;
     fprintf(stderr, "[SERVER] Left cluster\n");
 
@@ -343,34 +242,6 @@ int server_leave_cluster(void) {
     return 0;
 }
 
-/* Get cluster nodes */
-int server_get_cluster_nodes(cluster_node_t* nodes, uint32_t* count, uint32_t max) {
-    if (!nodes || !count) {
-        return -1;
-    }
-
-    uint32_t n = 0;
-    for (uint32_t i = 0; i < server_state.cluster_node_count && n < max; i++) {
-        if (server_state.cluster_nodes[i].active) {
-            nodes[n++] = server_state.cluster_nodes[i];
-        }
-    }
-
-    *count = n;
-    return 0;
-}
-
-/* Send heartbeat */
-int server_send_heartbeat(void) {
-    /* In production, send heartbeat to cluster leader */
-    return 0;
-}
-
-/* Check if this node is cluster leader */
-bool server_is_cluster_leader(void) {
-    return server_state.is_leader;
-}
-
 /* Set resource limits */
 int server_set_resource_limits(const resource_limits_t* limits) {
     if (!limits) {
@@ -402,54 +273,6 @@ int server_get_resource_usage(resource_limits_t* usage) {
     return 0;
 }
 
-/* Audit log */
-int server_audit_log(audit_event_type_t type, const char* user, const char* action,
-                     const char* resource, bool success, const char* details) {
-    if (!user || !action) {
-        return -1;
-    }
-
-    if (server_state.audit_count >= MAX_AUDIT_ENTRIES) {
-        /* Rotate log (in production, write to file and clear) */
-        server_state.audit_count = 0;
-    }
-
-    audit_entry_t* entry = &server_state.audit_log[server_state.audit_count++];
-    entry->id = server_state.next_audit_id++;
-    entry->type = type;
-    entry->timestamp = get_timestamp_us();
-    strncpy(entry->user, user, sizeof(entry->user) - 1);
-    strncpy(entry->action, action, sizeof(entry->action) - 1);
-    strncpy(entry->resource, resource ?: "", sizeof(entry->resource) - 1);
-    entry->success = success;
-    strncpy(entry->details, details ?: "", sizeof(entry->details) - 1);
-
-    /* In production, also write to syslog */
-    fprintf(stderr, "[AUDIT] %s: %s %s %s (%s)\n",
-            entry->user, entry->action, entry->resource,
-            success ? "SUCCESS" : "FAILURE", entry->details);
-
-    return 0;
-}
-
-/* Get audit log */
-int server_get_audit_log(audit_entry_t* entries, uint32_t* count, uint32_t max,
-                         uint64_t since_timestamp) {
-    if (!entries || !count) {
-        return -1;
-    }
-
-    uint32_t n = 0;
-    for (uint32_t i = 0; i < server_state.audit_count && n < max; i++) {
-        if (server_state.audit_log[i].timestamp >= since_timestamp) {
-            entries[n++] = server_state.audit_log[i];
-        }
-    }
-
-    *count = n;
-    return 0;
-}
-
 /* Start service */
 int server_start_service(const char* service_name) {
     if (!service_name) {
@@ -518,5 +341,10 @@ int server_graceful_shutdown(uint32_t timeout_sec) {
     server_audit_log(AUDIT_SERVICE_STOP, "system", "graceful_shutdown",
                      "server", true, "Server shutting down");
 
+    server_health_stop();
+
+    /* Drain pending audit events last */
+    server_audit_shutdown();
+
     return 0;
 }
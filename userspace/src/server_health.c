@@ -0,0 +1,558 @@
+/*
+ * Server Edition Health Monitoring
+ * Checks run on their own intervals in a worker pool with per-check
+ * timeouts; readers get a lock-free snapshot of the latest results
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/sysinfo.h>
+#include <sys/time.h>
+#include "server_edition.h"
+
+#define MAX_HEALTH_CHECKS          64
+#define HEALTH_WORKERS             4
+#define HEALTH_DEFAULT_INTERVAL_MS 5000
+#define HEALTH_DEFAULT_TIMEOUT_MS  2000
+#define HEALTH_TICK_US             10000ULL
+#define HEALTH_SYSINFO_REFRESH_US  1000000ULL
+
+/* Registered health check */
+typedef struct health_check {
+    char service_name[128];
+    int (*check_fn)(service_health_t* health);
+    uint64_t interval_us;
+    uint64_t timeout_us;
+
+    /* Scheduling (scheduler thread and workers, under sched_lock) */
+    uint64_t next_run_us;
+    uint64_t started_us;
+    uint32_t generation;       /* Bumped per run; stale results are discarded */
+    bool running;              /* Result still awaited */
+    bool inflight;             /* A worker is inside check_fn */
+    bool abandoned;            /* That worker timed out and was replaced */
+
+    /* Published result (seqlock: odd while being written) */
+    uint32_t seq;
+    service_health_t result;
+
+    health_latency_t latency;
+} health_check_t;
+
+/* Work item handed to a pool thread */
+typedef struct health_job {
+    uint32_t check;
+    uint32_t generation;
+} health_job_t;
+
+static struct {
+    bool running;
+    health_check_t checks[MAX_HEALTH_CHECKS];
+    uint32_t count;            /* Published with release; slots below are immutable */
+
+    pthread_t scheduler;
+    pthread_t workers[HEALTH_WORKERS];
+    uint32_t worker_count;     /* Live pool threads, replacements included */
+    uint32_t stuck_count;      /* Threads held by a timed-out check */
+    pthread_mutex_t sched_lock;
+    pthread_cond_t work_ready;
+    health_job_t jobs[MAX_HEALTH_CHECKS];
+    uint32_t job_head;
+    uint32_t job_count;
+
+    /* Cached system sample for server_check_health */
+    uint32_t sysinfo_seq;
+    uint64_t sysinfo_uptime;
+    uint64_t sysinfo_used_mb;
+    uint64_t sysinfo_sampled_us;
+
+    /* Load balancer endpoint */
+    pthread_t http;
+    int http_sock;
+} health_state = {
+    .sched_lock = PTHREAD_MUTEX_INITIALIZER,
+    .work_ready = PTHREAD_COND_INITIALIZER,
+    .http_sock = -1,
+};
+
+/* Get current timestamp (microseconds) */
+static uint64_t get_timestamp_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/* Seqlock write side: only one writer per check at a time (sched_lock) */
+static void health_publish(health_check_t* hc, const service_health_t* result) {
+    __atomic_add_fetch(&hc->seq, 1, __ATOMIC_ACQ_REL);
+    memcpy(&hc->result, result, sizeof(*result));
+    __atomic_add_fetch(&hc->seq, 1, __ATOMIC_RELEASE);
+}
+
+/* Seqlock read side */
+static void health_read(health_check_t* hc, service_health_t* out) {
+    uint32_t seq;
+    do {
+        while ((seq = __atomic_load_n(&hc->seq, __ATOMIC_ACQUIRE)) & 1) {
+            /* Writer in progress */
+        }
+        memcpy(out, &hc->result, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&hc->seq, __ATOMIC_RELAXED) != seq);
+}
+
+static void health_record_latency(health_latency_t* latency, uint64_t us, bool timed_out) {
+    uint32_t bucket = 0;
+    while (bucket < HEALTH_LATENCY_BUCKETS - 1 && (1ULL << (bucket + 1)) <= us) {
+        bucket++;
+    }
+
+    __atomic_add_fetch(&latency->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&latency->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&latency->total_us, us, __ATOMIC_RELAXED);
+    if (timed_out) {
+        __atomic_add_fetch(&latency->timeouts, 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t max = __atomic_load_n(&latency->max_us, __ATOMIC_RELAXED);
+    while (us > max &&
+           !__atomic_compare_exchange_n(&latency->max_us, &max, us, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void health_refresh_sysinfo(uint64_t now) {
+    struct sysinfo si;
+    if (sysinfo(&si) != 0) {
+        return;
+    }
+
+    __atomic_add_fetch(&health_state.sysinfo_seq, 1, __ATOMIC_ACQ_REL);
+    health_state.sysinfo_uptime = si.uptime;
+    health_state.sysinfo_used_mb = ((uint64_t)(si.totalram - si.freeram) * si.mem_unit) /
+                                   (1024 * 1024);
+    health_state.sysinfo_sampled_us = now;
+    __atomic_add_fetch(&health_state.sysinfo_seq, 1, __ATOMIC_RELEASE);
+}
+
+/* Pool thread: run one check outside any lock */
+static void* health_worker_main(void* arg) {
+    (void)arg;
+
+    pthread_mutex_lock(&health_state.sched_lock);
+    while (health_state.running) {
+        if (health_state.job_count == 0) {
+            pthread_cond_wait(&health_state.work_ready, &health_state.sched_lock);
+            continue;
+        }
+
+        health_job_t job = health_state.jobs[health_state.job_head];
+        health_state.job_head = (health_state.job_head + 1) % MAX_HEALTH_CHECKS;
+        health_state.job_count--;
+
+        /* Timed out while still queued: its slot was already reported down */
+        health_check_t* hc = &health_state.checks[job.check];
+        if (hc->generation != job.generation) {
+            hc->inflight = false;
+            continue;
+        }
+        pthread_mutex_unlock(&health_state.sched_lock);
+
+        service_health_t result;
+        memset(&result, 0, sizeof(result));
+        strncpy(result.service_name, hc->service_name, sizeof(result.service_name) - 1);
+
+        uint64_t start = get_timestamp_us();
+        if (hc->check_fn(&result) != 0 && result.status == HEALTH_OK) {
+            result.status = HEALTH_DOWN;
+            strncpy(result.status_message, "Health check failed", sizeof(result.status_message) - 1);
+        }
+        uint64_t end = get_timestamp_us();
+        result.last_check_timestamp = end;
+
+        pthread_mutex_lock(&health_state.sched_lock);
+        hc->inflight = false;
+        /* A result arriving after its timeout was already reported is dropped */
+        if (hc->running && hc->generation == job.generation) {
+            health_record_latency(&hc->latency, end - start, false);
+            health_publish(hc, &result);
+            hc->running = false;
+            hc->next_run_us = end + hc->interval_us;
+        } else {
+            health_record_latency(&hc->latency, end - start, true);
+        }
+
+        /* A replacement took this thread's place while the check hung */
+        if (hc->abandoned) {
+            hc->abandoned = false;
+            health_state.stuck_count--;
+            if (health_state.worker_count - health_state.stuck_count > HEALTH_WORKERS) {
+                health_state.worker_count--;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&health_state.sched_lock);
+
+    return NULL;
+}
+
+/* Add a pool thread (caller holds sched_lock once the pool is running) */
+static int health_spawn_worker(bool detached) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, health_worker_main, NULL) != 0) {
+        return -1;
+    }
+    if (detached) {
+        pthread_detach(thread);
+    } else {
+        health_state.workers[health_state.worker_count] = thread;
+    }
+    health_state.worker_count++;
+    return 0;
+}
+
+/* Scheduler: dispatch due checks and time out stuck ones */
+static void* health_scheduler_main(void* arg) {
+    (void)arg;
+
+    while (__atomic_load_n(&health_state.running, __ATOMIC_ACQUIRE)) {
+        uint64_t now = get_timestamp_us();
+
+        if (now - health_state.sysinfo_sampled_us >= HEALTH_SYSINFO_REFRESH_US) {
+            health_refresh_sysinfo(now);
+        }
+
+        pthread_mutex_lock(&health_state.sched_lock);
+        uint32_t count = __atomic_load_n(&health_state.count, __ATOMIC_ACQUIRE);
+
+        for (uint32_t i = 0; i < count; i++) {
+            health_check_t* hc = &health_state.checks[i];
+
+            if (hc->running) {
+                if (now - hc->started_us > hc->timeout_us) {
+                    service_health_t result;
+                    health_read(hc, &result);
+                    result.status = HEALTH_DOWN;
+                    result.last_check_timestamp = now;
+                    snprintf(result.status_message, sizeof(result.status_message),
+                             "Health check timed out after %lu ms",
+                             (unsigned long)(hc->timeout_us / 1000));
+                    health_publish(hc, &result);
+
+                    /* The worker's eventual result is discarded via the generation */
+                    hc->running = false;
+                    hc->generation++;
+                    hc->next_run_us = now + hc->interval_us;
+
+                    /* Bound the check: the pool gets a thread back now, not when it returns */
+                    if (hc->inflight && !hc->abandoned && health_spawn_worker(true) == 0) {
+                        hc->abandoned = true;
+                        health_state.stuck_count++;
+                    }
+                }
+                continue;
+            }
+
+            /* A hung check is not re-dispatched until its call returns */
+            if (now >= hc->next_run_us && !hc->inflight &&
+                health_state.job_count < MAX_HEALTH_CHECKS) {
+                hc->running = true;
+                hc->inflight = true;
+                hc->started_us = now;
+                hc->generation++;
+
+                uint32_t tail = (health_state.job_head + health_state.job_count) % MAX_HEALTH_CHECKS;
+                health_state.jobs[tail].check = i;
+                health_state.jobs[tail].generation = hc->generation;
+                health_state.job_count++;
+                pthread_cond_signal(&health_state.work_ready);
+            }
+        }
+        pthread_mutex_unlock(&health_state.sched_lock);
+
+        usleep(HEALTH_TICK_US);
+    }
+
+    return NULL;
+}
+
+static const char* health_status_name(health_status_t status) {
+    switch (status) {
+        case HEALTH_OK: return "ok";
+        case HEALTH_WARNING: return "warning";
+        case HEALTH_CRITICAL: return "critical";
+        case HEALTH_DOWN: return "down";
+    }
+    return "unknown";
+}
+
+/* Minimal HTTP/1.0 endpoint: 200 when every check is OK or WARNING, else 503 */
+static void health_http_respond(int client) {
+    char request[512];
+    ssize_t n = recv(client, request, sizeof(request) - 1, 0);
+    if (n <= 0) {
+        return;
+    }
+    request[n] = '\0';
+
+    static char body[MAX_HEALTH_CHECKS * 256 + 64];
+    size_t len = 0;
+    bool healthy = true;
+
+    uint32_t count = __atomic_load_n(&health_state.count, __ATOMIC_ACQUIRE);
+    len += snprintf(body + len, sizeof(body) - len, "{\"services\":[");
+    for (uint32_t i = 0; i < count; i++) {
+        service_health_t result;
+        health_read(&health_state.checks[i], &result);
+        if (result.status == HEALTH_CRITICAL || result.status == HEALTH_DOWN) {
+            healthy = false;
+        }
+        len += snprintf(body + len, sizeof(body) - len,
+                        "%s{\"name\":\"%s\",\"status\":\"%s\",\"checked_us\":%lu}",
+                        i ? "," : "", health_state.checks[i].service_name,
+                        health_status_name(result.status),
+                        (unsigned long)result.last_check_timestamp);
+        if (len >= sizeof(body) - 64) {
+            break;
+        }
+    }
+    len += snprintf(body + len, sizeof(body) - len, "]}\n");
+
+    char header[160];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 %s\r\nContent-Type: application/json\r\n"
+                              "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                              healthy ? "200 OK" : "503 Service Unavailable", len);
+
+    send(client, header, (size_t)header_len, MSG_NOSIGNAL);
+    if (strncmp(request, "HEAD ", 5) != 0) {
+        send(client, body, len, MSG_NOSIGNAL);
+    }
+}
+
+static void* health_http_main(void* arg) {
+    (void)arg;
+
+    while (__atomic_load_n(&health_state.running, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfd = { .fd = health_state.http_sock, .events = POLLIN };
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+
+        int client = accept(health_state.http_sock, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        health_http_respond(client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+static int health_http_start(uint16_t port) {
+    health_state.http_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (health_state.http_sock < 0) {
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(health_state.http_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (bind(health_state.http_sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(health_state.http_sock, 64) < 0 ||
+        pthread_create(&health_state.http, NULL, health_http_main, NULL) != 0) {
+        close(health_state.http_sock);
+        health_state.http_sock = -1;
+        return -1;
+    }
+
+    fprintf(stderr, "[HEALTH] Endpoint listening on port %u\n", port);
+    return 0;
+}
+
+/* Start the scheduler, worker pool and (if port != 0) the HTTP endpoint */
+int server_health_start(uint16_t http_port) {
+    if (health_state.running) {
+        return -1;
+    }
+
+    health_refresh_sysinfo(get_timestamp_us());
+
+    health_state.running = true;
+
+    if (pthread_create(&health_state.scheduler, NULL, health_scheduler_main, NULL) != 0) {
+        health_state.running = false;
+        return -1;
+    }
+    pthread_mutex_lock(&health_state.sched_lock);
+    health_state.worker_count = 0;
+    health_state.stuck_count = 0;
+    for (uint32_t i = 0; i < HEALTH_WORKERS; i++) {
+        health_spawn_worker(false);
+    }
+    pthread_mutex_unlock(&health_state.sched_lock);
+
+    if (http_port && health_http_start(http_port) != 0) {
+        fprintf(stderr, "[HEALTH] Cannot listen on port %u; endpoint disabled\n", http_port);
+    }
+
+    return 0;
+}
+
+/* Stop all health threads; checks still running are detached from the pool */
+void server_health_stop(void) {
+    if (!health_state.running) {
+        return;
+    }
+
+    pthread_mutex_lock(&health_state.sched_lock);
+    __atomic_store_n(&health_state.running, false, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&health_state.work_ready);
+    pthread_mutex_unlock(&health_state.sched_lock);
+
+    pthread_join(health_state.scheduler, NULL);
+    for (uint32_t i = 0; i < HEALTH_WORKERS; i++) {
+        pthread_detach(health_state.workers[i]);
+    }
+
+    if (health_state.http_sock >= 0) {
+        pthread_join(health_state.http, NULL);
+        close(health_state.http_sock);
+        health_state.http_sock = -1;
+    }
+}
+
+/* Check health (system-wide, from the cached sample) */
+int server_check_health(service_health_t* health) {
+    if (!health) {
+        return -1;
+    }
+
+    if (!health_state.running) {
+        health_refresh_sysinfo(get_timestamp_us());
+    }
+
+    uint32_t seq;
+    do {
+        while ((seq = __atomic_load_n(&health_state.sysinfo_seq, __ATOMIC_ACQUIRE)) & 1) {
+        }
+        health->uptime_seconds = health_state.sysinfo_uptime;
+        health->memory_usage_mb = (uint32_t)health_state.sysinfo_used_mb;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&health_state.sysinfo_seq, __ATOMIC_RELAXED) != seq);
+
+    /* Determine status */
+    if (health->cpu_usage < 70 && health->memory_usage_mb < 1024) {
+        health->status = HEALTH_OK;
+        strncpy(health->status_message, "Operating normally", 255);
+    } else if (health->cpu_usage < 90 && health->memory_usage_mb < 2048) {
+        health->status = HEALTH_WARNING;
+        strncpy(health->status_message, "High resource usage", 255);
+    } else {
+        health->status = HEALTH_CRITICAL;
+        strncpy(health->status_message, "Critical resource usage", 255);
+    }
+
+    health->last_check_timestamp = get_timestamp_us();
+    return 0;
+}
+
+/* Register health check with explicit interval and timeout */
+int server_register_health_check_ex(const char* service_name,
+                                     int (*check_fn)(service_health_t* health),
+                                     uint32_t interval_ms, uint32_t timeout_ms) {
+    if (!service_name || !check_fn) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&health_state.sched_lock);
+
+    uint32_t index = health_state.count;
+    if (index >= MAX_HEALTH_CHECKS) {
+        pthread_mutex_unlock(&health_state.sched_lock);
+        return -1;
+    }
+
+    health_check_t* hc = &health_state.checks[index];
+    memset(hc, 0, sizeof(*hc));
+    strncpy(hc->service_name, service_name, sizeof(hc->service_name) - 1);
+    hc->check_fn = check_fn;
+    hc->interval_us = (uint64_t)(interval_ms ? interval_ms : HEALTH_DEFAULT_INTERVAL_MS) * 1000;
+    hc->timeout_us = (uint64_t)(timeout_ms ? timeout_ms : HEALTH_DEFAULT_TIMEOUT_MS) * 1000;
+    hc->next_run_us = 0;  /* Run on the next tick */
+
+    strncpy(hc->result.service_name, service_name, sizeof(hc->result.service_name) - 1);
+    hc->result.status = HEALTH_WARNING;
+    strncpy(hc->result.status_message, "Pending first check", sizeof(hc->result.status_message) - 1);
+
+    __atomic_store_n(&health_state.count, index + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&health_state.sched_lock);
+    return 0;
+}
+
+/* Register health check */
+int server_register_health_check(const char* service_name,
+                                  int (*check_fn)(service_health_t* health)) {
+    return server_register_health_check_ex(service_name, check_fn, 0, 0);
+}
+
+/* Get all health statuses (snapshot of the latest results; never runs checks) */
+int server_get_all_health(service_health_t* services, uint32_t* count, uint32_t max) {
+    if (!services || !count) {
+        return -1;
+    }
+
+    uint32_t total = __atomic_load_n(&health_state.count, __ATOMIC_ACQUIRE);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < total && n < max; i++) {
+        health_read(&health_state.checks[i], &services[n++]);
+    }
+
+    *count = n;
+    return 0;
+}
+
+/* Check latency histogram */
+int server_get_health_latency(const char* service_name, health_latency_t* latency) {
+    if (!service_name || !latency) {
+        return -1;
+    }
+
+    uint32_t total = __atomic_load_n(&health_state.count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < total; i++) {
+        health_check_t* hc = &health_state.checks[i];
+        if (strcmp(hc->service_name, service_name) != 0) {
+            continue;
+        }
+
+        for (uint32_t b = 0; b < HEALTH_LATENCY_BUCKETS; b++) {
+            latency->buckets[b] = __atomic_load_n(&hc->latency.buckets[b], __ATOMIC_RELAXED);
+        }
+        latency->count = __atomic_load_n(&hc->latency.count, __ATOMIC_RELAXED);
+        latency->timeouts = __atomic_load_n(&hc->latency.timeouts, __ATOMIC_RELAXED);
+        latency->total_us = __atomic_load_n(&hc->latency.total_us, __ATOMIC_RELAXED);
+        latency->max_us = __atomic_load_n(&hc->latency.max_us, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    return -1;
+}
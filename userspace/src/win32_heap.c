@@ -0,0 +1,1075 @@
+/*
+ * Windows Persona - Heaps and Virtual Memory
+ * Low-fragmentation heaps on 64 KiB slabs with per-thread caches, and
+ * VirtualAlloc reserve/commit on 64 KiB granularity
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "win32_persona.h"
+
+#define HEAP_MAGIC          0x48454150u  /* "HEAP" */
+#define HEAP_SLAB_MAGIC     0x534c4142u  /* "SLAB" */
+#define HEAP_LARGE_MAGIC    0x4c415247u  /* "LARG" */
+
+#define HEAP_SLAB_SIZE      WIN32_ALLOCATION_GRANULARITY
+#define HEAP_HEADER_SIZE    64           /* Slab or large block header */
+#define HEAP_SMALL_MAX      16384
+#define HEAP_CLASSES        64           /* 16..256 by 16, then 8 per doubling */
+#define HEAP_ARENA_MIN      (1u << 20)
+#define HEAP_ARENA_MAX      (16u << 20)
+#define HEAP_EMPTY_KEEP     16           /* Empty slabs kept resident per heap */
+#define HEAP_LARGE_CACHE    32           /* Freed large mappings kept for reuse */
+#define HEAP_PAGE_SIZE      4096
+
+#define WIN32_VIRTUAL_MAX   4096         /* VirtualAlloc reservations */
+
+struct win32_heap;
+
+/* Header at the start of every 64 KiB slab */
+typedef struct heap_slab {
+    uint32_t magic;
+    uint32_t size_class;
+    struct win32_heap* heap;
+    void* free_list;            // Freed blocks, linked through their first word
+    char* bump;                 // Next never-used block
+    uint32_t block_size;
+    uint32_t used;
+    uint32_t capacity;
+    bool on_partial;
+    struct heap_slab* next;     // Partial list of its class, or the heap's empty list
+    struct heap_slab* prev;
+} heap_slab_t;
+
+/* Header of a block too big for a slab; the block follows it */
+typedef struct heap_large {
+    uint32_t magic;
+    uint32_t reserved;
+    struct win32_heap* heap;
+    size_t size;
+    size_t mapped;
+    struct heap_large* next;
+    struct heap_large* prev;
+} heap_large_t;
+
+_Static_assert(sizeof(heap_slab_t) <= HEAP_HEADER_SIZE, "slab header too big");
+_Static_assert(sizeof(heap_large_t) <= HEAP_HEADER_SIZE, "large header too big");
+
+/* Address space slabs are carved from */
+typedef struct heap_arena {
+    char* base;
+    size_t size;
+    size_t used;
+    struct heap_arena* next;
+} heap_arena_t;
+
+typedef struct win32_heap {
+    uint32_t magic;
+    uint32_t flags;             // HeapCreate options
+    uint32_t lock;
+    size_t maximum;             // 0 = growable
+    size_t committed;
+    heap_slab_t* partial[HEAP_CLASSES];
+    heap_slab_t* empty;
+    uint32_t empty_count;
+    heap_large_t* large;
+    heap_large_t* large_cache[HEAP_LARGE_CACHE];
+    uint32_t large_cached;
+    heap_arena_t* arenas;
+    size_t next_arena_size;
+} win32_heap_t;
+
+/* Free blocks of the process heap owned by one thread */
+typedef struct heap_tcache {
+    void* head[HEAP_CLASSES];
+    uint32_t count[HEAP_CLASSES];
+    uint64_t allocs;            // Not yet added to the global count
+    bool registered;
+} heap_tcache_t;
+
+typedef struct virtual_region {
+    uintptr_t base;
+    size_t size;
+    DWORD protect;              // Last protection applied anywhere in it
+} virtual_region_t;
+
+static win32_heap_t g_process_heap;
+static pthread_once_t g_process_heap_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_tcache_key;
+static __thread heap_tcache_t g_tcache;
+
+static struct {
+    virtual_region_t regions[WIN32_VIRTUAL_MAX];
+    uint32_t count;
+    uint32_t lock;
+} g_virtual;
+
+static win32_heap_stats_t g_heap_stats;
+
+static void heap_lock(uint32_t* lock) {
+    while (__sync_lock_test_and_set(lock, 1)) {
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+static void heap_unlock(uint32_t* lock) {
+    __sync_lock_release(lock);
+}
+
+static inline size_t heap_round_up(size_t value, size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* Size classes: 16-byte steps to 256, then eight per power of two up to 16 KiB */
+static inline uint32_t heap_class_of(size_t size) {
+    if (size <= 256) {
+        return size ? (uint32_t)((size - 1) >> 4) : 0;
+    }
+    uint32_t k = 63 - (uint32_t)__builtin_clzll(size - 1);
+    return 16 + (k - 8) * 8 + (uint32_t)((size - 1 - ((size_t)1 << k)) >> (k - 3));
+}
+
+static inline uint32_t heap_class_size(uint32_t size_class) {
+    if (size_class < 16) {
+        return (size_class + 1) << 4;
+    }
+    uint32_t k = 8 + (size_class - 16) / 8;
+    return (1u << k) + (((size_class - 16) % 8 + 1) << (k - 3));
+}
+
+/* Blocks moved between a thread cache and the heap at once */
+static inline uint32_t heap_tcache_batch(uint32_t size_class) {
+    uint32_t n = 8192 / heap_class_size(size_class);
+    return n < 4 ? 4 : n > 32 ? 32 : n;
+}
+
+/* Map size bytes at a 64 KiB boundary */
+static void* heap_map_aligned(size_t size, int prot, int extra_flags) {
+    size_t span = size + WIN32_ALLOCATION_GRANULARITY;
+    char* raw = (char*)mmap(NULL, span, prot, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+    if (raw == (char*)MAP_FAILED) {
+        return NULL;
+    }
+
+    char* base = (char*)heap_round_up((uintptr_t)raw, WIN32_ALLOCATION_GRANULARITY);
+    if (base > raw) {
+        munmap(raw, base - raw);
+    }
+    if (raw + span > base + size) {
+        munmap(base + size, raw + span - (base + size));
+    }
+    return base;
+}
+
+static inline void* heap_header_of(const void* ptr) {
+    return (void*)((uintptr_t)ptr & ~(uintptr_t)(WIN32_ALLOCATION_GRANULARITY - 1));
+}
+
+/* ============================================================================
+ * Slabs (caller holds the heap lock unless the heap is unserialized)
+ * ============================================================================ */
+
+static void heap_partial_add(win32_heap_t* heap, heap_slab_t* slab) {
+    heap_slab_t** head = &heap->partial[slab->size_class];
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+    slab->on_partial = true;
+}
+
+static void heap_partial_remove(win32_heap_t* heap, heap_slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        heap->partial[slab->size_class] = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->on_partial = false;
+}
+
+/* Carve a fresh slab out of the heap's arenas */
+static heap_slab_t* heap_carve_slab(win32_heap_t* heap) {
+    heap_arena_t* arena = heap->arenas;
+    if (!arena || arena->used == arena->size) {
+        size_t size = heap->next_arena_size;
+        arena = (heap_arena_t*)malloc(sizeof(heap_arena_t));
+        if (!arena) {
+            return NULL;
+        }
+
+        int prot = PROT_READ | PROT_WRITE | ((heap->flags & HEAP_CREATE_ENABLE_EXECUTE) ? PROT_EXEC : 0);
+        arena->base = (char*)heap_map_aligned(size, prot, MAP_NORESERVE);
+        if (!arena->base) {
+            free(arena);
+            return NULL;
+        }
+        arena->size = size;
+        arena->used = 0;
+        arena->next = heap->arenas;
+        heap->arenas = arena;
+        if (heap->next_arena_size < HEAP_ARENA_MAX) {
+            heap->next_arena_size *= 2;
+        }
+    }
+
+    heap_slab_t* slab = (heap_slab_t*)(arena->base + arena->used);
+    arena->used += HEAP_SLAB_SIZE;
+    return slab;
+}
+
+static heap_slab_t* heap_new_slab(win32_heap_t* heap, uint32_t size_class) {
+    heap_slab_t* slab = heap->empty;
+    if (slab) {
+        heap->empty = slab->next;
+        heap->empty_count--;
+    } else {
+        if (heap->maximum && heap->committed + HEAP_SLAB_SIZE > heap->maximum) {
+            return NULL;
+        }
+        slab = heap_carve_slab(heap);
+        if (!slab) {
+            return NULL;
+        }
+        heap->committed += HEAP_SLAB_SIZE;
+        __atomic_fetch_add(&g_heap_stats.committed, HEAP_SLAB_SIZE, __ATOMIC_RELAXED);
+    }
+
+    slab->magic = HEAP_SLAB_MAGIC;
+    slab->size_class = size_class;
+    slab->heap = heap;
+    slab->free_list = NULL;
+    slab->bump = (char*)slab + HEAP_HEADER_SIZE;
+    slab->block_size = heap_class_size(size_class);
+    slab->used = 0;
+    slab->capacity = (HEAP_SLAB_SIZE - HEAP_HEADER_SIZE) / slab->block_size;
+    heap_partial_add(heap, slab);
+    return slab;
+}
+
+/* An empty slab is kept for any class; past a few, its pages go back to the system */
+static void heap_retire_slab(win32_heap_t* heap, heap_slab_t* slab) {
+    heap_partial_remove(heap, slab);
+    if (heap->empty_count >= HEAP_EMPTY_KEEP) {
+        madvise((char*)slab + HEAP_PAGE_SIZE, HEAP_SLAB_SIZE - HEAP_PAGE_SIZE, MADV_DONTNEED);
+    }
+    slab->next = heap->empty;
+    heap->empty = slab;
+    heap->empty_count++;
+}
+
+static void* heap_alloc_small(win32_heap_t* heap, uint32_t size_class) {
+    heap_slab_t* slab = heap->partial[size_class];
+    if (!slab) {
+        slab = heap_new_slab(heap, size_class);
+        if (!slab) {
+            return NULL;
+        }
+    }
+
+    void* block = slab->free_list;
+    if (block) {
+        slab->free_list = *(void**)block;
+    } else {
+        block = slab->bump;
+        slab->bump += slab->block_size;
+    }
+
+    if (++slab->used == slab->capacity) {
+        heap_partial_remove(heap, slab);
+    }
+    return block;
+}
+
+static void heap_free_small(win32_heap_t* heap, heap_slab_t* slab, void* block) {
+    *(void**)block = slab->free_list;
+    slab->free_list = block;
+
+    if (!slab->on_partial) {
+        heap_partial_add(heap, slab);
+    }
+    /* Keep the last slab of a class so alloc/free of one block does not thrash */
+    if (--slab->used == 0 && (slab->prev || slab->next)) {
+        heap_retire_slab(heap, slab);
+    }
+}
+
+/* ============================================================================
+ * Large blocks
+ * ============================================================================ */
+
+static void* heap_alloc_large(win32_heap_t* heap, size_t size) {
+    size_t need = heap_round_up(size + HEAP_HEADER_SIZE, HEAP_PAGE_SIZE);
+    heap_large_t* large = NULL;
+
+    for (uint32_t i = 0; i < heap->large_cached; i++) {
+        heap_large_t* cached = heap->large_cache[i];
+        if (cached->mapped >= need && cached->mapped / 2 <= need) {
+            large = cached;
+            heap->large_cache[i] = heap->large_cache[--heap->large_cached];
+            break;
+        }
+    }
+
+    if (!large) {
+        if (heap->maximum && heap->committed + need > heap->maximum) {
+            return NULL;
+        }
+        int prot = PROT_READ | PROT_WRITE | ((heap->flags & HEAP_CREATE_ENABLE_EXECUTE) ? PROT_EXEC : 0);
+        large = (heap_large_t*)heap_map_aligned(need, prot, 0);
+        if (!large) {
+            return NULL;
+        }
+        large->magic = HEAP_LARGE_MAGIC;
+        large->heap = heap;
+        large->mapped = need;
+        heap->committed += need;
+        __atomic_fetch_add(&g_heap_stats.committed, need, __ATOMIC_RELAXED);
+    }
+
+    large->size = size;
+    large->prev = NULL;
+    large->next = heap->large;
+    if (heap->large) {
+        heap->large->prev = large;
+    }
+    heap->large = large;
+    return (char*)large + HEAP_HEADER_SIZE;
+}
+
+static void heap_unmap_large(win32_heap_t* heap, heap_large_t* large) {
+    heap->committed -= large->mapped;
+    __atomic_fetch_sub(&g_heap_stats.committed, large->mapped, __ATOMIC_RELAXED);
+    large->magic = 0;
+    munmap(large, large->mapped);
+}
+
+static void heap_free_large(win32_heap_t* heap, heap_large_t* large) {
+    if (large->prev) {
+        large->prev->next = large->next;
+    } else {
+        heap->large = large->next;
+    }
+    if (large->next) {
+        large->next->prev = large->prev;
+    }
+
+    if (heap->large_cached < HEAP_LARGE_CACHE) {
+        heap->large_cache[heap->large_cached++] = large;
+    } else {
+        heap_unmap_large(heap, large);
+    }
+}
+
+/* ============================================================================
+ * Process heap thread caches
+ * ============================================================================ */
+
+/* Give n cached blocks of a class back to their slabs */
+static void heap_tcache_drain(heap_tcache_t* tc, uint32_t size_class, uint32_t n) {
+    heap_lock(&g_process_heap.lock);
+    while (n-- && tc->head[size_class]) {
+        void* block = tc->head[size_class];
+        tc->head[size_class] = *(void**)block;
+        tc->count[size_class]--;
+        heap_free_small(&g_process_heap, (heap_slab_t*)heap_header_of(block), block);
+    }
+    heap_unlock(&g_process_heap.lock);
+}
+
+static void heap_tcache_exit(void* arg) {
+    heap_tcache_t* tc = (heap_tcache_t*)arg;
+    for (uint32_t i = 0; i < HEAP_CLASSES; i++) {
+        if (tc->count[i]) {
+            heap_tcache_drain(tc, i, tc->count[i]);
+        }
+    }
+    __atomic_fetch_add(&g_heap_stats.allocations, tc->allocs, __ATOMIC_RELAXED);
+    tc->allocs = 0;
+}
+
+static bool heap_tcache_refill(heap_tcache_t* tc, uint32_t size_class) {
+    if (!tc->registered) {
+        /* Flush this thread's cache back to the heap when it exits */
+        pthread_setspecific(g_tcache_key, tc);
+        tc->registered = true;
+    }
+
+    uint32_t batch = heap_tcache_batch(size_class);
+    heap_lock(&g_process_heap.lock);
+    while (batch--) {
+        void* block = heap_alloc_small(&g_process_heap, size_class);
+        if (!block) {
+            break;
+        }
+        *(void**)block = tc->head[size_class];
+        tc->head[size_class] = block;
+        tc->count[size_class]++;
+    }
+    heap_unlock(&g_process_heap.lock);
+
+    __atomic_fetch_add(&g_heap_stats.allocations, tc->allocs, __ATOMIC_RELAXED);
+    tc->allocs = 0;
+    return tc->head[size_class] != NULL;
+}
+
+static inline void* heap_tcache_alloc(uint32_t size_class) {
+    heap_tcache_t* tc = &g_tcache;
+    if (!tc->head[size_class] && !heap_tcache_refill(tc, size_class)) {
+        return NULL;
+    }
+
+    void* block = tc->head[size_class];
+    tc->head[size_class] = *(void**)block;
+    tc->count[size_class]--;
+    tc->allocs++;
+    return block;
+}
+
+static inline void heap_tcache_free(uint32_t size_class, void* block) {
+    heap_tcache_t* tc = &g_tcache;
+    *(void**)block = tc->head[size_class];
+    tc->head[size_class] = block;
+
+    uint32_t batch = heap_tcache_batch(size_class);
+    if (++tc->count[size_class] > 2 * batch) {
+        heap_tcache_drain(tc, size_class, batch);
+    }
+}
+
+/* ============================================================================
+ * Heap API
+ * ============================================================================ */
+
+static void heap_init(win32_heap_t* heap, DWORD options, size_t initial, size_t maximum) {
+    memset(heap, 0, sizeof(*heap));
+    heap->flags = options & (HEAP_NO_SERIALIZE | HEAP_GENERATE_EXCEPTIONS | HEAP_CREATE_ENABLE_EXECUTE);
+    heap->maximum = maximum ? heap_round_up(maximum, HEAP_SLAB_SIZE) : 0;
+    heap->next_arena_size = HEAP_ARENA_MIN;
+    while (heap->next_arena_size < initial && heap->next_arena_size < HEAP_ARENA_MAX) {
+        heap->next_arena_size *= 2;
+    }
+    heap->magic = HEAP_MAGIC;
+    __atomic_fetch_add(&g_heap_stats.heaps, 1, __ATOMIC_RELAXED);
+}
+
+static void process_heap_init(void) {
+    heap_init(&g_process_heap, 0, 0, 0);
+    pthread_key_create(&g_tcache_key, heap_tcache_exit);
+}
+
+static win32_heap_t* heap_from_handle(HANDLE hHeap) {
+    win32_heap_t* heap = (win32_heap_t*)hHeap;
+    if (!heap || heap->magic != HEAP_MAGIC) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return NULL;
+    }
+    return heap;
+}
+
+static inline bool heap_serialized(win32_heap_t* heap, DWORD flags) {
+    return !((heap->flags | flags) & HEAP_NO_SERIALIZE);
+}
+
+static void* heap_alloc(win32_heap_t* heap, DWORD flags, size_t size) {
+    void* block;
+
+    if (size <= HEAP_SMALL_MAX) {
+        uint32_t size_class = heap_class_of(size);
+        if (heap == &g_process_heap) {
+            block = heap_tcache_alloc(size_class);
+        } else {
+            bool serialize = heap_serialized(heap, flags);
+            if (serialize) {
+                heap_lock(&heap->lock);
+            }
+            block = heap_alloc_small(heap, size_class);
+            if (serialize) {
+                heap_unlock(&heap->lock);
+            }
+            __atomic_fetch_add(&g_heap_stats.allocations, 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        bool serialize = heap_serialized(heap, flags);
+        if (serialize) {
+            heap_lock(&heap->lock);
+        }
+        block = heap_alloc_large(heap, size);
+        if (serialize) {
+            heap_unlock(&heap->lock);
+        }
+        __atomic_fetch_add(&g_heap_stats.allocations, 1, __ATOMIC_RELAXED);
+    }
+
+    if (block && (flags & HEAP_ZERO_MEMORY)) {
+        memset(block, 0, size);
+    }
+    return block;
+}
+
+/* Slab or large header of a block from this heap, NULL if it is not one */
+static void* heap_block_header(win32_heap_t* heap, const void* ptr) {
+    if (!ptr) {
+        return NULL;
+    }
+
+    void* header = heap_header_of(ptr);
+    uint32_t magic = *(uint32_t*)header;
+    if (magic == HEAP_SLAB_MAGIC) {
+        heap_slab_t* slab = (heap_slab_t*)header;
+        return slab->heap == heap && (char*)ptr >= (char*)slab + HEAP_HEADER_SIZE ? slab : NULL;
+    }
+    if (magic == HEAP_LARGE_MAGIC) {
+        heap_large_t* large = (heap_large_t*)header;
+        return large->heap == heap && (char*)ptr == (char*)large + HEAP_HEADER_SIZE ? large : NULL;
+    }
+    return NULL;
+}
+
+static size_t heap_block_size(void* header) {
+    return *(uint32_t*)header == HEAP_SLAB_MAGIC ? ((heap_slab_t*)header)->block_size
+                                                 : ((heap_large_t*)header)->size;
+}
+
+static void heap_free(win32_heap_t* heap, DWORD flags, void* header, void* ptr) {
+    if (*(uint32_t*)header == HEAP_SLAB_MAGIC && heap == &g_process_heap) {
+        heap_tcache_free(((heap_slab_t*)header)->size_class, ptr);
+        return;
+    }
+
+    bool serialize = heap_serialized(heap, flags);
+    if (serialize) {
+        heap_lock(&heap->lock);
+    }
+    if (*(uint32_t*)header == HEAP_SLAB_MAGIC) {
+        heap_free_small(heap, (heap_slab_t*)header, ptr);
+    } else {
+        heap_free_large(heap, (heap_large_t*)header);
+    }
+    if (serialize) {
+        heap_unlock(&heap->lock);
+    }
+}
+
+HANDLE GetProcessHeap(void) {
+    pthread_once(&g_process_heap_once, process_heap_init);
+    return (HANDLE)&g_process_heap;
+}
+
+HANDLE HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize) {
+    if (dwMaximumSize && dwInitialSize > dwMaximumSize) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    win32_heap_t* heap = (win32_heap_t*)malloc(sizeof(win32_heap_t));
+    if (!heap) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    heap_init(heap, flOptions, dwInitialSize, dwMaximumSize);
+    SetLastError(ERROR_SUCCESS);
+    return (HANDLE)heap;
+}
+
+BOOL HeapDestroy(HANDLE hHeap) {
+    win32_heap_t* heap = heap_from_handle(hHeap);
+    if (!heap) {
+        return FALSE;
+    }
+    if (heap == &g_process_heap) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Every slab lives in an arena, so whole arenas go at once */
+    while (heap->arenas) {
+        heap_arena_t* arena = heap->arenas;
+        heap->arenas = arena->next;
+        munmap(arena->base, arena->size);
+        free(arena);
+    }
+    while (heap->large) {
+        heap_large_t* large = heap->large;
+        heap->large = large->next;
+        heap_unmap_large(heap, large);
+    }
+    while (heap->large_cached) {
+        heap_unmap_large(heap, heap->large_cache[--heap->large_cached]);
+    }
+
+    __atomic_fetch_sub(&g_heap_stats.committed, heap->committed, __ATOMIC_RELAXED);
+    heap->magic = 0;
+    free(heap);
+
+    SetLastError(ERROR_SUCCESS);
+    return TRUE;
+}
+
+LPVOID HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes) {
+    win32_heap_t* heap = heap_from_handle(hHeap);
+    if (!heap) {
+        return NULL;
+    }
+
+    void* ptr = heap_alloc(heap, dwFlags, dwBytes);
+    if (!ptr) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    return ptr;
+}
+
+LPVOID HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes) {
+    win32_heap_t* heap = heap_from_handle(hHeap);
+    if (!heap) {
+        return NULL;
+    }
+
+    void* header = heap_block_header(heap, lpMem);
+    if (!header) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    /* Same size class, or shrinking a large block: nothing moves */
+    size_t old_size = heap_block_size(header);
+    bool fits = *(uint32_t*)header == HEAP_SLAB_MAGIC
+        ? dwBytes <= HEAP_SMALL_MAX && heap_class_of(dwBytes) == ((heap_slab_t*)header)->size_class
+        : dwBytes > HEAP_SMALL_MAX && dwBytes + HEAP_HEADER_SIZE <= ((heap_large_t*)header)->mapped;
+    if (fits) {
+        if ((dwFlags & HEAP_ZERO_MEMORY) && dwBytes > old_size) {
+            memset((char*)lpMem + old_size, 0, dwBytes - old_size);
+        }
+        if (*(uint32_t*)header == HEAP_LARGE_MAGIC) {
+            ((heap_large_t*)header)->size = dwBytes;
+        }
+        return lpMem;
+    }
+    if (dwFlags & HEAP_REALLOC_IN_PLACE_ONLY) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    void* ptr = heap_alloc(heap, dwFlags & ~HEAP_ZERO_MEMORY, dwBytes);
+    if (!ptr) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    memcpy(ptr, lpMem, old_size < dwBytes ? old_size : dwBytes);
+    if ((dwFlags & HEAP_ZERO_MEMORY) && dwBytes > old_size) {
+        memset((char*)ptr + old_size, 0, dwBytes - old_size);
+    }
+    heap_free(heap, dwFlags, header, lpMem);
+    return ptr;
+}
+
+BOOL HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem) {
+    win32_heap_t* heap = heap_from_handle(hHeap);
+    if (!heap) {
+        return FALSE;
+    }
+
+    void* header = heap_block_header(heap, lpMem);
+    if (!header) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    heap_free(heap, dwFlags, header, lpMem);
+    return TRUE;
+}
+
+SIZE_T HeapSize(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem) {
+    (void)dwFlags;
+
+    win32_heap_t* heap = heap_from_handle(hHeap);
+    void* header = heap ? heap_block_header(heap, lpMem) : NULL;
+    if (!header) {
+        return (SIZE_T)-1;
+    }
+    return heap_block_size(header);
+}
+
+BOOL HeapSetInformation(HANDLE hHeap, int HeapInformationClass, LPVOID HeapInformation,
+                        SIZE_T HeapInformationLength) {
+    if (!heap_from_handle(hHeap)) {
+        return FALSE;
+    }
+
+    if (HeapInformationClass != HeapCompatibilityInformation || !HeapInformation ||
+        HeapInformationLength < sizeof(DWORD) || *(DWORD*)HeapInformation != HEAP_LFH) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    SetLastError(ERROR_SUCCESS);
+    return TRUE;
+}
+
+/* ============================================================================
+ * Virtual memory
+ * ============================================================================ */
+
+static int virtual_prot(DWORD protect) {
+    switch (protect) {
+        case PAGE_NOACCESS:          return PROT_NONE;
+        case PAGE_READONLY:          return PROT_READ;
+        case PAGE_READWRITE:         return PROT_READ | PROT_WRITE;
+        case PAGE_EXECUTE:           return PROT_EXEC;
+        case PAGE_EXECUTE_READ:      return PROT_READ | PROT_EXEC;
+        case PAGE_EXECUTE_READWRITE: return PROT_READ | PROT_WRITE | PROT_EXEC;
+        default:                     return -1;
+    }
+}
+
+/* Reservation containing [addr, addr + size); caller holds the lock */
+static virtual_region_t* virtual_find(uintptr_t addr, size_t size) {
+    for (uint32_t i = 0; i < g_virtual.count; i++) {
+        virtual_region_t* region = &g_virtual.regions[i];
+        if (addr >= region->base && addr - region->base < region->size &&
+            size <= region->size - (addr - region->base)) {
+            return region;
+        }
+    }
+    return NULL;
+}
+
+/* Reserve at a 64 KiB boundary (or exactly at addr) with no access; caller holds the lock */
+static void* virtual_reserve(uintptr_t addr, size_t size) {
+    if (g_virtual.count >= WIN32_VIRTUAL_MAX) {
+        return NULL;
+    }
+
+    void* base;
+    if (addr) {
+        base = mmap((void*)addr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            return NULL;
+        }
+        if ((uintptr_t)base != addr) {
+            munmap(base, size);
+            return NULL;
+        }
+    } else {
+        base = heap_map_aligned(size, PROT_NONE, MAP_NORESERVE);
+        if (!base) {
+            return NULL;
+        }
+    }
+
+    virtual_region_t* region = &g_virtual.regions[g_virtual.count++];
+    region->base = (uintptr_t)base;
+    region->size = size;
+    region->protect = PAGE_NOACCESS;
+    __atomic_fetch_add(&g_heap_stats.reserved, size, __ATOMIC_RELAXED);
+    return base;
+}
+
+LPVOID VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType,
+                    DWORD flProtect) {
+    int prot = virtual_prot(flProtect);
+    if (dwSize == 0 || prot < 0 || !(flAllocationType & (MEM_RESERVE | MEM_COMMIT))) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    __atomic_fetch_add(&g_heap_stats.virtual_calls, 1, __ATOMIC_RELAXED);
+
+    uintptr_t addr = (uintptr_t)lpAddress;
+    void* result = NULL;
+
+    heap_lock(&g_virtual.lock);
+
+    if ((flAllocationType & MEM_RESERVE) || !addr) {
+        /* New reservation: base on the allocation granularity, size in whole pages */
+        uintptr_t base = addr & ~(uintptr_t)(WIN32_ALLOCATION_GRANULARITY - 1);
+        size_t size = heap_round_up(addr + dwSize - base, HEAP_PAGE_SIZE);
+        result = virtual_reserve(base, size);
+        if (!result) {
+            heap_unlock(&g_virtual.lock);
+            SetLastError(addr ? ERROR_INVALID_ADDRESS : ERROR_NOT_ENOUGH_MEMORY);
+            return NULL;
+        }
+        if ((flAllocationType & MEM_COMMIT) && prot != PROT_NONE) {
+            mprotect(result, size, prot);
+            g_virtual.regions[g_virtual.count - 1].protect = flProtect;
+        }
+    } else {
+        /* Commit pages inside an existing reservation */
+        uintptr_t start = addr & ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+        size_t size = heap_round_up(addr + dwSize - start, HEAP_PAGE_SIZE);
+        virtual_region_t* region = virtual_find(start, size);
+        if (!region || mprotect((void*)start, size, prot) != 0) {
+            heap_unlock(&g_virtual.lock);
+            SetLastError(ERROR_INVALID_ADDRESS);
+            return NULL;
+        }
+        region->protect = flProtect;
+        result = (void*)start;
+    }
+
+    heap_unlock(&g_virtual.lock);
+
+    SetLastError(ERROR_SUCCESS);
+    return result;
+}
+
+BOOL VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType) {
+    uintptr_t addr = (uintptr_t)lpAddress;
+    if (!addr || (dwFreeType != MEM_RELEASE && dwFreeType != MEM_DECOMMIT)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    __atomic_fetch_add(&g_heap_stats.virtual_calls, 1, __ATOMIC_RELAXED);
+
+    heap_lock(&g_virtual.lock);
+
+    virtual_region_t* region = virtual_find(addr, 1);
+    if (!region) {
+        heap_unlock(&g_virtual.lock);
+        SetLastError(ERROR_INVALID_ADDRESS);
+        return FALSE;
+    }
+
+    if (dwFreeType == MEM_RELEASE) {
+        /* Only a whole reservation, named by its base, can be released */
+        if (dwSize != 0 || addr != region->base) {
+            heap_unlock(&g_virtual.lock);
+            SetLastError(ERROR_INVALID_PARAMETER);
+            return FALSE;
+        }
+        munmap((void*)region->base, region->size);
+        __atomic_fetch_sub(&g_heap_stats.reserved, region->size, __ATOMIC_RELAXED);
+        *region = g_virtual.regions[--g_virtual.count];
+    } else {
+        /* Decommit: drop the pages and their contents but keep the range reserved */
+        uintptr_t start = addr & ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+        size_t size = dwSize ? heap_round_up(addr + dwSize - start, HEAP_PAGE_SIZE)
+                             : region->base + region->size - start;
+        if (!virtual_find(start, size)) {
+            heap_unlock(&g_virtual.lock);
+            SetLastError(ERROR_INVALID_ADDRESS);
+            return FALSE;
+        }
+        madvise((void*)start, size, MADV_DONTNEED);
+        mprotect((void*)start, size, PROT_NONE);
+    }
+
+    heap_unlock(&g_virtual.lock);
+
+    SetLastError(ERROR_SUCCESS);
+    return TRUE;
+}
+
+BOOL VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, DWORD* lpflOldProtect) {
+    int prot = virtual_prot(flNewProtect);
+    if (!lpAddress || dwSize == 0 || prot < 0 || !lpflOldProtect) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    __atomic_fetch_add(&g_heap_stats.virtual_calls, 1, __ATOMIC_RELAXED);
+
+    uintptr_t start = (uintptr_t)lpAddress & ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+    size_t size = heap_round_up((uintptr_t)lpAddress + dwSize - start, HEAP_PAGE_SIZE);
+
+    heap_lock(&g_virtual.lock);
+    virtual_region_t* region = virtual_find(start, size);
+    if (!region || mprotect((void*)start, size, prot) != 0) {
+        heap_unlock(&g_virtual.lock);
+        SetLastError(ERROR_INVALID_ADDRESS);
+        return FALSE;
+    }
+    *lpflOldProtect = region->protect;
+    region->protect = flNewProtect;
+    heap_unlock(&g_virtual.lock);
+
+    SetLastError(ERROR_SUCCESS);
+    return TRUE;
+}
+
+void win32_heap_get_stats(win32_heap_stats_t* out_stats) {
+    if (!out_stats) {
+        return;
+    }
+
+    out_stats->allocations = __atomic_load_n(&g_heap_stats.allocations, __ATOMIC_RELAXED) + g_tcache.allocs;
+    out_stats->heaps = __atomic_load_n(&g_heap_stats.heaps, __ATOMIC_RELAXED);
+    out_stats->committed = __atomic_load_n(&g_heap_stats.committed, __ATOMIC_RELAXED);
+    out_stats->reserved = __atomic_load_n(&g_heap_stats.reserved, __ATOMIC_RELAXED);
+    out_stats->virtual_calls = __atomic_load_n(&g_heap_stats.virtual_calls, __ATOMIC_RELAXED);
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+#define HEAP_BENCH_SLOTS 1024
+
+typedef struct heap_bench_ops {
+    void* (*alloc)(void* ctx, size_t size);
+    void (*release)(void* ctx, void* ptr);
+    void* ctx;
+} heap_bench_ops_t;
+
+typedef struct heap_bench_worker {
+    const heap_bench_ops_t* ops;
+    uint32_t iterations;
+    uint32_t seed;
+    pthread_t thread;
+} heap_bench_worker_t;
+
+static void* bench_heap_alloc(void* ctx, size_t size) {
+    return HeapAlloc((HANDLE)ctx, 0, size);
+}
+
+static void bench_heap_free(void* ctx, void* ptr) {
+    HeapFree((HANDLE)ctx, 0, ptr);
+}
+
+static void* bench_libc_alloc(void* ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void bench_libc_free(void* ctx, void* ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static uint64_t heap_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Mostly small objects, some medium, a few past the slab limit */
+static size_t heap_bench_size(uint32_t r) {
+    uint32_t pick = r % 100;
+    if (pick < 80) {
+        return 16 + (r >> 8) % 241;
+    }
+    if (pick < 97) {
+        return 256 + (r >> 8) % 3841;
+    }
+    return 4096 + (r >> 8) % 28673;
+}
+
+/* Replace random slots of a working set; with keep, leave it allocated */
+static void heap_bench_churn(const heap_bench_ops_t* ops, uint32_t iterations, uint32_t seed,
+                             void** slots, bool keep) {
+    memset(slots, 0, sizeof(void*) * HEAP_BENCH_SLOTS);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 4) % HEAP_BENCH_SLOTS;
+        if (slots[slot]) {
+            ops->release(ops->ctx, slots[slot]);
+        }
+        seed = seed * 1103515245 + 12345;
+        size_t size = heap_bench_size(seed >> 1);
+        slots[slot] = ops->alloc(ops->ctx, size);
+        if (slots[slot]) {
+            ((char*)slots[slot])[0] = (char)i;
+            ((char*)slots[slot])[size - 1] = (char)i;
+        }
+    }
+
+    for (uint32_t i = 0; !keep && i < HEAP_BENCH_SLOTS; i++) {
+        if (slots[i]) {
+            ops->release(ops->ctx, slots[i]);
+        }
+    }
+}
+
+static void* heap_bench_thread(void* arg) {
+    heap_bench_worker_t* worker = (heap_bench_worker_t*)arg;
+    void** slots = (void**)malloc(sizeof(void*) * HEAP_BENCH_SLOTS);
+    if (slots) {
+        heap_bench_churn(worker->ops, worker->iterations, worker->seed, slots, false);
+        free(slots);
+    }
+    return NULL;
+}
+
+/* Wall-clock ns per operation pair with threads running the churn at once */
+static uint64_t heap_bench_parallel(const heap_bench_ops_t* ops, uint32_t threads, uint32_t iterations) {
+    heap_bench_worker_t* workers = (heap_bench_worker_t*)calloc(threads, sizeof(heap_bench_worker_t));
+    if (!workers) {
+        return 0;
+    }
+
+    uint64_t start = heap_now_ns();
+    for (uint32_t i = 0; i < threads; i++) {
+        workers[i].ops = ops;
+        workers[i].iterations = iterations;
+        workers[i].seed = 777 + i;
+        pthread_create(&workers[i].thread, NULL, heap_bench_thread, &workers[i]);
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t elapsed = heap_now_ns() - start;
+
+    free(workers);
+    return elapsed / ((uint64_t)iterations * threads);
+}
+
+int win32_heap_benchmark(uint32_t threads, uint32_t iterations, win32_heap_bench_result_t* out_result) {
+    if (!out_result || threads == 0 || iterations == 0) {
+        return -1;
+    }
+
+    memset(out_result, 0, sizeof(*out_result));
+
+    void** slots = (void**)malloc(sizeof(void*) * HEAP_BENCH_SLOTS);
+    if (!slots) {
+        return -1;
+    }
+
+    heap_bench_ops_t heap_ops = { bench_heap_alloc, bench_heap_free, GetProcessHeap() };
+    heap_bench_ops_t libc_ops = { bench_libc_alloc, bench_libc_free, NULL };
+
+    /* Warm both allocators so neither pays for first-touch page faults alone */
+    heap_bench_churn(&heap_ops, iterations / 4 + 1, 1, slots, false);
+    heap_bench_churn(&libc_ops, iterations / 4 + 1, 1, slots, false);
+
+    uint64_t start = heap_now_ns();
+    heap_bench_churn(&heap_ops, iterations, 42, slots, false);
+    out_result->heap_ns = (heap_now_ns() - start) / iterations;
+
+    start = heap_now_ns();
+    heap_bench_churn(&libc_ops, iterations, 42, slots, false);
+    out_result->libc_ns = (heap_now_ns() - start) / iterations;
+
+    out_result->heap_mt_ns = heap_bench_parallel(&heap_ops, threads, iterations);
+    out_result->libc_mt_ns = heap_bench_parallel(&libc_ops, threads, iterations);
+
+    /* Private unserialized heap, then throw it away with everything in it */
+    HANDLE private_heap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    if (private_heap) {
+        heap_bench_ops_t private_ops = { bench_heap_alloc, bench_heap_free, private_heap };
+        start = heap_now_ns();
+        heap_bench_churn(&private_ops, iterations, 42, slots, true);
+        out_result->private_ns = (heap_now_ns() - start) / iterations;
+
+        start = heap_now_ns();
+        HeapDestroy(private_heap);
+        out_result->destroy_ns = heap_now_ns() - start;
+    }
+
+    free(slots);
+    return 0;
+}
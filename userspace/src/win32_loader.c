@@ -0,0 +1,1426 @@
+/*
+ * Windows Persona - Module Loader
+ * Maps PE32+ images from a shared, indexed image cache and binds their
+ * imports in one pass
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "win32_persona.h"
+
+/* PE32+ on-disk format (the subset the loader reads) */
+#define PE_DOS_MAGIC              0x5A4D       /* "MZ" */
+#define PE_NT_MAGIC               0x00004550   /* "PE\0\0" */
+#define PE_MACHINE_AMD64          0x8664
+#define PE_OPTIONAL_MAGIC_PE32_PLUS 0x20B
+#define PE_CHAR_EXECUTABLE        0x0002
+#define PE_CHAR_DLL               0x2000
+#define PE_NUM_DIRECTORIES        16
+#define PE_DIR_EXPORT             0
+#define PE_DIR_IMPORT             1
+#define PE_DIR_BASERELOC          5
+#define PE_SCN_MEM_EXECUTE        0x20000000u
+#define PE_SCN_MEM_READ           0x40000000u
+#define PE_SCN_MEM_WRITE          0x80000000u
+#define PE_REL_BASED_ABSOLUTE     0
+#define PE_REL_BASED_HIGHLOW      3
+#define PE_REL_BASED_DIR64        10
+#define PE_ORDINAL_FLAG64         (1ULL << 63)
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0   /* Plain hint; a different address is caught below */
+#endif
+
+typedef struct pe_coff_header {
+    uint16_t machine;
+    uint16_t num_sections;
+    uint32_t timestamp;
+    uint32_t symbol_table_offset;
+    uint32_t num_symbols;
+    uint16_t optional_header_size;
+    uint16_t characteristics;
+} __attribute__((packed)) pe_coff_header_t;
+
+typedef struct pe_data_directory {
+    uint32_t virtual_address;
+    uint32_t size;
+} __attribute__((packed)) pe_data_directory_t;
+
+typedef struct pe_optional_header64 {
+    uint16_t magic;
+    uint8_t major_linker_version;
+    uint8_t minor_linker_version;
+    uint32_t code_size;
+    uint32_t initialized_data_size;
+    uint32_t uninitialized_data_size;
+    uint32_t entry_point;
+    uint32_t code_base;
+    uint64_t image_base;
+    uint32_t section_alignment;
+    uint32_t file_alignment;
+    uint16_t major_os_version;
+    uint16_t minor_os_version;
+    uint16_t major_image_version;
+    uint16_t minor_image_version;
+    uint16_t major_subsystem_version;
+    uint16_t minor_subsystem_version;
+    uint32_t win32_version;
+    uint32_t image_size;
+    uint32_t headers_size;
+    uint32_t checksum;
+    uint16_t subsystem;
+    uint16_t dll_characteristics;
+    uint64_t stack_reserve;
+    uint64_t stack_commit;
+    uint64_t heap_reserve;
+    uint64_t heap_commit;
+    uint32_t loader_flags;
+    uint32_t num_data_directories;
+    pe_data_directory_t data_directories[PE_NUM_DIRECTORIES];
+} __attribute__((packed)) pe_optional_header64_t;
+
+typedef struct pe_section_header {
+    char name[8];
+    uint32_t virtual_size;
+    uint32_t virtual_address;
+    uint32_t raw_data_size;
+    uint32_t raw_data_offset;
+    uint32_t relocations_offset;
+    uint32_t line_numbers_offset;
+    uint16_t num_relocations;
+    uint16_t num_line_numbers;
+    uint32_t characteristics;
+} __attribute__((packed)) pe_section_header_t;
+
+typedef struct pe_import_descriptor {
+    uint32_t import_lookup_table_rva;
+    uint32_t timestamp;
+    uint32_t forwarder_chain;
+    uint32_t name_rva;
+    uint32_t import_address_table_rva;
+} __attribute__((packed)) pe_import_descriptor_t;
+
+typedef struct pe_export_directory {
+    uint32_t characteristics;
+    uint32_t timestamp;
+    uint16_t major_version;
+    uint16_t minor_version;
+    uint32_t name_rva;
+    uint32_t ordinal_base;
+    uint32_t num_functions;
+    uint32_t num_names;
+    uint32_t functions_rva;
+    uint32_t names_rva;
+    uint32_t name_ordinals_rva;
+} __attribute__((packed)) pe_export_directory_t;
+
+typedef struct pe_base_relocation {
+    uint32_t virtual_address;
+    uint32_t size;
+} __attribute__((packed)) pe_base_relocation_t;
+
+#define LOADER_PAGE_SIZE        4096
+#define LOADER_NAME_MAX         64
+#define LOADER_PATH_MAX         1024
+#define LOADER_FORWARD_DEPTH    8    /* Forwarder chains followed before giving up */
+#define LOADER_IDLE_IMAGES      64   /* Unreferenced images kept indexed */
+#define LOADER_POPULATE_MAX     (256 * 1024)  /* Smaller flat images are mapped with their pages in */
+
+/* DllMain is called with the Windows x64 convention */
+typedef BOOL (__attribute__((ms_abi)) *win32_dll_entry_t)(HMODULE, DWORD, LPVOID);
+
+/* One file on disk, parsed and indexed once however many modules map it */
+typedef struct win32_image {
+    char name[LOADER_NAME_MAX];     // Lower-case file name, the module's identity
+    char path[LOADER_PATH_MAX];
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+
+    int fd;
+    const uint8_t* file;            // Whole file, read-only
+    const pe_optional_header64_t* opt;
+    const pe_section_header_t* sections;
+    uint16_t num_sections;
+    bool is_dll;
+    bool direct;                    // Sections page-aligned in the file: map, don't copy
+    bool flat;                      // File laid out like memory: one mapping covers it all
+    size_t flat_size;
+    uint64_t iat_sections;          // Sections holding import address tables, by index
+
+    /* Export directory and its name index */
+    uint32_t export_rva;
+    uint32_t export_size;
+    uint32_t ordinal_base;
+    uint32_t num_functions;
+    uint32_t num_names;
+    uint32_t functions_rva;
+    uint32_t names_rva;
+    uint32_t ordinals_rva;
+    uint64_t* export_slots;         // hash << 32 | (name index + 1); 0 = empty
+    uint32_t export_mask;
+
+    uint32_t modules;               // Modules currently mapped from this image
+    struct win32_image* next;
+} win32_image_t;
+
+/* An image mapped into this process */
+typedef struct win32_module {
+    win32_image_t* image;
+    uint8_t* base;                  // Also the HMODULE
+    uint32_t refcount;
+    bool relocated;                 // Not at the preferred base: every section gets written
+    bool attached;                  // DllMain(DLL_PROCESS_ATTACH) succeeded
+    struct win32_module** deps;     // One reference held on each
+    uint32_t num_deps;
+    uint32_t max_deps;
+    struct win32_module* next;
+} win32_module_t;
+
+/* The loader lock is recursive: DllMain may call LoadLibrary, as on Windows */
+static pthread_mutex_t g_loader_lock;
+static pthread_once_t g_loader_once = PTHREAD_ONCE_INIT;
+static win32_image_t* g_images;
+static win32_loader_stats_t g_loader_stats;
+
+static void loader_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_loader_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void loader_lock(void) {
+    pthread_once(&g_loader_once, loader_init);
+    pthread_mutex_lock(&g_loader_lock);
+}
+
+static void loader_unlock(void) {
+    pthread_mutex_unlock(&g_loader_lock);
+}
+
+static inline size_t loader_page_round(size_t size) {
+    return (size + LOADER_PAGE_SIZE - 1) & ~(size_t)(LOADER_PAGE_SIZE - 1);
+}
+
+/* FNV-1a */
+static inline uint32_t loader_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Lower-case file name of a module path, with ".dll" added when it has no extension */
+static void loader_module_name(const char* path, char* out) {
+    const char* start = path;
+    for (const char* p = path; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            start = p + 1;
+        }
+    }
+
+    size_t len = 0;
+    bool dot = false;
+    for (; start[len] && len < LOADER_NAME_MAX - 5; len++) {
+        char c = start[len];
+        out[len] = (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+        dot |= c == '.';
+    }
+    out[len] = '\0';
+    if (!dot) {
+        memcpy(out + len, ".dll", 5);
+    }
+}
+
+/* ============================================================================
+ * Images
+ * ============================================================================ */
+
+/* File bytes at rva, if len bytes of it lie in the headers or one section */
+static const void* image_rva(const win32_image_t* image, uint32_t rva, size_t len) {
+    if (rva + (uint64_t)len <= image->opt->headers_size) {
+        return image->file + rva;
+    }
+
+    for (uint16_t i = 0; i < image->num_sections; i++) {
+        const pe_section_header_t* section = &image->sections[i];
+        if (rva >= section->virtual_address &&
+            rva - section->virtual_address + (uint64_t)len <= section->raw_data_size) {
+            return image->file + section->raw_data_offset + (rva - section->virtual_address);
+        }
+    }
+    return NULL;
+}
+
+static const char* image_string(const win32_image_t* image, uint32_t rva) {
+    const char* str = (const char*)image_rva(image, rva, 1);
+    if (!str) {
+        return NULL;
+    }
+    size_t room = (size_t)image->size - (size_t)(str - (const char*)image->file);
+    return memchr(str, '\0', room) ? str : NULL;
+}
+
+/* Validate headers; returns a Win32 error code */
+static DWORD image_parse(win32_image_t* image) {
+    const uint8_t* file = image->file;
+    size_t size = (size_t)image->size;
+
+    if (size < 0x40 || *(const uint16_t*)file != PE_DOS_MAGIC) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    uint32_t nt = *(const uint32_t*)(file + 0x3C);
+    if ((uint64_t)nt + 4 + sizeof(pe_coff_header_t) + sizeof(pe_optional_header64_t) > size ||
+        *(const uint32_t*)(file + nt) != PE_NT_MAGIC) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    const pe_coff_header_t* coff = (const pe_coff_header_t*)(file + nt + 4);
+    const pe_optional_header64_t* opt = (const pe_optional_header64_t*)(coff + 1);
+    if (coff->machine != PE_MACHINE_AMD64 || opt->magic != PE_OPTIONAL_MAGIC_PE32_PLUS ||
+        coff->optional_header_size < sizeof(pe_optional_header64_t)) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    const pe_section_header_t* sections =
+        (const pe_section_header_t*)((const uint8_t*)opt + coff->optional_header_size);
+    if ((uint64_t)((const uint8_t*)(sections + coff->num_sections) - file) > size ||
+        opt->headers_size > opt->image_size || opt->headers_size > size) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    image->direct = opt->file_alignment % LOADER_PAGE_SIZE == 0 &&
+                    opt->section_alignment % LOADER_PAGE_SIZE == 0;
+    for (uint16_t i = 0; i < coff->num_sections; i++) {
+        const pe_section_header_t* section = &sections[i];
+        uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+        if ((uint64_t)section->raw_data_offset + section->raw_data_size > size ||
+            (uint64_t)section->virtual_address + vsize > opt->image_size ||
+            section->virtual_address < opt->headers_size ||
+            section->virtual_address % LOADER_PAGE_SIZE) {
+            return ERROR_BAD_EXE_FORMAT;
+        }
+        if (section->raw_data_offset % LOADER_PAGE_SIZE) {
+            image->direct = false;
+        }
+    }
+
+    /* Linkers using page-sized file alignment usually put every section at its RVA */
+    image->flat = image->direct;
+    for (uint16_t i = 0; i < coff->num_sections && image->flat; i++) {
+        const pe_section_header_t* section = &sections[i];
+        uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+        size_t end = loader_page_round((size_t)section->virtual_address + vsize);
+        image->flat = section->raw_data_offset == section->virtual_address &&
+                      loader_page_round(section->raw_data_size) >= loader_page_round(vsize);
+        if (end > image->flat_size) {
+            image->flat_size = end;
+        }
+    }
+
+    image->opt = opt;
+    image->sections = sections;
+    image->num_sections = coff->num_sections;
+    image->is_dll = (coff->characteristics & PE_CHAR_DLL) != 0;
+    return ERROR_SUCCESS;
+}
+
+/* Hash every exported name once, so lookups never search the name table */
+static DWORD image_index_exports(win32_image_t* image) {
+    const pe_optional_header64_t* opt = image->opt;
+    if (opt->num_data_directories <= PE_DIR_EXPORT || !opt->data_directories[PE_DIR_EXPORT].size) {
+        return ERROR_SUCCESS;
+    }
+
+    image->export_rva = opt->data_directories[PE_DIR_EXPORT].virtual_address;
+    image->export_size = opt->data_directories[PE_DIR_EXPORT].size;
+    const pe_export_directory_t* dir =
+        (const pe_export_directory_t*)image_rva(image, image->export_rva, sizeof(pe_export_directory_t));
+    if (!dir) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    const uint32_t* functions = (const uint32_t*)image_rva(image, dir->functions_rva,
+                                                           (size_t)dir->num_functions * 4);
+    const uint32_t* names = (const uint32_t*)image_rva(image, dir->names_rva, (size_t)dir->num_names * 4);
+    const uint16_t* ordinals = (const uint16_t*)image_rva(image, dir->name_ordinals_rva,
+                                                          (size_t)dir->num_names * 2);
+    if ((dir->num_functions && !functions) || (dir->num_names && (!names || !ordinals))) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    image->ordinal_base = dir->ordinal_base;
+    image->num_functions = dir->num_functions;
+    image->num_names = dir->num_names;
+    image->functions_rva = dir->functions_rva;
+    image->names_rva = dir->names_rva;
+    image->ordinals_rva = dir->name_ordinals_rva;
+    if (!dir->num_names) {
+        return ERROR_SUCCESS;
+    }
+
+    /* Open addressing at most half full */
+    uint32_t slots = 4;
+    while (slots < dir->num_names * 2) {
+        slots <<= 1;
+    }
+    image->export_slots = (uint64_t*)calloc(slots, sizeof(uint64_t));
+    if (!image->export_slots) {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    image->export_mask = slots - 1;
+
+    for (uint32_t i = 0; i < dir->num_names; i++) {
+        const char* name = image_string(image, names[i]);
+        if (!name || ordinals[i] >= dir->num_functions) {
+            return ERROR_BAD_EXE_FORMAT;
+        }
+        uint32_t hash = loader_hash(name);
+        uint32_t slot = hash & image->export_mask;
+        while (image->export_slots[slot]) {
+            slot = (slot + 1) & image->export_mask;
+        }
+        image->export_slots[slot] = ((uint64_t)hash << 32) | (i + 1);
+    }
+    return ERROR_SUCCESS;
+}
+
+/* Note which sections binding writes to, so only those are mapped writable */
+static void image_scan_imports(win32_image_t* image) {
+    const pe_optional_header64_t* opt = image->opt;
+    if (opt->num_data_directories <= PE_DIR_IMPORT || !opt->data_directories[PE_DIR_IMPORT].size) {
+        return;
+    }
+
+    for (uint32_t rva = opt->data_directories[PE_DIR_IMPORT].virtual_address;; rva += sizeof(pe_import_descriptor_t)) {
+        const pe_import_descriptor_t* desc =
+            (const pe_import_descriptor_t*)image_rva(image, rva, sizeof(pe_import_descriptor_t));
+        if (!desc || !desc->name_rva) {
+            break;
+        }
+        for (uint16_t i = 0; i < image->num_sections; i++) {
+            const pe_section_header_t* section = &image->sections[i];
+            uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+            if (desc->import_address_table_rva - section->virtual_address < vsize) {
+                /* Past 64 sections, mark them all */
+                image->iat_sections |= i < 64 ? 1ULL << i : ~0ULL;
+            }
+        }
+    }
+}
+
+static void image_free(win32_image_t* image) {
+    free(image->export_slots);
+    if (image->file) {
+        munmap((void*)image->file, (size_t)image->size);
+    }
+    if (image->fd >= 0) {
+        close(image->fd);
+    }
+    free(image);
+}
+
+/* Forget idle images beyond the cache limit, oldest first */
+static void image_trim(void) {
+    uint32_t idle = 0;
+    for (win32_image_t* image = g_images; image; image = image->next) {
+        idle += image->modules == 0;
+    }
+
+    /* The list is most recently used first, so the last idle image is the oldest */
+    while (idle > LOADER_IDLE_IMAGES) {
+        win32_image_t** victim = NULL;
+        for (win32_image_t** link = &g_images; *link; link = &(*link)->next) {
+            if ((*link)->modules == 0) {
+                victim = link;
+            }
+        }
+        win32_image_t* image = *victim;
+        *victim = image->next;
+        image_free(image);
+        idle--;
+    }
+}
+
+/* Indexed image for a file, parsed only the first time any module maps it */
+static win32_image_t* image_get(const char* path, const struct stat* st, DWORD* out_error) {
+    for (win32_image_t** link = &g_images; *link; link = &(*link)->next) {
+        win32_image_t* image = *link;
+        if (image->dev == st->st_dev && image->ino == st->st_ino &&
+            image->size == st->st_size && image->mtime == st->st_mtime) {
+            /* Most recently used first */
+            *link = image->next;
+            image->next = g_images;
+            g_images = image;
+            g_loader_stats.images_shared++;
+            return image;
+        }
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *out_error = ERROR_FILE_NOT_FOUND;
+        return NULL;
+    }
+
+    win32_image_t* image = (win32_image_t*)calloc(1, sizeof(win32_image_t));
+    if (!image) {
+        close(fd);
+        *out_error = ERROR_NOT_ENOUGH_MEMORY;
+        return NULL;
+    }
+
+    image->fd = fd;
+    image->dev = st->st_dev;
+    image->ino = st->st_ino;
+    image->size = st->st_size;
+    image->mtime = st->st_mtime;
+    snprintf(image->path, sizeof(image->path), "%s", path);
+    loader_module_name(path, image->name);
+
+    void* file = st->st_size ? mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (file == MAP_FAILED) {
+        image_free(image);
+        *out_error = ERROR_BAD_EXE_FORMAT;
+        return NULL;
+    }
+    image->file = (const uint8_t*)file;
+
+    DWORD error = image_parse(image);
+    if (error == ERROR_SUCCESS) {
+        error = image_index_exports(image);
+    }
+    if (error == ERROR_SUCCESS) {
+        image_scan_imports(image);
+    }
+    if (error != ERROR_SUCCESS) {
+        image_free(image);
+        *out_error = error;
+        return NULL;
+    }
+
+    image->next = g_images;
+    g_images = image;
+    g_loader_stats.images_opened++;
+    image_trim();
+    return image;
+}
+
+/* Directory of the image's file with a trailing slash, "" if it has none */
+static void image_dir(const win32_image_t* image, char* out) {
+    const char* slash = strrchr(image->path, '/');
+    size_t len = slash ? (size_t)(slash - image->path) + 1 : 0;
+    memcpy(out, image->path, len);
+    out[len] = '\0';
+}
+
+/* ============================================================================
+ * Modules
+ * ============================================================================ */
+
+/* The process's modules, newest first, hang off the Win32 context */
+static win32_module_t* module_first(void) {
+    return (win32_module_t*)win32_get_context()->module_list;
+}
+
+static win32_module_t* module_by_name(const char* name) {
+    for (win32_module_t* module = module_first(); module; module = module->next) {
+        if (strcmp(module->image->name, name) == 0) {
+            return module;
+        }
+    }
+    return NULL;
+}
+
+static win32_module_t* module_by_handle(HMODULE handle) {
+    for (win32_module_t* module = module_first(); module; module = module->next) {
+        if (module->base == (uint8_t*)handle) {
+            return module;
+        }
+    }
+    return NULL;
+}
+
+static int section_prot(uint32_t characteristics) {
+    return ((characteristics & PE_SCN_MEM_READ) ? PROT_READ : 0) |
+           ((characteristics & PE_SCN_MEM_WRITE) ? PROT_WRITE : 0) |
+           ((characteristics & PE_SCN_MEM_EXECUTE) ? PROT_EXEC : 0);
+}
+
+/* Relocation and import binding write to this section before it gets its final protection */
+static bool section_written(const win32_module_t* module, uint16_t index) {
+    const win32_image_t* image = module->image;
+    return !image->direct || module->relocated ||
+           (image->iat_sections & (index < 64 ? 1ULL << index : ~0ULL));
+}
+
+/*
+ * Map the image. Page-aligned sections come straight from the file, so
+ * pages nobody writes stay shared with every other mapping of it; only
+ * sections the loader writes are mapped writable to begin with.
+ */
+static bool module_map(win32_module_t* module) {
+    const win32_image_t* image = module->image;
+    const pe_optional_header64_t* opt = image->opt;
+    size_t size = loader_page_round(opt->image_size);
+    void* preferred = (void*)(uintptr_t)opt->image_base;
+
+    uint8_t* base = (uint8_t*)mmap(preferred, size, PROT_NONE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (base != MAP_FAILED && base != preferred) {
+        munmap(base, size);
+        base = (uint8_t*)MAP_FAILED;
+    }
+    if (base == MAP_FAILED) {
+        base = (uint8_t*)mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            return false;
+        }
+    }
+    module->base = base;
+    module->relocated = base != preferred && opt->num_data_directories > PE_DIR_BASERELOC &&
+                        opt->data_directories[PE_DIR_BASERELOC].size;
+
+    if (image->flat) {
+        /* One view of the file, then only sections that are not plain read-only change */
+        int populate = image->flat_size <= LOADER_POPULATE_MAX ? MAP_POPULATE : 0;
+        if (mmap(base, image->flat_size, PROT_READ, MAP_PRIVATE | MAP_FIXED | populate, image->fd, 0) == MAP_FAILED) {
+            munmap(base, size);
+            return false;
+        }
+        for (uint16_t i = 0; i < image->num_sections; i++) {
+            const pe_section_header_t* section = &image->sections[i];
+            uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+            int prot = section_prot(section->characteristics) |
+                       (section_written(module, i) ? PROT_READ | PROT_WRITE : 0);
+            if (prot != PROT_READ) {
+                mprotect(base + section->virtual_address, loader_page_round(vsize), prot);
+            }
+        }
+        return true;
+    }
+
+    size_t headers = loader_page_round(opt->headers_size);
+    if (image->direct) {
+        if (mmap(base, headers, PROT_READ, MAP_PRIVATE | MAP_FIXED, image->fd, 0) == MAP_FAILED) {
+            munmap(base, size);
+            return false;
+        }
+    } else {
+        mprotect(base, headers, PROT_READ | PROT_WRITE);
+        memcpy(base, image->file, opt->headers_size);
+    }
+
+    for (uint16_t i = 0; i < image->num_sections; i++) {
+        const pe_section_header_t* section = &image->sections[i];
+        uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+        size_t span = loader_page_round(vsize);
+        size_t raw = section->raw_data_size < vsize ? section->raw_data_size : vsize;
+        uint8_t* va = base + section->virtual_address;
+        int prot = section_prot(section->characteristics) |
+                   (section_written(module, i) ? PROT_READ | PROT_WRITE : 0);
+
+        if (image->direct && raw) {
+            /* Raw size is a multiple of the page-sized file alignment */
+            size_t mapped = loader_page_round(raw);
+            if (mmap(va, mapped, prot, MAP_PRIVATE | MAP_FIXED, image->fd, section->raw_data_offset) == MAP_FAILED) {
+                munmap(base, size);
+                return false;
+            }
+            if (span > mapped) {
+                mprotect(va + mapped, span - mapped, prot);
+            }
+        } else {
+            mprotect(va, span, prot);
+            memcpy(va, image->file + section->raw_data_offset, raw);
+        }
+    }
+    return true;
+}
+
+static void module_unmap(win32_module_t* module) {
+    munmap(module->base, loader_page_round(module->image->opt->image_size));
+}
+
+/* Drop the write access relocation and binding needed */
+static void module_protect(win32_module_t* module) {
+    const win32_image_t* image = module->image;
+    if (!image->direct) {
+        mprotect(module->base, loader_page_round(image->opt->headers_size), PROT_READ);
+    }
+
+    for (uint16_t i = 0; i < image->num_sections; i++) {
+        const pe_section_header_t* section = &image->sections[i];
+        int prot = section_prot(section->characteristics);
+        if (section_written(module, i) && prot != (PROT_READ | PROT_WRITE)) {
+            uint32_t vsize = section->virtual_size ? section->virtual_size : section->raw_data_size;
+            mprotect(module->base + section->virtual_address, loader_page_round(vsize), prot);
+        }
+    }
+}
+
+/* Apply base relocations for a module not at its preferred base */
+static DWORD module_relocate(win32_module_t* module) {
+    const win32_image_t* image = module->image;
+    const pe_optional_header64_t* opt = image->opt;
+    uint64_t delta = (uint64_t)(uintptr_t)module->base - opt->image_base;
+    if (!module->relocated) {
+        /* Away from its preferred base with nothing to fix up its absolute addresses */
+        return delta ? ERROR_BAD_EXE_FORMAT : ERROR_SUCCESS;
+    }
+
+    uint32_t rva = opt->data_directories[PE_DIR_BASERELOC].virtual_address;
+    uint32_t size = opt->data_directories[PE_DIR_BASERELOC].size;
+    if ((uint64_t)rva + size > opt->image_size) {
+        return ERROR_BAD_EXE_FORMAT;
+    }
+
+    uint64_t count = 0;
+    for (uint32_t done = 0; done + sizeof(pe_base_relocation_t) <= size;) {
+        const pe_base_relocation_t* block = (const pe_base_relocation_t*)(module->base + rva + done);
+        if (block->size < sizeof(pe_base_relocation_t) || block->size > size - done) {
+            break;
+        }
+
+        const uint16_t* entries = (const uint16_t*)(block + 1);
+        uint32_t num_entries = (block->size - sizeof(pe_base_relocation_t)) / sizeof(uint16_t);
+        for (uint32_t i = 0; i < num_entries; i++) {
+            uint32_t target = block->virtual_address + (entries[i] & 0x0FFF);
+            uint32_t type = entries[i] >> 12;
+            if (target < opt->headers_size) {
+                continue;
+            }
+            if (type == PE_REL_BASED_DIR64 && (uint64_t)target + 8 <= opt->image_size) {
+                *(uint64_t*)(module->base + target) += delta;
+                count++;
+            } else if (type == PE_REL_BASED_HIGHLOW && (uint64_t)target + 4 <= opt->image_size) {
+                *(uint32_t*)(module->base + target) += (uint32_t)delta;
+                count++;
+            }
+        }
+        done += block->size;
+    }
+
+    g_loader_stats.relocations += count;
+    return ERROR_SUCCESS;
+}
+
+static bool module_add_dep(win32_module_t* module, win32_module_t* dep) {
+    if (module->num_deps == module->max_deps) {
+        uint32_t max = module->max_deps ? module->max_deps * 2 : 8;
+        win32_module_t** deps = (win32_module_t**)realloc(module->deps, max * sizeof(win32_module_t*));
+        if (!deps) {
+            return false;
+        }
+        module->deps = deps;
+        module->max_deps = max;
+    }
+    module->deps[module->num_deps++] = dep;
+    return true;
+}
+
+static win32_module_t* module_load(const char* path, const char* search_dir, DWORD* out_error);
+static void module_release(win32_module_t* module);
+
+/* Index into the export name table, or -1 */
+static int64_t module_find_name(const win32_module_t* module, const char* name) {
+    const win32_image_t* image = module->image;
+    if (!image->export_slots) {
+        return -1;
+    }
+
+    const uint32_t* names = (const uint32_t*)(module->base + image->names_rva);
+    uint32_t hash = loader_hash(name);
+    for (uint32_t slot = hash & image->export_mask;; slot = (slot + 1) & image->export_mask) {
+        uint64_t entry = image->export_slots[slot];
+        if (!entry) {
+            return -1;
+        }
+        uint32_t index = (uint32_t)entry - 1;
+        if ((uint32_t)(entry >> 32) == hash && strcmp((const char*)module->base + names[index], name) == 0) {
+            return index;
+        }
+    }
+}
+
+/*
+ * Address of an export, by name or by ordinal. A forwarded export
+ * ("OTHER.Name" or "OTHER.#12") loads OTHER.dll and holds it for module.
+ */
+static void* module_export(win32_module_t* module, const char* name, uint32_t ordinal, uint32_t depth) {
+    const win32_image_t* image = module->image;
+    uint32_t index;
+
+    if (name) {
+        int64_t found = module_find_name(module, name);
+        if (found < 0) {
+            return NULL;
+        }
+        index = ((const uint16_t*)(module->base + image->ordinals_rva))[found];
+    } else {
+        index = ordinal - image->ordinal_base;
+        if (ordinal < image->ordinal_base || index >= image->num_functions) {
+            return NULL;
+        }
+    }
+
+    uint32_t rva = ((const uint32_t*)(module->base + image->functions_rva))[index];
+    if (rva == 0) {
+        return NULL;
+    }
+    if (rva < image->export_rva || rva >= image->export_rva + image->export_size) {
+        return module->base + rva;
+    }
+
+    /* Forwarder string inside the export directory */
+    const char* forward = (const char*)module->base + rva;
+    const char* dot = strrchr(forward, '.');
+    if (!dot || dot == forward || dot - forward >= LOADER_NAME_MAX - 5 || depth >= LOADER_FORWARD_DEPTH) {
+        return NULL;
+    }
+
+    char target[LOADER_NAME_MAX];
+    memcpy(target, forward, (size_t)(dot - forward));
+    target[dot - forward] = '\0';
+
+    char dir[LOADER_PATH_MAX];
+    image_dir(image, dir);
+
+    DWORD error;
+    win32_module_t* dep = module_load(target, dir, &error);
+    if (!dep) {
+        return NULL;
+    }
+    if (!module_add_dep(module, dep)) {
+        module_release(dep);
+        return NULL;
+    }
+
+    if (dot[1] == '#') {
+        return module_export(dep, NULL, (uint32_t)strtoul(dot + 2, NULL, 10), depth + 1);
+    }
+    return module_export(dep, dot + 1, 0, depth + 1);
+}
+
+/* Load every imported DLL and fill the import address tables in one pass */
+static DWORD module_bind_imports(win32_module_t* module) {
+    const win32_image_t* image = module->image;
+    const pe_optional_header64_t* opt = image->opt;
+    if (opt->num_data_directories <= PE_DIR_IMPORT || !opt->data_directories[PE_DIR_IMPORT].size) {
+        return ERROR_SUCCESS;
+    }
+
+    /* Dependencies are searched for next to the importer first */
+    char dir[LOADER_PATH_MAX];
+    image_dir(image, dir);
+
+    uint32_t image_size = opt->image_size;
+    uint64_t bound = 0;
+    for (uint32_t rva = opt->data_directories[PE_DIR_IMPORT].virtual_address;
+         (uint64_t)rva + sizeof(pe_import_descriptor_t) <= image_size; rva += sizeof(pe_import_descriptor_t)) {
+        const pe_import_descriptor_t* desc = (const pe_import_descriptor_t*)(module->base + rva);
+        if (!desc->name_rva || desc->name_rva >= image_size ||
+            desc->import_address_table_rva >= image_size) {
+            break;
+        }
+
+        DWORD error;
+        win32_module_t* dep = module_load((const char*)module->base + desc->name_rva, dir, &error);
+        if (!dep) {
+            return error;
+        }
+        if (!module_add_dep(module, dep)) {
+            module_release(dep);
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+
+        const uint32_t* names = (const uint32_t*)(dep->base + dep->image->names_rva);
+
+        uint32_t lookup_rva = desc->import_lookup_table_rva ? desc->import_lookup_table_rva
+                                                            : desc->import_address_table_rva;
+        const uint64_t* lookup = (const uint64_t*)(module->base + lookup_rva);
+        uint64_t* iat = (uint64_t*)(module->base + desc->import_address_table_rva);
+
+        for (uint32_t i = 0; (uint64_t)lookup_rva + (i + 1) * 8ULL <= image_size && lookup[i]; i++) {
+            void* address;
+            if (lookup[i] & PE_ORDINAL_FLAG64) {
+                address = module_export(dep, NULL, (uint32_t)(lookup[i] & 0xFFFF), 0);
+            } else {
+                uint32_t hint_rva = (uint32_t)lookup[i];
+                if ((uint64_t)hint_rva + 3 > image_size) {
+                    return ERROR_BAD_EXE_FORMAT;
+                }
+                uint16_t hint = *(const uint16_t*)(module->base + hint_rva);
+                const char* name = (const char*)module->base + hint_rva + 2;
+
+                /* The linker's hint is right unless the DLL changed; then hash */
+                if (hint < dep->image->num_names &&
+                    strcmp((const char*)dep->base + names[hint], name) == 0) {
+                    uint16_t index = ((const uint16_t*)(dep->base + dep->image->ordinals_rva))[hint];
+                    address = module_export(dep, NULL, index + dep->image->ordinal_base, 0);
+                } else {
+                    address = module_export(dep, name, 0, 0);
+                }
+            }
+            if (!address) {
+                return ERROR_PROC_NOT_FOUND;
+            }
+            iat[i] = (uint64_t)(uintptr_t)address;
+            bound++;
+        }
+    }
+
+    g_loader_stats.imports_bound += bound;
+    return ERROR_SUCCESS;
+}
+
+static void module_link(win32_module_t* module) {
+    win32_context_t* ctx = win32_get_context();
+    module->next = (win32_module_t*)ctx->module_list;
+    ctx->module_list = module;
+    ctx->num_modules++;
+}
+
+static void module_unlink(win32_module_t* module) {
+    win32_context_t* ctx = win32_get_context();
+    win32_module_t* prev = NULL;
+    for (win32_module_t* cur = module_first(); cur; prev = cur, cur = cur->next) {
+        if (cur == module) {
+            if (prev) {
+                prev->next = module->next;
+            } else {
+                ctx->module_list = module->next;
+            }
+            ctx->num_modules--;
+            return;
+        }
+    }
+}
+
+/* Tear down a module whose last reference is gone, then drop what it held */
+static void module_destroy(win32_module_t* module) {
+    if (module->attached) {
+        win32_dll_entry_t entry = (win32_dll_entry_t)(module->base + module->image->opt->entry_point);
+        entry((HMODULE)module->base, DLL_PROCESS_DETACH, NULL);
+    }
+
+    module_unlink(module);
+    module_unmap(module);
+    module->image->modules--;
+
+    for (uint32_t i = module->num_deps; i-- > 0;) {
+        module_release(module->deps[i]);
+    }
+    free(module->deps);
+    free(module);
+}
+
+static void module_release(win32_module_t* module) {
+    if (--module->refcount == 0) {
+        module_destroy(module);
+    }
+}
+
+/* Find a path as given, or a bare name in search_dir, the current directory, then "." */
+static bool module_find(const char* path, const char* search_dir, char* out_path, struct stat* out_st) {
+    char name[LOADER_PATH_MAX];
+    size_t len = strlen(path);
+    if (len >= sizeof(name) - 5) {
+        return false;
+    }
+
+    for (size_t i = 0; i <= len; i++) {
+        name[i] = path[i] == '\\' ? '/' : path[i];
+    }
+    const char* file = strrchr(name, '/');
+    if (!strchr(file ? file : name, '.')) {
+        memcpy(name + len, ".dll", 5);
+    }
+
+    if (file) {
+        snprintf(out_path, LOADER_PATH_MAX, "%s", name);
+        return stat(out_path, out_st) == 0 && S_ISREG(out_st->st_mode);
+    }
+
+    /* Windows names are case-insensitive; also try the lower-case spelling */
+    char lower[LOADER_NAME_MAX];
+    loader_module_name(name, lower);
+
+    const char* dirs[3] = { search_dir, win32_get_context()->current_directory, "." };
+    for (int d = 0; d < 3; d++) {
+        if (!dirs[d] || !dirs[d][0]) {
+            continue;
+        }
+        size_t dlen = strlen(dirs[d]);
+        const char* sep = dirs[d][dlen - 1] == '/' ? "" : "/";
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass && strcmp(lower, name) == 0) {
+                break;
+            }
+            int n = snprintf(out_path, LOADER_PATH_MAX, "%s%s%s", dirs[d], sep, pass ? lower : name);
+            if (n < LOADER_PATH_MAX && stat(out_path, out_st) == 0 && S_ISREG(out_st->st_mode)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* Load or reference a module; caller holds the loader lock */
+static win32_module_t* module_load(const char* path, const char* search_dir, DWORD* out_error) {
+    char name[LOADER_NAME_MAX];
+    loader_module_name(path, name);
+
+    win32_module_t* module = module_by_name(name);
+    if (module) {
+        module->refcount++;
+        return module;
+    }
+
+    char resolved[LOADER_PATH_MAX];
+    struct stat st;
+    if (!module_find(path, search_dir, resolved, &st)) {
+        *out_error = ERROR_MOD_NOT_FOUND;
+        return NULL;
+    }
+
+    win32_image_t* image = image_get(resolved, &st, out_error);
+    if (!image) {
+        return NULL;
+    }
+
+    module = (win32_module_t*)calloc(1, sizeof(win32_module_t));
+    if (!module) {
+        *out_error = ERROR_NOT_ENOUGH_MEMORY;
+        return NULL;
+    }
+    module->image = image;
+    module->refcount = 1;
+    if (!module_map(module)) {
+        free(module);
+        *out_error = ERROR_NOT_ENOUGH_MEMORY;
+        return NULL;
+    }
+    image->modules++;
+
+    /* Listed before binding so import cycles find it instead of recursing */
+    module_link(module);
+
+    DWORD error = module_relocate(module);
+    if (error == ERROR_SUCCESS) {
+        error = module_bind_imports(module);
+    }
+    if (error != ERROR_SUCCESS) {
+        module_destroy(module);
+        *out_error = error;
+        return NULL;
+    }
+    module_protect(module);
+
+    if (image->is_dll && image->opt->entry_point) {
+        win32_dll_entry_t entry = (win32_dll_entry_t)(module->base + image->opt->entry_point);
+        if (!entry((HMODULE)module->base, DLL_PROCESS_ATTACH, NULL)) {
+            module_destroy(module);
+            *out_error = ERROR_DLL_INIT_FAILED;
+            return NULL;
+        }
+        module->attached = true;
+    }
+
+    g_loader_stats.modules_loaded++;
+    return module;
+}
+
+/* ============================================================================
+ * Module API
+ * ============================================================================ */
+
+HMODULE LoadLibraryA(LPCSTR lpLibFileName) {
+    if (!lpLibFileName || !lpLibFileName[0]) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    DWORD error = ERROR_SUCCESS;
+    loader_lock();
+    win32_module_t* module = module_load(lpLibFileName, NULL, &error);
+    loader_unlock();
+
+    if (!module) {
+        SetLastError(error);
+        return NULL;
+    }
+    SetLastError(ERROR_SUCCESS);
+    return (HMODULE)module->base;
+}
+
+BOOL FreeLibrary(HMODULE hLibModule) {
+    loader_lock();
+    win32_module_t* module = module_by_handle(hLibModule);
+    if (module) {
+        module_release(module);
+    }
+    loader_unlock();
+
+    if (!module) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void* GetProcAddress(HMODULE hModule, LPCSTR lpProcName) {
+    if (!lpProcName) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    loader_lock();
+    void* address = NULL;
+    win32_module_t* module = module_by_handle(hModule);
+    if (module) {
+        /* Values below 64K are ordinals, as on Windows */
+        if ((uintptr_t)lpProcName < 0x10000) {
+            address = module_export(module, NULL, (uint32_t)(uintptr_t)lpProcName, 0);
+        } else {
+            address = module_export(module, lpProcName, 0, 0);
+        }
+    }
+    loader_unlock();
+
+    if (!address) {
+        SetLastError(module ? ERROR_PROC_NOT_FOUND : ERROR_INVALID_HANDLE);
+    }
+    return address;
+}
+
+HMODULE GetModuleHandleA(LPCSTR lpModuleName) {
+    HMODULE handle = NULL;
+
+    loader_lock();
+    if (!lpModuleName) {
+        /* The executable: the first non-DLL loaded */
+        for (win32_module_t* module = module_first(); module; module = module->next) {
+            if (!module->image->is_dll) {
+                handle = (HMODULE)module->base;
+            }
+        }
+    } else {
+        char name[LOADER_NAME_MAX];
+        loader_module_name(lpModuleName, name);
+        win32_module_t* module = module_by_name(name);
+        handle = module ? (HMODULE)module->base : NULL;
+    }
+    loader_unlock();
+
+    if (!handle) {
+        SetLastError(ERROR_MOD_NOT_FOUND);
+    }
+    return handle;
+}
+
+void win32_loader_get_stats(win32_loader_stats_t* out_stats) {
+    if (!out_stats) {
+        return;
+    }
+
+    loader_lock();
+    *out_stats = g_loader_stats;
+    loader_unlock();
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+#define LOADER_BENCH_EXPORTS    256   /* Exports per generated DLL */
+#define LOADER_BENCH_IMPORTS    64    /* Functions the EXE takes from each DLL */
+#define LOADER_BENCH_CHAIN      16    /* Functions each DLL takes from the one before */
+#define LOADER_BENCH_LOOKUPS    100000
+
+static uint64_t loader_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Write a page-aligned PE32+ image: .text with a DllMain returning TRUE and
+ * one "mov eax, n; ret" per export, .rdata with exports named Fn00000...,
+ * and .idata importing every stride-th export of each listed DLL.
+ */
+static int loader_write_image(const char* path, const char* name, bool dll, uint64_t base,
+                              uint32_t num_exports, const char* const* imports, uint32_t num_imports,
+                              uint32_t funcs_per_import, uint32_t stride) {
+    const uint32_t name_len = 8;  /* "Fn00000" */
+    uint32_t text_size = 8 * (num_exports + 1);
+    uint32_t rdata_size = num_exports ? (uint32_t)(sizeof(pe_export_directory_t) + 10 * num_exports +
+                                                   strlen(name) + 1 + name_len * num_exports) : 0;
+    uint32_t per_dll = (funcs_per_import + 1) * 16 + funcs_per_import * (2 + name_len) + LOADER_NAME_MAX + 8;
+    uint32_t idata_size = num_imports ? (num_imports + 1) * sizeof(pe_import_descriptor_t) + num_imports * per_dll : 0;
+
+    uint32_t text_rva = LOADER_PAGE_SIZE;
+    uint32_t rdata_rva = text_rva + (uint32_t)loader_page_round(text_size);
+    uint32_t idata_rva = rdata_rva + (uint32_t)loader_page_round(rdata_size);
+    uint32_t image_size = idata_rva + (uint32_t)loader_page_round(idata_size);
+
+    uint8_t* buf = (uint8_t*)calloc(1, image_size);
+    if (!buf) {
+        return -1;
+    }
+
+    /* Headers */
+    *(uint16_t*)buf = PE_DOS_MAGIC;
+    *(uint32_t*)(buf + 0x3C) = 0x40;
+    *(uint32_t*)(buf + 0x40) = PE_NT_MAGIC;
+    pe_coff_header_t* coff = (pe_coff_header_t*)(buf + 0x44);
+    pe_optional_header64_t* opt = (pe_optional_header64_t*)(coff + 1);
+    pe_section_header_t* sections = (pe_section_header_t*)(opt + 1);
+
+    coff->machine = PE_MACHINE_AMD64;
+    coff->optional_header_size = sizeof(pe_optional_header64_t);
+    coff->characteristics = PE_CHAR_EXECUTABLE | (dll ? PE_CHAR_DLL : 0);
+    opt->magic = PE_OPTIONAL_MAGIC_PE32_PLUS;
+    opt->entry_point = text_rva;
+    opt->image_base = base;
+    opt->section_alignment = LOADER_PAGE_SIZE;
+    opt->file_alignment = LOADER_PAGE_SIZE;
+    opt->image_size = image_size;
+    opt->headers_size = LOADER_PAGE_SIZE;
+    opt->num_data_directories = PE_NUM_DIRECTORIES;
+
+    const struct { const char* name; uint32_t rva; uint32_t size; uint32_t flags; } layout[] = {
+        { ".text", text_rva, text_size, PE_SCN_MEM_READ | PE_SCN_MEM_EXECUTE },
+        { ".rdata", rdata_rva, rdata_size, PE_SCN_MEM_READ },
+        { ".idata", idata_rva, idata_size, PE_SCN_MEM_READ | PE_SCN_MEM_WRITE },
+    };
+    for (uint32_t i = 0; i < 3; i++) {
+        if (!layout[i].size) {
+            continue;
+        }
+        pe_section_header_t* section = &sections[coff->num_sections++];
+        memcpy(section->name, layout[i].name, strlen(layout[i].name));
+        section->virtual_size = layout[i].size;
+        section->virtual_address = layout[i].rva;
+        section->raw_data_size = (uint32_t)loader_page_round(layout[i].size);
+        section->raw_data_offset = layout[i].rva;
+        section->characteristics = layout[i].flags;
+    }
+
+    /* Code: mov eax, imm32; ret */
+    for (uint32_t i = 0; i <= num_exports; i++) {
+        uint8_t* code = buf + text_rva + i * 8;
+        uint32_t value = i ? i - 1 : TRUE;
+        code[0] = 0xB8;
+        memcpy(code + 1, &value, sizeof(value));
+        code[5] = 0xC3;
+    }
+
+    if (num_exports) {
+        pe_export_directory_t* dir = (pe_export_directory_t*)(buf + rdata_rva);
+        uint32_t cursor = rdata_rva + sizeof(pe_export_directory_t);
+        dir->ordinal_base = 1;
+        dir->num_functions = num_exports;
+        dir->num_names = num_exports;
+        dir->functions_rva = cursor;
+        dir->names_rva = cursor + 4 * num_exports;
+        dir->name_ordinals_rva = cursor + 8 * num_exports;
+        cursor += 10 * num_exports;
+        dir->name_rva = cursor;
+        strcpy((char*)buf + cursor, name);
+        cursor += (uint32_t)strlen(name) + 1;
+
+        for (uint32_t i = 0; i < num_exports; i++) {
+            ((uint32_t*)(buf + dir->functions_rva))[i] = text_rva + (i + 1) * 8;
+            ((uint32_t*)(buf + dir->names_rva))[i] = cursor;
+            ((uint16_t*)(buf + dir->name_ordinals_rva))[i] = (uint16_t)i;
+            snprintf((char*)buf + cursor, name_len, "Fn%05u", i);
+            cursor += name_len;
+        }
+        opt->data_directories[PE_DIR_EXPORT].virtual_address = rdata_rva;
+        opt->data_directories[PE_DIR_EXPORT].size = rdata_size;
+    }
+
+    if (num_imports) {
+        pe_import_descriptor_t* desc = (pe_import_descriptor_t*)(buf + idata_rva);
+        uint32_t cursor = idata_rva + (num_imports + 1) * sizeof(pe_import_descriptor_t);
+        for (uint32_t d = 0; d < num_imports; d++) {
+            cursor = (cursor + 7) & ~7u;
+            uint64_t* lookup = (uint64_t*)(buf + cursor);
+            desc[d].import_lookup_table_rva = cursor;
+            cursor += (funcs_per_import + 1) * 8;
+            uint64_t* iat = (uint64_t*)(buf + cursor);
+            desc[d].import_address_table_rva = cursor;
+            cursor += (funcs_per_import + 1) * 8;
+
+            for (uint32_t f = 0; f < funcs_per_import; f++) {
+                uint32_t index = f * stride;
+                lookup[f] = iat[f] = cursor;
+                *(uint16_t*)(buf + cursor) = (uint16_t)index;
+                snprintf((char*)buf + cursor + 2, name_len, "Fn%05u", index);
+                cursor += 2 + name_len;
+            }
+            desc[d].name_rva = cursor;
+            snprintf((char*)buf + cursor, LOADER_NAME_MAX, "%s", imports[d]);
+            cursor += LOADER_NAME_MAX;
+        }
+        opt->data_directories[PE_DIR_IMPORT].virtual_address = idata_rva;
+        opt->data_directories[PE_DIR_IMPORT].size = (num_imports + 1) * sizeof(pe_import_descriptor_t);
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        free(buf);
+        return -1;
+    }
+    ssize_t written = write(fd, buf, image_size);
+    close(fd);
+    free(buf);
+    return written == (ssize_t)image_size ? 0 : -1;
+}
+
+/* What GetProcAddress would cost searching the sorted name table instead */
+static void* loader_bsearch_export(const win32_module_t* module, const char* name) {
+    const win32_image_t* image = module->image;
+    const uint32_t* names = (const uint32_t*)(module->base + image->names_rva);
+    uint32_t lo = 0;
+    uint32_t hi = image->num_names;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(name, (const char*)module->base + names[mid]);
+        if (cmp == 0) {
+            uint16_t index = ((const uint16_t*)(module->base + image->ordinals_rva))[mid];
+            return module->base + ((const uint32_t*)(module->base + image->functions_rva))[index];
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+int win32_loader_benchmark(const char* dir, uint32_t dll_count, uint32_t iterations,
+                           win32_loader_bench_result_t* out_result) {
+    if (!dir || !out_result || dll_count == 0 || iterations == 0) {
+        return -1;
+    }
+
+    memset(out_result, 0, sizeof(*out_result));
+
+    char** names = (char**)calloc(dll_count, sizeof(char*));
+    char path[LOADER_PATH_MAX];
+    int result = -1;
+    if (!names) {
+        return -1;
+    }
+
+    /* A stamp in the names keeps earlier runs' images out of the cold start */
+    unsigned stamp = (unsigned)(loader_now_ns() / 1000) & 0xFFFFFF;
+    for (uint32_t i = 0; i < dll_count; i++) {
+        names[i] = (char*)malloc(LOADER_NAME_MAX);
+        if (!names[i]) {
+            goto out;
+        }
+        snprintf(names[i], LOADER_NAME_MAX, "bench%06x_%u.dll", stamp, i);
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (loader_write_image(path, names[i], true, 0x7e0000000000ULL + (uint64_t)i * 0x1000000,
+                               LOADER_BENCH_EXPORTS, (const char* const*)(i ? &names[i - 1] : NULL),
+                               i ? 1 : 0, LOADER_BENCH_CHAIN, 7) < 0) {
+            goto out;
+        }
+    }
+
+    char exe[LOADER_PATH_MAX];
+    snprintf(exe, sizeof(exe), "%s/bench%06x.exe", dir, stamp);
+    if (loader_write_image(exe, "bench.exe", false, 0x140000000ULL, 0, (const char* const*)names,
+                           dll_count, LOADER_BENCH_IMPORTS, LOADER_BENCH_EXPORTS / LOADER_BENCH_IMPORTS) < 0) {
+        goto out;
+    }
+
+    win32_loader_stats_t before, after;
+    win32_loader_get_stats(&before);
+
+    uint64_t start = loader_now_ns();
+    HMODULE module = LoadLibraryA(exe);
+    out_result->cold_start_ns = loader_now_ns() - start;
+    if (!module) {
+        goto out;
+    }
+    win32_loader_get_stats(&after);
+    out_result->imports_per_start = after.imports_bound - before.imports_bound;
+    FreeLibrary(module);
+
+    uint64_t load_total = 0;
+    uint64_t unload_total = 0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        start = loader_now_ns();
+        module = LoadLibraryA(exe);
+        uint64_t loaded = loader_now_ns();
+        FreeLibrary(module);
+        unload_total += loader_now_ns() - loaded;
+        load_total += loaded - start;
+    }
+    out_result->warm_start_ns = load_total / iterations;
+    out_result->unload_ns = unload_total / iterations;
+
+    /* Name lookups in the last DLL, hashed against bisected */
+    snprintf(path, sizeof(path), "%s/%s", dir, names[dll_count - 1]);
+    HMODULE dll = LoadLibraryA(path);
+    if (dll) {
+        static char procs[LOADER_BENCH_EXPORTS][8];
+        uint32_t seed = 12345;
+        uintptr_t sink = 0;
+        for (uint32_t i = 0; i < LOADER_BENCH_EXPORTS; i++) {
+            snprintf(procs[i], sizeof(procs[i]), "Fn%05u", i);
+        }
+
+        start = loader_now_ns();
+        for (uint32_t i = 0; i < LOADER_BENCH_LOOKUPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            sink += (uintptr_t)GetProcAddress(dll, procs[(seed >> 8) % LOADER_BENCH_EXPORTS]);
+        }
+        out_result->proc_hash_ns = (loader_now_ns() - start) / LOADER_BENCH_LOOKUPS;
+
+        /* Same locking and module lookup as GetProcAddress, bisecting instead */
+        seed = 12345;
+        start = loader_now_ns();
+        for (uint32_t i = 0; i < LOADER_BENCH_LOOKUPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            loader_lock();
+            sink -= (uintptr_t)loader_bsearch_export(module_by_handle(dll), procs[(seed >> 8) % LOADER_BENCH_EXPORTS]);
+            loader_unlock();
+        }
+        out_result->proc_bsearch_ns = (loader_now_ns() - start) / LOADER_BENCH_LOOKUPS;
+
+        FreeLibrary(dll);
+        result = sink == 0 ? 0 : -1;
+    }
+
+out:
+    for (uint32_t i = 0; i < dll_count; i++) {
+        if (names[i]) {
+            snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+            unlink(path);
+            free(names[i]);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/bench%06x.exe", dir, stamp);
+    unlink(path);
+    free(names);
+    return result;
+}
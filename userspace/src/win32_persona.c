@@ -7,6 +7,10 @@
 #include "posix_persona.h"  // Reuse POSIX syscalls where applicable
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 /* Global Win32 context */
 static win32_context_t g_win32_ctx = {0};
@@ -19,8 +23,10 @@ static win32_stats_t g_win32_stats = {0};
 #define HANDLE_TYPE_HEAP    4
 
 typedef struct win32_handle {
-    uint32_t type;
+    uint32_t type;        // 0 while the slot is free
     uint32_t flags;
+    uint32_t generation;  // Bumped on close; must match the HANDLE's
+    uint32_t next_free;   // Free list link, slot index + 1
     union {
         int fd;           // File descriptor (for files)
         uint32_t pid;     // Process ID
@@ -29,25 +35,31 @@ typedef struct win32_handle {
     };
 } win32_handle_t;
 
-/* Initialize Win32 persona */
-int win32_persona_init(void) {
-    /* Initialize context */
-    for (int i = 0; i < sizeof(g_win32_ctx); i++) {
-        ((uint8_t*)&g_win32_ctx)[i] = 0;
-    }
+/* HANDLE = generation << 32 | (slot + 1) << 2 */
+#define HANDLE_SLOT_SHIFT 2
+#define HANDLE_GEN_SHIFT  32
 
-    /* Allocate handle table */
-    g_win32_ctx.max_handles = 1024;
-    g_win32_ctx.handle_table = (void**)malloc(sizeof(void*) * g_win32_ctx.max_handles);
-    if (!g_win32_ctx.handle_table) {
-        return -1;
-    }
+static inline HANDLE win32_make_handle(uint32_t slot, uint32_t generation) {
+    return (HANDLE)(uintptr_t)(((uint64_t)generation << HANDLE_GEN_SHIFT) |
+                               ((uint64_t)(slot + 1) << HANDLE_SLOT_SHIFT));
+}
 
-    for (uint32_t i = 0; i < g_win32_ctx.max_handles; i++) {
-        g_win32_ctx.handle_table[i] = NULL;
+/* Slot index + 1 encoded in a handle, 0 if it cannot be one of ours */
+static inline uint32_t win32_handle_slot(HANDLE handle) {
+    uint64_t value = (uint64_t)(uintptr_t)handle;
+    uint32_t slot = (uint32_t)value >> HANDLE_SLOT_SHIFT;
+    if ((value & ((1u << HANDLE_SLOT_SHIFT) - 1)) || slot > WIN32_HANDLE_MAX_CHUNKS * WIN32_HANDLE_CHUNK) {
+        return 0;
     }
+    return slot;
+}
 
-    g_win32_ctx.next_handle = 1;
+/* Initialize Win32 persona */
+int win32_persona_init(void) {
+    /* Initialize context */
+    memset(&g_win32_ctx, 0, sizeof(g_win32_ctx));
+
+    /* Handle chunks are added on demand */
     g_win32_ctx.process_id = getpid();
     g_win32_ctx.last_error = ERROR_SUCCESS;
 
@@ -62,9 +74,14 @@ int win32_persona_init(void) {
 
 /* Shutdown Win32 persona */
 int win32_persona_shutdown(void) {
-    if (g_win32_ctx.handle_table) {
-        free(g_win32_ctx.handle_table);
+    for (uint32_t i = 0; i < WIN32_HANDLE_MAX_CHUNKS; i++) {
+        free(g_win32_ctx.handle_chunks[i]);
+        g_win32_ctx.handle_chunks[i] = NULL;
     }
+    g_win32_ctx.handle_capacity = 0;
+    g_win32_ctx.handles_open = 0;
+    g_win32_ctx.free_handle = 0;
+
     if (g_win32_ctx.current_directory) {
         free(g_win32_ctx.current_directory);
     }
@@ -79,43 +96,115 @@ win32_context_t* win32_get_context(void) {
     return &g_win32_ctx;
 }
 
+static void win32_lock(void) {
+    while (__sync_lock_test_and_set(&g_win32_ctx.lock, 1)) {
+        while (__atomic_load_n(&g_win32_ctx.lock, __ATOMIC_RELAXED)) {
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+static void win32_unlock(void) {
+    __sync_lock_release(&g_win32_ctx.lock);
+}
+
+static inline win32_handle_t* win32_slot(uint32_t slot) {
+    win32_handle_t* chunk = __atomic_load_n((win32_handle_t**)&g_win32_ctx.handle_chunks[slot / WIN32_HANDLE_CHUNK],
+                                            __ATOMIC_ACQUIRE);
+    return chunk ? &chunk[slot % WIN32_HANDLE_CHUNK] : NULL;
+}
+
+/* Add a chunk of free slots; caller holds the lock */
+static bool win32_grow_handles(void) {
+    uint32_t index = g_win32_ctx.handle_capacity / WIN32_HANDLE_CHUNK;
+    if (index >= WIN32_HANDLE_MAX_CHUNKS) {
+        return false;
+    }
+
+    win32_handle_t* chunk = (win32_handle_t*)calloc(WIN32_HANDLE_CHUNK, sizeof(win32_handle_t));
+    if (!chunk) {
+        return false;
+    }
+
+    /* Thread the new slots onto the free list in order, lowest first */
+    uint32_t base = g_win32_ctx.handle_capacity;
+    for (uint32_t i = 0; i < WIN32_HANDLE_CHUNK; i++) {
+        chunk[i].generation = 1;
+        chunk[i].next_free = i + 1 < WIN32_HANDLE_CHUNK ? base + i + 2 : g_win32_ctx.free_handle;
+    }
+    g_win32_ctx.free_handle = base + 1;
+
+    /* Publish last so a lock-free reader never sees a half-built chunk */
+    __atomic_store_n((win32_handle_t**)&g_win32_ctx.handle_chunks[index], chunk, __ATOMIC_RELEASE);
+    g_win32_ctx.handle_capacity = base + WIN32_HANDLE_CHUNK;
+    return true;
+}
+
 /* Allocate handle */
 static HANDLE win32_alloc_handle(uint32_t type) {
-    __sync_lock_test_and_set(&g_win32_ctx.lock, 1);
-
-    for (uint32_t i = g_win32_ctx.next_handle; i < g_win32_ctx.max_handles; i++) {
-        if (g_win32_ctx.handle_table[i] == NULL) {
-            win32_handle_t* h = (win32_handle_t*)malloc(sizeof(win32_handle_t));
-            if (!h) {
-                __sync_lock_release(&g_win32_ctx.lock);
-                return INVALID_HANDLE_VALUE;
-            }
+    win32_lock();
 
-            for (int j = 0; j < sizeof(win32_handle_t); j++) {
-                ((uint8_t*)h)[j] = 0;
-            }
+    if (!g_win32_ctx.free_handle && !win32_grow_handles()) {
+        win32_unlock();
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_HANDLE_VALUE;
+    }
 
-            h->type = type;
-            g_win32_ctx.handle_table[i] = h;
-            g_win32_ctx.next_handle = i + 1;
+    uint32_t slot = g_win32_ctx.free_handle - 1;
+    win32_handle_t* h = win32_slot(slot);
+    g_win32_ctx.free_handle = h->next_free;
+    g_win32_ctx.handles_open++;
 
-            __sync_lock_release(&g_win32_ctx.lock);
-            return (HANDLE)(uintptr_t)i;
-        }
-    }
+    h->flags = 0;
+    h->next_free = 0;
+    h->heap_ptr = NULL;
+    __atomic_store_n(&h->type, type, __ATOMIC_RELEASE);
+    uint32_t generation = h->generation;
 
-    __sync_lock_release(&g_win32_ctx.lock);
-    SetLastError(ERROR_NOT_ENOUGH_MEMORY);
-    return INVALID_HANDLE_VALUE;
+    win32_unlock();
+    return win32_make_handle(slot, generation);
 }
 
-/* Get handle data */
-static win32_handle_t* win32_get_handle(HANDLE h) {
-    uintptr_t index = (uintptr_t)h;
-    if (index == 0 || index >= g_win32_ctx.max_handles) {
+/* Get handle data; lock-free, NULL for closed, stale or made-up handles */
+static win32_handle_t* win32_get_handle(HANDLE handle) {
+    uint32_t slot = win32_handle_slot(handle);
+    if (slot == 0) {
         return NULL;
     }
-    return (win32_handle_t*)g_win32_ctx.handle_table[index];
+
+    win32_handle_t* h = win32_slot(slot - 1);
+    uint32_t generation = (uint32_t)((uint64_t)(uintptr_t)handle >> HANDLE_GEN_SHIFT);
+    if (!h || __atomic_load_n(&h->generation, __ATOMIC_ACQUIRE) != generation ||
+        __atomic_load_n(&h->type, __ATOMIC_ACQUIRE) == 0) {
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * Retire a handle, copying out the object it referred to: later lookups
+ * of it fail and the slot goes back on the free list. Fails if another
+ * thread closed it first.
+ */
+static bool win32_free_handle(HANDLE handle, win32_handle_t* h, win32_handle_t* out_closed) {
+    win32_lock();
+
+    if (h->type == 0 || h->generation != (uint32_t)((uint64_t)(uintptr_t)handle >> HANDLE_GEN_SHIFT)) {
+        win32_unlock();
+        return false;
+    }
+    *out_closed = *h;
+
+    __atomic_store_n(&h->type, 0, __ATOMIC_RELEASE);
+    /* Skip 0 on wrap so a handle value of 0 is never valid */
+    uint32_t generation = h->generation + 1;
+    __atomic_store_n(&h->generation, generation ? generation : 1, __ATOMIC_RELEASE);
+    h->next_free = g_win32_ctx.free_handle;
+    g_win32_ctx.free_handle = win32_handle_slot(handle);
+    g_win32_ctx.handles_open--;
+
+    win32_unlock();
+    return true;
 }
 
 /* File I/O */
@@ -231,21 +320,15 @@ BOOL WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
 
 BOOL CloseHandle(HANDLE hObject) {
     win32_handle_t* h = win32_get_handle(hObject);
-    if (!h) {
+    win32_handle_t closed;
+    if (!h || !win32_free_handle(hObject, h, &closed)) {
         SetLastError(ERROR_INVALID_HANDLE);
         return FALSE;
     }
 
     /* Close based on type */
-    if (h->type == HANDLE_TYPE_FILE) {
-        close(h->fd);
-    }
-
-    /* Free handle */
-    uintptr_t index = (uintptr_t)hObject;
-    if (index < g_win32_ctx.max_handles) {
-        free(g_win32_ctx.handle_table[index]);
-        g_win32_ctx.handle_table[index] = NULL;
+    if (closed.type == HANDLE_TYPE_FILE) {
+        close(closed.fd);
     }
 
     g_win32_stats.syscalls_translated++;
@@ -297,81 +380,6 @@ BOOL DeleteFileA(LPCSTR lpFileName) {
     return TRUE;
 }
 
-/* Memory Management */
-LPVOID VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType,
-                    DWORD flProtect) {
-    (void)lpAddress;
-    (void)flAllocationType;
-    (void)flProtect;
-
-    void* ptr = malloc(dwSize);
-    if (!ptr) {
-        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
-        return NULL;
-    }
-
-    g_win32_stats.syscalls_translated++;
-    g_win32_stats.allocations++;
-    SetLastError(ERROR_SUCCESS);
-    return ptr;
-}
-
-BOOL VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType) {
-    (void)dwSize;
-    (void)dwFreeType;
-
-    if (!lpAddress) {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        return FALSE;
-    }
-
-    free(lpAddress);
-
-    g_win32_stats.syscalls_translated++;
-    SetLastError(ERROR_SUCCESS);
-    return TRUE;
-}
-
-HANDLE GetProcessHeap(void) {
-    static HANDLE heap = NULL;
-    if (!heap) {
-        heap = win32_alloc_handle(HANDLE_TYPE_HEAP);
-    }
-    return heap;
-}
-
-LPVOID HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes) {
-    (void)hHeap;
-    (void)dwFlags;
-
-    void* ptr = malloc(dwBytes);
-    if (!ptr) {
-        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
-        return NULL;
-    }
-
-    g_win32_stats.syscalls_translated++;
-    g_win32_stats.allocations++;
-    SetLastError(ERROR_SUCCESS);
-    return ptr;
-}
-
-BOOL HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem) {
-    (void)hHeap;
-    (void)dwFlags;
-
-    if (!lpMem) {
-        SetLastError(ERROR_INVALID_PARAMETER);
-        return FALSE;
-    }
-
-    free(lpMem);
-
-    g_win32_stats.syscalls_translated++;
-    SetLastError(ERROR_SUCCESS);
-    return TRUE;
-}
-
 /* Process Management */
 BOOL CreateProcessA(LPCSTR lpApplicationName, LPSTR lpCommandLine,
                     SECURITY_ATTRIBUTES* lpProcessAttributes,
@@ -381,31 +389,43 @@ BOOL CreateProcessA(LPCSTR lpApplicationName, LPSTR lpCommandLine,
                     STARTUPINFO* lpStartupInfo, PROCESS_INFORMATION* lpProcessInformation) {
     (void)lpProcessAttributes;
     (void)lpThreadAttributes;
-    (void)bInheritHandles;
     (void)dwCreationFlags;
     (void)lpEnvironment;
-    (void)lpCurrentDirectory;
-    (void)lpStartupInfo;
 
     if (!lpApplicationName && !lpCommandLine) {
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
-        return FALSE;
+    /* Spawn directly: nothing of this process needs to be copied into the child */
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    if (lpCurrentDirectory) {
+        posix_spawn_file_actions_addchdir_np(&actions, lpCurrentDirectory);
+    }
+
+    if (bInheritHandles && lpStartupInfo && (lpStartupInfo->dwFlags & STARTF_USESTDHANDLES)) {
+        HANDLE std_handles[3] = { lpStartupInfo->hStdInput, lpStartupInfo->hStdOutput,
+                                  lpStartupInfo->hStdError };
+        for (int i = 0; i < 3; i++) {
+            win32_handle_t* h = win32_get_handle(std_handles[i]);
+            if (h && h->type == HANDLE_TYPE_FILE) {
+                posix_spawn_file_actions_adddup2(&actions, h->fd, i);
+            }
+        }
     }
 
-    if (pid == 0) {
-        /* Child process */
-        const char* argv[2] = { lpApplicationName ? lpApplicationName : lpCommandLine, NULL };
-        execve(argv[0], (char* const*)argv, NULL);
-        _exit(1);
+    pid_t pid;
+    char* const argv[2] = { (char*)(lpApplicationName ? lpApplicationName : lpCommandLine), NULL };
+    int error = posix_spawn(&pid, argv[0], &actions, NULL, argv, NULL);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (error != 0) {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
     }
 
-    /* Parent process */
     if (lpProcessInformation) {
         HANDLE process_handle = win32_alloc_handle(HANDLE_TYPE_PROCESS);
         win32_handle_t* h = win32_get_handle(process_handle);
@@ -549,25 +569,6 @@ DWORD GetTickCount(void) {
     return 0;  // TODO: Implement
 }
 
-HMODULE LoadLibraryA(LPCSTR lpLibFileName) {
-    (void)lpLibFileName;
-    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
-    return NULL;
-}
-
-BOOL FreeLibrary(HMODULE hLibModule) {
-    (void)hLibModule;
-    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
-    return FALSE;
-}
-
-void* GetProcAddress(HMODULE hModule, LPCSTR lpProcName) {
-    (void)hModule;
-    (void)lpProcName;
-    SetLastError(ERROR_CALL_NOT_IMPLEMENTED);
-    return NULL;
-}
-
 LPSTR GetCommandLineA(void) {
     return g_win32_ctx.command_line;
 }
@@ -580,8 +581,92 @@ int win32_get_stats(win32_stats_t* out_stats) {
     out_stats->files_opened = g_win32_stats.files_opened;
     out_stats->processes_created = g_win32_stats.processes_created;
     out_stats->threads_created = g_win32_stats.threads_created;
-    out_stats->allocations = g_win32_stats.allocations;
-    out_stats->modules_loaded = g_win32_stats.modules_loaded;
 
+    win32_heap_stats_t heap;
+    win32_heap_get_stats(&heap);
+    out_stats->allocations = g_win32_stats.allocations + heap.allocations;
+
+    win32_loader_stats_t loader;
+    win32_loader_get_stats(&loader);
+    out_stats->modules_loaded = g_win32_stats.modules_loaded + loader.modules_loaded;
+
+    return 0;
+}
+
+static uint64_t win32_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Handle churn benchmark */
+int win32_handle_benchmark(const char* path, uint32_t open_handles, uint32_t iterations,
+                           win32_handle_bench_result_t* out_result) {
+    if (!out_result || open_handles == 0 || iterations == 0) {
+        return -1;
+    }
+
+    memset(out_result, 0, sizeof(*out_result));
+
+    HANDLE* live = (HANDLE*)malloc(sizeof(HANDLE) * open_handles);
+    if (!live) {
+        return -1;
+    }
+
+    /* Table only: a long-lived working set while one slot churns */
+    for (uint32_t i = 0; i < open_handles; i++) {
+        live[i] = win32_alloc_handle(HANDLE_TYPE_HEAP);
+        if (live[i] == INVALID_HANDLE_VALUE) {
+            while (i--) {
+                CloseHandle(live[i]);
+            }
+            free(live);
+            return -1;
+        }
+    }
+
+    uint32_t seed = 12345;
+    uint64_t start = win32_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t victim = (seed >> 8) % open_handles;
+        HANDLE stale = live[victim];
+        CloseHandle(stale);
+        live[victim] = win32_alloc_handle(HANDLE_TYPE_HEAP);
+        if (!win32_get_handle(stale)) {
+            out_result->stale_rejected++;
+        }
+    }
+    out_result->alloc_free_ns = (win32_now_ns() - start) / iterations;
+
+    volatile uint32_t sink = 0;
+    start = win32_now_ns();
+    for (uint32_t i = 0; i < iterations; i++) {
+        win32_handle_t* h = win32_get_handle(live[i % open_handles]);
+        sink += h ? h->type : 0;
+    }
+    out_result->lookup_ns = (win32_now_ns() - start) / iterations;
+    (void)sink;
+
+    /* Through the API, with the same working set still open */
+    if (path) {
+        start = win32_now_ns();
+        for (uint32_t i = 0; i < iterations; i++) {
+            HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                break;
+            }
+            CloseHandle(file);
+        }
+        out_result->create_close_ns = (win32_now_ns() - start) / iterations;
+    }
+
+    out_result->capacity = g_win32_ctx.handle_capacity;
+
+    for (uint32_t i = 0; i < open_handles; i++) {
+        CloseHandle(live[i]);
+    }
+    free(live);
     return 0;
 }
@@ -0,0 +1,377 @@
+#ifndef LIMITLESS_PKG_H
+#define LIMITLESS_PKG_H
+
+/*
+ * Native Package Manager
+ * Binary package index with a SAT dependency solver, a content-addressed
+ * file store, a parallel fetch/verify/unpack pipeline and delta upgrades
+ * over resumable HTTP range transfers
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "terminal.h"
+
+#define PKG_DEFAULT_ROOT      "/"
+#define PKG_DEFAULT_MIRROR    "/var/cache/limitless/mirror"
+#define PKG_STATE_DIR         "var/lib/limitless"     /* Under the install root */
+#define PKG_NONE              UINT32_MAX
+#define PKG_MAX_DELTAS        8                       /* Delta fields per package version */
+
+/* Engine configuration */
+typedef struct {
+    const char* root;             // Install root
+    const char* mirror;           // Directory or http://host[:port]/path holding Packages + pool/
+    uint32_t threads;             // Pipeline workers, 0 = one per CPU
+    uint32_t connections;         // Parallel range requests per download, 0 = 4
+    bool no_deltas;               // Always fetch full archives
+    bool verbose;
+} pkg_config_t;
+
+/* Version constraint operators */
+typedef enum {
+    PKG_OP_ANY,
+    PKG_OP_EQ,
+    PKG_OP_LT,
+    PKG_OP_LE,
+    PKG_OP_GT,
+    PKG_OP_GE,
+} pkg_op_t;
+
+/* ============================================================================
+ * Binary index (index.bin)
+ * Header, records, deltas, dependency groups, alternatives, name buckets,
+ * strings
+ * ============================================================================ */
+
+#define PKG_INDEX_MAGIC       0x494B504C              /* "LPKI" */
+#define PKG_INDEX_VERSION     2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pkg_count;
+    uint32_t bucket_count;        // Power of two
+    uint32_t group_count;
+    uint32_t alt_count;
+    uint32_t strings_size;
+    uint32_t delta_count;
+    uint64_t source_size;         // Packages file the index was built from
+    uint64_t source_mtime;
+} pkg_index_header_t;
+
+/* One package version */
+typedef struct {
+    uint32_t name;                // String offsets
+    uint32_t version;
+    uint32_t filename;
+    uint32_t name_hash;
+    uint32_t next_version;        // Next older version of the same name
+    uint32_t groups;              // Depends groups, then Conflicts groups
+    uint16_t depends_count;
+    uint16_t conflicts_count;
+    uint32_t deltas;              // First delta from an older version
+    uint32_t delta_count;
+    uint32_t reserved;
+    uint64_t size;                // Archive bytes
+    uint8_t sha256[32];           // Archive hash
+} pkg_record_t;
+
+/* "a | b": satisfied by any alternative */
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+} pkg_group_t;
+
+typedef struct {
+    uint32_t target;              // Newest record of the name, resolved at build
+    uint32_t version;             // String offset, 0 for PKG_OP_ANY
+    uint32_t op;
+} pkg_alt_t;
+
+/* "Delta: <from-version> <filename> <size> <sha256>" */
+typedef struct {
+    uint32_t from;                // String offsets
+    uint32_t filename;
+    uint64_t size;
+    uint8_t sha256[32];
+} pkg_delta_ref_t;
+
+typedef struct {
+    void* map;
+    size_t map_size;
+    const pkg_index_header_t* header;
+    const pkg_record_t* pkgs;
+    const pkg_group_t* groups;
+    const pkg_alt_t* alts;
+    const pkg_delta_ref_t* deltas;
+    const uint32_t* buckets;      // Newest record per name, open addressed
+    const char* strings;
+} pkg_index_t;
+
+int pkg_index_build(const char* packages_path, const char* index_path);
+int pkg_index_open(const char* path, pkg_index_t* index);
+void pkg_index_close(pkg_index_t* index);
+uint32_t pkg_index_find(const pkg_index_t* index, const char* name);
+bool pkg_index_match(const pkg_index_t* index, uint32_t record, pkg_op_t op, const char* version);
+int pkg_version_compare(const char* a, const char* b);
+uint32_t pkg_name_hash(const char* name);
+
+static inline uint64_t pkg_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline const char* pkg_str(const pkg_index_t* index, uint32_t offset) {
+    return index->strings + offset;
+}
+
+/* ============================================================================
+ * Installed packages
+ * ============================================================================ */
+
+typedef struct {
+    char* name;
+    char* version;
+} pkg_installed_t;
+
+/* Removed entries keep their slot with a NULL version */
+typedef struct {
+    pkg_installed_t* items;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t* slots;              // Item index + 1 by name hash, 0 = empty
+    uint32_t slot_mask;
+} pkg_db_t;
+
+int pkg_db_load(const char* path, pkg_db_t* db);
+int pkg_db_save(const char* path, const pkg_db_t* db);
+void pkg_db_free(pkg_db_t* db);
+pkg_installed_t* pkg_db_find(const pkg_db_t* db, const char* name);
+int pkg_db_set(pkg_db_t* db, const char* name, const char* version);
+void pkg_db_remove(pkg_db_t* db, const char* name);
+
+/* ============================================================================
+ * Solver
+ * ============================================================================ */
+
+typedef enum {
+    PKG_SOLVE_INSTALL,            // Requests must be installed, the rest kept
+    PKG_SOLVE_REMOVE,             // Requests must go, with whatever needs them
+    PKG_SOLVE_UPGRADE,            // Everything installed moves to its newest version
+} pkg_solve_mode_t;
+
+/* "name", "name=1.2", "name>=1.2", "name@1.2" */
+typedef struct {
+    char name[128];
+    char version[64];
+    pkg_op_t op;
+} pkg_request_t;
+
+typedef struct {
+    uint32_t* install;            // Records to install, new or at another version
+    uint32_t install_count;
+    char** remove;                // Installed names to remove
+    uint32_t remove_count;
+    uint32_t vars;
+    uint32_t clauses;
+    uint32_t learned;
+    uint32_t conflicts;
+    uint32_t decisions;
+    uint64_t solve_ns;
+    char error[256];
+} pkg_solution_t;
+
+int pkg_request_parse(const char* arg, pkg_request_t* request);
+int pkg_solve(const pkg_index_t* index, const pkg_db_t* db, pkg_solve_mode_t mode,
+              const pkg_request_t* requests, uint32_t count, pkg_solution_t* solution);
+void pkg_solution_free(pkg_solution_t* solution);
+
+/* ============================================================================
+ * Archives and the content-addressed store
+ * ============================================================================ */
+
+#define PKG_ARCHIVE_MAGIC     0x414B504C              /* "LPKA" */
+#define PKG_ARCHIVE_VERSION   1
+#define PKG_ENTRY_COMPRESSED  0x0001
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t file_count;
+    uint32_t table_size;          // Entry table bytes after this header
+} pkg_archive_header_t;
+
+/* Followed by path_len path bytes; data lives at offset from the archive start */
+typedef struct {
+    uint64_t offset;
+    uint32_t stored_size;
+    uint32_t size;
+    uint32_t mode;
+    uint16_t path_len;
+    uint16_t flags;
+    uint8_t sha256[32];           // Of the unpacked contents: the store key
+} pkg_archive_entry_t;
+
+/*
+ * Delta packages (.lpd) rebuild a version's files from the objects of an
+ * older one already in the store: header, bases, ops, files with paths,
+ * then literal data. Ops of one file run in order and cover it exactly.
+ */
+#define PKG_DELTA_MAGIC       0x444B504C              /* "LPKD" */
+#define PKG_DELTA_VERSION     1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t base_count;
+    uint32_t op_count;
+    uint32_t file_count;
+    uint32_t table_size;          // Bases, ops and files after this header
+} pkg_delta_header_t;
+
+/* A store object the ops copy from */
+typedef struct {
+    uint8_t sha256[32];
+    uint64_t size;
+    uint32_t mode;
+    uint32_t reserved;
+} pkg_delta_base_t;
+
+typedef struct {
+    uint32_t base;                // PKG_NONE for literal bytes from the delta
+    uint32_t length;              // Output bytes
+    uint64_t offset;              // Into the base object, or the delta
+    uint32_t stored_size;         // Literal bytes in the delta
+    uint32_t flags;               // PKG_ENTRY_COMPRESSED
+} pkg_delta_op_t;
+
+/* Followed by path_len path bytes */
+typedef struct {
+    uint32_t size;
+    uint32_t mode;
+    uint32_t first_op;
+    uint32_t op_count;
+    uint16_t path_len;
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint8_t sha256[32];
+} pkg_delta_file_t;
+
+/* A file to pack */
+typedef struct {
+    const char* path;             // Relative to the install root
+    const void* data;
+    size_t size;
+    uint32_t mode;
+} pkg_file_t;
+
+/* A file an installed package owns */
+typedef struct {
+    char* path;
+    uint8_t sha256[32];
+    uint32_t mode;
+} pkg_manifest_entry_t;
+
+typedef struct {
+    pkg_manifest_entry_t* entries;
+    uint32_t count;
+} pkg_manifest_t;
+
+typedef struct {
+    uint64_t archives;
+    uint64_t archive_bytes;
+    uint64_t files;
+    uint64_t bytes;               // Unpacked bytes linked into the root
+    uint64_t objects_written;
+    uint64_t objects_deduped;     // Already in the store or shared within the run
+    uint64_t failed;
+    uint64_t deltas;              // Packages rebuilt from a delta
+    uint64_t delta_saved;         // Archive bytes the deltas did not transfer
+    uint64_t delta_fallbacks;     // Files refetched from the full archive instead
+    uint64_t ns;
+} pkg_install_stats_t;
+
+void pkg_sha256(const void* data, size_t len, uint8_t hash[32]);
+void pkg_hex(const uint8_t* bytes, size_t len, char* out);
+int pkg_archive_write(const char* path, const pkg_file_t* files, uint32_t count, uint8_t sha256[32], uint64_t* size);
+int pkg_delta_write(const char* path, const pkg_file_t* old_files, uint32_t old_count,
+                    const pkg_file_t* files, uint32_t count, uint8_t sha256[32], uint64_t* size);
+bool pkg_path_safe(const char* path, size_t len);
+int pkg_install_records(const pkg_config_t* config, const pkg_index_t* index,
+                        const uint32_t* records, uint32_t count, bool* installed,
+                        pkg_install_stats_t* stats);
+int pkg_manifest_load(const char* path, pkg_manifest_t* manifest, char* version, size_t version_size);
+void pkg_manifest_free(pkg_manifest_t* manifest);
+int pkg_store_clean(const char* state_dir, uint64_t* removed, uint64_t* corrupt);
+
+/* ============================================================================
+ * Mirror transport
+ * ============================================================================ */
+
+typedef struct {
+    uint64_t requests;
+    uint64_t connects;
+    uint64_t bytes;               // Response bodies received
+    uint64_t resumed;             // Bytes a resumed download did not fetch again
+} pkg_net_stats_t;
+
+typedef struct pkg_mirror_server pkg_mirror_server_t;
+
+bool pkg_mirror_is_remote(const char* mirror);
+int pkg_net_get(const char* mirror, const char* rel, const char* dest);
+int pkg_net_read(const char* mirror, const char* rel, uint64_t offset, uint64_t length, void* buf);
+int pkg_net_fetch(const char* mirror, const char* rel, const char* dest, uint64_t size, uint32_t connections);
+void pkg_net_stats(pkg_net_stats_t* stats);
+void pkg_net_close_idle(void);
+int pkg_cache_clean(const char* state_dir, uint64_t* removed);
+
+pkg_mirror_server_t* pkg_mirror_serve(const char* dir, uint16_t port, uint16_t* bound_port);
+void pkg_mirror_set_rate(pkg_mirror_server_t* server, uint64_t bytes_per_sec);
+void pkg_mirror_stop(pkg_mirror_server_t* server);
+
+/* ============================================================================
+ * Engine
+ * ============================================================================ */
+
+typedef struct {
+    uint32_t packages;
+    uint64_t index_build_ns;
+    uint64_t solve_ns;
+    uint32_t solve_vars;
+    uint32_t solve_clauses;
+    uint32_t solve_conflicts;
+    uint64_t install_ns;
+    uint64_t install_bytes;
+    uint64_t archive_bytes;
+    uint64_t files;
+    uint64_t objects_written;
+    uint64_t objects_deduped;
+} pkg_bench_result_t;
+
+/* Full-archive against delta upgrade of one package set over the HTTP mirror */
+typedef struct {
+    uint32_t packages;
+    uint32_t upgraded;
+    uint64_t full_bytes;          // Transferred by each upgrade
+    uint64_t delta_bytes;
+    uint64_t full_ns;             // Upgrade wall clock, unthrottled
+    uint64_t delta_ns;
+    uint64_t full_ns_limited;     // Same at the throttled link rate
+    uint64_t delta_ns_limited;
+    uint64_t link_rate;           // Bytes per second
+    uint64_t deltas;
+    uint64_t delta_fallbacks;
+    uint64_t resumed_bytes;       // From an interrupted and resumed download
+    bool identical;               // Both roots ended with the same files
+} pkg_upgrade_bench_t;
+
+void pkg_configure(const pkg_config_t* config);
+int pkg_execute(const command_t* cmd);
+int pkg_benchmark(const char* dir, uint32_t packages, pkg_bench_result_t* result);
+int pkg_benchmark_upgrade(const char* dir, uint32_t packages, pkg_upgrade_bench_t* result);
+
+#endif /* LIMITLESS_PKG_H */
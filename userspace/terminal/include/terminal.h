@@ -72,6 +72,7 @@ int shim_winget(int argc, char** argv);
 int shim_npm(int argc, char** argv);
 int shim_pip(int argc, char** argv);
 int shim_cargo(int argc, char** argv);
+int shim_limitless(int argc, char** argv);
 
 /* Command parser */
 command_t* parse_command(int argc, char** argv);
@@ -6,7 +6,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "terminal.h"
+#include "pkg.h"
 
 /* Global configuration */
 static terminal_config_t config = {
@@ -25,16 +27,85 @@ static void print_usage(const char* program_name) {
     printf("  -v, --verbose   Enable verbose output\n");
     printf("  --no-color      Disable colored output\n");
     printf("  --version       Show version information\n");
+    printf("  --root DIR      Install root (default %s)\n", PKG_DEFAULT_ROOT);
+    printf("  --mirror DIR|URL  Repository mirror, a directory or http://host[:port]/path\n");
+    printf("                  (default %s)\n", PKG_DEFAULT_MIRROR);
+    printf("  --jobs N        Install pipeline workers (default: one per CPU)\n");
+    printf("  --connections N Parallel range requests per download (default 4)\n");
+    printf("  --no-delta      Always download full archives\n");
+    printf("  --pkg-serve DIR PORT  Serve a mirror directory over HTTP on 127.0.0.1\n");
+    printf("  --pkg-bench DIR N  Benchmark the package manager on N synthetic packages\n");
+    printf("  --pkg-bench-upgrade DIR N  Compare full and delta upgrades of N packages\n");
     printf("\n");
     printf("Supported Commands:\n");
     printf("  apt, yum, dnf, pacman, apk, zypper\n");
     printf("  brew, choco, winget\n");
     printf("  npm, pip, cargo\n");
+    printf("  limitless (lpm)\n");
     printf("\n");
     printf("All package manager commands are automatically translated\n");
     printf("to the native LimitlessOS package manager.\n");
 }
 
+/* Build a synthetic mirror and time indexing, solving and installing */
+static int run_pkg_bench(const char* dir, uint32_t packages) {
+    pkg_bench_result_t r;
+    if (pkg_benchmark(dir, packages, &r) < 0) {
+        terminal_print_error("Package benchmark failed\n");
+        return 1;
+    }
+
+    double install_s = (double)r.install_ns / 1e9;
+    printf("Packages:   %u\n", r.packages);
+    printf("Index:      %.2f ms to build\n", (double)r.index_build_ns / 1e6);
+    printf("Solve:      %.2f ms (%u variables, %u clauses, %u conflicts)\n",
+           (double)r.solve_ns / 1e6, r.solve_vars, r.solve_clauses, r.solve_conflicts);
+    printf("Install:    %.2f s, %.0f packages/s, %.1f MB/s unpacked (%.1f MB archives)\n",
+           install_s, install_s > 0 ? r.packages / install_s : 0.0,
+           install_s > 0 ? (double)r.install_bytes / 1e6 / install_s : 0.0, (double)r.archive_bytes / 1e6);
+    printf("Store:      %llu files, %llu objects written, %llu deduplicated\n",
+           (unsigned long long)r.files, (unsigned long long)r.objects_written,
+           (unsigned long long)r.objects_deduped);
+    return 0;
+}
+
+/* Upgrade the same package set with full archives and with deltas over loopback HTTP */
+static int run_pkg_upgrade_bench(const char* dir, uint32_t packages) {
+    pkg_upgrade_bench_t r;
+    if (pkg_benchmark_upgrade(dir, packages, &r) < 0) {
+        terminal_print_error("Upgrade benchmark failed\n");
+        return 1;
+    }
+
+    double link = (double)r.link_rate * 8 / 1e6;
+    printf("Packages:   %u, %u upgraded, %llu by delta (%llu files refetched whole)\n", r.packages, r.upgraded,
+           (unsigned long long)r.deltas, (unsigned long long)r.delta_fallbacks);
+    printf("Transfer:   %.1f MB full, %.1f MB delta, %.1f%% saved\n", (double)r.full_bytes / 1e6,
+           (double)r.delta_bytes / 1e6,
+           r.full_bytes ? 100.0 * (1.0 - (double)r.delta_bytes / (double)r.full_bytes) : 0.0);
+    printf("Loopback:   %.2f s full, %.2f s delta\n", (double)r.full_ns / 1e9, (double)r.delta_ns / 1e9);
+    printf("%.0f Mbit/s: %.2f s full, %.2f s delta\n", link, (double)r.full_ns_limited / 1e9,
+           (double)r.delta_ns_limited / 1e9);
+    printf("Resume:     %.1f MB kept from an interrupted download\n", (double)r.resumed_bytes / 1e6);
+    printf("Result:     %s\n", r.identical ? "delta and full upgrades installed identical files" : "MISMATCH");
+    return r.identical ? 0 : 1;
+}
+
+/* Serve a mirror until interrupted */
+static int run_pkg_serve(const char* dir, uint16_t port) {
+    uint16_t bound = 0;
+    pkg_mirror_server_t* server = pkg_mirror_serve(dir, port, &bound);
+    if (!server) {
+        terminal_print_error("Cannot serve the mirror\n");
+        return 1;
+    }
+    printf("Serving %s at http://127.0.0.1:%u\n", dir, bound);
+    fflush(stdout);
+    for (;;) {
+        pause();
+    }
+}
+
 /* Print version */
 static void print_version(void) {
     printf("LimitlessOS Universal Terminal v0.1.0\n");
@@ -50,8 +121,17 @@ int main(int argc, char** argv) {
         return 0;
     }
 
-    /* Parse flags */
-    for (int i = 1; i < argc; i++) {
+    /* Parse flags; the first other argument is the command */
+    pkg_config_t pkg = {
+        .root = PKG_DEFAULT_ROOT,
+        .mirror = PKG_DEFAULT_MIRROR,
+        .threads = 0,
+        .connections = 0,
+        .no_deltas = false,
+        .verbose = false,
+    };
+    int cmd_index = 0;
+    for (int i = 1; i < argc && !cmd_index; i++) {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             return 0;
@@ -68,52 +148,97 @@ int main(int argc, char** argv) {
             config.color_output = false;
             continue;
         }
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            pkg.root = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--mirror") == 0 && i + 1 < argc) {
+            pkg.mirror = argv[++i];
+            continue;
+        }
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            pkg.threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc) {
+            pkg.connections = (uint32_t)strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+        if (strcmp(argv[i], "--no-delta") == 0) {
+            pkg.no_deltas = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--pkg-serve") == 0 && i + 2 < argc) {
+            return run_pkg_serve(argv[i + 1], (uint16_t)strtoul(argv[i + 2], NULL, 10));
+        }
+        if (strcmp(argv[i], "--pkg-bench-upgrade") == 0 && i + 2 < argc) {
+            pkg.verbose = config.verbose;
+            pkg_configure(&pkg);
+            return run_pkg_upgrade_bench(argv[i + 1], (uint32_t)strtoul(argv[i + 2], NULL, 10));
+        }
+        if (strcmp(argv[i], "--pkg-bench") == 0 && i + 2 < argc) {
+            pkg.verbose = config.verbose;
+            pkg_configure(&pkg);
+            return run_pkg_bench(argv[i + 1], (uint32_t)strtoul(argv[i + 2], NULL, 10));
+        }
+        cmd_index = i;
     }
+    if (!cmd_index) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    pkg.verbose = config.verbose;
+    pkg_configure(&pkg);
 
     /* Initialize terminal */
     terminal_init();
 
     /* Determine command type */
-    const char* cmd_name = argv[1];
+    const char* cmd_name = argv[cmd_index];
+    int cmd_argc = argc - cmd_index;
+    char** cmd_argv = &argv[cmd_index];
 
     /* Route to appropriate shim */
     int result = 0;
 
     if (strcmp(cmd_name, "apt") == 0 || strcmp(cmd_name, "apt-get") == 0) {
-        result = shim_apt(argc - 1, &argv[1]);
+        result = shim_apt(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "yum") == 0) {
-        result = shim_yum(argc - 1, &argv[1]);
+        result = shim_yum(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "dnf") == 0) {
-        result = shim_dnf(argc - 1, &argv[1]);
+        result = shim_dnf(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "pacman") == 0) {
-        result = shim_pacman(argc - 1, &argv[1]);
+        result = shim_pacman(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "apk") == 0) {
-        result = shim_apk(argc - 1, &argv[1]);
+        result = shim_apk(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "zypper") == 0) {
-        result = shim_zypper(argc - 1, &argv[1]);
+        result = shim_zypper(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "brew") == 0) {
-        result = shim_brew(argc - 1, &argv[1]);
+        result = shim_brew(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "choco") == 0) {
-        result = shim_choco(argc - 1, &argv[1]);
+        result = shim_choco(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "winget") == 0) {
-        result = shim_winget(argc - 1, &argv[1]);
+        result = shim_winget(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "npm") == 0) {
-        result = shim_npm(argc - 1, &argv[1]);
+        result = shim_npm(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "pip") == 0) {
-        result = shim_pip(argc - 1, &argv[1]);
+        result = shim_pip(cmd_argc, cmd_argv);
     }
     else if (strcmp(cmd_name, "cargo") == 0) {
-        result = shim_cargo(argc - 1, &argv[1]);
+        result = shim_cargo(cmd_argc, cmd_argv);
+    }
+    else if (strcmp(cmd_name, "limitless") == 0 || strcmp(cmd_name, "lpm") == 0) {
+        result = shim_limitless(cmd_argc, cmd_argv);
     }
     else {
         terminal_print_error("Unknown command. Use --help for usage information.\n");
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "terminal.h"
+#include "pkg.h"
 
 /* Parse command line arguments into command structure */
 command_t* parse_command(int argc, char** argv) {
@@ -58,6 +59,9 @@ command_t* parse_command(int argc, char** argv) {
     else if (strcmp(prog_name, "cargo") == 0) {
         cmd->manager = PKG_MGR_CARGO;
     }
+    else if (strcmp(prog_name, "limitless") == 0 || strcmp(prog_name, "lpm") == 0) {
+        cmd->manager = PKG_MGR_LIMITLESS;
+    }
 
     /* Parse action if present */
     if (argc >= 2) {
@@ -124,11 +128,6 @@ int execute_command(command_t* cmd) {
         return 1;
     }
 
-    printf("[EXEC] Manager: %d, Type: %d, Args: %d\n",
-           cmd->manager, cmd->type, cmd->arg_count);
-
-    /* Phase 1: Stub implementation */
-    printf("[TODO] Execute package operation via native backend\n");
-
-    return 0;
+    /* Every front end runs on the native package manager */
+    return pkg_execute(cmd);
 }
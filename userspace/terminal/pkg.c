@@ -0,0 +1,1874 @@
+/*
+ * Native Package Manager
+ * Binary package index, installed database and the command front end
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "pkg.h"
+
+#define PKG_PATH_MAX          512
+
+static pkg_config_t pkg_config = {
+    .root = PKG_DEFAULT_ROOT,
+    .mirror = PKG_DEFAULT_MIRROR,
+    .threads = 0,
+    .verbose = false,
+};
+
+void pkg_configure(const pkg_config_t* config) {
+    if (config) {
+        pkg_config = *config;
+    }
+}
+
+/* ============================================================================
+ * Versions and names
+ * ============================================================================ */
+
+uint32_t pkg_name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Letters sort after digits and punctuation after letters; '~' sorts before everything */
+static int version_order(int c) {
+    if (isdigit(c)) {
+        return 0;
+    }
+    if (isalpha(c)) {
+        return c;
+    }
+    if (c == '~') {
+        return -1;
+    }
+    return c ? c + 256 : 0;
+}
+
+/* dpkg ordering: alternate non-digit runs compared by character and digit runs compared by value */
+int pkg_version_compare(const char* a, const char* b) {
+    while (*a || *b) {
+        int first_diff = 0;
+
+        while ((*a && !isdigit((uint8_t)*a)) || (*b && !isdigit((uint8_t)*b))) {
+            int ac = version_order((uint8_t)*a);
+            int bc = version_order((uint8_t)*b);
+            if (ac != bc) {
+                return ac - bc;
+            }
+            a++;
+            b++;
+        }
+        while (*a == '0') {
+            a++;
+        }
+        while (*b == '0') {
+            b++;
+        }
+        while (isdigit((uint8_t)*a) && isdigit((uint8_t)*b)) {
+            if (!first_diff) {
+                first_diff = *a - *b;
+            }
+            a++;
+            b++;
+        }
+        if (isdigit((uint8_t)*a)) {
+            return 1;
+        }
+        if (isdigit((uint8_t)*b)) {
+            return -1;
+        }
+        if (first_diff) {
+            return first_diff;
+        }
+    }
+    return 0;
+}
+
+/* ============================================================================
+ * Index builder
+ * ============================================================================ */
+
+/* Interned strings: equal strings share one offset, so names compare by offset */
+typedef struct {
+    char* data;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t* slots;              // Offsets, 0 = empty ("" is never interned)
+    uint32_t slot_mask;
+    uint32_t used;
+} strtab_t;
+
+typedef struct {
+    pkg_record_t* pkgs;
+    uint32_t pkg_count;
+    uint32_t pkg_capacity;
+    pkg_group_t* groups;
+    uint32_t group_count;
+    uint32_t group_capacity;
+    pkg_alt_t* alts;              // target holds the name offset until resolved
+    uint32_t alt_count;
+    uint32_t alt_capacity;
+    pkg_delta_ref_t* deltas;
+    uint32_t delta_count;
+    uint32_t delta_capacity;
+    strtab_t strings;
+} index_builder_t;
+
+static int grow(void** items, uint32_t* capacity, uint32_t need, size_t size) {
+    if (need <= *capacity) {
+        return 0;
+    }
+    uint32_t cap = *capacity ? *capacity : 64;
+    while (cap < need) {
+        cap *= 2;
+    }
+    void* p = realloc(*items, (size_t)cap * size);
+    if (!p) {
+        return -1;
+    }
+    *items = p;
+    *capacity = cap;
+    return 0;
+}
+
+static uint32_t hash_bytes(const char* s, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int strtab_init(strtab_t* tab) {
+    memset(tab, 0, sizeof(*tab));
+    tab->slot_mask = 4095;
+    tab->slots = calloc(tab->slot_mask + 1, sizeof(uint32_t));
+    if (!tab->slots || grow((void**)&tab->data, &tab->capacity, 4096, 1) < 0) {
+        return -1;
+    }
+    tab->data[0] = '\0';
+    tab->size = 1;
+    return 0;
+}
+
+static void strtab_free(strtab_t* tab) {
+    free(tab->data);
+    free(tab->slots);
+}
+
+static int strtab_rehash(strtab_t* tab) {
+    uint32_t mask = tab->slot_mask * 2 + 1;
+    uint32_t* slots = calloc(mask + 1, sizeof(uint32_t));
+    if (!slots) {
+        return -1;
+    }
+    for (uint32_t i = 0; i <= tab->slot_mask; i++) {
+        uint32_t off = tab->slots[i];
+        if (!off) {
+            continue;
+        }
+        uint32_t j = hash_bytes(tab->data + off, strlen(tab->data + off)) & mask;
+        while (slots[j]) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = off;
+    }
+    free(tab->slots);
+    tab->slots = slots;
+    tab->slot_mask = mask;
+    return 0;
+}
+
+/* Offset of s[0..len), adding it if new; UINT32_MAX on allocation failure */
+static uint32_t strtab_intern(strtab_t* tab, const char* s, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if ((tab->used + 1) * 2 > tab->slot_mask && strtab_rehash(tab) < 0) {
+        return UINT32_MAX;
+    }
+
+    uint32_t i = hash_bytes(s, len) & tab->slot_mask;
+    while (tab->slots[i]) {
+        const char* t = tab->data + tab->slots[i];
+        if (strncmp(t, s, len) == 0 && t[len] == '\0') {
+            return tab->slots[i];
+        }
+        i = (i + 1) & tab->slot_mask;
+    }
+
+    if (grow((void**)&tab->data, &tab->capacity, tab->size + (uint32_t)len + 1, 1) < 0) {
+        return UINT32_MAX;
+    }
+    uint32_t off = tab->size;
+    memcpy(tab->data + off, s, len);
+    tab->data[off + len] = '\0';
+    tab->size += (uint32_t)len + 1;
+    tab->slots[i] = off;
+    tab->used++;
+    return off;
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+static pkg_op_t parse_op(const char* s, size_t len) {
+    if (len == 2 && (memcmp(s, ">=", 2) == 0)) {
+        return PKG_OP_GE;
+    }
+    if (len == 2 && (memcmp(s, "<=", 2) == 0)) {
+        return PKG_OP_LE;
+    }
+    if ((len == 2 && memcmp(s, ">>", 2) == 0) || (len == 1 && *s == '>')) {
+        return PKG_OP_GT;
+    }
+    if ((len == 2 && memcmp(s, "<<", 2) == 0) || (len == 1 && *s == '<')) {
+        return PKG_OP_LT;
+    }
+    if ((len == 1 && *s == '=') || (len == 2 && memcmp(s, "==", 2) == 0)) {
+        return PKG_OP_EQ;
+    }
+    return PKG_OP_ANY;
+}
+
+/* "a (>= 1.0) | b, c" into groups of alternatives; returns the group count */
+static int parse_relations(index_builder_t* b, const char* p, const char* end) {
+    int groups = 0;
+
+    while (p < end) {
+        if (grow((void**)&b->groups, &b->group_capacity, b->group_count + 1, sizeof(pkg_group_t)) < 0) {
+            return -1;
+        }
+        pkg_group_t* group = &b->groups[b->group_count];
+        group->first = b->alt_count;
+        group->count = 0;
+
+        for (;;) {
+            p = skip_space(p, end);
+            const char* name = p;
+            while (p < end && !isspace((uint8_t)*p) && *p != ',' && *p != '|' && *p != '(') {
+                p++;
+            }
+            size_t name_len = (size_t)(p - name);
+            pkg_op_t op = PKG_OP_ANY;
+            uint32_t version = 0;
+
+            p = skip_space(p, end);
+            if (p < end && *p == '(') {
+                const char* close = memchr(p, ')', (size_t)(end - p));
+                if (!close) {
+                    return -1;
+                }
+                const char* q = skip_space(p + 1, close);
+                const char* op_start = q;
+                while (q < close && strchr("<>=", *q)) {
+                    q++;
+                }
+                op = parse_op(op_start, (size_t)(q - op_start));
+                q = skip_space(q, close);
+                const char* v_end = close;
+                while (v_end > q && isspace((uint8_t)v_end[-1])) {
+                    v_end--;
+                }
+                version = strtab_intern(&b->strings, q, (size_t)(v_end - q));
+                if (op == PKG_OP_ANY || version == 0 || version == UINT32_MAX) {
+                    return -1;
+                }
+                p = skip_space(close + 1, end);
+            }
+
+            if (name_len) {
+                if (grow((void**)&b->alts, &b->alt_capacity, b->alt_count + 1, sizeof(pkg_alt_t)) < 0) {
+                    return -1;
+                }
+                uint32_t name_off = strtab_intern(&b->strings, name, name_len);
+                if (name_off == UINT32_MAX) {
+                    return -1;
+                }
+                b->alts[b->alt_count++] = (pkg_alt_t){ .target = name_off, .version = version, .op = op };
+                group->count++;
+            }
+
+            if (p < end && *p == '|') {
+                p++;
+                continue;
+            }
+            break;
+        }
+
+        if (group->count) {
+            b->group_count++;
+            groups++;
+        }
+        if (p < end && *p == ',') {
+            p++;
+        } else if (p < end) {
+            return -1;
+        }
+    }
+    return groups;
+}
+
+static int hex_decode(const char* s, size_t len, uint8_t* out, size_t out_len) {
+    if (len != out_len * 2) {
+        return -1;
+    }
+    for (size_t i = 0; i < out_len; i++) {
+        int hi = isdigit((uint8_t)s[2 * i]) ? s[2 * i] - '0' : (tolower((uint8_t)s[2 * i]) - 'a' + 10);
+        int lo = isdigit((uint8_t)s[2 * i + 1]) ? s[2 * i + 1] - '0' : (tolower((uint8_t)s[2 * i + 1]) - 'a' + 10);
+        if (hi < 0 || hi > 15 || lo < 0 || lo > 15) {
+            return -1;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return 0;
+}
+
+/*
+ * One stanza's fields. Depends and Conflicts are parsed once the stanza
+ * ends, so a record's groups stay contiguous whatever the field order.
+ */
+typedef struct {
+    const char* name;
+    size_t name_len;
+    const char* version;
+    size_t version_len;
+    const char* filename;
+    size_t filename_len;
+    const char* depends;
+    const char* depends_end;
+    const char* conflicts;
+    const char* conflicts_end;
+    uint64_t size;
+    uint8_t sha256[32];
+    bool has_hash;
+    const char* deltas[PKG_MAX_DELTAS];
+    const char* deltas_end[PKG_MAX_DELTAS];
+    uint32_t delta_count;
+} stanza_t;
+
+/* "<from-version> <filename> <size> <sha256>" */
+static int parse_delta(index_builder_t* b, const char* p, const char* end) {
+    const char* field[4];
+    size_t len[4];
+    for (int i = 0; i < 4; i++) {
+        p = skip_space(p, end);
+        field[i] = p;
+        while (p < end && !isspace((uint8_t)*p)) {
+            p++;
+        }
+        len[i] = (size_t)(p - field[i]);
+        if (len[i] == 0) {
+            return -1;
+        }
+    }
+    if (skip_space(p, end) != end ||
+        grow((void**)&b->deltas, &b->delta_capacity, b->delta_count + 1, sizeof(pkg_delta_ref_t)) < 0) {
+        return -1;
+    }
+
+    pkg_delta_ref_t* ref = &b->deltas[b->delta_count];
+    memset(ref, 0, sizeof(*ref));
+    ref->from = strtab_intern(&b->strings, field[0], len[0]);
+    ref->filename = strtab_intern(&b->strings, field[1], len[1]);
+    ref->size = strtoull(field[2], NULL, 10);
+    if (ref->from == UINT32_MAX || ref->filename == UINT32_MAX || ref->size == 0 ||
+        hex_decode(field[3], len[3], ref->sha256, 32) < 0) {
+        return -1;
+    }
+    b->delta_count++;
+    return 0;
+}
+
+static int builder_add(index_builder_t* b, const stanza_t* st) {
+    if (!st->name || !st->version || !st->filename || !st->has_hash) {
+        return -1;
+    }
+    if (grow((void**)&b->pkgs, &b->pkg_capacity, b->pkg_count + 1, sizeof(pkg_record_t)) < 0) {
+        return -1;
+    }
+
+    pkg_record_t* rec = &b->pkgs[b->pkg_count];
+    memset(rec, 0, sizeof(*rec));
+    rec->name = strtab_intern(&b->strings, st->name, st->name_len);
+    rec->version = strtab_intern(&b->strings, st->version, st->version_len);
+    rec->filename = strtab_intern(&b->strings, st->filename, st->filename_len);
+    if (rec->name == UINT32_MAX || rec->version == UINT32_MAX || rec->filename == UINT32_MAX) {
+        return -1;
+    }
+    rec->name_hash = hash_bytes(st->name, st->name_len);
+    rec->next_version = PKG_NONE;
+    rec->size = st->size;
+    memcpy(rec->sha256, st->sha256, 32);
+
+    uint32_t first = b->group_count;
+    int depends = st->depends ? parse_relations(b, st->depends, st->depends_end) : 0;
+    int conflicts = st->conflicts ? parse_relations(b, st->conflicts, st->conflicts_end) : 0;
+    if (depends < 0 || conflicts < 0 || depends > UINT16_MAX || conflicts > UINT16_MAX) {
+        return -1;
+    }
+
+    rec->deltas = b->delta_count;
+    for (uint32_t d = 0; d < st->delta_count; d++) {
+        if (parse_delta(b, st->deltas[d], st->deltas_end[d]) < 0) {
+            return -1;
+        }
+    }
+    rec->delta_count = b->delta_count - rec->deltas;
+
+    b->pkg_count++;
+    rec->groups = first;
+    rec->depends_count = (uint16_t)depends;
+    rec->conflicts_count = (uint16_t)conflicts;
+    return 0;
+}
+
+/* Parse Debian-style stanzas: Package, Version, Depends, Conflicts, Filename, Size, SHA256, Delta */
+static int builder_parse(index_builder_t* b, const char* text, size_t len) {
+    const char* p = text;
+    const char* end = text + len;
+    stanza_t st;
+    memset(&st, 0, sizeof(st));
+    uint32_t line_no = 0;
+
+    while (p <= end) {
+        const char* eol = p < end ? memchr(p, '\n', (size_t)(end - p)) : NULL;
+        const char* line_end = eol ? eol : end;
+        line_no++;
+
+        if (line_end == p || (line_end == p + 1 && *p == '\r')) {
+            if (st.name && builder_add(b, &st) < 0) {
+                fprintf(stderr, "pkg: bad stanza ending at line %u\n", line_no);
+                return -1;
+            }
+            memset(&st, 0, sizeof(st));
+        } else if (*p != '#') {
+            const char* colon = memchr(p, ':', (size_t)(line_end - p));
+            if (!colon) {
+                fprintf(stderr, "pkg: malformed line %u\n", line_no);
+                return -1;
+            }
+            size_t key_len = (size_t)(colon - p);
+            const char* v = skip_space(colon + 1, line_end);
+            const char* v_end = line_end;
+            while (v_end > v && isspace((uint8_t)v_end[-1])) {
+                v_end--;
+            }
+            size_t v_len = (size_t)(v_end - v);
+
+            if (key_len == 7 && memcmp(p, "Package", 7) == 0) {
+                st.name = v;
+                st.name_len = v_len;
+            } else if (key_len == 7 && memcmp(p, "Version", 7) == 0) {
+                st.version = v;
+                st.version_len = v_len;
+            } else if (key_len == 8 && memcmp(p, "Filename", 8) == 0) {
+                st.filename = v;
+                st.filename_len = v_len;
+            } else if (key_len == 7 && memcmp(p, "Depends", 7) == 0) {
+                st.depends = v;
+                st.depends_end = v_end;
+            } else if (key_len == 9 && memcmp(p, "Conflicts", 9) == 0) {
+                st.conflicts = v;
+                st.conflicts_end = v_end;
+            } else if (key_len == 4 && memcmp(p, "Size", 4) == 0) {
+                st.size = strtoull(v, NULL, 10);
+            } else if (key_len == 6 && memcmp(p, "SHA256", 6) == 0) {
+                st.has_hash = hex_decode(v, v_len, st.sha256, 32) == 0;
+            } else if (key_len == 5 && memcmp(p, "Delta", 5) == 0 && st.delta_count < PKG_MAX_DELTAS) {
+                st.deltas[st.delta_count] = v;
+                st.deltas_end[st.delta_count++] = v_end;
+            }
+        }
+
+        if (!eol) {
+            break;
+        }
+        p = eol + 1;
+    }
+
+    if (st.name && builder_add(b, &st) < 0) {
+        fprintf(stderr, "pkg: bad stanza at end of index\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Hash names into buckets, chain versions newest first and resolve every alternative */
+static uint32_t* builder_link(index_builder_t* b, uint32_t* bucket_count) {
+    uint32_t count = 16;
+    while (count < b->pkg_count * 2) {
+        count *= 2;
+    }
+    uint32_t mask = count - 1;
+    uint32_t* buckets = malloc(count * sizeof(uint32_t));
+    if (!buckets) {
+        return NULL;
+    }
+    memset(buckets, 0xFF, count * sizeof(uint32_t));
+
+    for (uint32_t r = 0; r < b->pkg_count; r++) {
+        pkg_record_t* rec = &b->pkgs[r];
+        uint32_t i = rec->name_hash & mask;
+        while (buckets[i] != PKG_NONE && b->pkgs[buckets[i]].name != rec->name) {
+            i = (i + 1) & mask;
+        }
+        if (buckets[i] == PKG_NONE) {
+            buckets[i] = r;
+            continue;
+        }
+
+        const char* version = b->strings.data + rec->version;
+        uint32_t* link = &buckets[i];
+        while (*link != PKG_NONE &&
+               pkg_version_compare(b->strings.data + b->pkgs[*link].version, version) > 0) {
+            link = &b->pkgs[*link].next_version;
+        }
+        rec->next_version = *link;
+        *link = r;
+    }
+
+    for (uint32_t a = 0; a < b->alt_count; a++) {
+        pkg_alt_t* alt = &b->alts[a];
+        const char* name = b->strings.data + alt->target;
+        uint32_t i = pkg_name_hash(name) & mask;
+        while (buckets[i] != PKG_NONE && b->pkgs[buckets[i]].name != alt->target) {
+            i = (i + 1) & mask;
+        }
+        alt->target = buckets[i];
+    }
+
+    *bucket_count = count;
+    return buckets;
+}
+
+/* Empty sections have no array behind them */
+static bool write_section(FILE* out, const void* items, size_t size, uint32_t count) {
+    return count == 0 || fwrite(items, size, count, out) == count;
+}
+
+int pkg_index_build(const char* packages_path, const char* index_path) {
+    int fd = open(packages_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "pkg: cannot open %s: %s\n", packages_path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    const char* text = "";
+    if (st.st_size > 0) {
+        text = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+
+    index_builder_t b;
+    memset(&b, 0, sizeof(b));
+    uint32_t* buckets = NULL;
+    uint32_t bucket_count = 0;
+    int result = -1;
+
+    if (strtab_init(&b.strings) < 0 || builder_parse(&b, text, (size_t)st.st_size) < 0) {
+        goto out;
+    }
+    buckets = builder_link(&b, &bucket_count);
+    if (!buckets) {
+        goto out;
+    }
+
+    pkg_index_header_t header = {
+        .magic = PKG_INDEX_MAGIC,
+        .version = PKG_INDEX_VERSION,
+        .pkg_count = b.pkg_count,
+        .bucket_count = bucket_count,
+        .group_count = b.group_count,
+        .alt_count = b.alt_count,
+        .strings_size = b.strings.size,
+        .delta_count = b.delta_count,
+        .source_size = (uint64_t)st.st_size,
+        .source_mtime = (uint64_t)st.st_mtime,
+    };
+
+    /* Written beside the live index and renamed over it, so readers never see half an index */
+    char tmp[PKG_PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", index_path);
+    FILE* out = fopen(tmp, "wb");
+    if (!out) {
+        fprintf(stderr, "pkg: cannot write %s: %s\n", tmp, strerror(errno));
+        goto out;
+    }
+    bool ok = write_section(out, &header, sizeof(header), 1) &&
+              write_section(out, b.pkgs, sizeof(pkg_record_t), b.pkg_count) &&
+              write_section(out, b.deltas, sizeof(pkg_delta_ref_t), b.delta_count) &&
+              write_section(out, b.groups, sizeof(pkg_group_t), b.group_count) &&
+              write_section(out, b.alts, sizeof(pkg_alt_t), b.alt_count) &&
+              write_section(out, buckets, sizeof(uint32_t), bucket_count) &&
+              write_section(out, b.strings.data, 1, b.strings.size);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmp, index_path) < 0) {
+        unlink(tmp);
+        goto out;
+    }
+    result = 0;
+
+out:
+    if (st.st_size > 0) {
+        munmap((void*)text, (size_t)st.st_size);
+    }
+    free(buckets);
+    free(b.pkgs);
+    free(b.groups);
+    free(b.alts);
+    free(b.deltas);
+    strtab_free(&b.strings);
+    return result;
+}
+
+/* ============================================================================
+ * Index lookup
+ * ============================================================================ */
+
+int pkg_index_open(const char* path, pkg_index_t* index) {
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(pkg_index_header_t)) {
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const pkg_index_header_t* h = map;
+    uint64_t need = sizeof(*h) + (uint64_t)h->pkg_count * sizeof(pkg_record_t) +
+                    (uint64_t)h->group_count * sizeof(pkg_group_t) +
+                    (uint64_t)h->alt_count * sizeof(pkg_alt_t) +
+                    (uint64_t)h->delta_count * sizeof(pkg_delta_ref_t) +
+                    (uint64_t)h->bucket_count * sizeof(uint32_t) + h->strings_size;
+    if (h->magic != PKG_INDEX_MAGIC || h->version != PKG_INDEX_VERSION ||
+        h->bucket_count == 0 || (h->bucket_count & (h->bucket_count - 1)) ||
+        h->strings_size == 0 || need != (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    const uint8_t* p = (const uint8_t*)map + sizeof(*h);
+    index->map = map;
+    index->map_size = (size_t)st.st_size;
+    index->header = h;
+    index->pkgs = (const pkg_record_t*)p;
+    p += h->pkg_count * sizeof(pkg_record_t);
+    index->deltas = (const pkg_delta_ref_t*)p;
+    p += h->delta_count * sizeof(pkg_delta_ref_t);
+    index->groups = (const pkg_group_t*)p;
+    p += h->group_count * sizeof(pkg_group_t);
+    index->alts = (const pkg_alt_t*)p;
+    p += h->alt_count * sizeof(pkg_alt_t);
+    index->buckets = (const uint32_t*)p;
+    p += h->bucket_count * sizeof(uint32_t);
+    index->strings = (const char*)p;
+
+    if (index->strings[h->strings_size - 1] != '\0') {
+        pkg_index_close(index);
+        return -1;
+    }
+    return 0;
+}
+
+void pkg_index_close(pkg_index_t* index) {
+    if (index->map) {
+        munmap(index->map, index->map_size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+/* Newest record named name, or PKG_NONE */
+uint32_t pkg_index_find(const pkg_index_t* index, const char* name) {
+    uint32_t hash = pkg_name_hash(name);
+    uint32_t mask = index->header->bucket_count - 1;
+
+    for (uint32_t i = hash & mask; index->buckets[i] != PKG_NONE; i = (i + 1) & mask) {
+        const pkg_record_t* rec = &index->pkgs[index->buckets[i]];
+        if (rec->name_hash == hash && strcmp(pkg_str(index, rec->name), name) == 0) {
+            return index->buckets[i];
+        }
+    }
+    return PKG_NONE;
+}
+
+bool pkg_index_match(const pkg_index_t* index, uint32_t record, pkg_op_t op, const char* version) {
+    if (op == PKG_OP_ANY) {
+        return true;
+    }
+    int cmp = pkg_version_compare(pkg_str(index, index->pkgs[record].version), version);
+    switch (op) {
+    case PKG_OP_EQ: return cmp == 0;
+    case PKG_OP_LT: return cmp < 0;
+    case PKG_OP_LE: return cmp <= 0;
+    case PKG_OP_GT: return cmp > 0;
+    case PKG_OP_GE: return cmp >= 0;
+    default: return true;
+    }
+}
+
+/* ============================================================================
+ * Installed database
+ * ============================================================================ */
+
+static int db_rehash(pkg_db_t* db, uint32_t mask) {
+    uint32_t* slots = calloc(mask + 1, sizeof(uint32_t));
+    if (!slots) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < db->count; i++) {
+        uint32_t j = pkg_name_hash(db->items[i].name) & mask;
+        while (slots[j]) {
+            j = (j + 1) & mask;
+        }
+        slots[j] = i + 1;
+    }
+    free(db->slots);
+    db->slots = slots;
+    db->slot_mask = mask;
+    return 0;
+}
+
+static pkg_installed_t* db_lookup(const pkg_db_t* db, const char* name) {
+    if (!db->slots) {
+        return NULL;
+    }
+    for (uint32_t i = pkg_name_hash(name) & db->slot_mask; db->slots[i]; i = (i + 1) & db->slot_mask) {
+        pkg_installed_t* item = &db->items[db->slots[i] - 1];
+        if (strcmp(item->name, name) == 0) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+pkg_installed_t* pkg_db_find(const pkg_db_t* db, const char* name) {
+    pkg_installed_t* item = db_lookup(db, name);
+    return item && item->version ? item : NULL;
+}
+
+int pkg_db_set(pkg_db_t* db, const char* name, const char* version) {
+    char* copy = strdup(version);
+    if (!copy) {
+        return -1;
+    }
+
+    pkg_installed_t* item = db_lookup(db, name);
+    if (item) {
+        free(item->version);
+        item->version = copy;
+        return 0;
+    }
+
+    if ((db->count + 1) * 2 > db->slot_mask && db_rehash(db, db->slot_mask ? db->slot_mask * 2 + 1 : 255) < 0) {
+        free(copy);
+        return -1;
+    }
+    if (grow((void**)&db->items, &db->capacity, db->count + 1, sizeof(pkg_installed_t)) < 0 ||
+        !(db->items[db->count].name = strdup(name))) {
+        free(copy);
+        return -1;
+    }
+    db->items[db->count].version = copy;
+
+    uint32_t i = pkg_name_hash(name) & db->slot_mask;
+    while (db->slots[i]) {
+        i = (i + 1) & db->slot_mask;
+    }
+    db->slots[i] = ++db->count;
+    return 0;
+}
+
+void pkg_db_remove(pkg_db_t* db, const char* name) {
+    pkg_installed_t* item = db_lookup(db, name);
+    if (item) {
+        free(item->version);
+        item->version = NULL;
+    }
+}
+
+/* "name version" per line; a missing file is an empty database */
+int pkg_db_load(const char* path, pkg_db_t* db) {
+    memset(db, 0, sizeof(*db));
+    if (db_rehash(db, 255) < 0) {
+        return -1;
+    }
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    char line[512];
+    int result = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char name[256];
+        char version[128];
+        if (sscanf(line, "%255s %127s", name, version) == 2 && pkg_db_set(db, name, version) < 0) {
+            result = -1;
+            break;
+        }
+    }
+    fclose(f);
+    return result;
+}
+
+int pkg_db_save(const char* path, const pkg_db_t* db) {
+    char tmp[PKG_PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < db->count; i++) {
+        if (db->items[i].version) {
+            fprintf(f, "%s %s\n", db->items[i].name, db->items[i].version);
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void pkg_db_free(pkg_db_t* db) {
+    for (uint32_t i = 0; i < db->count; i++) {
+        free(db->items[i].name);
+        free(db->items[i].version);
+    }
+    free(db->items);
+    free(db->slots);
+    memset(db, 0, sizeof(*db));
+}
+
+/* ============================================================================
+ * Commands
+ * ============================================================================ */
+
+static void state_path(const pkg_config_t* config, char* out, size_t size, const char* leaf) {
+    snprintf(out, size, "%s/%s%s%s", config->root, PKG_STATE_DIR, leaf ? "/" : "", leaf ? leaf : "");
+}
+
+static int make_dirs(const char* path) {
+    char buf[PKG_PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", path);
+    for (char* p = buf + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, 0755) < 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    return (mkdir(buf, 0755) < 0 && errno != EEXIST) ? -1 : 0;
+}
+
+/*
+ * Open the binary index, rebuilding it first if the Packages file changed.
+ * A remote mirror's Packages is downloaded by "update", or when missing.
+ */
+static int open_index(const pkg_config_t* config, pkg_index_t* index, bool force, uint64_t* build_ns) {
+    char packages[PKG_PATH_MAX];
+    char path[PKG_PATH_MAX];
+    char state[PKG_PATH_MAX];
+    struct stat st;
+
+    state_path(config, state, sizeof(state), NULL);
+    state_path(config, path, sizeof(path), "index.bin");
+    if (pkg_mirror_is_remote(config->mirror)) {
+        char lists[PKG_PATH_MAX];
+        state_path(config, lists, sizeof(lists), "lists");
+        state_path(config, packages, sizeof(packages), "lists/Packages");
+        if ((force || stat(packages, &st) < 0) &&
+            (make_dirs(lists) < 0 || pkg_net_get(config->mirror, "Packages", packages) < 0)) {
+            fprintf(stderr, "pkg: cannot fetch Packages from %s\n", config->mirror);
+            return -1;
+        }
+    } else {
+        snprintf(packages, sizeof(packages), "%s/Packages", config->mirror);
+    }
+    if (stat(packages, &st) < 0) {
+        fprintf(stderr, "pkg: no Packages file in mirror %s\n", config->mirror);
+        return -1;
+    }
+
+    if (!force && pkg_index_open(path, index) == 0) {
+        if (index->header->source_size == (uint64_t)st.st_size &&
+            index->header->source_mtime == (uint64_t)st.st_mtime) {
+            return 0;
+        }
+        pkg_index_close(index);
+    }
+
+    uint64_t start = pkg_now_ns();
+    if (make_dirs(state) < 0 || pkg_index_build(packages, path) < 0 || pkg_index_open(path, index) < 0) {
+        fprintf(stderr, "pkg: failed to build the package index\n");
+        return -1;
+    }
+    if (build_ns) {
+        *build_ns = pkg_now_ns() - start;
+    }
+    return 0;
+}
+
+int pkg_request_parse(const char* arg, pkg_request_t* request) {
+    memset(request, 0, sizeof(*request));
+
+    size_t name_len = strcspn(arg, "<>=@");
+    const char* rest = arg + name_len;
+    size_t op_len = strspn(rest, "<>=@");
+    const char* version = rest + op_len;
+
+    if (name_len == 0 || name_len >= sizeof(request->name) || strlen(version) >= sizeof(request->version)) {
+        return -1;
+    }
+    memcpy(request->name, arg, name_len);
+
+    if (op_len == 0) {
+        request->op = PKG_OP_ANY;
+        return 0;
+    }
+    request->op = (op_len == 1 && *rest == '@') ? PKG_OP_EQ : parse_op(rest, op_len);
+    if (request->op == PKG_OP_ANY || *version == '\0') {
+        return -1;
+    }
+    strcpy(request->version, version);
+    return 0;
+}
+
+/* Unlink every file a package owns and forget it */
+static void remove_package(const pkg_config_t* config, const char* name) {
+    char list[PKG_PATH_MAX];
+    char leaf[300];
+    pkg_manifest_t manifest;
+
+    snprintf(leaf, sizeof(leaf), "info/%s.list", name);
+    state_path(config, list, sizeof(list), leaf);
+    if (pkg_manifest_load(list, &manifest, NULL, 0) == 0) {
+        for (uint32_t i = 0; i < manifest.count; i++) {
+            char path[PKG_PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", config->root, manifest.entries[i].path);
+            unlink(path);
+        }
+        pkg_manifest_free(&manifest);
+    }
+    unlink(list);
+}
+
+/* Solve, remove and install, keeping the installed database in step */
+static int run_transaction(const pkg_config_t* config, pkg_solve_mode_t mode, const pkg_request_t* requests,
+                           uint32_t count, bool report, pkg_install_stats_t* stats) {
+    char db_path[PKG_PATH_MAX];
+    pkg_index_t index;
+    pkg_db_t db;
+    pkg_solution_t solution;
+    int result = 1;
+
+    memset(stats, 0, sizeof(*stats));
+    state_path(config, db_path, sizeof(db_path), "installed");
+    if (open_index(config, &index, false, NULL) < 0) {
+        return 1;
+    }
+    if (pkg_db_load(db_path, &db) < 0) {
+        fprintf(stderr, "pkg: cannot read %s\n", db_path);
+        pkg_index_close(&index);
+        return 1;
+    }
+
+    if (pkg_solve(&index, &db, mode, requests, count, &solution) < 0) {
+        fprintf(stderr, "pkg: %s\n", solution.error);
+        goto out;
+    }
+    if (config->verbose) {
+        printf("Solved %u variables, %u clauses (%u learned, %u conflicts) in %.2f ms\n",
+               solution.vars, solution.clauses, solution.learned, solution.conflicts,
+               (double)solution.solve_ns / 1e6);
+    }
+    if (solution.install_count == 0 && solution.remove_count == 0) {
+        if (report) {
+            printf("Nothing to do.\n");
+        }
+        result = 0;
+        goto out;
+    }
+
+    for (uint32_t i = 0; i < solution.remove_count; i++) {
+        if (report) {
+            printf("Removing %s\n", solution.remove[i]);
+        }
+        remove_package(config, solution.remove[i]);
+        pkg_db_remove(&db, solution.remove[i]);
+    }
+
+    result = 0;
+    if (solution.install_count) {
+        bool* installed = calloc(solution.install_count, sizeof(bool));
+        if (!installed) {
+            result = 1;
+            goto save;
+        }
+        if (pkg_install_records(config, &index, solution.install, solution.install_count, installed, stats) < 0) {
+            result = 1;
+        }
+        for (uint32_t i = 0; i < solution.install_count; i++) {
+            const pkg_record_t* rec = &index.pkgs[solution.install[i]];
+            if (!installed[i]) {
+                fprintf(stderr, "pkg: failed to install %s %s\n", pkg_str(&index, rec->name), pkg_str(&index, rec->version));
+                result = 1;
+                continue;
+            }
+            if (config->verbose) {
+                printf("Installed %s %s\n", pkg_str(&index, rec->name), pkg_str(&index, rec->version));
+            }
+            if (pkg_db_set(&db, pkg_str(&index, rec->name), pkg_str(&index, rec->version)) < 0) {
+                result = 1;
+            }
+        }
+        free(installed);
+    }
+
+save:
+    if (pkg_db_save(db_path, &db) < 0) {
+        fprintf(stderr, "pkg: cannot write %s\n", db_path);
+        result = 1;
+    }
+
+out:
+    pkg_solution_free(&solution);
+    pkg_db_free(&db);
+    pkg_index_close(&index);
+    return result;
+}
+
+static int cmd_transaction(const pkg_config_t* config, pkg_solve_mode_t mode, const command_t* cmd) {
+    if (mode != PKG_SOLVE_UPGRADE && cmd->arg_count == 0) {
+        fprintf(stderr, "pkg: no packages given\n");
+        return 1;
+    }
+
+    pkg_request_t* requests = calloc((size_t)cmd->arg_count + 1, sizeof(pkg_request_t));
+    if (!requests) {
+        return 1;
+    }
+    uint32_t count = 0;
+    for (int i = 0; i < cmd->arg_count; i++) {
+        if (cmd->args[i][0] == '-') {
+            continue;
+        }
+        if (pkg_request_parse(cmd->args[i], &requests[count]) < 0) {
+            fprintf(stderr, "pkg: bad package spec '%s'\n", cmd->args[i]);
+            free(requests);
+            return 1;
+        }
+        count++;
+    }
+
+    pkg_install_stats_t stats;
+    int result = run_transaction(config, mode, requests, count, true, &stats);
+    if (stats.archives) {
+        double secs = (double)stats.ns / 1e9;
+        printf("%llu packages, %llu files, %.1f MB in %.2f s (%.1f MB/s); %llu objects written, %llu deduplicated\n",
+               (unsigned long long)(stats.archives - stats.failed), (unsigned long long)stats.files,
+               (double)stats.bytes / 1e6, secs, secs > 0 ? (double)stats.bytes / 1e6 / secs : 0.0,
+               (unsigned long long)stats.objects_written, (unsigned long long)stats.objects_deduped);
+        if (stats.deltas) {
+            printf("%llu deltas: %.1f MB fetched, %.1f MB saved", (unsigned long long)stats.deltas,
+                   (double)stats.archive_bytes / 1e6, (double)stats.delta_saved / 1e6);
+            if (stats.delta_fallbacks) {
+                printf(", %llu files from full archives", (unsigned long long)stats.delta_fallbacks);
+            }
+            printf("\n");
+        }
+    }
+    free(requests);
+    return result;
+}
+
+static void print_relations(const pkg_index_t* index, uint32_t first, uint32_t count) {
+    static const char* ops[] = { "", "=", "<<", "<=", ">>", ">=" };
+    for (uint32_t g = first; g < first + count; g++) {
+        const pkg_group_t* group = &index->groups[g];
+        printf("%s", g == first ? "" : ", ");
+        for (uint32_t a = group->first; a < group->first + group->count; a++) {
+            const pkg_alt_t* alt = &index->alts[a];
+            const char* name = alt->target != PKG_NONE ? pkg_str(index, index->pkgs[alt->target].name) : "?";
+            printf("%s%s", a == group->first ? "" : " | ", name);
+            if (alt->op != PKG_OP_ANY) {
+                printf(" (%s %s)", ops[alt->op], pkg_str(index, alt->version));
+            }
+        }
+    }
+    printf("\n");
+}
+
+static int cmd_query(const pkg_config_t* config, const command_t* cmd) {
+    pkg_index_t index;
+    pkg_db_t db;
+    char db_path[PKG_PATH_MAX];
+
+    if (open_index(config, &index, false, NULL) < 0) {
+        return 1;
+    }
+    state_path(config, db_path, sizeof(db_path), "installed");
+    if (pkg_db_load(db_path, &db) < 0) {
+        pkg_index_close(&index);
+        return 1;
+    }
+
+    int result = 0;
+    if (cmd->type == CMD_TYPE_SEARCH) {
+        const char* term = cmd->arg_count ? cmd->args[0] : "";
+        uint32_t hits = 0;
+        for (uint32_t i = 0; i < index.header->bucket_count; i++) {
+            if (index.buckets[i] == PKG_NONE) {
+                continue;
+            }
+            const pkg_record_t* rec = &index.pkgs[index.buckets[i]];
+            const char* name = pkg_str(&index, rec->name);
+            if (strstr(name, term)) {
+                pkg_installed_t* item = pkg_db_find(&db, name);
+                printf("%s %s", name, pkg_str(&index, rec->version));
+                if (item) {
+                    printf(" [installed %s]", item->version);
+                }
+                printf("\n");
+                hits++;
+            }
+        }
+        if (!hits) {
+            printf("No packages match '%s'.\n", term);
+        }
+    } else {
+        for (int i = 0; i < cmd->arg_count; i++) {
+            uint32_t r = pkg_index_find(&index, cmd->args[i]);
+            if (r == PKG_NONE) {
+                fprintf(stderr, "pkg: unknown package %s\n", cmd->args[i]);
+                result = 1;
+                continue;
+            }
+            const pkg_record_t* rec = &index.pkgs[r];
+            pkg_installed_t* item = pkg_db_find(&db, cmd->args[i]);
+            printf("Package: %s\n", pkg_str(&index, rec->name));
+            printf("Versions:");
+            for (uint32_t v = r; v != PKG_NONE; v = index.pkgs[v].next_version) {
+                printf(" %s", pkg_str(&index, index.pkgs[v].version));
+            }
+            printf("\nInstalled: %s\n", item ? item->version : "no");
+            if (rec->depends_count) {
+                printf("Depends: ");
+                print_relations(&index, rec->groups, rec->depends_count);
+            }
+            if (rec->conflicts_count) {
+                printf("Conflicts: ");
+                print_relations(&index, rec->groups + rec->depends_count, rec->conflicts_count);
+            }
+            for (uint32_t d = 0; d < rec->delta_count; d++) {
+                const pkg_delta_ref_t* ref = &index.deltas[rec->deltas + d];
+                printf("Delta: from %s, %llu bytes\n", pkg_str(&index, ref->from), (unsigned long long)ref->size);
+            }
+            printf("Size: %llu\n\n", (unsigned long long)rec->size);
+        }
+    }
+
+    pkg_db_free(&db);
+    pkg_index_close(&index);
+    return result;
+}
+
+static int compare_installed(const void* a, const void* b) {
+    return strcmp(((const pkg_installed_t*)a)->name, ((const pkg_installed_t*)b)->name);
+}
+
+static int cmd_list(const pkg_config_t* config) {
+    pkg_db_t db;
+    char db_path[PKG_PATH_MAX];
+
+    state_path(config, db_path, sizeof(db_path), "installed");
+    if (pkg_db_load(db_path, &db) < 0) {
+        return 1;
+    }
+    pkg_installed_t* items = malloc((db.count + 1) * sizeof(pkg_installed_t));
+    uint32_t n = 0;
+    for (uint32_t i = 0; items && i < db.count; i++) {
+        if (db.items[i].version) {
+            items[n++] = db.items[i];
+        }
+    }
+    if (items) {
+        qsort(items, n, sizeof(pkg_installed_t), compare_installed);
+        for (uint32_t i = 0; i < n; i++) {
+            printf("%s %s\n", items[i].name, items[i].version);
+        }
+        free(items);
+    }
+    pkg_db_free(&db);
+    return items ? 0 : 1;
+}
+
+int pkg_execute(const command_t* cmd) {
+    const pkg_config_t* config = &pkg_config;
+    pkg_index_t index;
+    uint64_t build_ns = 0;
+    char state[PKG_PATH_MAX];
+    uint64_t removed = 0;
+    uint64_t corrupt = 0;
+
+    switch (cmd->type) {
+    case CMD_TYPE_UPDATE:
+        if (open_index(config, &index, true, &build_ns) < 0) {
+            return 1;
+        }
+        printf("Indexed %u packages in %.2f ms\n", index.header->pkg_count, (double)build_ns / 1e6);
+        pkg_index_close(&index);
+        return 0;
+    case CMD_TYPE_INSTALL:
+        return cmd_transaction(config, PKG_SOLVE_INSTALL, cmd);
+    case CMD_TYPE_REMOVE:
+        return cmd_transaction(config, PKG_SOLVE_REMOVE, cmd);
+    case CMD_TYPE_UPGRADE:
+        return cmd_transaction(config, PKG_SOLVE_UPGRADE, cmd);
+    case CMD_TYPE_SEARCH:
+    case CMD_TYPE_INFO:
+        return cmd_query(config, cmd);
+    case CMD_TYPE_LIST:
+        return cmd_list(config);
+    case CMD_TYPE_CLEAN:
+        state_path(config, state, sizeof(state), NULL);
+        if (pkg_store_clean(state, &removed, &corrupt) < 0) {
+            return 1;
+        }
+        printf("Removed %llu unreferenced store objects\n", (unsigned long long)removed);
+        if (corrupt) {
+            printf("Removed %llu modified store objects; reinstall the packages using them\n",
+                   (unsigned long long)corrupt);
+        }
+        if (pkg_cache_clean(state, &removed) < 0) {
+            return 1;
+        }
+        if (removed) {
+            printf("Removed %llu cached downloads\n", (unsigned long long)removed);
+        }
+        return 0;
+    default:
+        fprintf(stderr, "pkg: unsupported command\n");
+        return 1;
+    }
+}
+
+/* ============================================================================
+ * Benchmark
+ * ============================================================================ */
+
+/* Text-like contents so the archives compress the way real packages do */
+static void bench_fill(char* buf, size_t len, uint32_t seed) {
+    static const char* words[] = {
+        "static ", "int ", "return ", "struct ", "void ", "const ", "char* ", "uint32_t ",
+        "if (", ") {\n", "}\n", "for (", "; ", "= ", "NULL", "0;\n",
+    };
+    size_t n = 0;
+    while (n < len) {
+        seed = seed * 1103515245u + 12345u;
+        const char* w = (seed >> 16) % 7 == 0 ? "x_" : words[(seed >> 16) % 16];
+        size_t wl = strlen(w);
+        if (wl > len - n) {
+            wl = len - n;
+        }
+        memcpy(buf + n, w, wl);
+        n += wl;
+        if (n < len && (seed >> 8) % 5 == 0) {
+            buf[n++] = (char)('a' + (seed >> 20) % 26);
+        }
+    }
+}
+
+/*
+ * Generate a mirror of synthetic packages under dir: each depends on a few
+ * older ones, some through alternatives or version bounds, one in ten has
+ * two versions, and every package ships a license file shared with all the
+ * others. Then index, solve for all of them at once and install the lot.
+ */
+int pkg_benchmark(const char* dir, uint32_t packages, pkg_bench_result_t* result) {
+    char mirror[PKG_PATH_MAX];
+    char pool[PKG_PATH_MAX];
+    char root[PKG_PATH_MAX];
+    char path[PKG_PATH_MAX];
+    static const char license[] = "Permission is hereby granted, free of charge, to any person obtaining a copy\n";
+
+    memset(result, 0, sizeof(*result));
+    if (packages == 0) {
+        return -1;
+    }
+    snprintf(mirror, sizeof(mirror), "%s/mirror", dir);
+    snprintf(pool, sizeof(pool), "%s/mirror/pool", dir);
+    snprintf(root, sizeof(root), "%s/root", dir);
+    if (make_dirs(pool) < 0 || make_dirs(root) < 0) {
+        return -1;
+    }
+
+    if (snprintf(path, sizeof(path), "%s/Packages", mirror) >= (int)sizeof(path)) {
+        return -1;
+    }
+    FILE* index_text = fopen(path, "w");
+    char* data = malloc(3 * 16384);
+    if (!index_text || !data) {
+        if (index_text) {
+            fclose(index_text);
+        }
+        free(data);
+        return -1;
+    }
+
+    uint32_t seed = 42;
+    for (uint32_t i = 0; i < packages; i++) {
+        uint32_t versions = (i % 10 == 3) ? 2 : 1;
+        for (uint32_t v = 0; v < versions; v++) {
+            char name[32];
+            char version[16];
+            char bin[64];
+            char doc[64];
+            char filename[96];
+            snprintf(name, sizeof(name), "pkg%05u", i);
+            snprintf(version, sizeof(version), "1.%u", v);
+            snprintf(bin, sizeof(bin), "usr/bin/%s", name);
+            snprintf(doc, sizeof(doc), "usr/share/doc/%s/README", name);
+            snprintf(filename, sizeof(filename), "pool/%s_%s.lpk", name, version);
+
+            seed = seed * 1103515245u + 12345u;
+            size_t bin_size = 2048 + (seed >> 16) % 8192;
+            size_t doc_size = 512 + (seed >> 8) % 2048;
+            bench_fill(data, bin_size, seed + v);
+            bench_fill(data + bin_size, doc_size, ~seed);
+
+            pkg_file_t files[3] = {
+                { bin, data, bin_size, 0755 },
+                { doc, data + bin_size, doc_size, 0644 },
+                { "usr/share/licenses/COPYING", license, sizeof(license) - 1, 0644 },
+            };
+            uint8_t hash[32];
+            char hex[65];
+            uint64_t size = 0;
+            if (snprintf(path, sizeof(path), "%s/%s", mirror, filename) >= (int)sizeof(path) ||
+                pkg_archive_write(path, files, 3, hash, &size) < 0) {
+                fclose(index_text);
+                free(data);
+                return -1;
+            }
+            pkg_hex(hash, 32, hex);
+
+            fprintf(index_text, "Package: %s\nVersion: %s\n", name, version);
+            if (i > 0) {
+                uint32_t deps = 1 + (seed >> 4) % 3;
+                fprintf(index_text, "Depends: ");
+                for (uint32_t d = 0; d < deps; d++) {
+                    uint32_t a = (seed >> (3 * d)) % i;
+                    uint32_t b = (seed >> (3 * d + 7)) % i;
+                    fprintf(index_text, "%spkg%05u", d ? ", " : "", a);
+                    if (d == 1) {
+                        fprintf(index_text, " | pkg%05u", b);
+                    } else if (d == 2 && a % 10 == 3) {
+                        fprintf(index_text, " (>= 1.1)");
+                    }
+                }
+                fprintf(index_text, "\n");
+            }
+            if (v == 0 && i > 13 && (seed >> 12) % 50 == 0) {
+                fprintf(index_text, "Conflicts: pkg%05u (<< 1.1)\n", ((seed >> 2) % (i / 10)) * 10 + 3);
+            }
+            fprintf(index_text, "Filename: %s\nSize: %llu\nSHA256: %s\n\n", filename, (unsigned long long)size, hex);
+        }
+    }
+    free(data);
+    if (fclose(index_text) != 0) {
+        return -1;
+    }
+
+    pkg_config_t config = pkg_config;
+    config.root = root;
+    config.mirror = mirror;
+
+    pkg_index_t index;
+    if (open_index(&config, &index, true, &result->index_build_ns) < 0) {
+        return -1;
+    }
+
+    /* Ask for every package: the solver sees the whole index at once */
+    pkg_request_t* requests = calloc(packages, sizeof(pkg_request_t));
+    pkg_db_t db;
+    pkg_solution_t solution;
+    char db_path[PKG_PATH_MAX];
+    int status = -1;
+
+    state_path(&config, db_path, sizeof(db_path), "installed");
+    if (!requests || pkg_db_load(db_path, &db) < 0) {
+        free(requests);
+        pkg_index_close(&index);
+        return -1;
+    }
+    for (uint32_t i = 0; i < packages; i++) {
+        snprintf(requests[i].name, sizeof(requests[i].name), "pkg%05u", i);
+    }
+
+    if (pkg_solve(&index, &db, PKG_SOLVE_INSTALL, requests, packages, &solution) < 0) {
+        fprintf(stderr, "pkg: benchmark solve failed: %s\n", solution.error);
+        goto out;
+    }
+    result->packages = solution.install_count;
+    result->solve_ns = solution.solve_ns;
+    result->solve_vars = solution.vars;
+    result->solve_clauses = solution.clauses;
+    result->solve_conflicts = solution.conflicts;
+
+    bool* installed = calloc(solution.install_count, sizeof(bool));
+    pkg_install_stats_t stats;
+    if (installed && pkg_install_records(&config, &index, solution.install, solution.install_count, installed, &stats) == 0) {
+        result->install_ns = stats.ns;
+        result->install_bytes = stats.bytes;
+        result->archive_bytes = stats.archive_bytes;
+        result->files = stats.files;
+        result->objects_written = stats.objects_written;
+        result->objects_deduped = stats.objects_deduped;
+        status = 0;
+    }
+    free(installed);
+
+out:
+    pkg_solution_free(&solution);
+    pkg_db_free(&db);
+    pkg_index_close(&index);
+    free(requests);
+    return status;
+}
+
+/* ============================================================================
+ * Upgrade benchmark
+ * ============================================================================ */
+
+#define UPGRADE_LINK_RATE     12500000ULL     /* 100 Mbit/s */
+#define UPGRADE_FILES_MAX     5
+
+typedef struct {
+    pkg_file_t files[UPGRADE_FILES_MAX];
+    char paths[UPGRADE_FILES_MAX][64];
+    uint8_t* data[UPGRADE_FILES_MAX];
+    uint32_t count;
+} bench_version_t;
+
+static uint32_t bench_rand(uint32_t* seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+/* Text with a constant every few dozen bytes, so it compresses about as well as machine code */
+static void bench_binary(uint8_t* buf, size_t len, uint32_t seed) {
+    bench_fill((char*)buf, len, seed);
+    for (size_t i = 0; i + 4 <= len; i += 16 + bench_rand(&seed) % 32) {
+        uint32_t word = bench_rand(&seed);
+        memcpy(buf + i, &word, 4);
+    }
+}
+
+static int bench_add(bench_version_t* v, const char* path, size_t size, uint32_t mode) {
+    uint32_t n = v->count;
+    v->data[n] = malloc(size ? size : 1);
+    if (!v->data[n]) {
+        return -1;
+    }
+    snprintf(v->paths[n], sizeof(v->paths[n]), "%s", path);
+    v->files[n] = (pkg_file_t){ v->paths[n], v->data[n], size, mode };
+    v->count++;
+    return 0;
+}
+
+static void bench_version_free(bench_version_t* v) {
+    for (uint32_t i = 0; i < v->count; i++) {
+        free(v->data[i]);
+    }
+    v->count = 0;
+}
+
+/* A rebuilt binary: a few patched spans and insertions, more the larger it is */
+static int bench_edit(bench_version_t* v, const pkg_file_t* old, uint32_t* seed) {
+    uint32_t edits = 1 + (uint32_t)(old->size / (128 * 1024));
+    if (bench_add(v, old->path, old->size + edits * 256, old->mode) < 0) {
+        return -1;
+    }
+    uint8_t* out = v->data[v->count - 1];
+    const uint8_t* in = old->data;
+    size_t out_len = 0;
+    size_t pos = 0;
+    for (uint32_t e = 0; e < edits; e++) {
+        size_t at = pos + bench_rand(seed) % ((old->size - pos) / (edits - e) + 1);
+        memcpy(out + out_len, in + pos, at - pos);
+        out_len += at - pos;
+        pos = at;
+        size_t n = 16 + bench_rand(seed) % 240;
+        bench_binary(out + out_len, n, bench_rand(seed));
+        out_len += n;
+        if (bench_rand(seed) % 10 < 7) {
+            pos += n < old->size - pos ? n : old->size - pos;   /* Patched in place */
+        }
+    }
+    memcpy(out + out_len, in + pos, old->size - pos);
+    v->files[v->count - 1].size = out_len + old->size - pos;
+    return 0;
+}
+
+/* Version 1.0 of package i, and its 2.0 when next is given */
+static int bench_package(uint32_t i, bench_version_t* v1, bench_version_t* v2) {
+    static const char license[] = "Permission is hereby granted, free of charge, to any person obtaining a copy\n";
+    uint32_t seed = 0x5EED0000u + i * 7919u;
+    char path[64];
+
+    memset(v1, 0, sizeof(*v1));
+    snprintf(path, sizeof(path), "usr/bin/pkg%05u", i);
+    size_t bin = (16384u << (bench_rand(&seed) % 7)) + bench_rand(&seed) % 16384;
+    if (bench_add(v1, path, bin, 0755) < 0) {
+        return -1;
+    }
+    bench_binary(v1->data[0], bin, bench_rand(&seed));
+    if (i % 3 == 0) {
+        snprintf(path, sizeof(path), "usr/lib/libpkg%05u.so", i);
+        size_t lib = 65536 + bench_rand(&seed) % 196608;
+        if (bench_add(v1, path, lib, 0755) < 0) {
+            return -1;
+        }
+        bench_binary(v1->data[v1->count - 1], lib, bench_rand(&seed));
+    }
+    snprintf(path, sizeof(path), "usr/share/doc/pkg%05u/README", i);
+    size_t doc = 1024 + bench_rand(&seed) % 7168;
+    if (bench_add(v1, path, doc, 0644) < 0) {
+        return -1;
+    }
+    bench_fill((char*)v1->data[v1->count - 1], doc, bench_rand(&seed));
+    if (bench_add(v1, "usr/share/licenses/COPYING", sizeof(license) - 1, 0644) < 0) {
+        return -1;
+    }
+    memcpy(v1->data[v1->count - 1], license, sizeof(license) - 1);
+    if (!v2) {
+        return 0;
+    }
+
+    /* Binaries rebuilt, documentation appended to, the license untouched, sometimes a new file */
+    memset(v2, 0, sizeof(*v2));
+    for (uint32_t f = 0; f < v1->count; f++) {
+        const pkg_file_t* old = &v1->files[f];
+        int rc;
+        if (old->mode & 0111) {
+            rc = bench_edit(v2, old, &seed);
+        } else if (strstr(old->path, "README")) {
+            static const char note[] = "\nChanges in 2.0: fixes and performance improvements.\n";
+            rc = bench_add(v2, old->path, old->size + sizeof(note) - 1, old->mode);
+            if (rc == 0) {
+                memcpy(v2->data[v2->count - 1], old->data, old->size);
+                memcpy(v2->data[v2->count - 1] + old->size, note, sizeof(note) - 1);
+            }
+        } else {
+            rc = bench_add(v2, old->path, old->size, old->mode);
+            if (rc == 0) {
+                memcpy(v2->data[v2->count - 1], old->data, old->size);
+            }
+        }
+        if (rc < 0) {
+            return -1;
+        }
+    }
+    if (bench_rand(&seed) % 10 == 0) {
+        snprintf(path, sizeof(path), "usr/share/pkg%05u/data.bin", i);
+        size_t size = 4096 + bench_rand(&seed) % 28672;
+        if (bench_add(v2, path, size, 0644) < 0) {
+            return -1;
+        }
+        bench_binary(v2->data[v2->count - 1], size, bench_rand(&seed));
+    }
+    return 0;
+}
+
+static int bench_write(FILE* index_text, const char* mirror, const char* filename, const char* name,
+                       const char* version, const bench_version_t* v, const char* delta_line) {
+    char path[PKG_PATH_MAX];
+    char hex[65];
+    uint8_t hash[32];
+    uint64_t size = 0;
+    if (snprintf(path, sizeof(path), "%s/%s", mirror, filename) >= (int)sizeof(path) ||
+        pkg_archive_write(path, v->files, v->count, hash, &size) < 0) {
+        return -1;
+    }
+    pkg_hex(hash, 32, hex);
+    fprintf(index_text, "Package: %s\nVersion: %s\n%sFilename: %s\nSize: %llu\nSHA256: %s\n\n",
+            name, version, delta_line, filename, (unsigned long long)size, hex);
+    return 0;
+}
+
+static int bench_files_equal(const char* a, const char* b) {
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    int equal = fa && fb;
+    while (equal) {
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        equal = ca == cb;
+        if (ca == EOF || cb == EOF) {
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return equal;
+}
+
+/*
+ * Kill a download of rel partway through at the throttled rate, then finish
+ * it. One connection, so segments complete in order rather than all at the end.
+ */
+static uint64_t bench_resume(const char* dir, const char* url, const char* rel, uint64_t size,
+                             pkg_mirror_server_t* server) {
+    char dest[PKG_PATH_MAX];
+    if (snprintf(dest, sizeof(dest), "%s/resume", dir) >= (int)sizeof(dest) || make_dirs(dest) < 0 ||
+        snprintf(dest, sizeof(dest), "%s/resume/archive", dir) >= (int)sizeof(dest)) {
+        return 0;
+    }
+    unlink(dest);
+
+    pkg_mirror_set_rate(server, UPGRADE_LINK_RATE);
+    pid_t child = fork();
+    if (child == 0) {
+        pkg_net_close_idle();     /* Those sockets are the parent's */
+        _exit(pkg_net_fetch(url, rel, dest, size, 1) == 0 ? 0 : 1);
+    }
+    if (child < 0) {
+        pkg_mirror_set_rate(server, 0);
+        return 0;
+    }
+    uint64_t partway = size * 6 / 10 * 1000000000ULL / UPGRADE_LINK_RATE;
+    struct timespec ts = { .tv_sec = (time_t)(partway / 1000000000ULL), .tv_nsec = (long)(partway % 1000000000ULL) };
+    nanosleep(&ts, NULL);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    pkg_mirror_set_rate(server, 0);
+
+    pkg_net_stats_t before;
+    pkg_net_stats_t after;
+    pkg_net_stats(&before);
+    if (pkg_net_fetch(url, rel, dest, size, 4) < 0) {
+        return 0;
+    }
+    pkg_net_stats(&after);
+    return after.resumed - before.resumed;
+}
+
+/*
+ * Publish 1.0 and 2.0 of each package, with a delta between them for most,
+ * serve the mirror over loopback HTTP, install 1.0 into four roots and
+ * upgrade them: full archives and deltas, unthrottled and at a 100 Mbit/s
+ * link rate. The delta roots must end up with the same files.
+ */
+int pkg_benchmark_upgrade(const char* dir, uint32_t packages, pkg_upgrade_bench_t* result) {
+    char mirror[PKG_PATH_MAX];
+    char pool[PKG_PATH_MAX];
+    char path[PKG_PATH_MAX];
+    char largest[128];
+
+    memset(result, 0, sizeof(*result));
+    if (packages == 0 || snprintf(pool, sizeof(pool), "%s/mirror/pool", dir) >= (int)sizeof(pool)) {
+        return -1;
+    }
+    snprintf(mirror, sizeof(mirror), "%s/mirror", dir);
+    if (make_dirs(pool) < 0 || snprintf(path, sizeof(path), "%s/Packages", mirror) >= (int)sizeof(path)) {
+        return -1;
+    }
+    FILE* index_text = fopen(path, "w");
+    if (!index_text) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < packages; i++) {
+        char name[32];
+        char v1_file[96];
+        char v2_file[96];
+        char delta_file[96];
+        char delta_line[256];
+        bench_version_t v1;
+        bench_version_t v2;
+        bool upgrade = i % 10 < 7;
+        int rc = -1;
+
+        snprintf(name, sizeof(name), "pkg%05u", i);
+        snprintf(v1_file, sizeof(v1_file), "pool/%s_1.0.lpk", name);
+        snprintf(v2_file, sizeof(v2_file), "pool/%s_2.0.lpk", name);
+        snprintf(delta_file, sizeof(delta_file), "pool/%s_1.0_2.0.lpd", name);
+        if (bench_package(i, &v1, upgrade ? &v2 : NULL) == 0 &&
+            bench_write(index_text, mirror, v1_file, name, "1.0", &v1, "") == 0) {
+            rc = 0;
+        }
+        if (rc == 0 && upgrade) {
+            uint8_t hash[32];
+            char hex[65];
+            uint64_t size = 0;
+            rc = -1;
+            if (snprintf(path, sizeof(path), "%s/%s", mirror, delta_file) < (int)sizeof(path) &&
+                pkg_delta_write(path, v1.files, v1.count, v2.files, v2.count, hash, &size) == 0) {
+                pkg_hex(hash, 32, hex);
+                snprintf(delta_line, sizeof(delta_line), "Delta: 1.0 %s %llu %s\n", delta_file,
+                         (unsigned long long)size, hex);
+                rc = bench_write(index_text, mirror, v2_file, name, "2.0", &v2, delta_line);
+            }
+            result->upgraded++;
+            bench_version_free(&v2);
+        }
+        bench_version_free(&v1);
+        if (rc < 0) {
+            fclose(index_text);
+            return -1;
+        }
+    }
+    if (fclose(index_text) != 0) {
+        return -1;
+    }
+    result->packages = packages;
+    result->link_rate = UPGRADE_LINK_RATE;
+
+    uint16_t port = 0;
+    char url[64];
+    pkg_mirror_server_t* server = pkg_mirror_serve(mirror, 0, &port);
+    if (!server) {
+        return -1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u", port);
+
+    static const char* roots[4] = { "full", "delta", "full-limited", "delta-limited" };
+    char root_paths[4][PKG_PATH_MAX];
+    pkg_config_t configs[4];
+    pkg_request_t* requests = calloc(packages, sizeof(pkg_request_t));
+    int status = requests ? 0 : -1;
+    for (uint32_t i = 0; i < packages && requests; i++) {
+        snprintf(requests[i].name, sizeof(requests[i].name), "pkg%05u", i);
+        strcpy(requests[i].version, "1.0");
+        requests[i].op = PKG_OP_EQ;
+    }
+
+    for (int r = 0; r < 4 && status == 0; r++) {
+        pkg_install_stats_t stats;
+        configs[r] = pkg_config;
+        configs[r].verbose = false;
+        configs[r].mirror = url;
+        configs[r].no_deltas = r % 2 == 0;
+        configs[r].root = root_paths[r];
+        if (snprintf(root_paths[r], sizeof(root_paths[r]), "%s/%s", dir, roots[r]) >= (int)sizeof(root_paths[r]) ||
+            make_dirs(root_paths[r]) < 0 ||
+            run_transaction(&configs[r], PKG_SOLVE_INSTALL, requests, packages, false, &stats) != 0) {
+            status = -1;
+        }
+    }
+
+    /* The upgrades themselves: wall clock and bytes over the wire */
+    for (int r = 0; r < 4 && status == 0; r++) {
+        pkg_install_stats_t stats;
+        pkg_net_stats_t before;
+        pkg_net_stats_t after;
+        pkg_mirror_set_rate(server, r >= 2 ? UPGRADE_LINK_RATE : 0);
+        pkg_net_stats(&before);
+        uint64_t start = pkg_now_ns();
+        if (run_transaction(&configs[r], PKG_SOLVE_UPGRADE, NULL, 0, false, &stats) != 0) {
+            status = -1;
+            break;
+        }
+        uint64_t ns = pkg_now_ns() - start;
+        pkg_net_stats(&after);
+        switch (r) {
+        case 0:
+            result->full_ns = ns;
+            result->full_bytes = after.bytes - before.bytes;
+            break;
+        case 1:
+            result->delta_ns = ns;
+            result->delta_bytes = after.bytes - before.bytes;
+            result->deltas = stats.deltas;
+            result->delta_fallbacks = stats.delta_fallbacks;
+            break;
+        case 2:
+            result->full_ns_limited = ns;
+            break;
+        default:
+            result->delta_ns_limited = ns;
+            break;
+        }
+    }
+    pkg_mirror_set_rate(server, 0);
+
+    /* Manifests record every file's hash: equal lists mean equal trees */
+    result->identical = status == 0;
+    for (uint32_t i = 0; i < packages && result->identical; i++) {
+        char a[PKG_PATH_MAX];
+        char b[PKG_PATH_MAX];
+        result->identical =
+            snprintf(a, sizeof(a), "%s/%s/info/pkg%05u.list", root_paths[0], PKG_STATE_DIR, i) < (int)sizeof(a) &&
+            snprintf(b, sizeof(b), "%s/%s/info/pkg%05u.list", root_paths[1], PKG_STATE_DIR, i) < (int)sizeof(b) &&
+            bench_files_equal(a, b);
+    }
+
+    /* Resume the largest archive after killing its download */
+    if (status == 0) {
+        uint32_t best = PKG_NONE;
+        uint64_t best_size = 0;
+        pkg_index_t index;
+        if (open_index(&configs[0], &index, false, NULL) == 0) {
+            for (uint32_t r = 0; r < index.header->pkg_count; r++) {
+                if (index.pkgs[r].size > best_size) {
+                    best = r;
+                    best_size = index.pkgs[r].size;
+                }
+            }
+            if (best != PKG_NONE) {
+                snprintf(largest, sizeof(largest), "%s", pkg_str(&index, index.pkgs[best].filename));
+                result->resumed_bytes = bench_resume(dir, url, largest, best_size, server);
+            }
+            pkg_index_close(&index);
+        }
+    }
+
+    free(requests);
+    pkg_net_close_idle();
+    pkg_mirror_stop(server);
+    return status;
+}
@@ -0,0 +1,935 @@
+/*
+ * Native Package Manager - Mirror transport
+ * HTTP/1.1 client with keep-alive and range requests for remote mirrors,
+ * resumable segmented downloads, and a small mirror server
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "pkg.h"
+
+#define PKG_PATH_MAX          512
+#define NET_SEGMENT_SIZE      (256 * 1024)    /* One range request */
+#define NET_IDLE_MAX          16              /* Kept-alive connections */
+#define NET_RETRIES           3
+#define NET_HEADER_MAX        8192
+#define NET_BUFFER_SIZE       65536
+#define NET_TIMEOUT_SEC       30
+#define NET_DEFAULT_CONNECTIONS 4
+
+/* ============================================================================
+ * URLs and connections
+ * ============================================================================ */
+
+typedef struct {
+    char host[256];
+    char port[8];
+    char path[256];               // Without a trailing slash
+} mirror_url_t;
+
+typedef struct net_conn {
+    struct net_conn* next;
+    int fd;
+    char key[272];                // host:port
+    size_t start;                 // Buffered response bytes
+    size_t end;
+    uint8_t buf[NET_BUFFER_SIZE];
+} net_conn_t;
+
+typedef struct {
+    int status;
+    uint64_t length;              // Content-Length
+    uint64_t range_start;
+    bool ranged;
+    bool close;
+} http_response_t;
+
+static pthread_mutex_t net_lock = PTHREAD_MUTEX_INITIALIZER;
+static net_conn_t* net_idle;
+static uint32_t net_idle_count;
+static pkg_net_stats_t net_stats;
+
+bool pkg_mirror_is_remote(const char* mirror) {
+    return strncmp(mirror, "http://", 7) == 0;
+}
+
+/* "http://host[:port][/path]" */
+static int url_parse(const char* mirror, mirror_url_t* url) {
+    if (!pkg_mirror_is_remote(mirror)) {
+        return -1;
+    }
+    const char* host = mirror + 7;
+    const char* path = strchr(host, '/');
+    if (!path) {
+        path = host + strlen(host);
+    }
+    const char* colon = memchr(host, ':', (size_t)(path - host));
+    const char* host_end = colon ? colon : path;
+    size_t host_len = (size_t)(host_end - host);
+    size_t port_len = colon ? (size_t)(path - colon - 1) : 2;
+    size_t path_len = strlen(path);
+    while (path_len && path[path_len - 1] == '/') {
+        path_len--;
+    }
+    if (host_len == 0 || host_len >= sizeof(url->host) || port_len == 0 ||
+        port_len >= sizeof(url->port) || path_len >= sizeof(url->path)) {
+        return -1;
+    }
+
+    memcpy(url->host, host, host_len);
+    url->host[host_len] = '\0';
+    if (colon) {
+        memcpy(url->port, colon + 1, port_len);
+        url->port[port_len] = '\0';
+    } else {
+        strcpy(url->port, "80");
+    }
+    memcpy(url->path, path, path_len);
+    url->path[path_len] = '\0';
+    return 0;
+}
+
+static void conn_close(net_conn_t* conn) {
+    if (conn) {
+        close(conn->fd);
+        free(conn);
+    }
+}
+
+/* An idle keep-alive connection to the host, or a new one */
+static net_conn_t* conn_get(const mirror_url_t* url, bool fresh) {
+    char key[272];
+    snprintf(key, sizeof(key), "%s:%s", url->host, url->port);
+
+    pthread_mutex_lock(&net_lock);
+    net_conn_t** link = &net_idle;
+    while (!fresh && *link && strcmp((*link)->key, key) != 0) {
+        link = &(*link)->next;
+    }
+    net_conn_t* conn = fresh ? NULL : *link;
+    if (conn) {
+        *link = conn->next;
+        net_idle_count--;
+    }
+    pthread_mutex_unlock(&net_lock);
+    if (conn) {
+        return conn;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo* addrs = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(url->host, url->port, &hints, &addrs) != 0) {
+        return NULL;
+    }
+
+    int fd = -1;
+    for (struct addrinfo* a = addrs; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    int one = 1;
+    struct timeval tv = { .tv_sec = NET_TIMEOUT_SEC };
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    conn = malloc(sizeof(net_conn_t));
+    if (!conn) {
+        close(fd);
+        return NULL;
+    }
+    conn->next = NULL;
+    conn->fd = fd;
+    conn->start = conn->end = 0;
+    snprintf(conn->key, sizeof(conn->key), "%s", key);
+
+    pthread_mutex_lock(&net_lock);
+    net_stats.connects++;
+    pthread_mutex_unlock(&net_lock);
+    return conn;
+}
+
+static void conn_put(net_conn_t* conn) {
+    pthread_mutex_lock(&net_lock);
+    if (net_idle_count < NET_IDLE_MAX) {
+        conn->next = net_idle;
+        net_idle = conn;
+        net_idle_count++;
+        conn = NULL;
+    }
+    pthread_mutex_unlock(&net_lock);
+    conn_close(conn);
+}
+
+void pkg_net_close_idle(void) {
+    pthread_mutex_lock(&net_lock);
+    net_conn_t* list = net_idle;
+    net_idle = NULL;
+    net_idle_count = 0;
+    pthread_mutex_unlock(&net_lock);
+    while (list) {
+        net_conn_t* next = list->next;
+        conn_close(list);
+        list = next;
+    }
+}
+
+void pkg_net_stats(pkg_net_stats_t* stats) {
+    pthread_mutex_lock(&net_lock);
+    *stats = net_stats;
+    pthread_mutex_unlock(&net_lock);
+}
+
+static int send_all(int fd, const void* data, size_t len) {
+    const uint8_t* p = data;
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Up to len bytes, buffered first; 0 at end of stream */
+static ssize_t conn_read(net_conn_t* conn, void* out, size_t len) {
+    if (conn->start < conn->end) {
+        size_t n = conn->end - conn->start;
+        n = n < len ? n : len;
+        memcpy(out, conn->buf + conn->start, n);
+        conn->start += n;
+        return (ssize_t)n;
+    }
+    for (;;) {
+        ssize_t n = recv(conn->fd, out, len, 0);
+        if (n >= 0 || errno != EINTR) {
+            return n;
+        }
+    }
+}
+
+static int conn_read_full(net_conn_t* conn, void* out, size_t len) {
+    uint8_t* p = out;
+    while (len) {
+        ssize_t n = conn_read(conn, p, len);
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Read through the blank line ending the headers, leaving the body buffered */
+static int conn_read_headers(net_conn_t* conn, char* headers, size_t size) {
+    size_t used = 0;
+    for (;;) {
+        if (conn->start == conn->end) {
+            ssize_t n;
+            do {
+                n = recv(conn->fd, conn->buf, sizeof(conn->buf), 0);
+            } while (n < 0 && errno == EINTR);
+            if (n <= 0) {
+                return -1;
+            }
+            conn->start = 0;
+            conn->end = (size_t)n;
+        }
+        while (conn->start < conn->end) {
+            if (used + 1 >= size) {
+                return -1;
+            }
+            headers[used++] = (char)conn->buf[conn->start++];
+            if (used >= 4 && memcmp(headers + used - 4, "\r\n\r\n", 4) == 0) {
+                headers[used] = '\0';
+                return (int)used;
+            }
+        }
+    }
+}
+
+/* Value of a header, case-insensitively, or NULL */
+static const char* header_value(const char* headers, const char* name) {
+    size_t len = strlen(name);
+    for (const char* line = strstr(headers, "\r\n"); line; line = strstr(line, "\r\n")) {
+        line += 2;
+        if (strncasecmp(line, name, len) == 0 && line[len] == ':') {
+            const char* v = line + len + 1;
+            while (*v == ' ' || *v == '\t') {
+                v++;
+            }
+            return v;
+        }
+    }
+    return NULL;
+}
+
+/* ============================================================================
+ * Client
+ * ============================================================================ */
+
+/* Send a GET (ranged if length is non-zero) and read the response headers */
+static int http_begin(net_conn_t* conn, const mirror_url_t* url, const char* rel,
+                      uint64_t offset, uint64_t length, http_response_t* r) {
+    char request[1024];
+    int n;
+    if (length) {
+        n = snprintf(request, sizeof(request),
+                     "GET %s/%s HTTP/1.1\r\nHost: %s:%s\r\nRange: bytes=%llu-%llu\r\nUser-Agent: lpm\r\n\r\n",
+                     url->path, rel, url->host, url->port,
+                     (unsigned long long)offset, (unsigned long long)(offset + length - 1));
+    } else {
+        n = snprintf(request, sizeof(request), "GET %s/%s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: lpm\r\n\r\n",
+                     url->path, rel, url->host, url->port);
+    }
+    if (n < 0 || n >= (int)sizeof(request) || send_all(conn->fd, request, (size_t)n) < 0) {
+        return -1;
+    }
+
+    char headers[NET_HEADER_MAX];
+    int minor;
+    if (conn_read_headers(conn, headers, sizeof(headers)) < 0 ||
+        sscanf(headers, "HTTP/1.%d %d", &minor, &r->status) != 2) {
+        return -1;
+    }
+
+    const char* v = header_value(headers, "Content-Length");
+    const char* te = header_value(headers, "Transfer-Encoding");
+    const char* c = header_value(headers, "Connection");
+    if (!v || (te && strncasecmp(te, "identity", 8) != 0)) {
+        return -1;                /* Only sized bodies: mirrors serve plain files */
+    }
+    r->length = strtoull(v, NULL, 10);
+    r->close = minor == 0 ? !(c && strncasecmp(c, "keep-alive", 10) == 0) : (c && strncasecmp(c, "close", 5) == 0);
+    r->ranged = false;
+    r->range_start = 0;
+    if (r->status == 206) {
+        v = header_value(headers, "Content-Range");
+        unsigned long long start;
+        if (!v || sscanf(v, "bytes %llu-", &start) != 1) {
+            return -1;
+        }
+        r->ranged = true;
+        r->range_start = start;
+    }
+
+    pthread_mutex_lock(&net_lock);
+    net_stats.requests++;
+    pthread_mutex_unlock(&net_lock);
+    return 0;
+}
+
+static void count_bytes(uint64_t bytes) {
+    pthread_mutex_lock(&net_lock);
+    net_stats.bytes += bytes;
+    pthread_mutex_unlock(&net_lock);
+}
+
+/*
+ * Copy length bytes of a response body to fd at offset, or to buf. A
+ * connection that failed or holds unread bytes is not reused.
+ */
+static int http_body(net_conn_t* conn, const http_response_t* r, uint64_t length,
+                     int fd, uint64_t offset, uint8_t* buf) {
+    uint8_t chunk[NET_BUFFER_SIZE];
+    uint64_t left = length;
+    while (left) {
+        size_t want = left < sizeof(chunk) ? (size_t)left : sizeof(chunk);
+        uint8_t* dst = buf ? buf + (length - left) : chunk;
+        ssize_t n = conn_read(conn, dst, want);
+        if (n <= 0) {
+            count_bytes(length - left);
+            conn_close(conn);
+            return -1;
+        }
+        if (!buf && pwrite(fd, chunk, (size_t)n, (off_t)(offset + length - left)) != n) {
+            count_bytes(length - left);
+            conn_close(conn);
+            return -1;
+        }
+        left -= (uint64_t)n;
+    }
+    count_bytes(length);
+    if (r->close || length != r->length) {
+        conn_close(conn);
+    } else {
+        conn_put(conn);
+    }
+    return 0;
+}
+
+/*
+ * One range into fd or buf. A server that ignores Range answers 200 with
+ * the whole file: with whole given, all of it goes to fd and its length to
+ * *whole; otherwise the range is taken from it and the rest dropped.
+ */
+static int http_range(const mirror_url_t* url, const char* rel, uint64_t offset, uint64_t length,
+                      int fd, uint8_t* buf, uint64_t* whole) {
+    for (int attempt = 0; attempt < NET_RETRIES; attempt++) {
+        /* A kept-alive connection the server already closed fails at once: retry fresh */
+        net_conn_t* conn = conn_get(url, attempt > 0);
+        http_response_t r = { 0 };
+        if (!conn) {
+            continue;
+        }
+        if (http_begin(conn, url, rel, offset, length, &r) < 0) {
+            conn_close(conn);
+            continue;
+        }
+        if (r.status == 206 && r.range_start == offset && r.length == length) {
+            if (http_body(conn, &r, length, fd, offset, buf) == 0) {
+                return 0;
+            }
+            continue;
+        }
+        if (r.status == 200 && whole) {
+            if (http_body(conn, &r, r.length, fd, 0, NULL) == 0) {
+                *whole = r.length;
+                return 0;
+            }
+            continue;
+        }
+        if (r.status == 200 && r.length >= offset + length) {
+            uint8_t skip[4096];
+            uint64_t left = offset;
+            while (left) {
+                size_t n = left < sizeof(skip) ? (size_t)left : sizeof(skip);
+                if (conn_read_full(conn, skip, n) < 0) {
+                    break;
+                }
+                left -= n;
+            }
+            r.close = true;
+            if (left == 0 && http_body(conn, &r, length, fd, offset, buf) == 0) {
+                return 0;
+            }
+            if (left) {
+                conn_close(conn);
+            }
+            continue;
+        }
+        conn_close(conn);
+        if (r.status == 404 || r.status == 416) {
+            break;
+        }
+    }
+    return -1;
+}
+
+int pkg_net_read(const char* mirror, const char* rel, uint64_t offset, uint64_t length, void* buf) {
+    mirror_url_t url;
+    if (url_parse(mirror, &url) < 0) {
+        return -1;
+    }
+    return length ? http_range(&url, rel, offset, length, -1, buf, NULL) : 0;
+}
+
+/* Whole file, written beside dest and renamed over it */
+int pkg_net_get(const char* mirror, const char* rel, const char* dest) {
+    mirror_url_t url;
+    char tmp[PKG_PATH_MAX];
+    if (url_parse(mirror, &url) < 0 || snprintf(tmp, sizeof(tmp), "%s.tmp", dest) >= (int)sizeof(tmp)) {
+        return -1;
+    }
+
+    for (int attempt = 0; attempt < NET_RETRIES; attempt++) {
+        net_conn_t* conn = conn_get(&url, attempt > 0);
+        http_response_t r = { 0 };
+        if (!conn) {
+            continue;
+        }
+        if (http_begin(conn, &url, rel, 0, 0, &r) < 0 || r.status != 200) {
+            conn_close(conn);
+            if (r.status == 404) {
+                break;
+            }
+            continue;
+        }
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            conn_close(conn);
+            return -1;
+        }
+        int rc = http_body(conn, &r, r.length, fd, 0, NULL);
+        if (close(fd) < 0) {
+            rc = -1;
+        }
+        if (rc == 0 && rename(tmp, dest) == 0) {
+            return 0;
+        }
+        unlink(tmp);
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Resumable downloads
+ * dest.part holds the file as it arrives, dest.part.map one byte per
+ * segment that is set once the segment is written. An interrupted download
+ * picks up the segments still clear; the caller verifies the hash.
+ * ============================================================================ */
+
+typedef struct {
+    mirror_url_t url;
+    const char* rel;
+    int part;
+    int map;
+    uint64_t size;
+    uint32_t segments;
+    uint8_t* done;
+    uint32_t next;
+    bool failed;
+    pthread_mutex_t lock;
+} fetch_t;
+
+static void* fetch_worker(void* arg) {
+    fetch_t* f = arg;
+    for (;;) {
+        pthread_mutex_lock(&f->lock);
+        while (f->next < f->segments && f->done[f->next]) {
+            f->next++;
+        }
+        uint32_t seg = f->next++;
+        bool stop = f->failed || seg >= f->segments;
+        pthread_mutex_unlock(&f->lock);
+        if (stop) {
+            return NULL;
+        }
+
+        uint64_t offset = (uint64_t)seg * NET_SEGMENT_SIZE;
+        uint64_t length = f->size - offset < NET_SEGMENT_SIZE ? f->size - offset : NET_SEGMENT_SIZE;
+        static const uint8_t one = 1;
+        uint64_t whole = 0;
+        if (http_range(&f->url, f->rel, offset, length, f->part, NULL, &whole) < 0 ||
+            (whole && whole != f->size) || pwrite(f->map, &one, 1, seg) != 1) {
+            pthread_mutex_lock(&f->lock);
+            f->failed = true;
+            pthread_mutex_unlock(&f->lock);
+            return NULL;
+        }
+        if (whole) {
+            /* No range support: that was the entire file */
+            pthread_mutex_lock(&f->lock);
+            memset(f->done, 1, f->segments);
+            f->next = f->segments;
+            pthread_mutex_unlock(&f->lock);
+            if (pwrite(f->map, f->done, f->segments, 0) != (ssize_t)f->segments) {
+                pthread_mutex_lock(&f->lock);
+                f->failed = true;
+                pthread_mutex_unlock(&f->lock);
+            }
+            return NULL;
+        }
+    }
+}
+
+int pkg_net_fetch(const char* mirror, const char* rel, const char* dest, uint64_t size, uint32_t connections) {
+    struct stat st;
+    if (stat(dest, &st) == 0 && (uint64_t)st.st_size == size) {
+        return 0;
+    }
+
+    fetch_t f;
+    char part[PKG_PATH_MAX];
+    char map[PKG_PATH_MAX];
+    memset(&f, 0, sizeof(f));
+    if (size == 0 || url_parse(mirror, &f.url) < 0 ||
+        snprintf(part, sizeof(part), "%s.part", dest) >= (int)sizeof(part) ||
+        snprintf(map, sizeof(map), "%s.part.map", dest) >= (int)sizeof(map)) {
+        return -1;
+    }
+    f.rel = rel;
+    f.size = size;
+    f.segments = (uint32_t)((size + NET_SEGMENT_SIZE - 1) / NET_SEGMENT_SIZE);
+    f.part = open(part, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    f.map = open(map, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    f.done = calloc(f.segments, 1);
+    if (f.part < 0 || f.map < 0 || !f.done) {
+        goto fail;
+    }
+
+    /* A map that does not match this file's size belongs to some other download */
+    struct stat part_st;
+    struct stat map_st;
+    if (fstat(f.part, &part_st) < 0 || fstat(f.map, &map_st) < 0) {
+        goto fail;
+    }
+    if ((uint64_t)part_st.st_size != size || (uint64_t)map_st.st_size != f.segments ||
+        pread(f.map, f.done, f.segments, 0) != (ssize_t)f.segments) {
+        memset(f.done, 0, f.segments);
+        if (ftruncate(f.part, (off_t)size) < 0 || ftruncate(f.map, 0) < 0 || ftruncate(f.map, f.segments) < 0) {
+            goto fail;
+        }
+    }
+
+    uint32_t todo = 0;
+    uint64_t resumed = 0;
+    for (uint32_t s = 0; s < f.segments; s++) {
+        if (f.done[s]) {
+            uint64_t offset = (uint64_t)s * NET_SEGMENT_SIZE;
+            resumed += size - offset < NET_SEGMENT_SIZE ? size - offset : NET_SEGMENT_SIZE;
+        } else {
+            todo++;
+        }
+    }
+    pthread_mutex_lock(&net_lock);
+    net_stats.resumed += resumed;
+    pthread_mutex_unlock(&net_lock);
+
+    uint32_t workers = connections ? connections : NET_DEFAULT_CONNECTIONS;
+    workers = workers < todo ? workers : todo;
+    pthread_t threads[32];
+    uint32_t started = 0;
+    pthread_mutex_init(&f.lock, NULL);
+    while (started + 1 < workers && started < 32 && pthread_create(&threads[started], NULL, fetch_worker, &f) == 0) {
+        started++;
+    }
+    fetch_worker(&f);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&f.lock);
+    if (f.failed) {
+        goto fail;
+    }
+
+    close(f.part);
+    close(f.map);
+    free(f.done);
+    if (rename(part, dest) < 0) {
+        return -1;
+    }
+    unlink(map);
+    return 0;
+
+fail:
+    /* The segments already written stay for the next attempt */
+    if (f.part >= 0) {
+        close(f.part);
+    }
+    if (f.map >= 0) {
+        close(f.map);
+    }
+    free(f.done);
+    return -1;
+}
+
+/* Drop downloaded archives and deltas, finished or partial */
+int pkg_cache_clean(const char* state_dir, uint64_t* removed) {
+    char dir_path[PKG_PATH_MAX];
+    *removed = 0;
+    if (snprintf(dir_path, sizeof(dir_path), "%s/cache", state_dir) >= (int)sizeof(dir_path)) {
+        return -1;
+    }
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct dirent* de;
+    while ((de = readdir(dir)) != NULL) {
+        char path[PKG_PATH_MAX];
+        if (de->d_name[0] == '.' ||
+            snprintf(path, sizeof(path), "%s/%s", dir_path, de->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (unlink(path) == 0) {
+            (*removed)++;
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+/* ============================================================================
+ * Mirror server
+ * Serves a mirror directory over HTTP/1.1 with keep-alive and single
+ * ranges. An optional rate limit paces all connections together, as one
+ * shared link would.
+ * ============================================================================ */
+
+struct pkg_mirror_server {
+    char root[PKG_PATH_MAX];
+    int listen_fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    uint32_t active;
+    bool stopping;
+    uint64_t rate;                // Bytes per second, 0 = unlimited
+    uint64_t link_free_ns;        // When the shared link can send again
+};
+
+typedef struct {
+    pkg_mirror_server_t* server;
+    net_conn_t conn;
+} serve_conn_t;
+
+/* Hold a chunk until the shared link has room for it */
+static void serve_pace(pkg_mirror_server_t* s, size_t bytes) {
+    pthread_mutex_lock(&s->lock);
+    uint64_t now = pkg_now_ns();
+    uint64_t slot = s->link_free_ns > now ? s->link_free_ns : now;
+    if (s->rate) {
+        s->link_free_ns = slot + (uint64_t)bytes * 1000000000ULL / s->rate;
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (slot > now) {
+        uint64_t wait = slot - now;
+        struct timespec ts = { .tv_sec = (time_t)(wait / 1000000000ULL), .tv_nsec = (long)(wait % 1000000000ULL) };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static int serve_status(int fd, int status, const char* reason) {
+    char reply[128];
+    int n = snprintf(reply, sizeof(reply), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\n\r\n", status, reason);
+    return send_all(fd, reply, (size_t)n);
+}
+
+/* One request; -1 ends the connection */
+static int serve_request(pkg_mirror_server_t* s, net_conn_t* conn) {
+    char headers[NET_HEADER_MAX];
+    char target[PKG_PATH_MAX];
+    if (conn_read_headers(conn, headers, sizeof(headers)) < 0) {
+        return -1;
+    }
+    if (sscanf(headers, "GET %511s HTTP/1.%*d", target) != 1) {
+        serve_status(conn->fd, 400, "Bad Request");
+        return -1;
+    }
+    const char* c = header_value(headers, "Connection");
+    bool keep_alive = !(c && strncasecmp(c, "close", 5) == 0);
+
+    char path[PKG_PATH_MAX * 2];
+    const char* rel = target[0] == '/' ? target + 1 : target;
+    int fd = -1;
+    struct stat st;
+    if (pkg_path_safe(rel, strlen(rel)) &&
+        snprintf(path, sizeof(path), "%s/%s", s->root, rel) < (int)sizeof(path)) {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return serve_status(conn->fd, 404, "Not Found") < 0 || !keep_alive ? -1 : 0;
+    }
+
+    uint64_t size = (uint64_t)st.st_size;
+    uint64_t start = 0;
+    uint64_t end = size ? size - 1 : 0;
+    bool ranged = false;
+    const char* range = header_value(headers, "Range");
+    if (range) {
+        unsigned long long a;
+        unsigned long long b;
+        int fields = sscanf(range, "bytes=%llu-%llu", &a, &b);
+        if (fields < 1 || a >= size || (fields == 2 && b < a)) {
+            close(fd);
+            return serve_status(conn->fd, 416, "Range Not Satisfiable") < 0 || !keep_alive ? -1 : 0;
+        }
+        start = a;
+        end = (fields == 2 && b < size) ? b : size - 1;
+        ranged = true;
+    }
+    uint64_t length = size ? end - start + 1 : 0;
+
+    char reply[256];
+    int n = ranged ?
+        snprintf(reply, sizeof(reply), "HTTP/1.1 206 Partial Content\r\nContent-Length: %llu\r\n"
+                 "Content-Range: bytes %llu-%llu/%llu\r\n\r\n", (unsigned long long)length,
+                 (unsigned long long)start, (unsigned long long)end, (unsigned long long)size) :
+        snprintf(reply, sizeof(reply), "HTTP/1.1 200 OK\r\nContent-Length: %llu\r\nAccept-Ranges: bytes\r\n\r\n",
+                 (unsigned long long)length);
+    int rc = send_all(conn->fd, reply, (size_t)n);
+
+    uint8_t chunk[NET_BUFFER_SIZE];
+    uint64_t sent = 0;
+    while (rc == 0 && sent < length) {
+        size_t want = length - sent < sizeof(chunk) ? (size_t)(length - sent) : sizeof(chunk);
+        ssize_t got = pread(fd, chunk, want, (off_t)(start + sent));
+        if (got <= 0) {
+            rc = -1;
+            break;
+        }
+        serve_pace(s, (size_t)got);
+        rc = send_all(conn->fd, chunk, (size_t)got);
+        sent += (uint64_t)got;
+    }
+    close(fd);
+    return rc < 0 || !keep_alive ? -1 : 0;
+}
+
+static void* serve_connection(void* arg) {
+    serve_conn_t* sc = arg;
+    pkg_mirror_server_t* s = sc->server;
+
+    for (;;) {
+        /* Wait for the next request in short slices so a stop is noticed */
+        if (sc->conn.start == sc->conn.end) {
+            struct pollfd pfd = { .fd = sc->conn.fd, .events = POLLIN };
+            int ready = poll(&pfd, 1, 100);
+            pthread_mutex_lock(&s->lock);
+            bool stopping = s->stopping;
+            pthread_mutex_unlock(&s->lock);
+            if (stopping) {
+                break;
+            }
+            if (ready == 0 || (ready < 0 && errno == EINTR)) {
+                continue;
+            }
+        }
+        if (serve_request(s, &sc->conn) < 0) {
+            break;
+        }
+    }
+
+    close(sc->conn.fd);
+    free(sc);
+    pthread_mutex_lock(&s->lock);
+    if (--s->active == 0) {
+        pthread_cond_broadcast(&s->idle);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void* serve_accept(void* arg) {
+    pkg_mirror_server_t* s = arg;
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return NULL;          /* Listener shut down */
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        serve_conn_t* sc = malloc(sizeof(serve_conn_t));
+        pthread_t thread;
+        pthread_attr_t attr;
+        if (!sc) {
+            close(fd);
+            continue;
+        }
+        sc->server = s;
+        sc->conn.fd = fd;
+        sc->conn.start = sc->conn.end = 0;
+
+        pthread_mutex_lock(&s->lock);
+        s->active++;
+        pthread_mutex_unlock(&s->lock);
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, serve_connection, sc) != 0) {
+            close(fd);
+            free(sc);
+            pthread_mutex_lock(&s->lock);
+            s->active--;
+            pthread_mutex_unlock(&s->lock);
+        }
+        pthread_attr_destroy(&attr);
+    }
+}
+
+/* Listen on 127.0.0.1:port (0 picks one) */
+pkg_mirror_server_t* pkg_mirror_serve(const char* dir, uint16_t port, uint16_t* bound_port) {
+    pkg_mirror_server_t* s = calloc(1, sizeof(pkg_mirror_server_t));
+    if (!s || snprintf(s->root, sizeof(s->root), "%s", dir) >= (int)sizeof(s->root)) {
+        free(s);
+        return NULL;
+    }
+
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int one = 1;
+
+    s->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0 ||
+        setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(s->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(s->listen_fd, 64) < 0 ||
+        getsockname(s->listen_fd, (struct sockaddr*)&addr, &addr_len) < 0) {
+        if (s->listen_fd >= 0) {
+            close(s->listen_fd);
+        }
+        free(s);
+        return NULL;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->idle, NULL);
+    if (pthread_create(&s->thread, NULL, serve_accept, s) != 0) {
+        close(s->listen_fd);
+        pthread_cond_destroy(&s->idle);
+        pthread_mutex_destroy(&s->lock);
+        free(s);
+        return NULL;
+    }
+    if (bound_port) {
+        *bound_port = ntohs(addr.sin_port);
+    }
+    return s;
+}
+
+void pkg_mirror_set_rate(pkg_mirror_server_t* server, uint64_t bytes_per_sec) {
+    pthread_mutex_lock(&server->lock);
+    server->rate = bytes_per_sec;
+    server->link_free_ns = 0;
+    pthread_mutex_unlock(&server->lock);
+}
+
+void pkg_mirror_stop(pkg_mirror_server_t* server) {
+    if (!server) {
+        return;
+    }
+    shutdown(server->listen_fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    while (server->active) {
+        pthread_cond_wait(&server->idle, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    pthread_cond_destroy(&server->idle);
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+}
@@ -0,0 +1,732 @@
+/*
+ * Native Package Manager - Solver
+ * CDCL SAT solving over the part of the index a request can reach
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pkg.h"
+
+/*
+ * One boolean per package version: installed or not. Requests, dependencies,
+ * conflicts and "one version per name" become clauses; watched literals
+ * propagate them and conflicts are learned from the first UIP.
+ *
+ * Decisions are rule-driven rather than activity-based, so the answer is
+ * the one a person would expect: satisfy the requests first, then the
+ * dependencies of everything chosen so far, each time taking the first
+ * acceptable candidate (installed version, else newest, in "a | b" order),
+ * then keep what is already installed, and leave everything else out.
+ */
+
+#define LIT(var, neg)   (((var) << 1) | (uint32_t)(neg))
+#define LIT_VAR(lit)    ((lit) >> 1)
+#define LIT_NEG(lit)    ((lit) & 1)
+#define LIT_UNDEF       UINT32_MAX
+#define CLAUSE_NONE     UINT32_MAX
+
+#define ITEM_REMOVE     1         /* Installed item named by a remove request */
+#define ITEM_KEEP       2         /* Installed item with a soft job */
+
+typedef struct {
+    uint32_t* items;
+    uint32_t count;
+    uint32_t capacity;
+} vec_t;
+
+typedef struct {
+    const pkg_index_t* index;
+    const pkg_db_t* db;
+    pkg_solve_mode_t mode;
+    bool failed;                  // Allocation failure while building
+
+    /* Variables */
+    uint32_t* var_of;             // Record -> var + 1, 0 = outside the problem
+    vec_t records;                // Var -> record
+    vec_t dep_first;              // Var -> first dependency candidate set
+    vec_t dep_count;
+    vec_t conflicts;              // (var, record) pairs, clauses added once the closure is known
+
+    /* Clauses; clause c is lits[start[c] .. start[c + 1]) */
+    vec_t start;
+    vec_t lits;
+    vec_t units;
+    uint32_t problem_clauses;
+    vec_t* watches;               // Per literal: clauses watching it
+
+    /* Candidate sets in preference order, which watching would reorder in the clauses */
+    vec_t cand_start;
+    vec_t cands;
+    vec_t jobs;                   // Hard: one must hold
+    vec_t soft;                   // Installed packages to keep if possible
+
+    /* Assignment */
+    int8_t* value;                // -1 unassigned, 0 false, 1 true
+    uint32_t* level;
+    uint32_t* reason;
+    uint8_t* seen;
+    uint32_t* trail;
+    uint32_t trail_count;
+    uint32_t qhead;
+    vec_t trail_lim;
+    vec_t learnt;
+    vec_t install;
+
+    /* Decision cursors, rewound on backtrack */
+    uint32_t job_pos;
+    uint32_t dep_pos;
+    uint32_t soft_pos;
+    uint32_t free_pos;
+
+    uint32_t* stamp;              // Per record, dedups candidates within one set
+    uint32_t stamp_gen;
+
+    uint32_t decisions;
+    uint32_t conflicts_seen;
+} solver_t;
+
+static bool vec_push(vec_t* v, uint32_t x) {
+    if (v->count == v->capacity) {
+        uint32_t cap = v->capacity ? v->capacity * 2 : 16;
+        uint32_t* items = realloc(v->items, cap * sizeof(uint32_t));
+        if (!items) {
+            return false;
+        }
+        v->items = items;
+        v->capacity = cap;
+    }
+    v->items[v->count++] = x;
+    return true;
+}
+
+static void vec_free(vec_t* v) {
+    free(v->items);
+    memset(v, 0, sizeof(*v));
+}
+
+static void push(solver_t* s, vec_t* v, uint32_t x) {
+    if (!vec_push(v, x)) {
+        s->failed = true;
+    }
+}
+
+/* ============================================================================
+ * Building the problem
+ * ============================================================================ */
+
+static uint32_t var_for(solver_t* s, uint32_t record) {
+    if (!s->var_of[record]) {
+        s->var_of[record] = s->records.count + 1;
+        push(s, &s->records, record);
+    }
+    return s->var_of[record] - 1;
+}
+
+/* The installed record of record's name, if the index still has that version */
+static uint32_t installed_record(solver_t* s, uint32_t head) {
+    const pkg_installed_t* item = pkg_db_find(s->db, pkg_str(s->index, s->index->pkgs[head].name));
+    if (!item) {
+        return PKG_NONE;
+    }
+    for (uint32_t r = head; r != PKG_NONE; r = s->index->pkgs[r].next_version) {
+        if (strcmp(pkg_str(s->index, s->index->pkgs[r].version), item->version) == 0) {
+            return r;
+        }
+    }
+    return PKG_NONE;
+}
+
+static void cand_add(solver_t* s, uint32_t record) {
+    if (s->stamp[record] != s->stamp_gen) {
+        s->stamp[record] = s->stamp_gen;
+        push(s, &s->cands, LIT(var_for(s, record), 0));
+    }
+}
+
+/* Append the versions of head's name that satisfy op/version, best first */
+static void cand_add_matching(solver_t* s, uint32_t head, pkg_op_t op, const char* version) {
+    if (head == PKG_NONE) {
+        return;
+    }
+    if (s->mode != PKG_SOLVE_UPGRADE) {
+        uint32_t installed = installed_record(s, head);
+        if (installed != PKG_NONE && pkg_index_match(s->index, installed, op, version)) {
+            cand_add(s, installed);
+        }
+    }
+    for (uint32_t r = head; r != PKG_NONE; r = s->index->pkgs[r].next_version) {
+        if (pkg_index_match(s->index, r, op, version)) {
+            cand_add(s, r);
+        }
+    }
+}
+
+static uint32_t cand_begin(solver_t* s) {
+    s->stamp_gen++;
+    return s->cand_start.count - 1;
+}
+
+static uint32_t cand_end(solver_t* s) {
+    push(s, &s->cand_start, s->cands.count);
+    return s->cand_start.count - 2;
+}
+
+static uint32_t cand_size(const solver_t* s, uint32_t set) {
+    return s->cand_start.items[set + 1] - s->cand_start.items[set];
+}
+
+static const uint32_t* cand_lits(const solver_t* s, uint32_t set) {
+    return &s->cands.items[s->cand_start.items[set]];
+}
+
+/* Close the clause appended to lits; a single literal becomes a level-0 unit */
+static void clause_end(solver_t* s) {
+    uint32_t first = s->start.items[s->start.count - 1];
+    uint32_t len = s->lits.count - first;
+    if (len == 1) {
+        push(s, &s->units, s->lits.items[first]);
+        s->lits.count = first;
+        return;
+    }
+    push(s, &s->start, s->lits.count);
+}
+
+static uint32_t clause_count(const solver_t* s) {
+    return s->start.count - 1;
+}
+
+/* head -> any candidate of the set: (-head | c1 | c2 ...) */
+static void clause_from_set(solver_t* s, uint32_t head_var, bool has_head, uint32_t set) {
+    if (has_head) {
+        push(s, &s->lits, LIT(head_var, 1));
+    }
+    const uint32_t* lits = cand_lits(s, set);
+    for (uint32_t i = 0; i < cand_size(s, set); i++) {
+        push(s, &s->lits, lits[i]);
+    }
+    clause_end(s);
+}
+
+/* Dependencies of var become candidate sets and clauses; conflicts wait for the closure */
+static void expand_var(solver_t* s, uint32_t var) {
+    const pkg_index_t* index = s->index;
+    uint32_t record = s->records.items[var];
+    const pkg_record_t* rec = &index->pkgs[record];
+
+    push(s, &s->dep_first, s->cand_start.count - 1);
+    push(s, &s->dep_count, rec->depends_count);
+
+    for (uint32_t g = rec->groups; g < rec->groups + rec->depends_count; g++) {
+        const pkg_group_t* group = &index->groups[g];
+        uint32_t set = cand_begin(s);
+        for (uint32_t a = group->first; a < group->first + group->count; a++) {
+            const pkg_alt_t* alt = &index->alts[a];
+            cand_add_matching(s, alt->target, (pkg_op_t)alt->op, pkg_str(index, alt->version));
+        }
+        set = cand_end(s);
+        clause_from_set(s, var, true, set);
+    }
+
+    for (uint32_t g = rec->groups + rec->depends_count; g < rec->groups + rec->depends_count + rec->conflicts_count; g++) {
+        const pkg_group_t* group = &index->groups[g];
+        for (uint32_t a = group->first; a < group->first + group->count; a++) {
+            const pkg_alt_t* alt = &index->alts[a];
+            if (alt->target == PKG_NONE || index->pkgs[alt->target].name == rec->name) {
+                continue;
+            }
+            for (uint32_t r = alt->target; r != PKG_NONE; r = index->pkgs[r].next_version) {
+                if (pkg_index_match(index, r, (pkg_op_t)alt->op, pkg_str(index, alt->version))) {
+                    push(s, &s->conflicts, var);
+                    push(s, &s->conflicts, r);
+                }
+            }
+        }
+    }
+}
+
+static void add_binary(solver_t* s, uint32_t a, uint32_t b) {
+    push(s, &s->lits, a);
+    push(s, &s->lits, b);
+    clause_end(s);
+}
+
+/* Conflicts whose target made it into the problem, and at most one version per name */
+static void finish_problem(solver_t* s) {
+    for (uint32_t i = 0; i + 1 < s->conflicts.count; i += 2) {
+        uint32_t var = s->conflicts.items[i];
+        uint32_t other = s->var_of[s->conflicts.items[i + 1]];
+        if (other) {
+            add_binary(s, LIT(var, 1), LIT(other - 1, 1));
+        }
+    }
+
+    for (uint32_t var = 0; var < s->records.count; var++) {
+        const pkg_record_t* rec = &s->index->pkgs[s->records.items[var]];
+        uint32_t head = pkg_index_find(s->index, pkg_str(s->index, rec->name));
+        for (uint32_t r = head; r != PKG_NONE; r = s->index->pkgs[r].next_version) {
+            uint32_t other = s->var_of[r];
+            if (other && other - 1 > var) {
+                add_binary(s, LIT(var, 1), LIT(other - 1, 1));
+            }
+        }
+    }
+}
+
+/* ============================================================================
+ * Search
+ * ============================================================================ */
+
+static inline int lit_value(const solver_t* s, uint32_t lit) {
+    int8_t v = s->value[LIT_VAR(lit)];
+    return v < 0 ? -1 : (v ^ (int)LIT_NEG(lit));
+}
+
+static void assign(solver_t* s, uint32_t lit, uint32_t reason) {
+    uint32_t var = LIT_VAR(lit);
+    s->value[var] = (int8_t)!LIT_NEG(lit);
+    s->level[var] = s->trail_lim.count;
+    s->reason[var] = reason;
+    s->trail[s->trail_count++] = lit;
+}
+
+static void watch(solver_t* s, uint32_t clause) {
+    uint32_t* lits = &s->lits.items[s->start.items[clause]];
+    push(s, &s->watches[lits[0]], clause);
+    push(s, &s->watches[lits[1]], clause);
+}
+
+/* Unit propagation over two watched literals; returns a conflicting clause or CLAUSE_NONE */
+static uint32_t propagate(solver_t* s) {
+    while (s->qhead < s->trail_count) {
+        uint32_t false_lit = s->trail[s->qhead++] ^ 1;
+        vec_t* ws = &s->watches[false_lit];
+        uint32_t i = 0;
+        uint32_t j = 0;
+
+        while (i < ws->count) {
+            uint32_t c = ws->items[i++];
+            uint32_t* lits = &s->lits.items[s->start.items[c]];
+            uint32_t len = s->start.items[c + 1] - s->start.items[c];
+
+            if (lits[0] == false_lit) {
+                lits[0] = lits[1];
+                lits[1] = false_lit;
+            }
+            if (lit_value(s, lits[0]) == 1) {
+                ws->items[j++] = c;
+                continue;
+            }
+
+            bool moved = false;
+            for (uint32_t k = 2; k < len; k++) {
+                if (lit_value(s, lits[k]) != 0) {
+                    lits[1] = lits[k];
+                    lits[k] = false_lit;
+                    push(s, &s->watches[lits[1]], c);
+                    moved = true;
+                    break;
+                }
+            }
+            if (moved) {
+                continue;
+            }
+
+            ws->items[j++] = c;
+            if (lit_value(s, lits[0]) == 0) {
+                while (i < ws->count) {
+                    ws->items[j++] = ws->items[i++];
+                }
+                ws->count = j;
+                return c;
+            }
+            assign(s, lits[0], c);
+        }
+        ws->count = j;
+    }
+    return CLAUSE_NONE;
+}
+
+/* First-UIP learning; leaves the clause in s->learnt and returns the level to jump back to */
+static uint32_t analyze(solver_t* s, uint32_t conflict) {
+    uint32_t current = s->trail_lim.count;
+    uint32_t pending = 0;
+    uint32_t p = LIT_UNDEF;
+    uint32_t idx = s->trail_count;
+    uint32_t c = conflict;
+
+    s->learnt.count = 0;
+    push(s, &s->learnt, LIT_UNDEF);
+
+    do {
+        uint32_t* lits = &s->lits.items[s->start.items[c]];
+        uint32_t len = s->start.items[c + 1] - s->start.items[c];
+        for (uint32_t k = (p == LIT_UNDEF) ? 0 : 1; k < len; k++) {
+            uint32_t var = LIT_VAR(lits[k]);
+            if (s->seen[var] || s->level[var] == 0) {
+                continue;
+            }
+            s->seen[var] = 1;
+            if (s->level[var] == current) {
+                pending++;
+            } else {
+                push(s, &s->learnt, lits[k]);
+            }
+        }
+        do {
+            idx--;
+        } while (!s->seen[LIT_VAR(s->trail[idx])]);
+        p = s->trail[idx];
+        c = s->reason[LIT_VAR(p)];
+        s->seen[LIT_VAR(p)] = 0;
+        pending--;
+    } while (pending > 0);
+
+    s->learnt.items[0] = p ^ 1;
+
+    /* The highest remaining level goes second, as the clause's other watch */
+    uint32_t back = 0;
+    for (uint32_t k = 1; k < s->learnt.count; k++) {
+        uint32_t var = LIT_VAR(s->learnt.items[k]);
+        s->seen[var] = 0;
+        if (s->level[var] > back) {
+            back = s->level[var];
+            uint32_t t = s->learnt.items[1];
+            s->learnt.items[1] = s->learnt.items[k];
+            s->learnt.items[k] = t;
+        }
+    }
+    return back;
+}
+
+static void backtrack(solver_t* s, uint32_t level) {
+    if (s->trail_lim.count <= level) {
+        return;
+    }
+    uint32_t keep = s->trail_lim.items[level];
+    for (uint32_t i = keep; i < s->trail_count; i++) {
+        s->value[LIT_VAR(s->trail[i])] = -1;
+    }
+    s->trail_count = keep;
+    s->qhead = keep;
+    s->trail_lim.count = level;
+
+    s->job_pos = 0;
+    s->soft_pos = 0;
+    s->free_pos = 0;
+    if (s->dep_pos > keep) {
+        s->dep_pos = keep;
+    }
+}
+
+/* First unassigned candidate of a set no candidate of which holds yet */
+static uint32_t pick_from(const solver_t* s, uint32_t set) {
+    const uint32_t* lits = cand_lits(s, set);
+    uint32_t choice = LIT_UNDEF;
+    for (uint32_t i = 0; i < cand_size(s, set); i++) {
+        int v = lit_value(s, lits[i]);
+        if (v == 1) {
+            return LIT_UNDEF;
+        }
+        if (v < 0 && choice == LIT_UNDEF) {
+            choice = lits[i];
+        }
+    }
+    return choice;
+}
+
+static uint32_t decide(solver_t* s) {
+    for (; s->job_pos < s->jobs.count; s->job_pos++) {
+        uint32_t lit = pick_from(s, s->jobs.items[s->job_pos]);
+        if (lit != LIT_UNDEF) {
+            return lit;
+        }
+    }
+
+    for (; s->dep_pos < s->trail_count; s->dep_pos++) {
+        uint32_t lit = s->trail[s->dep_pos];
+        if (LIT_NEG(lit)) {
+            continue;
+        }
+        uint32_t var = LIT_VAR(lit);
+        uint32_t first = s->dep_first.items[var];
+        for (uint32_t d = first; d < first + s->dep_count.items[var]; d++) {
+            uint32_t choice = pick_from(s, d);
+            if (choice != LIT_UNDEF) {
+                return choice;
+            }
+        }
+    }
+
+    for (; s->soft_pos < s->soft.count; s->soft_pos++) {
+        uint32_t lit = pick_from(s, s->soft.items[s->soft_pos]);
+        if (lit != LIT_UNDEF) {
+            return lit;
+        }
+    }
+
+    for (; s->free_pos < s->records.count; s->free_pos++) {
+        if (s->value[s->free_pos] < 0) {
+            return LIT(s->free_pos, 1);
+        }
+    }
+    return LIT_UNDEF;
+}
+
+static bool search(solver_t* s) {
+    uint32_t vars = s->records.count;
+
+    s->value = malloc(vars ? vars : 1);
+    s->level = calloc(vars + 1, sizeof(uint32_t));
+    s->reason = calloc(vars + 1, sizeof(uint32_t));
+    s->seen = calloc(vars + 1, 1);
+    s->trail = calloc(vars + 1, sizeof(uint32_t));
+    s->watches = calloc(2 * (size_t)vars + 2, sizeof(vec_t));
+    if (!s->value || !s->level || !s->reason || !s->seen || !s->trail || !s->watches) {
+        s->failed = true;
+        return false;
+    }
+    memset(s->value, -1, vars ? vars : 1);
+
+    for (uint32_t c = 0; c < clause_count(s); c++) {
+        watch(s, c);
+    }
+    for (uint32_t i = 0; i < s->units.count; i++) {
+        int v = lit_value(s, s->units.items[i]);
+        if (v == 0) {
+            return false;
+        }
+        if (v < 0) {
+            assign(s, s->units.items[i], CLAUSE_NONE);
+        }
+    }
+
+    for (;;) {
+        uint32_t conflict = propagate(s);
+        if (s->failed) {
+            return false;
+        }
+        if (conflict != CLAUSE_NONE) {
+            s->conflicts_seen++;
+            if (s->trail_lim.count == 0) {
+                return false;
+            }
+            uint32_t back = analyze(s, conflict);
+            backtrack(s, back);
+            if (s->learnt.count == 1) {
+                assign(s, s->learnt.items[0], CLAUSE_NONE);
+                continue;
+            }
+            for (uint32_t k = 0; k < s->learnt.count; k++) {
+                push(s, &s->lits, s->learnt.items[k]);
+            }
+            push(s, &s->start, s->lits.count);
+            uint32_t clause = clause_count(s) - 1;
+            watch(s, clause);
+            assign(s, s->learnt.items[0], clause);
+            continue;
+        }
+
+        uint32_t lit = decide(s);
+        if (lit == LIT_UNDEF) {
+            return true;
+        }
+        s->decisions++;
+        push(s, &s->trail_lim, s->trail_count);
+        assign(s, lit, CLAUSE_NONE);
+    }
+}
+
+/* ============================================================================
+ * Entry point
+ * ============================================================================ */
+
+static bool name_kept(const solver_t* s, uint32_t head) {
+    for (uint32_t r = head; r != PKG_NONE; r = s->index->pkgs[r].next_version) {
+        if (s->var_of[r] && s->value[s->var_of[r] - 1] == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool add_remove(pkg_solution_t* solution, const char* name) {
+    char** list = realloc(solution->remove, (solution->remove_count + 1) * sizeof(char*));
+    if (!list) {
+        return false;
+    }
+    solution->remove = list;
+    if (!(list[solution->remove_count] = strdup(name))) {
+        return false;
+    }
+    solution->remove_count++;
+    return true;
+}
+
+static void solver_free(solver_t* s) {
+    if (s->watches) {
+        for (uint32_t i = 0; i < 2 * s->records.count + 2; i++) {
+            vec_free(&s->watches[i]);
+        }
+    }
+    free(s->watches);
+    free(s->var_of);
+    free(s->stamp);
+    free(s->value);
+    free(s->level);
+    free(s->reason);
+    free(s->seen);
+    free(s->trail);
+    vec_t* vecs[] = {
+        &s->records, &s->dep_first, &s->dep_count, &s->conflicts, &s->start, &s->lits, &s->units,
+        &s->cand_start, &s->cands, &s->jobs, &s->soft, &s->trail_lim, &s->learnt, &s->install,
+    };
+    for (size_t i = 0; i < sizeof(vecs) / sizeof(vecs[0]); i++) {
+        vec_free(vecs[i]);
+    }
+}
+
+int pkg_solve(const pkg_index_t* index, const pkg_db_t* db, pkg_solve_mode_t mode,
+              const pkg_request_t* requests, uint32_t count, pkg_solution_t* solution) {
+    memset(solution, 0, sizeof(*solution));
+    uint64_t start_ns = pkg_now_ns();
+    uint32_t pkg_count = index->header->pkg_count;
+
+    solver_t s;
+    memset(&s, 0, sizeof(s));
+    s.index = index;
+    s.db = db;
+    s.mode = mode;
+    s.var_of = calloc(pkg_count + 1, sizeof(uint32_t));
+    s.stamp = calloc(pkg_count + 1, sizeof(uint32_t));
+    uint8_t* item_state = calloc(db->count + 1, 1);   /* ITEM_REMOVE or ITEM_KEEP */
+    int result = -1;
+
+    if (!s.var_of || !s.stamp || !item_state) {
+        snprintf(solution->error, sizeof(solution->error), "out of memory");
+        goto out;
+    }
+    push(&s, &s.start, 0);
+    push(&s, &s.cand_start, 0);
+
+    /* Hard jobs */
+    for (uint32_t i = 0; i < count; i++) {
+        const pkg_request_t* req = &requests[i];
+        uint32_t head = pkg_index_find(index, req->name);
+
+        if (mode == PKG_SOLVE_REMOVE) {
+            pkg_installed_t* item = pkg_db_find(db, req->name);
+            if (!item) {
+                snprintf(solution->error, sizeof(solution->error), "%s is not installed", req->name);
+                goto out;
+            }
+            item_state[item - db->items] = ITEM_REMOVE;
+            for (uint32_t r = head; r != PKG_NONE; r = index->pkgs[r].next_version) {
+                push(&s, &s.units, LIT(var_for(&s, r), 1));
+            }
+            if (head == PKG_NONE && !add_remove(solution, req->name)) {
+                goto out;
+            }
+            continue;
+        }
+
+        cand_begin(&s);
+        cand_add_matching(&s, head, req->op, req->version);
+        uint32_t set = cand_end(&s);
+        if (cand_size(&s, set) == 0) {
+            snprintf(solution->error, sizeof(solution->error), "no package matches %s%s%s", req->name,
+                     req->op != PKG_OP_ANY ? " " : "", req->version);
+            goto out;
+        }
+        push(&s, &s.jobs, set);
+        clause_from_set(&s, 0, false, set);
+    }
+
+    /* Soft jobs: what is installed stays, at its version unless upgrading */
+    for (uint32_t i = 0; i < db->count; i++) {
+        const pkg_installed_t* item = &db->items[i];
+        uint32_t head = item->version && !item_state[i] ? pkg_index_find(index, item->name) : PKG_NONE;
+        if (head == PKG_NONE) {
+            continue;
+        }
+        cand_begin(&s);
+        if (mode == PKG_SOLVE_UPGRADE) {
+            cand_add_matching(&s, head, PKG_OP_ANY, "");
+        } else {
+            uint32_t installed = installed_record(&s, head);
+            if (installed == PKG_NONE) {
+                continue;
+            }
+            cand_add(&s, installed);
+        }
+        push(&s, &s.soft, cand_end(&s));
+        item_state[i] = ITEM_KEEP;
+    }
+
+    /* Everything reachable; expand_var() appends as it goes */
+    for (uint32_t var = 0; var < s.records.count && !s.failed; var++) {
+        expand_var(&s, var);
+    }
+    finish_problem(&s);
+    s.problem_clauses = clause_count(&s) + s.units.count;
+    if (s.failed) {
+        snprintf(solution->error, sizeof(solution->error), "out of memory");
+        goto out;
+    }
+
+    if (!search(&s)) {
+        snprintf(solution->error, sizeof(solution->error), s.failed ? "out of memory" :
+                 "the requested changes leave dependencies or conflicts that cannot be resolved");
+        goto out;
+    }
+
+    /* Read off the model */
+    for (uint32_t var = 0; var < s.records.count; var++) {
+        if (s.value[var] != 1) {
+            continue;
+        }
+        uint32_t r = s.records.items[var];
+        const pkg_installed_t* item = pkg_db_find(db, pkg_str(index, index->pkgs[r].name));
+        if (item && strcmp(item->version, pkg_str(index, index->pkgs[r].version)) == 0) {
+            continue;
+        }
+        if (!vec_push(&s.install, r)) {
+            goto out;
+        }
+    }
+    for (uint32_t i = 0; i < db->count; i++) {
+        const pkg_installed_t* item = &db->items[i];
+        uint32_t head = item_state[i] ? pkg_index_find(index, item->name) : PKG_NONE;
+        if (head != PKG_NONE && !name_kept(&s, head) && !add_remove(solution, item->name)) {
+            goto out;
+        }
+    }
+
+    solution->install = s.install.items;
+    solution->install_count = s.install.count;
+    s.install.items = NULL;
+    result = 0;
+
+out:
+    solution->vars = s.records.count;
+    solution->clauses = s.problem_clauses;
+    solution->learned = s.start.count ? clause_count(&s) + s.units.count - s.problem_clauses : 0;
+    solution->conflicts = s.conflicts_seen;
+    solution->decisions = s.decisions;
+    solution->solve_ns = pkg_now_ns() - start_ns;
+    if (result < 0 && !solution->error[0]) {
+        snprintf(solution->error, sizeof(solution->error), "out of memory");
+    }
+    solver_free(&s);
+    free(item_state);
+    return result;
+}
+
+void pkg_solution_free(pkg_solution_t* solution) {
+    for (uint32_t i = 0; i < solution->remove_count; i++) {
+        free(solution->remove[i]);
+    }
+    free(solution->remove);
+    free(solution->install);
+    memset(solution, 0, sizeof(*solution));
+}
@@ -0,0 +1,1895 @@
+/*
+ * Native Package Manager - Store
+ * Package archives and deltas, the content-addressed file store and the
+ * parallel fetch/verify/unpack/link pipeline that fills it
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pkg.h"
+
+#define PKG_PATH_MAX          512
+#define CLAIM_BUCKETS         4096
+#define IN_FLIGHT_PER_WORKER  2           /* Archives mapped at once, per worker */
+
+/* ============================================================================
+ * SHA-256
+ * ============================================================================ */
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    uint32_t used;
+} sha256_ctx_t;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_transform(uint32_t state[8], const uint8_t* data) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+               (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void sha256_init(sha256_ctx_t* ctx) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, init, sizeof(init));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_update(sha256_ctx_t* ctx, const uint8_t* data, size_t len) {
+    ctx->length += len;
+    if (ctx->used) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, data, take);
+        ctx->used += (uint32_t)take;
+        data += take;
+        len -= take;
+        if (ctx->used < 64) {
+            return;
+        }
+        sha256_transform(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    while (len >= 64) {
+        sha256_transform(ctx->state, data);
+        data += 64;
+        len -= 64;
+    }
+    memcpy(ctx->block, data, len);
+    ctx->used = (uint32_t)len;
+}
+
+static void sha256_final(sha256_ctx_t* ctx, uint8_t hash[32]) {
+    uint64_t bits = ctx->length * 8;
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        sha256_transform(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    for (int i = 0; i < 8; i++) {
+        ctx->block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_transform(ctx->state, ctx->block);
+    for (int i = 0; i < 8; i++) {
+        hash[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+        hash[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        hash[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        hash[4 * i + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void pkg_sha256(const void* data, size_t len, uint8_t hash[32]) {
+    sha256_ctx_t ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, hash);
+}
+
+void pkg_hex(const uint8_t* bytes, size_t len, char* out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[bytes[i] >> 4];
+        out[2 * i + 1] = digits[bytes[i] & 15];
+    }
+    out[2 * len] = '\0';
+}
+
+/* ============================================================================
+ * LZ codec
+ * Sequences of a token (literal length << 4 | match length - 4), the
+ * literals, then a 16-bit little-endian offset; lengths of 15 continue in
+ * bytes of 255. The last sequence is literals only.
+ * ============================================================================ */
+
+#define LZ_MIN_MATCH    4
+#define LZ_HASH_BITS    13
+#define LZ_MAX_OFFSET   65535
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint8_t* lz_put_length(uint8_t* op, uint8_t* oend, size_t len) {
+    while (len >= 255) {
+        if (op >= oend) {
+            return NULL;
+        }
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) {
+        return NULL;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t* lz_put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* lit, size_t lit_len,
+                                size_t offset, size_t match_len) {
+    if (op >= oend) {
+        return NULL;
+    }
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15 && !(op = lz_put_length(op, oend, lit_len - 15))) {
+        return NULL;
+    }
+    if ((size_t)(oend - op) < lit_len) {
+        return NULL;
+    }
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len) {
+        size_t code = match_len - LZ_MIN_MATCH;
+        *token |= (uint8_t)(code >= 15 ? 15 : code);
+        if (oend - op < 2) {
+            return NULL;
+        }
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if (code >= 15 && !(op = lz_put_length(op, oend, code - 15))) {
+            return NULL;
+        }
+    }
+    return op;
+}
+
+/* Compressed size, or 0 if it would not fit in capacity */
+static size_t lz_compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) {
+    uint32_t* table = calloc(1u << LZ_HASH_BITS, sizeof(uint32_t));
+    if (!table) {
+        return 0;
+    }
+
+    uint8_t* op = dst;
+    uint8_t* oend = dst + capacity;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    while (op && i + LZ_MIN_MATCH <= len) {
+        uint32_t seq = read32(src + i);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)i;
+
+        if (candidate < i && i - candidate <= LZ_MAX_OFFSET && read32(src + candidate) == seq) {
+            size_t match = LZ_MIN_MATCH;
+            while (i + match < len && src[candidate + match] == src[i + match]) {
+                match++;
+            }
+            op = lz_put_sequence(op, oend, src + anchor, i - anchor, i - candidate, match);
+            i += match;
+            anchor = i;
+        } else {
+            /* Skip faster through data that is not matching */
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+    if (op) {
+        op = lz_put_sequence(op, oend, src + anchor, len - anchor, 0, 0);
+    }
+    free(table);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+static int lz_get_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+/* Decode exactly dst_len bytes; every length and offset is bounds-checked */
+static int lz_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && lz_get_length(&ip, iend, &lit) < 0) {
+            return -1;
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && lz_get_length(&ip, iend, &match) < 0) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < match) {
+            return -1;
+        }
+
+        const uint8_t* from = op - offset;
+        if (offset >= match) {
+            memcpy(op, from, match);
+            op += match;
+        } else {
+            for (size_t k = 0; k < match; k++) {
+                *op++ = from[k];
+            }
+        }
+    }
+    return op == oend ? 0 : -1;
+}
+
+/* ============================================================================
+ * Archives
+ * ============================================================================ */
+
+static int write_all(int fd, const void* data, size_t len) {
+    const uint8_t* p = data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint32_t normalize_mode(uint32_t mode) {
+    return (mode & 0111) ? 0755 : 0644;
+}
+
+int pkg_archive_write(const char* path, const pkg_file_t* files, uint32_t count, uint8_t sha256[32], uint64_t* size) {
+    size_t table_size = 0;
+    size_t data_size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t path_len = strlen(files[i].path);
+        if (path_len == 0 || path_len > UINT16_MAX || files[i].size > UINT32_MAX) {
+            return -1;
+        }
+        table_size += sizeof(pkg_archive_entry_t) + path_len;
+        data_size += files[i].size;
+    }
+
+    size_t capacity = sizeof(pkg_archive_header_t) + table_size + data_size;
+    uint8_t* buf = malloc(capacity);
+    if (!buf) {
+        return -1;
+    }
+
+    pkg_archive_header_t header = {
+        .magic = PKG_ARCHIVE_MAGIC,
+        .version = PKG_ARCHIVE_VERSION,
+        .file_count = count,
+        .table_size = (uint32_t)table_size,
+    };
+    memcpy(buf, &header, sizeof(header));
+
+    uint8_t* table = buf + sizeof(header);
+    size_t offset = sizeof(header) + table_size;
+    for (uint32_t i = 0; i < count; i++) {
+        const pkg_file_t* file = &files[i];
+        pkg_archive_entry_t entry = {
+            .offset = offset,
+            .size = (uint32_t)file->size,
+            .mode = normalize_mode(file->mode),
+            .path_len = (uint16_t)strlen(file->path),
+        };
+        pkg_sha256(file->data, file->size, entry.sha256);
+
+        /* Compress only when it saves at least one byte in sixteen */
+        size_t packed = file->size >= 64 ? lz_compress(file->data, file->size, buf + offset, file->size - file->size / 16) : 0;
+        if (packed) {
+            entry.flags = PKG_ENTRY_COMPRESSED;
+            entry.stored_size = (uint32_t)packed;
+        } else {
+            memcpy(buf + offset, file->data, file->size);
+            entry.stored_size = (uint32_t)file->size;
+        }
+        offset += entry.stored_size;
+
+        memcpy(table, &entry, sizeof(entry));
+        memcpy(table + sizeof(entry), file->path, entry.path_len);
+        table += sizeof(entry) + entry.path_len;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int result = -1;
+    if (fd >= 0) {
+        result = write_all(fd, buf, offset);
+        if (close(fd) < 0) {
+            result = -1;
+        }
+    }
+    if (result == 0) {
+        pkg_sha256(buf, offset, sha256);
+        *size = offset;
+    }
+    free(buf);
+    return result;
+}
+
+/* Relative, no empty, "." or ".." components */
+bool pkg_path_safe(const char* path, size_t len) {
+    if (len == 0 || path[0] == '/') {
+        return false;
+    }
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i == len || path[i] == '/') {
+            size_t n = i - start;
+            if (n == 0 || (n == 1 && path[start] == '.') ||
+                (n == 2 && path[start] == '.' && path[start + 1] == '.')) {
+                return false;
+            }
+            start = i + 1;
+        } else if (path[i] == '\0' || path[i] == '\n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Check and copy out an archive's entry table */
+static int archive_parse(const uint8_t* data, size_t size, pkg_archive_entry_t** entries_out, pkg_manifest_t* manifest) {
+    pkg_archive_header_t header;
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != PKG_ARCHIVE_MAGIC || header.version != PKG_ARCHIVE_VERSION ||
+        header.table_size > size - sizeof(header) ||
+        header.file_count > header.table_size / sizeof(pkg_archive_entry_t)) {
+        return -1;
+    }
+
+    pkg_archive_entry_t* entries = calloc(header.file_count + 1, sizeof(pkg_archive_entry_t));
+    manifest->entries = calloc(header.file_count + 1, sizeof(pkg_manifest_entry_t));
+    manifest->count = 0;
+    if (!entries || !manifest->entries) {
+        free(entries);
+        pkg_manifest_free(manifest);
+        return -1;
+    }
+
+    const uint8_t* p = data + sizeof(header);
+    const uint8_t* end = p + header.table_size;
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        pkg_archive_entry_t* entry = &entries[i];
+        if ((size_t)(end - p) < sizeof(*entry)) {
+            goto bad;
+        }
+        memcpy(entry, p, sizeof(*entry));
+        p += sizeof(*entry);
+
+        bool compressed = entry->flags & PKG_ENTRY_COMPRESSED;
+        if ((size_t)(end - p) < entry->path_len || !pkg_path_safe((const char*)p, entry->path_len) ||
+            entry->offset > size || entry->stored_size > size - entry->offset ||
+            (!compressed && entry->stored_size != entry->size)) {
+            goto bad;
+        }
+
+        pkg_manifest_entry_t* m = &manifest->entries[i];
+        m->path = strndup((const char*)p, entry->path_len);
+        if (!m->path) {
+            goto bad;
+        }
+        memcpy(m->sha256, entry->sha256, 32);
+        m->mode = normalize_mode(entry->mode);
+        manifest->count++;
+        p += entry->path_len;
+    }
+    *entries_out = entries;
+    return 0;
+
+bad:
+    free(entries);
+    pkg_manifest_free(manifest);
+    return -1;
+}
+
+/* ============================================================================
+ * Deltas
+ * Content-defined chunking cuts old and new files at the same places
+ * wherever their bytes agree: a gear rolling hash with FastCDC's stricter
+ * mask before the average size and looser one after. An edit then costs
+ * the chunks it touches, and every other chunk becomes a copy from an
+ * object the old version already put in the store.
+ * ============================================================================ */
+
+#define CDC_MIN_SIZE    1024
+#define CDC_AVG_SIZE    4096
+#define CDC_MAX_SIZE    32768
+#define CDC_MASK_HARD   (0x1FFFULL << 51)     /* 13 high bits before the average */
+#define CDC_MASK_EASY   (0x7FFULL << 53)      /* 11 after it */
+
+static uint64_t cdc_gear[256];
+static pthread_once_t cdc_once = PTHREAD_ONCE_INIT;
+
+static void cdc_init(void) {
+    uint64_t x = 0;
+    for (int i = 0; i < 256; i++) {
+        x += 0x9E3779B97F4A7C15ULL;       /* splitmix64 */
+        uint64_t z = x;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        cdc_gear[i] = z ^ (z >> 31);
+    }
+}
+
+/* Length of the chunk starting at data */
+static size_t cdc_cut(const uint8_t* data, size_t len) {
+    if (len <= CDC_MIN_SIZE) {
+        return len;
+    }
+    size_t end = len < CDC_MAX_SIZE ? len : CDC_MAX_SIZE;
+    size_t normal = end < CDC_AVG_SIZE ? end : CDC_AVG_SIZE;
+    uint64_t h = 0;
+    size_t i = CDC_MIN_SIZE;
+    for (; i < normal; i++) {
+        h = (h << 1) + cdc_gear[data[i]];
+        if (!(h & CDC_MASK_HARD)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        h = (h << 1) + cdc_gear[data[i]];
+        if (!(h & CDC_MASK_EASY)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+/* FNV-1a, never zero so zero marks an empty slot */
+static uint64_t chunk_hash(const uint8_t* data, size_t len) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 0x100000001B3ULL;
+    }
+    return h | 1;
+}
+
+typedef struct {
+    uint64_t hash;
+    uint32_t file;                // Old file index
+    uint32_t length;
+    uint64_t offset;
+} cdc_chunk_t;
+
+typedef struct {
+    pkg_delta_op_t* ops;
+    size_t op_count;
+    size_t op_capacity;
+    uint8_t* data;                // Literal bytes, offsets fixed up on assembly
+    size_t data_size;
+    size_t data_capacity;
+} delta_builder_t;
+
+static int reserve(void** items, size_t* capacity, size_t need, size_t size) {
+    if (need <= *capacity) {
+        return 0;
+    }
+    size_t cap = *capacity ? *capacity : 64;
+    while (cap < need) {
+        cap *= 2;
+    }
+    void* grown = realloc(*items, cap * size);
+    if (!grown) {
+        return -1;
+    }
+    *items = grown;
+    *capacity = cap;
+    return 0;
+}
+
+/* A copy extends the previous one when it continues it in the same base */
+static int delta_copy(delta_builder_t* d, uint32_t first_op, uint32_t file, uint64_t offset, size_t length) {
+    if (d->op_count > first_op) {
+        pkg_delta_op_t* prev = &d->ops[d->op_count - 1];
+        if (prev->base == file && prev->offset + prev->length == offset) {
+            prev->length += (uint32_t)length;
+            return 0;
+        }
+    }
+    if (reserve((void**)&d->ops, &d->op_capacity, d->op_count + 1, sizeof(pkg_delta_op_t)) < 0) {
+        return -1;
+    }
+    d->ops[d->op_count++] = (pkg_delta_op_t){ .base = file, .length = (uint32_t)length, .offset = offset };
+    return 0;
+}
+
+static int delta_literal(delta_builder_t* d, const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (reserve((void**)&d->ops, &d->op_capacity, d->op_count + 1, sizeof(pkg_delta_op_t)) < 0 ||
+        reserve((void**)&d->data, &d->data_capacity, d->data_size + length, 1) < 0) {
+        return -1;
+    }
+    pkg_delta_op_t op = { .base = PKG_NONE, .length = (uint32_t)length, .offset = d->data_size };
+    size_t packed = length >= 64 ? lz_compress(data, length, d->data + d->data_size, length - length / 16) : 0;
+    if (packed) {
+        op.flags = PKG_ENTRY_COMPRESSED;
+        op.stored_size = (uint32_t)packed;
+    } else {
+        memcpy(d->data + d->data_size, data, length);
+        op.stored_size = (uint32_t)length;
+    }
+    d->data_size += op.stored_size;
+    d->ops[d->op_count++] = op;
+    return 0;
+}
+
+int pkg_delta_write(const char* path, const pkg_file_t* old_files, uint32_t old_count,
+                    const pkg_file_t* files, uint32_t count, uint8_t sha256[32], uint64_t* size) {
+    pthread_once(&cdc_once, cdc_init);
+
+    uint8_t (*old_sha)[32] = calloc(old_count + 1, 32);
+    uint32_t* base_of = malloc((old_count + 1) * sizeof(uint32_t));
+    pkg_delta_file_t* out_files = calloc(count + 1, sizeof(pkg_delta_file_t));
+    size_t old_bytes = 0;
+    for (uint32_t i = 0; i < old_count; i++) {
+        old_bytes += old_files[i].size;
+    }
+    size_t slot_count = 64;
+    while (slot_count < 2 * (old_bytes / CDC_MIN_SIZE + old_count + 1)) {
+        slot_count *= 2;
+    }
+    size_t slot_mask = slot_count - 1;
+    cdc_chunk_t* slots = calloc(slot_count, sizeof(cdc_chunk_t));
+    delta_builder_t d;
+    memset(&d, 0, sizeof(d));
+    uint8_t* buf = NULL;
+    int result = -1;
+    if (!old_sha || !base_of || !out_files || !slots) {
+        goto out;
+    }
+
+    /* Index every chunk of the old files; the first of identical chunks wins */
+    for (uint32_t i = 0; i < old_count; i++) {
+        const uint8_t* data = old_files[i].data;
+        pkg_sha256(data, old_files[i].size, old_sha[i]);
+        base_of[i] = PKG_NONE;
+        for (size_t pos = 0; pos < old_files[i].size;) {
+            size_t n = cdc_cut(data + pos, old_files[i].size - pos);
+            uint64_t h = chunk_hash(data + pos, n);
+            size_t s = h & slot_mask;
+            while (slots[s].hash && slots[s].hash != h) {
+                s = (s + 1) & slot_mask;
+            }
+            if (!slots[s].hash) {
+                slots[s] = (cdc_chunk_t){ .hash = h, .file = i, .length = (uint32_t)n, .offset = pos };
+            }
+            pos += n;
+        }
+    }
+
+    size_t table_size = 0;
+    for (uint32_t j = 0; j < count; j++) {
+        const pkg_file_t* file = &files[j];
+        const uint8_t* data = file->data;
+        size_t path_len = strlen(file->path);
+        if (path_len == 0 || path_len > UINT16_MAX || file->size > UINT32_MAX) {
+            goto out;
+        }
+        table_size += sizeof(pkg_delta_file_t) + path_len;
+
+        pkg_delta_file_t* f = &out_files[j];
+        f->size = (uint32_t)file->size;
+        f->mode = normalize_mode(file->mode);
+        f->path_len = (uint16_t)path_len;
+        f->first_op = (uint32_t)d.op_count;
+        pkg_sha256(data, file->size, f->sha256);
+
+        /* Unchanged contents, perhaps moved: one copy of the whole object */
+        uint32_t same = PKG_NONE;
+        for (uint32_t i = 0; i < old_count && same == PKG_NONE && file->size; i++) {
+            if (old_files[i].size == file->size && memcmp(old_sha[i], f->sha256, 32) == 0) {
+                same = i;
+            }
+        }
+        if (same != PKG_NONE) {
+            if (delta_copy(&d, f->first_op, same, 0, file->size) < 0) {
+                goto out;
+            }
+        } else {
+            size_t literal = 0;
+            size_t pos = 0;
+            while (pos < file->size) {
+                size_t n = cdc_cut(data + pos, file->size - pos);
+                uint64_t h = chunk_hash(data + pos, n);
+                size_t s = h & slot_mask;
+                while (slots[s].hash && slots[s].hash != h) {
+                    s = (s + 1) & slot_mask;
+                }
+                const cdc_chunk_t* c = &slots[s];
+                if (c->hash && c->length == n &&
+                    memcmp((const uint8_t*)old_files[c->file].data + c->offset, data + pos, n) == 0) {
+                    if (delta_literal(&d, data + literal, pos - literal) < 0 ||
+                        delta_copy(&d, f->first_op, c->file, c->offset, n) < 0) {
+                        goto out;
+                    }
+                    literal = pos + n;
+                }
+                pos += n;
+            }
+            if (delta_literal(&d, data + literal, file->size - literal) < 0) {
+                goto out;
+            }
+        }
+        f->op_count = (uint32_t)d.op_count - f->first_op;
+    }
+
+    /* Only the old files something copies from become bases */
+    uint32_t base_count = 0;
+    for (size_t o = 0; o < d.op_count; o++) {
+        pkg_delta_op_t* op = &d.ops[o];
+        if (op->base == PKG_NONE) {
+            continue;
+        }
+        if (base_of[op->base] == PKG_NONE) {
+            base_of[op->base] = base_count++;
+        }
+        op->base = base_of[op->base];
+    }
+    table_size += base_count * sizeof(pkg_delta_base_t) + d.op_count * sizeof(pkg_delta_op_t);
+    if (d.op_count > UINT32_MAX || table_size > UINT32_MAX) {
+        goto out;
+    }
+
+    size_t data_start = sizeof(pkg_delta_header_t) + table_size;
+    size_t total = data_start + d.data_size;
+    buf = malloc(total);
+    if (!buf) {
+        goto out;
+    }
+    pkg_delta_header_t header = {
+        .magic = PKG_DELTA_MAGIC,
+        .version = PKG_DELTA_VERSION,
+        .base_count = base_count,
+        .op_count = (uint32_t)d.op_count,
+        .file_count = count,
+        .table_size = (uint32_t)table_size,
+    };
+    uint8_t* p = buf;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    pkg_delta_base_t* bases = (pkg_delta_base_t*)p;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (base_of[i] != PKG_NONE) {
+            pkg_delta_base_t base = { .size = old_files[i].size, .mode = normalize_mode(old_files[i].mode) };
+            memcpy(base.sha256, old_sha[i], 32);
+            memcpy(&bases[base_of[i]], &base, sizeof(base));
+        }
+    }
+    p += base_count * sizeof(pkg_delta_base_t);
+
+    for (size_t o = 0; o < d.op_count; o++) {
+        if (d.ops[o].base == PKG_NONE) {
+            d.ops[o].offset += data_start;
+        }
+    }
+    memcpy(p, d.ops, d.op_count * sizeof(pkg_delta_op_t));
+    p += d.op_count * sizeof(pkg_delta_op_t);
+
+    for (uint32_t j = 0; j < count; j++) {
+        memcpy(p, &out_files[j], sizeof(pkg_delta_file_t));
+        memcpy(p + sizeof(pkg_delta_file_t), files[j].path, out_files[j].path_len);
+        p += sizeof(pkg_delta_file_t) + out_files[j].path_len;
+    }
+    if (d.data_size) {
+        memcpy(p, d.data, d.data_size);
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        result = write_all(fd, buf, total);
+        if (close(fd) < 0) {
+            result = -1;
+        }
+    }
+    if (result == 0) {
+        pkg_sha256(buf, total, sha256);
+        *size = total;
+    }
+
+out:
+    free(buf);
+    free(d.ops);
+    free(d.data);
+    free(slots);
+    free(out_files);
+    free(base_of);
+    free(old_sha);
+    return result;
+}
+
+/*
+ * Check a delta's tables and copy out its files. Bases, ops and files stay
+ * in the mapping; every op is bounds-checked here so applying is a plain copy.
+ */
+static int delta_parse(const uint8_t* data, size_t size, pkg_delta_file_t** files_out,
+                       pkg_archive_entry_t** entries_out, pkg_manifest_t* manifest) {
+    pkg_delta_header_t header;
+    if (size < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, data, sizeof(header));
+    uint64_t fixed = (uint64_t)header.base_count * sizeof(pkg_delta_base_t) +
+                     (uint64_t)header.op_count * sizeof(pkg_delta_op_t) +
+                     (uint64_t)header.file_count * sizeof(pkg_delta_file_t);
+    if (header.magic != PKG_DELTA_MAGIC || header.version != PKG_DELTA_VERSION ||
+        header.table_size > size - sizeof(header) || fixed > header.table_size) {
+        return -1;
+    }
+
+    const pkg_delta_base_t* bases = (const pkg_delta_base_t*)(data + sizeof(header));
+    const pkg_delta_op_t* ops = (const pkg_delta_op_t*)(bases + header.base_count);
+    for (uint32_t o = 0; o < header.op_count; o++) {
+        const pkg_delta_op_t* op = &ops[o];
+        bool bad = op->base == PKG_NONE ?
+            op->offset > size || op->stored_size > size - op->offset ||
+                (!(op->flags & PKG_ENTRY_COMPRESSED) && op->stored_size != op->length) :
+            op->base >= header.base_count || op->offset > bases[op->base].size ||
+                op->length > bases[op->base].size - op->offset;
+        if (bad) {
+            return -1;
+        }
+    }
+
+    pkg_delta_file_t* files = calloc(header.file_count + 1, sizeof(pkg_delta_file_t));
+    pkg_archive_entry_t* entries = calloc(header.file_count + 1, sizeof(pkg_archive_entry_t));
+    manifest->entries = calloc(header.file_count + 1, sizeof(pkg_manifest_entry_t));
+    manifest->count = 0;
+    if (!files || !entries || !manifest->entries) {
+        goto bad;
+    }
+
+    const uint8_t* p = (const uint8_t*)(ops + header.op_count);
+    const uint8_t* end = data + sizeof(header) + header.table_size;
+    for (uint32_t i = 0; i < header.file_count; i++) {
+        pkg_delta_file_t* f = &files[i];
+        if ((size_t)(end - p) < sizeof(*f)) {
+            goto bad;
+        }
+        memcpy(f, p, sizeof(*f));
+        p += sizeof(*f);
+        if ((size_t)(end - p) < f->path_len || !pkg_path_safe((const char*)p, f->path_len) ||
+            f->first_op > header.op_count || f->op_count > header.op_count - f->first_op) {
+            goto bad;
+        }
+        uint64_t covered = 0;
+        for (uint32_t o = f->first_op; o < f->first_op + f->op_count; o++) {
+            covered += ops[o].length;
+        }
+        if (covered != f->size) {
+            goto bad;
+        }
+
+        pkg_manifest_entry_t* m = &manifest->entries[i];
+        m->path = strndup((const char*)p, f->path_len);
+        if (!m->path) {
+            goto bad;
+        }
+        memcpy(m->sha256, f->sha256, 32);
+        m->mode = normalize_mode(f->mode);
+        manifest->count++;
+        entries[i].size = f->size;
+        entries[i].mode = m->mode;
+        entries[i].path_len = f->path_len;
+        memcpy(entries[i].sha256, f->sha256, 32);
+        p += f->path_len;
+    }
+    *files_out = files;
+    *entries_out = entries;
+    return 0;
+
+bad:
+    free(files);
+    free(entries);
+    pkg_manifest_free(manifest);
+    return -1;
+}
+
+/* ============================================================================
+ * Store
+ * Objects live at store/ab/<sha256>, with ".x" for executables since hard
+ * links share one mode; a link count of one means no package uses it.
+ * Objects are read-only: every installed copy is a link to the same inode.
+ * ============================================================================ */
+
+static uint32_t object_mode(uint32_t mode) {
+    return mode & 0555;
+}
+
+static bool object_path(const char* store, const uint8_t sha256[32], uint32_t mode, char* out, size_t size) {
+    char hex[65];
+    pkg_hex(sha256, 32, hex);
+    return snprintf(out, size, "%s/%.2s/%s%s", store, hex, hex, (mode & 0111) ? ".x" : "") < (int)size;
+}
+
+static int make_parent_dirs(const char* path) {
+    char buf[PKG_PATH_MAX];
+    snprintf(buf, sizeof(buf), "%s", path);
+    char* slash = strrchr(buf, '/');
+    if (!slash || slash == buf) {
+        return 0;
+    }
+    *slash = '\0';
+    for (char* p = buf + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, 0755) < 0 && errno != EEXIST) {
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+    return (mkdir(buf, 0755) < 0 && errno != EEXIST) ? -1 : 0;
+}
+
+/* Write an object under a private name and rename it in, so readers only ever see whole files */
+static int object_write(const char* path, const void* data, size_t len, uint32_t mode) {
+    char tmp[PKG_PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%lx.tmp", path, (unsigned long)pthread_self());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    if (fd < 0 && errno == ENOENT && make_parent_dirs(tmp) == 0) {
+        fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, mode);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    int result = write_all(fd, data, len);
+    if (close(fd) < 0 || result < 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int copy_file(const char* from, const char* to, uint32_t mode) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) {
+        return -1;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(in, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+    }
+    close(in);
+    if (st.st_size > 0 && map == MAP_FAILED) {
+        return -1;
+    }
+    int result = object_write(to, st.st_size > 0 ? map : "", (size_t)st.st_size, mode);
+    if (map != MAP_FAILED) {
+        munmap(map, (size_t)st.st_size);
+    }
+    return result;
+}
+
+/* Hard link object at dst, replacing whatever is there; copies where links cannot go */
+static int link_object(const char* object, const char* dst, uint32_t mode) {
+    char tmp[PKG_PATH_MAX + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%lx.new", dst, (unsigned long)pthread_self());
+
+    int rc = link(object, tmp);
+    if (rc < 0 && errno == ENOENT && make_parent_dirs(tmp) == 0) {
+        rc = link(object, tmp);
+    }
+    if (rc < 0 && errno == EEXIST) {
+        unlink(tmp);
+        rc = link(object, tmp);
+    }
+    if (rc < 0 && (errno == EXDEV || errno == EPERM || errno == EMLINK)) {
+        return copy_file(object, dst, mode);
+    }
+    if (rc < 0) {
+        return -1;
+    }
+    /* rename() between two links to one file succeeds without doing anything: drop ours either way */
+    rc = rename(tmp, dst);
+    unlink(tmp);
+    return rc;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    return strcmp(((const pkg_manifest_entry_t*)a)->path, ((const pkg_manifest_entry_t*)b)->path);
+}
+
+/* Line one is the version, then "sha256 mode path" per file, sorted by path */
+int pkg_manifest_load(const char* path, pkg_manifest_t* manifest, char* version, size_t version_size) {
+    memset(manifest, 0, sizeof(*manifest));
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    char line[PKG_PATH_MAX + 96];
+    uint32_t capacity = 0;
+    int result = 0;
+    if (!fgets(line, sizeof(line), f)) {
+        fclose(f);
+        return -1;
+    }
+    if (version) {
+        line[strcspn(line, "\n")] = '\0';
+        snprintf(version, version_size, "%s", line);
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char hex[65];
+        unsigned mode;
+        int path_at = 0;
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%64s %o %n", hex, &mode, &path_at) != 2 || !path_at || strlen(hex) != 64) {
+            continue;
+        }
+        if (manifest->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            pkg_manifest_entry_t* entries = realloc(manifest->entries, capacity * sizeof(pkg_manifest_entry_t));
+            if (!entries) {
+                result = -1;
+                break;
+            }
+            manifest->entries = entries;
+        }
+        pkg_manifest_entry_t* entry = &manifest->entries[manifest->count];
+        for (int i = 0; i < 32; i++) {
+            unsigned byte;
+            sscanf(hex + 2 * i, "%2x", &byte);
+            entry->sha256[i] = (uint8_t)byte;
+        }
+        entry->mode = mode;
+        if (!(entry->path = strdup(line + path_at))) {
+            result = -1;
+            break;
+        }
+        manifest->count++;
+    }
+    fclose(f);
+    if (result < 0) {
+        pkg_manifest_free(manifest);
+    }
+    return result;
+}
+
+static int manifest_save(const char* path, const pkg_manifest_t* manifest, const char* version) {
+    char tmp[PKG_PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (!f && errno == ENOENT && make_parent_dirs(tmp) == 0) {
+        f = fopen(tmp, "w");
+    }
+    if (!f) {
+        return -1;
+    }
+    fprintf(f, "%s\n", version);
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        char hex[65];
+        pkg_hex(manifest->entries[i].sha256, 32, hex);
+        fprintf(f, "%s %o %s\n", hex, manifest->entries[i].mode, manifest->entries[i].path);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+void pkg_manifest_free(pkg_manifest_t* manifest) {
+    for (uint32_t i = 0; i < manifest->count; i++) {
+        free(manifest->entries[i].path);
+    }
+    free(manifest->entries);
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+/* Whether an object's contents still hash to its name */
+static bool object_intact(const char* path, const char* name, off_t size) {
+    size_t len = strlen(name);
+    if (len != 64 && !(len == 66 && strcmp(name + 64, ".x") == 0)) {
+        return true;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return true;
+    }
+    void* map = size > 0 ? mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return true;
+    }
+
+    uint8_t hash[32];
+    char hex[65];
+    pkg_sha256(map ? map : "", (size_t)size, hash);
+    pkg_hex(hash, 32, hex);
+    if (map) {
+        munmap(map, (size_t)size);
+    }
+    return strncmp(hex, name, 64) == 0;
+}
+
+/*
+ * Drop objects nothing links to any more, and objects whose contents no
+ * longer match their hash so the next install writes them again
+ */
+int pkg_store_clean(const char* state_dir, uint64_t* removed, uint64_t* corrupt) {
+    char store[PKG_PATH_MAX];
+    snprintf(store, sizeof(store), "%s/store", state_dir);
+    *removed = 0;
+    *corrupt = 0;
+
+    DIR* top = opendir(store);
+    if (!top) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct dirent* bucket;
+    while ((bucket = readdir(top))) {
+        if (bucket->d_name[0] == '.') {
+            continue;
+        }
+        char dir_path[PKG_PATH_MAX];
+        if (snprintf(dir_path, sizeof(dir_path), "%s/%s", store, bucket->d_name) >= (int)sizeof(dir_path)) {
+            continue;
+        }
+        DIR* dir = opendir(dir_path);
+        if (!dir) {
+            continue;
+        }
+        struct dirent* object;
+        while ((object = readdir(dir))) {
+            char path[PKG_PATH_MAX + 256];
+            struct stat st;
+            if (object->d_name[0] == '.') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir_path, object->d_name);
+            if (lstat(path, &st) < 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            if (st.st_nlink == 1) {
+                *removed += unlink(path) == 0;
+            } else if (!object_intact(path, object->d_name, st.st_size)) {
+                fprintf(stderr, "pkg: store object %s no longer matches its hash\n", object->d_name);
+                *corrupt += unlink(path) == 0;
+            }
+        }
+        closedir(dir);
+    }
+    closedir(top);
+    return 0;
+}
+
+/* ============================================================================
+ * Install pipeline
+ * ============================================================================ */
+
+/*
+ * Each package passes fetch -> verify -> unpack -> link. Workers always
+ * take the latest stage first, so packages already started finish before
+ * new archives are mapped, and unpacking fans out per file. An object two
+ * packages share is claimed by the first and only waited on by the second,
+ * so it is decompressed and written once.
+ *
+ * An installed version the mirror has a delta from is upgraded from the
+ * delta instead of the archive, rebuilding each file from the objects the
+ * old version left in the store. A remote mirror's files are downloaded to
+ * the cache first, in parallel ranges that survive an interrupted run.
+ */
+enum {
+    STAGE_FETCH,
+    STAGE_VERIFY,
+    STAGE_UNPACK,
+    STAGE_LINK,
+    STAGE_COUNT,
+};
+
+typedef struct pkg_unit pkg_unit_t;
+
+typedef struct pkg_job {
+    struct pkg_job* next;
+    pkg_unit_t* unit;
+    uint32_t entry;
+    uint32_t stage;
+} pkg_job_t;
+
+struct pkg_unit {
+    uint32_t record;
+    const uint8_t* data;          // Mapped archive or delta
+    size_t size;
+    const pkg_delta_ref_t* delta; // Source is this delta, NULL for the archive
+    pkg_delta_file_t* delta_files;
+    pkg_archive_entry_t* entries;
+    pkg_manifest_t manifest;
+    pkg_manifest_t old;           // Files of the installed version
+    bool has_old;
+    pkg_job_t job;                // Fetch, verify and link, one at a time
+    pkg_job_t* unpack_jobs;
+    uint32_t unpacking;           // Own unpack jobs left; the archive is unmapped at zero
+    uint32_t pending;             // Objects still missing before the link can run
+    bool failed;
+    bool done;
+};
+
+typedef struct claim {
+    struct claim* next;
+    uint8_t sha256[32];
+    uint32_t mode;
+    bool done;
+    bool failed;
+    pkg_unit_t** waiters;
+    uint32_t waiter_count;
+} claim_t;
+
+typedef struct {
+    const pkg_config_t* config;
+    const pkg_index_t* index;
+    char state[PKG_PATH_MAX];
+    char store[PKG_PATH_MAX];
+    char cache[PKG_PATH_MAX];     // Downloads from a remote mirror
+    bool remote;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pkg_job_t* head[STAGE_COUNT];
+    pkg_job_t* tail[STAGE_COUNT];
+    uint32_t in_flight;
+    uint32_t in_flight_max;
+    uint32_t remaining;           // Units not yet linked or failed
+    claim_t* claims[CLAIM_BUCKETS];
+
+    pkg_install_stats_t stats;
+} pipeline_t;
+
+/* Caller holds the lock */
+static void queue_job(pipeline_t* p, pkg_job_t* job, uint32_t stage) {
+    job->stage = stage;
+    job->next = NULL;
+    if (p->tail[stage]) {
+        p->tail[stage]->next = job;
+    } else {
+        p->head[stage] = job;
+    }
+    p->tail[stage] = job;
+    pthread_cond_signal(&p->work);
+}
+
+/* Latest stage first; a new archive only while under the mapping limit. Caller holds the lock */
+static pkg_job_t* take_job(pipeline_t* p) {
+    for (int stage = STAGE_COUNT - 1; stage >= 0; stage--) {
+        pkg_job_t* job = p->head[stage];
+        if (!job || (stage == STAGE_FETCH && p->in_flight >= p->in_flight_max)) {
+            continue;
+        }
+        p->head[stage] = job->next;
+        if (!p->head[stage]) {
+            p->tail[stage] = NULL;
+        }
+        if (stage == STAGE_FETCH) {
+            p->in_flight++;
+        }
+        return job;
+    }
+    return NULL;
+}
+
+/* Caller holds the lock */
+static void unit_release_archive(pipeline_t* p, pkg_unit_t* unit) {
+    if (unit->data) {
+        munmap((void*)unit->data, unit->size);
+        unit->data = NULL;
+    }
+    p->in_flight--;
+    pthread_cond_signal(&p->work);
+}
+
+/* One thing the unit waited for is done. Caller holds the lock */
+static void unit_settle(pipeline_t* p, pkg_unit_t* unit) {
+    if (--unit->pending == 0) {
+        queue_job(p, &unit->job, STAGE_LINK);
+    }
+}
+
+static claim_t** claim_slot(pipeline_t* p, const uint8_t sha256[32], uint32_t mode) {
+    uint32_t bucket = (read32(sha256) ^ mode) % CLAIM_BUCKETS;
+    claim_t** link = &p->claims[bucket];
+    while (*link && (memcmp((*link)->sha256, sha256, 32) != 0 || (*link)->mode != mode)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/* Where a mirror file is read from: the mirror itself, or its download in the cache */
+static bool source_path(pipeline_t* p, const char* rel, char* out, size_t size) {
+    if (!p->remote) {
+        return snprintf(out, size, "%s/%s", p->config->mirror, rel) < (int)size;
+    }
+    const char* leaf = strrchr(rel, '/');
+    return snprintf(out, size, "%s/%s", p->cache, leaf ? leaf + 1 : rel) < (int)size;
+}
+
+/* Download if remote, then map. NULL on failure */
+static const uint8_t* source_map(pipeline_t* p, const char* rel, uint64_t size) {
+    char path[PKG_PATH_MAX];
+    if (!source_path(p, rel, path, sizeof(path)) ||
+        (p->remote && pkg_net_fetch(p->config->mirror, rel, path, size, p->config->connections) < 0)) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (uint64_t)st.st_size == size && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_WILLNEED);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return map == MAP_FAILED ? NULL : map;
+}
+
+/* A download that failed verification is dropped so the next run fetches it again */
+static void source_discard(pipeline_t* p, const char* rel) {
+    char path[PKG_PATH_MAX];
+    if (p->remote && source_path(p, rel, path, sizeof(path))) {
+        unlink(path);
+    }
+}
+
+/* Read part of a mirror file without fetching the rest */
+static int source_read(pipeline_t* p, const char* rel, uint64_t offset, uint64_t length, void* buf) {
+    if (p->remote) {
+        return pkg_net_read(p->config->mirror, rel, offset, length, buf);
+    }
+    char path[PKG_PATH_MAX];
+    int fd = source_path(p, rel, path, sizeof(path)) ? open(path, O_RDONLY) : -1;
+    if (fd < 0) {
+        return -1;
+    }
+    uint8_t* out = buf;
+    uint64_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, out + done, (size_t)(length - done), (off_t)(offset + done));
+        if (n <= 0) {
+            break;
+        }
+        done += (uint64_t)n;
+    }
+    close(fd);
+    return done == length ? 0 : -1;
+}
+
+static void stage_fetch(pipeline_t* p, pkg_unit_t* unit) {
+    const pkg_record_t* rec = &p->index->pkgs[unit->record];
+    char list[PKG_PATH_MAX];
+    char version[64];
+
+    if (snprintf(list, sizeof(list), "%s/info/%s.list", p->state, pkg_str(p->index, rec->name)) < (int)sizeof(list) &&
+        pkg_manifest_load(list, &unit->old, version, sizeof(version)) == 0) {
+        unit->has_old = true;
+        for (uint32_t d = 0; !p->config->no_deltas && d < rec->delta_count; d++) {
+            const pkg_delta_ref_t* ref = &p->index->deltas[rec->deltas + d];
+            if (strcmp(pkg_str(p->index, ref->from), version) == 0) {
+                unit->delta = ref;
+                break;
+            }
+        }
+    }
+
+    const char* rel = pkg_str(p->index, unit->delta ? unit->delta->filename : rec->filename);
+    uint64_t size = unit->delta ? unit->delta->size : rec->size;
+    const uint8_t* map = source_map(p, rel, size);
+    if (!map && unit->delta) {
+        unit->delta = NULL;
+        rel = pkg_str(p->index, rec->filename);
+        size = rec->size;
+        map = source_map(p, rel, size);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (!map) {
+        fprintf(stderr, "pkg: cannot fetch %s\n", rel);
+        unit->failed = true;
+        unit_release_archive(p, unit);
+        unit_settle(p, unit);
+    } else {
+        unit->data = map;
+        unit->size = (size_t)size;
+        p->stats.archives++;
+        p->stats.archive_bytes += unit->size;
+        queue_job(p, &unit->job, STAGE_VERIFY);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Hash and parse a delta, and check the store still has every object it copies from */
+static bool verify_delta(pipeline_t* p, pkg_unit_t* unit) {
+    uint8_t hash[32];
+    pkg_sha256(unit->data, unit->size, hash);
+    if (memcmp(hash, unit->delta->sha256, 32) != 0) {
+        source_discard(p, pkg_str(p->index, unit->delta->filename));
+        return false;
+    }
+    if (delta_parse(unit->data, unit->size, &unit->delta_files, &unit->entries, &unit->manifest) < 0) {
+        return false;
+    }
+
+    pkg_delta_header_t header;
+    memcpy(&header, unit->data, sizeof(header));
+    const pkg_delta_base_t* bases = (const pkg_delta_base_t*)(unit->data + sizeof(header));
+    for (uint32_t b = 0; b < header.base_count; b++) {
+        char path[PKG_PATH_MAX];
+        struct stat st;
+        if (!object_path(p->store, bases[b].sha256, bases[b].mode, path, sizeof(path)) ||
+            stat(path, &st) < 0 || (uint64_t)st.st_size != bases[b].size) {
+            free(unit->delta_files);
+            free(unit->entries);
+            pkg_manifest_free(&unit->manifest);
+            unit->delta_files = NULL;
+            unit->entries = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void stage_verify(pipeline_t* p, pkg_unit_t* unit) {
+    const pkg_record_t* rec = &p->index->pkgs[unit->record];
+    uint8_t hash[32];
+    bool ok = true;
+
+    /* A delta that cannot be used falls back to the full archive */
+    if (unit->delta && !verify_delta(p, unit)) {
+        if (p->config->verbose) {
+            printf("Delta for %s unusable, fetching the full archive\n", pkg_str(p->index, rec->name));
+        }
+        munmap((void*)unit->data, unit->size);
+        unit->delta = NULL;
+        unit->size = (size_t)rec->size;
+        unit->data = source_map(p, pkg_str(p->index, rec->filename), rec->size);
+        if (!unit->data) {
+            fprintf(stderr, "pkg: cannot fetch %s\n", pkg_str(p->index, rec->filename));
+            ok = false;
+        }
+        pthread_mutex_lock(&p->lock);
+        p->stats.archive_bytes += unit->data ? unit->size : 0;
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    if (ok && !unit->delta) {
+        pkg_sha256(unit->data, unit->size, hash);
+        if (memcmp(hash, rec->sha256, 32) != 0) {
+            fprintf(stderr, "pkg: %s: archive hash mismatch\n", pkg_str(p->index, rec->filename));
+            source_discard(p, pkg_str(p->index, rec->filename));
+            ok = false;
+        } else if (archive_parse(unit->data, unit->size, &unit->entries, &unit->manifest) < 0) {
+            fprintf(stderr, "pkg: %s: malformed archive\n", pkg_str(p->index, rec->filename));
+            ok = false;
+        }
+    }
+    if (ok && unit->manifest.count &&
+        !(unit->unpack_jobs = calloc(unit->manifest.count, sizeof(pkg_job_t)))) {
+        ok = false;
+    }
+
+    /* Objects the store already has cost one stat; the rest are claimed or waited on */
+    bool* present = ok ? calloc(unit->manifest.count + 1, sizeof(bool)) : NULL;
+    for (uint32_t i = 0; present && i < unit->manifest.count; i++) {
+        char path[PKG_PATH_MAX];
+        struct stat st;
+        present[i] = object_path(p->store, unit->entries[i].sha256, unit->manifest.entries[i].mode, path, sizeof(path)) &&
+                     stat(path, &st) == 0;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (ok && !present) {
+        ok = false;
+    }
+    if (ok && unit->delta) {
+        p->stats.deltas++;
+        p->stats.delta_saved += rec->size > unit->delta->size ? rec->size - unit->delta->size : 0;
+    }
+    for (uint32_t i = 0; ok && i < unit->manifest.count; i++) {
+        const pkg_manifest_entry_t* m = &unit->manifest.entries[i];
+        if (present[i]) {
+            p->stats.objects_deduped++;
+            continue;
+        }
+
+        claim_t** slot = claim_slot(p, m->sha256, m->mode);
+        claim_t* claim = *slot;
+        if (!claim) {
+            if (!(claim = calloc(1, sizeof(claim_t)))) {
+                ok = false;
+                break;
+            }
+            memcpy(claim->sha256, m->sha256, 32);
+            claim->mode = m->mode;
+            *slot = claim;
+            unit->unpacking++;
+            unit->pending++;
+            unit->unpack_jobs[i].unit = unit;
+            unit->unpack_jobs[i].entry = i;
+            queue_job(p, &unit->unpack_jobs[i], STAGE_UNPACK);
+            continue;
+        }
+
+        p->stats.objects_deduped++;
+        if (claim->done) {
+            ok = !claim->failed;
+            continue;
+        }
+        pkg_unit_t** waiters = realloc(claim->waiters, (claim->waiter_count + 1) * sizeof(pkg_unit_t*));
+        if (!waiters) {
+            ok = false;
+            break;
+        }
+        claim->waiters = waiters;
+        claim->waiters[claim->waiter_count++] = unit;
+        unit->pending++;
+    }
+    if (!ok) {
+        unit->failed = true;
+    }
+    if (unit->unpacking == 0) {
+        unit_release_archive(p, unit);
+    }
+    unit_settle(p, unit);
+    pthread_mutex_unlock(&p->lock);
+    free(present);
+}
+
+/* Rebuild one file from its delta ops: literals from the delta, copies from store objects */
+static int delta_apply(pipeline_t* p, pkg_unit_t* unit, uint32_t i, uint8_t* buf) {
+    const pkg_delta_file_t* f = &unit->delta_files[i];
+    pkg_delta_header_t header;
+    memcpy(&header, unit->data, sizeof(header));
+    const pkg_delta_base_t* bases = (const pkg_delta_base_t*)(unit->data + sizeof(header));
+    const pkg_delta_op_t* ops = (const pkg_delta_op_t*)(bases + header.base_count);
+    uint32_t open_base = PKG_NONE;
+    int fd = -1;
+    size_t pos = 0;
+    int result = 0;
+
+    for (uint32_t o = f->first_op; result == 0 && o < f->first_op + f->op_count; o++) {
+        const pkg_delta_op_t* op = &ops[o];
+        if (op->base == PKG_NONE) {
+            if (op->flags & PKG_ENTRY_COMPRESSED) {
+                result = lz_decompress(unit->data + op->offset, op->stored_size, buf + pos, op->length);
+            } else {
+                memcpy(buf + pos, unit->data + op->offset, op->length);
+            }
+        } else {
+            if (op->base != open_base) {
+                char path[PKG_PATH_MAX];
+                if (fd >= 0) {
+                    close(fd);
+                }
+                open_base = op->base;
+                fd = object_path(p->store, bases[op->base].sha256, bases[op->base].mode, path, sizeof(path)) ?
+                     open(path, O_RDONLY) : -1;
+            }
+            size_t done = 0;
+            while (fd >= 0 && done < op->length) {
+                ssize_t n = pread(fd, buf + pos + done, op->length - done, (off_t)(op->offset + done));
+                if (n <= 0) {
+                    break;
+                }
+                done += (size_t)n;
+            }
+            result = done == op->length ? 0 : -1;
+        }
+        pos += op->length;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    /* Copies read whatever the object holds now: only the hash says it was the expected base */
+    uint8_t hash[32];
+    if (result == 0) {
+        pkg_sha256(buf, f->size, hash);
+        result = memcmp(hash, f->sha256, 32) == 0 ? 0 : -1;
+    }
+    return result;
+}
+
+/* One file straight from the full archive, by range: the header, the entry table, then its data */
+static int archive_extract(pipeline_t* p, const pkg_record_t* rec, const pkg_manifest_entry_t* m,
+                           uint8_t* buf, uint32_t size) {
+    const char* rel = pkg_str(p->index, rec->filename);
+    pkg_archive_header_t header;
+    if (source_read(p, rel, 0, sizeof(header), &header) < 0 || header.magic != PKG_ARCHIVE_MAGIC ||
+        header.table_size > rec->size - sizeof(header)) {
+        return -1;
+    }
+    uint8_t* table = malloc(sizeof(header) + header.table_size);
+    if (!table || source_read(p, rel, 0, sizeof(header) + header.table_size, table) < 0) {
+        free(table);
+        return -1;
+    }
+
+    pkg_archive_entry_t* entries = NULL;
+    pkg_manifest_t manifest;
+    int result = -1;
+    if (archive_parse(table, rec->size, &entries, &manifest) == 0) {
+        for (uint32_t e = 0; e < manifest.count; e++) {
+            const pkg_archive_entry_t* entry = &entries[e];
+            if (strcmp(manifest.entries[e].path, m->path) != 0 || entry->size != size ||
+                memcmp(entry->sha256, m->sha256, 32) != 0) {
+                continue;
+            }
+            uint8_t* stored = malloc(entry->stored_size ? entry->stored_size : 1);
+            if (stored && source_read(p, rel, entry->offset, entry->stored_size, stored) == 0) {
+                if (entry->flags & PKG_ENTRY_COMPRESSED) {
+                    result = lz_decompress(stored, entry->stored_size, buf, size);
+                } else {
+                    memcpy(buf, stored, size);
+                    result = 0;
+                }
+            }
+            free(stored);
+            break;
+        }
+        free(entries);
+        pkg_manifest_free(&manifest);
+    }
+    free(table);
+
+    uint8_t hash[32];
+    if (result == 0) {
+        pkg_sha256(buf, size, hash);
+        result = memcmp(hash, m->sha256, 32) == 0 ? 0 : -1;
+    }
+    return result;
+}
+
+static void stage_unpack(pipeline_t* p, pkg_unit_t* unit, uint32_t i) {
+    const pkg_archive_entry_t* entry = &unit->entries[i];
+    const pkg_manifest_entry_t* m = &unit->manifest.entries[i];
+    const uint8_t* stored = unit->data + entry->offset;
+    char path[PKG_PATH_MAX];
+    bool ok = false;
+    bool fallback = false;
+
+    if (!object_path(p->store, m->sha256, m->mode, path, sizeof(path))) {
+        ok = false;
+    } else if (unit->delta) {
+        uint8_t* buf = malloc(entry->size ? entry->size : 1);
+        if (buf && delta_apply(p, unit, i, buf) < 0) {
+            fallback = true;
+            if (archive_extract(p, &p->index->pkgs[unit->record], m, buf, entry->size) < 0) {
+                free(buf);
+                buf = NULL;
+            }
+        }
+        ok = buf && object_write(path, buf, entry->size, object_mode(m->mode)) == 0;
+        free(buf);
+    } else if (!(entry->flags & PKG_ENTRY_COMPRESSED)) {
+        ok = object_write(path, stored, entry->size, object_mode(m->mode)) == 0;
+    } else {
+        uint8_t* buf = malloc(entry->size ? entry->size : 1);
+        if (buf && lz_decompress(stored, entry->stored_size, buf, entry->size) == 0) {
+            ok = object_write(path, buf, entry->size, object_mode(m->mode)) == 0;
+        }
+        free(buf);
+    }
+    if (!ok) {
+        fprintf(stderr, "pkg: cannot unpack %s\n", m->path);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    claim_t* claim = *claim_slot(p, m->sha256, m->mode);
+    claim->done = true;
+    claim->failed = !ok;
+    for (uint32_t w = 0; w < claim->waiter_count; w++) {
+        if (!ok) {
+            claim->waiters[w]->failed = true;
+        }
+        unit_settle(p, claim->waiters[w]);
+    }
+    free(claim->waiters);
+    claim->waiters = NULL;
+    claim->waiter_count = 0;
+
+    p->stats.delta_fallbacks += fallback;
+    if (ok) {
+        p->stats.objects_written++;
+    } else {
+        unit->failed = true;
+    }
+    if (--unit->unpacking == 0) {
+        unit_release_archive(p, unit);
+    }
+    unit_settle(p, unit);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Link every file into the root, drop files the old version had and this one does not */
+static void stage_link(pipeline_t* p, pkg_unit_t* unit) {
+    const pkg_record_t* rec = &p->index->pkgs[unit->record];
+    uint64_t bytes = 0;
+    bool ok = !unit->failed;
+
+    for (uint32_t i = 0; ok && i < unit->manifest.count; i++) {
+        const pkg_manifest_entry_t* m = &unit->manifest.entries[i];
+        char object[PKG_PATH_MAX];
+        char dst[PKG_PATH_MAX];
+        if (!object_path(p->store, m->sha256, m->mode, object, sizeof(object)) ||
+            snprintf(dst, sizeof(dst), "%s/%s", p->config->root, m->path) >= (int)sizeof(dst) ||
+            link_object(object, dst, m->mode) < 0) {
+            fprintf(stderr, "pkg: cannot install %s: %s\n", dst, strerror(errno));
+            ok = false;
+        }
+        bytes += unit->entries[i].size;
+    }
+
+    char list[PKG_PATH_MAX];
+    if (ok && snprintf(list, sizeof(list), "%s/info/%s.list", p->state, pkg_str(p->index, rec->name)) >= (int)sizeof(list)) {
+        ok = false;
+    }
+    if (ok) {
+        qsort(unit->manifest.entries, unit->manifest.count, sizeof(pkg_manifest_entry_t), compare_entries);
+
+        if (unit->has_old) {
+            pkg_manifest_t old = unit->old;
+            qsort(old.entries, old.count, sizeof(pkg_manifest_entry_t), compare_entries);
+            uint32_t j = 0;
+            for (uint32_t i = 0; i < old.count; i++) {
+                while (j < unit->manifest.count && strcmp(unit->manifest.entries[j].path, old.entries[i].path) < 0) {
+                    j++;
+                }
+                if (j == unit->manifest.count || strcmp(unit->manifest.entries[j].path, old.entries[i].path) != 0) {
+                    char stale[PKG_PATH_MAX];
+                    snprintf(stale, sizeof(stale), "%s/%s", p->config->root, old.entries[i].path);
+                    unlink(stale);
+                }
+            }
+        }
+        ok = manifest_save(list, &unit->manifest, pkg_str(p->index, rec->version)) == 0;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (ok) {
+        p->stats.files += unit->manifest.count;
+        p->stats.bytes += bytes;
+    } else {
+        unit->failed = true;
+        p->stats.failed++;
+    }
+    unit->done = true;
+    if (--p->remaining == 0) {
+        pthread_cond_broadcast(&p->work);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void* pipeline_worker(void* arg) {
+    pipeline_t* p = arg;
+
+    pthread_mutex_lock(&p->lock);
+    while (p->remaining) {
+        pkg_job_t* job = take_job(p);
+        if (!job) {
+            pthread_cond_wait(&p->work, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        switch (job->stage) {
+        case STAGE_FETCH:
+            stage_fetch(p, job->unit);
+            break;
+        case STAGE_VERIFY:
+            stage_verify(p, job->unit);
+            break;
+        case STAGE_UNPACK:
+            stage_unpack(p, job->unit, job->entry);
+            break;
+        default:
+            stage_link(p, job->unit);
+            break;
+        }
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+int pkg_install_records(const pkg_config_t* config, const pkg_index_t* index,
+                        const uint32_t* records, uint32_t count, bool* installed,
+                        pkg_install_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (count == 0) {
+        return 0;
+    }
+
+    pipeline_t* p = calloc(1, sizeof(pipeline_t));
+    pkg_unit_t* units = calloc(count, sizeof(pkg_unit_t));
+    if (!p || !units) {
+        free(p);
+        free(units);
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workers = config->threads ? config->threads : (cpus > 0 ? (uint32_t)cpus : 1);
+    if (workers > count * 4) {
+        workers = count * 4;
+    }
+
+    p->config = config;
+    p->index = index;
+    if (snprintf(p->store, sizeof(p->store), "%s/%s/store", config->root, PKG_STATE_DIR) >= (int)sizeof(p->store) - 80) {
+        fprintf(stderr, "pkg: install root path too long\n");
+        free(p);
+        free(units);
+        return -1;
+    }
+    snprintf(p->state, sizeof(p->state), "%s/%s", config->root, PKG_STATE_DIR);
+    p->remote = pkg_mirror_is_remote(config->mirror);
+    if (p->remote && (snprintf(p->cache, sizeof(p->cache), "%s/cache", p->state) >= (int)sizeof(p->cache) ||
+                      (mkdir(p->cache, 0755) < 0 && errno != EEXIST))) {
+        fprintf(stderr, "pkg: cannot create %s: %s\n", p->cache, strerror(errno));
+        free(p);
+        free(units);
+        return -1;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    p->in_flight_max = workers * IN_FLIGHT_PER_WORKER;
+    p->remaining = count;
+
+    uint64_t start = pkg_now_ns();
+    pthread_mutex_lock(&p->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        units[i].record = records[i];
+        units[i].pending = 1;
+        units[i].job.unit = &units[i];
+        queue_job(p, &units[i].job, STAGE_FETCH);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    pthread_t* threads = calloc(workers, sizeof(pthread_t));
+    uint32_t started = 0;
+    while (threads && started < workers && pthread_create(&threads[started], NULL, pipeline_worker, p) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        pipeline_worker(p);
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+
+    p->stats.ns = pkg_now_ns() - start;
+    *stats = p->stats;
+    for (uint32_t i = 0; i < count; i++) {
+        installed[i] = units[i].done && !units[i].failed;
+        pkg_manifest_free(&units[i].manifest);
+        pkg_manifest_free(&units[i].old);
+        free(units[i].delta_files);
+        free(units[i].entries);
+        free(units[i].unpack_jobs);
+    }
+    for (uint32_t b = 0; b < CLAIM_BUCKETS; b++) {
+        while (p->claims[b]) {
+            claim_t* claim = p->claims[b];
+            p->claims[b] = claim->next;
+            free(claim);
+        }
+    }
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+    int result = stats->failed ? -1 : 0;
+    free(units);
+    free(p);
+    return result;
+}
@@ -9,27 +9,24 @@
 
 /* Generic shim implementation */
 static int generic_shim(const char* manager_name, int argc, char** argv) {
-    printf("[SHIM] %s", manager_name);
-    for (int i = 0; i < argc; i++) {
-        printf(" %s", argv[i]);
-    }
-    printf("\n");
-
     if (argc < 2) {
         printf("Usage: %s <command> [options] [packages]\n", manager_name);
         return 1;
     }
 
-    const char* action = argv[1];
-
-    printf("[INFO] Translating %s command to native package manager\n", manager_name);
-    printf("[INFO] Action: %s\n", action);
-
-    /* Phase 1: Just show what would be done */
-    printf("[TODO] Execute native package operation\n");
-    printf("[NOTE] Phase 1: Package management not yet implemented\n");
+    command_t* cmd = parse_command(argc, argv);
+    if (!cmd) {
+        return 1;
+    }
+    if (cmd->type == CMD_TYPE_UNKNOWN) {
+        printf("[ERROR] %s: unsupported action '%s'\n", manager_name, argv[1]);
+        free_command(cmd);
+        return 1;
+    }
 
-    return 0;
+    int result = execute_command(cmd);
+    free_command(cmd);
+    return result;
 }
 
 /* APT shim (Debian/Ubuntu) */
@@ -91,3 +88,8 @@ int shim_pip(int argc, char** argv) {
 int shim_cargo(int argc, char** argv) {
     return generic_shim("cargo", argc, argv);
 }
+
+/* Native package manager */
+int shim_limitless(int argc, char** argv) {
+    return generic_shim("limitless", argc, argv);
+}